@@ -87,6 +87,9 @@ enum
 namespace BPrivate {
 	class BMessageBody;
 }
+class	TCompactWriter;
+class	TCompactReader;
+class	TCompactNameTable;
 
 // BMessage class --------------------------------------------------------------
 class BMessage
@@ -317,7 +320,16 @@ virtual	void		_ReservedMessage3();
 
 		void		init_data();
 		status_t	flatten_hdr(BDataIO *stream) const;
-		status_t	unflatten_hdr(BDataIO *stream, bool& swap);
+		status_t	flatten_hdr(BDataIO *stream, int32 version,
+								ssize_t size) const;
+		status_t	unflatten_hdr(BDataIO *stream, bool& swap,
+								  bool& compact, ssize_t& body_size);
+		uint8		hdr_flags() const;
+		char		*compact_flatten(ssize_t *size, status_t *err) const;
+		status_t	compact_unflatten(const char *buffer, size_t size,
+									  bool swap);
+		void		compact_unflatten_body(TCompactReader& reader,
+										   TCompactNameTable& names);
 		status_t	flatten_target_info(BDataIO *stream,
 										ssize_t size,
 										uchar flags) const;
@@ -359,6 +371,7 @@ virtual	void		_ReservedMessage3();
 static	port_id		sReplyPorts[sNumReplyPorts];
 static	long		sReplyPortInUse[sNumReplyPorts];
 static	int32		sGetCachedReplyPort();
+static	bool		sCompactFormat;
 
 friend	int _init_message_();
 friend	int _delete_message_();
@@ -455,6 +468,7 @@ static	BBlockCache	*sMsgCache;
 		bool				fWasDelivered;
 		bool				fReadOnly;
 		bool				fHasSpecifiers;	
+		bool				fCompact;
 };
 
 //------------------------------------------------------------------------------
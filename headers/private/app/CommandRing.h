@@ -0,0 +1,73 @@
+//------------------------------------------------------------------------------
+//	File Name:		CommandRing.h
+//	Description:	Ring buffer in a shared area which carries link messages
+//					from a client to the server without a port write for each
+//					batch
+//
+//------------------------------------------------------------------------------
+#ifndef COMMANDRING_H
+#define COMMANDRING_H
+
+#include <OS.h>
+
+//! Bytes of messages a window's ring holds
+#define COMMAND_RING_SIZE		65536
+
+//! Environment variable which, set to 0, makes windows send their messages through their port
+#define COMMAND_RING_VARIABLE	"COSMOE_COMMAND_RING"
+
+struct command_ring_header;
+
+/*!
+	\class CommandRing CommandRing.h
+	\brief A ring of link message batches shared by one writer and one reader
+
+	The server creates the ring and the client clones its area. A batch, as
+	LinkMsgSender buffers it, is copied in with Write() and is read in place
+	with NextBatch() until Consume() gives its room back.
+
+	The reader only waits on its port once it has found the ring empty and
+	said so with Sleep(). The writer then sends it a single empty
+	AS_SERVER_AREALINK message as a doorbell; as long as the reader is busy,
+	writing a batch takes no system call at all. When the ring is full,
+	the writer waits on a semaphore which the reader releases as it makes
+	room.
+
+	The reader trusts nothing the writer put in the ring. If a batch doesn't
+	fit in what was written, the reader drops the ring: Write() then fails
+	with B_BAD_DATA, and both sides go back to the port.
+*/
+class CommandRing
+{
+public:
+	CommandRing(const char *name, size_t size = COMMAND_RING_SIZE);
+	CommandRing(area_id area);
+	~CommandRing(void);
+
+	status_t InitCheck(void) const;
+	area_id Area(void) const { return fArea; }
+
+	status_t Write(const void *data, int32 size, port_id doorbell,
+		bigtime_t timeout = B_INFINITE_TIMEOUT);
+
+	const char *NextBatch(int32 *size);
+	void Consume(void);
+	bool IsDropped(void) const { return fDropped; }
+
+	bool Sleep(void);
+	void Awake(void);
+
+private:
+	status_t WaitForRoom(int32 needed, port_id doorbell, bigtime_t timeout);
+	const char *Drop(void);
+
+	area_id fArea;
+	bool fOwner;
+	command_ring_header *fHeader;
+	char *fData;
+	int32 fSize;
+	int32 fBatchSize;
+	bool fDropped;
+};
+
+#endif
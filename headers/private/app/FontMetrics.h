@@ -0,0 +1,110 @@
+//------------------------------------------------------------------------------
+//	File Name:		FontMetrics.h
+//	Description:	Layout of the area in which the app_server publishes the
+//					installed fonts and their metrics.  Applications map it
+//					read-only, so BFont can measure text without asking the
+//					server every time.
+//------------------------------------------------------------------------------
+
+#ifndef FONTMETRICS_H
+#define FONTMETRICS_H
+
+// Standard Includes -----------------------------------------------------------
+
+// System Includes -------------------------------------------------------------
+
+// Project Includes ------------------------------------------------------------
+#include <Font.h>
+#include <SupportDefs.h>
+
+// Local Includes --------------------------------------------------------------
+
+// Local Defines ---------------------------------------------------------------
+#define FONT_METRICS_AREA_NAME		"font_metrics"
+#define FONT_METRICS_MAGIC			'FMTR'
+
+// Most font styles and (style, size) pairs which can be published
+#define FONT_METRICS_MAX_STYLES		256
+#define FONT_METRICS_MAX_TABLES		128
+// Kerning pairs shared by all tables
+#define FONT_METRICS_MAX_KERNING	16384
+
+// Metrics are kept for single bytes, as the server draws them
+#define FONT_METRICS_CHARS			256
+
+// Globals ---------------------------------------------------------------------
+
+// All values are in pixels at the table's size.  Bounds are relative to the
+// glyph's origin on the baseline, with y going down.
+struct font_metrics_glyph
+{
+	float				advance;
+	float				left;
+	float				top;
+	float				right;
+	float				bottom;
+};
+
+struct font_metrics_kerning
+{
+	uint8				left;
+	uint8				right;
+	float				amount;
+};
+
+// A table is written once, before it is counted in table_count, and is never
+// changed afterwards
+struct font_metrics_table
+{
+	uint16				family_id;
+	uint16				style_id;
+	float				size;
+	font_height			height;
+	int32				kerning_first;
+	int32				kerning_count;
+	uint8				has_glyph[FONT_METRICS_CHARS / 8];
+	font_metrics_glyph	glyphs[FONT_METRICS_CHARS];
+};
+
+struct font_metrics_style
+{
+	uint16				family_id;
+	uint16				style_id;
+	uint16				face;
+	uint32				flags;
+	font_family			family;
+	font_style			style;
+};
+
+struct font_metrics_system_font
+{
+	uint16				family_id;
+	uint16				style_id;
+	float				size;
+};
+
+// The font list and system fonts.  There are two of them: the server writes
+// a new one where the other is, then counts up the area's generation to make
+// it the current one.  Readers read the generation before and after they look
+// at the list, and start over if it changed.
+struct font_metrics_style_list
+{
+	int32					style_count;
+	font_metrics_system_font	plain;
+	font_metrics_system_font	bold;
+	font_metrics_system_font	fixed;
+	font_metrics_style		styles[FONT_METRICS_MAX_STYLES];
+};
+
+struct font_metrics_area
+{
+	uint32					magic;
+	vint32					generation;		// lists[generation & 1] is current
+	vint32					table_count;
+	int32					kerning_count;
+	font_metrics_style_list	lists[2];
+	font_metrics_table		tables[FONT_METRICS_MAX_TABLES];
+	font_metrics_kerning	kerning[FONT_METRICS_MAX_KERNING];
+};
+
+#endif	//FONTMETRICS_H
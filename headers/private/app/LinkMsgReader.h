@@ -30,6 +30,8 @@
 
 #include <OS.h>
 
+class CommandRing;
+
 class LinkMsgReader
 {
 public:
@@ -38,6 +40,7 @@ public:
 
 	virtual void SetPort(port_id port);
 	virtual port_id	GetPort(void);
+	void SetRing(CommandRing *ring);
 	
 	virtual status_t GetNextMessage(int32 *code, bigtime_t timeout = B_INFINITE_TIMEOUT);
 	virtual status_t Read(void *data, ssize_t size);
@@ -46,9 +49,12 @@ public:
 	{
 		return Read(data, sizeof(Type));
 	}
+	//! Size of the current message, header included
+	int32 MessageSize(void) const { return fReplySize; }
 	
 protected:
 	virtual status_t ReadFromPort(bigtime_t timeout);
+	status_t ReadFromRing(void);
 	virtual status_t AdjustReplyBuffer(bigtime_t timeout);
 	void ResetBuffer();
 	
@@ -66,6 +72,10 @@ protected:
 	int32	fReplySize;	//size of current reply message
 	
 	status_t fReadError;	//Read failed for current message
+
+	CommandRing *fRing;	//ring read before the port, if any
+	char	*fPortBuffer;	//fRecvBuffer while a batch is read in the ring
+	bool	fInRing;	//fRecvBuffer points in the ring
 };
 
 #endif
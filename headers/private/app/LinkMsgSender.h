@@ -30,6 +30,16 @@
 
 #include <OS.h>
 
+class CommandRing;
+
+//! What a LinkMsgSender sent since its statistics were last reset
+struct link_sender_stats
+{
+	int32 messages;
+	int32 bytes;
+	int32 flushes;	//port or ring writes
+};
+
 class LinkMsgSender
 {
 public:
@@ -47,6 +57,10 @@ public:
 
 	void SetPort(port_id port);
 	port_id	GetPort();
+	void SetRing(CommandRing *ring);
+	void SetFlushLatency(bigtime_t latency);
+	status_t FlushIfLate(void);
+	void GetStats(link_sender_stats *stats, bool reset = true);
 
 	status_t Attach(const void *data, ssize_t size);
 	status_t AttachString(const char *string);
@@ -57,6 +71,7 @@ public:
 
 protected:
 	status_t FlushCompleted(ssize_t newbuffersize);
+	status_t WriteToPort(bigtime_t timeout);
 	status_t AdjustReplyBuffer(bigtime_t timeout);
 	void ResetReplyBuffer();
 	
@@ -76,6 +91,12 @@ protected:
 	int32	fReplySize;	//size of current reply message
 	
 	status_t fWriteError;	//Attach failed for current message
+
+	CommandRing *fRing;	//ring written instead of the port, if any
+
+	bigtime_t fFlushLatency;	//longest a message stays buffered, 0 for no limit
+	bigtime_t fBatchStart;	//when the first buffered message was started
+	link_sender_stats fStats;
 };
 
 
@@ -77,7 +77,29 @@ class BLooperList
 			uint32		id;
 		};
 
+		// Lock-free validity registry.  Slots are never moved or freed, so
+		// a thread can look a looper up and pin it without taking fLock;
+		// RemoveLooper() waits for the pins to drain before it returns.
+		struct RegistrySlot
+		{
+			BLooper* volatile	looper;		// NULL if the slot was never used
+			vint32				id;			// 0 once the looper is removed
+			vint32				pins;
+		};
+
+		RegistrySlot*	AcquireLooper(const BLooper* l);
+		void			ReleaseLooper(RegistrySlot* slot);
+
 	private:
+		enum {
+			kFirstRegistrySize	= 64,
+			kMaxRegistryTables	= 16
+		};
+
+		RegistrySlot*	FindSlot(const BLooper* l);
+		void			RegisterLooper(BLooper* l);
+		void			UnregisterLooper(BLooper* l);
+
 		static	bool	EmptySlotPred(LooperData& Data);
 		struct FindLooperPred
 		{
@@ -109,9 +131,28 @@ class BLooperList
 		BLocker					fLock;
 		uint32					fLooperID;
 		std::vector<LooperData>	fData;
+
+		RegistrySlot* volatile	fRegistry[kMaxRegistryTables];
+		int32					fRegistryUsed[kMaxRegistryTables];
+		int32					fRegistryCount;
 };
 
 extern _IMPEXP_BE BLooperList gLooperList;
+
+// Keeps a looper from being deleted for the lifetime of the pin, without
+// locking gLooperList.
+class BLooperPin
+{
+	public:
+		BLooperPin(const BLooper* looper)
+			:	fSlot(gLooperList.AcquireLooper(looper)) {;}
+		~BLooperPin() { if (fSlot) gLooperList.ReleaseLooper(fSlot); }
+
+		bool IsValid() const { return fSlot != NULL; }
+
+	private:
+		BLooperList::RegistrySlot*	fSlot;
+};
 }
 
 
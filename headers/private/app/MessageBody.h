@@ -52,6 +52,9 @@
 
 enum { B_FLATTENABLE_TYPE = 'FLAT' };
 
+class TCompactWriter;
+class TCompactNameTable;
+
 namespace BPrivate {
 
 class BMessageBody
@@ -83,6 +86,8 @@ public:
 		status_t	Flatten(BDataIO *stream) const;
 		status_t	Unflatten(const char *flat_buffer);
 		status_t	Unflatten(BDataIO *stream);
+		void		FlattenCompact(TCompactWriter& writer,
+								   TCompactNameTable& names) const;
 
 // Removing data
 		status_t	RemoveData(const char *name, int32 index = 0);
@@ -109,6 +114,9 @@ public:
 private:
 		BMessageField*	FindData(const char *name, type_code type,
 								 status_t& err) const;
+		bool		FlattenCompactMessages(const BMessageField* field,
+										   TCompactWriter& writer,
+										   TCompactNameTable& names) const;
 
 		typedef std::map<std::string, BMessageField*>	TMsgDataMap;
 		TMsgDataMap	fData;
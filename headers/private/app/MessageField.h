@@ -31,11 +31,14 @@
 // Standard Includes -----------------------------------------------------------
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <new>
 #include <vector>
 #include <string>
 
 // System Includes -------------------------------------------------------------
 #include <Entry.h>
+#include <Messenger.h>
 #include <Path.h>
 #include <Point.h>
 #include <Rect.h>
@@ -54,6 +57,8 @@
 #define MSG_FLAG_FIXED_SIZE		0x04
 #define MSG_FLAG_SINGLE_ITEM	0x08
 #define MSG_FLAG_ALL			0x0F
+// compact format only: the items are messages flattened inline
+#define MSG_FLAG_NESTED_MESSAGE	0x10
 
 #define MSG_LAST_ENTRY			0x0
 
@@ -195,6 +200,9 @@ class BMessageFieldImpl : public BMessageField
 		virtual void		PrintDataItem(int32 index) const;
 
 	private:
+				size_t		DataSize() const;
+				uchar		FlattenFlags(size_t dataSize) const;
+
 		StorageType	fData;
 		size_t		fMaxSize;
 		uchar		fFlags;
@@ -216,28 +224,29 @@ ssize_t
 BMessageFieldImpl<T1, StoragePolicy, SizePolicy, PrintPolicy, FlattenPolicy, GetDataPolicy>::
 FlattenedSize() const
 {
+	size_t dataSize = DataSize();
+	uchar flags = FlattenFlags(dataSize);
+
 	// Mandatory stuff
 	ssize_t size = 1;						// field flags byte
 	size += sizeof (type_code);				// field type bytes
-	if (!(fFlags & MSG_FLAG_SINGLE_ITEM))	// item count byte
-		++size;
-	if (fFlags & MSG_FLAG_MINI_DATA)
+	if (flags & MSG_FLAG_MINI_DATA)
+	{
+		if (!(flags & MSG_FLAG_SINGLE_ITEM))
+			++size;							// item count byte
 		++size;								// data length byte for mini data
+	}
 	else
+	{
+		if (!(flags & MSG_FLAG_SINGLE_ITEM))
+			size += sizeof (int32);			// item count bytes
 		size += sizeof (size_t);			// data length bytes for maxi data
+	}
 	++size;									// name length byte
 	size += Name().length();				// name length
 
 	// data length and item size bytes
-	size += SizePolicy::Size(fData);
-	if (!SizePolicy::Fixed())
-	{
-		for (uint32 i = 0; i < fData.Size(); ++i)
-		{
-			size += SizePolicy::Padding(fData[i]);	// pad to 8-byte boundary
-			size += 4;								// item size bytes
-		}
-	}
+	size += dataSize;
 
 	return size;
 }
@@ -257,41 +266,37 @@ Flatten(BDataIO& stream) const
 {
 	status_t	err = B_OK;
 	type_code	type = Type();
-	uint8		count = fData.Size();
 	uint8		nameLen = Name().length();
-	size_t		size = SizePolicy::Size(fData);
+	size_t		size = DataSize();
+	uchar		flags = FlattenFlags(size);
 
-	// Calculate any necessary padding
-	if (!SizePolicy::Fixed())
-	{
-		for (uint32 i = 0; i < fData.Size(); ++i)
-		{
-			size += SizePolicy::Padding(fData[i]);	// pad to 8-byte boundary
-			size += 4;								// item size bytes
-		}
-	}
-	
-	err = stream.Write(&fFlags, sizeof (fFlags));
+	err = stream.Write(&flags, sizeof (flags));
 
 	// Field type_code
 	if (err >= 0)
 		err = stream.Write(&type, sizeof (type_code));
 
-	// Item count, if more than one
-	if (err >= 0 && !(fFlags & MSG_FLAG_SINGLE_ITEM))
-		err = stream.Write(&count, sizeof (count));
-
-	// Data length
+	// Item count, if more than one, and data length
 	if (err >= 0)
 	{
-		if (fFlags & MSG_FLAG_MINI_DATA)
+		if (flags & MSG_FLAG_MINI_DATA)
 		{
+			uint8 miniCount = fData.Size();
+			if (!(flags & MSG_FLAG_SINGLE_ITEM))
+				err = stream.Write(&miniCount, sizeof (miniCount));
+
 			uint8 miniSize = size;
-			err = stream.Write(&miniSize, sizeof (miniSize));
+			if (err >= 0)
+				err = stream.Write(&miniSize, sizeof (miniSize));
 		}
 		else
 		{
-			err = stream.Write(&size, sizeof (size));
+			int32 count = fData.Size();
+			if (!(flags & MSG_FLAG_SINGLE_ITEM))
+				err = stream.Write(&count, sizeof (count));
+
+			if (err >= 0)
+				err = stream.Write(&size, sizeof (size));
 		}
 	}
 
@@ -317,7 +322,7 @@ Flatten(BDataIO& stream) const
 		}
 		if (err >= 0)
 		{
-			err = stream.Write(&BMessageField::sNullData[size],
+			err = stream.Write(BMessageField::sNullData,
 							   SizePolicy::Padding(fData[i]));
 		}
 	}
@@ -336,6 +341,55 @@ template
 	class FlattenPolicy,
 	class GetDataPolicy
 >
+size_t
+BMessageFieldImpl<T1, StoragePolicy, SizePolicy, PrintPolicy, FlattenPolicy, GetDataPolicy>::
+DataSize() const
+{
+	size_t size = SizePolicy::Size(fData);
+
+	// Calculate any necessary padding
+	if (!SizePolicy::Fixed())
+	{
+		for (uint32 i = 0; i < fData.Size(); ++i)
+		{
+			size += SizePolicy::Padding(fData[i]);	// pad to 8-byte boundary
+			size += sizeof (int32);					// item size bytes
+		}
+	}
+
+	return size;
+}
+//------------------------------------------------------------------------------
+template
+<
+	class T1,
+	class StoragePolicy,
+	class SizePolicy,
+	class PrintPolicy,
+	class FlattenPolicy,
+	class GetDataPolicy
+>
+uchar
+BMessageFieldImpl<T1, StoragePolicy, SizePolicy, PrintPolicy, FlattenPolicy, GetDataPolicy>::
+FlattenFlags(size_t dataSize) const
+{
+	// Mini data needs both the item count and the whole data length (not
+	// just the largest item) to fit in a byte
+	uchar flags = fFlags;
+	if (fData.Size() > 255 || dataSize > 255)
+		flags &= ~MSG_FLAG_MINI_DATA;
+	return flags;
+}
+//------------------------------------------------------------------------------
+template
+<
+	class T1,
+	class StoragePolicy,
+	class SizePolicy,
+	class PrintPolicy,
+	class FlattenPolicy,
+	class GetDataPolicy
+>
 void 
 BMessageFieldImpl<T1, StoragePolicy, SizePolicy, PrintPolicy, FlattenPolicy, GetDataPolicy>::
 AddItem(const T1& data)
@@ -703,6 +757,27 @@ struct BMessageFieldFlattenPolicy<BDataBuffer>
 		return err;
 	}
 };
+//------------------------------------------------------------------------------
+template<>
+struct BMessageFieldFlattenPolicy<BMessenger>
+{
+	typedef BMessageFieldSizePolicy<BMessenger> SizePolicy;
+
+	static status_t Flatten(BDataIO& stream, const BMessenger& data)
+	{
+		// Only copy what the copy constructor does, so the reserved fields
+		// and padding go out as zeros instead of whatever they held
+		union { int64 align; char bytes[sizeof (BMessenger)]; } clean;
+		memset(clean.bytes, 0, sizeof (clean.bytes));
+		BMessenger* copy = new (clean.bytes) BMessenger(data);
+		status_t err = stream.Write(clean.bytes, SizePolicy::Size(data));
+		copy->~BMessenger();
+
+		if (err > 0)
+			err = B_OK;
+		return err;
+	}
+};
 // GetData policy specializations ----------------------------------------------
 template<>
 struct BMessageFieldGetDataPolicy<BDataBuffer>
@@ -7,6 +7,7 @@
 #define MESSAGEPRIVATE_H
 
 // Standard Includes -----------------------------------------------------------
+#include <stdlib.h>
 
 // System Includes -------------------------------------------------------------
 #include <Message.h>
@@ -52,6 +53,41 @@ class BMessage::Private
 		{
 			return fMessage->fPreferred;
 		}
+
+		// The compact ('FOB2') format shares one name table between a
+		// message and the messages nested in it, and packs its data with
+		// varint lengths.  Unflatten() reads both formats, but peers built
+		// before it was introduced only read the old one, so it is only sent
+		// when enabled for the team or when replying to a compact message.
+		// It is smaller but slower to flatten and unflatten than the old one.
+		inline status_t FlattenCompact(BDataIO* stream, ssize_t* size = NULL)
+		{
+			status_t err;
+			ssize_t len;
+			char* buffer = fMessage->compact_flatten(&len, &err);
+			if (!buffer)
+				return err;
+
+			err = stream->Write(buffer, len);
+			free(buffer);
+			if (err < B_OK)
+				return err;
+			if (size)
+				*size = len;
+			return B_OK;
+		}
+		inline bool IsCompact()
+		{
+			return fMessage->fCompact;
+		}
+		static inline void SetCompactFormat(bool compact)
+		{
+			BMessage::sCompactFormat = compact;
+		}
+		static inline bool UsesCompactFormat()
+		{
+			return BMessage::sCompactFormat;
+		}
 		
 	private:
 		BMessage*	fMessage;
@@ -7,6 +7,9 @@
 #define MESSAGEUTILS_H
 
 // Standard Includes -----------------------------------------------------------
+#include <string.h>
+#include <string>
+#include <vector>
 
 // System Includes -------------------------------------------------------------
 #include <ByteOrder.h>
@@ -36,6 +39,21 @@ size_t calc_padding(size_t size, size_t boundary);
 
 }	// namespace BPrivate
 
+class TCompactWriter;
+class TCompactReader;
+class TCompactNameTable;
+
+namespace BPrivate {
+
+// Convert between a message flattened in the old format (as nested messages
+// are stored) and the inline form nested messages take in the compact one
+bool compact_transcode(const char* flat, size_t size, TCompactWriter& writer,
+					   TCompactNameTable& names, int32 depth = 0);
+void compact_untranscode(TCompactReader& reader, TCompactNameTable& names,
+						 TCompactWriter& flat);
+
+}	// namespace BPrivate
+
 //------------------------------------------------------------------------------
 // _set_message_target_
 /*!	\brief Sets the target of a message.
@@ -119,9 +137,7 @@ class TReadHelper
 
 		template<class T> inline void operator()(T& data)
 		{
-			err = normalize_err(fStream->Read((void*)&data, sizeof (T)));
-			if (err)
-				throw err;
+			Read((void*)&data, sizeof (T));
 
 			if (IsSwapping())
 			{
@@ -131,9 +147,7 @@ class TReadHelper
 
 		template<class T> inline void operator()(T data, size_t len)
 		{
-			err = normalize_err(fStream->Read((void*)data, len));
-			if (err)
-				throw err;
+			Read((void*)data, len);
 		}
 
 		status_t	Status() { return err; }
@@ -141,6 +155,17 @@ class TReadHelper
 		bool		IsSwapping() { return fSwap; }
 
 	private:
+		inline void	Read(void* data, size_t len)
+		{
+			// Running out of data halfway through is as bad as an error
+			ssize_t bytesRead = fStream->Read(data, len);
+			err = normalize_err(bytesRead);
+			if (!err && (size_t)bytesRead != len)
+				err = B_BAD_DATA;
+			if (err)
+				throw err;
+		}
+
 		BDataIO*	fStream;
 		status_t	err;
 		bool		fSwap;
@@ -158,12 +183,172 @@ class TChecksumHelper
 		}
 
 		int32    CheckSum();
+		int32    CachedSize() const { return fBufPtr - fBuffer; }
 
 	private:
 		uchar*		fBuffer;
 		uchar*		fBufPtr;
 };
 //------------------------------------------------------------------------------
+// Output buffer for the compact ('FOB2') flattened format.  It grows as
+// needed; the inline writers throw B_NO_MEMORY like TReadHelper throws its
+// read errors, while the BDataIO interface (used for the message header)
+// reports them instead.
+class TCompactWriter : public BDataIO
+{
+	public:
+		TCompactWriter() : fBuffer(NULL), fSize(0), fCapacity(0) {;}
+		virtual ~TCompactWriter();
+
+		virtual	ssize_t	Read(void* buffer, size_t size);
+		virtual	ssize_t	Write(const void* buffer, size_t size);
+
+		inline void Put(const void* data, size_t len)
+		{
+			if (fSize + len > fCapacity)
+				Grow(len);
+			memcpy(fBuffer + fSize, data, len);
+			fSize += len;
+		}
+
+		template<class T> inline void operator()(const T& data)
+		{
+			Put((const void*)&data, sizeof (T));
+		}
+
+		// Type codes and the like always take four bytes, whatever the
+		// size of int32 on the host
+		inline void Put32(uint32 value)
+		{
+			unsigned int data = value;
+			Put((const void*)&data, 4);
+		}
+
+		inline void PutVarInt(uint32 value)
+		{
+			if (fSize + 5 > fCapacity)
+				Grow(5);
+			while (value >= 0x80)
+			{
+				fBuffer[fSize++] = (char)(value | 0x80);
+				value >>= 7;
+			}
+			fBuffer[fSize++] = (char)value;
+		}
+
+		char*		Buffer() const { return fBuffer; }
+		size_t		Size() const { return fSize; }
+		void		Truncate(size_t size) { if (size < fSize) fSize = size; }
+		char*		Detach();
+
+	private:
+		void		Grow(size_t len);
+
+		char*		fBuffer;
+		size_t		fSize;
+		size_t		fCapacity;
+};
+//------------------------------------------------------------------------------
+// Bounds-checked reader for the compact format; throws B_BAD_DATA when the
+// buffer runs out.
+class TCompactReader
+{
+	public:
+		TCompactReader(const char* buffer, size_t size, bool swap)
+			:	fPos(buffer), fEnd(buffer + size), fSwap(swap), fDepth(0)
+		{
+			;
+		}
+
+		inline const char* Get(size_t len)
+		{
+			if ((size_t)(fEnd - fPos) < len)
+				throw (status_t)B_BAD_DATA;
+			const char* data = fPos;
+			fPos += len;
+			return data;
+		}
+
+		template<class T> inline void operator()(T& data)
+		{
+			memcpy((void*)&data, Get(sizeof (T)), sizeof (T));
+			if (fSwap)
+			{
+				byte_swap(data);
+			}
+		}
+
+		inline uint32 Get32()
+		{
+			unsigned int data;
+			memcpy((void*)&data, Get(4), 4);
+			if (fSwap)
+			{
+				data = (data >> 24) | ((data >> 8) & 0xff00) |
+					   ((data << 8) & 0xff0000) | (data << 24);
+			}
+			return data;
+		}
+
+		inline int32 GetSigned32()
+		{
+			return (int)Get32();
+		}
+
+		inline uint32 GetVarInt()
+		{
+			uint32 value = 0;
+			for (int shift = 0; shift < 35; shift += 7)
+			{
+				if (fPos >= fEnd)
+					throw (status_t)B_BAD_DATA;
+				uint8 byte = (uint8)*fPos++;
+				value |= (uint32)(byte & 0x7f) << shift;
+				if (!(byte & 0x80))
+					return value;
+			}
+			throw (status_t)B_BAD_DATA;
+		}
+
+		// Nested messages are decoded recursively; don't let a bogus
+		// buffer take the stack with it
+		inline void EnterMessage()
+		{
+			if (++fDepth > 64)
+				throw (status_t)B_BAD_DATA;
+		}
+		inline void LeaveMessage() { --fDepth; }
+
+		bool		IsSwapping() const { return fSwap; }
+
+	private:
+		const char*	fPos;
+		const char*	fEnd;
+		bool		fSwap;
+		int32		fDepth;
+};
+//------------------------------------------------------------------------------
+// Field names of a compact message and all the messages nested in it; each
+// distinct name is stored once and referred to by index.
+class TCompactNameTable
+{
+	public:
+		uint32		IndexOf(const char* name, size_t length);
+		uint32		IndexOf(const std::string& name)
+						{ return IndexOf(name.data(), name.length()); }
+		void		Flatten(TCompactWriter& writer) const;
+		void		Unflatten(TCompactReader& reader);
+		const char*	NameAt(uint32 index) const;
+
+	private:
+		void		Rehash(uint32 size);
+
+		// Open addressing over fNames, so that looking up a name which is
+		// already there allocates nothing; a slot holds its index plus one.
+		std::vector<uint32>			fSlots;
+		std::vector<std::string>	fNames;
+};
+//------------------------------------------------------------------------------
 template<class T> inline status_t read_helper(BDataIO* stream, T& data)
 {
 	return normalize_err(stream->Read((void*)&data, sizeof (T)));
@@ -32,6 +32,8 @@
 #include <LinkMsgReader.h>
 #include <LinkMsgSender.h>
 
+class CommandRing;
+
 /*
 	Error checking rules: (for if you don't want to check every return code)
 	
@@ -61,6 +63,10 @@ public:
 	
 	void SetSendPort(port_id port);
 	port_id	GetSendPort();
+	status_t SetSendRing(area_id area);
+	void SetFlushLatency(bigtime_t latency);
+	status_t FlushIfLate(void);
+	void GetStats(link_sender_stats *stats, bool reset = true);
 	void SetReplyPort(port_id port);
 	port_id	GetReplyPort();
 
@@ -78,10 +84,12 @@ public:
 	{
 		return fReader->Read(data,sizeof(T));
 	}
+	int32 MessageSize(void) const { return fReader->MessageSize(); }
 	
 protected:
 	LinkMsgReader *fReader;
 	LinkMsgSender *fSender;
+	CommandRing *fRing;
 };
 
 #endif
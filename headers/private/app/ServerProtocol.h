@@ -94,6 +94,7 @@ AS_UPDATED_CLIENT_FONTLIST,
 AS_GET_FAMILY_ID,
 AS_GET_STYLE_ID,
 AS_GET_STYLE_FOR_FACE,
+AS_GET_FONT_METRICS,
 
 // This will be modified. Currently a kludge for the input server until
 // BScreens are implemented by the IK Taeam
@@ -245,7 +246,12 @@ AS_LAYER_SET_FONT_STATE,
 AS_LAYER_GET_STATE,
 AS_LAYER_SET_VIEW_IMAGE,
 AS_LAYER_SET_PATTERN,
-AS_SET_CURRENT_LAYER
+AS_SET_CURRENT_LAYER,
+
+// Message profiles, when COSMOE_PROFILE is set. New codes go at the end so
+// that recorded sessions keep their meaning.
+AS_GET_PROFILE,
+AS_DUMP_PROFILE
 };
 
 #define AS_PATTERN_SIZE 8
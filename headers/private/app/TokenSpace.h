@@ -7,8 +7,6 @@
 #define TOKENSPACE_H
 
 // Standard Includes -----------------------------------------------------------
-#include <map>
-#include <stack>
 
 // System Includes -------------------------------------------------------------
 #include <BeBuild.h>
@@ -53,18 +51,36 @@ class BTokenSpace
 //		BDirectMessageTarget* TokenTarget(uint32 token, int16 type);
 
 	private:
+		// A token is the slot index in its low kIndexBits and the slot's
+		// generation above that, so a stale token never matches a reused
+		// slot.  Slots live in fixed-size slabs that are never freed, which
+		// lets CheckToken() and GetToken() run without taking fLocker.
+		enum {
+			kIndexBits		= 20,
+			kIndexMask		= (1 << kIndexBits) - 1,
+			kGenerationMask	= 0x7ff,
+			kSlabBits		= 10,
+			kSlabSize		= 1 << kSlabBits,
+			kMaxSlabs		= 1 << (kIndexBits - kSlabBits)
+		};
+
 		struct TTokenInfo
 		{
-			int16 type;
-			void* object;
+			vint32	token;		// B_NULL_TOKEN while the slot is free
+			int16	type;
+			void*	object;
+			int32	generation;
+			int32	nextFree;
 		};
 
-		typedef std::map<int32, TTokenInfo>	TTokenMap;
+		TTokenInfo*	_Slot(int32 index) const;
+		bool		_Lookup(int32 token, int16* type, void** object) const;
 
-		TTokenMap			fTokenMap;
-		std::stack<int32>	fTokenBin;
-		int32				fTokenCount;
-		BLocker				fLocker;
+		TTokenInfo* volatile	fSlabs[kMaxSlabs];
+		int32					fSlabCount;
+		int32					fFirstFree;
+		int32					fTokenCount;
+		BLocker					fLocker;
 };
 
 // Possible expansion
@@ -22,7 +22,8 @@
 //	File Name:		BitmapManager.h
 //	Author:			DarkWyrm <bpmagic@columbus.rr.com>
 //	Description:	Handler for allocating and freeing area memory for BBitmaps 
-//					on the server side. Utilizes the BGET pool allocator.
+//					on the server side. Small bitmaps share areas by size class,
+//					large ones get an area each.
 //------------------------------------------------------------------------------
 #ifndef BITMAP_MANAGER_H_
 #define BITMAP_MANAGER_H_
@@ -34,15 +35,47 @@
 #include "TokenHandler.h"
 
 class ServerBitmap;
-class AreaPool;
+struct bitmap_slab;
+struct bitmap_team;
+
+//! Environment variable which limits the bitmap memory of each team, in kilobytes. 0 means no limit.
+#define BITMAP_TEAM_LIMIT_VARIABLE		"COSMOE_BITMAP_TEAM_LIMIT"
+
+//! Kilobytes of bitmap memory a team may use when BITMAP_TEAM_LIMIT_VARIABLE is not set
+#define BITMAP_TEAM_LIMIT_DEFAULT_KB	262144
+
+//! Largest bitmap, in bytes, which shares an area with others
+#define BITMAP_MAX_SMALL_SIZE			131072
+
+//! Number of size classes small bitmaps are sorted in
+#define BITMAP_SIZE_CLASSES				33
+
+typedef struct
+{
+	int32 bitmaps;		// bitmaps allocated
+	int32 areas;		// areas holding them
+	int64 used;			// bytes the bitmaps need
+	int64 reserved;		// bytes of the areas, free space included
+	int32 failures;		// allocations refused for lack of memory or over a team's limit
+} bitmap_manager_stats;
 
 /*!
 	\class BitmapManager BitmapManager.h
 	\brief Handler for BBitmap allocation
-	
-	Whenever a ServerBitmap associated with a client-side BBitmap needs to be 
-	created or destroyed, the BitmapManager needs to handle it. It takes care of 
+
+	Whenever a ServerBitmap associated with a client-side BBitmap needs to be
+	created or destroyed, the BitmapManager needs to handle it. It takes care of
 	all memory management related to them.
+
+	Bitmaps up to BITMAP_MAX_SMALL_SIZE bytes are rounded up to a size class
+	and get a slot in an area shared by bitmaps of the same class. Taking and
+	giving back a slot costs the same however many bitmaps there are, and
+	since all slots of an area have the same size, it never fragments. Larger
+	bitmaps get an area of their own, which is deleted along with them.
+
+	The memory of each team is counted and limited. Areas left empty are given
+	back, except for one for each size class, which ReleaseUnusedMemory() gives
+	back as well.
 */
 class BitmapManager
 {
@@ -50,15 +83,27 @@ public:
 	BitmapManager(void);
 	~BitmapManager(void);
 	ServerBitmap *CreateBitmap(BRect bounds, color_space space, int32 flags,
-		int32 bytes_per_row=-1, screen_id screen=B_MAIN_SCREEN_ID);
+		int32 bytes_per_row=-1, screen_id screen=B_MAIN_SCREEN_ID,
+		team_id team=-1);
 	void DeleteBitmap(ServerBitmap *bitmap);
+
+	void ReleaseUnusedMemory(void);
+	void SetTeamLimit(int64 bytes);
+	int64 TeamUsage(team_id team);
+	void GetStats(bitmap_manager_stats *stats);
 protected:
+	bool AllocateSmall(ServerBitmap *bitmap, int32 sizeclass);
+	bool AllocateLarge(ServerBitmap *bitmap, size_t size);
+	void FreeSlab(bitmap_slab *slab);
+	bitmap_team *FindTeam(team_id team, bool create);
+
 	BList *bmplist;
-	area_id bmparea;
-	int8 *buffer;
 	TokenHandler tokenizer;
 	sem_id lock;
-	AreaPool *fMemPool;
+	BList fPartialSlabs[BITMAP_SIZE_CLASSES];
+	BList fTeams;
+	int64 fTeamLimit;
+	bitmap_manager_stats fStats;
 };
 
 extern BitmapManager *bitmapmanager;
@@ -0,0 +1,87 @@
+//------------------------------------------------------------------------------
+//
+//	File Name:		ClipRects.h
+//	Description:	The rectangles of a clipping region which meet a shape,
+//					with a quick lookup of those on a row
+//
+//------------------------------------------------------------------------------
+#ifndef CLIPRECTS_H_
+#define CLIPRECTS_H_
+
+#include <Rect.h>
+#include <Region.h>
+
+/*!
+	\class ClipRects ClipRects.h
+	\brief The rectangles of a region which a shape can touch
+
+	A region keeps its rectangles in order by their tops. Only those which
+	meet the bounds of whatever is drawn are kept, so a shape in one corner of
+	a window which is partly covered doesn't look at the rest. Rows are found
+	with a binary search when there are many rectangles, and the last row
+	found is remembered because shapes are drawn from the top down. The list
+	keeps its memory from one shape to the next.
+*/
+class ClipRects
+{
+public:
+	ClipRects(void);
+	~ClipRects(void);
+
+	void Set(const BRegion *clip, const BRect &bounds);
+	void Set(const BRegion *clip, const clipping_rect &bounds);
+
+	const clipping_rect &Bounds(void) const { return fBounds; }
+	int32 CountRects(void) const { return fCount; }
+	const clipping_rect &RectAtInt(int32 index) const { return fRects[index]; }
+	BRect RectAt(int32 index) const;
+
+	inline int32 FindRows(int32 top, int32 bottom, int32 *first);
+	inline int32 FindRow(int32 y, int32 *first);
+
+private:
+	int32 Search(int32 top, int32 bottom, int32 *first) const;
+	bool Grow(void);
+
+	clipping_rect fBounds;
+	clipping_rect *fRects;
+	// how far down the rectangles up to each one in the list reach
+	int32 *fReach;
+	int32 fCount;
+	int32 fSize;
+
+	int32 fRowTop;
+	int32 fRowBottom;
+	int32 fRowFirst;
+	int32 fRowEnd;
+};
+
+/*!
+	\brief Finds the rectangles which may meet some rows
+	\param top First row
+	\param bottom Last row
+	\param first Set to the index of the first rectangle to look at
+	\return One past the index of the last rectangle to look at
+
+	The rectangles between the two still have to be checked, but none
+	outside them meets the rows.
+*/
+int32 ClipRects::FindRows(int32 top, int32 bottom, int32 *first)
+{
+	if(top!=fRowTop || bottom!=fRowBottom)
+	{
+		fRowEnd=Search(top,bottom,&fRowFirst);
+		fRowTop=top;
+		fRowBottom=bottom;
+	}
+	*first=fRowFirst;
+	return fRowEnd;
+}
+
+//! Finds the rectangles which may meet a row, as FindRows does
+int32 ClipRects::FindRow(int32 y, int32 *first)
+{
+	return FindRows(y,y,first);
+}
+
+#endif
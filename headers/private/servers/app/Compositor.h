@@ -0,0 +1,41 @@
+//------------------------------------------------------------------------------
+//	File Name:		Compositor.h
+//	Description:	Span functions which apply a drawing mode to a row of
+//					pixels, one for each mode and depth
+//
+//------------------------------------------------------------------------------
+#ifndef COMPOSITOR_H_
+#define COMPOSITOR_H_
+
+#include <GraphicsDefs.h>
+#include <SupportDefs.h>
+
+//! Everything a drawing mode needs besides the pixels
+struct compositor_state
+{
+	rgb_color high;
+	rgb_color low;
+};
+
+/*
+	A compositor draws count pixels of a source row onto a row of the target.
+	Source pixels are always B_RGBA32, in memory order blue, green, red,
+	alpha. high, if not NULL, has a byte for each pixel which is nonzero where
+	the pixel comes from the high color of a pattern. Modes which only draw
+	the high color, like B_OP_OVER, leave the other pixels alone. A NULL high
+	counts every pixel as high.
+
+	get_compositor() picks the function once for a primitive, so neither the
+	mode nor the depth is looked at per pixel. It returns NULL for depths it
+	doesn't handle.
+*/
+typedef void (*compositor_func)(uint8 *dest, const uint8 *src,
+	const uint8 *high, int32 count, const compositor_state *state);
+
+compositor_func get_compositor(drawing_mode mode, source_alpha alphasrc,
+	alpha_function alphafunc, int32 bitsperpixel);
+
+void compositor_pattern_row(uint8 *src, uint8 *high, int32 count,
+	uint8 patternrow, int32 phase, rgb_color highcolor, rgb_color lowcolor);
+
+#endif
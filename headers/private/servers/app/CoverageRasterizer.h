@@ -0,0 +1,204 @@
+//------------------------------------------------------------------------------
+//
+//	File Name:		CoverageRasterizer.h
+//	Description:	Anti-aliased scanline rasterizer for paths, and the
+//					flattening and stroking which turn lines, shapes and
+//					Bézier curves into paths it can fill
+//
+//------------------------------------------------------------------------------
+#ifndef COVERAGERASTERIZER_H_
+#define COVERAGERASTERIZER_H_
+
+#include <Rect.h>
+#include <InterfaceDefs.h>
+#include "ShapeRasterizer.h"
+
+//! Set to 0 to draw polygons, shapes and thick lines without anti-aliasing
+#define ANTIALIAS_VARIABLE		"COSMOE_ANTIALIAS"
+
+//! Which parts of a path which crosses itself are inside it
+enum fill_rule
+{
+	FILL_NONZERO=0,		// points the path winds around at all
+	FILL_EVEN_ODD		// points the path winds around an odd number of times
+};
+
+/*!
+	\class CoverageRasterizer CoverageRasterizer.h
+	\brief Works out how much of each pixel a path covers
+
+	The edges of the path are cut at pixel boundaries and each piece adds
+	to the pixel it is in how much of it lies right of the piece and how far
+	the piece goes up or down. Going along a row from the left and summing
+	gives the coverage of each pixel, so a pixel costs something only if an
+	edge goes through it and the rest of a row is drawn as runs.
+
+	Points are in the frame buffer, with whole numbers at pixel centers.
+	Subpaths don't have to be closed; they are closed when the next one is
+	started and when the path is rendered.
+*/
+class CoverageRasterizer
+{
+public:
+	CoverageRasterizer(void);
+	~CoverageRasterizer(void);
+
+	void Reset(const BRect &clip);
+	void Reset(void);
+	void SetFillRule(fill_rule rule) { fFillRule=rule; }
+	void SetAntialiasing(bool antialias) { fAntialias=antialias; }
+
+	void MoveTo(const BPoint &pt);
+	void LineTo(const BPoint &pt);
+	void ClosePath(void);
+	void AddPolygon(const BPoint *points, int32 count, bool orient=false);
+
+	void Render(SpanList &spans, BRegion *clip=NULL);
+
+	//! The pixels the last rendered path touched. Invalid if it was empty.
+	BRect Bounds(void) const { return fBounds; }
+	int32 CountCells(void) const { return fCellCount; }
+
+private:
+	struct cell
+	{
+		int32 x;
+		int32 y;
+		int32 cover;
+		int32 area;
+	};
+
+	struct coverage_span
+	{
+		int32 y;
+		int32 left;
+		int32 right;
+		int32 offset;	// into fCoverage, -1 if fully covered
+	};
+
+	void ClipLine(double x1, double y1, double x2, double y2);
+	void RenderLine(int32 x1, int32 y1, int32 x2, int32 y2);
+	void RenderHLine(int32 ey, int32 x1, int32 y1, int32 x2, int32 y2);
+	inline void SetCell(int32 x, int32 y);
+	void FlushCell(void);
+	bool SortCells(void);
+	int32 Alpha(int32 area) const;
+	void AddRun(int32 y, int32 left, int32 right, int32 alpha);
+	void AddPixel(int32 y, int32 x, int32 alpha);
+
+	cell *fCells;
+	int32 fCellCount;
+	int32 fCellSize;
+	cell *fSorted;
+	int32 fSortedSize;
+	int32 *fRows;
+	int32 fRowSize;
+
+	cell fCell;
+
+	// the clipping box in subpixels, left and top in, right and bottom out
+	double fClipLeft;
+	double fClipTop;
+	double fClipRight;
+	double fClipBottom;
+
+	double fStartX;
+	double fStartY;
+	double fLastX;
+	double fLastY;
+	bool fOpen;
+
+	fill_rule fFillRule;
+	bool fAntialias;
+	BRect fBounds;
+
+	coverage_span *fSpans;
+	int32 fSpanCount;
+	int32 fSpanSize;
+	uint8 *fCoverage;
+	int32 fCoverageCount;
+	int32 fCoverageSize;
+};
+
+/*!
+	\class PathBuilder CoverageRasterizer.h
+	\brief Turns lines, Bézier curves and BShape data into polylines
+
+	Curves are cut into enough straight pieces that none is more than a
+	tenth of a pixel off.
+*/
+class PathBuilder
+{
+public:
+	PathBuilder(void);
+	~PathBuilder(void);
+
+	void Reset(void);
+	void MoveTo(const BPoint &pt);
+	void LineTo(const BPoint &pt);
+	void BezierTo(const BPoint *points);
+	void Close(void);
+	status_t AddShape(int32 opcount, const int32 *oplist, int32 ptcount,
+		const BPoint *ptlist);
+
+	int32 CountPaths(void) const { return fPathCount; }
+	const BPoint *PathAt(int32 index, int32 *count, bool *closed) const;
+
+	void Fill(CoverageRasterizer &rasterizer) const;
+
+private:
+	struct subpath
+	{
+		int32 start;
+		int32 count;
+		bool closed;
+	};
+
+	bool AddPoint(const BPoint &pt);
+
+	BPoint *fPoints;
+	int32 fPointCount;
+	int32 fPointSize;
+	subpath *fPaths;
+	int32 fPathCount;
+	int32 fPathSize;
+};
+
+/*!
+	\class PathStroker CoverageRasterizer.h
+	\brief Adds the outline a pen draws along polylines to a rasterizer
+
+	The outline is made of a quadrilateral for each segment and the pieces
+	its caps and joins add, all wound the same way, so the rasterizer has to
+	use FILL_NONZERO. Cap and join modes are those of BView::SetLineMode().
+	Whatever the join mode, joins sharper than the miter limit are beveled.
+*/
+class PathStroker
+{
+public:
+	PathStroker(CoverageRasterizer &rasterizer, float pensize, cap_mode cap,
+		join_mode join, float miterLimit);
+	~PathStroker(void);
+
+	void Stroke(const BPoint *points, int32 count, bool closed);
+	void Stroke(const PathBuilder &path);
+
+private:
+	void AddSegment(const BPoint &from, const BPoint &to);
+	void AddJoin(const BPoint &pt, const BPoint &in, const BPoint &out);
+	void AddCap(const BPoint &pt, const BPoint &dir);
+	void AddFan(const BPoint &center, const BPoint &from, double angle);
+	void AddCircle(const BPoint &center);
+
+	CoverageRasterizer &fRasterizer;
+	double fHalfWidth;
+	cap_mode fCap;
+	join_mode fJoin;
+	float fMiterLimit;
+	int32 fCircleSteps;
+
+	BPoint *fVertices;
+	int32 fVertexSize;
+};
+
+#endif
@@ -36,6 +36,7 @@
 #include <View.h>
 #include <Font.h>
 #include <Rect.h>
+#include <List.h>
 #include <Locker.h>
 #include <Screen.h>
 #include "RGBColor.h"
@@ -45,6 +46,9 @@
 #include "DisplaySupport.h"
 #include "LayerData.h"
 #include "ServerBitmap.h"
+#include "ShapeRasterizer.h"
+#include "CoverageRasterizer.h"
+#include "ClipRects.h"
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
@@ -127,6 +131,9 @@ public:
 	void DrawBitmap(BRegion *region, ServerBitmap *bitmap, const BRect &source, const BRect &dest, const DrawData *d);
 		// one more:
 	void CopyRegionList(BList* list, BList* pList, int32 rCount, BRegion* clipReg);
+	void SaveRegion(BRegion *region, ServerBitmap *bitmap, const BPoint &origin);
+	void RestoreRegion(BRegion *region, ServerBitmap *bitmap, const BPoint &origin);
+	void DrawPixels(BRegion *region, ServerBitmap *bitmap, const BPoint &origin);
 
 	void FillArc(const BRect &r, const float &angle, const float &span, const RGBColor &color);
 	void FillArc(const BRect &r, const float &angle, const float &span, const DrawData *d);
@@ -142,6 +149,8 @@ public:
 	void FillRegion(BRegion &r, const DrawData *d);
 	void FillRoundRect(const BRect &r, const float &xrad, const float &yrad, const RGBColor &color);
 	void FillRoundRect(const BRect &r, const float &xrad, const float &yrad, const DrawData *d);
+	void FillSpans(const shape_span *spans, int32 count, int32 dx, int32 dy,
+		const BRect &bounds, const DrawData *d);
 	void FillShape(const BRect &bounds, const int32 &opcount, const int32 *oplist, 
 			const int32 &ptcount, const BPoint *ptlist, const DrawData *d);
 	void FillTriangle(BPoint *pts, const BRect &bounds, const RGBColor &color);
@@ -213,6 +222,7 @@ public:
 	virtual bool DumpToFile(const char *path);
 	virtual ServerBitmap *DumpToBitmap(void);
 	virtual void InvertRect(const BRect &r);
+	virtual void Sync(void);
 	virtual void StrokeLineArray(const int32 &numlines, const LineArrayData *data, const DrawData *d);
 
 	virtual status_t SetDPMSMode(const uint32 &state);
@@ -239,8 +249,9 @@ friend class CursorHandler;
 
 	// Blit functions specific to FreeType2 glyph copying. These probably could be replaced with
 	// more generic functions, but these are written and can be replaced later.
-	void BlitMono2RGB32(FT_Bitmap *src, const BPoint &pt, const DrawData *d);
-	void BlitGray2RGB32(FT_Bitmap *src, const BPoint &pt, const DrawData *d);
+	void BlitMono2RGB32(FT_Bitmap *src, const BPoint &pt, const clipping_rect &clip, const DrawData *d);
+	void BlitGray2RGB32(FT_Bitmap *src, const BPoint &pt, const clipping_rect &clip, const DrawData *d);
+	void DrawGlyph(FT_Bitmap *src, const BPoint &pt, bool antialias, BRegion *clip, const DrawData *d);
 	
 	// Two functions for gaining direct access to the framebuffer of a child class. This removes the need
 	// for a set of glyph-blitting virtual functions for each driver.
@@ -265,9 +276,10 @@ friend class CursorHandler;
 	virtual void StrokeSolidLine(int32 x1, int32 y1, int32 x2, int32 y2, const RGBColor &color);
 	virtual void StrokePatternLine(int32 x1, int32 y1, int32 x2, int32 y2, const DrawData *d);
 	virtual void StrokeSolidRect(const BRect &rect, const RGBColor &color);
+	virtual void FillSolidSpans(const shape_span *spans, int32 count, const RGBColor &color);
+	virtual void FillPatternSpans(const shape_span *spans, int32 count, const DrawData *d);
 	virtual void CopyBitmap(ServerBitmap *bitmap, const BRect &source, const BRect &dest, const DrawData *d);
 	virtual void CopyToBitmap(ServerBitmap *target, const BRect &source);
-		// temporarily virtual - until clipping code is added in DisplayDriver
 	virtual	void ConstrainClippingRegion(BRegion *reg);
 
 	PatternHandler fDrawPattern;
@@ -287,6 +299,29 @@ friend class CursorHandler;
 	display_mode fDisplayMode;
 	
 	CursorHandler *fCursorHandler;
+
+	// Spans of the shape being drawn, which the drawing calls share
+	SpanList fSpans;
+	void DrawSpans(const BRect &bounds, const RGBColor &color);
+	void DrawSpans(const BRect &bounds, const DrawData *d);
+
+	// Where the server's own drawing may go, a clip_constraint for each
+	// thread which set one, and the rectangles of a clipping region which
+	// the rectangle, line or glyph being drawn meets
+	BList fConstraints;
+	ClipRects fClipRects;
+	BRegion *ClippingRegion(const DrawData *d);
+	void FillClipped(const clipping_rect &rect, const RGBColor *color, const DrawData *d);
+	void StrokeClippedLine(const BPoint &start, const BPoint &end, BRegion *clip,
+		const RGBColor *color, const DrawData *d);
+
+	// Anti-aliased paths for polygons, shapes, curves and thick lines
+	CoverageRasterizer fRasterizer;
+	PathBuilder fPath;
+	bool fAntialias;
+	void StartPath(const DrawData *d, fill_rule rule);
+	void DrawPath(const RGBColor &color);
+	void DrawPath(const DrawData *d);
 	
 //	BRect oldcursorframe, cursorframe, saveframe;
 	DrawData fDrawData;
@@ -0,0 +1,114 @@
+//------------------------------------------------------------------------------
+//	File Name:		FontCache.h
+//	Description:	Server-wide cache of open font faces and rendered glyphs
+//
+//------------------------------------------------------------------------------
+#ifndef FONTCACHE_H_
+#define FONTCACHE_H_
+
+#include <OS.h>
+#include <SupportDefs.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+class FontStyle;
+
+//! Default number of bytes the glyph cache may use
+#define DEFAULT_GLYPH_CACHE_BUDGET	(2 * 1024 * 1024)
+
+//! Most faces kept open at once. Each (style, size) pair has its own face.
+#define MAX_CACHED_FACES			32
+
+//! How a glyph is rendered
+enum glyph_render_mode
+{
+	GLYPH_RENDER_GRAY=0,
+	GLYPH_RENDER_MONO
+};
+
+/*!
+	\class CachedGlyph FontCache.h
+	\brief A glyph as FreeType rendered it, kept by the FontCache
+
+	The bitmap's position is relative to the whole pixel the pen was in when
+	the glyph was rendered; the subpixel part of the pen position is part of
+	what the glyph is cached by.
+*/
+class CachedGlyph
+{
+public:
+	FT_Bitmap bitmap;
+	int32 left, top;
+	FT_Vector advance;
+	FT_Glyph_Metrics metrics;
+protected:
+	friend class FontCache;
+	CachedGlyph *hashnext, *lruprev, *lrunext;
+	FT_Face face;
+	uint32 charcode;
+	uint8 mode;
+	uint8 phasex, phasey;
+	FT_Matrix matrix;
+	uint32 hash;
+	size_t memsize;
+};
+
+/*!
+	\class FontCache FontCache.h
+	\brief Keeps font faces open and glyphs rendered between string calls
+
+	Opening a face and rendering its glyphs for every string made text the
+	most expensive thing the server drew. Faces are kept by style and size,
+	and rendered glyphs by face, character, render mode, transformation and
+	subpixel pen position, least recently used first out once the glyphs go
+	over the memory budget. Drawing text that was drawn before does not call
+	FreeType at all.
+
+	The cache must be locked while faces and glyphs from it are used. A glyph
+	is only good until the next call to GetGlyph().
+*/
+class FontCache
+{
+public:
+	FontCache(size_t budget=DEFAULT_GLYPH_CACHE_BUDGET);
+	~FontCache(void);
+	void Lock(void);
+	void Unlock(void);
+	FT_Face GetFace(FontStyle *style, float size);
+	CachedGlyph *GetGlyph(FT_Face face, uint32 charcode, glyph_render_mode mode,
+		const FT_Matrix *matrix, const FT_Vector &pen);
+	void RemoveStyle(FontStyle *style);
+	void SetBudget(size_t budget);
+	/*!
+		\brief Returns the number of bytes the glyph cache may use
+	*/
+	size_t Budget(void) const { return fBudget; }
+	/*!
+		\brief Returns the number of bytes the glyph cache uses
+	*/
+	size_t Usage(void) const { return fUsage; }
+protected:
+	struct face_entry
+	{
+		FontStyle *style;
+		int32 size;
+		FT_Face face;
+		face_entry *next;
+	};
+
+	void _RemoveFace(face_entry *entry);
+	void _RemoveGlyph(CachedGlyph *glyph);
+	void _RemoveGlyphs(FT_Face face);
+	void _Trim(size_t budget);
+
+	sem_id fLock;
+	face_entry *fFaces;
+	int32 fFaceCount;
+	CachedGlyph **fTable;
+	CachedGlyph *fLRUHead, *fLRUTail;
+	size_t fBudget, fUsage;
+};
+
+extern FontCache *fontcache;
+
+#endif
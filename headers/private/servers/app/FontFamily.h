@@ -119,6 +119,12 @@ public:
 	uint16 CharMapCount(void) { return charmapcount; }
 	const char *Name(void);
 	FontFamily *Family(void) { return family; }
+/*!
+	\fn uint16 FontStyle::GetID(void)
+	\brief Returns the style's ID, unique within its family
+	\return The style's ID
+*/
+	uint16 GetID(void) { return id; }
 
 	// TODO: Re-enable when I understand how the FT2 Cache system changed from
 	// 2.1.4 to 2.1.8
@@ -133,6 +139,7 @@ protected:
 	friend class FontFamily;
 	FontFamily *family;
 	uint16 glyphcount, charmapcount;
+	uint16 id;
 	BString *name, *path;
 	BList *instances;
 	bool is_fixedwidth, is_scalable, has_kerning, has_bitmaps;
@@ -152,18 +159,26 @@ protected:
 class FontFamily : public SharedObject
 {
 public:
-	FontFamily(const char *namestr);
+	FontFamily(const char *namestr, uint16 index);
 	~FontFamily(void);
 	const char *Name(void);
+/*!
+	\fn uint16 FontFamily::GetID(void)
+	\brief Returns the family's ID, unique within the font server
+	\return The family's ID
+*/
+	uint16 GetID(void) { return id; }
 	void AddStyle(const char *path, FT_Face face);
 	void RemoveStyle(const char *style);
 	bool HasStyle(const char *style);
 	int32 CountStyles(void);
 	const char *GetStyle(int32 index);
 	FontStyle *GetStyle(const char *style);
+	FontStyle *GetStyleByID(uint16 styleid);
 protected:
 	BString *name;
 	BList *styles;
+	uint16 id, nextstyleid;
 };
 
 #endif
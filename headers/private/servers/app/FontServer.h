@@ -34,6 +34,7 @@
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_CACHE_H
+#include <FontMetrics.h>
 
 class FontFamily;
 class FontStyle;
@@ -62,6 +63,8 @@ public:
 	status_t ScanDirectory(const char *path);
 	void SaveList(void);
 	FontStyle *GetStyle(font_family family, font_style face);
+	FontStyle *GetStyle(uint16 familyid, uint16 styleid);
+	int32 GetMetrics(uint16 familyid, uint16 styleid, float size);
 	ServerFont *GetSystemPlain(void);
 	ServerFont *GetSystemBold(void);
 	ServerFont *GetSystemFixed(void);
@@ -75,12 +78,18 @@ public:
 	void FontsUpdated(void) { need_update=false; }
 protected:
 	FontFamily *_FindFamily(const char *name);
+	FontFamily *_FindFamily(uint16 familyid);
 	FT_CharMap _GetSupportedCharmap(const FT_Face &face);
+	void _PublishStyles(void);
+	bool _PublishMetrics(font_metrics_table *table, FontStyle *style, int32 size);
 	bool init;
 	sem_id lock;
 	BList *families;
+	uint16 nextfamilyid;
 	ServerFont *plain, *bold, *fixed;
 	bool need_update;
+	area_id metricsarea;
+	font_metrics_area *metrics;
 };
 
 extern FTC_Manager ftmanager; 
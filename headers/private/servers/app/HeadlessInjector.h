@@ -0,0 +1,67 @@
+//------------------------------------------------------------------------------
+//	File Name:		HeadlessInjector.h
+//	Description:	Synthetic input and frame control for an app_server
+//					running on the headless driver
+//
+//------------------------------------------------------------------------------
+
+#ifndef HEADLESSINJECTOR_H_
+#define HEADLESSINJECTOR_H_
+
+#include <OS.h>
+#include <Point.h>
+#include <Rect.h>
+#include <GraphicsDefs.h>
+
+//! Environment variable which makes the app_server run headless, e.g. "1024x768x16"
+#define HEADLESS_MODE_VARIABLE		"COSMOE_HEADLESS"
+
+//! Port on which the headless driver takes requests
+#define HEADLESS_CONTROL_PORT_NAME	"headless_control"
+
+/*
+	Requests to the headless driver. Each starts with the port_id to which the
+	driver replies with SERVER_TRUE or SERVER_FALSE and the values listed.
+
+	HEADLESS_GET_FRAME_INFO:	reply int32 updates, int64 updated pixels,
+								int32 width, int32 height, int32 color space
+	HEADLESS_DUMP_FRAME:		string path to the PNG to write; no values
+*/
+enum
+{
+	HEADLESS_GET_FRAME_INFO = 'hdfi',
+	HEADLESS_DUMP_FRAME = 'hddf',
+	HEADLESS_STOP = 'hdst'
+};
+
+class HeadlessInjector
+{
+public:
+	HeadlessInjector(void);
+	~HeadlessInjector(void);
+
+	status_t WaitForServer(bigtime_t timeout);
+
+	status_t MouseMoved(BPoint pt, int32 buttons=0);
+	status_t MouseDown(BPoint pt, int32 buttons=1, int32 clicks=1, int32 modifiers=0);
+	status_t MouseUp(BPoint pt, int32 modifiers=0);
+	status_t Click(BPoint pt);
+	status_t KeyDown(int32 scancode, int32 modifiers=0);
+	status_t KeyUp(int32 scancode, int32 modifiers=0);
+
+	status_t GetFrameInfo(int32 *updates, int64 *pixels, BRect *bounds,
+		color_space *space);
+	status_t DumpFrame(const char *path);
+	status_t Quit(void);
+
+private:
+	status_t SendInput(int32 code, BPoint pt, int32 modifiers, int32 buttons,
+		int32 clicks);
+
+	port_id fInputPort;
+	port_id fServerPort;
+	port_id fControlPort;
+	port_id fReplyPort;
+};
+
+#endif
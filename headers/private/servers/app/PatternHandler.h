@@ -88,6 +88,8 @@ public:
 	bool GetValue(const float &x, const float &y);
 	bool GetValue(const BPoint &pt);
 	pattern *GetR5Pattern(void) { return (pattern*)_pat.GetInt8(); }
+	const RGBColor &HighColor(void) const { return *_high; }
+	const RGBColor &LowColor(void) const { return *_low; }
 private:
 	Pattern _pat;
 	RGBColor *_high,*_low;
@@ -22,18 +22,54 @@
 //	File Name:		PixelRenderer.cpp
 //	Author:			DarkWyrm <bpmagic@columbus.rr.com>
 //
-//	Description:	Base class for pixel plotting renderers
+//	Description:	Span renderers for each color space
 //					Based on concepts from the Anti-Grain Geometry vector gfx library
 //------------------------------------------------------------------------------
 #ifndef PIXEL_RENDERER
 #define PIXEL_RENDERER
 
+#include <string.h>
 #include "GraphicsBuffer.h"
 #include "GraphicsDefs.h"
 #include "RGBColor.h"
+#include "Compositor.h"
+#include "SpanKernels.h"
+#include "IPoint.h"
 
-class IPoint;
+class DrawData;
 
+//! Spans collected before they are drawn in one go
+#define RENDERER_BATCH_SIZE		64
+//! Pixels composited per call. A whole number of pattern widths.
+#define RENDERER_CHUNK_SIZE		256
+
+/*!
+	\brief A run of pixels on one row
+	
+	coverage, if not NULL, has a value for each pixel from 0 (not drawn) to
+	255 (fully drawn), for edges which only cover part of a pixel.
+*/
+struct renderer_span
+{
+	int32 x;
+	int32 y;
+	int32 length;
+	const uint8 *coverage;
+};
+
+/*
+	Primitives hand the renderer spans, not pixels. SetColor() and
+	SetDrawData() convert the colors to the buffer's format and pick the
+	drawing mode once, and RenderSpans() draws a whole batch of spans with
+	them, so there is one virtual call per batch rather than per pixel.
+	
+	AddSpan() clips a span to the buffer and collects it, and FlushSpans()
+	draws what has been collected. Coverage passed to AddSpan() has to stay
+	valid until then. Changing the colors or the buffer flushes first.
+	
+	The color spaces are template parameters of SpanRenderer, so storing a
+	pixel is inlined into the loops which draw the spans.
+*/
 class PixelRenderer
 {
 public:
@@ -41,75 +77,283 @@ public:
 	virtual ~PixelRenderer(void);
 	
 	virtual color_space ColorSpace(void) { return B_NO_COLOR_SPACE; }
-	
 	virtual RGBColor GetPixel(const IPoint &pt);
-	virtual void PutPixel(const IPoint &pt, RGBColor &c);
-	virtual void PutHLine(const IPoint &pt, const uint32 length, RGBColor &c);
-	virtual void PutVLine(const IPoint &pt, const uint32 length, RGBColor &c);
 	
-	virtual void SetBuffer(GraphicsBuffer &buffer) { fBuffer=&buffer; }
+	void SetColor(const RGBColor &color);
+	void SetDrawData(const DrawData *d);
+	
+	inline void AddSpan(int32 x, int32 y, int32 length, const uint8 *coverage=NULL);
+	inline void FlushSpans(void);
+	virtual void RenderSpans(const renderer_span *spans, int32 count);
+	
+	void PutPixel(const IPoint &pt);
+	void PutHLine(const IPoint &pt, const uint32 length);
+	void PutVLine(const IPoint &pt, const uint32 length);
+	void StrokeLine(int32 x1, int32 y1, int32 x2, int32 y2);
+	
+	void SetBuffer(GraphicsBuffer &buffer) { FlushSpans(); fBuffer=&buffer; }
 	GraphicsBuffer *GetBuffer(void) const { return fBuffer; }
 
+protected:
+	virtual void UpdateColors(void);
+	void PickCompositors(int32 bitsperpixel);
+	void CompositeSpan(const renderer_span &span, uint8 *dest, int32 pixelsize);
+	
+	rgb_color fHigh;
+	rgb_color fLow;
+	uint8 fPattern[8];
+	bool fSolid;
+	drawing_mode fMode;
+	source_alpha fAlphaSource;
+	alpha_function fAlphaFunction;
+	
+	// NULL for B_OP_COPY without coverage, which needs no compositor
+	compositor_func fComposite;
+	compositor_func fBlend;
+	compositor_state fState;
+
 private:
+	void MakeSourceRows(void);
+
 	GraphicsBuffer *fBuffer;
+	renderer_span fSpans[RENDERER_BATCH_SIZE];
+	int32 fSpanCount;
+	
+	// The pattern's rows as compositor source, made when first needed
+	bool fSourceValid;
+	uint8 fSource[8][(RENDERER_CHUNK_SIZE+8)*4];
+	uint8 fSourceHigh[8][RENDERER_CHUNK_SIZE+8];
 };
 
-class PixelRendererRGBA32 : public PixelRenderer
+/*!
+	\brief Collects a span to draw, clipped to the buffer
+	\param x Leftmost pixel
+	\param y Row
+	\param length Number of pixels
+	\param coverage A value for each pixel, or NULL if all are fully covered
+*/
+void PixelRenderer::AddSpan(int32 x, int32 y, int32 length, const uint8 *coverage)
 {
-public:
-	PixelRendererRGBA32(GraphicsBuffer &buffer);
-	virtual ~PixelRendererRGBA32(void);
+	if(y<0 || y>=(int32)fBuffer->Height())
+		return;
 	
-	virtual color_space ColorSpace(void) { return B_RGBA32; }
+	if(x<0)
+	{
+		if(coverage)
+			coverage-=x;
+		length+=x;
+		x=0;
+	}
+	if(x+length>(int32)fBuffer->Width())
+		length=fBuffer->Width()-x;
+	if(length<=0)
+		return;
 	
-	virtual RGBColor GetPixel(const IPoint &pt);
-	virtual void PutPixel(const IPoint &pt, RGBColor &c);
-	virtual void PutHLine(const IPoint &pt, const uint32 length, RGBColor &c);
-	virtual void PutVLine(const IPoint &pt, const uint32 length, RGBColor &c);
+	if(fSpanCount==RENDERER_BATCH_SIZE)
+		FlushSpans();
+	
+	renderer_span &span=fSpans[fSpanCount++];
+	span.x=x;
+	span.y=y;
+	span.length=length;
+	span.coverage=coverage;
+}
+
+//! Draws the spans collected so far
+void PixelRenderer::FlushSpans(void)
+{
+	if(fSpanCount>0)
+		RenderSpans(fSpans,fSpanCount);
+	fSpanCount=0;
+}
+
+//! B_RGB32 and B_RGBA32
+struct renderer_rgba32
+{
+	enum { kSize=4, kBits=32 };
+	static color_space ColorSpace(void) { return B_RGBA32; }
+	
+	static inline uint32 Pack(const rgb_color &c)
+	{
+		return c.blue | (c.green << 8) | (c.red << 16) | ((uint32)c.alpha << 24);
+	}
+	
+	// Byte by byte, because uint32 isn't four bytes everywhere
+	static inline void Store(uint8 *p, uint32 pixel)
+	{
+		p[0]=pixel;
+		p[1]=pixel >> 8;
+		p[2]=pixel >> 16;
+		p[3]=pixel >> 24;
+	}
+	
+	static inline RGBColor Load(const uint8 *p)
+	{
+		return RGBColor(p[2],p[1],p[0],p[3]);
+	}
 };
 
-class PixelRendererRGB16 : public PixelRenderer
+//! B_RGB16, 5:6:5
+struct renderer_rgb16
 {
-public:
-	PixelRendererRGB16(GraphicsBuffer &buffer);
-	virtual ~PixelRendererRGB16(void);
+	enum { kSize=2, kBits=16 };
+	static color_space ColorSpace(void) { return B_RGB16; }
 	
-	virtual color_space ColorSpace(void) { return B_RGB16; }
+	static inline uint32 Pack(const rgb_color &c)
+	{
+		return RGBColor(c).GetColor16();
+	}
 	
-	virtual RGBColor GetPixel(const IPoint &pt);
-	virtual void PutPixel(const IPoint &pt, RGBColor &c);
-	virtual void PutHLine(const IPoint &pt, const uint32 length, RGBColor &c);
-	virtual void PutVLine(const IPoint &pt, const uint32 length, RGBColor &c);
+	static inline void Store(uint8 *p, uint32 pixel)
+	{
+		uint16 v=pixel;
+		memcpy(p,&v,2);
+	}
+	
+	static inline RGBColor Load(const uint8 *p)
+	{
+		uint16 v;
+		memcpy(&v,p,2);
+		uint8 r=v >> 11, g=(v >> 5) & 0x3f, b=v & 0x1f;
+		return RGBColor((r<<3) | (r>>2), (g<<2) | (g>>4), (b<<3) | (b>>2));
+	}
 };
 
-class PixelRendererRGBA15 : public PixelRenderer
+//! B_RGB15 and B_RGBA15, 1:5:5:5
+struct renderer_rgba15
 {
-public:
-	PixelRendererRGBA15(GraphicsBuffer &buffer);
-	virtual ~PixelRendererRGBA15(void);
+	enum { kSize=2, kBits=15 };
+	static color_space ColorSpace(void) { return B_RGBA15; }
 	
-	virtual color_space ColorSpace(void) { return B_RGBA15; }
+	static inline uint32 Pack(const rgb_color &c)
+	{
+		return RGBColor(c).GetColor15();
+	}
 	
-	virtual RGBColor GetPixel(const IPoint &pt);
-	virtual void PutPixel(const IPoint &pt, RGBColor &c);
-	virtual void PutHLine(const IPoint &pt, const uint32 length, RGBColor &c);
-	virtual void PutVLine(const IPoint &pt, const uint32 length, RGBColor &c);
+	static inline void Store(uint8 *p, uint32 pixel)
+	{
+		uint16 v=pixel;
+		memcpy(p,&v,2);
+	}
+	
+	static inline RGBColor Load(const uint8 *p)
+	{
+		uint16 v;
+		memcpy(&v,p,2);
+		uint8 r=(v >> 10) & 0x1f, g=(v >> 5) & 0x1f, b=v & 0x1f;
+		return RGBColor((r<<3) | (r>>2), (g<<3) | (g>>2), (b<<3) | (b>>2),
+			(v & 0x8000) ? 255 : 0);
+	}
 };
 
-class PixelRendererCMAP8 : public PixelRenderer
+//! B_CMAP8 in the system palette
+struct renderer_cmap8
 {
-public:
-	PixelRendererCMAP8(GraphicsBuffer &buffer);
-	virtual ~PixelRendererCMAP8(void);
+	enum { kSize=1, kBits=8 };
+	static color_space ColorSpace(void) { return B_CMAP8; }
+	
+	static inline uint32 Pack(const rgb_color &c)
+	{
+		return RGBColor(c).GetColor8();
+	}
 	
-	virtual color_space ColorSpace(void) { return B_CMAP8; }
+	static inline void Store(uint8 *p, uint32 pixel)
+	{
+		*p=pixel;
+	}
 	
+	static inline RGBColor Load(const uint8 *p)
+	{
+		return RGBColor(*p);
+	}
+};
+
+template<class Space>
+class SpanRenderer : public PixelRenderer
+{
+public:
+	SpanRenderer(GraphicsBuffer &buffer);
+	virtual ~SpanRenderer(void);
+	
+	virtual color_space ColorSpace(void) { return Space::ColorSpace(); }
 	virtual RGBColor GetPixel(const IPoint &pt);
-	virtual void PutPixel(const IPoint &pt, RGBColor &c);
-	virtual void PutHLine(const IPoint &pt, const uint32 length, RGBColor &c);
-	virtual void PutVLine(const IPoint &pt, const uint32 length, RGBColor &c);
+	virtual void RenderSpans(const renderer_span *spans, int32 count);
+
+protected:
+	virtual void UpdateColors(void);
+
+private:
+	uint32 fHighPixel;
+	uint32 fLowPixel;
+	uint8 fBlock[SPAN_BLOCK_SIZE];
 };
 
+template<class Space>
+SpanRenderer<Space>::SpanRenderer(GraphicsBuffer &buffer)
+ : PixelRenderer(buffer)
+{
+	UpdateColors();
+}
+
+template<class Space>
+SpanRenderer<Space>::~SpanRenderer(void)
+{
+	FlushSpans();
+}
+
+template<class Space>
+RGBColor SpanRenderer<Space>::GetPixel(const IPoint &pt)
+{
+	return Space::Load(GetBuffer()->RowAt(pt.y) + pt.x*Space::kSize);
+}
+
+template<class Space>
+void SpanRenderer<Space>::UpdateColors(void)
+{
+	fHighPixel=Space::Pack(fHigh);
+	fLowPixel=Space::Pack(fLow);
+	span_make_block(fBlock,fHighPixel,Space::kSize);
+	PickCompositors(Space::kBits);
+}
+
+template<class Space>
+void SpanRenderer<Space>::RenderSpans(const renderer_span *spans, int32 count)
+{
+	for(int32 i=0; i<count; i++)
+	{
+		const renderer_span &span=spans[i];
+		uint8 *dest=GetBuffer()->RowAt(span.y) + span.x*Space::kSize;
+		
+		if(fComposite || span.coverage)
+		{
+			CompositeSpan(span,dest,Space::kSize);
+			continue;
+		}
+		
+		if(!fSolid)
+		{
+			uint8 block[SPAN_BLOCK_SIZE];
+			span_make_pattern_block(block,fPattern[span.y & 7],span.x,
+				fHighPixel,fLowPixel,Space::kSize);
+			span_fill(dest,block,span.length*Space::kSize);
+		}
+		else if(span.length<=8)
+		{
+			// Lines are mostly short runs, which aren't worth a call
+			for(int32 x=0; x<span.length; x++, dest+=Space::kSize)
+				Space::Store(dest,fHighPixel);
+		}
+		else
+			span_fill(dest,fBlock,span.length*Space::kSize);
+	}
+}
+
+// The renderers BitmapDriver picks from, one for each color space family
+typedef SpanRenderer<renderer_rgba32> PixelRendererRGBA32;
+typedef SpanRenderer<renderer_rgb16> PixelRendererRGB16;
+typedef SpanRenderer<renderer_rgba15> PixelRendererRGBA15;
+typedef SpanRenderer<renderer_cmap8> PixelRendererCMAP8;
+
 // TODO: These inlines probably should go in ColorUtils
 inline uint16 MakeRGB16Color(uint8 r, uint8 g, uint8 b)
 {
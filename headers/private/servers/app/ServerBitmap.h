@@ -111,6 +111,7 @@ protected:
 	friend class BitmapManager;
 	friend class PicturePlayer;
 	friend class SDLDriver;
+	friend class X11Driver;
 
 	//! Internal function used by the BitmapManager.
 	void _SetArea(area_id ID) { fArea=ID; }
@@ -133,6 +134,11 @@ protected:
 	int fBitsPerPixel;
 	int32 fToken;
 	int32 fOffset;
+
+	//! Area of the BitmapManager the buffer shares with others, NULL if none
+	void *fSlab;
+	//! Team whose memory the buffer counts against
+	team_id fTeam;
 };
 
 class UtilityBitmap : public ServerBitmap
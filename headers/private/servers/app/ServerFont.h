@@ -65,6 +65,7 @@ public:
 	void SetSize(const float &value) { fsize=value; }
 	void SetRotation(const float &value) { frotation=value; }
 	void SetFace(const uint32 &value) { fface=value; }
+	void SetStyle(FontStyle *style);
 
 	BRect BoundingBox(void);
 	void Height(font_height *fh);
@@ -0,0 +1,125 @@
+//------------------------------------------------------------------------------
+//	File Name:		ServerProfiler.h
+//	Description:	Counts and times the messages each application and window
+//					sends the server
+//
+//------------------------------------------------------------------------------
+#ifndef SERVER_PROFILER_H_
+#define SERVER_PROFILER_H_
+
+#include <stdio.h>
+#include <OS.h>
+#include <List.h>
+#include <ServerProtocol.h>
+
+class BPortLink;
+
+/*!
+	\brief Environment variable which turns on message profiling
+
+	If it names a file rather than being 1, the profile is written to it when
+	the server quits.
+*/
+#define PROFILE_VARIABLE		"COSMOE_PROFILE"
+
+//! Number of message codes, from SERVER_TRUE on, which are counted one by one
+#define PROFILE_CODES			(AS_DUMP_PROFILE-SERVER_TRUE+1)
+
+//! Longest application signature or window title a profile keeps
+#define PROFILE_NAME_LENGTH		64
+
+//! Default number of codes listed for each profile by a query or a dump
+#define PROFILE_DEFAULT_TOP		8
+
+typedef struct
+{
+	int32 code;			// SERVER_TRUE-relative, PROFILE_CODES for any other code
+	int32 count;		// messages handled
+	int64 bytes;		// bytes received, headers included
+	bigtime_t time;		// time spent handling them, drawing included
+} opcode_stats;
+
+/*!
+	\class MessageProfile ServerProfiler.h
+	\brief What one application or window sent the server and what it cost
+
+	Only the thread which handles the messages adds to a profile, so adding is
+	not locked. Readers may see a message counted whose time is not added yet.
+*/
+class MessageProfile
+{
+public:
+	MessageProfile(const char *name, team_id team, MessageProfile *app);
+
+	/*!
+		\brief Counts a message
+		\param code The message's code
+		\param bytes Its size, header included
+		\param time How long handling it took
+	*/
+	void Add(int32 code, int32 bytes, bigtime_t time)
+	{
+		int32 index=code-SERVER_TRUE;
+		if(index<0 || index>=PROFILE_CODES)
+			index=PROFILE_CODES;
+		opcode_stats *stats=&fStats[index];
+		stats->count++;
+		stats->bytes+=bytes;
+		stats->time+=time;
+	}
+
+	const char *Name(void) const { return fName; }
+	team_id Team(void) const { return fTeam; }
+	//! Returns the application profile of a window, NULL for an application
+	MessageProfile *App(void) const { return fApp; }
+
+	void GetTotals(opcode_stats *totals) const;
+	int32 GetTop(opcode_stats *top, int32 count) const;
+	void Merge(const MessageProfile *profile);
+	void Reset(void);
+
+private:
+	friend class ServerProfiler;
+
+	char fName[PROFILE_NAME_LENGTH];
+	team_id fTeam;
+	MessageProfile *fApp;
+	bool fExited;
+	opcode_stats fStats[PROFILE_CODES+1];
+};
+
+/*!
+	\class ServerProfiler ServerProfiler.h
+	\brief Keeps the message profiles of all applications and windows
+
+	There is only one, and only while PROFILE_VARIABLE is set; profiling costs
+	nothing otherwise. When a window goes away its profile is added to its
+	application's. Application profiles are kept after the application quits,
+	so what it cost can still be looked at.
+*/
+class ServerProfiler
+{
+public:
+	ServerProfiler(const char *dumppath=NULL);
+	~ServerProfiler(void);
+
+	MessageProfile *AddApp(const char *signature, team_id team);
+	MessageProfile *AddWindow(const char *title, MessageProfile *app);
+	void RemoveApp(MessageProfile *profile);
+	void RemoveWindow(MessageProfile *profile);
+
+	void Reset(void);
+	void Attach(BPortLink *link, int32 top);
+	void Print(FILE *file, int32 top);
+	status_t Dump(const char *path, int32 top=PROFILE_DEFAULT_TOP);
+	const char *DumpPath(void) const { return fDumpPath; }
+
+private:
+	sem_id fLock;
+	BList fProfiles;
+	char *fDumpPath;
+};
+
+extern ServerProfiler *serverprofiler;
+
+#endif
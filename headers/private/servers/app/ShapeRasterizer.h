@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+//
+//	File Name:		ShapeRasterizer.h
+//	Description:	Scanline rasterizers which turn ellipses, arcs, round
+//					rectangles and polygons into clipped spans
+//
+//------------------------------------------------------------------------------
+#ifndef SHAPERASTERIZER_H_
+#define SHAPERASTERIZER_H_
+
+#include <Rect.h>
+#include <Region.h>
+#include "ClipRects.h"
+
+/*!
+	\brief Pixels left to right on one row, both ends included
+
+	coverage, if not NULL, has a value for each pixel of the span from 0 (not
+	drawn) to 255 (fully drawn). It belongs to whatever made the span.
+*/
+struct shape_span
+{
+	int32 y;
+	int32 left;
+	int32 right;
+	const uint8 *coverage;
+};
+
+/*!
+	\class SpanList ShapeRasterizer.h
+	\brief The spans of a shape, clipped to a region
+
+	A rasterizer adds each row of a shape once, from the top down, and the
+	driver then draws the whole list with a single call. The list keeps its
+	memory from one shape to the next.
+*/
+class SpanList
+{
+public:
+	SpanList(void);
+	~SpanList(void);
+
+	void Reset(BRegion *clip, const BRect &bounds);
+	void Reset(void);
+
+	inline void Add(int32 y, int32 left, int32 right,
+		const uint8 *coverage=NULL);
+
+	const shape_span *Spans(void) const { return fSpans; }
+	int32 CountSpans(void) const { return fCount; }
+
+private:
+	void AddClipped(int32 y, int32 left, int32 right,
+		const uint8 *coverage);
+	bool Grow(void);
+
+	shape_span *fSpans;
+	int32 fCount;
+	int32 fSize;
+
+	// the rectangles of the clipping region which meet the shape
+	ClipRects fClip;
+	bool fClipping;
+};
+
+/*!
+	\brief Adds a span, cut to the clipping region
+	\param y Row
+	\param left Leftmost pixel
+	\param right Rightmost pixel. Nothing is added if it is left of left.
+	\param coverage Coverage of each pixel from left on, or NULL if all are
+	fully covered
+*/
+void SpanList::Add(int32 y, int32 left, int32 right, const uint8 *coverage)
+{
+	if(left>right)
+		return;
+
+	if(fClipping)
+	{
+		AddClipped(y,left,right,coverage);
+		return;
+	}
+
+	if(fCount==fSize && !Grow())
+		return;
+
+	shape_span &span=fSpans[fCount++];
+	span.y=y;
+	span.left=left;
+	span.right=right;
+	span.coverage=coverage;
+}
+
+/*
+	Angles are in degrees, counterclockwise from the positive x axis, and an
+	arc's rays go through the points of its ellipse at those angles as if it
+	were a circle stretched to fit the rectangle. A negative span goes
+	clockwise. Outlines are centered on the shape's edge and drawn with
+	whole pixels for pens of one pixel or less.
+*/
+void rasterize_ellipse(SpanList &spans, const BRect &r);
+void rasterize_ellipse_outline(SpanList &spans, const BRect &r, float pensize);
+void rasterize_arc(SpanList &spans, const BRect &r, float angle, float span);
+void rasterize_arc_outline(SpanList &spans, const BRect &r, float angle,
+	float span, float pensize);
+void rasterize_round_rect(SpanList &spans, const BRect &r, float xrad,
+	float yrad);
+void rasterize_round_rect_outline(SpanList &spans, const BRect &r, float xrad,
+	float yrad, float pensize);
+void rasterize_polygon(SpanList &spans, const BPoint *points, int32 count);
+
+#endif
@@ -0,0 +1,56 @@
+//------------------------------------------------------------------------------
+//	File Name:		SpanKernels.h
+//	Description:	Vectorized span and rectangle primitives used by the
+//					drivers for fills, pattern fills and blits
+//
+//------------------------------------------------------------------------------
+#ifndef SPANKERNELS_H_
+#define SPANKERNELS_H_
+
+#include <stddef.h>
+#include <SupportDefs.h>
+
+//! Number of bytes in a fill block. Eight pixels of any depth fit evenly.
+#define SPAN_BLOCK_SIZE		32
+
+//! Instruction sets the span kernels can be run with
+enum span_kernel_level
+{
+	SPAN_KERNEL_SCALAR=0,
+	SPAN_KERNEL_SSE2,
+	SPAN_KERNEL_AVX2
+};
+
+/*
+	A fill writes a block of SPAN_BLOCK_SIZE bytes over and over, starting at
+	the first byte of the span. A solid color is the pixel repeated; an 8x8
+	pattern row is its eight pixels, starting with the pattern column of the
+	span's first pixel. Either way the depth no longer matters to the kernel.
+
+	The best level the CPU supports is picked the first time a kernel is used.
+*/
+span_kernel_level span_get_kernel_level(void);
+span_kernel_level span_best_kernel_level(void);
+bool span_set_kernel_level(span_kernel_level level);
+const char *span_kernel_level_name(span_kernel_level level);
+
+int32 span_pixel_size(int32 bitsperpixel);
+void span_make_block(uint8 *block, uint32 pixel, int32 pixelsize);
+void span_make_pattern_block(uint8 *block, uint8 patternrow, int32 phase,
+	uint32 high, uint32 low, int32 pixelsize);
+
+void span_fill(uint8 *dest, const uint8 *block, size_t bytes);
+void span_copy(uint8 *dest, const uint8 *src, size_t bytes);
+void span_move(uint8 *dest, const uint8 *src, size_t bytes);
+
+void rect_fill(uint8 *dest, int32 bpr, int32 width, int32 height,
+	uint32 pixel, int32 pixelsize);
+void rect_fill_pattern(uint8 *dest, int32 bpr, int32 width, int32 height,
+	const uint8 *pattern, int32 x, int32 y, uint32 high, uint32 low,
+	int32 pixelsize);
+void rect_copy(uint8 *dest, int32 destbpr, const uint8 *src, int32 srcbpr,
+	size_t bytes, int32 rows);
+void rect_move(uint8 *dest, const uint8 *src, int32 bpr, size_t bytes,
+	int32 rows);
+
+#endif
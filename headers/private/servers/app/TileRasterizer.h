@@ -0,0 +1,84 @@
+//------------------------------------------------------------------------------
+//	File Name:		TileRasterizer.h
+//	Description:	Worker threads which rasterize the bands of a large
+//					rectangle in parallel
+//
+//------------------------------------------------------------------------------
+#ifndef TILERASTERIZER_H_
+#define TILERASTERIZER_H_
+
+#include <OS.h>
+#include <SupportDefs.h>
+
+//! Environment variable which sets the number of rasterizer threads. 1 turns them off.
+#define TILE_THREADS_VARIABLE		"COSMOE_RASTER_THREADS"
+
+//! Most threads a rasterizer will use, counting the one which calls Run()
+#define TILE_MAX_THREADS			16
+
+//! Rectangles with fewer pixels than this are drawn by the caller alone
+#define TILE_MIN_PIXELS				32768
+
+//! Fewest rows in a band
+#define TILE_MIN_ROWS				8
+
+/*!
+	\brief Draws rows first to first+count-1 of a job
+	\param cookie The job, as passed to TileRasterizer::Run()
+	\param first First row, counting from the top of the job
+	\param count Number of rows
+*/
+typedef void (*tile_func)(void *cookie, int32 first, int32 count);
+
+/*!
+	\class TileRasterizer TileRasterizer.h
+	\brief Splits a rectangle into bands and has a pool of threads draw them
+
+	A band is a run of whole rows, which is the shape of a tile when the
+	buffer is laid out a row at a time: each thread writes memory no other
+	one touches and none of them has to clip inside a row. The caller draws
+	bands too and Run() only returns once all of them are done, so the job
+	lands on the buffer in one piece, as it would have without threads.
+
+	Jobs must only write their own rows and must not use the driver's lock.
+	All the drivers in the server share one rasterizer, which they get with
+	Acquire(). A caller which finds it busy with another driver's job draws
+	its own alone instead of waiting.
+*/
+class TileRasterizer
+{
+public:
+	static TileRasterizer *Acquire(void);
+	static void Release(void);
+
+	void Run(tile_func func, void *cookie, int32 rows, int32 width);
+
+	void SetThreadCount(int32 threads);
+	int32 CountThreads(void) const { return fWorkerCount+1; }
+
+	static int32 DefaultThreadCount(void);
+
+private:
+	TileRasterizer(int32 threads=0);
+	~TileRasterizer(void);
+
+	static int32 WorkerThread(void *data);
+	void DoBands(void);
+	void StopWorkers(void);
+
+	thread_id fWorkers[TILE_MAX_THREADS];
+	int32 fWorkerCount;
+	sem_id fStartSem;
+	sem_id fDoneSem;
+	bool fQuitting;
+	vint32 fBusy;
+
+	tile_func fFunc;
+	void *fCookie;
+	int32 fRows;
+	int32 fBandRows;
+	int32 fBandCount;
+	vint32 fNextBand;
+};
+
+#endif
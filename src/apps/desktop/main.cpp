@@ -13,6 +13,7 @@
 
 #include <pwd.h>
 
+#include <image.h>
 #include <Window.h>
 #include <Button.h>
 #include <Bitmap.h>
@@ -37,6 +38,17 @@ class BitmapView;
 
 static BBitmap* g_pcBackDrop = NULL;
 
+static void launch_app( const char* pzName )
+{
+	const char* apzArgs[] = { pzName, NULL };
+
+	thread_id hThread = load_image( 1, apzArgs, (const char**) environ );
+	if ( hThread >= 0 )
+	{
+		resume_thread( hThread );
+	}
+}
+
 class DirWindow : public BWindow
 {
 public:
@@ -233,63 +245,27 @@ void BitmapView::MouseDown( BPoint cPosition )
 				}
 				else  if ( pcIcon->GetName() == "Terminal" )
 				{
-					pid_t nPid = fork();
-					if ( nPid == 0 )
-					{
-						set_thread_priority( -1, 0 );
-						execlp( "cterm", "cterm", NULL );
-						exit( 1 );
-					}
+					launch_app( "cterm" );
 				}
 				else  if ( pcIcon->GetName() == "Prefs" )
 				{
-					pid_t nPid = fork();
-					if ( nPid == 0 )
-					{
-						set_thread_priority( -1, 0 );
-						execlp( "guiprefs", "guiprefs", NULL );
-						exit( 1 );
-					}
+					launch_app( "guiprefs" );
 				}
 				else  if ( pcIcon->GetName() == "Pulse" )
 				{
-					pid_t nPid = fork();
-					if ( nPid == 0 )
-					{
-						set_thread_priority( -1, 0 );
-						execlp( "pulse", "pulse", NULL );
-						exit( 1 );
-					}
+					launch_app( "pulse" );
 				}
 				else  if ( pcIcon->GetName() == "Calculator" )
 				{
-					pid_t nPid = fork();
-					if ( nPid == 0 )
-					{
-						set_thread_priority( -1, 0 );
-						execlp( "calc", "calc", NULL );
-						exit( 1 );
-					}
+					launch_app( "calc" );
 				}
 				else  if ( pcIcon->GetName() == "Editor" )
 				{
-					pid_t nPid = fork();
-					if ( nPid == 0 )
-					{
-						set_thread_priority( -1, 0 );
-						execlp( "aedit", "aedit", NULL );
-						exit( 1 );
-					}
+					launch_app( "aedit" );
 				}
 				else  if ( pcIcon->GetName() == "Guido" )
 				{
-					pid_t nPid = fork();
-					if ( nPid == 0 )
-					{
-						set_thread_priority( -1, 0 );
-						execlp( "guido", "guido", NULL );
-						exit( 1 );
-					}
+					launch_app( "guido" );
 				}
 			}
 			else
@@ -0,0 +1,33 @@
+#ifndef TESTHARNESS_H_
+#define TESTHARNESS_H_
+
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+
+// What the checking tests share: each check which doesn't hold prints a FAIL
+// line and is counted, and the test's exit code says whether any failed.
+
+static int gFailures = 0;
+
+static inline void fail(const char* what)
+{
+	printf("FAIL %s\n", what);
+	gFailures++;
+}
+
+//! Same, with the name of what was being checked in a column before it
+static inline void fail(const char* label, const char* what)
+{
+	printf("FAIL %-12s %s\n", label, what);
+	gFailures++;
+}
+
+//! Prints how many checks failed, if any, and returns the exit code for it
+static inline int test_result(void)
+{
+	if (gFailures)
+		printf("%d failures\n", gFailures);
+	return gFailures ? 1 : 0;
+}
+
+#endif
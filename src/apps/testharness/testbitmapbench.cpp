@@ -0,0 +1,292 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+
+// Project Includes ------------------------------------------------------------
+#include <BitmapManager.h>
+#include <ServerBitmap.h>
+#include "BGet++.h"
+
+// Local Includes --------------------------------------------------------------
+#include "TestHarness.h"
+
+// Local Defines ---------------------------------------------------------------
+#define LIVE_BITMAPS	256
+#define OPERATIONS		20000
+#define TEAMS			4
+#define POOL_INCREMENT	(1024 * 1024)
+
+// Globals ---------------------------------------------------------------------
+static uint32 gSeed = 1;
+
+// Checks the app_server's BitmapManager, then churns a set of LIVE_BITMAPS
+// bitmaps through it: each operation frees a random one or creates one in its
+// place, mostly icons, then window-sized offscreens and a few screen-sized
+// ones. The same sizes go through the first-fit BGet pool the manager used
+// before (BGet++.cpp), growing by POOL_INCREMENT since a fixed one fills up
+// at once. For each, it prints the time per operation, the failures, and the
+// memory held against what the bitmaps need at the peak and at the end.
+
+
+static uint32 random_number(void)
+{
+	gSeed = gSeed * 1103515245 + 12345;
+	return (gSeed >> 16) & 0x7fff;
+}
+
+
+static BRect random_bounds(void)
+{
+	uint32 kind = random_number() % 100;
+	int32 width, height;
+	if (kind < 70)
+	{
+		width = 16 + random_number() % 49;
+		height = 16 + random_number() % 49;
+	}
+	else if (kind < 95)
+	{
+		width = 100 + random_number() % 201;
+		height = 100 + random_number() % 101;
+	}
+	else
+	{
+		width = 640 + random_number() % 385;
+		height = 480 + random_number() % 289;
+	}
+	return BRect(0, 0, width - 1, height - 1);
+}
+
+
+static void check_manager(void)
+{
+	BitmapManager manager;
+	ServerBitmap* bitmaps[64];
+
+	// Buffers must be usable and not overlap
+	gSeed = 7;
+	for (int i = 0; i < 64; i++)
+	{
+		bitmaps[i] = manager.CreateBitmap(random_bounds(), B_RGB32, 0, -1,
+			B_MAIN_SCREEN_ID, i % TEAMS);
+		if (!bitmaps[i])
+		{
+			fail("allocation");
+			return;
+		}
+		memset(bitmaps[i]->Bits(), i, bitmaps[i]->BitsLength());
+	}
+	for (int i = 0; i < 64; i++)
+	{
+		uint8* bits = bitmaps[i]->Bits();
+		for (uint32 j = 0; j < bitmaps[i]->BitsLength(); j++)
+		{
+			if (bits[j] != i)
+			{
+				fail("overlapping buffers");
+				i = 64;
+				break;
+			}
+		}
+	}
+
+	// The area and offset given to clients must lead to the buffer
+	for (int i = 0; i < 64; i++)
+	{
+		area_info info;
+		if (get_area_info(bitmaps[i]->Area(), &info) != B_OK
+			|| (uint8*)info.address + bitmaps[i]->AreaOffset()
+				!= bitmaps[i]->Bits())
+		{
+			fail("area and offset");
+			break;
+		}
+	}
+
+	for (int i = 0; i < 64; i++)
+		manager.DeleteBitmap(bitmaps[i]);
+
+	bitmap_manager_stats stats;
+	manager.GetStats(&stats);
+	if (stats.bitmaps != 0 || stats.used != 0)
+		fail("bitmaps left after deleting all of them");
+	for (int team = 0; team < TEAMS; team++)
+	{
+		if (manager.TeamUsage(team) != 0)
+			fail("memory left to a team after deleting its bitmaps");
+	}
+
+	manager.ReleaseUnusedMemory();
+	manager.GetStats(&stats);
+	if (stats.areas != 0 || stats.reserved != 0)
+		fail("areas left after releasing unused memory");
+
+	// A team may not go over its limit, and that does not affect the others
+	manager.SetTeamLimit(1024 * 1024);
+	int created = 0;
+	ServerBitmap* icon;
+	while ((icon = manager.CreateBitmap(BRect(0, 0, 63, 63), B_RGB32, 0, -1,
+			B_MAIN_SCREEN_ID, 1)))
+	{
+		bitmaps[created++ % 64] = icon;
+		if (created > 1024)
+			break;
+	}
+	if (created != 64)
+		fail("team limit");
+	if (manager.TeamUsage(1) > 1024 * 1024)
+		fail("team over its limit");
+	icon = manager.CreateBitmap(BRect(0, 0, 63, 63), B_RGB32, 0, -1,
+		B_MAIN_SCREEN_ID, 2);
+	if (!icon)
+		fail("limit of one team applied to another");
+	manager.GetStats(&stats);
+	if (stats.failures != 1)
+		fail("failure count");
+}
+
+
+// What the BitmapManager used before, counting the areas it takes
+class CountingPool : public AreaPool
+{
+public:
+	CountingPool(void) : reserved(0) {}
+
+	virtual void* AcquireMem(ssize_t size)
+	{
+		void* buffer = AreaPool::AcquireMem(size);
+		area_info info;
+		if (buffer && get_area_info(area_for(buffer), &info) == B_OK)
+			reserved += info.size;
+		return buffer;
+	}
+
+	virtual void ReleaseMem(void* buffer)
+	{
+		area_info info;
+		if (get_area_info(area_for(buffer), &info) == B_OK)
+			reserved -= info.size;
+		AreaPool::ReleaseMem(buffer);
+	}
+
+	int64 reserved;
+};
+
+
+static void report(const char* label, bigtime_t time, int failures,
+				   int64 peakReserved, int64 peakUsed, int64 reserved,
+				   int64 used)
+{
+	printf("%-12s %6.2f us/op %5d failed   peak %6.1f MB for %6.1f MB"
+		"   end %6.1f MB for %6.1f MB (%.2fx)\n", label,
+		(double)time / OPERATIONS, failures, peakReserved / 1048576.0,
+		peakUsed / 1048576.0, reserved / 1048576.0, used / 1048576.0,
+		used ? (double)reserved / used : 0.0);
+}
+
+
+static void bench_manager(void)
+{
+	BitmapManager manager;
+	ServerBitmap* live[LIVE_BITMAPS];
+	memset(live, 0, sizeof(live));
+
+	int64 peakReserved = 0, peakUsed = 0;
+	bitmap_manager_stats stats;
+
+	gSeed = 1;
+	bigtime_t start = system_time();
+	for (int i = 0; i < OPERATIONS; i++)
+	{
+		int slot = random_number() % LIVE_BITMAPS;
+		BRect bounds = random_bounds();
+		if (live[slot])
+		{
+			manager.DeleteBitmap(live[slot]);
+			live[slot] = NULL;
+		}
+		else
+		{
+			live[slot] = manager.CreateBitmap(bounds, B_RGB32, 0, -1,
+				B_MAIN_SCREEN_ID, slot % TEAMS);
+		}
+
+		manager.GetStats(&stats);
+		if (stats.reserved > peakReserved)
+			peakReserved = stats.reserved;
+		if (stats.used > peakUsed)
+			peakUsed = stats.used;
+	}
+	bigtime_t time = system_time() - start;
+
+	manager.GetStats(&stats);
+	report("manager", time, stats.failures, peakReserved, peakUsed,
+		stats.reserved, stats.used);
+}
+
+
+static void bench_pool(void)
+{
+	CountingPool pool;
+	pool.SetPoolIncrement(POOL_INCREMENT);
+	void* live[LIVE_BITMAPS];
+	size_t sizes[LIVE_BITMAPS];
+	memset(live, 0, sizeof(live));
+
+	int64 peakReserved = 0, peakUsed = 0, used = 0;
+	int failures = 0;
+
+	gSeed = 1;
+	bigtime_t start = system_time();
+	for (int i = 0; i < OPERATIONS; i++)
+	{
+		int slot = random_number() % LIVE_BITMAPS;
+		BRect bounds = random_bounds();
+		if (live[slot])
+		{
+			pool.ReleaseBuffer(live[slot]);
+			used -= sizes[slot];
+			live[slot] = NULL;
+		}
+		else
+		{
+			ServerBitmap bitmap(bounds, B_RGB32, 0);
+			sizes[slot] = bitmap.BitsLength();
+			live[slot] = pool.GetBuffer(sizes[slot]);
+			if (live[slot])
+				used += sizes[slot];
+			else
+				failures++;
+		}
+
+		if (pool.reserved > peakReserved)
+			peakReserved = pool.reserved;
+		if (used > peakUsed)
+			peakUsed = used;
+	}
+	bigtime_t time = system_time() - start;
+
+	report("bget pool", time, failures, peakReserved, peakUsed,
+		pool.reserved, used);
+
+	for (int i = 0; i < LIVE_BITMAPS; i++)
+	{
+		if (live[i])
+			pool.ReleaseBuffer(live[i]);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	check_manager();
+
+	bench_manager();
+	bench_pool();
+
+	return test_result();
+}
@@ -0,0 +1,337 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+#include <AppDefs.h>
+
+// Project Includes ------------------------------------------------------------
+#include <CommandRing.h>
+#include <LinkMsgReader.h>
+#include <LinkMsgSender.h>
+#include <ServerProtocol.h>
+
+// Local Includes --------------------------------------------------------------
+#include "TestHarness.h"
+
+// Local Defines ---------------------------------------------------------------
+#define CHECK_MESSAGES	5000
+#define CHECK_RING_SIZE	4096
+#define BENCH_MESSAGES	200000
+#define MESSAGE_SIZE	48
+
+// Globals ---------------------------------------------------------------------
+
+// Checks CommandRing with a LinkMsgReader reading it the way a ServerWindow
+// does: a small ring makes the writer wrap around and wait for room, and
+// pauses make the reader sleep so it has to be rung. The last message comes
+// through the port. Checks a LinkMsgSender batches what it sends to a ring
+// until it is full or its messages are too old, and that a batch whose size
+// runs past what was written makes both go back to the port. Then times
+// sending small messages, one at a time as BView flushes them, through a
+// port and through a ring.
+
+struct writer_args
+{
+	CommandRing* ring;
+	port_id port;
+	int32 count;
+	bool check;
+};
+
+
+// One link message: size, code and flags, then its number and some bytes
+// which depend on it
+static int32 build_message(char* buffer, int32 code, int32 number, int32 extra)
+{
+	int32* header = (int32*)buffer;
+	int32 size = sizeof(int32) * 4 + extra;
+	header[0] = size;
+	header[1] = code;
+	header[2] = 0;
+	header[3] = number;
+	for (int32 i = 0; i < extra; i++)
+		buffer[sizeof(int32) * 4 + i] = (char)(number + i);
+	return size;
+}
+
+
+static int32 writer_thread(void* data)
+{
+	writer_args* args = (writer_args*)data;
+	char buffer[2048];
+
+	for (int32 i = 0; i < args->count; i++)
+	{
+		int32 extra = args->check ? (i * 37) % 1500 : MESSAGE_SIZE - sizeof(int32) * 4;
+		int32 size = build_message(buffer, AS_FILL_RECT, i, extra);
+
+		status_t err;
+		if (args->ring)
+			err = args->ring->Write(buffer, size, args->port);
+		else
+			err = write_port(args->port, AS_SERVER_PORTLINK, buffer, size);
+		if (err != B_OK)
+			return err;
+
+		if (args->check && i % 500 == 0)
+			snooze(5000);
+	}
+
+	// the end is sent through the port, as anything but the client would
+	int32 size = build_message(buffer, B_QUIT_REQUESTED, args->count, 0);
+	return write_port(args->port, AS_SERVER_PORTLINK, buffer, size);
+}
+
+
+static void check_ring(void)
+{
+	CommandRing server("command ring check", CHECK_RING_SIZE);
+	if (server.InitCheck() != B_OK)
+	{
+		fail("creating a ring");
+		return;
+	}
+	CommandRing client(server.Area());
+	if (client.InitCheck() != B_OK)
+	{
+		fail("cloning a ring");
+		return;
+	}
+
+	port_id port = create_port(30, "command ring check");
+	LinkMsgReader reader(port);
+	reader.SetRing(&server);
+
+	// a batch may take at most half the ring
+	char big[CHECK_RING_SIZE];
+	if (client.Write(big, CHECK_RING_SIZE, port) != B_BAD_VALUE)
+		fail("batch larger than the ring");
+
+	writer_args args = { &client, port, CHECK_MESSAGES, true };
+	thread_id writer = spawn_thread(writer_thread, "ring writer",
+		B_NORMAL_PRIORITY, &args);
+	resume_thread(writer);
+
+	int32 expected = 0;
+	int32 code;
+	while (reader.GetNextMessage(&code) == B_OK)
+	{
+		int32 number = -1;
+		reader.Read<int32>(&number);
+		if (number != expected)
+		{
+			fail("message lost or out of order");
+			break;
+		}
+		if (code == B_QUIT_REQUESTED)
+			break;
+
+		int32 extra = (number * 37) % 1500;
+		char data[1500];
+		if (extra && (reader.Read(data, extra) != B_OK
+			|| data[extra - 1] != (char)(number + extra - 1)))
+		{
+			fail("message contents");
+			break;
+		}
+		expected++;
+	}
+	if (expected != CHECK_MESSAGES)
+		fail("messages read");
+
+	status_t result;
+	wait_for_thread(writer, &result);
+	if (result != B_OK)
+		fail("writing");
+
+	delete_port(port);
+}
+
+
+static void check_sender(void)
+{
+	CommandRing server("command ring sender");
+	CommandRing client(server.Area());
+	port_id port = create_port(30, "command ring sender");
+	LinkMsgSender sender(port);
+	sender.SetRing(&client);
+
+	// 16K batches of 48 byte messages: a drawing pass of 1000 takes 3 writes
+	link_sender_stats stats;
+	for (int32 i = 0; i < 1000; i++)
+	{
+		sender.StartMessage(AS_FILL_RECT);
+		char data[MESSAGE_SIZE - sizeof(int32) * 3];
+		sender.Attach(data, sizeof(data));
+	}
+	sender.Flush();
+	sender.GetStats(&stats);
+	if (stats.messages != 1000 || stats.flushes != 3)
+		fail("batching");
+
+	// nothing waits much longer than the latency
+	sender.SetFlushLatency(20000);
+	sender.StartMessage(AS_FILL_RECT);
+	snooze(30000);
+	sender.StartMessage(AS_FILL_RECT);
+	sender.GetStats(&stats);
+	if (stats.flushes != 1 || stats.messages != 1)
+		fail("flush latency");
+
+	// nor when no other message comes to send it
+	sender.EndMessage();
+	sender.FlushIfLate();
+	sender.GetStats(&stats);
+	if (stats.flushes != 0)
+		fail("flushed before the latency");
+	snooze(30000);
+	sender.FlushIfLate();
+	sender.GetStats(&stats);
+	if (stats.flushes != 1 || stats.messages != 1)
+		fail("flushed once late");
+
+	int32 size, batches = 0;
+	while (server.NextBatch(&size))
+		batches++;
+	if (batches != 5)
+		fail("batches in the ring");
+
+	delete_port(port);
+}
+
+
+static void check_garbage(void)
+{
+	CommandRing server("command ring garbage");
+	CommandRing client(server.Area());
+	port_id port = create_port(30, "command ring garbage");
+	LinkMsgReader reader(port);
+	reader.SetRing(&server);
+	LinkMsgSender sender(port);
+	sender.SetRing(&client);
+
+	// a batch of one message is preceded by its size, then the message's
+	area_info info;
+	get_area_info(server.Area(), &info);
+	char buffer[64];
+	int32 size = build_message(buffer, AS_FILL_RECT, 0x5a5a, 8);
+	client.Write(buffer, size, port);
+
+	int32* record = NULL;
+	for (int32* p = (int32*)info.address; p < (int32*)info.address + 64; p++)
+	{
+		if (p[0] == size && p[1] == size && p[2] == AS_FILL_RECT)
+		{
+			record = p;
+			break;
+		}
+	}
+	if (record == NULL)
+	{
+		fail("finding the batch");
+		delete_port(port);
+		return;
+	}
+	*record = COMMAND_RING_SIZE;
+
+	int32 code;
+	if (reader.GetNextMessage(&code, 50000) == B_OK)
+		fail("reading a batch larger than what was written");
+	if (!server.IsDropped())
+		fail("ring dropped");
+	if (client.Write(buffer, size, port) != B_BAD_DATA)
+		fail("writing a dropped ring");
+
+	// more than a port message takes, which the sender splits
+	for (int32 i = 0; i < 400; i++)
+	{
+		sender.StartMessage(AS_FILL_RECT);
+		sender.Attach<int32>(i);
+	}
+	if (sender.Flush() != B_OK)
+		fail("falling back to the port");
+
+	int32 expected = 0;
+	while (expected < 400 && reader.GetNextMessage(&code, 50000) == B_OK)
+	{
+		int32 number = -1;
+		reader.Read<int32>(&number);
+		if (number != expected)
+			break;
+		expected++;
+	}
+	if (expected != 400)
+		fail("messages through the port");
+
+	delete_port(port);
+}
+
+
+static void bench(const char* label, bool useRing)
+{
+	CommandRing server("command ring bench");
+	CommandRing client(server.Area());
+	port_id port = create_port(30, "command ring bench");
+
+	writer_args args = { useRing ? &client : NULL, port, BENCH_MESSAGES, false };
+	thread_id writer = spawn_thread(writer_thread, "ring writer",
+		B_NORMAL_PRIORITY, &args);
+
+	bigtime_t start = system_time();
+	resume_thread(writer);
+
+	// what LinkMsgReader does, without its tracing
+	char buffer[2048];
+	int32 messages = 0, doorbells = 0, code;
+	while (true)
+	{
+		int32 size;
+		if (useRing && server.NextBatch(&size))
+		{
+			messages++;
+			continue;
+		}
+		if (useRing && !server.Sleep())
+			continue;
+
+		if (read_port(port, &code, buffer, sizeof(buffer)) < 0)
+			break;
+		if (useRing)
+			server.Awake();
+		if (code == AS_SERVER_AREALINK)
+		{
+			doorbells++;
+			continue;
+		}
+		if (((int32*)buffer)[1] == B_QUIT_REQUESTED)
+			break;
+		messages++;
+	}
+	bigtime_t time = system_time() - start;
+
+	status_t result;
+	wait_for_thread(writer, &result);
+	delete_port(port);
+
+	printf("%-6s %8ld messages %7.3f us each, %ld port writes\n", label,
+		messages, (double)time / BENCH_MESSAGES,
+		useRing ? doorbells + 1 : messages + 1);
+	if (messages != BENCH_MESSAGES)
+		fail("messages lost");
+}
+
+
+int main(int argc, char** argv)
+{
+	check_ring();
+	check_sender();
+	check_garbage();
+
+	bench("port", false);
+	bench("ring", true);
+
+	return test_result();
+}
@@ -0,0 +1,406 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+#include <Region.h>
+
+// Project Includes ------------------------------------------------------------
+#include <CoverageRasterizer.h>
+
+// Local Includes --------------------------------------------------------------
+#include "TestHarness.h"
+
+// Local Defines ---------------------------------------------------------------
+#define GRID_SIZE		256
+#define MIN_TIME		200000
+
+// The ops of a BShape's op list
+#define OP_LINETO		0x10000000
+#define OP_BEZIERTO		0x20000000
+#define OP_CLOSE		0x40000000
+#define OP_MOVETO		0x80000000
+
+// Globals ---------------------------------------------------------------------
+static float gGrid[GRID_SIZE][GRID_SIZE];
+static float gOther[GRID_SIZE][GRID_SIZE];
+
+// Checks the app_server's anti-aliased rasterizer (CoverageRasterizer.cpp)
+// by adding up the coverage of its spans in a grid: fills and strokes cover
+// the area they should, joins and caps add what their mode says, curves
+// stay close to the circle they approximate, and clipping cuts out what the
+// region leaves out. No pixel may be in two spans. Checks the cells a thick
+// line needs per row don't grow with its width, then times the rasterizer.
+
+
+static void expect(const char* what, double value, double expected,
+	double tolerance)
+{
+	if (fabs(value - expected) <= tolerance)
+		return;
+
+	printf("FAIL %s: %.2f, not %.2f\n", what, value, expected);
+	gFailures++;
+}
+
+
+// Adds up the spans' coverage in a grid, as fractions of a pixel. Returns
+// the total, or -1 if a pixel was in two spans or off the grid.
+static double draw(SpanList& spans, float grid[GRID_SIZE][GRID_SIZE])
+{
+	memset(grid, 0, sizeof(gGrid));
+	double total = 0;
+	const shape_span* span = spans.Spans();
+	for (int32 i = 0; i < spans.CountSpans(); i++, span++)
+	{
+		if (span->y < 0 || span->y >= GRID_SIZE || span->left < 0
+			|| span->right >= GRID_SIZE || span->left > span->right)
+			return -1;
+		for (int32 x = span->left; x <= span->right; x++)
+		{
+			if (grid[span->y][x] != 0)
+				return -1;
+			float value = span->coverage
+				? span->coverage[x - span->left] / 255.0 : 1;
+			if (value == 0)
+				value = 1e-6;
+			grid[span->y][x] = value;
+			total += value;
+		}
+	}
+	return total;
+}
+
+
+static double fill(CoverageRasterizer& rasterizer, fill_rule rule,
+	const BPoint* points, int32 count)
+{
+	SpanList spans;
+	rasterizer.Reset();
+	rasterizer.SetFillRule(rule);
+	rasterizer.AddPolygon(points, count);
+	rasterizer.Render(spans);
+	return draw(spans, gGrid);
+}
+
+
+static double stroke(const BPoint* points, int32 count, bool closed,
+	float pensize, cap_mode cap, join_mode join, float miterLimit = 10)
+{
+	CoverageRasterizer rasterizer;
+	SpanList spans;
+	PathStroker stroker(rasterizer, pensize, cap, join, miterLimit);
+	stroker.Stroke(points, count, closed);
+	rasterizer.Render(spans);
+	return draw(spans, gGrid);
+}
+
+
+static void check_fills(void)
+{
+	CoverageRasterizer rasterizer;
+
+	BPoint square[] = { BPoint(10.3, 10.6), BPoint(50.3, 10.6),
+		BPoint(50.3, 40.6), BPoint(10.3, 40.6) };
+	expect("square", fill(rasterizer, FILL_NONZERO, square, 4), 1200, 1);
+
+	BPoint triangle[] = { BPoint(20, 20), BPoint(120, 45.5), BPoint(33.3, 130) };
+	double area = fabs((100 * 110.0 - 25.5 * 13.3) / 2);
+	expect("triangle", fill(rasterizer, FILL_EVEN_ODD, triangle, 3), area, 1);
+
+	// edges through pixel centers cover half of them
+	BPoint centers[] = { BPoint(10, 10), BPoint(20, 10), BPoint(20, 20),
+		BPoint(10, 20) };
+	fill(rasterizer, FILL_NONZERO, centers, 4);
+	if (gGrid[15][15] != 1 || fabs(gGrid[10][15] - .5) > .01
+		|| fabs(gGrid[15][20] - .5) > .01 || fabs(gGrid[20][20] - .25) > .01)
+		fail("pixel centers");
+
+	// squares of 900 and 400 pixels, wound the same way and overlapping by
+	// 100. Where edges cross, a pixel counts what each covers, so it may get
+	// up to a half more than it should.
+	BPoint both[] = { BPoint(10, 10), BPoint(40, 10), BPoint(40, 40),
+		BPoint(30, 40), BPoint(30, 30), BPoint(50, 30), BPoint(50, 50),
+		BPoint(30, 50), BPoint(30, 40), BPoint(10, 40) };
+	expect("nonzero", fill(rasterizer, FILL_NONZERO, both, 10), 1200, 1);
+	expect("even-odd", fill(rasterizer, FILL_EVEN_ODD, both, 10), 1100, 2);
+
+	rasterizer.SetAntialiasing(false);
+	// whole pixels, as many as their centers inside
+	expect("aliased square", fill(rasterizer, FILL_NONZERO, square, 4),
+		1200, 70);
+	rasterizer.SetAntialiasing(true);
+}
+
+
+static void check_strokes(void)
+{
+	BPoint line[] = { BPoint(20, 50), BPoint(120, 50) };
+	expect("butt caps", stroke(line, 2, false, 10, B_BUTT_CAP, B_MITER_JOIN),
+		1000, 1);
+	expect("square caps", stroke(line, 2, false, 10, B_SQUARE_CAP,
+		B_MITER_JOIN), 1100, 1);
+	expect("round caps", stroke(line, 2, false, 10, B_ROUND_CAP, B_MITER_JOIN),
+		1000 + M_PI * 25, 1.5);
+
+	BPoint diagonal[] = { BPoint(20, 30), BPoint(140, 120) };
+	expect("diagonal", stroke(diagonal, 2, false, 8, B_BUTT_CAP, B_MITER_JOIN),
+		150 * 8, 1);
+
+	// a right angle: the joins add nothing, a triangle, a quarter circle
+	// and a square
+	BPoint corner[] = { BPoint(20, 20), BPoint(100, 20), BPoint(100, 100) };
+	double base = 80 * 10 * 2 - 25;
+	expect("butt join", stroke(corner, 3, false, 10, B_BUTT_CAP, B_BUTT_JOIN),
+		base, 1.5);
+	expect("bevel join", stroke(corner, 3, false, 10, B_BUTT_CAP,
+		B_BEVEL_JOIN), base + 12.5, 1);
+	expect("round join", stroke(corner, 3, false, 10, B_BUTT_CAP,
+		B_ROUND_JOIN), base + M_PI * 25 / 4, 1);
+	expect("miter join", stroke(corner, 3, false, 10, B_BUTT_CAP,
+		B_MITER_JOIN), base + 25, 1);
+	expect("square join", stroke(corner, 3, false, 10, B_BUTT_CAP,
+		B_SQUARE_JOIN), base + 25, 1);
+
+	// too sharp for the miter limit
+	BPoint sharp[] = { BPoint(20, 100), BPoint(120, 100), BPoint(20, 110) };
+	double bevel = stroke(sharp, 3, false, 6, B_BUTT_CAP, B_BEVEL_JOIN);
+	expect("miter limit", stroke(sharp, 3, false, 6, B_BUTT_CAP, B_MITER_JOIN),
+		bevel, .5);
+	if (stroke(sharp, 3, false, 6, B_BUTT_CAP, B_MITER_JOIN, 100) < bevel + 20)
+		fail("miter under the limit");
+
+	// closed outlines have no caps and join every corner
+	BPoint rect[] = { BPoint(30, 30), BPoint(130, 30), BPoint(130, 90),
+		BPoint(30, 90) };
+	expect("closed", stroke(rect, 4, true, 6, B_ROUND_CAP, B_MITER_JOIN),
+		106 * 66 - 94 * 54, 3);
+
+	BPoint dot[] = { BPoint(60, 60), BPoint(60, 60) };
+	expect("round dot", stroke(dot, 2, false, 20, B_ROUND_CAP, B_MITER_JOIN),
+		M_PI * 100, 2);
+	expect("square dot", stroke(dot, 2, false, 20, B_BUTT_CAP, B_MITER_JOIN),
+		400, 1);
+}
+
+
+static void check_curves(void)
+{
+	// a quarter circle of radius 100 is within 0.03 of this curve
+	BPoint center(20, 20);
+	BPoint curve[] = { BPoint(20 + 100, 20 + 55.2285), BPoint(20 + 55.2285,
+		20 + 100), BPoint(20, 20 + 100) };
+
+	PathBuilder path;
+	path.MoveTo(center);
+	path.LineTo(BPoint(120, 20));
+	path.BezierTo(curve);
+	path.Close();
+
+	int32 count;
+	bool closed;
+	const BPoint* points = path.PathAt(0, &count, &closed);
+	if (path.CountPaths() != 1 || !closed || count < 10)
+	{
+		fail("flattening");
+		return;
+	}
+	double worst = 0;
+	for (int32 i = 1; i < count - 1; i++)
+	{
+		BPoint mid((points[i].x + points[i + 1].x) / 2,
+			(points[i].y + points[i + 1].y) / 2);
+		double dx = mid.x - center.x, dy = mid.y - center.y;
+		double off = fabs(sqrt(dx * dx + dy * dy) - 100);
+		if (off > worst)
+			worst = off;
+	}
+	if (worst > .14)
+		fail("curve flatness");
+
+	double area = 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		const BPoint& a = points[i];
+		const BPoint& b = points[(i + 1) % count];
+		area += (a.x * b.y - b.x * a.y) / 2;
+	}
+	if (fabs(area - M_PI * 2500) > 10)
+		fail("curve area");
+
+	CoverageRasterizer rasterizer;
+	SpanList spans;
+	path.Fill(rasterizer);
+	rasterizer.Render(spans);
+	expect("quarter disc", draw(spans, gGrid), area, 1);
+
+	// the same from a BShape's ops
+	int32 ops[] = { OP_MOVETO | OP_LINETO | 1, OP_BEZIERTO | 3, OP_CLOSE };
+	BPoint pts[] = { center, BPoint(120, 20), curve[0], curve[1], curve[2] };
+	path.Reset();
+	if (path.AddShape(3, ops, 5, pts) != B_OK)
+		fail("shape ops");
+	path.Fill(rasterizer);
+	rasterizer.Render(spans);
+	expect("shape", draw(spans, gGrid), area, 1);
+
+	path.Reset();
+	if (path.AddShape(3, ops, 4, pts) == B_OK)
+		fail("shape with too few points");
+}
+
+
+static void check_clipping(void)
+{
+	BRegion region;
+	region.Include(BRect(0, 0, 60, 60));
+	region.Include(BRect(80, 20, 150, 40));
+	region.Include(BRect(30, 100, 90, 200));
+
+	BPoint star[] = { BPoint(75, 5), BPoint(95, 140), BPoint(5, 50),
+		BPoint(145, 50), BPoint(55, 140) };
+
+	CoverageRasterizer rasterizer;
+	SpanList spans;
+	rasterizer.Reset(region.Frame());
+	rasterizer.SetFillRule(FILL_EVEN_ODD);
+	rasterizer.AddPolygon(star, 5);
+	rasterizer.Render(spans, &region);
+	if (draw(spans, gGrid) < 0)
+	{
+		fail("clipped pixels overlap");
+		return;
+	}
+
+	rasterizer.Reset();
+	rasterizer.SetFillRule(FILL_EVEN_ODD);
+	rasterizer.AddPolygon(star, 5);
+	rasterizer.Render(spans);
+	draw(spans, gOther);
+	for (int32 y = 0; y < GRID_SIZE; y++)
+		for (int32 x = 0; x < GRID_SIZE; x++)
+			if (!region.Contains(BPoint(x, y)))
+				gOther[y][x] = 0;
+	if (memcmp(gGrid, gOther, sizeof(gGrid)) != 0)
+		fail("clipping");
+
+	// a box cuts off what is outside without changing what is in
+	rasterizer.Reset(BRect(40, 30, 100, 80));
+	rasterizer.SetFillRule(FILL_EVEN_ODD);
+	rasterizer.AddPolygon(star, 5);
+	rasterizer.Render(spans);
+	draw(spans, gGrid);
+	for (int32 y = 0; y < GRID_SIZE; y++)
+		for (int32 x = 0; x < GRID_SIZE; x++)
+		{
+			bool in = x >= 40 && x <= 100 && y >= 30 && y <= 80;
+			if (gGrid[y][x] != 0 && !in)
+			{
+				fail("clipping box");
+				return;
+			}
+		}
+}
+
+
+// Cells per row of a thick diagonal line
+static double cells_per_row(float pensize)
+{
+	CoverageRasterizer rasterizer;
+	SpanList spans;
+	PathStroker stroker(rasterizer, pensize, B_BUTT_CAP, B_MITER_JOIN, 10);
+	BPoint line[] = { BPoint(-1000, -700), BPoint(1000, 700) };
+	stroker.Stroke(line, 2, false);
+	int32 cells = rasterizer.CountCells();
+	rasterizer.Render(spans);
+	return (double)cells / (rasterizer.Bounds().Height() + 1);
+}
+
+
+static void check_width_cost(void)
+{
+	double thin = cells_per_row(2), thick = cells_per_row(100);
+	if (thick > thin * 1.5 || thick > 12)
+	{
+		printf("FAIL cells per row: %.2f at 2 pixels, %.2f at 100\n", thin,
+			thick);
+		gFailures++;
+	}
+}
+
+
+static void bench(const char* label, int32 shape, float pensize)
+{
+	CoverageRasterizer rasterizer;
+	SpanList spans;
+	PathBuilder path;
+	BPoint line[] = { BPoint(10, 10), BPoint(200, 120) };
+	BPoint polygon[] = { BPoint(0, 20), BPoint(30, 0), BPoint(60, 20),
+		BPoint(45, 60), BPoint(15, 60) };
+	BPoint curve[] = { BPoint(0, 0), BPoint(40, 100), BPoint(160, -60),
+		BPoint(200, 40) };
+
+	int32 count = 0, pixels = 0;
+	bigtime_t start = system_time(), time;
+	do
+	{
+		for (int32 i = 0; i < 100; i++)
+		{
+			switch (shape)
+			{
+				case 0:
+				{
+					PathStroker stroker(rasterizer, pensize, B_BUTT_CAP,
+						B_MITER_JOIN, 10);
+					stroker.Stroke(line, 2, false);
+					break;
+				}
+				case 1:
+					rasterizer.SetFillRule(FILL_EVEN_ODD);
+					rasterizer.AddPolygon(polygon, 5);
+					break;
+				case 2:
+				{
+					path.Reset();
+					path.MoveTo(curve[0]);
+					path.BezierTo(curve + 1);
+					PathStroker stroker(rasterizer, pensize, B_ROUND_CAP,
+						B_ROUND_JOIN, 10);
+					stroker.Stroke(path);
+					break;
+				}
+			}
+			rasterizer.Render(spans);
+			rasterizer.SetFillRule(FILL_NONZERO);
+		}
+		count += 100;
+		time = system_time() - start;
+	} while (time < MIN_TIME);
+
+	for (int32 i = 0; i < spans.CountSpans(); i++)
+		pixels += spans.Spans()[i].right - spans.Spans()[i].left + 1;
+	printf("%-18s %5ld spans %6ld pixels %7.3f us each\n", label,
+		spans.CountSpans(), pixels, (double)time / count);
+}
+
+
+int main(int argc, char** argv)
+{
+	check_fills();
+	check_strokes();
+	check_curves();
+	check_clipping();
+	check_width_cost();
+
+	bench("line, 2 pixels", 0, 2);
+	bench("line, 8 pixels", 0, 8);
+	bench("line, 32 pixels", 0, 32);
+	bench("polygon", 1, 1);
+	bench("curve, 1 pixel", 2, 1);
+	bench("curve, 6 pixels", 2, 6);
+
+	return test_result();
+}
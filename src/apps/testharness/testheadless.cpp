@@ -0,0 +1,511 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+#include <Font.h>
+#include <GraphicsDefs.h>
+#include <Point.h>
+#include <Rect.h>
+
+// Project Includes ------------------------------------------------------------
+#include <ServerProtocol.h>
+#include <PictureProtocol.h>
+#include <HeadlessInjector.h>
+
+// Local Includes --------------------------------------------------------------
+
+// Local Defines ---------------------------------------------------------------
+#define DEFAULT_SERVER		"../../servers/app/objs/appserver"
+#define SESSION_PATH		"/tmp/testheadless.session"
+#define REPLAY_PNG			"/tmp/testheadless-replay.png"
+#define SERVER_PNG			"/tmp/testheadless-server.png"
+#define SESSION_FRAMES		30
+#define REPLAY_LOOPS		"10"
+#define PICTURE_SESSION		"/tmp/testheadless-picture.session"
+#define PICTURE_PNG			"/tmp/testheadless-picture.png"
+
+// The ops of a BShape's op list
+#define OP_LINETO		0x10000000
+#define OP_CLOSE		0x40000000
+#define OP_MOVETO		0x80000000
+
+// Globals ---------------------------------------------------------------------
+
+// Runs the app_server on the headless driver the way a CI machine would:
+// first a synthetic drawing session is written and replayed with
+// "appserver --replay", which prints frames per second and the time spent on
+// each message; then a session which draws a picture over and over and
+// copies what it drew the same number of times, so the time each
+// AS_LAYER_DRAW_PICTURE takes can be set against a blit of the same size;
+// then the whole server is started headless, fed input through a
+// HeadlessInjector and made to save its frame before being told to quit.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+	printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+	if (!ok)
+		failures++;
+}
+
+
+// Writes messages in the layout SessionRecorder records: the size, code and
+// flags header LinkMsgSender puts on the port, then the attachments.
+class SessionWriter
+{
+public:
+	SessionWriter(const char* path)
+		: fFile(fopen(path, "wb")), fSize(0)
+	{
+	}
+
+	~SessionWriter()
+	{
+		if (fFile)
+			fclose(fFile);
+	}
+
+	bool InitCheck() const { return fFile != NULL; }
+
+	void Start(int32 code)
+	{
+		int32 header[3] = { 0, code, 0 };
+		memcpy(fBuffer, header, sizeof(header));
+		fSize = sizeof(header);
+	}
+
+	void Attach(const void* data, size_t size)
+	{
+		memcpy(fBuffer + fSize, data, size);
+		fSize += size;
+	}
+
+	template <class Type> void Attach(const Type& data)
+	{
+		Attach(&data, sizeof(Type));
+	}
+
+	void AttachString(const char* string)
+	{
+		int32 length = strlen(string) + 1;
+		Attach<int32>(length);
+		Attach(string, length);
+	}
+
+	void End()
+	{
+		int32 size = fSize;
+		memcpy(fBuffer, &size, sizeof(size));
+		fwrite(fBuffer, 1, fSize, fFile);
+	}
+
+private:
+	FILE*	fFile;
+	char	fBuffer[1024];
+	int32	fSize;
+};
+
+
+// Builds a picture's data the way BPicture flattens it: each call is its
+// code, the size of its data and then the data.
+class PictureData
+{
+public:
+	PictureData()
+		: fSize(0), fCall(0)
+	{
+	}
+
+	void Start(int16 code)
+	{
+		fCall = fSize;
+		Add<int16>(code);
+		Add<int32>(0);
+	}
+
+	template <class Type> void Add(const Type& data)
+	{
+		memcpy(fBuffer + fSize, &data, sizeof(Type));
+		fSize += sizeof(Type);
+	}
+
+	void End()
+	{
+		int32 length = fSize - fCall - sizeof(int16) - sizeof(int32);
+		memcpy(fBuffer + fCall + sizeof(int16), &length, sizeof(length));
+	}
+
+	const char* Data() const { return fBuffer; }
+	int32 Size() const { return fSize; }
+
+private:
+	char	fBuffer[768];
+	int32	fSize;
+	int32	fCall;
+};
+
+
+static void set_color(SessionWriter& session, int32 code, uint8 r, uint8 g, uint8 b)
+{
+	rgb_color color = { r, g, b, 255 };
+	session.Start(code);
+	session.Attach(&color, sizeof(color));
+	session.End();
+}
+
+
+static void rect_message(SessionWriter& session, int32 code, BRect rect)
+{
+	session.Start(code);
+	session.Attach<BRect>(rect);
+	session.End();
+}
+
+
+// Each frame is a desktop with a few windows on it, each with a tab, a
+// border, a title, some controls and a little vector art, moved a bit from
+// one frame to the next.
+static bool write_session(const char* path, int32 frames)
+{
+	SessionWriter session(path);
+	if (!session.InitCheck())
+		return false;
+
+	for (int32 frame = 0; frame < frames; frame++)
+	{
+		set_color(session, AS_LAYER_SET_HIGH_COLOR, 51, 102, 160);
+		rect_message(session, AS_FILL_RECT, BRect(0, 0, 799, 599));
+
+		for (int32 window = 0; window < 6; window++)
+		{
+			float x = 20 + window * 110 + (frame * 3) % 40;
+			float y = 30 + window * 70 + (frame * 2) % 30;
+			BRect frameRect(x, y, x + 300, y + 220);
+
+			set_color(session, AS_LAYER_SET_HIGH_COLOR, 255, 203, 0);
+			rect_message(session, AS_FILL_RECT,
+				BRect(x, y - 18, x + 120, y - 1));
+
+			set_color(session, AS_LAYER_SET_HIGH_COLOR, 216, 216, 216);
+			rect_message(session, AS_FILL_RECT, frameRect);
+
+			set_color(session, AS_LAYER_SET_HIGH_COLOR, 152, 152, 152);
+			session.Start(AS_STROKE_RECT);
+			session.Attach<float>(frameRect.left);
+			session.Attach<float>(frameRect.top);
+			session.Attach<float>(frameRect.right);
+			session.Attach<float>(frameRect.bottom);
+			session.End();
+
+			set_color(session, AS_LAYER_SET_HIGH_COLOR, 255, 255, 255);
+			session.Start(AS_STROKE_LINE);
+			session.Attach<float>(x + 1);
+			session.Attach<float>(y + 1);
+			session.Attach<float>(x + 299);
+			session.Attach<float>(y + 1);
+			session.End();
+
+			set_color(session, AS_LAYER_SET_HIGH_COLOR, 0, 0, 0);
+			escapement_delta delta = { 0, 0 };
+			const char* title = "Untitled Window";
+			session.Start(AS_DRAW_STRING);
+			session.Attach<int32>(strlen(title));
+			session.Attach<BPoint>(BPoint(x + 6, y - 5));
+			session.Attach<escapement_delta>(delta);
+			session.AttachString(title);
+			session.End();
+
+			set_color(session, AS_LAYER_SET_HIGH_COLOR, 232, 232, 232);
+			session.Start(AS_FILL_ROUNDRECT);
+			session.Attach<BRect>(BRect(x + 200, y + 180, x + 290, y + 210));
+			session.Attach<float>(4);
+			session.Attach<float>(4);
+			session.End();
+
+			set_color(session, AS_LAYER_SET_HIGH_COLOR, 200, 40, 40);
+			rect_message(session, AS_FILL_ELLIPSE,
+				BRect(x + 20, y + 20, x + 120, y + 100));
+			rect_message(session, AS_STROKE_ELLIPSE,
+				BRect(x + 140, y + 20, x + 240, y + 100));
+
+			BPoint points[5] = {
+				BPoint(x + 20, y + 200), BPoint(x + 60, y + 120),
+				BPoint(x + 100, y + 180), BPoint(x + 140, y + 130),
+				BPoint(x + 180, y + 200)
+			};
+			set_color(session, AS_LAYER_SET_HIGH_COLOR, 40, 140, 40);
+			session.Start(AS_FILL_POLYGON);
+			session.Attach<BRect>(BRect(x + 20, y + 120, x + 180, y + 200));
+			session.Attach<int32>(5);
+			session.Attach(points, sizeof(points));
+			session.End();
+		}
+
+		session.Start(AS_SYNC);
+		session.End();
+	}
+
+	return true;
+}
+
+
+static void picture_color(PictureData& picture, uint8 r, uint8 g, uint8 b)
+{
+	rgb_color color = { r, g, b, 255 };
+	picture.Start(B_PIC_SET_FORE_COLOR);
+	picture.Add<rgb_color>(color);
+	picture.End();
+}
+
+
+// A control's worth of vector art, 200x140: rounded and elliptical shapes,
+// whose spans the server keeps, a shape, a rectangle and a clipped ellipse.
+static void write_picture(PictureData& picture)
+{
+	picture_color(picture, 200, 40, 40);
+	picture.Start(B_PIC_FILL_ELLIPSE);
+	picture.Add<BRect>(BRect(0, 0, 70, 40));
+	picture.End();
+	picture.Start(B_PIC_STROKE_ELLIPSE);
+	picture.Add<BRect>(BRect(80, 0, 150, 40));
+	picture.End();
+
+	picture_color(picture, 232, 232, 232);
+	picture.Start(B_PIC_FILL_ROUND_RECT);
+	picture.Add<BRect>(BRect(0, 50, 90, 80));
+	picture.Add<BPoint>(BPoint(4, 4));
+	picture.End();
+
+	picture_color(picture, 40, 40, 200);
+	picture.Start(B_PIC_FILL_ARC);
+	picture.Add<BPoint>(BPoint(130, 80));
+	picture.Add<BPoint>(BPoint(30, 30));
+	picture.Add<float>(30);
+	picture.Add<float>(240);
+	picture.End();
+	picture.Start(B_PIC_FILL_RECT);
+	picture.Add<BRect>(BRect(170, 0, 199, 139));
+	picture.End();
+
+	int32 ops[2] = { OP_MOVETO | OP_LINETO | 3, OP_CLOSE };
+	BPoint points[4] = {
+		BPoint(0, 139), BPoint(40, 95), BPoint(80, 139), BPoint(60, 139)
+	};
+	picture_color(picture, 40, 140, 40);
+	picture.Start(B_PIC_FILL_SHAPE);
+	picture.Add<int32>(2);
+	picture.Add<int32>(4);
+	for (int32 i = 0; i < 2; i++)
+		picture.Add<int32>(ops[i]);
+	for (int32 i = 0; i < 4; i++)
+		picture.Add<BPoint>(points[i]);
+	picture.End();
+
+	picture.Start(B_PIC_SET_CLIPPING_RECTS);
+	picture.Add<int32>(1);
+	picture.Add<BRect>(BRect(90, 90, 160, 115));
+	picture.End();
+	picture.Start(B_PIC_FILL_ELLIPSE);
+	picture.Add<BRect>(BRect(90, 90, 160, 139));
+	picture.End();
+	picture.Start(B_PIC_CLEAR_CLIPPING_RECTS);
+	picture.End();
+}
+
+
+// Each frame draws the picture at four places, then copies it to four more
+static bool write_picture_session(const char* path, int32 frames)
+{
+	SessionWriter session(path);
+	if (!session.InitCheck())
+		return false;
+
+	PictureData picture;
+	write_picture(picture);
+	session.Start(AS_CREATE_PICTURE);
+	session.Attach<int32>(0);
+	session.Attach<int32>(picture.Size());
+	session.Attach(picture.Data(), picture.Size());
+	session.End();
+
+	for (int32 frame = 0; frame < frames; frame++)
+	{
+		for (int32 i = 0; i < 4; i++)
+		{
+			session.Start(AS_LAYER_DRAW_PICTURE);
+			session.Attach<int32>(1);
+			session.Attach<BPoint>(BPoint(5 + i * 195, 20 + frame % 10));
+			session.End();
+		}
+
+		for (int32 i = 0; i < 4; i++)
+		{
+			BRect source(5 + i * 195, 20 + frame % 10, 204 + i * 195,
+				159 + frame % 10);
+			session.Start(AS_LAYER_COPY_BITS);
+			session.Attach<BRect>(source);
+			session.Attach<BRect>(BRect(source.left, source.top + 200,
+				source.right, source.bottom + 200));
+			session.End();
+		}
+
+		session.Start(AS_SYNC);
+		session.End();
+	}
+
+	return true;
+}
+
+
+static int run_and_wait(const char* const* args, bigtime_t timeout)
+{
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		execv(args[0], (char* const*)args);
+		_exit(127);
+	}
+	if (pid < 0)
+		return -1;
+
+	bigtime_t end = system_time() + timeout;
+	int status;
+	while (waitpid(pid, &status, WNOHANG) == 0)
+	{
+		if (system_time() > end)
+		{
+			kill(pid, SIGKILL);
+			waitpid(pid, &status, 0);
+			return -1;
+		}
+		snooze(20000);
+	}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+
+static bool file_has_data(const char* path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 && st.st_size > 0;
+}
+
+
+static void test_replay(const char* server, const char* mode)
+{
+	check(write_session(SESSION_PATH, SESSION_FRAMES), "write synthetic session");
+
+	unlink(REPLAY_PNG);
+	const char* args[] = { server, "--replay", SESSION_PATH, "--loops", REPLAY_LOOPS,
+		"--mode", mode, "--dump", REPLAY_PNG, NULL };
+	check(run_and_wait(args, 120000000LL) == 0, "replay session");
+	check(file_has_data(REPLAY_PNG), "replay frame saved");
+}
+
+
+static void test_picture_replay(const char* server, const char* mode)
+{
+	check(write_picture_session(PICTURE_SESSION, SESSION_FRAMES),
+		"write picture session");
+
+	unlink(PICTURE_PNG);
+	const char* args[] = { server, "--replay", PICTURE_SESSION, "--loops", REPLAY_LOOPS,
+		"--mode", mode, "--dump", PICTURE_PNG, NULL };
+	check(run_and_wait(args, 120000000LL) == 0, "replay picture session");
+	check(file_has_data(PICTURE_PNG), "picture frame saved");
+}
+
+
+static void test_server(const char* server, const char* mode)
+{
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		setenv(HEADLESS_MODE_VARIABLE, mode, 1);
+		execl(server, server, NULL);
+		_exit(127);
+	}
+	check(pid > 0, "start headless server");
+	if (pid <= 0)
+		return;
+
+	HeadlessInjector injector;
+	status_t err = injector.WaitForServer(20000000LL);
+	check(err == B_OK, "server ready");
+
+	if (err == B_OK)
+	{
+		for (int32 i = 0; i < 50; i++)
+			injector.MouseMoved(BPoint(10 + i * 8, 10 + i * 6));
+
+		check(injector.Click(BPoint(400, 300)) == B_OK, "inject click");
+		check(injector.KeyDown(0x26) == B_OK && injector.KeyUp(0x26) == B_OK,
+			"inject key");
+
+		int32 updates = 0;
+		int64 pixels = 0;
+		BRect bounds;
+		color_space space;
+		err = injector.GetFrameInfo(&updates, &pixels, &bounds, &space);
+		check(err == B_OK, "get frame info");
+		if (err == B_OK)
+		{
+			printf("    %ld updates covering %Ld pixels on a %.0fx%.0f frame\n",
+				updates, pixels, bounds.Width() + 1, bounds.Height() + 1);
+		}
+
+		unlink(SERVER_PNG);
+		check(injector.DumpFrame(SERVER_PNG) == B_OK && file_has_data(SERVER_PNG),
+			"server frame saved");
+		check(injector.Quit() == B_OK, "ask server to quit");
+	}
+
+	bigtime_t end = system_time() + 10000000LL;
+	int status;
+	bool exited = false;
+	while (system_time() < end)
+	{
+		if (waitpid(pid, &status, WNOHANG) == pid)
+		{
+			exited = true;
+			break;
+		}
+		snooze(20000);
+	}
+	if (!exited)
+	{
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+	}
+	check(exited, "server quit");
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* server = argc > 1 ? argv[1] : DEFAULT_SERVER;
+	const char* mode = argc > 2 ? argv[2] : "800x600x32";
+
+	if (access(server, X_OK) != 0)
+	{
+		printf("usage: testheadless [APPSERVER] [WIDTHxHEIGHTxDEPTH]\n"
+			"can't run %s\n", server);
+		return 1;
+	}
+
+	test_replay(server, mode);
+	test_picture_replay(server, mode);
+	test_server(server, mode);
+
+	printf("%s\n", failures ? "FAILED" : "all tests passed");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+#include <image.h>
+
+// Project Includes ------------------------------------------------------------
+
+// Local Includes --------------------------------------------------------------
+
+// Local Defines ---------------------------------------------------------------
+#define WARM_RUNS	50
+
+// Globals ---------------------------------------------------------------------
+
+// Measures how long it takes to get a team started and finished through
+// load_image()/resume_thread(), next to the fork()/exec() it replaces.
+// "Cold" runs first evict the executable from the page cache, so they
+// include reading it back from disk; "warm" runs don't.
+
+// There is no strerror() for status_t codes, so name the ones load_image()
+// returns.
+static const char* launch_error(status_t error)
+{
+	switch (error)
+	{
+		case B_BAD_VALUE:			return "bad value";
+		case B_NO_MEMORY:			return "no memory";
+		case B_NO_MORE_FDS:			return "no more file descriptors";
+		case B_NO_MORE_THREADS:		return "no more threads";
+		case B_ENTRY_NOT_FOUND:		return "entry not found";
+		case B_NOT_AN_EXECUTABLE:	return "not an executable";
+		default:					return "unknown error";
+	}
+}
+
+
+static void evict(const char* path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd >= 0)
+	{
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+
+static bigtime_t launch_image(const char* path)
+{
+	const char* args[] = { path, NULL };
+	bigtime_t start = system_time();
+
+	thread_id thread = load_image(1, args, (const char**)environ);
+	if (thread < 0)
+	{
+		printf("load_image(%s) failed: %s (%lx)\n", path, launch_error(thread),
+			   thread);
+		exit(1);
+	}
+
+	status_t result;
+	resume_thread(thread);
+	wait_for_thread(thread, &result);
+	bigtime_t elapsed = system_time() - start;
+
+	// reaping the team must free its thread slot
+	thread_info info;
+	if (get_thread_info(thread, &info) == B_OK)
+	{
+		printf("FAIL thread %ld of %s still in the thread table\n", thread,
+			   path);
+		exit(1);
+	}
+
+	return elapsed;
+}
+
+
+static bigtime_t launch_fork(const char* path)
+{
+	bigtime_t start = system_time();
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		execl(path, path, NULL);
+		_exit(1);
+	}
+	waitpid(pid, NULL, 0);
+
+	return system_time() - start;
+}
+
+
+static void run(const char* label, const char* path,
+				bigtime_t (*launch)(const char*))
+{
+	evict(path);
+	bigtime_t cold = launch(path);
+
+	bigtime_t warm = 0;
+	for (int i = 0; i < WARM_RUNS; i++)
+	{
+		warm += launch(path);
+	}
+
+	printf("%-12s cold: %6lld us   warm: %6lld us (avg of %d)\n", label, cold,
+		   warm / WARM_RUNS, WARM_RUNS);
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "/bin/true";
+
+	printf("launch latency for %s\n", path);
+	run("load_image", path, launch_image);
+	run("fork/exec", path, launch_fork);
+
+	return 0;
+}
@@ -0,0 +1,499 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+#include <image.h>
+#include <Application.h>
+#include <Box.h>
+#include <Button.h>
+#include <DataIO.h>
+#include <Looper.h>
+#include <Message.h>
+#include <Messenger.h>
+#include <StringView.h>
+#include <View.h>
+
+// Project Includes ------------------------------------------------------------
+#include <HeadlessInjector.h>
+#include <RegistrarDefs.h>
+
+// Local Includes --------------------------------------------------------------
+
+// Local Defines ---------------------------------------------------------------
+#define RUNS		2000
+#define SEND_RUNS	5000
+#define MAX_FIELDS	200
+#define SERVER		"../../servers/app/objs/appserver"
+#define REGISTRAR	"../../servers/registrar/registrar"
+#define SERVER_MODE	"640x480x32"
+
+// Globals ---------------------------------------------------------------------
+static char gNames[MAX_FIELDS][16];
+
+// Baseline numbers for BMessage, to measure changes to Message.cpp and
+// MessageBody.cpp against (testmsgcorpus checks they don't break anything):
+//
+//	fields		AddInt32()/FindInt32() and AddString()/FindString()
+//	copy		the copy constructor
+//	flatten		Flatten()/Unflatten(), in memory and through a BDataIO
+//	send		SendMessage() to a looper in this team and in another one
+//	archive		Archive()/Instantiate() of a typical BView tree
+//
+// Run "testmsgbench <section>..." to only run some of them.  All times are
+// per operation, in microseconds.  BViews are made with colors from the
+// app_server, so the archive section starts a headless app_server and a
+// registrar for its BApplication, and is skipped if it can't.
+
+static void report(const char* label, int fields, bigtime_t time, int runs)
+{
+	printf("%-24s %3d fields %9.3f us\n", label, fields, (double)time / runs);
+}
+
+
+static void fill(BMessage* message, int fields)
+{
+	for (int i = 0; i < fields; i++)
+	{
+		if (i % 2)
+		{
+			message->AddString(gNames[i], "value");
+		}
+		else
+		{
+			message->AddInt32(gNames[i], i);
+		}
+	}
+}
+
+
+static void bench_fields(int fields)
+{
+	int runs = RUNS * 10 / fields;
+
+	bigtime_t addTime = 0;
+	bigtime_t findTime = 0;
+	for (int run = 0; run < runs; run++)
+	{
+		BMessage message;
+
+		bigtime_t start = system_time();
+		fill(&message, fields);
+		addTime += system_time() - start;
+
+		start = system_time();
+		int32 value;
+		const char* string;
+		for (int i = 0; i < fields; i++)
+		{
+			if (i % 2)
+			{
+				message.FindString(gNames[i], &string);
+			}
+			else
+			{
+				message.FindInt32(gNames[i], &value);
+			}
+		}
+		findTime += system_time() - start;
+	}
+
+	report("AddX()", fields, addTime, runs * fields);
+	report("FindX()", fields, findTime, runs * fields);
+}
+
+
+static void bench_copy(int fields)
+{
+	BMessage message('copy');
+	fill(&message, fields);
+
+	bigtime_t start = system_time();
+	for (int run = 0; run < RUNS; run++)
+	{
+		BMessage copy(message);
+	}
+	report("copy constructor", fields, system_time() - start, RUNS);
+}
+
+
+static void bench_flatten(int fields)
+{
+	BMessage message('flat');
+	fill(&message, fields);
+
+	ssize_t size = message.FlattenedSize();
+	char* buffer = new char[size];
+
+	bigtime_t start = system_time();
+	for (int run = 0; run < RUNS; run++)
+	{
+		message.Flatten(buffer, message.FlattenedSize());
+	}
+	report("Flatten(char*)", fields, system_time() - start, RUNS);
+
+	start = system_time();
+	for (int run = 0; run < RUNS; run++)
+	{
+		BMessage copy;
+		copy.Unflatten(buffer);
+	}
+	report("Unflatten(char*)", fields, system_time() - start, RUNS);
+
+	BMallocIO stream;
+	start = system_time();
+	for (int run = 0; run < RUNS; run++)
+	{
+		stream.Seek(0, SEEK_SET);
+		message.Flatten(&stream);
+	}
+	report("Flatten(BDataIO*)", fields, system_time() - start, RUNS);
+
+	start = system_time();
+	for (int run = 0; run < RUNS; run++)
+	{
+		BMemoryIO input(buffer, size);
+		BMessage copy;
+		copy.Unflatten(&input);
+	}
+	report("Unflatten(BDataIO*)", fields, system_time() - start, RUNS);
+
+	delete[] buffer;
+}
+
+
+class TCounter : public BLooper
+{
+	public:
+		TCounter() : BLooper("msgbench counter"), fCount(0) {;}
+
+		virtual void MessageReceived(BMessage* message)
+		{
+			// The sender is waiting on this to know everything before it
+			// was handled
+			if (message->what == 'sync')
+			{
+				BMessage reply('done');
+				reply.AddInt32("count", fCount);
+				message->SendReply(&reply);
+				fCount = 0;
+				return;
+			}
+			fCount++;
+		}
+
+	private:
+		int32	fCount;
+};
+
+
+static void bench_send_to(const char* label, BMessenger& target, int fields)
+{
+	BMessage message('send');
+	fill(&message, fields);
+
+	bigtime_t start = system_time();
+	for (int run = 0; run < SEND_RUNS; run++)
+	{
+		target.SendMessage(&message);
+	}
+
+	BMessage sync('sync');
+	BMessage reply;
+	target.SendMessage(&sync, &reply);
+	bigtime_t time = system_time() - start;
+
+	int32 count = 0;
+	reply.FindInt32("count", &count);
+	if (count != SEND_RUNS)
+	{
+		printf("%s: only %ld of %d messages arrived\n", label, count,
+			   SEND_RUNS);
+	}
+	report(label, fields, time, SEND_RUNS);
+}
+
+
+static int run_remote(int fd)
+{
+	// Runs in the other team: hand our messenger over the pipe, then keep
+	// counting until told to quit
+	TCounter* counter = new TCounter;
+	thread_id thread = counter->Run();
+
+	BMessage address;
+	address.AddMessenger("target", BMessenger(counter));
+	ssize_t size = address.FlattenedSize();
+	char* buffer = new char[size];
+	address.Flatten(buffer, size);
+	write(fd, &size, sizeof (size));
+	write(fd, buffer, size);
+	close(fd);
+	delete[] buffer;
+
+	status_t result;
+	wait_for_thread(thread, &result);
+	return 0;
+}
+
+
+static void bench_send(const char* self, int fields)
+{
+	TCounter* counter = new TCounter;
+	counter->Run();
+	BMessenger local(counter);
+	bench_send_to("SendMessage() local", local, fields);
+	local.SendMessage(B_QUIT_REQUESTED);
+
+	int fds[2];
+	if (pipe(fds) < 0)
+		return;
+
+	char fd[16];
+	sprintf(fd, "%d", fds[1]);
+	const char* args[] = { self, "--remote", fd, NULL };
+	thread_id thread = load_image(3, args, (const char**)environ);
+	close(fds[1]);
+	if (thread < 0)
+	{
+		printf("can't start the remote looper: %s\n", strerror(thread));
+		close(fds[0]);
+		return;
+	}
+	thread_info info;
+	get_thread_info(thread, &info);
+	resume_thread(thread);
+
+	ssize_t size = 0;
+	read(fds[0], &size, sizeof (size));
+	char* buffer = new char[size];
+	ssize_t bytesRead = read(fds[0], buffer, size);
+	close(fds[0]);
+
+	BMessage address;
+	BMessenger remote;
+	if (bytesRead == size && address.Unflatten(buffer) == B_OK &&
+		address.FindMessenger("target", &remote) == B_OK)
+	{
+		bench_send_to("SendMessage() remote", remote, fields);
+		remote.SendMessage(B_QUIT_REQUESTED);
+	}
+	else
+	{
+		printf("no messenger from the remote looper\n");
+		kill((pid_t)info.team, SIGTERM);
+	}
+	waitpid((pid_t)info.team, NULL, 0);
+	delete[] buffer;
+}
+
+
+static BView* view_tree()
+{
+	// A window's worth of controls: boxes of buttons with labels
+	BView* top = new BView(BRect(0, 0, 400, 300), "top", B_FOLLOW_ALL,
+						   B_WILL_DRAW);
+	for (int i = 0; i < 5; i++)
+	{
+		BBox* box = new BBox(BRect(10, 10 + i * 55, 390, 60 + i * 55), "box");
+		box->SetLabel("Settings");
+		for (int j = 0; j < 5; j++)
+		{
+			BRect frame(10 + j * 70, 20, 70 + j * 70, 40);
+			if (j % 2)
+			{
+				box->AddChild(new BStringView(frame, "label", "Label:"));
+			}
+			else
+			{
+				box->AddChild(new BButton(frame, "button", "OK",
+										  new BMessage('invk')));
+			}
+		}
+		top->AddChild(box);
+	}
+	return top;
+}
+
+
+// Starts a program, with its output thrown away unless it is ourselves
+static pid_t start(const char* path, const char* arg, const char* mode,
+				   bool quiet)
+{
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		if (quiet)
+		{
+			int null = open("/dev/null", O_WRONLY);
+			dup2(null, 1);
+			dup2(null, 2);
+		}
+		if (mode)
+			setenv(HEADLESS_MODE_VARIABLE, mode, 1);
+		execl(path, path, arg, NULL);
+		_exit(127);
+	}
+	return pid;
+}
+
+
+static void stop(pid_t pid)
+{
+	bigtime_t end = system_time() + 5000000LL;
+	while (system_time() < end)
+	{
+		if (waitpid(pid, NULL, WNOHANG) == pid)
+			return;
+		snooze(20000);
+	}
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+}
+
+
+static int run_archive()
+{
+	// Runs in a team of its own started once the registrar is up, since
+	// be_roster is only set up when a team starts
+	BApplication app("application/x-vnd.cosmoe-testmsgbench");
+	if (app.InitCheck() != B_OK)
+	{
+		printf("archive: no BApplication, skipped\n");
+		return 1;
+	}
+
+	BView* top = view_tree();
+
+	BMessage archive;
+	bigtime_t start = system_time();
+	for (int run = 0; run < RUNS / 10; run++)
+	{
+		archive.MakeEmpty();
+		top->Archive(&archive, true);
+	}
+	report("Archive() view tree", archive.CountNames(B_ANY_TYPE),
+		   system_time() - start, RUNS / 10);
+
+	// Children are instantiated through instantiate_object(), which only
+	// finds those it can look up by symbol name
+	start = system_time();
+	for (int run = 0; run < RUNS / 10; run++)
+	{
+		delete BView::Instantiate(&archive);
+	}
+	report("Instantiate() view tree", archive.CountNames(B_ANY_TYPE),
+		   system_time() - start, RUNS / 10);
+
+	delete top;
+	return 0;
+}
+
+
+static void bench_archive(const char* self)
+{
+	if (access(SERVER, X_OK) != 0 || access(REGISTRAR, X_OK) != 0)
+	{
+		printf("archive: no %s or %s, skipped\n", SERVER, REGISTRAR);
+		return;
+	}
+
+	pid_t server = start(SERVER, NULL, SERVER_MODE, true);
+	HeadlessInjector injector;
+	if (server < 0 || injector.WaitForServer(20000000LL) != B_OK)
+	{
+		printf("archive: the app_server didn't start, skipped\n");
+		if (server > 0)
+		{
+			kill(server, SIGKILL);
+			waitpid(server, NULL, 0);
+		}
+		return;
+	}
+
+	pid_t registrar = start(REGISTRAR, NULL, NULL, true);
+	bigtime_t end = system_time() + 10000000LL;
+	while (registrar > 0 && find_port(kRosterPortName) < 0 &&
+		   system_time() < end)
+	{
+		snooze(20000);
+	}
+
+	if (find_port(kRosterPortName) >= 0)
+	{
+		pid_t bench = start(self, "--archive", NULL, false);
+		if (bench > 0)
+			waitpid(bench, NULL, 0);
+	}
+	else
+		printf("archive: the registrar didn't start, skipped\n");
+
+	if (registrar > 0)
+	{
+		kill(registrar, SIGTERM);
+		stop(registrar);
+	}
+	injector.Quit();
+	stop(server);
+}
+
+
+static bool wanted(int argc, char** argv, const char* section)
+{
+	if (argc < 2)
+		return true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], section) == 0)
+			return true;
+	}
+	return false;
+}
+
+
+int main(int argc, char** argv)
+{
+	if (argc == 3 && strcmp(argv[1], "--remote") == 0)
+		return run_remote(atoi(argv[2]));
+	if (argc == 2 && strcmp(argv[1], "--archive") == 0)
+		return run_archive();
+
+	for (int i = 0; i < MAX_FIELDS; i++)
+	{
+		sprintf(gNames[i], "field %d", i);
+	}
+
+	const int counts[] = { 1, 10, 50, MAX_FIELDS };
+	const int numCounts = sizeof (counts) / sizeof (counts[0]);
+
+	for (int i = 0; i < numCounts && wanted(argc, argv, "fields"); i++)
+	{
+		bench_fields(counts[i]);
+	}
+	for (int i = 0; i < numCounts && wanted(argc, argv, "copy"); i++)
+	{
+		bench_copy(counts[i]);
+	}
+	for (int i = 0; i < numCounts && wanted(argc, argv, "flatten"); i++)
+	{
+		bench_flatten(counts[i]);
+	}
+	for (int i = 0; i < 2 && wanted(argc, argv, "send"); i++)
+	{
+		bench_send(argv[0], counts[i]);
+	}
+	if (wanted(argc, argv, "archive"))
+	{
+		bench_archive(argv[0]);
+	}
+
+	return 0;
+}
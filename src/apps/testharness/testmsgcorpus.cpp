@@ -0,0 +1,393 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+#include <DataIO.h>
+#include <Entry.h>
+#include <Message.h>
+#include <Messenger.h>
+
+// Project Includes ------------------------------------------------------------
+#include <MessagePrivate.h>
+
+// Local Includes --------------------------------------------------------------
+#include "TestHarness.h"
+
+// Local Defines ---------------------------------------------------------------
+#define MUTATIONS	1000
+
+// Globals ---------------------------------------------------------------------
+
+// Correctness corpus for BMessage flattening.  Every message of the corpus
+// must come back byte for byte from the old format (through memory and
+// through a BDataIO) and from the compact one, and mangled copies of it must
+// be refused or read back into something that is itself stable; they must
+// never crash.  The mutations are seeded, so a failure always reproduces.
+//
+//	testmsgcorpus				check the built-in corpus
+//	testmsgcorpus -w <dir>		also save the corpus, flattened, into <dir>
+//	testmsgcorpus <dir>			check messages saved by an earlier build
+//
+// Saving the corpus before reworking Message.cpp/MessageBody.cpp and
+// checking it afterwards shows that nothing already out there changed.
+
+static void add_every_type(BMessage* message)
+{
+	message->AddBool("bool", true);
+	message->AddInt8("int8", -8);
+	message->AddInt16("int16", -16);
+	message->AddInt32("int32", -32);
+	message->AddInt64("int64", -64);
+	message->AddFloat("float", 1.5);
+	message->AddDouble("double", 2.25);
+	message->AddString("string", "string");
+	message->AddPoint("point", BPoint(1, 2));
+	message->AddRect("rect", BRect(1, 2, 3, 4));
+	message->AddPointer("pointer", (const void*)0x1234);
+	message->AddMessenger("messenger", BMessenger());
+
+	entry_ref ref(3, 1000, "file");
+	message->AddRef("ref", &ref);
+
+	const char raw[] = { 0, 1, 2, 3, 4, 5, 6 };
+	message->AddData("raw", B_RAW_TYPE, raw, sizeof (raw));
+
+	uint32 value = 0xdeadbeef;
+	message->AddData("uint32", B_UINT32_TYPE, &value, sizeof (value));
+}
+
+
+static void build_corpus(BMessage* corpus, int* count)
+{
+	int n = 0;
+
+	// Empty messages, with and without a what
+	corpus[n++] = BMessage();
+	corpus[n++] = BMessage('_QRY');
+
+	// One item of every type, then several
+	corpus[n].what = 'ones';
+	add_every_type(&corpus[n++]);
+	corpus[n].what = 'many';
+	for (int i = 0; i < 3; i++)
+	{
+		add_every_type(&corpus[n]);
+	}
+	n++;
+
+	// Fields just under and over what fits the one byte counts
+	corpus[n].what = 'mini';
+	for (int i = 0; i < 255; i++)
+	{
+		corpus[n].AddInt8("255 items", i);
+	}
+	for (int i = 0; i < 256; i++)
+	{
+		corpus[n].AddInt8("256 items", i);
+	}
+	char text[300];
+	memset(text, 'x', sizeof (text));
+	text[sizeof (text) - 1] = '\0';
+	corpus[n].AddString("long string", text);
+	text[200] = '\0';
+	corpus[n].AddString("short strings", text);
+	corpus[n].AddString("short strings", text);
+	corpus[n].AddString("empty string", "");
+	n++;
+
+	// Long names and many fields
+	corpus[n].what = 'name';
+	char name[256];
+	memset(name, 'n', sizeof (name));
+	name[255] = '\0';
+	corpus[n].AddInt32(name, 255);
+	for (int i = 0; i < 200; i++)
+	{
+		sprintf(name, "field %d", i);
+		corpus[n].AddInt32(name, i);
+	}
+	n++;
+
+	// Nested messages, several levels deep
+	BMessage inner('innr');
+	add_every_type(&inner);
+	BMessage middle('midl');
+	middle.AddMessage("inner", &inner);
+	middle.AddMessage("inner", &inner);
+	middle.AddString("label", "middle");
+	corpus[n].what = 'nest';
+	corpus[n].AddMessage("middle", &middle);
+	corpus[n].AddMessage("empty", &corpus[0]);
+	n++;
+
+	// Scripting messages
+	corpus[n].what = B_GET_PROPERTY;
+	corpus[n].AddSpecifier("Frame");
+	corpus[n].AddSpecifier("View", 3);
+	corpus[n].AddSpecifier("Window", "main");
+	n++;
+
+	*count = n;
+}
+
+
+static void flatten(const BMessage& message, BMallocIO* buffer)
+{
+	buffer->Seek(0, SEEK_SET);
+	buffer->SetSize(0);
+	message.Flatten(buffer);
+}
+
+
+static bool same(const BMallocIO& a, const BMallocIO& b)
+{
+	return a.BufferLength() == b.BufferLength() &&
+		   memcmp(a.Buffer(), b.Buffer(), a.BufferLength()) == 0;
+}
+
+
+static void check_round_trip(const char* label, const char* flat,
+							 ssize_t size)
+{
+	BMallocIO original;
+	original.Write(flat, size);
+
+	// Through memory
+	BMessage message;
+	if (message.Unflatten(flat) != B_OK)
+	{
+		fail(label, "doesn't unflatten");
+		return;
+	}
+	if (message.FlattenedSize() != size)
+	{
+		fail(label, "FlattenedSize() changed");
+	}
+	BMallocIO copy;
+	flatten(message, &copy);
+	if (!same(original, copy))
+	{
+		fail(label, "changed going through memory");
+	}
+
+	// Through a stream
+	BMemoryIO stream(flat, size);
+	BMessage streamed;
+	if (streamed.Unflatten(&stream) != B_OK)
+	{
+		fail(label, "doesn't unflatten from a stream");
+	}
+	flatten(streamed, &copy);
+	if (!same(original, copy))
+	{
+		fail(label, "changed going through a stream");
+	}
+
+	// Through the compact format
+	BMallocIO compact;
+	BMessage::Private(message).FlattenCompact(&compact);
+	BMessage fromCompact;
+	if (fromCompact.Unflatten((const char*)compact.Buffer()) != B_OK)
+	{
+		fail(label, "doesn't unflatten from the compact format");
+	}
+	flatten(fromCompact, &copy);
+	if (!same(original, copy))
+	{
+		fail(label, "changed going through the compact format");
+	}
+}
+
+
+static uint32 gSeed;
+
+static uint32 next_random()
+{
+	gSeed = gSeed * 1103515245 + 12345;
+	return gSeed >> 8;
+}
+
+
+static void mutate(char* flat, ssize_t* size)
+{
+	if (*size == 0)
+		return;
+
+	switch (next_random() % 4)
+	{
+		case 0:		// flip a bit
+			flat[next_random() % *size] ^= 1 << (next_random() % 8);
+			break;
+		case 1:		// clobber a byte
+			flat[next_random() % *size] = next_random() % 2 ? 0xff : 0x00;
+			break;
+		case 2:		// make a length or count huge
+		{
+			ssize_t at = next_random() % *size;
+			memset(flat + at, 0x7f, min_c(2, *size - at));
+			break;
+		}
+		case 3:		// cut it short
+			*size = next_random() % *size;
+			break;
+	}
+}
+
+
+static void check_mutations(const char* label, const char* flat,
+							ssize_t size, bool compact)
+{
+	char* buffer = new char[size];
+
+	for (int i = 0; i < MUTATIONS; i++)
+	{
+		ssize_t mutatedSize = size;
+		memcpy(buffer, flat, size);
+		mutate(buffer, &mutatedSize);
+		if (next_random() % 2)
+		{
+			mutate(buffer, &mutatedSize);
+		}
+
+		// Whatever it reads must be something it can write back and read
+		// again the same way
+		BMemoryIO stream(buffer, mutatedSize);
+		BMessage message;
+		if (message.Unflatten(&stream) != B_OK)
+			continue;
+
+		BMallocIO first;
+		BMallocIO second;
+		flatten(message, &first);
+		BMessage again;
+		if (again.Unflatten((const char*)first.Buffer()) != B_OK)
+		{
+			fail(label, compact ? "compact mutation not stable" :
+				 "mutation not stable");
+			continue;
+		}
+		flatten(again, &second);
+		if (!same(first, second))
+		{
+			fail(label, compact ? "compact mutation not stable" :
+				 "mutation not stable");
+		}
+	}
+
+	delete[] buffer;
+}
+
+
+static void check(const char* label, const char* flat, ssize_t size)
+{
+	check_round_trip(label, flat, size);
+
+	BMessage message;
+	if (message.Unflatten(flat) != B_OK)
+		return;
+
+	check_mutations(label, flat, size, false);
+
+	BMallocIO compact;
+	BMessage::Private(message).FlattenCompact(&compact);
+	check_mutations(label, (const char*)compact.Buffer(), compact.Position(),
+					true);
+}
+
+
+static int check_saved(const char* dir)
+{
+	int checked = 0;
+	for (int i = 0; ; i++)
+	{
+		char path[B_PATH_NAME_LENGTH];
+		sprintf(path, "%s/msg%03d", dir, i);
+		FILE* file = fopen(path, "rb");
+		if (!file)
+			break;
+
+		char* flat = NULL;
+		ssize_t size = 0;
+		char chunk[4096];
+		size_t read;
+		while ((read = fread(chunk, 1, sizeof (chunk), file)) > 0)
+		{
+			flat = (char*)realloc(flat, size + read);
+			memcpy(flat + size, chunk, read);
+			size += read;
+		}
+		fclose(file);
+
+		check(path, flat, size);
+		free(flat);
+		checked++;
+	}
+
+	return checked;
+}
+
+
+static void save(const char* dir, int index, const BMallocIO& flat)
+{
+	char path[B_PATH_NAME_LENGTH];
+	sprintf(path, "%s/msg%03d", dir, index);
+	FILE* file = fopen(path, "wb");
+	if (!file || fwrite(flat.Buffer(), 1, flat.BufferLength(), file) !=
+		flat.BufferLength())
+	{
+		printf("can't write %s: %s\n", path, strerror(errno));
+		exit(2);
+	}
+	fclose(file);
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* saveDir = NULL;
+	if (argc == 3 && strcmp(argv[1], "-w") == 0)
+	{
+		saveDir = argv[2];
+		mkdir(saveDir, 0755);
+	}
+	else if (argc == 2)
+	{
+		int checked = check_saved(argv[1]);
+		printf("%d saved messages checked, %d failures\n", checked,
+			   gFailures);
+		return gFailures ? 1 : 0;
+	}
+
+	BMessage corpus[16];
+	int count;
+	build_corpus(corpus, &count);
+
+	for (int i = 0; i < count; i++)
+	{
+		char label[32];
+		sprintf(label, "corpus %d", i);
+		gSeed = i;
+
+		BMallocIO flat;
+		flatten(corpus[i], &flat);
+		if (flat.BufferLength() != (size_t)corpus[i].FlattenedSize())
+		{
+			fail(label, "FlattenedSize() doesn't match Flatten()");
+		}
+		check(label, (const char*)flat.Buffer(), flat.BufferLength());
+
+		if (saveDir)
+		{
+			save(saveDir, i, flat);
+		}
+	}
+
+	printf("%d messages, %d mutations each, %d failures\n", count,
+		   MUTATIONS * 2, gFailures);
+	return gFailures ? 1 : 0;
+}
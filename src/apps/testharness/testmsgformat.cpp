@@ -0,0 +1,177 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+#include <DataIO.h>
+#include <Entry.h>
+#include <Message.h>
+#include <View.h>
+
+// Project Includes ------------------------------------------------------------
+#include <MessagePrivate.h>
+
+// Local Includes --------------------------------------------------------------
+
+// Local Defines ---------------------------------------------------------------
+#define RUNS	2000
+
+// Globals ---------------------------------------------------------------------
+
+// Compares the old ('FOB1') and the compact ('FOB2') flattened message
+// formats: size, flatten and unflatten time.  The messages are shaped like
+// the ones the system really writes: a BView tree archive, the registrar's
+// recent documents list, and a B_MOUSE_MOVED as sent by the app_server.
+// Every message is also checked to come back byte for byte from the compact
+// format.
+
+static void archive_view(BMessage* archive, const char* className,
+						 const char* name, BRect frame, int depth)
+{
+	archive->AddString("class", className);
+	archive->AddString("class", "BView");
+	archive->AddString("class", "BHandler");
+	archive->AddString("_name", name);
+	archive->AddRect("_frame", frame);
+	archive->AddInt32("_resize_mode", 0x1234);
+	archive->AddInt32("_flags", 0x20000000);
+	archive->AddString("_fname", "Swis721 BT");
+	archive->AddString("_fname", "Roman");
+	archive->AddFloat("_fflt", 12.0);
+	archive->AddFloat("_fflt", 90.0);
+	archive->AddFloat("_fflt", 0.0);
+	archive->AddInt32("_color", 0x000000ff);
+	archive->AddInt32("_color", 0xd8d8d8ff);
+	archive->AddInt32("_color", 0xd8d8d8ff);
+
+	if (depth == 0)
+	{
+		BMessage message('invk');
+		message.AddInt32("index", 3);
+		archive->AddString("_label", "Cancel");
+		archive->AddMessage("_msg", &message);
+		return;
+	}
+
+	for (int i = 0; i < 5; i++)
+	{
+		char childName[32];
+		sprintf(childName, "%s child %d", name, i);
+
+		BMessage child;
+		archive_view(&child, depth == 1 ? "BButton" : "BBox", childName,
+					 BRect(10, 10 + i * 30, 110, 35 + i * 30), depth - 1);
+		archive->AddMessage("_views", &child);
+	}
+}
+
+
+static void recent_documents(BMessage* settings)
+{
+	for (int i = 0; i < 20; i++)
+	{
+		char name[B_FILE_NAME_LENGTH];
+		sprintf(name, "Letter to the editor, draft %d", i);
+
+		BMessage document;
+		entry_ref ref(3, 1000 + i, name);
+		document.AddRef("ref", &ref);
+		document.AddString("app", "application/x-vnd.Be-STEE");
+		document.AddInt64("when", 1040000000000000LL + i);
+		settings->AddMessage("document", &document);
+	}
+}
+
+
+static void mouse_moved(BMessage* message)
+{
+	message->what = B_MOUSE_MOVED;
+	message->AddInt64("when", 1040000000000000LL);
+	message->AddPoint("where", BPoint(312, 188));
+	message->AddInt32("buttons", 0);
+	message->AddInt32("be:transit", B_INSIDE_VIEW);
+	message->AddPoint("be:view_where", BPoint(40, 12));
+}
+
+
+static void run(const char* label, BMessage& message)
+{
+	ssize_t oldSize = message.FlattenedSize();
+	char* oldBuffer = new char[oldSize];
+
+	bigtime_t start = system_time();
+	for (int i = 0; i < RUNS; i++)
+	{
+		message.Flatten(oldBuffer, message.FlattenedSize());
+	}
+	bigtime_t oldFlatten = system_time() - start;
+
+	BMallocIO compact;
+	start = system_time();
+	for (int i = 0; i < RUNS; i++)
+	{
+		compact.Seek(0, SEEK_SET);
+		BMessage::Private(message).FlattenCompact(&compact);
+	}
+	bigtime_t newFlatten = system_time() - start;
+	ssize_t newSize = compact.Position();
+	const char* newBuffer = (const char*)compact.Buffer();
+
+	BMessage copy;
+	start = system_time();
+	for (int i = 0; i < RUNS; i++)
+	{
+		copy.Unflatten(oldBuffer);
+	}
+	bigtime_t oldUnflatten = system_time() - start;
+
+	start = system_time();
+	for (int i = 0; i < RUNS; i++)
+	{
+		copy.Unflatten(newBuffer);
+	}
+	bigtime_t newUnflatten = system_time() - start;
+
+	// The compact format must lose nothing the old one had
+	bool same = copy.FlattenedSize() == oldSize;
+	if (same)
+	{
+		char* check = new char[oldSize];
+		copy.Flatten(check, oldSize);
+		same = memcmp(check, oldBuffer, oldSize) == 0;
+		delete[] check;
+	}
+
+	printf("%-10s size %6ld -> %6ld bytes (%3ld%%)   "
+		   "flatten %5.1f -> %5.1f us   unflatten %5.1f -> %5.1f us   %s\n",
+		   label, oldSize, newSize, newSize * 100 / oldSize,
+		   (double)oldFlatten / RUNS, (double)newFlatten / RUNS,
+		   (double)oldUnflatten / RUNS, (double)newUnflatten / RUNS,
+		   same ? "ok" : "MISMATCH");
+
+	delete[] oldBuffer;
+	if (!same)
+	{
+		exit(1);
+	}
+}
+
+
+int main()
+{
+	BMessage view;
+	archive_view(&view, "BWindow", "main window", BRect(0, 0, 400, 300), 2);
+	run("view tree", view);
+
+	BMessage settings;
+	recent_documents(&settings);
+	run("recent", settings);
+
+	BMessage mouse;
+	mouse_moved(&mouse);
+	run("mouse", mouse);
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+#include <AppDefs.h>
+
+// Project Includes ------------------------------------------------------------
+#include <PortLink.h>
+#include <ServerProtocol.h>
+#include <ServerProfiler.h>
+
+// Local Includes --------------------------------------------------------------
+#include "TestHarness.h"
+
+// Local Defines ---------------------------------------------------------------
+#define DUMP_PATH		"/tmp/testprofiler.txt"
+#define BENCH_MESSAGES	10000000
+
+// Globals ---------------------------------------------------------------------
+
+// Checks the app_server's message profiles: the costliest codes of a profile,
+// a window's profile going to its application's when it closes, the profiles
+// sent in a reply the way AS_GET_PROFILE sends them, and a dump. Then times
+// counting a message, which ServerWindow does for each one while profiling.
+
+
+static void check_top(void)
+{
+	MessageProfile profile("top check", 1, NULL);
+	profile.Add(AS_STROKE_LINE, 40, 10);
+	profile.Add(AS_STROKE_LINE, 40, 10);
+	profile.Add(AS_FILL_RECT, 32, 500);
+	profile.Add(AS_LAYER_DRAW_STRING, 64, 100);
+	profile.Add(B_QUIT_REQUESTED, 12, 1);
+
+	opcode_stats totals;
+	profile.GetTotals(&totals);
+	if (totals.count != 5 || totals.bytes != 188 || totals.time != 621)
+		fail("totals");
+
+	opcode_stats top[8];
+	if (profile.GetTop(top, 8) != 4)
+		fail("codes sent");
+	if (top[0].code != AS_FILL_RECT - SERVER_TRUE
+		|| top[1].code != AS_LAYER_DRAW_STRING - SERVER_TRUE
+		|| top[2].code != AS_STROKE_LINE - SERVER_TRUE
+		|| top[2].count != 2 || top[2].bytes != 80
+		|| top[3].code != PROFILE_CODES)
+		fail("costliest codes first");
+
+	if (profile.GetTop(top, 2) != 2 || top[1].code != AS_LAYER_DRAW_STRING - SERVER_TRUE)
+		fail("top codes only");
+
+	profile.Reset();
+	profile.GetTotals(&totals);
+	if (totals.count != 0 || profile.GetTop(top, 8) != 0)
+		fail("reset");
+}
+
+
+static void check_profiler(void)
+{
+	ServerProfiler profiler;
+	MessageProfile* app = profiler.AddApp("application/x-vnd.test", 7);
+	MessageProfile* window = profiler.AddWindow("test window", app);
+	if (window->App() != app || window->Team() != 7)
+		fail("window profile");
+
+	app->Add(AS_CREATE_BITMAP, 100, 50);
+	for (int32 i = 0; i < 10; i++)
+		window->Add(AS_FILL_RECT, 32, 20);
+
+	// what AS_GET_PROFILE replies, read the way a client would
+	port_id port = create_port(10, "profiler check");
+	BPortLink sender(port);
+	sender.StartMessage(SERVER_TRUE);
+	profiler.Attach(&sender, 4);
+	sender.Flush();
+
+	BPortLink reader(-1, port);
+	int32 code, count = 0;
+	if (reader.GetNextReply(&code) != B_OK || code != SERVER_TRUE)
+		fail("reply");
+	reader.Read<int32>(&count);
+	if (count != 2)
+		fail("profiles in reply");
+	for (int32 i = 0; i < count; i++)
+	{
+		char* name = NULL;
+		team_id team;
+		bool isWindow;
+		opcode_stats totals, stats[4];
+		int32 codes = 0;
+		reader.ReadString(&name);
+		reader.Read<team_id>(&team);
+		reader.Read<bool>(&isWindow);
+		reader.Read<opcode_stats>(&totals);
+		reader.Read<int32>(&codes);
+		if (codes < 0 || codes > 4 || reader.Read(stats, sizeof(opcode_stats) * codes) != B_OK)
+		{
+			fail("codes in reply");
+			free(name);
+			break;
+		}
+		if (isWindow && (strcmp(name, "test window") != 0 || totals.count != 10
+			|| totals.time != 200 || codes != 1
+			|| stats[0].code != AS_FILL_RECT - SERVER_TRUE))
+			fail("window in reply");
+		if (!isWindow && (strcmp(name, "application/x-vnd.test") != 0 || team != 7
+			|| totals.count != 1 || totals.bytes != 100))
+			fail("application in reply");
+		free(name);
+	}
+	delete_port(port);
+
+	// a closed window's messages are the application's
+	profiler.RemoveWindow(window);
+	profiler.RemoveApp(app);
+	opcode_stats totals;
+	app->GetTotals(&totals);
+	if (totals.count != 11 || totals.time != 250)
+		fail("window merged");
+
+	unlink(DUMP_PATH);
+	if (profiler.Dump(DUMP_PATH) != B_OK)
+		fail("dump");
+	FILE* file = fopen(DUMP_PATH, "r");
+	char line[256];
+	bool found = false;
+	while (file && fgets(line, sizeof(line), file))
+	{
+		if (strstr(line, "application/x-vnd.test, team 7, quit"))
+			found = true;
+	}
+	if (file)
+		fclose(file);
+	if (!found)
+		fail("application in dump");
+	unlink(DUMP_PATH);
+
+	if (profiler.Dump("/nonexistent/profile") == B_OK)
+		fail("dump to a bad path");
+}
+
+
+static void bench(void)
+{
+	MessageProfile profile("bench", 1, NULL);
+	int32 codes[4] = { AS_FILL_RECT, AS_STROKE_LINE,
+		AS_LAYER_DRAW_STRING, AS_LAYER_MOVETO };
+
+	bigtime_t start = system_time();
+	for (int32 i = 0; i < BENCH_MESSAGES; i++)
+	{
+		bigtime_t begin = system_time();
+		profile.Add(codes[i & 3], 40, system_time() - begin);
+	}
+	bigtime_t time = system_time() - start;
+
+	opcode_stats totals;
+	profile.GetTotals(&totals);
+	if (totals.count != BENCH_MESSAGES)
+		fail("messages counted");
+
+	printf("counting a message, timed: %.1f ns\n", time * 1000.0 / BENCH_MESSAGES);
+}
+
+
+int main(int argc, char** argv)
+{
+	check_top();
+	check_profiler();
+	bench();
+
+	return test_result();
+}
@@ -0,0 +1,467 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+#include <Region.h>
+
+// Project Includes ------------------------------------------------------------
+#include <ShapeRasterizer.h>
+
+// Local Includes --------------------------------------------------------------
+#include "TestHarness.h"
+
+// Local Defines ---------------------------------------------------------------
+#define GRID_SIZE		256
+#define MIN_TIME		200000
+
+// Globals ---------------------------------------------------------------------
+static uint8 gGrid[GRID_SIZE][GRID_SIZE];
+static uint8 gOther[GRID_SIZE][GRID_SIZE];
+
+// Checks the app_server's shape rasterizers (ShapeRasterizer.cpp) by drawing
+// their spans into a grid: filled ellipses have the area and symmetry they
+// should, the quarters of an ellipse make it up, outlines are on the edge of
+// their shape, polygons cover their outline, and clipping to a region cuts
+// the same pixels out of a shape that the region leaves out, however many
+// rectangles the region has. A shape moved by whole pixels has the same
+// spans moved, which ServerPicture counts on. No shape may
+// have a pixel twice. Then times rasterizing the shapes rounded controls and
+// graphs draw.
+
+
+// Draws the spans into a grid. Returns the number of pixels, or -1 if one
+// of them was drawn twice or was off the grid.
+static int32 draw(SpanList& spans, uint8 grid[GRID_SIZE][GRID_SIZE])
+{
+	memset(grid, 0, GRID_SIZE * GRID_SIZE);
+	int32 pixels = 0;
+	const shape_span* span = spans.Spans();
+	for (int32 i = 0; i < spans.CountSpans(); i++, span++)
+	{
+		if (span->y < 0 || span->y >= GRID_SIZE || span->left < 0
+			|| span->right >= GRID_SIZE || span->left > span->right)
+			return -1;
+		for (int32 x = span->left; x <= span->right; x++)
+		{
+			if (grid[span->y][x]++)
+				return -1;
+			pixels++;
+		}
+	}
+	return pixels;
+}
+
+
+static bool same_grids(void)
+{
+	return memcmp(gGrid, gOther, GRID_SIZE * GRID_SIZE) == 0;
+}
+
+
+static void check_ellipses(void)
+{
+	SpanList spans;
+	for (int32 width = 0; width < 60; width += 3)
+	{
+		for (int32 height = 0; height < 60; height += 5)
+		{
+			BRect r(10, 20, 10 + width, 20 + height);
+			spans.Reset();
+			rasterize_ellipse(spans, r);
+			int32 pixels = draw(spans, gGrid);
+			if (pixels < 0)
+			{
+				fail("ellipse pixels overlap");
+				return;
+			}
+
+			// the area of the ellipse around the pixels it covers
+			double area = M_PI * (width + 1) * (height + 1) / 4;
+			if (fabs(pixels - area) > width + height + 2)
+			{
+				printf("%ldx%ld: %ld pixels, %.1f area\n", width, height,
+					pixels, area);
+				fail("ellipse area");
+			}
+
+			for (int32 y = 20; y <= 20 + height; y++)
+			{
+				for (int32 x = 10; x <= 10 + width; x++)
+				{
+					if (gGrid[y][x] != gGrid[y][20 + width - x]
+						|| gGrid[y][x] != gGrid[40 + height - y][x])
+					{
+						fail("ellipse symmetry");
+						return;
+					}
+				}
+			}
+		}
+	}
+
+	// a round rectangle with no corners is the rectangle
+	spans.Reset();
+	rasterize_round_rect(spans, BRect(5, 5, 14, 24), 0, 0);
+	if (draw(spans, gGrid) != 200)
+		fail("square round rectangle");
+}
+
+
+static void check_arcs(void)
+{
+	SpanList spans;
+	BRect r(20, 30, 120, 90);
+
+	spans.Reset();
+	rasterize_ellipse(spans, r);
+	draw(spans, gOther);
+
+	// the rays are half a pixel wide on each side, so quarters overlap on
+	// the axes: each pixel has to be in at least one of them
+	memset(gGrid, 0, GRID_SIZE * GRID_SIZE);
+	for (int32 quarter = 0; quarter < 4; quarter++)
+	{
+		SpanList arc;
+		uint8 grid[GRID_SIZE][GRID_SIZE];
+		rasterize_arc(arc, r, quarter * 90 + 30, 90);
+		if (draw(arc, grid) < 0)
+		{
+			fail("arc pixels overlap");
+			return;
+		}
+		for (int32 y = 0; y < GRID_SIZE; y++)
+			for (int32 x = 0; x < GRID_SIZE; x++)
+				gGrid[y][x] |= grid[y][x];
+	}
+	if (!same_grids())
+		fail("quarter arcs");
+
+	// spans the other way round, and past a full turn
+	SpanList other;
+	spans.Reset();
+	rasterize_arc(spans, r, 200, -130);
+	rasterize_arc(other, r, 70, 130);
+	draw(spans, gGrid);
+	draw(other, gOther);
+	if (!same_grids())
+		fail("arc spanning clockwise");
+
+	spans.Reset();
+	other.Reset();
+	rasterize_arc(spans, r, 10, 400);
+	rasterize_ellipse(other, r);
+	draw(spans, gGrid);
+	draw(other, gOther);
+	if (!same_grids())
+		fail("arc of a full turn");
+
+	// an arc of more than half the ellipse is all of it but the rest
+	spans.Reset();
+	other.Reset();
+	rasterize_arc(spans, r, 45, 250);
+	if (draw(spans, gGrid) < 0)
+		fail("wide arc pixels overlap");
+	rasterize_arc(other, r, 295, 110);
+	draw(other, gOther);
+	for (int32 y = 0; y < GRID_SIZE; y++)
+		for (int32 x = 0; x < GRID_SIZE; x++)
+			gOther[y][x] |= gGrid[y][x];
+	spans.Reset();
+	rasterize_ellipse(spans, r);
+	draw(spans, gGrid);
+	if (!same_grids())
+		fail("wide arc");
+}
+
+
+static void check_outlines(void)
+{
+	SpanList spans;
+	const float pens[] = { 1, 3, 6 };
+	for (int32 i = 0; i < 3; i++)
+	{
+		BRect r(40, 40, 150, 110);
+		for (int32 shape = 0; shape < 2; shape++)
+		{
+			spans.Reset();
+			if (shape == 0)
+				rasterize_ellipse_outline(spans, r, pens[i]);
+			else
+				rasterize_round_rect_outline(spans, r, 12, 8, pens[i]);
+			if (draw(spans, gOther) < 0)
+			{
+				fail("outline pixels overlap");
+				return;
+			}
+
+			// the filled shape, grown by half the pen, covers the outline,
+			// and the outline covers its rows' ends. Pixel centers right on
+			// the edge of a ring are outside it.
+			float grow = (pens[i] - 1) / 2 - (pens[i] > 1 ? 0.0001 : 0);
+			BRect grown = r.InsetByCopy(-grow, -grow);
+			spans.Reset();
+			if (shape == 0)
+				rasterize_ellipse(spans, grown);
+			else
+				rasterize_round_rect(spans, grown, 12 + grow, 8 + grow);
+			draw(spans, gGrid);
+
+			const shape_span* span = spans.Spans();
+			for (int32 j = 0; j < spans.CountSpans(); j++, span++)
+			{
+				if (!gOther[span->y][span->left] || !gOther[span->y][span->right])
+				{
+					fail("outline edge");
+					break;
+				}
+			}
+			for (int32 y = 0; y < GRID_SIZE; y++)
+				for (int32 x = 0; x < GRID_SIZE; x++)
+					if (gOther[y][x] && !gGrid[y][x])
+					{
+						printf("pen %.0f shape %ld at %ld,%ld\n", pens[i], shape, x, y);
+						fail("outline outside its shape");
+						y = GRID_SIZE;
+						break;
+					}
+		}
+	}
+}
+
+
+static void check_polygons(void)
+{
+	SpanList spans;
+
+	// a rectangle covers its corners, as FillRect does
+	BPoint square[] = { BPoint(10, 10), BPoint(19, 10), BPoint(19, 29),
+		BPoint(10, 29) };
+	rasterize_polygon(spans, square, 4);
+	if (draw(spans, gGrid) != 200 || !gGrid[29][19] || gGrid[30][19])
+		fail("square polygon");
+
+	// a star crosses itself: its middle is outside with the even-odd rule
+	BPoint star[5];
+	for (int32 i = 0; i < 5; i++)
+		star[i] = BPoint(100 + 80 * sin(i * 4 * M_PI / 5),
+			100 - 80 * cos(i * 4 * M_PI / 5));
+	spans.Reset();
+	rasterize_polygon(spans, star, 5);
+	if (draw(spans, gGrid) < 0)
+		fail("polygon pixels overlap");
+	if (gGrid[100][100] || !gGrid[30][100] || !gGrid[20][100])
+		fail("star polygon");
+
+	// a triangle's edges all have their pixels
+	BPoint triangle[] = { BPoint(50, 200), BPoint(200, 180), BPoint(120, 60) };
+	spans.Reset();
+	rasterize_polygon(spans, triangle, 3);
+	if (draw(spans, gGrid) < 0)
+		fail("triangle pixels overlap");
+	for (int32 i = 0; i < 3; i++)
+	{
+		const BPoint& a = triangle[i];
+		const BPoint& b = triangle[(i + 1) % 3];
+		for (int32 step = 0; step <= 100; step++)
+		{
+			float t = step / 100.0;
+			int32 x = (int32)floor(a.x + (b.x - a.x) * t + .5);
+			int32 y = (int32)floor(a.y + (b.y - a.y) * t + .5);
+			if (!gGrid[y][x])
+			{
+				fail("triangle edge");
+				return;
+			}
+		}
+	}
+}
+
+
+// A window with others over it: many rectangles in many rows
+static void covered_region(BRegion* region)
+{
+	region->Set(BRect(0, 0, GRID_SIZE - 1, GRID_SIZE - 1));
+	for (int32 y = 0; y < 8; y++)
+		for (int32 x = 0; x < 8; x++)
+			region->Exclude(BRect(x * 32 + (y * 5) % 16, y * 32,
+				x * 32 + (y * 5) % 16 + 12, y * 32 + 20));
+}
+
+
+static void check_clipping(const BRegion& region, const BRect& r)
+{
+	SpanList spans;
+	spans.Reset(const_cast<BRegion*>(&region), r);
+	rasterize_ellipse(spans, r);
+	if (draw(spans, gGrid) < 0)
+	{
+		fail("clipped pixels overlap");
+		return;
+	}
+
+	SpanList whole;
+	rasterize_ellipse(whole, r);
+	draw(whole, gOther);
+	for (int32 y = 0; y < GRID_SIZE; y++)
+		for (int32 x = 0; x < GRID_SIZE; x++)
+			if (gOther[y][x] && !region.Contains(BPoint(x, y)))
+				gOther[y][x] = 0;
+	if (!same_grids())
+		fail("clipping");
+}
+
+
+static void check_clipping(void)
+{
+	BRegion region;
+	region.Include(BRect(0, 0, 60, 60));
+	region.Include(BRect(90, 30, 200, 70));
+	region.Include(BRect(30, 100, 130, 240));
+	check_clipping(region, BRect(10, 10, 180, 200));
+
+	// rows are looked up rather than gone through
+	covered_region(&region);
+	check_clipping(region, BRect(10, 10, 180, 200));
+	check_clipping(region, BRect(100, 150, 140, 170));
+	check_clipping(region, BRect(0, 0, GRID_SIZE - 1, GRID_SIZE - 1));
+}
+
+
+static void rasterize(SpanList& spans, int32 shape, const BRect& r)
+{
+	spans.Reset();
+	switch (shape)
+	{
+		case 0:
+			rasterize_ellipse(spans, r);
+			break;
+		case 1:
+			rasterize_ellipse_outline(spans, r, 1);
+			break;
+		case 2:
+			rasterize_ellipse_outline(spans, r, 5);
+			break;
+		case 3:
+			rasterize_arc(spans, r, 30, 120);
+			break;
+		case 4:
+			rasterize_arc_outline(spans, r, 200, -250, 3);
+			break;
+		case 5:
+			rasterize_round_rect(spans, r, 8, 6);
+			break;
+		case 6:
+			rasterize_round_rect_outline(spans, r, 8, 6, 4);
+			break;
+	}
+}
+
+
+static void check_moved(void)
+{
+	BRect shapes[] = { BRect(10, 10, 80, 50), BRect(5.5, 7.25, 60.75, 90.5),
+		BRect(3, 4, 9, 6) };
+	BPoint moves[] = { BPoint(1, 0), BPoint(37, 113), BPoint(150, 61) };
+	SpanList spans, moved;
+
+	for (int32 shape = 0; shape < 7; shape++)
+		for (int32 i = 0; i < 3; i++)
+		{
+			rasterize(spans, shape, shapes[i]);
+			draw(spans, gGrid);
+			for (int32 j = 0; j < 3; j++)
+			{
+				rasterize(moved, shape, shapes[i].OffsetByCopy(moves[j]));
+				draw(moved, gOther);
+				int32 dx = (int32)moves[j].x, dy = (int32)moves[j].y;
+				bool same = moved.CountSpans() == spans.CountSpans();
+				for (int32 y = 0; same && y < GRID_SIZE - dy; y++)
+					same = memcmp(gGrid[y], gOther[y + dy] + dx, GRID_SIZE - dx) == 0;
+				if (!same)
+				{
+					fail("moved shape");
+					return;
+				}
+			}
+		}
+}
+
+
+static void bench(const char* label, int32 shape, float pensize)
+{
+	SpanList spans;
+	BRect r(0, 0, 99, 23);
+	BPoint triangle[] = { BPoint(0, 20), BPoint(30, 0), BPoint(60, 20) };
+	BRegion region;
+	covered_region(&region);
+
+	int32 count = 0, pixels = 0;
+	bigtime_t start = system_time(), time;
+	do
+	{
+		for (int32 i = 0; i < 100; i++)
+		{
+			if (shape == 6)
+				spans.Reset(&region, r.OffsetByCopy(100, 100));
+			else
+				spans.Reset();
+			switch (shape)
+			{
+				case 0:
+					rasterize_round_rect(spans, r, 4, 4);
+					break;
+				case 1:
+					rasterize_round_rect_outline(spans, r, 4, 4, pensize);
+					break;
+				case 2:
+					rasterize_ellipse(spans, r);
+					break;
+				case 3:
+					rasterize_ellipse_outline(spans, r, pensize);
+					break;
+				case 4:
+					rasterize_arc(spans, r, 30, 120);
+					break;
+				case 5:
+					rasterize_polygon(spans, triangle, 3);
+					break;
+				case 6:
+					rasterize_ellipse(spans, r.OffsetByCopy(100, 100));
+					break;
+			}
+		}
+		count += 100;
+		time = system_time() - start;
+	} while (time < MIN_TIME);
+
+	for (int32 i = 0; i < spans.CountSpans(); i++)
+		pixels += spans.Spans()[i].right - spans.Spans()[i].left + 1;
+	printf("%-18s %5ld spans %6ld pixels %7.3f us each\n", label,
+		spans.CountSpans(), pixels, (double)time / count);
+}
+
+
+int main(int argc, char** argv)
+{
+	check_ellipses();
+	check_arcs();
+	check_outlines();
+	check_polygons();
+	check_clipping();
+	check_moved();
+
+	bench("round rect", 0, 1);
+	bench("round rect outline", 1, 1);
+	bench("ellipse", 2, 1);
+	bench("ellipse outline", 3, 1);
+	bench("thick outline", 3, 4);
+	bench("arc", 4, 1);
+	bench("triangle", 5, 1);
+	bench("covered ellipse", 6, 1);
+
+	return test_result();
+}
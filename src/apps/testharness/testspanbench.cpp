@@ -0,0 +1,502 @@
+// Standard Includes -----------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// System Includes -------------------------------------------------------------
+#include <OS.h>
+
+// Project Includes ------------------------------------------------------------
+#include <SpanKernels.h>
+#include <Compositor.h>
+
+// Local Includes --------------------------------------------------------------
+#include "TestHarness.h"
+
+// Local Defines ---------------------------------------------------------------
+#define SCREEN_WIDTH	1024
+#define SCREEN_HEIGHT	768
+#define MIN_TIME		200000
+
+// Globals ---------------------------------------------------------------------
+
+// Throughput of the app_server's span kernels (SpanKernels.cpp), at every
+// depth the drivers use and every instruction set this CPU has:
+//
+//	fill		a full screen of solid color, and a 40x20 rectangle
+//	pattern		a full screen of an 8x8 pattern
+//	copy		a full screen from another buffer
+//	move		a full screen scrolled by one row and by one pixel
+//	modes		a full screen of a 32-bit bitmap drawn in each drawing mode
+//				(Compositor.cpp), and a pattern filled in B_OP_OVER
+//
+// The per pixel loops BitmapDriver used before are timed as "pixel".
+// Before it is timed, every kernel level is checked against the scalar one
+// over odd sizes and alignments, and so are the compositors.  Run "testspanbench <section>..." to only
+// run some of them.  Results are in megabytes of frame buffer per second.
+
+static const int32 kDepths[] = { 8, 15, 16, 32 };
+static const int kNumDepths = sizeof (kDepths) / sizeof (kDepths[0]);
+static const uint8 kPattern[8] =
+	{ 0xaa, 0x55, 0xaa, 0x55, 0xf0, 0x0f, 0xff, 0x00 };
+
+
+static void check_level(span_kernel_level level)
+{
+	const char* label = span_kernel_level_name(level);
+	const size_t size = 600;
+	const size_t total = size + 128;
+	uint8* expected = (uint8*)malloc(total);
+	uint8* actual = (uint8*)malloc(total);
+	uint8 block[SPAN_BLOCK_SIZE];
+	for (int i = 0; i < SPAN_BLOCK_SIZE; i++)
+		block[i] = i * 7 + 1;
+
+	for (size_t offset = 0; offset < 33; offset++)
+	{
+		for (size_t bytes = 0; bytes < size - 40; bytes += 1 + bytes / 8)
+		{
+			// fill
+			memset(expected, 0xee, total);
+			memset(actual, 0xee, total);
+			span_set_kernel_level(SPAN_KERNEL_SCALAR);
+			span_fill(expected + offset, block, bytes);
+			span_set_kernel_level(level);
+			span_fill(actual + offset, block, bytes);
+			if (memcmp(expected, actual, total) != 0)
+			{
+				fail(label, "span_fill() differs");
+				return;
+			}
+
+			// copy, and move both ways with the source overlapping
+			for (size_t i = 0; i < total; i++)
+				expected[i] = actual[i] = i * 13;
+			span_copy(actual + offset, actual + 300, bytes < 260 ? bytes : 260);
+			memcpy(expected + offset, expected + 300, bytes < 260 ? bytes : 260);
+			if (memcmp(expected, actual, total) != 0)
+			{
+				fail(label, "span_copy() differs");
+				return;
+			}
+
+			for (int delta = -37; delta <= 37; delta += 37)
+			{
+				for (size_t i = 0; i < total; i++)
+					expected[i] = actual[i] = i * 13;
+				span_move(actual + 40 + offset + delta, actual + 40 + offset, bytes);
+				memmove(expected + 40 + offset + delta, expected + 40 + offset, bytes);
+				if (memcmp(expected, actual, total) != 0)
+				{
+					fail(label, "span_move() differs");
+					return;
+				}
+			}
+		}
+	}
+
+	free(expected);
+	free(actual);
+}
+
+
+struct mode_info
+{
+	const char*		name;
+	drawing_mode	mode;
+	source_alpha	alphaSource;
+	alpha_function	alphaFunction;
+};
+
+static const mode_info kModes[] = {
+	{ "copy", B_OP_COPY, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "over", B_OP_OVER, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "erase", B_OP_ERASE, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "invert", B_OP_INVERT, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "add", B_OP_ADD, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "subtract", B_OP_SUBTRACT, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "blend", B_OP_BLEND, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "min", B_OP_MIN, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "max", B_OP_MAX, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "select", B_OP_SELECT, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "alpha overlay", B_OP_ALPHA, B_PIXEL_ALPHA, B_ALPHA_OVERLAY },
+	{ "alpha overlay const", B_OP_ALPHA, B_CONSTANT_ALPHA, B_ALPHA_OVERLAY },
+	{ "alpha composite", B_OP_ALPHA, B_PIXEL_ALPHA, B_ALPHA_COMPOSITE },
+};
+static const int kNumModes = sizeof (kModes) / sizeof (kModes[0]);
+
+
+// A bitmap with every kind of alpha: transparent, opaque and in between
+static void make_source(uint8* src, int32 pixels)
+{
+	for (int32 i = 0; i < pixels; i++)
+	{
+		src[i * 4] = i * 7;
+		src[i * 4 + 1] = i * 13;
+		src[i * 4 + 2] = i * 29;
+		switch (i % 4)
+		{
+			case 0:
+				src[i * 4 + 3] = 0;
+				break;
+			case 1:
+				src[i * 4 + 3] = 255;
+				break;
+			default:
+				src[i * 4 + 3] = i * 3;
+				break;
+		}
+	}
+}
+
+
+static compositor_state mode_state(void)
+{
+	compositor_state state;
+	state.high.red = 10;
+	state.high.green = 20;
+	state.high.blue = 30;
+	state.high.alpha = 100;
+	state.low.red = 200;
+	state.low.green = 210;
+	state.low.blue = 220;
+	state.low.alpha = 255;
+	return state;
+}
+
+
+static void check_compositors(span_kernel_level level)
+{
+	const int32 pixels = 300;
+	uint8* src = (uint8*)malloc(pixels * 4);
+	uint8* expected = (uint8*)malloc(pixels * 4 + 64);
+	uint8* actual = (uint8*)malloc(pixels * 4 + 64);
+	compositor_state state = mode_state();
+	make_source(src, pixels);
+
+	for (int m = 0; m < kNumModes; m++)
+	{
+		for (int32 count = 0; count < pixels - 16; count += 1 + count / 4)
+		{
+			for (int32 i = 0; i < pixels * 4 + 64; i++)
+				expected[i] = actual[i] = i * 11;
+
+			span_set_kernel_level(SPAN_KERNEL_SCALAR);
+			get_compositor(kModes[m].mode, kModes[m].alphaSource,
+				kModes[m].alphaFunction, 32)(expected + 4, src + 4, NULL,
+					count, &state);
+			span_set_kernel_level(level);
+			get_compositor(kModes[m].mode, kModes[m].alphaSource,
+				kModes[m].alphaFunction, 32)(actual + 4, src + 4, NULL,
+					count, &state);
+			if (memcmp(expected, actual, pixels * 4 + 64) != 0)
+			{
+				fail(span_kernel_level_name(level), kModes[m].name);
+				break;
+			}
+		}
+	}
+
+	free(src);
+	free(expected);
+	free(actual);
+}
+
+
+static double throughput(bigtime_t time, int runs, double bytes)
+{
+	return bytes * runs / time;
+}
+
+
+static void report(const char* label, int32 depth, const char* level,
+				   double speed)
+{
+	printf("%-26s %2ld bpp %-6s %9.1f MB/s\n", label, depth, level, speed);
+}
+
+
+// What BitmapDriver did before the kernels: one store per pixel
+static void fill_per_pixel(uint8* screen, int32 bpr, int32 width,
+						   int32 height, uint32 pixel, int32 pixelSize,
+						   const uint8* pattern)
+{
+	for (int32 y = 0; y < height; y++, screen += bpr)
+	{
+		for (int32 x = 0; x < width; x++)
+		{
+			uint32 value = pixel;
+			if (pattern)
+				value = (pattern[y % 8] & (1 << (7 - x % 8))) ? pixel : 0;
+
+			switch (pixelSize)
+			{
+				case 1:
+					screen[x] = value;
+					break;
+				case 2:
+					((uint16*)screen)[x] = value;
+					break;
+				default:
+					// uint32 isn't four bytes everywhere
+					memcpy(screen + x * 4, &value, 4);
+					break;
+			}
+		}
+	}
+}
+
+
+static void bench_per_pixel(int32 depth, uint8* screen)
+{
+	int32 pixelSize = span_pixel_size(depth);
+	int32 bpr = SCREEN_WIDTH * pixelSize;
+
+	int runs = 0;
+	bigtime_t start = system_time();
+	bigtime_t time;
+	do
+	{
+		fill_per_pixel(screen, bpr, SCREEN_WIDTH, SCREEN_HEIGHT, runs,
+					   pixelSize, NULL);
+		runs++;
+	} while ((time = system_time() - start) < MIN_TIME);
+	report("fill screen", depth, "pixel",
+		   throughput(time, runs, (double)bpr * SCREEN_HEIGHT));
+
+	runs = 0;
+	start = system_time();
+	do
+	{
+		fill_per_pixel(screen, bpr, SCREEN_WIDTH, SCREEN_HEIGHT, 0xffffffff,
+					   pixelSize, kPattern);
+		runs++;
+	} while ((time = system_time() - start) < MIN_TIME);
+	report("pattern screen", depth, "pixel",
+		   throughput(time, runs, (double)bpr * SCREEN_HEIGHT));
+}
+
+
+static void bench_fill(int32 depth, span_kernel_level level, uint8* screen)
+{
+	int32 pixelSize = span_pixel_size(depth);
+	int32 bpr = SCREEN_WIDTH * pixelSize;
+
+	int runs = 0;
+	bigtime_t start = system_time();
+	bigtime_t time;
+	do
+	{
+		rect_fill(screen, bpr, SCREEN_WIDTH, SCREEN_HEIGHT, runs, pixelSize);
+		runs++;
+	} while ((time = system_time() - start) < MIN_TIME);
+	report("fill screen", depth, span_kernel_level_name(level),
+		   throughput(time, runs, (double)bpr * SCREEN_HEIGHT));
+
+	// Small rectangles are mostly row and call overhead
+	runs = 0;
+	start = system_time();
+	do
+	{
+		for (int i = 0; i < 100; i++)
+		{
+			rect_fill(screen + (i * 7) * bpr + (i * 3) * pixelSize, bpr,
+					  40, 20, runs, pixelSize);
+		}
+		runs++;
+	} while ((time = system_time() - start) < MIN_TIME);
+	report("fill 40x20", depth, span_kernel_level_name(level),
+		   throughput(time, runs * 100, 40.0 * pixelSize * 20));
+}
+
+
+static void bench_pattern(int32 depth, span_kernel_level level, uint8* screen)
+{
+	int32 pixelSize = span_pixel_size(depth);
+	int32 bpr = SCREEN_WIDTH * pixelSize;
+
+	int runs = 0;
+	bigtime_t start = system_time();
+	bigtime_t time;
+	do
+	{
+		rect_fill_pattern(screen, bpr, SCREEN_WIDTH, SCREEN_HEIGHT, kPattern,
+						  runs, 0, 0xffffffff, 0, pixelSize);
+		runs++;
+	} while ((time = system_time() - start) < MIN_TIME);
+	report("pattern screen", depth, span_kernel_level_name(level),
+		   throughput(time, runs, (double)bpr * SCREEN_HEIGHT));
+}
+
+
+static void bench_copy(int32 depth, span_kernel_level level, uint8* screen,
+					   uint8* other)
+{
+	int32 bpr = SCREEN_WIDTH * span_pixel_size(depth);
+
+	int runs = 0;
+	bigtime_t start = system_time();
+	bigtime_t time;
+	do
+	{
+		rect_copy(screen, bpr, other, bpr, bpr, SCREEN_HEIGHT);
+		runs++;
+	} while ((time = system_time() - start) < MIN_TIME);
+	report("copy screen", depth, span_kernel_level_name(level),
+		   throughput(time, runs, (double)bpr * SCREEN_HEIGHT));
+}
+
+
+static void bench_move(int32 depth, span_kernel_level level, uint8* screen)
+{
+	int32 pixelSize = span_pixel_size(depth);
+	int32 bpr = SCREEN_WIDTH * pixelSize;
+	size_t bytes = bpr - pixelSize;
+
+	int runs = 0;
+	bigtime_t start = system_time();
+	bigtime_t time;
+	do
+	{
+		rect_move(screen + bpr, screen, bpr, bytes, SCREEN_HEIGHT - 1);
+		runs++;
+	} while ((time = system_time() - start) < MIN_TIME);
+	report("move down a row", depth,
+		   span_kernel_level_name(level),
+		   throughput(time, runs, (double)bytes * (SCREEN_HEIGHT - 1)));
+
+	runs = 0;
+	start = system_time();
+	do
+	{
+		rect_move(screen + pixelSize, screen, bpr, bytes, SCREEN_HEIGHT);
+		runs++;
+	} while ((time = system_time() - start) < MIN_TIME);
+	report("move right a pixel", depth,
+		   span_kernel_level_name(level),
+		   throughput(time, runs, (double)bytes * SCREEN_HEIGHT));
+}
+
+
+static void bench_modes(int32 depth, span_kernel_level level, uint8* screen,
+						uint8* other)
+{
+	int32 pixelSize = span_pixel_size(depth);
+	int32 bpr = SCREEN_WIDTH * pixelSize;
+	compositor_state state = mode_state();
+	char label[64];
+
+	for (int m = 0; m < kNumModes; m++)
+	{
+		compositor_func composite = get_compositor(kModes[m].mode,
+			kModes[m].alphaSource, kModes[m].alphaFunction, depth);
+
+		memset(screen, 0x40, bpr * SCREEN_HEIGHT);
+		int runs = 0;
+		bigtime_t start = system_time();
+		bigtime_t time;
+		do
+		{
+			uint8* dest = screen;
+			uint8* src = other;
+			for (int32 y = 0; y < SCREEN_HEIGHT; y++)
+			{
+				composite(dest, src, NULL, SCREEN_WIDTH, &state);
+				dest += bpr;
+				src += SCREEN_WIDTH * 4;
+			}
+			runs++;
+		} while ((time = system_time() - start) < MIN_TIME);
+		sprintf(label, "bitmap %s", kModes[m].name);
+		report(label, depth, span_kernel_level_name(level),
+			   throughput(time, runs, (double)bpr * SCREEN_HEIGHT));
+	}
+
+	// A pattern fill in B_OP_OVER, the way BitmapDriver::FillPatternRect()
+	// does it: eight source rows made once, then composited
+	uint8 src[8][SCREEN_WIDTH * 4];
+	uint8 high[8][SCREEN_WIDTH];
+	for (int i = 0; i < 8; i++)
+	{
+		compositor_pattern_row(src[i], high[i], SCREEN_WIDTH, kPattern[i], 0,
+			state.high, state.low);
+	}
+	compositor_func composite = get_compositor(B_OP_OVER, B_PIXEL_ALPHA,
+		B_ALPHA_OVERLAY, depth);
+
+	int runs = 0;
+	bigtime_t start = system_time();
+	bigtime_t time;
+	do
+	{
+		uint8* dest = screen;
+		for (int32 y = 0; y < SCREEN_HEIGHT; y++, dest += bpr)
+			composite(dest, src[y & 7], high[y & 7], SCREEN_WIDTH, &state);
+		runs++;
+	} while ((time = system_time() - start) < MIN_TIME);
+	report("pattern over", depth, span_kernel_level_name(level),
+		   throughput(time, runs, (double)bpr * SCREEN_HEIGHT));
+}
+
+
+static bool wanted(int argc, char** argv, const char* section)
+{
+	if (argc < 2)
+		return true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], section) == 0)
+			return true;
+	}
+	return false;
+}
+
+
+int main(int argc, char** argv)
+{
+	span_kernel_level best = span_best_kernel_level();
+	printf("best kernel level: %s\n", span_kernel_level_name(best));
+
+	for (int level = SPAN_KERNEL_SSE2; level <= best; level++)
+	{
+		check_level((span_kernel_level)level);
+		check_compositors((span_kernel_level)level);
+	}
+
+	size_t size = SCREEN_WIDTH * SCREEN_HEIGHT * 4;
+	uint8* screen = (uint8*)malloc(size);
+	uint8* other = (uint8*)malloc(size);
+	memset(screen, 0, size);
+	memset(other, 0x5a, size);
+	if (wanted(argc, argv, "modes"))
+		make_source(other, SCREEN_WIDTH * SCREEN_HEIGHT);
+
+	for (int i = 0; i < kNumDepths; i++)
+	{
+		if (wanted(argc, argv, "fill") || wanted(argc, argv, "pattern"))
+			bench_per_pixel(kDepths[i], screen);
+		for (int level = SPAN_KERNEL_SCALAR; level <= best; level++)
+		{
+			span_set_kernel_level((span_kernel_level)level);
+			if (wanted(argc, argv, "fill"))
+				bench_fill(kDepths[i], (span_kernel_level)level, screen);
+			if (wanted(argc, argv, "pattern"))
+				bench_pattern(kDepths[i], (span_kernel_level)level, screen);
+			if (wanted(argc, argv, "copy"))
+				bench_copy(kDepths[i], (span_kernel_level)level, screen, other);
+			if (wanted(argc, argv, "move"))
+				bench_move(kDepths[i], (span_kernel_level)level, screen);
+			if (wanted(argc, argv, "modes"))
+			{
+				bench_modes(kDepths[i], (span_kernel_level)level, screen,
+							other);
+			}
+		}
+	}
+
+	free(screen);
+	free(other);
+
+	return test_result();
+}
@@ -0,0 +1,322 @@
+//------------------------------------------------------------------------------
+//	File Name:		CommandRing.cpp
+//	Description:	Ring buffer in a shared area which carries link messages
+//					from a client to the server without a port write for each
+//					batch
+//
+//------------------------------------------------------------------------------
+#include <string.h>
+
+#include <ServerProtocol.h>
+#include <CommandRing.h>
+
+// How long a writer waiting for room sleeps before it checks the reader is
+// still there
+static const bigtime_t kRoomCheckInterval = 100000;
+
+/*
+	Start of the area. head and tail count the bytes written and read since
+	the ring was created; only the writer changes head and only the reader
+	changes tail. Their difference is what is in the ring, and since size is
+	a power of two, they give positions in it even once they wrap around.
+*/
+struct command_ring_header
+{
+	int32 size;			// bytes of data following the header
+	sem_id room;		// released by the reader when the writer waits for room
+	vint32 head;
+	vint32 tail;
+	vint32 sleeping;	// the reader waits on its port for a doorbell
+	vint32 waiting;		// the writer waits on room
+	vint32 dropped;		// the reader found garbage and went back to the port
+};
+
+// Data starts on its own cache line, away from the counters
+static const int32 kHeaderSize = (sizeof(command_ring_header) + 63) & ~63;
+
+// Each batch is preceded by its size. A size of 0 means the rest of the ring
+// is unused and the batch is at its start.
+static inline int32 record_size(int32 size)
+{
+	return (sizeof(int32) + size + 7) & ~7;
+}
+
+/*!
+	\brief Creates a ring, for the server
+	\param name Name of its area
+	\param size Bytes of messages it holds at least
+*/
+CommandRing::CommandRing(const char *name, size_t size)
+ :	fArea(B_NO_INIT), fOwner(true), fHeader(NULL), fData(NULL), fSize(0),
+	fBatchSize(0), fDropped(false)
+{
+	int32 ringsize = 4096;
+	while((size_t)ringsize < size)
+		ringsize <<= 1;
+
+	size_t areasize = (kHeaderSize + ringsize + B_PAGE_SIZE - 1) & ~(B_PAGE_SIZE - 1);
+	void *address = NULL;
+	area_id area = create_area(name, &address, B_ANY_ADDRESS, areasize,
+		B_NO_LOCK, B_READ_AREA | B_WRITE_AREA);
+	if(area < 0)
+	{
+		fArea = area;
+		return;
+	}
+
+	fHeader = (command_ring_header*)address;
+	fHeader->room = create_sem(0, "command_ring_room");
+	if(fHeader->room < 0)
+	{
+		fArea = fHeader->room;
+		delete_area(area);
+		fHeader = NULL;
+		return;
+	}
+	fHeader->size = ringsize;
+	fHeader->head = 0;
+	fHeader->tail = 0;
+	fHeader->sleeping = 0;
+	fHeader->waiting = 0;
+	fHeader->dropped = 0;
+
+	fArea = area;
+	fData = (char*)address + kHeaderSize;
+	fSize = ringsize;
+}
+
+//! Maps a ring the server created, for the client
+CommandRing::CommandRing(area_id area)
+ :	fArea(B_NO_INIT), fOwner(false), fHeader(NULL), fData(NULL), fSize(0),
+	fBatchSize(0), fDropped(false)
+{
+	void *address = NULL;
+	area_id clone = clone_area("command_ring", &address, B_ANY_ADDRESS,
+		B_READ_AREA | B_WRITE_AREA, area);
+	if(clone < 0)
+	{
+		fArea = clone;
+		return;
+	}
+
+	fArea = clone;
+	fHeader = (command_ring_header*)address;
+	fData = (char*)address + kHeaderSize;
+	fSize = fHeader->size;
+}
+
+CommandRing::~CommandRing(void)
+{
+	if(fArea < 0)
+		return;
+
+	if(fOwner)
+		delete_sem(fHeader->room);
+	delete_area(fArea);
+}
+
+status_t CommandRing::InitCheck(void) const
+{
+	return fArea < 0 ? fArea : B_OK;
+}
+
+/*!
+	\brief Copies a batch of messages into the ring
+	\param data The batch
+	\param size Its size, at most half the ring
+	\param doorbell The reader's port, which is sent AS_SERVER_AREALINK if it sleeps
+	\param timeout How long to wait for room
+	\return B_OK, B_TIMED_OUT or B_WOULD_BLOCK if the ring stayed full,
+	B_BAD_PORT_ID if the reader is gone, B_BAD_DATA if it dropped the ring
+*/
+status_t CommandRing::Write(const void *data, int32 size, port_id doorbell,
+	bigtime_t timeout)
+{
+	if(fArea < 0)
+		return B_NO_INIT;
+
+	if(fHeader->dropped)
+		return B_BAD_DATA;
+
+	int32 record = record_size(size);
+	if(size <= 0 || record > fSize / 2)
+		return B_BAD_VALUE;
+
+	// a batch is never split: when it doesn't fit before the end, the rest
+	// of the ring is skipped
+	int32 position = (uint32)fHeader->head & (fSize - 1);
+	int32 skip = fSize - position;
+	if(skip >= record)
+		skip = 0;
+
+	status_t err = WaitForRoom(record + skip, doorbell, timeout);
+	if(err < B_OK)
+		return err;
+
+	if(skip)
+	{
+		*(int32*)(fData + position) = 0;
+		position = 0;
+	}
+	*(int32*)(fData + position) = size;
+	memcpy(fData + position + sizeof(int32), data, size);
+
+	// publishing the batch also orders it before the sleeping test below
+	atomic_add(&fHeader->head, record + skip);
+
+	if(fHeader->sleeping && atomic_and(&fHeader->sleeping, 0))
+	{
+		do {
+			err = write_port(doorbell, AS_SERVER_AREALINK, NULL, 0);
+		} while(err == B_INTERRUPTED);
+	}
+
+	return B_OK;
+}
+
+status_t CommandRing::WaitForRoom(int32 needed, port_id doorbell, bigtime_t timeout)
+{
+	bigtime_t deadline = (timeout == B_INFINITE_TIMEOUT) ? 0 : system_time() + timeout;
+
+	while(fSize - (fHeader->head - fHeader->tail) < needed)
+	{
+		if(fHeader->dropped)
+			return B_BAD_DATA;
+
+		atomic_or(&fHeader->waiting, 1);
+
+		// the reader may have made room before it could see the flag
+		if(fSize - (fHeader->head - fHeader->tail) >= needed)
+			break;
+
+		bigtime_t wait = kRoomCheckInterval;
+		if(deadline)
+		{
+			bigtime_t left = deadline - system_time();
+			if(left <= 0)
+				return timeout == 0 ? B_WOULD_BLOCK : B_TIMED_OUT;
+			if(left < wait)
+				wait = left;
+		}
+
+		status_t err = acquire_sem_etc(fHeader->room, 1, B_RELATIVE_TIMEOUT, wait);
+		if(err == B_TIMED_OUT)
+		{
+			port_info info;
+			if(get_port_info(doorbell, &info) != B_OK)
+				return B_BAD_PORT_ID;
+		}
+		else if(err != B_OK && err != B_INTERRUPTED)
+			return err;
+	}
+
+	return B_OK;
+}
+
+/*!
+	\brief Returns the oldest batch in the ring, in place
+	\param size Set to the size of the batch
+	\return The batch, or NULL if the ring is empty or was dropped
+
+	The batch stays where it is until Consume() is called, which this does
+	for the previous batch if it wasn't.
+*/
+const char *CommandRing::NextBatch(int32 *size)
+{
+	if(fArea < 0 || fDropped)
+		return NULL;
+
+	Consume();
+
+	// the counters, sizes and positions all come from the writer and are
+	// checked against our own idea of the ring before anything is read
+	int32 tail = fHeader->tail;
+	int32 available = fHeader->head - tail;
+	if(available == 0)
+		return NULL;
+
+	int32 position = (uint32)tail & (fSize - 1);
+	if(available < 0 || available > fSize || (position & 7) != 0)
+		return Drop();
+
+	int32 skip = 0;
+	int32 length = *(int32*)(fData + position);
+	if(length == 0)
+	{
+		skip = fSize - position;
+		position = 0;
+		length = *(int32*)fData;
+	}
+
+	if(length <= 0 || length > fSize - (int32)sizeof(int32))
+		return Drop();
+
+	int32 record = record_size(length);
+	if(skip + record > available || position + record > fSize)
+		return Drop();
+
+	fBatchSize = skip + record;
+	*size = length;
+	return fData + position + sizeof(int32);
+}
+
+/*!
+	\brief Stops reading a ring the writer put garbage in
+	\return NULL, for NextBatch()
+
+	What is left in the ring is lost. The writer's next Write() fails, and
+	it sends its messages through the port from then on.
+*/
+const char *CommandRing::Drop(void)
+{
+	fDropped = true;
+	fBatchSize = 0;
+	atomic_or(&fHeader->dropped, 1);
+
+	// a writer waiting for room has to find out too
+	if(fHeader->waiting && atomic_and(&fHeader->waiting, 0))
+		release_sem(fHeader->room);
+
+	return NULL;
+}
+
+//! Gives the room of the batch NextBatch() returned back to the writer
+void CommandRing::Consume(void)
+{
+	if(fBatchSize == 0)
+		return;
+
+	atomic_add(&fHeader->tail, fBatchSize);
+	fBatchSize = 0;
+
+	if(fHeader->waiting && atomic_and(&fHeader->waiting, 0))
+		release_sem(fHeader->room);
+}
+
+/*!
+	\brief Tells the writer that the reader is about to wait on its port
+	\return false if a batch came in meanwhile, in which case the reader
+	shouldn't wait
+
+	Call it once NextBatch() returned NULL.
+*/
+bool CommandRing::Sleep(void)
+{
+	if(fArea < 0 || fDropped)
+		return true;
+
+	atomic_or(&fHeader->sleeping, 1);
+	if(fHeader->head != fHeader->tail)
+	{
+		atomic_and(&fHeader->sleeping, 0);
+		return false;
+	}
+	return true;
+}
+
+//! Tells the writer that the reader woke up without being rung for
+void CommandRing::Awake(void)
+{
+	if(fArea >= 0)
+		atomic_and(&fHeader->sleeping, 0);
+}
@@ -41,6 +41,8 @@ extern int	_init_message_();
 extern int	_delete_message_();
 #endif
 
+extern void	_wait_for_launch_gate_();
+
 // debugging
 #define DBG(x) x
 //#define DBG(x)
@@ -54,6 +56,9 @@ initialize_before()
 {
 DBG(OUT("initialize_before()\n"));
 
+	// stay "suspended" until the team that load_image()d us resumes us
+	_wait_for_launch_gate_();
+
 	_init_message_();
 	_init_roster_();
 
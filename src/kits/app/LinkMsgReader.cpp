@@ -29,6 +29,7 @@
 #include <new>
 
 #include <ServerProtocol.h>
+#include <CommandRing.h>
 #include <LinkMsgReader.h>
 
 #define DEBUG_LINKMSGREADER
@@ -50,13 +51,15 @@ static const int32 kHeaderSize = sizeof(int32) * 3; //size + code + flags
 LinkMsgReader::LinkMsgReader(port_id port) :
 	fReceivePort(port), fRecvBuffer(NULL), fRecvPosition(0), fRecvStart(0),
 	fRecvBufferSize(0), fDataSize(0),
-	fReplySize(0), fReadError(B_OK)
+	fReplySize(0), fReadError(B_OK), fRing(NULL), fPortBuffer(NULL), fInRing(false)
 {
 	/*	*/
 }
 
 LinkMsgReader::~LinkMsgReader()
 {
+	if (fInRing)
+		fRecvBuffer = fPortBuffer;
 	if (fRecvBuffer)
 		free(fRecvBuffer);
 }
@@ -71,6 +74,25 @@ port_id LinkMsgReader::GetPort()
 	return fReceivePort;
 }
 
+/*!
+	\brief Reads messages from a shared ring before the port
+	\param ring The ring, or NULL to only read the port. The caller keeps it.
+
+	Messages are read in the ring, where the writer put them. The port is
+	waited on once the ring is empty, for the writer's doorbell or for
+	messages sent there the usual way.
+*/
+void LinkMsgReader::SetRing(CommandRing *ring)
+{
+	if (fInRing)
+	{
+		fRecvBuffer = fPortBuffer;
+		fInRing = false;
+		ResetBuffer();
+	}
+	fRing = ring;
+}
+
 status_t LinkMsgReader::GetNextMessage(int32 *code, bigtime_t timeout)
 {
 	int32 remaining;
@@ -187,6 +209,13 @@ status_t LinkMsgReader::ReadFromPort(bigtime_t timeout)
 	//we are here so it means we finished reading the buffer contents
 	ResetBuffer();
 
+	if (fRing)
+	{
+		status_t err = ReadFromRing();
+		if (err != B_WOULD_BLOCK)
+			return err;
+	}
+
 	status_t err = AdjustReplyBuffer(timeout);
 	if (err < B_OK)
 		return err;
@@ -213,6 +242,11 @@ status_t LinkMsgReader::ReadFromPort(bigtime_t timeout)
 	if (bytesread < B_OK)
 		return bytesread;
 
+	if (fRing)
+		fRing->Awake();
+	if (protocol == AS_SERVER_AREALINK)
+		return ReadFromPort(timeout);	//rung: the messages are in the ring, if we still read it
+
 	//TODO: we only need AS_SERVER_PORTLINK when all OBOS uses Link messages
 	if (protocol != AS_SERVER_PORTLINK && protocol != AS_SERVER_SESSION)
 		return B_ERROR;
@@ -225,6 +259,40 @@ status_t LinkMsgReader::ReadFromPort(bigtime_t timeout)
 	return B_OK;
 }
 
+//! Points the buffer at the next batch in the ring, B_WOULD_BLOCK if there is none
+status_t LinkMsgReader::ReadFromRing()
+{
+	//the previous batch has been read, give its room back
+	if (fInRing)
+	{
+		fRecvBuffer = fPortBuffer;
+		fInRing = false;
+	}
+
+	do {
+		int32 size;
+		const char *batch = fRing->NextBatch(&size);
+		if (batch)
+		{
+			STRACE(("info: LinkMsgReader read %ld bytes from the ring.\n", size));
+			fPortBuffer = fRecvBuffer;
+			fRecvBuffer = (char *)batch;
+			fInRing = true;
+			fDataSize = size;
+			return B_OK;
+		}
+	} while (!fRing->Sleep());
+
+	//the writer put garbage in the ring: it sends through the port from now on
+	if (fRing->IsDropped())
+	{
+		STRACE(("error info: LinkMsgReader dropped the ring of port %ld.\n", fReceivePort));
+		fRing = NULL;
+	}
+
+	return B_WOULD_BLOCK;
+}
+
 status_t LinkMsgReader::Read(void *data, ssize_t size)
 {
 //	STRACE(("info: LinkMsgReader Read()ing %ld bytes...\n", size));
@@ -361,6 +429,7 @@ static const char *kASCodeNames[] =
 "AS_GET_FAMILY_ID",
 "AS_GET_STYLE_ID",
 "AS_GET_STYLE_FOR_FACE",
+"AS_GET_FONT_METRICS",
 "AS_GET_SCREEN_MODE",
 "AS_SET_UI_COLORS",
 "AS_GET_UI_COLORS",
@@ -492,12 +561,14 @@ static const char *kASCodeNames[] =
 "AS_LAYER_SET_VIEW_IMAGE",
 "AS_LAYER_SET_PATTERN",
 "AS_SET_CURRENT_LAYER",
+"AS_GET_PROFILE",
+"AS_DUMP_PROFILE",
 };
 
 const char *strcode(int32 code)
 {
 	code = code - SERVER_TRUE;
-	if (code >= 0 && code <= AS_SET_CURRENT_LAYER - SERVER_TRUE)
+	if (code >= 0 && code <= AS_DUMP_PROFILE - SERVER_TRUE)
 		return kASCodeNames[code];
 	else
 		return bstrcode(code);
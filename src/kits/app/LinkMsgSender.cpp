@@ -29,6 +29,7 @@
 #include <new>
 
 #include <ServerProtocol.h>
+#include <CommandRing.h>
 #include <LinkMsgSender.h>
 
 #define DEBUG_LINKMSGSENDER
@@ -45,14 +46,18 @@
 static const int32 kInitialSendBufferSize = 2048;
 static const int32 kMaxSendBufferSize = 2048;
 
+//a ring takes larger batches than a port, but messages stay within the above
+static const int32 kRingSendBufferSize = 16384;
+
 static const int32 kHeaderSize = sizeof(int32) * 3; //size + code + flags
 
 LinkMsgSender::LinkMsgSender(port_id send) :
 	fSendPort(send), fSendBuffer(NULL), fSendPosition(0), fSendStart(0),
 	fSendBufferSize(0), fSendCount(0), fDataSize(0),
-	fReplySize(0), fWriteError(B_OK)
+	fReplySize(0), fWriteError(B_OK), fRing(NULL),
+	fFlushLatency(0), fBatchStart(0)
 {
-	/*	*/
+	memset(&fStats, 0, sizeof(fStats));
 }
 
 LinkMsgSender::~LinkMsgSender()
@@ -68,24 +73,31 @@ status_t LinkMsgSender::StartMessage(int32 code)
 
 	if (fSendBufferSize == 0)
 	{
-		fSendBuffer = (char *)malloc(kInitialSendBufferSize);
+		int32 size = fRing ? kRingSendBufferSize : kInitialSendBufferSize;
+		fSendBuffer = (char *)malloc(size);
 		if (fSendBuffer == NULL)
 		{
 			fWriteError = B_NO_MEMORY;
 			return B_NO_MEMORY;
 		}
-		fSendBufferSize = kInitialSendBufferSize;
+		fSendBufferSize = size;
 	}
 
 	status_t err;
-	//must have space for at least size + code + flags
-	if (fSendBufferSize - fSendPosition < kHeaderSize)
+	//must have space for at least size + code + flags, and the oldest
+	//message mustn't have waited too long
+	if (fSendBufferSize - fSendPosition < kHeaderSize
+		|| (fFlushLatency && fSendCount
+			&& system_time() - fBatchStart >= fFlushLatency))
 	{
 		err = Flush();	//will set fSendPosition and fSendStart to 0
 		if (err < B_OK)
 			return err;
 	}
 
+	if (fSendPosition == 0 && fFlushLatency)	//first of a new batch
+		fBatchStart = system_time();
+
 	int32 *p = (int32 *)(fSendBuffer + fSendStart);	//start of current message
 	*p = 0;	//size
 	*(++p) = code;	//code
@@ -139,13 +151,13 @@ status_t LinkMsgSender::Attach(const void *data, ssize_t size)
 			//resulting size of current message
 
 		int32 newbuffersize;
-		if (total <= fSendBufferSize)
-			newbuffersize = fSendBufferSize;	//no change
-		else if (total > kMaxSendBufferSize)
+		if (total > kMaxSendBufferSize)
 		{
 			fWriteError = B_BAD_VALUE;
 			return B_BAD_VALUE;
 		}
+		else if (total <= fSendBufferSize)
+			newbuffersize = fSendBufferSize;	//no change
 		else if (total <= kInitialSendBufferSize)
 			newbuffersize = kInitialSendBufferSize;
 		else
@@ -187,7 +199,8 @@ status_t LinkMsgSender::FlushCompleted(ssize_t newbuffersize)
 	err = Flush();
 	if (err < B_OK)
 	{
-		fSendPosition = position;
+		//the messages Flush() did send were taken out of the buffer
+		fSendPosition += position - start;
 		if (buffer != fSendBuffer)
 			free(buffer);
 		return err;
@@ -208,6 +221,66 @@ status_t LinkMsgSender::FlushCompleted(ssize_t newbuffersize)
 }
 
 
+/*!
+	\brief Writes the completed messages to the port
+	\param timeout How long to wait for room in the port
+
+	A batch buffered for a ring can be larger than the port takes. It is
+	written in as many pieces as it takes then. If a piece can't be written,
+	the pieces written before it are taken out of the buffer.
+*/
+status_t LinkMsgSender::WriteToPort(bigtime_t timeout)
+{
+	int32 start = 0;
+	int32 count = 0;
+	while (start < fSendPosition)
+	{
+		int32 end = start;
+		int32 pieceCount = 0;
+		do {
+			end += *(int32 *)(fSendBuffer + end);
+			pieceCount++;
+		} while (end < fSendPosition
+			&& end - start + *(int32 *)(fSendBuffer + end) <= kMaxSendBufferSize);
+
+		//TODO: we only need AS_SERVER_PORTLINK when all OBOS uses LinkMsgSender
+		int32 protocol = (pieceCount > 1 ? AS_SERVER_SESSION : AS_SERVER_PORTLINK);
+
+		status_t err;
+		if(timeout != B_INFINITE_TIMEOUT)
+		{
+			do {
+				err = write_port_etc(fSendPort, protocol, fSendBuffer + start,
+										end - start, B_RELATIVE_TIMEOUT, timeout);
+			} while(err == B_INTERRUPTED);
+		}
+		else
+		{
+			do {
+				err = write_port(fSendPort, protocol, fSendBuffer + start,
+									end - start);
+			} while(err == B_INTERRUPTED);
+		}
+
+		if (err < B_OK)
+		{
+			if (start > 0)
+			{
+				memmove(fSendBuffer, fSendBuffer + start, fSendBufferSize - start);
+				fSendPosition -= start;
+				fSendStart -= start;
+				fSendCount -= count;
+			}
+			return err;
+		}
+
+		start = end;
+		count += pieceCount;
+	}
+
+	return B_OK;
+}
+
 void LinkMsgSender::SetPort( port_id port )
 {
 	fSendPort=port;
@@ -218,6 +291,65 @@ port_id LinkMsgSender::GetPort()
 	return fSendPort;
 }
 
+/*!
+	\brief Sends messages through a shared ring rather than the port
+	\param ring The ring, or NULL to go back to the port. The caller keeps it.
+
+	The port is then only written to wake the reader up.
+*/
+void LinkMsgSender::SetRing(CommandRing *ring)
+{
+	fRing=ring;
+
+	//an empty buffer is sized for the new destination when next needed
+	if (fSendPosition == 0 && fSendBuffer)
+	{
+		free(fSendBuffer);
+		fSendBuffer = NULL;
+		fSendBufferSize = 0;
+	}
+}
+
+/*!
+	\brief Bounds how long messages wait in the buffer
+	\param latency Time after which StartMessage() sends the messages
+	buffered so far, or 0 to only send them when the buffer is full or
+	Flush() is called
+*/
+void LinkMsgSender::SetFlushLatency(bigtime_t latency)
+{
+	fFlushLatency=latency;
+	fBatchStart=system_time();
+}
+
+/*!
+	\brief Sends the buffered messages if the oldest has waited too long
+	\return B_OK if nothing had to be sent, or what Flush() returned
+
+	StartMessage() only looks at the age of a batch when a message is added.
+	A looper which keeps handling messages that don't draw calls this after
+	each of them, so nothing waits much longer than the flush latency.
+*/
+status_t LinkMsgSender::FlushIfLate(void)
+{
+	if (!fFlushLatency || !fSendCount || fSendStart != fSendPosition
+		|| system_time() - fBatchStart < fFlushLatency)
+		return B_OK;
+	return Flush();
+}
+
+/*!
+	\brief Gets what was sent since the statistics were last reset
+	\param stats Filled with the counts
+	\param reset Whether to start counting again
+*/
+void LinkMsgSender::GetStats(link_sender_stats *stats, bool reset)
+{
+	*stats=fStats;
+	if (reset)
+		memset(&fStats, 0, sizeof(fStats));
+}
+
 status_t LinkMsgSender::Flush(bigtime_t timeout)
 {
 	if (fWriteError < B_OK)
@@ -229,27 +361,27 @@ status_t LinkMsgSender::Flush(bigtime_t timeout)
 
 	STRACE(("info: LinkMsgSender Flush() waiting to send %ld messages of %ld bytes on port %ld.\n", fSendCount, fSendPosition, fSendPort));
 	
-	//TODO: we only need AS_SERVER_PORTLINK when all OBOS uses LinkMsgSender
-	int32 protocol = (fSendCount > 1 ? AS_SERVER_SESSION : AS_SERVER_PORTLINK);
-
 	status_t err;
-	if(timeout != B_INFINITE_TIMEOUT)
+	if(fRing)
 	{
-		do {
-			err = write_port_etc(fSendPort, protocol, fSendBuffer,
-									fSendPosition, B_RELATIVE_TIMEOUT, timeout);
-		} while(err == B_INTERRUPTED);
+		err = fRing->Write(fSendBuffer, fSendPosition, fSendPort, timeout);
+		if(err == B_BAD_DATA)
+		{
+			//the reader dropped the ring: go back to the port for good
+			STRACE(("error info: LinkMsgSender's ring was dropped, using port %ld.\n", fSendPort));
+			fRing = NULL;
+			err = WriteToPort(timeout);
+		}
 	}
 	else
-	{
-		do {
-			err = write_port(fSendPort, protocol, fSendBuffer, fSendPosition);
-		} while(err == B_INTERRUPTED);
-	}
+		err = WriteToPort(timeout);
 	
 	if (err == B_OK)
 	{
 		STRACE(("info: LinkMsgSender Flush() %ld messages total of %ld bytes on port %ld.\n", fSendCount, fSendPosition, fSendPort));
+		fStats.messages += fSendCount;
+		fStats.bytes += fSendPosition;
+		fStats.flushes++;
 		fSendPosition = 0;
 		fSendStart = 0;
 		fSendCount = 0;
@@ -351,6 +483,7 @@ static const char *kASCodeNames[] =
 "AS_GET_FAMILY_ID",
 "AS_GET_STYLE_ID",
 "AS_GET_STYLE_FOR_FACE",
+"AS_GET_FONT_METRICS",
 "AS_GET_SCREEN_MODE",
 "AS_SET_UI_COLORS",
 "AS_GET_UI_COLORS",
@@ -482,12 +615,14 @@ static const char *kASCodeNames[] =
 "AS_LAYER_SET_VIEW_IMAGE",
 "AS_LAYER_SET_PATTERN",
 "AS_SET_CURRENT_LAYER",
+"AS_GET_PROFILE",
+"AS_DUMP_PROFILE",
 };
 
 const char *strcode(int32 code)
 {
 	code = code - SERVER_TRUE;
-	if (code >= 0 && code <= AS_SET_CURRENT_LAYER - SERVER_TRUE)
+	if (code >= 0 && code <= AS_DUMP_PROFILE - SERVER_TRUE)
 		return kASCodeNames[code];
 	else
 		return bstrcode(code);
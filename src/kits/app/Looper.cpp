@@ -70,6 +70,7 @@ using BPrivate::gDefaultTokens;
 using BPrivate::gLooperList;
 using BPrivate::BObjectLocker;
 using BPrivate::BLooperList;
+using BPrivate::BLooperPin;
 
 port_id _get_looper_port_(const BLooper* looper);
 bool _use_preferred_target_(BMessage* msg) { return msg->fPreferred; }
@@ -643,17 +644,10 @@ DBG(OUT("BLooper::Unlock() done\n"));
 //------------------------------------------------------------------------------
 bool BLooper::IsLocked() const
 {
-	// We have to lock the list for the call to IsLooperValid().  Has the side
-	// effect of not letting the looper get deleted while we're here.
-	BObjectLocker<BLooperList> ListLock(gLooperList);
-
-	if (!ListLock.IsLocked())
-	{
-		// If we can't lock the list, our semaphore is probably toast
-		return false;
-	}
-
-	if (!IsLooperValid(this))
+	// Pinning the looper keeps it from getting deleted while we're here,
+	// without serializing on the looper list.
+	BLooperPin pin(this);
+	if (!pin.IsValid())
 	{
 		// The looper is gone, so of course it's not locked
 		return false;
@@ -969,13 +963,8 @@ BLooper::BLooper(int32 priority, port_id port, const char* name)
 status_t BLooper::_PostMessage(BMessage* msg, BHandler* handler,
 							   BHandler* reply_to)
 {
-	BObjectLocker<BLooperList> ListLock(gLooperList);
-	if (!ListLock.IsLocked())
-	{
-		return B_BAD_VALUE;
-	}
-
-	if (!IsLooperValid(this))
+	BLooperPin pin(this);
+	if (!pin.IsValid())
 	{
 		return B_BAD_VALUE;
 	}
@@ -1035,12 +1024,15 @@ DBG(OUT("BLooper::_Lock() done 1\n"));
 	sem_id sem;
 
 /**
-	@note	We lock the looper list at the start of the lock operation to
-			prevent the looper getting removed from the list while we're
-			doing list operations.  Also ensures that the looper doesn't
-			get deleted here (since ~BLooper() has to lock the list as
-			well to remove itself).
+	@note	Rather than locking the whole looper list for the duration of the
+			lock operation, we pin the looper in the lock-free looper
+			registry.  That keeps the looper from being deleted while we look
+			at it (~BLooper() waits for pins to drain) without serializing
+			every Lock() in the team on one global lock.  Only the lookup by
+			port_id still has to walk the list under its lock; pinning fails
+			harmlessly if the looper went away in between.
  */
+	if (!loop)
 	{
 		BObjectLocker<BLooperList> ListLock(gLooperList);
 		if (!ListLock.IsLocked())
@@ -1050,25 +1042,23 @@ DBG(OUT("BLooper::_Lock() done 1\n"));
 DBG(OUT("BLooper::_Lock() done 2\n"));
 			return B_BAD_VALUE;
 		}
-	
-		//	Look up looper by port_id, if necessary
+
+		//	Look up looper by port_id
+		loop = LooperForPort(port);
 		if (!loop)
 		{
-			loop = LooperForPort(port);
-			if (!loop)
-			{
 DBG(OUT("BLooper::_Lock() done 3\n"));
-				return B_BAD_VALUE;
-			}
+			return B_BAD_VALUE;
 		}
-		else
+	}
+
+	{
+		//	Check looper validity
+		BLooperPin pin(loop);
+		if (!pin.IsValid())
 		{
-			//	Check looper validity
-			if (!IsLooperValid(loop))
-			{
 DBG(OUT("BLooper::_Lock() done 4\n"));
-				return B_BAD_VALUE;
-			}
+			return B_BAD_VALUE;
 		}
 	
 		//	Is the looper trying to lock itself?
@@ -1096,7 +1086,7 @@ DBG(OUT("BLooper::_Lock() done 6\n"));
 		//	Bump the requested lock count (using fAtomicCount for this)
 		atomic_add(&loop->fAtomicCount, 1);
 
-		// sLooperListLock automatically released here
+		// pin automatically released here
 	}
 
 /**
@@ -48,10 +48,18 @@ BLooperList gLooperList;
 
 typedef vector<BLooperList::LooperData>::iterator LDIter;
 
+static inline uint32 HashLooper(const BLooper* looper)
+{
+	return (uint32)((unsigned long)looper >> 4) * 2654435761UL;
+}
+
 //------------------------------------------------------------------------------
 BLooperList::BLooperList()
-	:	fLooperID(0)
+	:	fLooperID(0),
+		fRegistryCount(0)
 {
+	memset((void*)fRegistry, 0, sizeof(fRegistry));
+	memset(fRegistryUsed, 0, sizeof(fRegistryUsed));
 }
 //------------------------------------------------------------------------------
 bool BLooperList::Lock()
@@ -79,26 +87,21 @@ void BLooperList::AddLooper(BLooper* looper)
 		if (i == fData.end())
 		{
 			fData.push_back(LooperData(looper, ++fLooperID));
-			looper->fLooperID = fLooperID;
-			looper->Lock();
 		}
 		else
 		{
 			i->looper = looper;
 			i->id = ++fLooperID;
-			looper->fLooperID = fLooperID;
-			looper->Lock();
 		}
+		looper->fLooperID = fLooperID;
+		RegisterLooper(looper);
+		looper->Lock();
 	}
 }
 //------------------------------------------------------------------------------
 bool BLooperList::IsLooperValid(const BLooper* looper)
 {
-	BAutolock Listlock(fLock);
-	AssertLocked();
-
-	return find_if(fData.begin(), fData.end(), FindLooperPred(looper)) !=
-			fData.end();
+	return FindSlot(looper) != NULL;
 }
 //------------------------------------------------------------------------------
 bool BLooperList::RemoveLooper(BLooper* looper)
@@ -109,6 +112,7 @@ bool BLooperList::RemoveLooper(BLooper* looper)
 	LDIter i = find_if(fData.begin(), fData.end(), FindLooperPred(looper));
 	if (i != fData.end())
 	{
+		UnregisterLooper(looper);
 		i->looper = NULL;
 		return true;
 	}
@@ -189,6 +193,125 @@ BLooper* BLooperList::LooperForPort(port_id port)
 	return looper;
 }
 //------------------------------------------------------------------------------
+BLooperList::RegistrySlot* BLooperList::AcquireLooper(const BLooper* looper)
+{
+	RegistrySlot* slot = FindSlot(looper);
+	if (!slot)
+	{
+		return NULL;
+	}
+
+	// Pin first, then make sure the slot wasn't retired (or reused) between
+	// the lookup and the pin.  UnregisterLooper() clears the id before it
+	// looks at the pins, so one of the two sides always sees the other.
+	atomic_add(&slot->pins, 1);
+	if (slot->looper != looper || atomic_get(&slot->id) == 0)
+	{
+		atomic_add(&slot->pins, -1);
+		return NULL;
+	}
+
+	return slot;
+}
+//------------------------------------------------------------------------------
+void BLooperList::ReleaseLooper(RegistrySlot* slot)
+{
+	atomic_add(&slot->pins, -1);
+}
+//------------------------------------------------------------------------------
+BLooperList::RegistrySlot* BLooperList::FindSlot(const BLooper* looper)
+{
+	if (!looper)
+	{
+		return NULL;
+	}
+
+	uint32 hash = HashLooper(looper);
+	for (int32 t = 0; t < kMaxRegistryTables; ++t)
+	{
+		RegistrySlot* table = fRegistry[t];
+		if (!table)
+		{
+			break;
+		}
+
+		uint32 mask = ((uint32)kFirstRegistrySize << t) - 1;
+		for (uint32 i = hash & mask, n = 0; n <= mask; i = (i + 1) & mask, ++n)
+		{
+			BLooper* slotLooper = table[i].looper;
+			if (!slotLooper)
+			{
+				break;
+			}
+
+			if (slotLooper == looper && table[i].id != 0)
+			{
+				return &table[i];
+			}
+		}
+	}
+
+	return NULL;
+}
+//------------------------------------------------------------------------------
+void BLooperList::RegisterLooper(BLooper* looper)
+{
+	uint32 hash = HashLooper(looper);
+	for (int32 t = 0; t < kMaxRegistryTables; ++t)
+	{
+		uint32 size = (uint32)kFirstRegistrySize << t;
+		if (t == fRegistryCount)
+		{
+			RegistrySlot* table = new RegistrySlot[size];
+			memset((void*)table, 0, size * sizeof(RegistrySlot));
+			fRegistry[t] = table;
+			++fRegistryCount;
+		}
+
+		// Readers stop probing at a never-used slot, so retired slots stay
+		// in place as tombstones until a new looper can reuse them.
+		RegistrySlot* table = fRegistry[t];
+		uint32 mask = size - 1;
+		for (uint32 i = hash & mask, n = 0; n <= mask; i = (i + 1) & mask, ++n)
+		{
+			RegistrySlot* slot = &table[i];
+			if (!slot->looper)
+			{
+				if (fRegistryUsed[t] >= (int32)(size / 2))
+				{
+					break;
+				}
+				++fRegistryUsed[t];
+			}
+			else if (slot->id != 0 || slot->pins != 0)
+			{
+				continue;
+			}
+
+			slot->looper = looper;
+			atomic_set(&slot->id, (int32)looper->fLooperID);
+			return;
+		}
+	}
+
+	debugger("looper registry is full");
+}
+//------------------------------------------------------------------------------
+void BLooperList::UnregisterLooper(BLooper* looper)
+{
+	RegistrySlot* slot = FindSlot(looper);
+	if (!slot)
+	{
+		return;
+	}
+
+	atomic_set(&slot->id, 0);
+	while (atomic_get(&slot->pins) != 0)
+	{
+		snooze(100);
+	}
+}
+//------------------------------------------------------------------------------
 bool BLooperList::EmptySlotPred(LooperData& Data)
 {
 	return Data.looper == NULL;
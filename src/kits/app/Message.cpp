@@ -32,6 +32,8 @@
 
 // Standard Includes -----------------------------------------------------------
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 // System Includes -------------------------------------------------------------
@@ -58,6 +60,7 @@
 
 // Local Defines ---------------------------------------------------------------
 #define	MSG_FIELD_VERSION		'FOB1'
+#define	MSG_COMPACT_VERSION		'FOB2'
 
 // flags for the overall message (the bitfield is 1 byte)
 #define MSG_FLAG_BIG_ENDIAN		0x01
@@ -74,7 +77,7 @@
 #define MSG_FLAG_HDR_MASK		0xF0
 #endif
 
-#define MSG_HEADER_MAX_SIZE		38
+#define MSG_HEADER_MAX_SIZE		(sizeof (int32) * 8 + 6)
 #define MSG_NAME_MAX_SIZE		256
 
 // Globals ---------------------------------------------------------------------
@@ -90,12 +93,14 @@ const char* B_PROPERTY_NAME_ENTRY = "name";
 BBlockCache* BMessage::sMsgCache = NULL;
 port_id BMessage::sReplyPorts[sNumReplyPorts];
 long BMessage::sReplyPortInUse[sNumReplyPorts];
+bool BMessage::sCompactFormat = false;
 
 
 static status_t handle_reply(port_id   reply_port,
                              int32*    pCode,
                              bigtime_t timeout,
                              BMessage* reply);
+static size_t fixed_item_size(type_code type);
 
 //------------------------------------------------------------------------------
 extern "C" {
@@ -114,6 +119,14 @@ int _init_message_()
 	BMessage::sReplyPortInUse[0] = 0;
 	BMessage::sReplyPortInUse[1] = 0;
 	BMessage::sReplyPortInUse[2] = 0;
+
+	// Teams started from a session that speaks the compact format can use
+	// it with each other from the start.  It trades speed for size: a view
+	// tree comes out at half the bytes but takes about five times as long to
+	// flatten and three times as long to unflatten, so it pays off for
+	// archives kept on disk rather than for messages sent between teams.
+	const char* format = getenv("COSMOE_MESSAGE_FORMAT");
+	BMessage::sCompactFormat = format && strcmp(format, "compact") == 0;
 	return 0;
 }
 //------------------------------------------------------------------------------
@@ -202,6 +215,7 @@ BMessage& BMessage::operator=(const BMessage& msg)
 	fWasDelivered = msg.fWasDelivered;
 	fReadOnly = msg.fReadOnly;
 	fHasSpecifiers = msg.fHasSpecifiers;
+	fCompact = msg.fCompact;
 
 	*fBody = *(msg.fBody);
 	return *this;
@@ -232,6 +246,7 @@ void BMessage::init_data()
 	fWasDelivered = false;
 	fReadOnly = false;
 	fHasSpecifiers = false;
+	fCompact = false;
 
 	if (fBody)
 	{
@@ -464,9 +479,12 @@ status_t BMessage::SendReply(BMessage* the_reply, BMessenger reply_to,
 			return B_DUPLICATE_REPLY;
 		}
 		fReplyDone = true;
+		bool compact = the_reply->fCompact;
 		the_reply->fIsReply = true;
+		the_reply->fCompact = fCompact;
 		status_t err = messenger.SendMessage(the_reply, reply_to, timeout);
 		the_reply->fIsReply = false;
+		the_reply->fCompact = compact;
 		if (err)
 		{
 			if (set_port_owner(messenger.fPort, messenger.fTeam) == B_BAD_TEAM_ID)
@@ -483,9 +501,12 @@ status_t BMessage::SendReply(BMessage* the_reply, BMessenger reply_to,
 	}
 
 	the_reply->AddMessage("_previous_", this);
+	bool compact = the_reply->fCompact;
 	the_reply->fIsReply = true;
+	the_reply->fCompact = fCompact;
 	status_t err = messenger.SendMessage(the_reply, reply_to, timeout);
 	the_reply->fIsReply = false;
+	the_reply->fCompact = compact;
 	the_reply->RemoveName("_previous_");
 	return err;
 }
@@ -533,10 +554,13 @@ status_t BMessage::SendReply(BMessage* the_reply, BMessage* reply_to_reply,
 			return B_DUPLICATE_REPLY;
 		}
 		fReplyDone = true;
+		bool compact = the_reply->fCompact;
 		the_reply->fIsReply = true;
+		the_reply->fCompact = fCompact;
 		status_t err = messenger.SendMessage(the_reply, reply_to_reply,
 											 send_timeout, reply_timeout);
 		the_reply->fIsReply = false;
+		the_reply->fCompact = compact;
 		if (err)
 		{
 			if (set_port_owner(messenger.fPort, messenger.fTeam) == B_BAD_TEAM_ID)
@@ -553,10 +577,13 @@ status_t BMessage::SendReply(BMessage* the_reply, BMessage* reply_to_reply,
 	}
 
 	the_reply->AddMessage("_previous_", this);
+	bool compact = the_reply->fCompact;
 	the_reply->fIsReply = true;
+	the_reply->fCompact = fCompact;
 	status_t err = messenger.SendMessage(the_reply, reply_to_reply,
 										 send_timeout, reply_timeout);
 	the_reply->fIsReply = false;
+	the_reply->fCompact = compact;
 	the_reply->RemoveName("_previous_");
 	return err;
 }
@@ -604,17 +631,55 @@ status_t BMessage::Flatten(BDataIO* stream, ssize_t* size) const
 status_t BMessage::Unflatten(const char* flat_buffer)
 {
 	uint32 size = ((uint32*)flat_buffer)[2];
-	
+	int32 version = ((int32*)flat_buffer)[0];
+	if (version == '1BOF' || version == '2BOF')
+	{
+		size = __swap_int32(size);
+	}
+
 	BMemoryIO MemIO(flat_buffer, size);
-	return Unflatten(&MemIO);
+	if (version != MSG_COMPACT_VERSION && version != '2BOF')
+	{
+		return Unflatten(&MemIO);
+	}
+
+	// Compact messages are decoded in place rather than through the stream
+	bool swap;
+	bool compact;
+	ssize_t bodySize;
+	status_t err = unflatten_hdr(&MemIO, swap, compact, bodySize);
+	if (!err)
+	{
+		err = compact_unflatten(flat_buffer + (size - bodySize), bodySize,
+								swap);
+	}
+
+	return err;
 }
 //------------------------------------------------------------------------------
 status_t BMessage::Unflatten(BDataIO* stream)
 {
 	bool swap;
-	status_t err = unflatten_hdr(stream, swap);
-	
-	if (!err)
+	bool compact;
+	ssize_t bodySize;
+	status_t err = unflatten_hdr(stream, swap, compact, bodySize);
+
+	if (!err && compact)
+	{
+		char* buffer = (char*)malloc(bodySize);
+		if (!buffer)
+			return B_NO_MEMORY;
+
+		ssize_t bytesRead = stream->Read(buffer, bodySize);
+		if (bytesRead < B_OK)
+			err = bytesRead;
+		else if (bytesRead != bodySize)
+			err = B_BAD_DATA;
+		else
+			err = compact_unflatten(buffer, bodySize, swap);
+		free(buffer);
+	}
+	else if (!err)
 	{
 		TReadHelper reader(stream, swap);
 		int8 flags;
@@ -677,10 +742,19 @@ status_t BMessage::Unflatten(BDataIO* stream)
 				reader(name, nameLen);
 				name[nameLen] = '\0';
 
+				// Every item takes at least a byte, or a size in front of it
+				if (count == 0 || dataLen < count ||
+					(flags & MSG_FLAG_FIXED_SIZE && dataLen % count))
+				{
+					throw (status_t)B_BAD_DATA;
+				}
+
 				// Copy the data into a new buffer to byte align it
-				databuffer = (unsigned char*)realloc(databuffer, dataLen);
-				if (!databuffer)
-					throw B_NO_MEMORY;
+				unsigned char* newBuffer =
+					(unsigned char*)realloc(databuffer, dataLen);
+				if (!newBuffer)
+					throw (status_t)B_NO_MEMORY;
+				databuffer = newBuffer;
 				// Get the data
 				reader(databuffer, dataLen);
 
@@ -693,14 +767,6 @@ status_t BMessage::Unflatten(BDataIO* stream)
 					if (err)
 						throw err;
 				}
-				// Is the data variable size? (!flags & MSG_FLAG_FIXED_SIZE)
-				else if (swap && type == B_REF_TYPE)
-				{
-					// Apparently, entry_refs are the only variable-length data
-					// 	  explicitely swapped -- the dev_t and ino_t
-					//    specifically
-					byte_swap(*(entry_ref*)databuffer);
-				}
 
 				// Add each data field to the message
 				uint32 itemSize = 0;
@@ -708,7 +774,7 @@ status_t BMessage::Unflatten(BDataIO* stream)
 				{
 					itemSize = dataLen / count;
 				}
-				unsigned char* dataPtr = databuffer;
+				size_t offset = 0;
 				for (uint32 i = 0; i < count; ++i)
 				{
 					// Line up for the next item
@@ -716,21 +782,49 @@ status_t BMessage::Unflatten(BDataIO* stream)
 					{
 						if (flags & MSG_FLAG_FIXED_SIZE)
 						{
-							dataPtr += itemSize;
+							offset += itemSize;
 						}
 						else
 						{
 							// Have to account for 8-byte boundary padding
 							// We add 4 because padding as calculated during
 							// flattening includes the four-byte size header
-							dataPtr += itemSize + calc_padding(itemSize + 4, 8);
+							offset += itemSize + calc_padding(itemSize + 4, 8);
 						}
 					}
 
 					if ((flags & MSG_FLAG_FIXED_SIZE) == 0)
 					{
-						itemSize = *(uint32*)dataPtr;
-						dataPtr += sizeof (uint32);
+						int32 size;
+						if (offset + sizeof (size) > dataLen)
+							throw (status_t)B_BAD_DATA;
+						memcpy(&size, databuffer + offset, sizeof (size));
+						if (swap)
+							byte_swap(size);
+						itemSize = size;
+						offset += sizeof (size);
+					}
+
+					// The item has to be all there, and be enough of one for
+					// AddData() to read
+					unsigned char* dataPtr = databuffer + offset;
+					if (itemSize > dataLen - offset ||
+						itemSize < fixed_item_size(type) ||
+						(type == B_STRING_TYPE &&
+						 (itemSize == 0 || dataPtr[itemSize - 1] != '\0')))
+					{
+						throw (status_t)B_BAD_DATA;
+					}
+
+					// Apparently, entry_refs are the only variable-length data
+					// 	  explicitely swapped -- the dev_t and ino_t
+					//    specifically
+					if (swap && type == B_REF_TYPE &&
+						!(flags & MSG_FLAG_FIXED_SIZE))
+					{
+						err = entry_ref_swap((char*)dataPtr, itemSize);
+						if (err)
+							throw err;
 					}
 
 					err = AddData(name, type, dataPtr, itemSize,
@@ -746,6 +840,7 @@ status_t BMessage::Unflatten(BDataIO* stream)
 		{
 			err = e;
 		}
+		free(databuffer);
 	}
 
 	return err;
@@ -1484,9 +1579,16 @@ BPoint BMessage::FindPoint(const char* name, int32 n) const
 }
 //------------------------------------------------------------------------------
 status_t BMessage::flatten_hdr(BDataIO* stream) const
+{
+	return flatten_hdr(stream, MSG_FIELD_VERSION,
+					   fBody->FlattenedSize() + calc_hdr_size(0));
+}
+//------------------------------------------------------------------------------
+status_t BMessage::flatten_hdr(BDataIO* stream, int32 version,
+							   ssize_t size) const
 {
 	status_t err = B_OK;
-	int32 data = MSG_FIELD_VERSION;
+	int32 data = version;
 
 	write_helper(stream, (const void*)&data, sizeof (data), err);
 	if (!err)
@@ -1496,7 +1598,7 @@ status_t BMessage::flatten_hdr(BDataIO* stream) const
 	}
 	if (!err)
 	{
-		data = fBody->FlattenedSize() + calc_hdr_size(0);
+		data = size;
 		write_helper(stream, (const void*)&data, sizeof (data), err);
 	}
 	if (!err)
@@ -1504,27 +1606,7 @@ status_t BMessage::flatten_hdr(BDataIO* stream) const
 		write_helper(stream, (const void*)&what, sizeof (what), err);
 	}
 
-	uint8 flags = 0;
-#ifdef B_HOST_IS_BENDIAN
-	flags |= MSG_FLAG_BIG_ENDIAN;
-#endif
-	if (HasSpecifiers())
-	{
-		flags |= MSG_FLAG_SCRIPT_MSG;
-	}
-
-	if (fTarget != B_NULL_TOKEN)
-	{
-		flags |= MSG_FLAG_INCL_TARGET;
-	}
-
-	if (fReplyTo.port >= 0 &&
-		fReplyTo.target != B_NULL_TOKEN &&
-		fReplyTo.team >= 0)
-	{
-		flags |= MSG_FLAG_INCL_REPLY;
-	}
-
+	uint8 flags = hdr_flags();
 	write_helper(stream, (const void*)&flags, sizeof (flags), err);
 
 	// Write targeting and reply info if necessary
@@ -1579,7 +1661,34 @@ status_t BMessage::flatten_hdr(BDataIO* stream) const
 	return err;
 }
 //------------------------------------------------------------------------------
-status_t BMessage::unflatten_hdr(BDataIO* stream, bool& swap)
+uint8 BMessage::hdr_flags() const
+{
+	uint8 flags = 0;
+#ifdef B_HOST_IS_BENDIAN
+	flags |= MSG_FLAG_BIG_ENDIAN;
+#endif
+	if (HasSpecifiers())
+	{
+		flags |= MSG_FLAG_SCRIPT_MSG;
+	}
+
+	if (fTarget != B_NULL_TOKEN)
+	{
+		flags |= MSG_FLAG_INCL_TARGET;
+	}
+
+	if (fReplyTo.port >= 0 &&
+		fReplyTo.target != B_NULL_TOKEN &&
+		fReplyTo.team >= 0)
+	{
+		flags |= MSG_FLAG_INCL_REPLY;
+	}
+
+	return flags;
+}
+//------------------------------------------------------------------------------
+status_t BMessage::unflatten_hdr(BDataIO* stream, bool& swap, bool& compact,
+								 ssize_t& body_size)
 {
 	status_t err = B_OK;
 	int32 data;
@@ -1588,16 +1697,18 @@ status_t BMessage::unflatten_hdr(BDataIO* stream, bool& swap)
 
 	TReadHelper read_helper(stream);
 	TChecksumHelper checksum_helper(csBuffer);
+	compact = false;
+	body_size = 0;
 
 	try {
 
 	// Get the message version
 	read_helper(data);
-	if (data == '1BOF')
+	if (data == '1BOF' || data == '2BOF')
 	{
 		swap = true;
 	}
-	else if (data == 'FOB1')
+	else if (data == MSG_FIELD_VERSION || data == MSG_COMPACT_VERSION)
 	{
 		swap = false;
 	}
@@ -1606,6 +1717,7 @@ status_t BMessage::unflatten_hdr(BDataIO* stream, bool& swap)
 		// This is *not* a message
 		return B_NOT_A_MESSAGE;
 	}
+	compact = data == MSG_COMPACT_VERSION || data == '2BOF';
 
 	// Make way for the new data
 	MakeEmpty();
@@ -1617,6 +1729,7 @@ status_t BMessage::unflatten_hdr(BDataIO* stream, bool& swap)
 	// get the size
 	read_helper(data);
 	checksum_helper.Cache(data);
+	body_size = data;
 	// Get the what
 	read_helper(what);
 	checksum_helper.Cache(what);
@@ -1683,6 +1796,13 @@ status_t BMessage::unflatten_hdr(BDataIO* stream, bool& swap)
 	if (checksum != checksum_helper.CheckSum())
 		err = B_NOT_A_MESSAGE;
 
+	// What follows the header: 8 bytes of version and checksum weren't cached
+	body_size -= (ssize_t)sizeof (uint32) * 2 +
+				 checksum_helper.CachedSize();
+	if (!err && body_size < 0)
+		err = B_BAD_DATA;
+
+	fCompact = compact;
 	return err;
 }
 //------------------------------------------------------------------------------
@@ -1731,6 +1851,580 @@ char* BMessage::stack_flatten(char* stack_ptr, ssize_t stack_size,
 	}
 	return new_ptr;
 }
+//------------------------------------------------------------------------------
+char* BMessage::compact_flatten(ssize_t* size, status_t* err) const
+{
+/**
+	@note	The compact ('FOB2') format keeps the header of the old one, so
+			that the size and checksum are found in the same places.  The
+			header is followed by the name table, then by the body.  Since
+			the name table isn't complete until the body (including any
+			nested messages) has been written, the body goes to a buffer of
+			its own first.
+ */
+	TCompactNameTable names;
+	TCompactWriter body;
+	TCompactWriter result;
+
+	try
+	{
+		fBody->FlattenCompact(body, names);
+
+		*err = flatten_hdr(&result, MSG_COMPACT_VERSION, 0);
+		if (*err)
+			return NULL;
+
+		names.Flatten(result);
+		result.Put(body.Buffer(), body.Size());
+	}
+	catch (status_t& e)
+	{
+		*err = e;
+		return NULL;
+	}
+
+	char* buffer = result.Buffer();
+	((uint32*)buffer)[2] = result.Size();
+	((uint32*)buffer)[1] = _checksum_((uchar*)buffer + (sizeof (uint32) * 2),
+									  calc_hdr_size(0) - (sizeof (uint32) * 2));
+
+	*size = result.Size();
+	*err = B_OK;
+	return result.Detach();
+}
+//------------------------------------------------------------------------------
+status_t BMessage::compact_unflatten(const char* buffer, size_t size,
+									 bool swap)
+{
+	status_t err = B_OK;
+	TCompactReader reader(buffer, size, swap);
+	TCompactNameTable names;
+
+	try
+	{
+		names.Unflatten(reader);
+		compact_unflatten_body(reader, names);
+	}
+	catch (status_t& e)
+	{
+		err = e;
+	}
+	catch (std::bad_alloc&)
+	{
+		err = B_NO_MEMORY;
+	}
+
+	return err;
+}
+//------------------------------------------------------------------------------
+void BMessage::compact_unflatten_body(TCompactReader& reader,
+									  TCompactNameTable& names)
+{
+	TCompactWriter nested;
+	for (uint32 nameIndex = reader.GetVarInt(); nameIndex;
+		 nameIndex = reader.GetVarInt())
+	{
+		const char* name = names.NameAt(nameIndex - 1);
+		type_code type = reader.Get32();
+		uint8 flags;
+		reader(flags);
+		uint32 count = reader.GetVarInt();
+		status_t err = B_OK;
+
+		if (flags & MSG_FLAG_NESTED_MESSAGE)
+		{
+			// Nested messages go straight back to the old format they are
+			// stored in, without being built up as a BMessage first
+			for (uint32 index = 0; index < count && !err; ++index)
+			{
+				nested.Truncate(0);
+				compact_untranscode(reader, names, nested);
+				err = AddData(name, B_MESSAGE_TYPE, nested.Buffer(),
+							  nested.Size(), false);
+			}
+		}
+		else if (flags & MSG_FLAG_FIXED_SIZE)
+		{
+			uint32 itemSize = reader.GetVarInt();
+			if (itemSize < fixed_item_size(type) ||
+				(uint64)itemSize * count > 0x7fffffff)
+			{
+				throw (status_t)B_BAD_DATA;
+			}
+			uint32 dataLen = itemSize * count;
+			const char* data = reader.Get(dataLen);
+
+			// Copy the items out to align them, and to swap them if needed
+			union { double align; char bytes[256]; } local;
+			char* buffer = local.bytes;
+			if (dataLen > sizeof (local.bytes))
+			{
+				buffer = (char*)malloc(dataLen);
+				if (!buffer)
+					throw (status_t)B_NO_MEMORY;
+			}
+			memcpy(buffer, data, dataLen);
+
+			if (reader.IsSwapping())
+			{
+				err = swap_data(type, buffer, dataLen, B_SWAP_ALWAYS);
+			}
+			for (uint32 index = 0; index < count && !err; ++index)
+			{
+				err = AddData(name, type, buffer + index * itemSize, itemSize,
+							  true);
+			}
+
+			if (buffer != local.bytes)
+			{
+				free(buffer);
+			}
+		}
+		else
+		{
+			for (uint32 index = 0; index < count && !err; ++index)
+			{
+				uint32 itemSize = reader.GetVarInt();
+				const char* data = reader.Get(itemSize);
+				if (itemSize < fixed_item_size(type) ||
+					(type == B_STRING_TYPE &&
+					 (itemSize == 0 || data[itemSize - 1] != '\0')))
+				{
+					throw (status_t)B_BAD_DATA;
+				}
+
+				if (reader.IsSwapping() && type == B_REF_TYPE)
+				{
+					char* ref = (char*)malloc(itemSize);
+					if (!ref)
+						throw (status_t)B_NO_MEMORY;
+					memcpy(ref, data, itemSize);
+					err = entry_ref_swap(ref, itemSize);
+					if (!err)
+					{
+						err = AddData(name, type, ref, itemSize, false);
+					}
+					free(ref);
+				}
+				else
+				{
+					err = AddData(name, type, data, itemSize, false);
+				}
+			}
+		}
+
+		if (err)
+			throw err;
+	}
+}
+//------------------------------------------------------------------------------
+namespace BPrivate {
+
+//------------------------------------------------------------------------------
+static void transcode_message(const char* flat, size_t size,
+							  TCompactWriter& writer, TCompactNameTable& names,
+							  int32 depth)
+{
+/**
+	@note	Inline form of a nested message: its 'what', its header flags
+			and whatever target and reply info they call for, then its body
+			as BMessageBody::FlattenCompact() writes it.  Only messages the
+			way BMessage::Flatten() writes them (host byte order) qualify;
+			throws B_BAD_DATA on anything else.
+ */
+	if (depth > 64)
+		throw (status_t)B_BAD_DATA;
+
+	TCompactReader reader(flat, size, false);
+	int32 version;
+	int32 checksum;
+	int32 flatSize;
+	uint32 what;
+	uint8 flags;
+	reader(version);
+	reader(checksum);
+	reader(flatSize);
+	if (version != MSG_FIELD_VERSION || (size_t)flatSize > size)
+		throw (status_t)B_BAD_DATA;
+
+	reader(what);
+	reader(flags);
+	writer.Put32(what);
+	writer(flags);
+
+	int32 data;
+	if (flags & MSG_FLAG_INCL_TARGET)
+	{
+		reader(data);
+		writer.Put32(data);
+	}
+	if (flags & MSG_FLAG_INCL_REPLY)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			reader(data);
+			writer.Put32(data);
+		}
+		writer.Put(reader.Get(4), 4);
+	}
+
+	uint8 fieldFlags;
+	for (reader(fieldFlags); fieldFlags != MSG_LAST_ENTRY; reader(fieldFlags))
+	{
+		type_code type;
+		reader(type);
+
+		uint32 count = 1;
+		size_t dataLen;
+		if (fieldFlags & MSG_FLAG_MINI_DATA)
+		{
+			uint8 miniCount;
+			uint8 miniLen;
+			if (!(fieldFlags & MSG_FLAG_SINGLE_ITEM))
+			{
+				reader(miniCount);
+				count = miniCount;
+			}
+			reader(miniLen);
+			dataLen = miniLen;
+		}
+		else
+		{
+			if (!(fieldFlags & MSG_FLAG_SINGLE_ITEM))
+			{
+				int32 maxiCount;
+				reader(maxiCount);
+				count = maxiCount;
+			}
+			reader(dataLen);
+		}
+
+		uint8 nameLen;
+		reader(nameLen);
+		const char* name = reader.Get(nameLen);
+		const char* data = reader.Get(dataLen);
+		if (count == 0 || count > dataLen)
+			throw (status_t)B_BAD_DATA;
+
+		writer.PutVarInt(names.IndexOf(name, nameLen) + 1);
+		writer.Put32(type);
+
+		if (fieldFlags & MSG_FLAG_FIXED_SIZE)
+		{
+			if (dataLen % count)
+				throw (status_t)B_BAD_DATA;
+
+			uint8 compactFlags = MSG_FLAG_FIXED_SIZE;
+			writer(compactFlags);
+			writer.PutVarInt(count);
+			writer.PutVarInt(dataLen / count);
+			writer.Put(data, dataLen);
+			continue;
+		}
+
+		// Variable size items are each preceded by their size and padded
+		const char* items = data;
+		const char* end = data + dataLen;
+		if (type == B_MESSAGE_TYPE)
+		{
+			size_t mark = writer.Size();
+			try
+			{
+				uint8 compactFlags = MSG_FLAG_NESTED_MESSAGE;
+				writer(compactFlags);
+				writer.PutVarInt(count);
+				for (uint32 index = 0; index < count; ++index)
+				{
+					TCompactReader item(items, end - items, false);
+					int32 itemSize;
+					item(itemSize);
+					transcode_message(item.Get(itemSize), itemSize, writer,
+									  names, depth + 1);
+					items += sizeof (int32) + itemSize +
+							 calc_padding(itemSize + 4, 8);
+				}
+				continue;
+			}
+			catch (status_t& e)
+			{
+				// Not a message after all; store it as plain data
+				if (e != B_BAD_DATA)
+					throw;
+				writer.Truncate(mark);
+				items = data;
+			}
+		}
+
+		uint8 compactFlags = 0;
+		writer(compactFlags);
+		writer.PutVarInt(count);
+		for (uint32 index = 0; index < count; ++index)
+		{
+			TCompactReader item(items, end - items, false);
+			int32 itemSize;
+			item(itemSize);
+			writer.PutVarInt(itemSize);
+			writer.Put(item.Get(itemSize), itemSize);
+			items += sizeof (int32) + itemSize + calc_padding(itemSize + 4, 8);
+		}
+	}
+
+	writer.PutVarInt(0);
+}
+//------------------------------------------------------------------------------
+bool compact_transcode(const char* flat, size_t size, TCompactWriter& writer,
+					   TCompactNameTable& names, int32 depth)
+{
+	size_t mark = writer.Size();
+	try
+	{
+		transcode_message(flat, size, writer, names, depth);
+	}
+	catch (status_t& e)
+	{
+		if (e != B_BAD_DATA)
+			throw;
+		writer.Truncate(mark);
+		return false;
+	}
+	return true;
+}
+//------------------------------------------------------------------------------
+struct compact_item
+{
+	const char*	data;
+	size_t		size;
+};
+//------------------------------------------------------------------------------
+static void put_field_header(TCompactWriter& flat, uint8 fixedSize,
+							 type_code type, uint32 count, size_t dataLen,
+							 const char* name, uint8 nameLen)
+{
+	// Same flags as BMessageFieldImpl::FlattenFlags() gives a field built up
+	// by AddData()
+	uint8 fieldFlags = MSG_FLAG_VALID | fixedSize;
+	if (count == 1)
+		fieldFlags |= MSG_FLAG_SINGLE_ITEM;
+	if (count <= 255 && dataLen <= 255)
+		fieldFlags |= MSG_FLAG_MINI_DATA;
+
+	flat(fieldFlags);
+	flat(type);
+	if (fieldFlags & MSG_FLAG_MINI_DATA)
+	{
+		uint8 miniCount = count;
+		uint8 miniLen = dataLen;
+		if (count != 1)
+			flat(miniCount);
+		flat(miniLen);
+	}
+	else
+	{
+		int32 maxiCount = count;
+		if (count != 1)
+			flat(maxiCount);
+		flat(dataLen);
+	}
+	flat(nameLen);
+	flat.Put(name, nameLen);
+}
+//------------------------------------------------------------------------------
+static void untranscode_nested(TCompactReader& reader,
+							   TCompactNameTable& names, TCompactWriter& flat,
+							   type_code type, uint32 count, const char* name,
+							   uint8 nameLen)
+{
+	// The messages go straight into place behind a header for the large
+	// layout, whose size is filled in afterwards, instead of through a
+	// scratch copy at every level of nesting.
+	size_t fieldStart = flat.Size();
+	put_field_header(flat, 0, type, count, 0x100, name, nameLen);
+	size_t dataStart = flat.Size();
+
+	for (uint32 index = 0; index < count; ++index)
+	{
+		size_t mark = flat.Size();
+		int32 itemSize = 0;
+		flat(itemSize);
+		compact_untranscode(reader, names, flat);
+		itemSize = flat.Size() - mark - sizeof (int32);
+		memcpy(flat.Buffer() + mark, &itemSize, sizeof (itemSize));
+		flat.Put(BMessageField::sNullData, calc_padding(itemSize + 4, 8));
+	}
+
+	size_t dataLen = flat.Size() - dataStart;
+	if (count <= 255 && dataLen <= 255)
+	{
+		// Small enough for the short layout after all
+		char data[255];
+		memcpy(data, flat.Buffer() + dataStart, dataLen);
+		flat.Truncate(fieldStart);
+		put_field_header(flat, 0, type, count, dataLen, name, nameLen);
+		flat.Put(data, dataLen);
+		return;
+	}
+
+	size_t lenAt = dataStart - nameLen - sizeof (nameLen) - sizeof (dataLen);
+	memcpy(flat.Buffer() + lenAt, &dataLen, sizeof (dataLen));
+}
+//------------------------------------------------------------------------------
+void compact_untranscode(TCompactReader& reader, TCompactNameTable& names,
+						 TCompactWriter& flat)
+{
+/**
+	@note	Writes the message exactly the way BMessage::Flatten() would once
+			it had been unflattened, so that what was read from the old
+			format goes back out unchanged.  Throws on failure.
+ */
+	reader.EnterMessage();
+	size_t start = flat.Size();
+
+	int32 data = MSG_FIELD_VERSION;
+	uint32 what = reader.Get32();
+	uint8 flags;
+	reader(flags);
+	flat(data);
+	flat(data);		// checksum
+	flat(data);		// size
+	flat(what);
+	flat(flags);
+
+	if (flags & MSG_FLAG_INCL_TARGET)
+	{
+		data = reader.GetSigned32();
+		flat(data);
+	}
+	if (flags & MSG_FLAG_INCL_REPLY)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			data = reader.GetSigned32();
+			flat(data);
+		}
+		flat.Put(reader.Get(4), 4);
+	}
+	size_t headerSize = flat.Size() - start;
+
+	// Most fields hold a single item; only long arrays need the heap
+	compact_item localItems[8];
+	std::vector<compact_item> heapItems;
+	TCompactWriter scratch;
+	for (uint32 nameIndex = reader.GetVarInt(); nameIndex;
+		 nameIndex = reader.GetVarInt())
+	{
+		const char* name = names.NameAt(nameIndex - 1);
+		uint8 nameLen = strlen(name);
+		type_code type = reader.Get32();
+		uint8 compactFlags;
+		reader(compactFlags);
+		uint32 count = reader.GetVarInt();
+		if (count == 0)
+			throw (status_t)B_BAD_DATA;
+
+		if (compactFlags & MSG_FLAG_NESTED_MESSAGE)
+		{
+			untranscode_nested(reader, names, flat, type, count, name,
+							   nameLen);
+			continue;
+		}
+
+		// Gather the items first: the field header needs their total size
+		size_t dataLen = 0;
+		const char* fixedData = NULL;
+		std::vector<char> swapped;
+		bool inScratch = false;
+		compact_item* items = localItems;
+		scratch.Truncate(0);
+		if (compactFlags & MSG_FLAG_FIXED_SIZE)
+		{
+			uint32 itemSize = reader.GetVarInt();
+			if (itemSize < fixed_item_size(type) ||
+				(uint64)itemSize * count > 0x7fffffff)
+			{
+				throw (status_t)B_BAD_DATA;
+			}
+			dataLen = itemSize * count;
+			fixedData = reader.Get(dataLen);
+			if (reader.IsSwapping())
+			{
+				swapped.assign(fixedData, fixedData + dataLen);
+				if (swap_data(type, &swapped[0], dataLen, B_SWAP_ALWAYS))
+					throw (status_t)B_BAD_DATA;
+				fixedData = &swapped[0];
+			}
+		}
+		else
+		{
+			if (count > sizeof (localItems) / sizeof (localItems[0]))
+			{
+				heapItems.resize(count);
+				items = &heapItems[0];
+			}
+			for (uint32 index = 0; index < count; ++index)
+			{
+				compact_item& item = items[index];
+				item.size = reader.GetVarInt();
+				item.data = reader.Get(item.size);
+				if (item.size < fixed_item_size(type) ||
+					(type == B_STRING_TYPE &&
+					 (item.size == 0 || item.data[item.size - 1] != '\0')))
+				{
+					throw (status_t)B_BAD_DATA;
+				}
+				if (reader.IsSwapping() && type == B_REF_TYPE)
+				{
+					// Offsets for now; the buffer may still move
+					size_t mark = scratch.Size();
+					scratch.Put(item.data, item.size);
+					entry_ref_swap(scratch.Buffer() + mark, item.size);
+					item.data = (const char*)mark;
+					inScratch = true;
+				}
+				dataLen += sizeof (int32) + item.size +
+						   calc_padding(item.size + 4, 8);
+			}
+		}
+
+		put_field_header(flat, compactFlags & MSG_FLAG_FIXED_SIZE, type, count,
+						 dataLen, name, nameLen);
+
+		if (fixedData)
+		{
+			flat.Put(fixedData, dataLen);
+			continue;
+		}
+
+		for (uint32 index = 0; index < count; ++index)
+		{
+			compact_item& item = items[index];
+			const char* itemData = item.data;
+			if (inScratch)
+			{
+				itemData = scratch.Buffer() + (size_t)item.data;
+			}
+			int32 itemSize = item.size;
+			flat(itemSize);
+			flat.Put(itemData, item.size);
+			flat.Put(BMessageField::sNullData, calc_padding(item.size + 4, 8));
+		}
+	}
+
+	uint8 last = MSG_LAST_ENTRY;
+	flat(last);
+	reader.LeaveMessage();
+
+	// Fill in the size and checksum
+	char* header = flat.Buffer() + start;
+	data = flat.Size() - start;
+	memcpy(header + sizeof (int32) * 2, &data, sizeof (data));
+	data = _checksum_((uchar*)header + sizeof (int32) * 2,
+					  headerSize - sizeof (int32) * 2);
+	memcpy(header + sizeof (int32), &data, sizeof (data));
+}
+//------------------------------------------------------------------------------
+
+}	// namespace BPrivate
+
 //------------------------------------------------------------------------------
 ssize_t BMessage::calc_hdr_size(uchar flags) const
 {
@@ -1759,11 +2453,11 @@ ssize_t BMessage::min_hdr_size() const
 {
 	ssize_t size = 0;
 
-	size += 4;	// version
-	size += 4;	// checksum
-	size += 4;	// flattened size
-	size += 4;	// 'what'
-	size += 1;	// flags
+	size += sizeof (int32);	// version
+	size += sizeof (int32);	// checksum
+	size += sizeof (int32);	// flattened size
+	size += sizeof (what);	// 'what'
+	size += 1;				// flags
 
 	return size;
 }
@@ -1789,17 +2483,33 @@ status_t BMessage::_send_(port_id port, int32 token, bool preferred,
 
 	char tmp[0x800];
 	ssize_t size;
-	char* p = stack_flatten(tmp, sizeof(tmp), true /* include reply */, &size);
-	char* pMem = p ? p : tmp;
-	status_t err;
-	do
+	status_t err = B_OK;
+	char* pCompact = NULL;
+	char* p = NULL;
+	char* pMem;
+	// Only use the compact format with peers known to read it: either the
+	// whole session does, or we're answering a message that came that way
+	if (sCompactFormat || (fIsReply && fCompact))
+	{
+		pCompact = compact_flatten(&size, &err);
+		pMem = pCompact;
+	}
+	else
+	{
+		p = stack_flatten(tmp, sizeof(tmp), true /* include reply */, &size);
+		pMem = p ? p : tmp;
+	}
+	while (pMem)
 	{
 		err = write_port_etc(port, 'pjpp', pMem, size, B_RELATIVE_TIMEOUT, timeout);
-	} while (err == B_INTERRUPTED);
+		if (err != B_INTERRUPTED)
+			break;
+	}
 	if (p)
 	{
 		delete[] p;
 	}
+	free(pCompact);
 	self->fPreferred     = tmp_msg.fPreferred;
 	self->fTarget        = tmp_msg.fTarget;
 	self->fReplyRequired = tmp_msg.fReplyRequired;
@@ -1953,6 +2663,42 @@ static status_t handle_reply(port_id   reply_port,
 	return err;
 }
 //------------------------------------------------------------------------------
+static size_t fixed_item_size(type_code type)
+{
+	// The least data AddData() reads for an item of the given type
+	switch (type)
+	{
+		case B_BOOL_TYPE:
+			return sizeof (bool);
+		case B_INT8_TYPE:
+		case B_UINT8_TYPE:
+			return sizeof (int8);
+		case B_INT16_TYPE:
+		case B_UINT16_TYPE:
+			return sizeof (int16);
+		case B_INT32_TYPE:
+		case B_UINT32_TYPE:
+			return sizeof (int32);
+		case B_INT64_TYPE:
+		case B_UINT64_TYPE:
+			return sizeof (int64);
+		case B_FLOAT_TYPE:
+			return sizeof (float);
+		case B_DOUBLE_TYPE:
+			return sizeof (double);
+		case B_POINT_TYPE:
+			return sizeof (BPoint);
+		case B_RECT_TYPE:
+			return sizeof (BRect);
+		case B_MESSENGER_TYPE:
+			return sizeof (BMessenger);
+		case B_POINTER_TYPE:
+			return sizeof (void*);
+		default:
+			return 0;
+	}
+}
+//------------------------------------------------------------------------------
 
 #else	// USING_TEMPLATE_MADNESS
 
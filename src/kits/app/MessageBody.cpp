@@ -33,6 +33,7 @@
 
 // Project Includes ------------------------------------------------------------
 #include <MessageBody.h>
+#include <MessageUtils.h>
 
 // Local Includes --------------------------------------------------------------
 
@@ -245,6 +246,91 @@ status_t BMessageBody::Flatten(BDataIO* stream) const
 	return err;
 }
 //------------------------------------------------------------------------------
+void BMessageBody::FlattenCompact(TCompactWriter& writer,
+								  TCompactNameTable& names) const
+{
+/**
+	@note	Compact ('FOB2') layout of a body: per field a varint index into
+			the name table plus one, the type code, a flags byte and a varint
+			item count, with a zero varint after the last field.  Fixed size
+			items follow as a varint item size and the packed items; nested
+			messages follow inline; other variable size items each carry a
+			varint length and no padding.  Throws on failure.
+ */
+	for (TMsgDataMap::const_iterator i = fData.begin(); i != fData.end(); ++i)
+	{
+		BMessageField* BMF = i->second;
+		type_code type = BMF->Type();
+		int32 count = BMF->CountItems();
+
+		writer.PutVarInt(names.IndexOf(BMF->Name()) + 1);
+		writer.Put32(type);
+
+		if (type == B_MESSAGE_TYPE &&
+			FlattenCompactMessages(BMF, writer, names))
+		{
+			continue;
+		}
+
+		ssize_t size;
+		const void* data;
+		if (BMF->FixedSize())
+		{
+			uint8 flags = MSG_FLAG_FIXED_SIZE;
+			writer(flags);
+			writer.PutVarInt(count);
+			data = BMF->DataAt(0, &size);
+			writer.PutVarInt(size);
+			for (int32 index = 0; index < count; ++index)
+			{
+				data = BMF->DataAt(index, &size);
+				writer.Put(data, size);
+			}
+		}
+		else
+		{
+			uint8 flags = 0;
+			writer(flags);
+			writer.PutVarInt(count);
+			for (int32 index = 0; index < count; ++index)
+			{
+				data = BMF->DataAt(index, &size);
+				writer.PutVarInt(size);
+				writer.Put(data, size);
+			}
+		}
+	}
+
+	writer.PutVarInt(0);
+}
+//------------------------------------------------------------------------------
+bool BMessageBody::FlattenCompactMessages(const BMessageField* field,
+										  TCompactWriter& writer,
+										  TCompactNameTable& names) const
+{
+	// Nested messages are kept flattened in the old format; they are
+	// converted as they are so their names go into the shared table.
+	// Anything that doesn't convert is written as plain data instead.
+	size_t mark = writer.Size();
+	int32 count = field->CountItems();
+	uint8 flags = MSG_FLAG_NESTED_MESSAGE;
+	writer(flags);
+	writer.PutVarInt(count);
+
+	for (int32 index = 0; index < count; ++index)
+	{
+		ssize_t size;
+		const char* data = (const char*)field->DataAt(index, &size);
+		if (!compact_transcode(data, size, writer, names))
+		{
+			writer.Truncate(mark);
+			return false;
+		}
+	}
+
+	return true;
+}
+//------------------------------------------------------------------------------
 status_t BMessageBody::Unflatten(const char* flat_buffer)
 {
 	// TODO: implement
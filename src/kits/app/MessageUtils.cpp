@@ -28,6 +28,7 @@
 //------------------------------------------------------------------------------
 
 // Standard Includes -----------------------------------------------------------
+#include <stdlib.h>
 #include <string.h>
 
 // System Includes -------------------------------------------------------------
@@ -158,6 +159,137 @@ int32 TChecksumHelper::CheckSum()
 	 return _checksum_(fBuffer, fBufPtr - fBuffer);
 }
 //------------------------------------------------------------------------------
+TCompactWriter::~TCompactWriter()
+{
+	free(fBuffer);
+}
+//------------------------------------------------------------------------------
+ssize_t TCompactWriter::Read(void* buffer, size_t size)
+{
+	return B_NOT_ALLOWED;
+}
+//------------------------------------------------------------------------------
+ssize_t TCompactWriter::Write(const void* buffer, size_t size)
+{
+	try
+	{
+		Put(buffer, size);
+	}
+	catch (status_t& e)
+	{
+		return e;
+	}
+	return size;
+}
+//------------------------------------------------------------------------------
+char* TCompactWriter::Detach()
+{
+	char* buffer = fBuffer;
+	fBuffer = NULL;
+	fSize = fCapacity = 0;
+	return buffer;
+}
+//------------------------------------------------------------------------------
+void TCompactWriter::Grow(size_t len)
+{
+	size_t capacity = fCapacity ? fCapacity * 2 : 256;
+	while (capacity < fSize + len)
+	{
+		capacity *= 2;
+	}
+
+	char* buffer = (char*)realloc(fBuffer, capacity);
+	if (!buffer)
+		throw (status_t)B_NO_MEMORY;
+
+	fBuffer = buffer;
+	fCapacity = capacity;
+}
+//------------------------------------------------------------------------------
+static inline uint32 hash_name(const char* name, size_t length)
+{
+	uint32 hash = 2166136261UL;
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash = (hash ^ (uint8)name[i]) * 16777619UL;
+	}
+	return hash;
+}
+//------------------------------------------------------------------------------
+uint32 TCompactNameTable::IndexOf(const char* name, size_t length)
+{
+	if (fSlots.size() < (fNames.size() + 1) * 2)
+	{
+		Rehash(fSlots.empty() ? 32 : fSlots.size() * 2);
+	}
+
+	uint32 mask = fSlots.size() - 1;
+	uint32 i = hash_name(name, length) & mask;
+	while (fSlots[i])
+	{
+		const std::string& slotName = fNames[fSlots[i] - 1];
+		if (slotName.length() == length
+			&& memcmp(slotName.data(), name, length) == 0)
+		{
+			return fSlots[i] - 1;
+		}
+		i = (i + 1) & mask;
+	}
+
+	fNames.push_back(std::string(name, length));
+	fSlots[i] = fNames.size();
+	return fNames.size() - 1;
+}
+//------------------------------------------------------------------------------
+void TCompactNameTable::Rehash(uint32 size)
+{
+	fSlots.assign(size, 0);
+	uint32 mask = size - 1;
+	for (uint32 index = 0; index < fNames.size(); ++index)
+	{
+		uint32 i = hash_name(fNames[index].data(), fNames[index].length())
+			& mask;
+		while (fSlots[i])
+		{
+			i = (i + 1) & mask;
+		}
+		fSlots[i] = index + 1;
+	}
+}
+//------------------------------------------------------------------------------
+void TCompactNameTable::Flatten(TCompactWriter& writer) const
+{
+	writer.PutVarInt(fNames.size());
+	for (uint32 i = 0; i < fNames.size(); ++i)
+	{
+		writer.PutVarInt(fNames[i].length());
+		writer.Put(fNames[i].data(), fNames[i].length());
+	}
+}
+//------------------------------------------------------------------------------
+void TCompactNameTable::Unflatten(TCompactReader& reader)
+{
+	fSlots.clear();
+	fNames.clear();
+
+	uint32 count = reader.GetVarInt();
+	for (uint32 i = 0; i < count; ++i)
+	{
+		uint32 len = reader.GetVarInt();
+		// Same limit as the old format's one byte name length
+		if (len > 255)
+			throw (status_t)B_BAD_DATA;
+		fNames.push_back(std::string(reader.Get(len), len));
+	}
+}
+//------------------------------------------------------------------------------
+const char* TCompactNameTable::NameAt(uint32 index) const
+{
+	if (index >= fNames.size())
+		throw (status_t)B_BAD_DATA;
+	return fNames[index].c_str();
+}
+//------------------------------------------------------------------------------
 
 /*
  * $Log $
@@ -59,6 +59,7 @@
 using BPrivate::gDefaultTokens;
 using BPrivate::gLooperList;
 using BPrivate::BLooperList;
+using BPrivate::BLooperPin;
 using BPrivate::BObjectLocker;
 
 enum {
@@ -138,8 +139,8 @@ BMessenger::BMessenger(const BHandler *handler, const BLooper *looper,
 		}
 		// set port, token,...
 		if (error == B_OK) {
-			BObjectLocker<BLooperList> locker(gLooperList);
-			if (locker.IsLocked() && gLooperList.IsLooperValid(looper)) {
+			BLooperPin pin(looper);
+			if (pin.IsValid()) {
 				fPort = looper->fMsgPort;
 				fHandlerToken = (handler ? _get_object_token_(handler) : -1);
 				fPreferredTarget = !handler;
@@ -29,10 +29,12 @@
 #include <new>
 
 #include <ServerProtocol.h>
+#include <CommandRing.h>
 #include <PortLink.h>
 
 BPortLink::BPortLink(port_id send, port_id receive) :
-	fReader(new LinkMsgReader(receive)), fSender(new LinkMsgSender(send))
+	fReader(new LinkMsgReader(receive)), fSender(new LinkMsgSender(send)),
+	fRing(NULL)
 {
 }
 
@@ -40,6 +42,7 @@ BPortLink::~BPortLink()
 {
 	delete fReader;
 	delete fSender;
+	delete fRing;
 }
 
 status_t BPortLink::StartMessage(int32 code)
@@ -72,6 +75,49 @@ port_id BPortLink::GetSendPort()
 	return fSender->GetPort();
 }
 
+/*!
+	\brief Sends messages through a ring the server shares instead of the port
+	\param area The ring's area, or a negative value to go back to the port
+
+	The send port is still needed, to wake the server up.
+*/
+status_t BPortLink::SetSendRing(area_id area)
+{
+	fSender->SetRing(NULL);
+	delete fRing;
+	fRing = NULL;
+
+	if (area < 0)
+		return B_OK;
+
+	fRing = new CommandRing(area);
+	status_t err = fRing->InitCheck();
+	if (err < B_OK)
+	{
+		delete fRing;
+		fRing = NULL;
+		return err;
+	}
+
+	fSender->SetRing(fRing);
+	return B_OK;
+}
+
+void BPortLink::SetFlushLatency(bigtime_t latency)
+{
+	fSender->SetFlushLatency(latency);
+}
+
+status_t BPortLink::FlushIfLate(void)
+{
+	return fSender->FlushIfLate();
+}
+
+void BPortLink::GetStats(link_sender_stats *stats, bool reset)
+{
+	fSender->GetStats(stats, reset);
+}
+
 void BPortLink::SetReplyPort( port_id port )
 {
 	fReader->SetPort(port);
@@ -25,8 +25,7 @@
 //------------------------------------------------------------------------------
 
 // Standard Includes -----------------------------------------------------------
-#include <map>
-#include <stack>
+#include <string.h>
 
 // System Includes -------------------------------------------------------------
 #include <Autolock.h>
@@ -38,6 +37,10 @@
 
 // Local Defines ---------------------------------------------------------------
 
+// Keeps the compiler from moving slot accesses across the token stamp; the
+// hardware already keeps stores (and loads) in program order on x86.
+#define token_barrier()		__asm__ __volatile__("" : : : "memory")
+
 // Globals ---------------------------------------------------------------------
 
 namespace BPrivate {
@@ -47,31 +50,63 @@ BTokenSpace gDefaultTokens;
 
 //------------------------------------------------------------------------------
 BTokenSpace::BTokenSpace()
+	:	fSlabCount(0),
+		fFirstFree(B_NULL_TOKEN),
+		fTokenCount(0)
 {
+	memset((void*)fSlabs, 0, sizeof(fSlabs));
 }
 //------------------------------------------------------------------------------
 BTokenSpace::~BTokenSpace()
 {
+	for (int32 i = 0; i < fSlabCount; ++i)
+	{
+		delete[] fSlabs[i];
+	}
 }
 //------------------------------------------------------------------------------
 int32 BTokenSpace::NewToken(int16 type, void* object,
 							new_token_callback callback)
 {
 	BAutolock Lock(fLocker);
-	TTokenInfo ti = { type, object };
-	int32 token;
-	if (fTokenBin.empty())
+	TTokenInfo* slot;
+	int32 index;
+	if (fFirstFree == B_NULL_TOKEN)
 	{
-		token = fTokenCount;
+		index = fTokenCount;
+		if (index > kIndexMask)
+		{
+			return B_NULL_TOKEN;
+		}
+
+		if ((index >> kSlabBits) == fSlabCount)
+		{
+			TTokenInfo* slab = new TTokenInfo[kSlabSize];
+			for (int32 i = 0; i < kSlabSize; ++i)
+			{
+				slab[i].token = B_NULL_TOKEN;
+				slab[i].generation = 0;
+			}
+			fSlabs[fSlabCount] = slab;
+			++fSlabCount;
+		}
+
 		++fTokenCount;
+		slot = _Slot(index);
 	}
 	else
 	{
-		token = fTokenBin.top();
-		fTokenBin.pop();
+		index = fFirstFree;
+		slot = _Slot(index);
+		fFirstFree = slot->nextFree;
+		slot->generation = (slot->generation + 1) & kGenerationMask;
 	}
 
-	fTokenMap[token] = ti;
+	int32 token = (slot->generation << kIndexBits) | index;
+	slot->type = type;
+	slot->object = object;
+	token_barrier();
+	slot->token = token;
 
 	if (callback)
 	{
@@ -84,57 +119,87 @@ int32 BTokenSpace::NewToken(int16 type, void* object,
 bool BTokenSpace::RemoveToken(int32 token, remove_token_callback callback)
 {
 	BAutolock Lock(fLocker);
-	TTokenMap::iterator iter = fTokenMap.find(token);
-	if (iter == fTokenMap.end())
+	TTokenInfo* slot = token < 0 ? NULL : _Slot(token & kIndexMask);
+	if (!slot || slot->token != token)
 	{
 		return false;
 	}
 
+	slot->token = B_NULL_TOKEN;
+	token_barrier();
+
 	if (callback)
 	{
-		callback(iter->second.type, iter->second.object);
+		callback(slot->type, slot->object);
 	}
 
-	fTokenMap.erase(iter);
-	fTokenBin.push(token);
+	slot->object = NULL;
+	slot->nextFree = fFirstFree;
+	fFirstFree = token & kIndexMask;
 
 	return true;
 }
 //------------------------------------------------------------------------------
 bool BTokenSpace::CheckToken(int32 token, int16 type) const
 {
-	BAutolock Locker(const_cast<BLocker&>(fLocker));
-	TTokenMap::const_iterator iter = fTokenMap.find(token);
-	if (iter != fTokenMap.end() && iter->second.type == type)
-	{
-		return true;
-	}
-
-	return false;
+	int16 tokenType;
+	void* object;
+	return _Lookup(token, &tokenType, &object) && tokenType == type;
 }
 //------------------------------------------------------------------------------
 status_t BTokenSpace::GetToken(int32 token, int16 type, void** object,
 							   get_token_callback callback) const
 {
-	BAutolock Locker(const_cast<BLocker&>(fLocker));
-	TTokenMap::const_iterator iter = fTokenMap.find(token);
-	if (iter == fTokenMap.end())
+	int16 tokenType;
+	if (!_Lookup(token, &tokenType, object))
 	{
 		*object = NULL;
 		return B_ERROR;
 	}
 
-	if (callback && !callback(iter->second.type, iter->second.object))
+	if (callback && !callback(tokenType, *object))
 	{
 		*object = NULL;
 		return B_ERROR;
 	}
 
-	*object = iter->second.object;
-
 	return B_OK;
 }
 //------------------------------------------------------------------------------
+BTokenSpace::TTokenInfo* BTokenSpace::_Slot(int32 index) const
+{
+	TTokenInfo* slab = fSlabs[index >> kSlabBits];
+	if (!slab)
+	{
+		return NULL;
+	}
+
+	return &slab[index & (kSlabSize - 1)];
+}
+//------------------------------------------------------------------------------
+bool BTokenSpace::_Lookup(int32 token, int16* type, void** object) const
+{
+	// Lock-free: read the slot between two looks at its stamp.  If the token
+	// was removed (or the slot reused) in between, the stamps won't match.
+	if (token < 0)
+	{
+		return false;
+	}
+
+	const TTokenInfo* slot = _Slot(token & kIndexMask);
+	if (!slot || slot->token != token)
+	{
+		return false;
+	}
+
+	token_barrier();
+	*type = slot->type;
+	*object = slot->object;
+	token_barrier();
+
+	return slot->token == token;
+}
+//------------------------------------------------------------------------------
 
 }	// namespace BPrivate
 
@@ -27,9 +27,16 @@
 #include <stdio.h>
 #include <Font.h>
 #include <PortLink.h>
+#include <AppServerLink.h>
+#include <FontMetrics.h>
+#include <ServerProtocol.h>
+#include <moreUTF8.h>
 
+#include <math.h>
 #include <string.h>
 
+using BPrivate::BAppServerLink;
+
 
 //----------------------------------------------------------------------------------------
 //		Globals
@@ -44,6 +51,280 @@ const BFont *be_plain_font=&be_plain_bfont;
 const BFont *be_bold_font=&be_bold_bfont;
 const BFont *be_fixed_font=&be_fixed_bfont;
 
+// The app_server's font list and metrics, mapped read-only
+static const font_metrics_area *sMetricsArea=NULL;
+static bool sMetricsAreaTried=false;
+
+// Fonts the server had no table for, so that they are only asked for again
+// once it publishes a new font list.  An entry holds the font's ID and size
+// in one word, so another thread never sees half of one.
+#define METRICS_MISSES		16
+static vint64 sMetricsMisses[METRICS_MISSES];
+static vint32 sMetricsMissIndex=0;
+static int32 sMetricsMissGeneration=0;
+
+// Keeps the compiler from moving reads of the font list across the reads of
+// its generation; the hardware already keeps loads in program order on x86.
+#define metrics_barrier()	__asm__ __volatile__("" : : : "memory")
+
+
+//----------------------------------------------------------------------------------------
+//		Font metrics
+//----------------------------------------------------------------------------------------
+
+/*!
+	\brief Maps the area in which the app_server publishes font metrics
+	\return The area, or NULL if there is no app_server to publish it
+*/
+static const font_metrics_area *metrics_area(void)
+{
+	if(!sMetricsAreaTried)
+	{
+		sMetricsAreaTried=true;
+
+		font_metrics_area *address;
+		area_id source=find_area(FONT_METRICS_AREA_NAME);
+		if(source>=0 && clone_area("font metrics",(void**)&address,B_ANY_ADDRESS,
+			B_READ_AREA,source)>=0 && address->magic==FONT_METRICS_MAGIC)
+		{
+			sMetricsArea=address;
+		}
+	}
+	return sMetricsArea;
+}
+
+/*!
+	\brief Tells whether the server already had no table for a font
+	\param area The metrics area
+	\param miss The font's ID and size, as add_metrics_miss() takes them
+*/
+static bool is_metrics_miss(const font_metrics_area *area, int64 miss)
+{
+	// A new font list may have the font
+	int32 generation=area->generation;
+	if(generation!=sMetricsMissGeneration)
+	{
+		for(int32 i=0; i<METRICS_MISSES; i++)
+			sMetricsMisses[i]=0;
+		sMetricsMissGeneration=generation;
+		return false;
+	}
+
+	for(int32 i=0; i<METRICS_MISSES; i++)
+	{
+		if(sMetricsMisses[i]==miss)
+			return true;
+	}
+	return false;
+}
+
+//! Remembers that the server has no table for a font, in place of the oldest miss
+static void add_metrics_miss(int64 miss)
+{
+	sMetricsMisses[atomic_add(&sMetricsMissIndex,1) & (METRICS_MISSES-1)]=miss;
+}
+
+/*!
+	\brief Finds the metrics table for a font
+	\param font The font to measure
+	\param scale Receives the factor to multiply the table's values with
+	\return The table, or NULL if there are no metrics for the font
+
+	Tables are only asked from the server the first time a font is used in any
+	application; after that they are found in the area. If the area is full,
+	another size of the same style is scaled. A font the server has no table
+	for isn't asked for again until the font list changes.
+*/
+static const font_metrics_table *find_metrics(const BFont *font, float *scale)
+{
+	const font_metrics_area *area=metrics_area();
+	uint32 id=font->FamilyAndStyle();
+	uint16 familyID=id >> 16, styleID=id & 0xFFFF;
+	if(!area || familyID==0)
+		return NULL;
+
+	// The server draws at whole sizes
+	float size=floorf(font->Size());
+	const font_metrics_table *table=NULL;
+	const font_metrics_table *closest=NULL;
+
+	int32 count=area->table_count;
+	for(int32 i=0; i<count; i++)
+	{
+		const font_metrics_table *candidate=&area->tables[i];
+		if(candidate->family_id!=familyID || candidate->style_id!=styleID)
+			continue;
+		if(candidate->size==size)
+		{
+			table=candidate;
+			break;
+		}
+		closest=candidate;
+	}
+
+	int64 miss=((int64)id << 32) | (uint32)size;
+	if(!table && count<FONT_METRICS_MAX_TABLES && !is_metrics_miss(area,miss))
+	{
+		// Attach Data:
+		// 1) uint16 family ID
+		// 2) uint16 style ID
+		// 3) float size
+		
+		// Reply Code: SERVER_TRUE
+		// Reply Data:
+		//	1) int32 index of the font's table in the metrics area
+		BAppServerLink link;
+		link.StartMessage(AS_GET_FONT_METRICS);
+		link.Attach<uint16>(familyID);
+		link.Attach<uint16>(styleID);
+		link.Attach<float>(font->Size());
+
+		int32 code=SERVER_FALSE;
+		int32 index;
+		if(link.FlushWithReply(&code)==B_OK && code==SERVER_TRUE
+			&& link.Read<int32>(&index)==B_OK
+			&& index>=0 && index<FONT_METRICS_MAX_TABLES)
+		{
+			table=&area->tables[index];
+		}
+		else
+			add_metrics_miss(miss);
+	}
+
+	if(!table)
+		table=closest;
+	if(table)
+		*scale=table->size>0 ? size/table->size : 0;
+	return table;
+}
+
+/*!
+	\brief Measures one UTF-8 character the way the server draws it
+	\param table The font's metrics table
+	\param string The character
+	\param bytes Receives the number of bytes in the character
+	\param bounds If not NULL, receives the character's bounding box
+	\return The character's escapement in pixels at the table's size
+
+	The server draws each byte with its own glyph, so that is what is measured.
+*/
+static float char_metrics(const font_metrics_table *table, const char *string,
+	int32 *bytes, BRect *bounds)
+{
+	int32 length=UTF8NextCharLen(string);
+	float advance=0;
+	for(int32 i=0; i<length; i++)
+	{
+		const font_metrics_glyph *glyph=&table->glyphs[(uint8)string[i]];
+		if(bounds)
+		{
+			BRect rect(advance+glyph->left,glyph->top,advance+glyph->right,glyph->bottom);
+			if(i==0)
+				*bounds=rect;
+			else
+				*bounds=*bounds | rect;
+		}
+		advance+=glyph->advance;
+	}
+	*bytes=length;
+	return advance;
+}
+
+/*!
+	\brief Looks up the kerning between two characters
+	\return The amount in pixels at the table's size to move the second character by
+*/
+static float kerning(const font_metrics_area *area, const font_metrics_table *table,
+	uint8 left, uint8 right)
+{
+	const font_metrics_kerning *pairs=&area->kerning[table->kerning_first];
+	uint32 key=(left << 8) | right;
+	int32 low=0, high=table->kerning_count-1;
+	while(low<=high)
+	{
+		int32 middle=(low+high)/2;
+		uint32 pair=(pairs[middle].left << 8) | pairs[middle].right;
+		if(pair==key)
+			return pairs[middle].amount;
+		if(pair<key)
+			low=middle+1;
+		else
+			high=middle-1;
+	}
+	return 0;
+}
+
+/*!
+	\brief Measures a string the way the server draws it
+	\param table The font's metrics table
+	\param string The string. It ends at a NUL even if length is longer.
+	\param length Number of bytes in the string
+	\param kern Whether to kern the characters, as for B_STRING_SPACING
+	\param bounds If not NULL, receives the bounding box of the string
+	\return The string's width in pixels at the table's size
+*/
+static float string_metrics(const font_metrics_table *table, const char *string,
+	int32 length, bool kern, BRect *bounds)
+{
+	float width=0;
+	uint8 previous=0;
+	bool first=true;
+	for(int32 i=0; i<length && string[i]; i++)
+	{
+		uint8 c=(uint8)string[i];
+		if(kern && previous)
+			width+=kerning(sMetricsArea,table,previous,c);
+		previous=c;
+
+		const font_metrics_glyph *glyph=&table->glyphs[c];
+		if(bounds)
+		{
+			BRect rect(width+glyph->left,glyph->top,width+glyph->right,glyph->bottom);
+			*bounds=first ? rect : (*bounds | rect);
+			first=false;
+		}
+		width+=glyph->advance;
+	}
+	if(bounds && first)
+		*bounds=BRect(0,0,-1,-1);
+	return width;
+}
+
+
+/*!
+	\brief Private function which sets the global fonts to the server's system fonts
+	
+	The server publishes them with the font list. Without a server, they keep
+	the defaults BFont was constructed with.
+*/
+extern "C" void _init_global_fonts()
+{
+	const font_metrics_area *area=metrics_area();
+	if(!area)
+		return;
+
+	font_metrics_system_font entries[3];
+	int32 generation;
+	do
+	{
+		generation=area->generation;
+		metrics_barrier();
+		const font_metrics_style_list *list=&area->lists[generation & 1];
+		entries[0]=list->plain;
+		entries[1]=list->bold;
+		entries[2]=list->fixed;
+		metrics_barrier();
+	} while(area->generation!=generation);
+
+	BFont *fonts[3]={ &be_plain_bfont, &be_bold_bfont, &be_fixed_bfont };
+	for(int32 i=0; i<3; i++)
+	{
+		if(entries[i].family_id==0)
+			continue;
+		fonts[i]->SetFamilyAndStyle((entries[i].family_id << 16) | entries[i].style_id);
+		fonts[i]->SetSize(entries[i].size);
+	}
+}
 
 /*!
 	\brief Private function used by Be. Exists only for compatibility. Does nothing.
@@ -227,11 +508,46 @@ status_t BFont::SetFamilyAndStyle(const font_family family, const font_style sty
 {
 	// R5 version always returns B_OK. That's a problem...
 	
-	// TODO: implement
+	// The server publishes its font list with the metrics, so there is no need
+	// to ask it. A NULL family keeps the current one; a NULL style picks the
+	// family's first.
+	const font_metrics_area *area=metrics_area();
+	if(!area)
+		return B_ERROR;
+
+	font_metrics_style found;
+	memset(&found,0,sizeof(found));
+	bool isFound;
+	int32 generation;
+	do
+	{
+		generation=area->generation;
+		metrics_barrier();
+		const font_metrics_style_list *list=&area->lists[generation & 1];
+		isFound=false;
+		for(int32 i=0; i<list->style_count && i<FONT_METRICS_MAX_STYLES; i++)
+		{
+			const font_metrics_style *entry=&list->styles[i];
+			if(family ? strncmp(entry->family,family,sizeof(font_family))!=0
+				: entry->family_id!=fFamilyID)
+				continue;
+			if(style && strncmp(entry->style,style,sizeof(font_style))!=0)
+				continue;
+
+			found=*entry;
+			isFound=true;
+			break;
+		}
+		metrics_barrier();
+	} while(area->generation!=generation);
+
+	if(!isFound)
+		return B_ERROR;
 
-	// Query server for the appropriate family and style IDs and then return the
-	// appropriate value
-	return B_ERROR;
+	fFamilyID=found.family_id;
+	fStyleID=found.style_id;
+	fFace=found.face;
+	return B_OK;
 }
 
 /*!
@@ -305,16 +621,47 @@ void BFont::SetFlags(uint32 flags)
 
 void BFont::GetFamilyAndStyle(font_family *family, font_style *style) const
 {
-	// TODO: implement
-
-	// Query server for the names of this stuff given the family and style IDs kept internally
+	const font_metrics_area *area=metrics_area();
+	if(!area)
+		return;
+
+	font_metrics_style found;
+	memset(&found,0,sizeof(found));
+	bool isFound;
+	int32 generation;
+	do
+	{
+		generation=area->generation;
+		metrics_barrier();
+		const font_metrics_style_list *list=&area->lists[generation & 1];
+		isFound=false;
+		for(int32 i=0; i<list->style_count && i<FONT_METRICS_MAX_STYLES; i++)
+		{
+			const font_metrics_style *entry=&list->styles[i];
+			if(entry->family_id!=fFamilyID || entry->style_id!=fStyleID)
+				continue;
+
+			found=*entry;
+			isFound=true;
+			break;
+		}
+		metrics_barrier();
+	} while(area->generation!=generation);
+
+	if(!isFound)
+		return;
+
+	if(family)
+		strcpy(*family,found.family);
+	if(style)
+		strcpy(*style,found.style);
 }
 
 uint32 BFont::FamilyAndStyle(void) const
 {
 	uint32 token;
 	token=(fFamilyID << 16) | fStyleID;
-	return 0L;
+	return token;
 }
 
 float BFont::Size(void) const
@@ -425,25 +772,43 @@ void BFont::GetTruncatedStrings(const char *stringArray[], int32 numStrings,
 
 float BFont::StringWidth(const char *string) const
 {
-	// TODO: implement
-
- 	// an estimate
- 	return (fHeight.ascent - fHeight.descent) * strlen(string);
+	if(!string)
+		return 0;
+	return StringWidth(string, strlen(string));
 }
 
 
 float BFont::StringWidth(const char *string, int32 length) const
 {
-	// TODO: implement
+	if(!string)
+		return 0;
 
- 	// an estimate
- 	return (fHeight.ascent - fHeight.descent) * length;
+	float scale;
+	const font_metrics_table *table=find_metrics(this,&scale);
+	if(!table)
+	{
+	 	// an estimate
+	 	return (fHeight.ascent - fHeight.descent) * length;
+	}
+	return string_metrics(table,string,length,fSpacing==B_STRING_SPACING,NULL) * scale;
 }
 
 void BFont::GetStringWidths(const char *stringArray[], const int32 lengthArray[], 
 		int32 numStrings, float widthArray[]) const
 {
-	// TODO: implement
+	if(!stringArray || !lengthArray || !widthArray)
+		return;
+
+	float scale;
+	const font_metrics_table *table=find_metrics(this,&scale);
+	for(int32 i=0; i<numStrings; i++)
+	{
+		if(!table)
+			widthArray[i]=(fHeight.ascent - fHeight.descent) * lengthArray[i];
+		else
+			widthArray[i]=string_metrics(table,stringArray[i],lengthArray[i],
+				fSpacing==B_STRING_SPACING,NULL) * scale;
+	}
 }
 
 
@@ -458,11 +823,6 @@ int BFont::GetStringLength( const char* pzString, int nLength, float vWidth, boo
 	const char*        apzStrPtr[] = { pzString };
 	int                nMaxLength;
 
-	if ((float)nLength <= (vWidth / 9.0f))
-		return nLength;
-	else
-		return (vWidth / 9.0f);
-
 	GetStringLengths( apzStrPtr, &nLength, 1, vWidth, &nMaxLength, bIncludeLast );
 	return( nMaxLength );
 }
@@ -471,60 +831,245 @@ int BFont::GetStringLength( const char* pzString, int nLength, float vWidth, boo
 void BFont::GetStringLengths( const char** apzStringArray, const int* anLengthArray,
                                int nStringCount, float vWidth, int* anMaxLengthArray, bool bIncludeLast ) const
 {
+	float scale;
+	const font_metrics_table *table=find_metrics(this,&scale);
+
+	for(int i=0; i<nStringCount; i++)
+	{
+		// Count the bytes of the characters which fit. If asked to, the one
+		// which only fits in part is counted too.
+		const char *string=apzStringArray[i];
+		int length=0;
+		float width=0;
+		while(length<anLengthArray[i] && string[length])
+		{
+			int32 bytes=UTF8NextCharLen(string+length);
+			float escapement=table ? char_metrics(table,string+length,&bytes,NULL) * scale
+				: (fHeight.ascent - fHeight.descent);
+			if(width+escapement>vWidth)
+			{
+				if(bIncludeLast)
+					length+=bytes;
+				break;
+			}
+			width+=escapement;
+			length+=bytes;
+		}
+		anMaxLengthArray[i]=min_c(length,anLengthArray[i]);
+	}
 }
 
 void BFont::GetEscapements(const char charArray[], int32 numChars, float escapementArray[]) const
 {
-	// TODO: implement
+	GetEscapements(charArray,numChars,NULL,escapementArray);
 }
 
 void BFont::GetEscapements(const char charArray[], int32 numChars, escapement_delta *delta, 
 		float escapementArray[]) const
 {
-	// TODO: implement
+	if(!charArray || !escapementArray)
+		return;
+
+	// Escapements are fractions of the font size, the delta is in pixels
+	float scale;
+	const font_metrics_table *table=find_metrics(this,&scale);
+	const char *string=charArray;
+	for(int32 i=0; i<numChars; i++)
+	{
+		int32 bytes=1;
+		float escapement=(fHeight.ascent - fHeight.descent);
+		if(table)
+			escapement=char_metrics(table,string,&bytes,NULL) * scale;
+		else if(*string)
+			bytes=UTF8NextCharLen(string);
+		if(delta)
+			escapement+=((uint8)*string<=0x20) ? delta->space : delta->nonspace;
+
+		escapementArray[i]=fSize>0 ? escapement/fSize : 0;
+		string+=bytes;
+	}
 }
 
 void BFont::GetEscapements(const char charArray[], int32 numChars, escapement_delta *delta, 
 		BPoint escapementArray[]) const
 {
-	// TODO: implement
+	GetEscapements(charArray,numChars,delta,escapementArray,NULL);
 }
 
 void BFont::GetEscapements(const char charArray[], int32 numChars, escapement_delta *delta, 
 		BPoint escapementArray[], BPoint offsetArray[]) const
 {
-	// TODO: implement
+	if(!charArray || !escapementArray || numChars<1)
+		return;
+
+	float *escapements=new float[numChars];
+	GetEscapements(charArray,numChars,delta,escapements);
+
+	// Rotated text advances along the rotated baseline. No glyph is offset
+	// from where its escapement puts it.
+	float angle=fRotation*M_PI/180.0;
+	for(int32 i=0; i<numChars; i++)
+	{
+		escapementArray[i].Set(escapements[i]*cos(angle),-escapements[i]*sin(angle));
+		if(offsetArray)
+			offsetArray[i].Set(0,0);
+	}
+	delete[] escapements;
 }
 
 void BFont::GetEdges(const char charArray[], int32 numBytes, edge_info edgeArray[]) const
 {
-	// TODO: implement
+	if(!charArray || !edgeArray)
+		return;
+
+	// numBytes is really the number of characters, as in R5
+	float scale;
+	const font_metrics_table *table=find_metrics(this,&scale);
+	const char *string=charArray;
+	for(int32 i=0; i<numBytes; i++)
+	{
+		if(!table || fSize<=0 || !*string)
+		{
+			edgeArray[i].left=0;
+			edgeArray[i].right=0;
+			if(*string)
+				string+=UTF8NextCharLen(string);
+			continue;
+		}
+
+		int32 bytes;
+		BRect bounds;
+		float advance=char_metrics(table,string,&bytes,&bounds);
+		edgeArray[i].left=bounds.left * scale / fSize;
+		edgeArray[i].right=(bounds.right - advance) * scale / fSize;
+		string+=bytes;
+	}
 }
 
 void BFont::GetHeight(font_height *height) const
 {
 	if(height)
 	{
-		*height=fHeight;
+		float scale;
+		const font_metrics_table *table=find_metrics(this,&scale);
+		if(!table)
+		{
+			*height=fHeight;
+			return;
+		}
+		height->ascent=table->height.ascent * scale;
+		height->descent=table->height.descent * scale;
+		height->leading=table->height.leading * scale;
 	}
 }
 
 void BFont::GetBoundingBoxesAsGlyphs(const char charArray[], int32 numChars, font_metric_mode mode,
 		BRect boundingBoxArray[]) const
 {
-	// TODO: implement
+	if(!charArray || !boundingBoxArray)
+		return;
+
+	// The metrics are those of the screen, whatever the mode
+	float scale;
+	const font_metrics_table *table=find_metrics(this,&scale);
+	const char *string=charArray;
+	for(int32 i=0; i<numChars; i++)
+	{
+		if(!table || !*string)
+		{
+			boundingBoxArray[i].Set(0,0,-1,-1);
+			if(*string)
+				string+=UTF8NextCharLen(string);
+			continue;
+		}
+
+		int32 bytes;
+		BRect bounds;
+		char_metrics(table,string,&bytes,&bounds);
+		boundingBoxArray[i].Set(bounds.left*scale,bounds.top*scale,
+			bounds.right*scale,bounds.bottom*scale);
+		string+=bytes;
+	}
 }
 
 void BFont::GetBoundingBoxesAsString(const char charArray[], int32 numChars, font_metric_mode mode,
 		escapement_delta *delta, BRect boundingBoxArray[]) const
 {
-	// TODO: implement
+	if(!charArray || !boundingBoxArray)
+		return;
+
+	// Like GetBoundingBoxesAsGlyphs(), but each glyph is placed where the
+	// string puts it
+	float scale;
+	const font_metrics_table *table=find_metrics(this,&scale);
+	const char *string=charArray;
+	uint8 previous=0;
+	float pen=0;
+	for(int32 i=0; i<numChars; i++)
+	{
+		if(!table || !*string)
+		{
+			boundingBoxArray[i].Set(0,0,-1,-1);
+			if(*string)
+				string+=UTF8NextCharLen(string);
+			continue;
+		}
+
+		if(fSpacing==B_STRING_SPACING && previous)
+			pen+=kerning(sMetricsArea,table,previous,(uint8)*string) * scale;
+
+		int32 bytes;
+		BRect bounds;
+		float advance=char_metrics(table,string,&bytes,&bounds) * scale;
+		boundingBoxArray[i].Set(pen+bounds.left*scale,bounds.top*scale,
+			pen+bounds.right*scale,bounds.bottom*scale);
+
+		pen+=advance;
+		if(delta)
+			pen+=((uint8)*string<=0x20) ? delta->space : delta->nonspace;
+		previous=(uint8)string[bytes-1];
+		string+=bytes;
+	}
 }
 
 void BFont::GetBoundingBoxesForStrings(const char *stringArray[], int32 numStrings,
 		font_metric_mode mode, escapement_delta deltas[], BRect boundingBoxArray[]) const
 {
-	// TODO: implement
+	if(!stringArray || !boundingBoxArray)
+		return;
+
+	float scale;
+	const font_metrics_table *table=find_metrics(this,&scale);
+	for(int32 i=0; i<numStrings; i++)
+	{
+		BRect bounds(0,0,-1,-1);
+		if(table && stringArray[i])
+		{
+			if(deltas)
+			{
+				// The deltas move each glyph, so the string is measured glyph by glyph
+				int32 count=0;
+				for(const char *c=stringArray[i]; *c; c+=UTF8NextCharLen(c))
+					count++;
+				BRect *boxes=new BRect[count];
+				GetBoundingBoxesAsString(stringArray[i],count,mode,&deltas[i],boxes);
+				for(int32 j=0; j<count; j++)
+				{
+					if(boxes[j].IsValid())
+						bounds=bounds.IsValid() ? (bounds | boxes[j]) : boxes[j];
+				}
+				delete[] boxes;
+			}
+			else
+			{
+				string_metrics(table,stringArray[i],strlen(stringArray[i]),
+					fSpacing==B_STRING_SPACING,&bounds);
+				bounds.Set(bounds.left*scale,bounds.top*scale,
+					bounds.right*scale,bounds.bottom*scale);
+			}
+		}
+		boundingBoxArray[i]=bounds;
+	}
 }
 
 void BFont::GetGlyphShapes(const char charArray[], int32 numChars, BShape *glyphShapeArray[]) const
@@ -534,7 +1079,31 @@ void BFont::GetGlyphShapes(const char charArray[], int32 numChars, BShape *glyph
    
 void BFont::GetHasGlyphs(const char charArray[], int32 numChars, bool hasArray[]) const
 {
-	// TODO: implement
+	if(!charArray || !hasArray)
+		return;
+
+	float scale;
+	const font_metrics_table *table=find_metrics(this,&scale);
+	const char *string=charArray;
+	for(int32 i=0; i<numChars; i++)
+	{
+		if(!*string)
+		{
+			hasArray[i]=false;
+			continue;
+		}
+
+		// A character is only drawn right if every one of its bytes is
+		int32 bytes=UTF8NextCharLen(string);
+		hasArray[i]=(table!=NULL);
+		for(int32 j=0; j<bytes && table; j++)
+		{
+			uint8 c=(uint8)string[j];
+			if(!(table->has_glyph[c/8] & (1 << (c%8))))
+				hasArray[i]=false;
+		}
+		string+=bytes;
+	}
 }
 
 BFont &BFont::operator=(const BFont &font)
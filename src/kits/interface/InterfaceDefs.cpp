@@ -602,6 +602,8 @@ _init_interface_kit_()
 	BTextView::sWidthAtom = 0;
 	BTextView::sWidths = new _BWidthBuffer_;
 		
+	_init_global_fonts();
+
 	status_t result = get_menu_info(&BMenu::sMenuInfo);
 	if (result != B_OK)  
 		return result;
@@ -621,14 +623,6 @@ _fini_interface_kit_()
 }
 
 
-extern "C" void
-_init_global_fonts()
-{
-	// This function will initialize the client-side font list
-	// TODO: Implement
-}
-
-
 /*!
 	\brief private function used by Tracker to set window decor
 	\param theme The theme to choose
@@ -44,7 +44,8 @@
 static const int32 kMaxPoints = 1024;
 static const int32 kMaxVerticalExtent = 0x10000000;
 static const int32 kMaxPositive = 0x7ffffffd;
-static const int32 kMaxNegative = 0x80000003;
+// written as a negative number: int32 may be wider than 32 bits
+static const int32 kMaxNegative = -0x7ffffffd;
 
 
 #define TRACE_REGION 0
@@ -92,8 +93,8 @@ BRegion::Support::ClearRegion(BRegion *region)
 	region->count = 0;
 	region->bound.left = 0xfffffff;
 	region->bound.top = 0xfffffff;
-	region->bound.right = 0xf0000001;
-	region->bound.bottom = 0xf0000001;
+	region->bound.right = -0xfffffff;
+	region->bound.bottom = -0xfffffff;
 }
 
 
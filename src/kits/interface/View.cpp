@@ -1661,7 +1661,9 @@ void BView::MovePenTo(BPoint pt)
 
 void BView::MovePenTo(float x, float y)
 {
-	if (x  == fState->penPosition.x && y == fState->penPosition.y)
+	// the cached location is stale once the server moved the pen
+	if (x  == fState->penPosition.x && y == fState->penPosition.y
+		&& !(fState->flags & B_VIEW_PEN_LOC_BIT))
 		return;
 		
 	if (owner)
@@ -1672,7 +1674,8 @@ void BView::MovePenTo(float x, float y)
 		owner->fLink->Attach<float>( x );
 		owner->fLink->Attach<float>( y );		
 		
-		fState->flags		|= B_VIEW_PEN_LOC_BIT;	
+		// we know where the pen is, PenLocation() needn't ask
+		fState->flags		&= ~B_VIEW_PEN_LOC_BIT;	
 	}
 	
 	fState->penPosition.x	= x;
@@ -2128,9 +2131,6 @@ void BView::ConstrainClippingRegion(BRegion* region)
 		for (int32 i = 0; i<noOfRects; i++)
 			owner->fLink->Attach<BRect>( region->RectAt(i) );
 		
-		// we flush here because app_server waits for all the rects
-		owner->fLink->Flush();
-
 		fState->flags			|= B_VIEW_CLIP_REGION_BIT;
 		fState->archivingFlags	|= B_VIEW_CLIP_REGION_BIT;
 	}
@@ -2551,6 +2551,7 @@ void BView::FillPolygon(const BPolygon* aPolygon,pattern p)
 		if(aPolygon->fCount * sizeof(BPoint) < MAX_ATTACHMENT_SIZE)
 		{
 			owner->fLink->StartMessage( AS_FILL_POLYGON );
+			owner->fLink->Attach<BRect>( aPolygon->Frame() );
 			owner->fLink->Attach<int32>( aPolygon->fCount );
 			owner->fLink->Attach(aPolygon->fPts,aPolygon->fCount * sizeof(BPoint) );
 		}
@@ -2827,8 +2828,9 @@ void BView::StrokeLine(BPoint pt0, BPoint pt1, pattern p)
 		owner->fLink->Attach<BPoint>( pt0 );
 		owner->fLink->Attach<BPoint>( pt1 );
 		
-		// this modifies our pen location, so we invalidate the flag.
-		fState->flags		|= B_VIEW_PEN_LOC_BIT;			
+		// the server leaves the pen at the end of the line
+		fState->penPosition	= pt1;
+		fState->flags		&= ~B_VIEW_PEN_LOC_BIT;			
 	}
 }
 
@@ -3233,7 +3235,10 @@ void BView::Invalidate(BRect invalRect)
 
 		owner->fLink->StartMessage( AS_LAYER_INVAL_RECT );
 		owner->fLink->Attach<BRect>( invalRect );
-		owner->fLink->Flush();
+		
+		// the window's looper sends it once it is idle
+		if (find_thread(NULL) != owner->Thread())
+			owner->fLink->Flush();
 	}
 }
 
@@ -3256,7 +3261,8 @@ void BView::Invalidate(const BRegion* invalRegion)
 		for (int i=0; i<noOfRects; i++)
 			owner->fLink->Attach<BRect>( const_cast<BRegion*>(invalRegion)->RectAt(i) );
 		
-		owner->fLink->Flush();
+		if (find_thread(NULL) != owner->Thread())
+			owner->fLink->Flush();
 	}
 }
 
@@ -67,7 +67,15 @@
 #	define STRACE(x) ;
 #endif
 
+// Longest drawing waits in a window's link before it is sent: about a frame
+#define FLUSH_LATENCY			16000
+
+// Environment variable which makes windows print what they send per frame
+#define FLUSH_STATS_VARIABLE	"COSMOE_FLUSH_STATS"
+
 // Globals ---------------------------------------------------------------------
+static int gPrintFlushStats = -1;
+
 static property_info windowPropInfo[] =
 {
 	{ "Feel", { B_GET_PROPERTY, 0 },
@@ -2211,11 +2219,20 @@ void BWindow::InitData(	BRect frame, const char* title, window_look look,
  	fLink->Flush();
  
  	send_port = -1;
+ 	area_id ringArea = -1;
  	int32 rCode = SERVER_FALSE;
  	err = fLink->GetNextReply( &rCode );
  	if (err == B_OK && rCode == SERVER_TRUE)
+ 	{
  		fLink->Read<port_id>(&send_port);
+ 		fLink->Read<area_id>(&ringArea);
+ 	}
  	fLink->SetSendPort(send_port);
+ 	// drawing goes through the shared ring, the port only wakes the server up
+ 	fLink->SetSendRing(ringArea);
+ 	// and is only sent as the looper goes idle, an update ends or a call
+ 	// needs a reply, unless it waits longer than that
+ 	fLink->SetFlushLatency(FLUSH_LATENCY);
 	
  	STRACE(("Server says that our send port is %ld\n", send_port));
  	
@@ -2227,6 +2244,32 @@ void BWindow::InitData(	BRect frame, const char* title, window_look look,
 
 //------------------------------------------------------------------------------
 
+/*!
+	\brief Sends a window's pending messages at the end of a frame
+	\param link The window's link
+	\param title The window's title, for the statistics
+
+	With FLUSH_STATS_VARIABLE set, it prints how many messages went to the
+	server since the last frame and in how many writes.
+*/
+static void flush_frame(BPortLink *link, const char *title)
+{
+	link->Flush();
+
+	if (gPrintFlushStats < 0)
+		gPrintFlushStats = getenv(FLUSH_STATS_VARIABLE) ? 1 : 0;
+	if (!gPrintFlushStats)
+		return;
+
+	link_sender_stats stats;
+	link->GetStats(&stats);
+	if (stats.messages)
+		printf("BWindow '%s' frame: %ld messages, %ld bytes in %ld flushes\n",
+			title, stats.messages, stats.bytes, stats.flushes);
+}
+
+//------------------------------------------------------------------------------
+
 void BWindow::task_looper()
 {
 	STRACE(("info: BWindow::task_looper() started.\n"));
@@ -2325,8 +2368,14 @@ void BWindow::task_looper()
 						DispatchMessage(fLastMessage, handler);
 				}
 			}
-				// empty our message buffer
-			fLink->Flush();
+			// empty our message buffer once the queue is, so that all the
+			// drawing of a frame goes out together; while messages keep
+			// coming, flush only what has waited too long, so a steady
+			// stream of them doesn't hold back what is already buffered
+			if (!fLastMessage)
+				flush_frame(fLink, Title());
+			else
+				fLink->FlushIfLate();
 
 			Unlock();
 
@@ -3092,7 +3141,9 @@ void BWindow::DoUpdate(BView* aView, BRect& area)
 		}
 	}
 
-	fLink->Flush();
+	// children are drawn within their parent's update
+	if (aView == top_view)
+		fLink->Flush();
 }
 
 //------------------------------------------------------------------------------
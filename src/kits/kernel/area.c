@@ -51,10 +51,16 @@
 
 #define dprintf printf
 
-  // Area IDs
-#define AREA_ID_MAX  256
+  /* Area IDs. The table is shared by every team, and each window takes two
+     entries for its command ring and each large bitmap one for itself and
+     one for each team which maps it. */
+#define AREA_ID_MAX  4096
 #define AREA_ID_FREE 0xFFFFFFFF
 
+  /* Shared memory key of an area. Key 0 is IPC_PRIVATE, which would give
+     every shmget() of area 0 its own segment. */
+#define AREA_KEY(id) ((key_t)(id) + 1)
+
 
 area_info* g_pAreaMap = NULL;
 
@@ -106,12 +112,14 @@ area_id create_area(const char* name, void** start_addr, uint32 addr_spec, size_
 
 	if (g_pAreaMap == NULL)
 		init_area_map();
+	if (g_pAreaMap == NULL)
+		return B_NO_MEMORY;
 
 	for(n = 0; n < AREA_ID_MAX; n++)
 	{
 		if(g_pAreaMap[n].area == AREA_ID_FREE)
 		{
-			int iShmID = shmget(n, size, IPC_CREAT | 0700);
+			int iShmID = shmget(AREA_KEY(n), size, IPC_CREAT | 0700);
 			if(iShmID == -1)
 			{
 				printf("create_area(): shmget(%u,%u) failed (%s)\n", n, size, strerror(errno));
@@ -166,7 +174,7 @@ area_id clone_area(const char* name, void** dest_addr, uint32 addr_spec, uint32
 	{
 		if( g_pAreaMap[n].area == AREA_ID_FREE )
 		{
-			int iShmID = shmget( source, nSize, IPC_CREAT | 0700 );
+			int iShmID = shmget( AREA_KEY(source), nSize, IPC_CREAT | 0700 );
 			if( iShmID == -1 )
 			{
 				printf( "clone_area(): shmget(%u,%u) failed (%s)\n", n, nSize, strerror(errno) );
@@ -255,7 +263,14 @@ status_t delete_area( area_id hArea )
 	{
 		return B_ERROR;
 	}
-	/* FIXME: refcount the shmseg and shmdt() when zero */
+	/* The memory is given back once no team has it attached anymore: detach
+	   it here, and mark the segment for removal unless this is a clone. A
+	   clone's segment has the key of the area it was cloned from. */
+	if (g_pAreaMap[hArea].team == getpid())
+		shmdt(g_pAreaMap[hArea].address);
+	if (shmget(AREA_KEY(hArea), 0, 0700) == (int)g_pAreaMap[hArea].area)
+		shmctl(g_pAreaMap[hArea].area, IPC_RMID, NULL);
+
 	g_pAreaMap[hArea].area = AREA_ID_FREE;
 
 	return 0;
@@ -77,3 +77,27 @@ int32 atomic_and(vint32 *value, int32 andvalue)
 	return oldval;
 }
 
+
+
+int32 atomic_set(vint32 *value, int32 newvalue)
+{
+	register int32 oldval;
+
+	do {
+		oldval = *value;
+	} while (atomic_exchange(value, oldval, newvalue) != oldval);
+
+	return oldval;
+}
+
+
+int32 atomic_test_and_set(vint32 *value, int32 newvalue, int32 testagainst)
+{
+	return atomic_exchange(value, testagainst, newvalue);
+}
+
+
+int32 atomic_get(vint32 *value)
+{
+	return atomic_exchange(value, 0, 0);
+}
@@ -24,21 +24,203 @@
 //------------------------------------------------------------------------------
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #include <image.h>
+#include <OS.h>
 #include <dlfcn.h>
 
+/*
+ * load_image() starts the new team with posix_spawn(), which (unlike fork())
+ * never copies the parent's page tables.  BeOS hands back the team's main
+ * thread suspended, so the launcher can register it before it runs; we
+ * emulate that with a "launch gate": the child inherits one end of a
+ * socket pair whose descriptor is named in LAUNCH_GATE_VAR, and libcosmoe's
+ * initialization blocks on it until resume_thread() writes a byte (or the
+ * launcher goes away).  The exec and dynamic linking of the child overlap
+ * with the launcher's bookkeeping instead of following it.
+ */
+
+#define LAUNCH_GATE_VAR		"COSMOE_LAUNCH_GATE"
+#define MAX_LAUNCH_GATES	32
+
+extern char **environ;
+
+extern thread_id _register_team_thread_(team_id team, const char *name);
+extern void _unregister_team_thread_(thread_id thread);
+
+typedef struct {
+	thread_id	thread;
+	int			fd;
+} launch_gate;
+
+static launch_gate launch_gates[MAX_LAUNCH_GATES];
+static int launch_gate_count = 0;
+
+
+static status_t
+add_launch_gate(thread_id thread, int fd)
+{
+	if (launch_gate_count == MAX_LAUNCH_GATES)
+		return B_NO_MORE_THREADS;
+
+	launch_gates[launch_gate_count].thread = thread;
+	launch_gates[launch_gate_count].fd = fd;
+	launch_gate_count++;
+
+	return B_OK;
+}
+
+
+/* Opens (release == true) or discards the gate of a team loaded by this
+ * process.  Returns B_BAD_THREAD_ID if we didn't launch the thread. */
+status_t
+_close_launch_gate_(thread_id thread, bool release)
+{
+	int i;
+	for (i = 0; i < launch_gate_count; i++)
+	{
+		if (launch_gates[i].thread == thread)
+		{
+			int fd = launch_gates[i].fd;
+
+			launch_gates[i] = launch_gates[--launch_gate_count];
+
+			if (release)
+			{
+				/* the child may already be gone; that's no reason for SIGPIPE */
+				while (send(fd, "", 1, MSG_NOSIGNAL) < 0 && errno == EINTR)
+					;
+			}
+			close(fd);
+
+			return B_OK;
+		}
+	}
+
+	return B_BAD_THREAD_ID;
+}
+
+
+/* Called from libcosmoe's initialization in every Cosmoe application. */
+void
+_wait_for_launch_gate_(void)
+{
+	const char *gate = getenv(LAUNCH_GATE_VAR);
+	char c;
+	int fd;
+
+	if (gate == NULL)
+		return;
+
+	fd = atoi(gate);
+	unsetenv(LAUNCH_GATE_VAR);
+
+	while (read(fd, &c, 1) < 0 && errno == EINTR)
+		;
+	close(fd);
+}
+
 
 thread_id load_image(int32 argc, const char **argv, const char **envp)
 {
-	// FIXME: this should launch the app in parameter 1 of argv with the
-	// arguments in argv and the environment variables in envp.  It
-	// returns the launched application's main thread id.
-	// The current app does NOT die, as with a straight exec.
+	posix_spawnattr_t attr;
+	sigset_t defaults;
+	const char **args;
+	const char **env;
+	char gateVar[32];
+	int gate[2];
+	int envc = 0;
+	const char *name;
+	thread_id thread;
+	pid_t pid;
+	int err;
 
-	printf("load_image(): UNIMPLEMENTED\n");
+	if (argc < 1 || argv == NULL || argv[0] == NULL)
+		return B_BAD_VALUE;
 
-	return B_ERROR;
+	/* posix_spawn() only reports a failed exec once the child is gone, so
+	 * weed out the common failures up front */
+	if (strchr(argv[0], '/') != NULL && access(argv[0], X_OK) != 0)
+		return errno == ENOENT ? B_ENTRY_NOT_FOUND : B_NOT_AN_EXECUTABLE;
+
+	if (envp == NULL)
+		envp = (const char **)environ;
+	while (envp[envc] != NULL)
+		envc++;
+
+	args = (const char **)malloc((argc + 1) * sizeof(char *));
+	env = (const char **)malloc((envc + 2) * sizeof(char *));
+	if (args == NULL || env == NULL)
+	{
+		free(args);
+		free(env);
+		return B_NO_MEMORY;
+	}
+
+	memcpy(args, argv, argc * sizeof(char *));
+	args[argc] = NULL;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, gate) < 0)
+	{
+		free(args);
+		free(env);
+		return B_NO_MORE_FDS;
+	}
+	fcntl(gate[1], F_SETFD, FD_CLOEXEC);
+
+	sprintf(gateVar, LAUNCH_GATE_VAR "=%d", gate[0]);
+	memcpy(env, envp, envc * sizeof(char *));
+	env[envc] = gateVar;
+	env[envc + 1] = NULL;
+
+	/* loopers ignore SIGCHLD and SIGALRM; don't pass that on */
+	posix_spawnattr_init(&attr);
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGCHLD);
+	sigaddset(&defaults, SIGALRM);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+#ifdef POSIX_SPAWN_USEVFORK
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_USEVFORK);
+#else
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+#endif
+
+	err = posix_spawnp(&pid, argv[0], NULL, &attr, (char * const *)args,
+					   (char * const *)env);
+
+	posix_spawnattr_destroy(&attr);
+	close(gate[0]);
+	free(args);
+	free(env);
+
+	if (err != 0)
+	{
+		close(gate[1]);
+		return err == ENOENT ? B_ENTRY_NOT_FOUND : B_NOT_AN_EXECUTABLE;
+	}
+
+	name = strrchr(argv[0], '/');
+	name = name ? name + 1 : argv[0];
+
+	thread = _register_team_thread_(pid, name);
+	if (thread < 0 || add_launch_gate(thread, gate[1]) != B_OK)
+	{
+		kill(pid, SIGKILL);
+		close(gate[1]);
+		if (thread >= 0)
+			_unregister_team_thread_(thread);
+		return thread < 0 ? thread : B_NO_MORE_THREADS;
+	}
+
+	return thread;
 }
 
 
@@ -31,6 +31,7 @@
 #include <sys/uio.h>
 #include <sys/utsname.h>
 #include <errno.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <Debug.h>
@@ -184,6 +185,16 @@ set_timezone(char *timezone)
 bigtime_t
 system_time(void)
 {
+	/* sysinfo()'s uptime only counts whole seconds, which is useless for
+	 * timing anything; use the monotonic clock where we have it */
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+	{
+		return (bigtime_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+#endif
 #if defined(linux)
 	struct sysinfo sinfo;
 
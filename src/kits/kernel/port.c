@@ -46,6 +46,7 @@ struct port_entry {
 	port_id 	id;
 	team_id 	owner;
 	int32 		capacity;
+	int32		closed;		// no more writes, what is queued can be read
 	sem_id		lock;
 	char		name[B_OS_NAME_LENGTH];
 	sem_id		read_sem;
@@ -325,7 +326,6 @@ create_port(int32 queueLength, const char *name)
 	// find the first empty spot
 	for (i = 0; i < gMaxPorts; i++) {
 		if (sPorts[i].id == -1) {
-			key_t  port_shm_key;
 			const size_t size = sizeof(port_msg) * queueLength;
 			int    j;
 			void* msg_queue;
@@ -344,6 +344,7 @@ create_port(int32 queueLength, const char *name)
 
 			strncpy(sPorts[i].name, name, B_OS_NAME_LENGTH);
 			sPorts[i].capacity = queueLength;
+			sPorts[i].closed = 0;
 			sPorts[i].owner = owner;
 			sPorts[i].name[B_OS_NAME_LENGTH - 1] = '\0';
 
@@ -357,34 +358,21 @@ create_port(int32 queueLength, const char *name)
 			sPorts[i].head		= 0;
 			sPorts[i].tail		= 0;
 
-			/* grab a (hopefully) unique key for our port */
-			char path[B_PATH_NAME_LENGTH];
-			static int static_port_count = 0;
-			sprintf(path, "/proc/%d/exe", getpid());
-			port_shm_key = ftok(path, ++static_port_count);	/* HACK ALERT */
-
-			TRACE(("create_port: generated port queue key %d from %s + %d.\n", port_shm_key, path, static_port_count));
-			/* create and initialize a new semaphore table in shared memory */
-			sPorts[i].queue_shm = shmget(port_shm_key, size, IPC_CREAT | IPC_EXCL | 0700);
-			if (sPorts[i].queue_shm == -1 && errno == EEXIST)
-			{
-				/* TODO: this should be FATAL */
-				/* TODO: we don't know if it is large enough */
-				sPorts[i].queue_shm = shmget(port_shm_key, size, IPC_CREAT | 0700);
-				TRACE(("WARNING: Using pre-existing port queue.\n"));
-			}
+			/* Other teams find the queue through queue_shm, so it needs no
+			 * key.  Keys made from our executable collided with those of any
+			 * other team running the same one, and wrapped after 255 ports. */
+			sPorts[i].queue_shm = shmget(IPC_PRIVATE, size, IPC_CREAT | 0700);
 
 			if (sPorts[i].queue_shm < 0)
 			{
-				TRACE(("FATAL: Couldn't setup port queue with key %d: %s\n",
-						port_shm_key,
+				TRACE(("FATAL: Couldn't setup port queue: %s\n",
 						strerror(errno)));
 				returnValue = B_NO_MEMORY;
 				sPorts[i].id = -1;
 				goto cleanup;
 			}
 
-			TRACE(("Port %d named %s is using shm key %x\n", i, name, port_shm_key));
+			TRACE(("Port %d named %s is using shm %d\n", i, name, sPorts[i].queue_shm));
 
 			/* point our local table at the master table */
 			msg_queue = shmat(sPorts[i].queue_shm, NULL, 0);
@@ -453,8 +441,9 @@ close_port(port_id id)
 		return B_BAD_PORT_ID;
 	}
 
-	// mark port to disable writing
-	sPorts[slot].capacity = 0;
+	// mark port to disable writing; the capacity is kept, since the
+	// messages still in the queue may be read
+	sPorts[slot].closed = 1;
 
 	RELEASE_PORT_LOCK(sPorts[slot]);
 
@@ -595,7 +584,7 @@ _get_port_info(port_id id, port_info *info, size_t size)
 
 	GRAB_PORT_LOCK(sPorts[slot]);
 
-	if (sPorts[slot].id != id || sPorts[slot].capacity == 0) {
+	if (sPorts[slot].id != id || sPorts[slot].closed) {
 		RELEASE_PORT_LOCK(sPorts[slot]);
 		TRACE(("get_port_info: invalid port_id %ld\n", id));
 		return B_BAD_PORT_ID;
@@ -635,7 +624,7 @@ _get_next_port_info(team_id team, int32 *_cookie, struct port_info *info, size_t
 
 	while (slot < gMaxPorts) {
 		GRAB_PORT_LOCK(sPorts[slot]);
-		if (sPorts[slot].id != -1 && sPorts[slot].capacity != 0 && sPorts[slot].owner == team) {
+		if (sPorts[slot].id != -1 && !sPorts[slot].closed && sPorts[slot].owner == team) {
 			// found one!
 			fill_port_info(&sPorts[slot], info, size);
 
@@ -881,6 +870,7 @@ read_port_etc(port_id id, int32 *_msgCode, void *msgBuffer, size_t bufferSize,
 			memcpy(msgBuffer, msg->buffer_chain, size);
 	}
 	put_port_msg(msg);
+	shmdt(msg_queue);
 
 	// make one spot in queue available again for write
 	release_sem(cachedSem);
@@ -932,7 +922,7 @@ write_port_etc(port_id id, int32 msgCode, const void *msgBuffer,
 		return B_BAD_PORT_ID;
 	}
 
-	if (sPorts[slot].capacity == 0) {
+	if (sPorts[slot].closed) {
 		RELEASE_PORT_LOCK(sPorts[slot]);
 		TRACE(("write_port_etc: port %ld closed\n", id));
 		return B_BAD_PORT_ID;
@@ -248,7 +248,7 @@ status_t acquire_sem_etc(sem_id id,
 	int member = id % SEMMSL;
 	struct sembuf sem_lock = {member, -count, 0};
 	struct timespec tmout;
-	int err;
+	status_t err;
 
 	TRACE(("acquire_sem_etc(%ld): enter\n", id));
 
@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/shm.h>
+#include <sys/wait.h>
 #include <errno.h>
 #include <pthread.h>
 #include <signal.h>
@@ -37,6 +38,9 @@
 
 #define FREE_SLOT 0xFFFFFFFF
 
+/* the main thread of a team started by load_image(), entered by the launcher */
+#define TEAM_THREAD(i) (thread_table[i].func == NULL && thread_table[i].pth == (pthread_t)-1)
+
 typedef void* (*pthread_entry) (void*);
 
 thread_info *thread_table = NULL;
@@ -45,6 +49,8 @@ static int thread_shm = -1;
 static void init_thread(void);
 static void teardown_threads(void);
 
+extern status_t _close_launch_gate_(thread_id thread, bool release);
+
 /* TODO: table access is not protected by a semaphore */
 
 static void
@@ -130,6 +136,104 @@ spawn_thread(thread_func func, const char *name, int32 priority, void *data)
 }
 
 
+/* Frees the slot of a team's main thread once the team is gone, reaping it
+ * if it is our child.  Unless block is true, returns false right away for a
+ * team that still runs. */
+static bool
+reap_team_thread(int i, status_t *_returnCode, bool block)
+{
+	pid_t team = (pid_t)thread_table[i].team;
+	status_t code = B_OK;
+	int status;
+	pid_t pid;
+
+	do
+		pid = waitpid(team, &status, block ? 0 : WNOHANG);
+	while (pid < 0 && errno == EINTR);
+
+	if (pid == 0)
+		return false;
+
+	if (pid > 0)
+		code = WIFEXITED(status) ? WEXITSTATUS(status) : B_INTERRUPTED;
+	else
+	{
+		/* somebody else's child, or one the system reaped because SIGCHLD
+		 * is ignored: all we can tell is whether it is still there */
+		while (kill(team, 0) == 0)
+		{
+			if (!block)
+				return false;
+			snooze(10000);
+		}
+	}
+
+	_close_launch_gate_(thread_table[i].thread, false);
+	thread_table[i].thread = FREE_SLOT;
+	thread_table[i].team = 0;
+
+	if (_returnCode)
+		*_returnCode = code;
+
+	return true;
+}
+
+
+/* Enters the main thread of another team, started by load_image(), into the
+ * thread table.  It stays B_THREAD_SUSPENDED until resume_thread(). */
+thread_id
+_register_team_thread_(team_id team, const char *name)
+{
+	init_thread();
+
+	int i;
+
+	/* free the slots of teams that exited without anyone waiting for them */
+	for (i = 0; i < MAX_THREADS; i++)
+	{
+		if (thread_table[i].thread != FREE_SLOT && TEAM_THREAD(i))
+			reap_team_thread(i, NULL, false);
+	}
+
+	for (i = 0; i < MAX_THREADS; i++)
+	{
+		if (thread_table[i].thread == FREE_SLOT)
+		{
+			thread_table[i].pth = -1;
+			thread_table[i].thread = i;
+			thread_table[i].team = team;
+			thread_table[i].priority = B_NORMAL_PRIORITY;
+			thread_table[i].state = B_THREAD_SUSPENDED;
+			strncpy(thread_table[i].name, name, B_OS_NAME_LENGTH);
+			thread_table[i].name[B_OS_NAME_LENGTH - 1] = '\0';
+			thread_table[i].func = NULL;
+			thread_table[i].data = NULL;
+			thread_table[i].code = 0;
+			thread_table[i].sender = 0;
+			thread_table[i].buffer = NULL;
+
+			return i;
+		}
+	}
+
+	return B_NO_MORE_THREADS;
+}
+
+
+void
+_unregister_team_thread_(thread_id thread)
+{
+	init_thread();
+
+	if (thread >= 0 && thread < MAX_THREADS
+		&& thread_table[thread].thread == thread)
+	{
+		thread_table[thread].thread = FREE_SLOT;
+		thread_table[thread].team = 0;
+	}
+}
+
+
 status_t
 kill_thread(thread_id thread)
 {
@@ -140,6 +244,31 @@ kill_thread(thread_id thread)
 	{
 		if (thread_table[i].thread == thread)
 		{
+			if (TEAM_THREAD(i))
+			{
+				/* killing a team's main thread kills the team */
+				pid_t team = (pid_t)thread_table[i].team;
+				int err = kill(team, SIGKILL);
+
+				if (err == 0)
+				{
+					while (waitpid(team, NULL, 0) < 0 && errno == EINTR)
+						;
+				}
+				if (err == 0 || errno == ESRCH)
+				{
+					_close_launch_gate_(thread, false);
+					thread_table[i].thread = FREE_SLOT;
+					thread_table[i].team = 0;
+				}
+
+				return err == 0 ? B_OK : B_BAD_THREAD_ID;
+			}
+
+			/* other teams' threads are out of our reach */
+			if (thread_table[i].team != getpid())
+				break;
+
 			if (pthread_kill(thread_table[i].pth, SIGKILL) == 0)
 			{
 				thread_table[i].thread = FREE_SLOT;
@@ -286,10 +415,11 @@ void teardown_threads()
 	int count = 0;
 	int i;
 	
-	/* Free thread table entries created by our process */
+	/* Free thread table entries created by our process.  The main thread's
+	 * entry, if we were load_image()d, is left for the launcher to reap. */
 	for (i = 0; i < MAX_THREADS; i++)
 	{
-		if (thread_table[i].team == getpid())
+		if (thread_table[i].team == getpid() && !TEAM_THREAD(i))
 		{
 			thread_table[i].thread = FREE_SLOT;
 			thread_table[i].team = 0;
@@ -437,6 +567,15 @@ wait_for_thread(thread_id id, status_t *_returnCode)
 	{
 		if (thread_table[i].thread == id)
 		{
+			if (TEAM_THREAD(i))
+			{
+				/* as on BeOS, waiting for a suspended thread starts it */
+				if (thread_table[i].state == B_THREAD_SUSPENDED)
+					resume_thread(id);
+				reap_team_thread(i, _returnCode, true);
+				return B_OK;
+			}
+
 			if (pthread_join(thread_table[i].pth, (void**)_returnCode) == 0)
 				return B_OK;
 			break;
@@ -496,7 +635,14 @@ resume_thread(thread_id id)
 				}
 
 				case B_THREAD_SUSPENDED:
-					pthread_kill(thread_table[i].pth, SIGCONT);
+					if (thread_table[i].team != getpid())
+					{
+						/* a team fresh from load_image() waits on its gate */
+						if (_close_launch_gate_(id, true) != B_OK)
+							kill((pid_t)thread_table[i].team, SIGCONT);
+					}
+					else
+						pthread_kill(thread_table[i].pth, SIGCONT);
 					thread_table[i].state = B_THREAD_RUNNING;
 					return B_OK;
 
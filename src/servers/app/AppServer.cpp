@@ -44,6 +44,7 @@
 #include <PortLink.h>
 #include <File.h>
 #include <Message.h>
+#include <Region.h>
 #include <RegistrarDefs.h>
 #include "AppServer.h"
 #include "ColorSet.h"
@@ -56,9 +57,15 @@
 #include "RGBColor.h"
 #include "BitmapManager.h"
 #include "CursorManager.h"
+#include "ServerProfiler.h"
 #include "Utils.h"
 #include "FontServer.h"
+#include "FontCache.h"
+#include "LayerData.h"
+#include "SessionPlayer.h"
+#include "headlessdriver.h"
 #include "Desktop.h"
+#include "DecoratorCache.h"
 
 //#define DEBUG_KEYHANDLING
 //#define DEBUG_SERVER
@@ -91,24 +98,12 @@ RGBColor workspace_default_color(51,102,160);
 ColorSet gui_colorset;
 
 /*!
-	\brief Constructor
+	\brief Creates the font server and the glyph cache and sets the system fonts
 	
-	This loads the default fonts, allocates all the major global variables, spawns the main housekeeping
-	threads, loads user preferences for the UI and decorator, and allocates various locks.
+	Shared by the server and by session replay, which draws text without one.
 */
-AppServer::AppServer(void)
+static void InitFonts(void)
 {
-	fMousePort= create_port(200,SERVER_INPUT_PORT);
-	fMessagePort= create_port(200,SERVER_PORT_NAME);
-
-	fAppList= new BList(0);
-	fQuittingServer= false;
-	fExitPoller= false;
-	make_decorator= NULL;
-	
-	// We need this in order for new_decorator to be able to instantiate new decorators
-	app_server=this;
-
 	// Create the font server and scan the proper directories.
 	fontserver=new FontServer;
 	fontserver->Lock();
@@ -130,7 +125,31 @@ AppServer::AppServer(void)
 				DEFAULT_FIXED_FONT_STYLE,DEFAULT_FIXED_FONT_SIZE);
 	fontserver->Unlock();
 
+	// Faces and glyphs are kept here between text drawing calls
+	fontcache=new FontCache;
+}
+
+/*!
+	\brief Constructor
 	
+	This loads the default fonts, allocates all the major global variables, spawns the main housekeeping
+	threads, loads user preferences for the UI and decorator, and allocates various locks.
+*/
+AppServer::AppServer(void)
+{
+	fMousePort= create_port(200,SERVER_INPUT_PORT);
+	fMessagePort= create_port(200,SERVER_PORT_NAME);
+
+	fAppList= new BList(0);
+	fQuittingServer= false;
+	fExitPoller= false;
+	make_decorator= NULL;
+	
+	// We need this in order for new_decorator to be able to instantiate new decorators
+	app_server=this;
+
+	InitFonts();
+
 	// Load the GUI colors here and set the global set to the values contained therein. If this
 	// is not possible, set colors to the defaults
 	if(!LoadGUIColors(&gui_colorset))
@@ -138,6 +157,9 @@ AppServer::AppServer(void)
 
 	InitDecorators();
 
+	// Pieces of decorators rendered once for all windows. Object declared in DecoratorCache.cpp
+	decoratorcache= new DecoratorCache();
+
 	// Set up the Desktop
 	desktop= new Desktop();
 	desktop->Init();
@@ -149,6 +171,12 @@ AppServer::AppServer(void)
 	// Create the bitmap allocator. Object declared in BitmapManager.cpp
 	bitmapmanager= new BitmapManager();
 
+	// Messages are only counted and timed when asked to. The value may name
+	// the file the profile is written to on the way out.
+	const char *profile=getenv(PROFILE_VARIABLE);
+	if(profile)
+		serverprofiler= new ServerProfiler(strcmp(profile,"1")==0 ? NULL : profile);
+
 	// This is necessary to mediate access between the Poller and app_server threads
 	fActiveAppLock= create_sem(1,"app_server_active_sem");
 
@@ -197,12 +225,17 @@ AppServer::~AppServer(void)
 
 	delete desktop;
 
+	delete decoratorcache;
+	decoratorcache=NULL;
+
 	// If these threads are still running, kill them - after this, if exit_poller
 	// is deleted, who knows what will happen... These things will just return an
 	// error and fail if the threads have already exited.
 	kill_thread(fPollerThreadID);
 	kill_thread(fPicassoThreadID);
 
+	delete fontcache;
+	fontcache=NULL;
 	delete fontserver;
 	
 	make_decorator=NULL;
@@ -341,6 +374,8 @@ void AppServer::MainLoop(void)
 			case AS_SET_DECORATOR:
 			case AS_GET_DECORATOR:
 			case AS_R5_SET_DECORATOR:
+			case AS_GET_PROFILE:
+			case AS_DUMP_PROFILE:
 				DispatchMessage(code,pmsg);
 				break;
 			default:
@@ -380,6 +415,8 @@ bool AppServer::LoadDecorator(const char *path)
 	if(!path)
 	{
 		make_decorator= NULL;
+		if(decoratorcache)
+			decoratorcache->Flush();
 		return true;
 	}
 	
@@ -412,6 +449,10 @@ bool AppServer::LoadDecorator(const char *path)
 	make_decorator=pcreatefunc;
 	fDecoratorID=addon;
 	release_sem(fDecoratorLock);
+
+	// what was rendered for the old decorator is of no use to the new one
+	if(decoratorcache)
+		decoratorcache->Flush();
 	return true;
 }
 
@@ -596,6 +637,7 @@ void AppServer::DispatchMessage(int32 code, BPortLink &msg)
 			gui_colorset.Lock();
 			msg.Read<ColorSet>(&gui_colorset);
 			gui_colorset.Unlock();
+			decoratorcache->Flush();
 			Broadcast(AS_UPDATE_COLORS);
 			break;
 		}
@@ -672,6 +714,66 @@ void AppServer::DispatchMessage(int32 code, BPortLink &msg)
 
 			break;
 		}
+		case AS_GET_PROFILE:
+		{
+			// Attached Data:
+			// 1) port_id reply port
+			// 2) int32 most codes to list for each profile
+			// 3) bool whether to start counting over afterwards
+
+			// Reply Code: SERVER_TRUE
+			// Reply Data: the profiles, as ServerProfiler::Attach() puts them
+
+			// alternatively, if profiling is not turned on
+			// Reply Code: SERVER_FALSE
+			port_id replyport=-1;
+			int32 top=PROFILE_DEFAULT_TOP;
+			bool reset=false;
+			if(msg.Read<port_id>(&replyport)<B_OK)
+				break;
+			msg.Read<int32>(&top);
+			msg.Read<bool>(&reset);
+
+			BPortLink replylink(replyport);
+			if(serverprofiler)
+			{
+				replylink.StartMessage(SERVER_TRUE);
+				serverprofiler->Attach(&replylink,top);
+				if(reset)
+					serverprofiler->Reset();
+			}
+			else
+				replylink.StartMessage(SERVER_FALSE);
+			replylink.Flush();
+			break;
+		}
+		case AS_DUMP_PROFILE:
+		{
+			// Attached Data:
+			// 1) port_id reply port
+			// 2) int32 most codes to list for each profile
+			// 3) char * path of the file to write
+			
+			// Reply Code: SERVER_TRUE, or SERVER_FALSE if profiling is not
+			// turned on or the file could not be written
+			port_id replyport=-1;
+			int32 top=PROFILE_DEFAULT_TOP;
+			char *path=NULL;
+			if(msg.Read<port_id>(&replyport)<B_OK)
+				break;
+			msg.Read<int32>(&top);
+			msg.ReadString(&path);
+
+			status_t err=B_ERROR;
+			if(serverprofiler && path)
+				err=serverprofiler->Dump(path,top);
+			free(path);
+
+			BPortLink replylink(replyport);
+			replylink.StartMessage(err==B_OK ? SERVER_TRUE : SERVER_FALSE);
+			replylink.Flush();
+			break;
+		}
 		case AS_GET_SCREEN_MODE:
 		{
 			// Synchronous message call to get the stats on the current screen mode
@@ -750,6 +852,11 @@ void AppServer::DispatchMessage(int32 code, BPortLink &msg)
 			}
 			release_sem(fAppListLock);
 
+			// Killing the threads below can take the whole process with it,
+			// so the profile is written first
+			if(serverprofiler && serverprofiler->DumpPath())
+				serverprofiler->Dump(serverprofiler->DumpPath());
+
 			// When we delete the last ServerApp, we can exit the server
 			fQuittingServer=true;
 			fExitPoller=true;
@@ -860,16 +967,115 @@ Decorator *new_decorator(BRect rect, const char *title, int32 wlook, int32 wfeel
 	return dec;
 }
 
+/*!
+	\brief Plays a recorded session on the headless driver and reports the timings
+	\param argc Number of arguments following --replay
+	\param argv The arguments following --replay
+	\return 0 if the session was played, 1 if not
+
+	The arguments are the session file, then optionally --loops COUNT,
+	--mode WIDTHxHEIGHTxDEPTH and --dump PNGFILE. The session is played once
+	untimed to fill the glyph cache, then COUNT times (10 by default) timed.
+*/
+static int ReplaySession(int argc, char **argv)
+{
+	const char *path=NULL, *mode="", *dump=NULL;
+	int32 loops=10, threads=0;
+
+	for(int32 i=0; i<argc; i++)
+	{
+		if(strcmp(argv[i],"--loops")==0 && i+1<argc)
+			loops=atol(argv[++i]);
+		else if(strcmp(argv[i],"--mode")==0 && i+1<argc)
+			mode=argv[++i];
+		else if(strcmp(argv[i],"--threads")==0 && i+1<argc)
+			threads=atol(argv[++i]);
+		else if(strcmp(argv[i],"--dump")==0 && i+1<argc)
+			dump=argv[++i];
+		else if(!path)
+			path=argv[i];
+	}
+
+	int32 width, height;
+	color_space space;
+	if(!path || loops<1 || !HeadlessDriver::ParseMode(mode,&width,&height,&space))
+	{
+		printf("usage: appserver --replay SESSION [--loops COUNT] "
+				"[--mode WIDTHxHEIGHTxDEPTH] [--threads COUNT] [--dump PNGFILE]\n");
+		return 1;
+	}
+
+	SessionPlayer player;
+	status_t err=player.SetTo(path);
+	if(err!=B_OK)
+	{
+		printf("Couldn't load session %s: %s\n",path,strerror(err));
+		return 1;
+	}
+
+	InitFonts();
+
+	// Drawing state starts with the system font, so there is nothing to do without one
+	if(!fontserver->GetSystemPlain())
+	{
+		printf("No system font was found\n");
+		return 1;
+	}
+
+	HeadlessDriver *driver=new HeadlessDriver(width,height,space);
+	if(!driver->Initialize())
+	{
+		printf("Couldn't start the headless driver\n");
+		delete driver;
+		return 1;
+	}
+
+	if(threads>0)
+		driver->SetRasterizerThreads(threads);
+
+	printf("%s: %ld messages, %ld frames, %ldx%ld, %ld loops\n",path,
+			player.CountMessages(),player.CountFrames(),width,height,loops);
+
+	// Windows always draw with a clipping region, and the driver counts on it
+	// to keep off the edges of the framebuffer
+	LayerData *data=new LayerData();
+	data->clipReg=new BRegion(BRect(0,0,width-1,height-1));
+	player.Play(driver,data);
+	player.ResetStats();
+
+	for(int32 i=0; i<loops; i++)
+		player.Play(driver,data);
+
+	player.PrintStats(stdout);
+
+	if(dump && !driver->DumpToFile(dump))
+		printf("Couldn't save the frame to %s\n",dump);
+
+	delete data;
+	driver->Shutdown();
+	delete driver;
+	delete fontcache;
+	fontcache=NULL;
+	delete fontserver;
+	return 0;
+}
+
 /*!
 	\brief Entry function to run the entire server
 	\param argc Number of command-line arguments present
 	\param argv String array of the command-line arguments
 	\return -1 if the app_server is already running, 0 if everything's OK.
+
+	"appserver --replay ..." plays a recorded session instead of running the
+	server; see ReplaySession().
 */
 int main( int argc, char** argv )
 {
 	STRACE(( "Appserver Alive %ld\n", find_thread(NULL) ));
 
+	if(argc>1 && strcmp(argv[1],"--replay")==0)
+		return ReplaySession(argc-2,argv+2);
+
 	// There can be only one....
 	if(find_port(SERVER_PORT_NAME)!=B_NAME_NOT_FOUND)
 		return -1;
@@ -442,7 +442,7 @@ void MemPool::ReleaseBuffer(void *buf)
 		// buffer.  Note that we subtract the size  in	the  buffer  being
 		// released,  since  it's  negative to indicate that the buffer is allocated.
 	
-		register ssize_t size = b->bh.bsize;
+		ssize_t size = b->bh.bsize;
 	
 	    // Make the previous buffer the one we're working on.
 		assert(BH((char *) b - b->bh.prevfree)->bsize == b->bh.prevfree);
@@ -613,6 +613,20 @@ void MemPool::Stats(ssize_t *curalloc, ssize_t *totfree, ssize_t *maxfree,
 }
 
 
+// Set how much memory to add to the pool when it runs out. 0 lets it fill up.
+void MemPool::SetPoolIncrement(ssize_t increment)
+{
+    exp_incr = increment;
+}
+
+
+// Return how much memory is added to the pool when it runs out
+ssize_t MemPool::PoolIncrement(void)
+{
+    return exp_incr;
+}
+
+
 // Return extended statistics 
 void MemPool::ExtendedStats(ssize_t *pool_incr, long *npool, long *npget, long *nprel, 
 	long *ndget, long *ndrel)
@@ -715,7 +729,7 @@ void MemPool::PoolDump(void *buf, bool dumpalloc, bool dumpfree)
 		} 
 		else 
 		{
-	            char *lerr = "";
+	            const char *lerr = "";
 	
 		    assert(bs > 0);
 		    if ((b->ql.blink->ql.flink != b) ||	(b->ql.flink->ql.blink != b)) 
@@ -759,7 +773,7 @@ int MemPool::Validate(void *buf)
 		}
 		else 
 		{
-            char *lerr = "";
+            const char *lerr = "";
 	
 		    assert(bs > 0);
 		    if (bs <= 0) 
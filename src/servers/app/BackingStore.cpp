@@ -0,0 +1,320 @@
+//------------------------------------------------------------------------------
+//	File Name:		BackingStore.cpp
+//	Description:	Offscreen copy of the parts of a window which are covered,
+//					so they can be put back without asking the client
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <Accelerant.h>
+#include <Autolock.h>
+#include <List.h>
+#include <Locker.h>
+#include "BackingStore.h"
+#include "DisplayDriver.h"
+#include "ServerBitmap.h"
+
+//#define DEBUG_BACKING_STORE
+#ifdef DEBUG_BACKING_STORE
+#	include <stdio.h>
+#	define STRACE(x) printf x
+#else
+#	define STRACE(x) ;
+#endif
+
+// Guards everything below along with the contents of all stores. Stores are
+// used from the rebuild and from each window's thread.
+static BLocker sStoreLock("backing store lock");
+
+// Stores which have a bitmap, the one used least recently first
+static BList sStores;
+
+static int64 sBudget = -1;
+static int64 sUsed = 0;
+
+static int64 get_budget(void)
+{
+	if (sBudget < 0)
+	{
+		const char *value = getenv(BACKING_STORE_VARIABLE);
+		sBudget = (value ? atol(value) : BACKING_STORE_DEFAULT_KB) * 1024LL;
+		if (sBudget < 0)
+			sBudget = 0;
+	}
+	return sBudget;
+}
+
+/*!
+	\brief Sets up an empty store
+	\param driver The driver whose screen will be saved and restored
+
+	No memory is used until something has to be saved.
+*/
+BackingStore::BackingStore(DisplayDriver *driver)
+{
+	fDriver = driver;
+	fBitmap = NULL;
+}
+
+//! Frees the store's bitmap
+BackingStore::~BackingStore(void)
+{
+	BAutolock locker(sStoreLock);
+	Free();
+}
+
+/*!
+	\brief Follows a window through a rebuild of the regions
+	\param oldVisible The client area which was visible before the rebuild
+	\param oldOrigin Where the window's top left corner was before the rebuild
+	\param newVisible The client area which is visible now
+	\param frame The window's frame now
+	\param save true to save what was covered. Only the framebuffer as it was
+	before the rebuild, with nothing copied or redrawn yet, may be saved.
+
+	Whatever was visible has been drawn since it was last saved, so it is
+	forgotten. What is not visible anymore is then saved, unless the client
+	has yet to draw it.
+*/
+void BackingStore::Update(const BRegion &oldVisible, const BPoint &oldOrigin,
+	const BRegion &newVisible, const BRect &frame, bool save)
+{
+	BAutolock locker(sStoreLock);
+
+	BRegion old(oldVisible);
+	old.OffsetBy(-(int32)oldOrigin.x, -(int32)oldOrigin.y);
+	fSaved.Exclude(&old);
+
+	if (!save)
+		return;
+
+	BRegion lost(oldVisible);
+	lost.Exclude(&newVisible);
+	if (lost.CountRects() == 0)
+		return;
+
+	BRegion pending(fPending);
+	pending.OffsetBy((int32)frame.left, (int32)frame.top);
+	lost.Exclude(&pending);
+	if (lost.CountRects() == 0 || !Allocate(frame))
+		return;
+
+	STRACE(("BackingStore::Update(): saving %ld rects\n", lost.CountRects()));
+	fDriver->SaveRegion(&lost, fBitmap, frame.LeftTop());
+
+	lost.OffsetBy(-(int32)frame.left, -(int32)frame.top);
+	fSaved.Include(&lost);
+	Touch();
+}
+
+/*!
+	\brief Finds what could be put back on screen of a region
+	\param region The region to redraw
+	\param visible The client area which is visible now
+	\param frame The window's frame now
+	\param restorable Receives the part of the region which was saved
+*/
+void BackingStore::GetRestorable(const BRegion &region, const BRegion &visible,
+	const BRect &frame, BRegion *restorable)
+{
+	BAutolock locker(sStoreLock);
+
+	restorable->MakeEmpty();
+	if (fSaved.CountRects() == 0)
+		return;
+
+	if (!Matches(frame))
+	{
+		// the window was resized or the screen changed since
+		fSaved.MakeEmpty();
+		return;
+	}
+
+	*restorable = fSaved;
+	restorable->OffsetBy((int32)frame.left, (int32)frame.top);
+	restorable->IntersectWith(&visible);
+	restorable->IntersectWith(&region);
+}
+
+/*!
+	\brief Puts back on screen what was saved of a region
+	\param region The region, as returned by GetRestorable()
+	\param frame The window's frame now
+
+	Whatever was drawn in the region since GetRestorable() is drawn over.
+*/
+void BackingStore::Restore(const BRegion &region, const BRect &frame)
+{
+	BAutolock locker(sStoreLock);
+
+	BRegion restore(fSaved);
+	restore.OffsetBy((int32)frame.left, (int32)frame.top);
+	restore.IntersectWith(&region);
+	if (restore.CountRects() == 0 || !Matches(frame))
+		return;
+
+	STRACE(("BackingStore::Restore(): restoring %ld rects\n", restore.CountRects()));
+	fDriver->RestoreRegion(&restore, fBitmap, frame.LeftTop());
+
+	// it is on screen again, where the client may draw on it
+	restore.OffsetBy(-(int32)frame.left, -(int32)frame.top);
+	fSaved.Exclude(&restore);
+	Touch();
+}
+
+/*!
+	\brief Notes that an update was sent to the client for a region
+	\param region The region of the update
+	\param origin Where the window's top left corner is
+*/
+void BackingStore::AddPending(const BRegion &region, const BPoint &origin)
+{
+	BAutolock locker(sStoreLock);
+
+	BRegion pending(region);
+	pending.OffsetBy(-(int32)origin.x, -(int32)origin.y);
+	fPending.Include(&pending);
+}
+
+/*!
+	\brief Notes that the client has finished drawing a region
+	\param region The region of a view which just ended its update
+	\param origin Where the window's top left corner is
+*/
+void BackingStore::RemovePending(const BRegion &region, const BPoint &origin)
+{
+	BAutolock locker(sStoreLock);
+
+	if (fPending.CountRects() == 0)
+		return;
+
+	BRegion done(region);
+	done.OffsetBy(-(int32)origin.x, -(int32)origin.y);
+	fPending.Exclude(&done);
+}
+
+/*!
+	\brief Forgets what was saved in a region
+	\param region The region whose contents changed
+	\param origin Where the window's top left corner is
+*/
+void BackingStore::Discard(const BRegion &region, const BPoint &origin)
+{
+	BAutolock locker(sStoreLock);
+
+	if (fSaved.CountRects() == 0)
+		return;
+
+	BRegion changed(region);
+	changed.OffsetBy(-(int32)origin.x, -(int32)origin.y);
+	fSaved.Exclude(&changed);
+}
+
+//! Forgets everything which was saved, keeping the bitmap for later
+void BackingStore::Discard(void)
+{
+	BAutolock locker(sStoreLock);
+	fSaved.MakeEmpty();
+}
+
+/*!
+	\brief Returns false if backing stores are turned off
+
+	They are turned off by setting BACKING_STORE_VARIABLE to 0.
+*/
+bool BackingStore::IsEnabled(void)
+{
+	BAutolock locker(sStoreLock);
+	return get_budget() > 0;
+}
+
+/*!
+	\brief Makes sure the store has a bitmap fit for the window
+	\param frame The window's frame
+	\return false if there is no room for one
+*/
+bool BackingStore::Allocate(const BRect &frame)
+{
+	if (fBitmap && Matches(frame))
+		return true;
+
+	Free();
+
+	display_mode mode;
+	fDriver->GetMode(&mode);
+
+	BRect bounds(0, 0, frame.IntegerWidth(), frame.IntegerHeight());
+	UtilityBitmap *bitmap = new UtilityBitmap(bounds, (color_space)mode.space, 0);
+	if (!bitmap->Bits() || (int64)bitmap->BitsLength() > get_budget())
+	{
+		delete bitmap;
+		return false;
+	}
+
+	MakeRoom(bitmap->BitsLength(), this);
+
+	fBitmap = bitmap;
+	sUsed += fBitmap->BitsLength();
+	sStores.AddItem(this);
+	return true;
+}
+
+//! Returns true if the store's bitmap has the window's size and the screen's color space
+bool BackingStore::Matches(const BRect &frame)
+{
+	if (!fBitmap)
+		return false;
+
+	display_mode mode;
+	fDriver->GetMode(&mode);
+
+	return fBitmap->ColorSpace() == (color_space)mode.space
+		&& fBitmap->Bounds().IntegerWidth() == frame.IntegerWidth()
+		&& fBitmap->Bounds().IntegerHeight() == frame.IntegerHeight();
+}
+
+//! Frees the bitmap and forgets what was saved in it
+void BackingStore::Free(void)
+{
+	fSaved.MakeEmpty();
+
+	if (!fBitmap)
+		return;
+
+	sUsed -= fBitmap->BitsLength();
+	sStores.RemoveItem(this);
+	delete fBitmap;
+	fBitmap = NULL;
+}
+
+//! Moves the store to the end of the list, as the one used most recently
+void BackingStore::Touch(void)
+{
+	if (sStores.RemoveItem(this))
+		sStores.AddItem(this);
+}
+
+/*!
+	\brief Frees the bitmaps of the stores used least recently
+	\param bytes The memory which has to fit in the budget
+	\param keep A store whose bitmap must not be freed
+*/
+void BackingStore::MakeRoom(int64 bytes, BackingStore *keep)
+{
+	int32 index = 0;
+	while (sUsed + bytes > get_budget())
+	{
+		BackingStore *store = (BackingStore*)sStores.ItemAt(index);
+		if (!store)
+			break;
+
+		if (store == keep)
+		{
+			index++;
+			continue;
+		}
+
+		STRACE(("BackingStore: evicting a store of %ld bytes\n",
+			store->fBitmap->BitsLength()));
+		store->Free();
+	}
+}
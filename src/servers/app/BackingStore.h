@@ -0,0 +1,76 @@
+//------------------------------------------------------------------------------
+//	File Name:		BackingStore.h
+//	Description:	Offscreen copy of the parts of a window which are covered,
+//					so they can be put back without asking the client
+//
+//------------------------------------------------------------------------------
+#ifndef _BACKINGSTORE_H_
+#define _BACKINGSTORE_H_
+
+#include <Point.h>
+#include <Rect.h>
+#include <Region.h>
+
+class DisplayDriver;
+class UtilityBitmap;
+
+//! Environment variable which sets the memory all backing stores may use, in kilobytes. 0 turns them off.
+#define BACKING_STORE_VARIABLE		"COSMOE_BACKING_STORE"
+
+//! Kilobytes all backing stores may use when BACKING_STORE_VARIABLE is not set
+#define BACKING_STORE_DEFAULT_KB	16384
+
+/*!
+	\class BackingStore BackingStore.h
+	\brief Keeps what a window showed in the parts of it which got covered
+
+	When a rebuild takes part of a window's client area off screen, those
+	pixels are still in the framebuffer: they are saved to a bitmap the size
+	of the window. Once that part is exposed again, it is put back from the
+	bitmap and the client only gets an update for what was not saved.
+
+	Regions passed in are in screen coordinates, with the window's top left
+	corner at the given origin; the store keeps them relative to that corner
+	so they survive the window being moved. Parts the client draws or
+	invalidates while they are covered are dropped, as are parts which still
+	have an update outstanding, since the screen does not hold their final
+	pixels yet.
+
+	All stores share a memory budget. When a new bitmap would not fit, those
+	of the stores used least recently are freed.
+*/
+class BackingStore
+{
+public:
+	BackingStore(DisplayDriver *driver);
+	~BackingStore(void);
+
+	void Update(const BRegion &oldVisible, const BPoint &oldOrigin,
+		const BRegion &newVisible, const BRect &frame, bool save);
+	void GetRestorable(const BRegion &region, const BRegion &visible,
+		const BRect &frame, BRegion *restorable);
+	void Restore(const BRegion &region, const BRect &frame);
+
+	void AddPending(const BRegion &region, const BPoint &origin);
+	void RemovePending(const BRegion &region, const BPoint &origin);
+
+	void Discard(const BRegion &region, const BPoint &origin);
+	void Discard(void);
+
+	static bool IsEnabled(void);
+
+private:
+	bool Allocate(const BRect &frame);
+	bool Matches(const BRect &frame);
+	void Free(void);
+	void Touch(void);
+
+	static void MakeRoom(int64 bytes, BackingStore *keep);
+
+	DisplayDriver *fDriver;
+	UtilityBitmap *fBitmap;
+	BRegion fSaved;
+	BRegion fPending;
+};
+
+#endif
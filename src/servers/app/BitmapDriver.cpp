@@ -38,6 +38,9 @@
 #include "FontFamily.h"
 #include "RGBColor.h"
 #include "LayerData.h"
+#include "SpanKernels.h"
+#include "Compositor.h"
+#include "TileRasterizer.h"
 #include <View.h>
 #include <stdio.h>
 #include <string.h>
@@ -46,6 +49,196 @@
 
 extern RGBColor workspace_default_color;	// defined in AppServer.cpp
 
+/*!
+	\brief Returns a color as it is stored in a buffer of the given depth
+	\param color The color to convert
+	\param bitsperpixel Depth of the buffer
+*/
+static uint32 pixel_value(const RGBColor &color, int32 bitsperpixel)
+{
+	RGBColor col(color);	// to avoid GetColor8/15/16() const issues
+
+	switch(bitsperpixel)
+	{
+		case 8:
+			return col.GetColor8();
+		case 15:
+			return col.GetColor15();
+		case 16:
+			return col.GetColor16();
+		default:
+		{
+			rgb_color c=col.GetColor32();
+			return (c.alpha << 24) | (c.red << 16) | (c.green << 8) | (c.blue);
+		}
+	}
+}
+
+/*
+	The rectangle functions below are split into jobs which the rasterizer
+	hands out a band of rows at a time. Row 0 of a job is the first row of
+	its rectangle.
+*/
+
+struct fill_job
+{
+	uint8 *dest;
+	int32 bpr;
+	int32 width;
+	uint32 pixel;
+	int32 pixelsize;
+};
+
+static void fill_band(void *cookie, int32 first, int32 count)
+{
+	fill_job *job=(fill_job*)cookie;
+	rect_fill(job->dest+first*job->bpr, job->bpr, job->width, count,
+		job->pixel, job->pixelsize);
+}
+
+struct pattern_job
+{
+	uint8 *dest;
+	int32 bpr;
+	int32 width;
+	const uint8 *pattern;
+	int32 left;
+	int32 top;
+	uint32 high;
+	uint32 low;
+	int32 pixelsize;
+};
+
+static void pattern_band(void *cookie, int32 first, int32 count)
+{
+	pattern_job *job=(pattern_job*)cookie;
+	rect_fill_pattern(job->dest+first*job->bpr, job->bpr, job->width, count,
+		job->pattern, job->left, job->top+first, job->high, job->low,
+		job->pixelsize);
+}
+
+//! Pixels in a source row of a pattern_composite_job
+#define PATTERN_CHUNK	256
+
+struct pattern_composite_job
+{
+	uint8 *dest;
+	int32 bpr;
+	int32 width;
+	int32 top;
+	int32 pixelsize;
+	compositor_func composite;
+	compositor_state state;
+
+	// A chunk is a whole number of pattern widths, so every chunk of a row
+	// starts at the same pattern column and can use the same source row
+	uint8 src[8][PATTERN_CHUNK*4];
+	uint8 high[8][PATTERN_CHUNK];
+};
+
+static void pattern_composite_band(void *cookie, int32 first, int32 count)
+{
+	pattern_composite_job *job=(pattern_composite_job*)cookie;
+	uint8 *dest=job->dest+first*job->bpr;
+
+	for(int32 y=job->top+first; y<job->top+first+count; y++, dest+=job->bpr)
+	{
+		int32 row=y & 7;
+		for(int32 x=0; x<job->width; x+=PATTERN_CHUNK)
+		{
+			int32 n=job->width-x<PATTERN_CHUNK ? job->width-x : PATTERN_CHUNK;
+			job->composite(dest+x*job->pixelsize, job->src[row], job->high[row],
+				n, &job->state);
+		}
+	}
+}
+
+struct copy_job
+{
+	uint8 *dest;
+	int32 destbpr;
+	const uint8 *src;
+	int32 srcbpr;
+	size_t bytes;
+};
+
+static void copy_band(void *cookie, int32 first, int32 count)
+{
+	copy_job *job=(copy_job*)cookie;
+	rect_copy(job->dest+first*job->destbpr, job->destbpr,
+		job->src+first*job->srcbpr, job->srcbpr, job->bytes, count);
+}
+
+/*!
+	\brief Copies a rectangle between buffers which don't overlap
+	\param tiles The rasterizer to copy with
+	\param pixelsize Bytes per pixel
+
+	The other parameters are those of rect_copy().
+*/
+static void copy_rect(TileRasterizer *tiles, uint8 *dest, int32 destbpr,
+	const uint8 *src, int32 srcbpr, size_t bytes, int32 rows, int32 pixelsize)
+{
+	copy_job job={ dest, destbpr, src, srcbpr, bytes };
+	tiles->Run(copy_band, &job, rows, bytes/(pixelsize>0 ? pixelsize : 1));
+}
+
+struct composite_job
+{
+	uint8 *dest;
+	int32 destbpr;
+	const uint8 *src;
+	int32 srcbpr;
+	int32 width;
+	compositor_func composite;
+	compositor_state state;
+};
+
+static void composite_band(void *cookie, int32 first, int32 count)
+{
+	composite_job *job=(composite_job*)cookie;
+	uint8 *dest=job->dest+first*job->destbpr;
+	const uint8 *src=job->src+first*job->srcbpr;
+
+	for(int32 i=0; i<count; i++, dest+=job->destbpr, src+=job->srcbpr)
+		job->composite(dest, src, NULL, job->width, &job->state);
+}
+
+/*!
+	\brief Draws a rectangle of a B_RGBA32 bitmap with a DrawData's mode
+	\param tiles The rasterizer to draw with
+	\param dest First pixel of the destination
+	\param destbpr Bytes per row of the destination
+	\param src First pixel of the source
+	\param srcbpr Bytes per row of the source
+	\param width Pixels per row
+	\param rows Number of rows
+	\param bitsperpixel Depth of the destination
+	\param d The DrawData to draw with
+	\return false if the compositor can't draw at that depth
+*/
+static bool composite_rect(TileRasterizer *tiles, uint8 *dest, int32 destbpr,
+	const uint8 *src, int32 srcbpr, int32 width, int32 rows, int32 bitsperpixel,
+	const DrawData *d)
+{
+	composite_job job;
+	job.composite=get_compositor(d->draw_mode, d->alphaSrcMode,
+		d->alphaFncMode, bitsperpixel);
+	if(!job.composite)
+		return false;
+
+	job.dest=dest;
+	job.destbpr=destbpr;
+	job.src=src;
+	job.srcbpr=srcbpr;
+	job.width=width;
+	job.state.high=d->highcolor.GetColor32();
+	job.state.low=d->lowcolor.GetColor32();
+
+	tiles->Run(composite_band, &job, rows, width);
+	return true;
+}
+
 /*!
 	\brief Sets up internal variables needed by all DisplayDriver subclasses
 	
@@ -57,6 +250,10 @@ BitmapDriver::BitmapDriver(void) : DisplayDriver()
 	fTarget=NULL;
 	fGraphicsBuffer=NULL;
 	fPixelRenderer=NULL;
+	fTiles=TileRasterizer::Acquire();
+	fPresentThread=-1;
+	fPresentSem=-1;
+	fPresentInterval=PRESENT_INTERVAL;
 }
 
 /*!
@@ -66,6 +263,8 @@ BitmapDriver::BitmapDriver(void) : DisplayDriver()
 */
 BitmapDriver::~BitmapDriver(void)
 {
+	StopPresenting();
+	TileRasterizer::Release();
 }
 
 /*!
@@ -92,15 +291,134 @@ void BitmapDriver::Shutdown(void)
 	// Nothing is needed here
 }
 
-void BitmapDriver::SetTarget(ServerBitmap *target)
+/*!
+	\brief Starts the thread which presents the damage
+	\param interval The longest time, in microseconds, damage waits to be presented
+
+	Subclasses call this once they are ready for Present() to be called. Each
+	of them has to call StopPresenting() before it is destroyed.
+*/
+void BitmapDriver::StartPresenting(bigtime_t interval)
 {
+	if(fPresentThread>=B_OK)
+		return;
+
+	fPresentInterval=interval;
+	fPresentSem=create_sem(0,"present sem");
+	if(fPresentSem<B_OK)
+		return;
+
+	fPresentThread=spawn_thread(PresentThread,"present",B_DISPLAY_PRIORITY,this);
+	if(fPresentThread<B_OK)
+	{
+		delete_sem(fPresentSem);
+		fPresentSem=-1;
+		return;
+	}
+	resume_thread(fPresentThread);
+}
+
+/*!
+	\brief Stops the presenting thread after one last presentation
+
+	It is safe to call this more than once, or without having started it.
+*/
+void BitmapDriver::StopPresenting(void)
+{
+	if(fPresentThread<B_OK)
+		return;
+
+	release_sem(fPresentSem);
+	status_t result;
+	wait_for_thread(fPresentThread,&result);
+	fPresentThread=-1;
+
+	delete_sem(fPresentSem);
+	fPresentSem=-1;
+
+	Sync();
+}
+
+int32 BitmapDriver::PresentThread(void *data)
+{
+	BitmapDriver *driver=(BitmapDriver*)data;
+
+	for(;;)
+	{
+		status_t err=acquire_sem_etc(driver->fPresentSem,1,B_RELATIVE_TIMEOUT,
+			driver->fPresentInterval);
+		if(err!=B_TIMED_OUT && err!=B_INTERRUPTED)
+			break;
+		driver->Sync();
+	}
+	return 0;
+}
+
+/*!
+	\brief Notes that a part of the target has to be presented
+	\param r The changed rectangle
+
+	This may be called from any thread.
+*/
+void BitmapDriver::AddDamage(const BRect &r)
+{
+	if(!fTarget)
+		return;
+
+	BRect damage(r & fTarget->Bounds());
+	if(!damage.IsValid())
+		return;
+
 	Lock();
-	
-	if(fGraphicsBuffer)
+	fDamage.Include(damage);
+	Unlock();
+}
+
+/*!
+	\brief Presents all the damage now
+
+	When the damage is in too many pieces, the rectangle around all of it is
+	presented instead; it is cheaper to send some pixels twice than to make
+	many small transfers.
+*/
+void BitmapDriver::Sync(void)
+{
+	Lock();
+	if(fDamage.CountRects()>PRESENT_MAX_RECTS)
+		fDamage.Set(fDamage.Frame());
+	if(fDamage.CountRects()>0)
 	{
-		delete fGraphicsBuffer;
-		fGraphicsBuffer=NULL;
+		Present(fDamage);
+		fDamage.MakeEmpty();
 	}
+	Unlock();
+}
+
+/*!
+	\brief Copies the damaged parts of the target to the real framebuffer
+	\param damage The parts to copy, which are all inside the target
+
+	Called by Sync() with the driver locked. The default does nothing.
+*/
+void BitmapDriver::Present(BRegion &damage)
+{
+}
+
+/*!
+	\brief Sets how many threads draw large rectangles
+	\param threads Number of threads, counting the one drawing. 0 uses one
+	per CPU unless TILE_THREADS_VARIABLE says otherwise.
+*/
+void BitmapDriver::SetRasterizerThreads(int32 threads)
+{
+	Lock();
+	fTiles->SetThreadCount(threads);
+	Unlock();
+}
+
+void BitmapDriver::SetTarget(ServerBitmap *target)
+{
+	Lock();
 	
 	if(fPixelRenderer)
 	{
@@ -108,6 +426,12 @@ void BitmapDriver::SetTarget(ServerBitmap *target)
 		fPixelRenderer=NULL;
 	}
 	
+	if(fGraphicsBuffer)
+	{
+		delete fGraphicsBuffer;
+		fGraphicsBuffer=NULL;
+	}
+	
 	fTarget=target;
 	
 	if(target)
@@ -116,8 +440,8 @@ void BitmapDriver::SetTarget(ServerBitmap *target)
 		fDisplayMode.virtual_height=target->Height();
 		fDisplayMode.space=target->ColorSpace();
 		
-		fGraphicsBuffer=new GraphicsBuffer((uint8*)fTarget->Bits(),fTarget->Bounds().Width(),
-				fTarget->Bounds().Height(),fTarget->BytesPerRow());
+		fGraphicsBuffer=new GraphicsBuffer((uint8*)fTarget->Bits(),fTarget->Width(),
+				fTarget->Height(),fTarget->BytesPerRow());
 		
 		switch(fTarget->ColorSpace())
 		{
@@ -215,109 +539,6 @@ void BitmapDriver::InvertRect(const BRect &r)
 	Unlock();
 }
 
-rgb_color BitmapDriver::GetBlitColor(rgb_color src, rgb_color dest, DrawData *d, bool use_high)
-{
-	rgb_color returncolor={0,0,0,0};
-	int16 value;
-	if(!d)
-		return returncolor;
-	
-	switch(d->draw_mode)
-	{
-		case B_OP_COPY:
-		{
-			return src;
-		}
-		case B_OP_ADD:
-		{
-			value=src.red+dest.red;
-			returncolor.red=(value>255)?255:value;
-
-			value=src.green+dest.green;
-			returncolor.green=(value>255)?255:value;
-
-			value=src.blue+dest.blue;
-			returncolor.blue=(value>255)?255:value;
-			return returncolor;
-		}
-		case B_OP_SUBTRACT:
-		{
-			value=src.red-dest.red;
-			returncolor.red=(value<0)?0:value;
-
-			value=src.green-dest.green;
-			returncolor.green=(value<0)?0:value;
-
-			value=src.blue-dest.blue;
-			returncolor.blue=(value<0)?0:value;
-			return returncolor;
-		}
-		case B_OP_BLEND:
-		{
-			value=int16(src.red+dest.red)>>1;
-			returncolor.red=value;
-
-			value=int16(src.green+dest.green)>>1;
-			returncolor.green=value;
-
-			value=int16(src.blue+dest.blue)>>1;
-			returncolor.blue=value;
-			return returncolor;
-		}
-		case B_OP_MIN:
-		{
-			
-			return ( uint16(src.red+src.blue+src.green) > 
-				uint16(dest.red+dest.blue+dest.green) )?dest:src;
-		}
-		case B_OP_MAX:
-		{
-			return ( uint16(src.red+src.blue+src.green) < 
-				uint16(dest.red+dest.blue+dest.green) )?dest:src;
-		}
-		case B_OP_OVER:
-		{
-			return (use_high && src.alpha>127)?src:dest;
-		}
-		case B_OP_INVERT:
-		{
-			returncolor.red=dest.red ^ 255;
-			returncolor.green=dest.green ^ 255;
-			returncolor.blue=dest.blue ^ 255;
-			return (use_high && src.alpha>127)?returncolor:dest;
-		}
-		// This is a pain in the arse to implement, so I'm saving it for the real
-		// server
-		case B_OP_ALPHA:
-		{
-			return src;
-		}
-		case B_OP_ERASE:
-		{
-			// This one's tricky. 
-			return (use_high && src.alpha>127)?d->lowcolor.GetColor32():dest;
-		}
-		case B_OP_SELECT:
-		{
-			// This one's tricky, too. We are passed a color in src. If it's the layer's
-			// high color or low color, we check for a swap.
-			if(d->highcolor==src)
-				return (use_high && d->highcolor==dest)?d->lowcolor.GetColor32():dest;
-			
-			if(d->lowcolor==src)
-				return (use_high && d->lowcolor==dest)?d->highcolor.GetColor32():dest;
-
-			return dest;
-		}
-		default:
-		{
-			break;
-		}
-	}
-	Unlock();
-	return returncolor;
-}
-
 /*!
 	\brief Draws a point using the display driver's specified thickness and pattern
 	\param x The x coordinate (not guaranteed to be in bounds)
@@ -603,59 +824,19 @@ void BitmapDriver::DrawBitmap(ServerBitmap *sourcebmp, const BRect &source,
 	uint32 line_length = uint32 ((destrect.right - destrect.left+1)*colorspace_size);
 	uint32 lines = uint32 (destrect.bottom-destrect.top+1);
 
-	switch(d->draw_mode)
+	// Modes other than B_OP_COPY need to know the source's colors and alpha
+	if(d->draw_mode!=B_OP_COPY && sourcebmp->BitsPerPixel()==32)
 	{
-		case B_OP_OVER:
-		{
-//			uint32 srow_pixels=src_width>>2;
-			uint32 srow_pixels=((destrect.IntegerWidth()>=sourcerect.IntegerWidth())?src_width:destrect.IntegerWidth()+1)>>2;
-			uint8 *srow_index, *drow_index;
-			
-			
-			// This could later be optimized to use uint32's for faster copying
-			for (uint32 pos_y=0; pos_y!=lines; pos_y++)
-			{
-				
-				srow_index=src_bits;
-				drow_index=dest_bits;
-				
-				for(uint32 pos_x=0; pos_x!=srow_pixels;pos_x++)
-				{
-					// 32-bit RGBA32 mode byte order is BGRA
-					if(srow_index[3]>127)
-					{
-						*drow_index=*srow_index; drow_index++; srow_index++;
-						*drow_index=*srow_index; drow_index++; srow_index++;
-						*drow_index=*srow_index; drow_index++; srow_index++;
-						// we don't copy the alpha channel
-						drow_index++; srow_index++;
-					}
-					else
-					{
-						srow_index+=4;
-						drow_index+=4;
-					}
-				}
-		
-				// Increment offsets
-		   		src_bits += src_width;
-		   		dest_bits += dest_width;
-			}
-			break;
-		}
-		default:	// B_OP_COPY
-		{
-			for (uint32 pos_y = 0; pos_y != lines; pos_y++)
-			{
-				memcpy(dest_bits,src_bits,line_length);
-		
-				// Increment offsets
-				src_bits += src_width;
-				dest_bits += dest_width;
-			}
-			break;
-		}
+		if(composite_rect(fTiles, dest_bits, dest_width, src_bits, src_width,
+				destrect.IntegerWidth()+1, lines, fTarget->BitsPerPixel(), d))
+			return;
 	}
+
+	if(sourcebmp->Bits()==fTarget->Bits())
+		rect_move(dest_bits,src_bits,dest_width,line_length,lines);
+	else
+		copy_rect(fTiles,dest_bits,dest_width,src_bits,src_width,line_length,lines,
+			colorspace_size);
 }
 
 
@@ -673,150 +854,204 @@ void BitmapDriver::ReleaseBuffer(void)
 {
 }
 
+/*!
+	\brief Copies a rectangle of the target to another place in it
+	\param src The rectangle to copy
+	\param dest Where to copy it to. Only its position is used.
+	\param d The DrawData (currently unused)
+
+	The rectangles may overlap, as they do when a view is scrolled.
+*/
 void BitmapDriver::Blit(const BRect &src, const BRect &dest, const DrawData *d)
 {
+	if(!fTarget)
+		return;
+
+	int32 pixelsize=span_pixel_size(fTarget->BitsPerPixel());
+	if(pixelsize==0)
+	{
+		printf("Error: Unknown color space\n");
+		return;
+	}
+
+	// Clip the source so that neither it nor the destination leave the target
+	int32 dx=int32(dest.left-src.left), dy=int32(dest.top-src.top);
+	BRect bounds(0,0,fTarget->Width()-1,fTarget->Height()-1);
+	BRect source=src & bounds & bounds.OffsetByCopy(-dx,-dy);
+	if(!source.IsValid())
+		return;
+
+	int32 bytes_per_row=fTarget->BytesPerRow();
+	int32 left=int32(source.left), top=int32(source.top);
+	uint8 *bits=(uint8*)fTarget->Bits();
+
+	rect_move(bits + (top+dy)*bytes_per_row + (left+dx)*pixelsize,
+		bits + top*bytes_per_row + left*pixelsize, bytes_per_row,
+		(source.IntegerWidth()+1)*pixelsize, source.IntegerHeight()+1);
 }
 
 void BitmapDriver::FillSolidRect(const BRect &rect, const RGBColor &color)
 {
+	int32 pixelsize=span_pixel_size(fTarget->BitsPerPixel());
+	if(pixelsize==0)
+	{
+		printf("Error: Unknown color space\n");
+		return;
+	}
+
 	int bytes_per_row = fTarget->BytesPerRow();
 	int top = (int)rect.top;
 	int left = (int)rect.left;
 	int right = (int)rect.right;
 	int bottom = (int)rect.bottom;
-	RGBColor col(color);	// to avoid GetColor8/15/16() const issues
 
-	switch(fTarget->BitsPerPixel())
-	{
-		case 8:
-			{
-				uint8 *fb = (uint8 *)fTarget->Bits() + top*bytes_per_row;
-				uint8 color8 = col.GetColor8();
-				int x,y;
-				for (y=top; y<=bottom; y++)
-				{
-					for (x=left; x<=right; x++)
-						fb[x] = color8;
-					fb += bytes_per_row;
-				}
-			} break;
-		case 15:
-			{
-				uint16 *fb = (uint16 *)((uint8 *)fTarget->Bits() + top*bytes_per_row);
-				uint16 color15 = col.GetColor15();
-				int x,y;
-				for (y=top; y<=bottom; y++)
-				{
-					for (x=left; x<=right; x++)
-						fb[x] = color15;
-					fb = (uint16 *)((uint8 *)fb + bytes_per_row);
-				}
-			} break;
-		case 16:
-			{
-				uint16 *fb = (uint16 *)((uint8 *)fTarget->Bits() + top*bytes_per_row);
-				uint16 color16 = col.GetColor16();
-				int x,y;
-				for (y=top; y<=bottom; y++)
-				{
-					for (x=left; x<=right; x++)
-						fb[x] = color16;
-					fb = (uint16 *)((uint8 *)fb + bytes_per_row);
-				}
-			} break;
-		case 24:
-		case 32:
-			{
-				uint32 *fb = (uint32 *)((uint8 *)fTarget->Bits() + top*bytes_per_row);
-				rgb_color fill_color = color.GetColor32();
-				uint32 color32 = (fill_color.alpha << 24) | (fill_color.red << 16) | (fill_color.green << 8) | (fill_color.blue);
-				int x,y;
-				for (y=top; y<=bottom; y++)
-				{
-					for (x=left; x<=right; x++)
-						fb[x] = color32;
-					fb = (uint32 *)((uint8 *)fb + bytes_per_row);
-				}
-			} break;
-		default:
-			printf("Error: Unknown color space\n");
-	}
+	fill_job job;
+	job.dest = (uint8 *)fTarget->Bits() + top*bytes_per_row + left*pixelsize;
+	job.bpr = bytes_per_row;
+	job.width = right-left+1;
+	job.pixel = pixel_value(color,fTarget->BitsPerPixel());
+	job.pixelsize = pixelsize;
+	fTiles->Run(fill_band, &job, bottom-top+1, job.width);
 }
 
+/*!
+	\brief Fills a rectangle with the DrawData's pattern and colors
+	\param rect The rectangle, which must be inside the target
+	\param d The DrawData to draw with
+
+	B_OP_COPY is a plain pattern fill. Every other mode goes through the
+	compositor, with the pattern's rows made into source rows once for the
+	whole rectangle.
+*/
 void BitmapDriver::FillPatternRect(const BRect &rect, const DrawData *d)
 {
+	int32 pixelsize=span_pixel_size(fTarget->BitsPerPixel());
+	if(pixelsize==0)
+	{
+		printf("Error: Unknown color space\n");
+		return;
+	}
+
 	int bytes_per_row = fTarget->BytesPerRow();
 	int top = (int)rect.top;
 	int left = (int)rect.left;
 	int right = (int)rect.right;
 	int bottom = (int)rect.bottom;
-	
-	switch(fTarget->BitsPerPixel())
+	int width = right-left+1;
+	int height = bottom-top+1;
+	if(width<=0 || height<=0)
+		return;
+
+	const uint8 *pattern=(const uint8*)d->patt.GetInt8();
+	uint8 *fb = (uint8 *)fTarget->Bits() + top*bytes_per_row + left*pixelsize;
+
+	if(d->draw_mode==B_OP_COPY)
 	{
-		case 8:
-			{
-				uint8 *fb = (uint8 *)fTarget->Bits() + top*bytes_per_row;
-				int x,y;
-				for (y=top; y<=bottom; y++)
-				{
-					for (x=left; x<=right; x++)
-						fb[x] = fDrawPattern.GetColor(x,y).GetColor8();
-					fb += bytes_per_row;
-				}
-			} break;
-		case 15:
-			{
-				uint16 *fb = (uint16 *)((uint8 *)fTarget->Bits() + top*bytes_per_row);
-				int x,y;
-				for (y=top; y<=bottom; y++)
-				{
-					for (x=left; x<=right; x++)
-						fb[x] = fDrawPattern.GetColor(x,y).GetColor15();
-					fb = (uint16 *)((uint8 *)fb + bytes_per_row);
-				}
-			} break;
-		case 16:
-			{
-				uint16 *fb = (uint16 *)((uint8 *)fTarget->Bits() + top*bytes_per_row);
-				int x,y;
-				for (y=top; y<=bottom; y++)
-				{
-					for (x=left; x<=right; x++)
-						fb[x] = fDrawPattern.GetColor(x,y).GetColor16();
-					fb = (uint16 *)((uint8 *)fb + bytes_per_row);
-				}
-			} break;
-		case 24:
-		case 32:
-			{
-				uint32 *fb = (uint32 *)((uint8 *)fTarget->Bits() + top*bytes_per_row);
-				int x,y;
-				rgb_color color;
-				for (y=top; y<=bottom; y++)
-				{
-					for (x=left; x<=right; x++)
-					{
-						color = fDrawPattern.GetColor(x,y).GetColor32();
-						fb[x] = (color.alpha << 24) | (color.red << 16) | (color.green << 8) | (color.blue);
-					}
-					fb = (uint32 *)((uint8 *)fb + bytes_per_row);
-				}
-			} break;
-		default:
-			printf("Error: Unknown color space\n");
+		pattern_job job={ fb, bytes_per_row, width, pattern, left, top,
+			pixel_value(d->highcolor,fTarget->BitsPerPixel()),
+			pixel_value(d->lowcolor,fTarget->BitsPerPixel()), pixelsize };
+		fTiles->Run(pattern_band, &job, height, width);
+		return;
+	}
+
+	pattern_composite_job job;
+	job.composite=get_compositor(d->draw_mode, d->alphaSrcMode,
+		d->alphaFncMode, fTarget->BitsPerPixel());
+	if(!job.composite)
+		return;
+
+	job.dest=fb;
+	job.bpr=bytes_per_row;
+	job.width=width;
+	job.top=top;
+	job.pixelsize=pixelsize;
+	job.state.high=d->highcolor.GetColor32();
+	job.state.low=d->lowcolor.GetColor32();
+
+	int32 rows=height<8 ? height : 8;
+	int32 count=width<PATTERN_CHUNK ? width : PATTERN_CHUNK;
+	for(int32 i=0; i<rows; i++)
+	{
+		int32 row=(top+i) & 7;
+		compositor_pattern_row(job.src[row], job.high[row], count, pattern[row],
+			left, job.state.high, job.state.low);
 	}
+
+	fTiles->Run(pattern_composite_band, &job, height, width);
 }
 
+/*!
+	\brief Draws a one pixel wide line in a solid color
+	
+	The shapes DisplayDriver fills are made of horizontal lines, and each of
+	those is a single span for the renderer.
+*/
 void BitmapDriver::StrokeSolidLine(int32 x1, int32 y1, int32 x2, int32 y2, const RGBColor &color)
 {
+	if(!fPixelRenderer)
+		return;
+	
+	fPixelRenderer->SetColor(color);
+	fPixelRenderer->StrokeLine(x1,y1,x2,y2);
+	fPixelRenderer->FlushSpans();
 }
 
+//! Draws a one pixel wide line with a DrawData's pattern, colors and mode
 void BitmapDriver::StrokePatternLine(int32 x1, int32 y1, int32 x2, int32 y2, const DrawData *d)
 {
+	if(!fPixelRenderer || !d)
+		return;
+	
+	fPixelRenderer->SetDrawData(d);
+	fPixelRenderer->StrokeLine(x1,y1,x2,y2);
+	fPixelRenderer->FlushSpans();
 }
 
+//! Draws the one pixel wide outline of a rectangle in a solid color
 void BitmapDriver::StrokeSolidRect(const BRect &rect, const RGBColor &color)
 {
+	if(!fPixelRenderer)
+		return;
+	
+	int32 left=(int32)rect.left, top=(int32)rect.top;
+	int32 right=(int32)rect.right, bottom=(int32)rect.bottom;
+	
+	fPixelRenderer->SetColor(color);
+	fPixelRenderer->AddSpan(left,top,right-left+1);
+	for(int32 y=top+1; y<bottom; y++)
+	{
+		fPixelRenderer->AddSpan(left,y,1);
+		fPixelRenderer->AddSpan(right,y,1);
+	}
+	if(bottom>top)
+		fPixelRenderer->AddSpan(left,bottom,right-left+1);
+	fPixelRenderer->FlushSpans();
+}
+
+//! Fills the spans of a shape in a solid color
+void BitmapDriver::FillSolidSpans(const shape_span *spans, int32 count, const RGBColor &color)
+{
+	if(!fPixelRenderer)
+		return;
+	
+	fPixelRenderer->SetColor(color);
+	for(int32 i=0; i<count; i++)
+		fPixelRenderer->AddSpan(spans[i].left,spans[i].y,spans[i].right-spans[i].left+1,
+			spans[i].coverage);
+	fPixelRenderer->FlushSpans();
+}
+
+//! Fills the spans of a shape with a DrawData's pattern, colors and mode
+void BitmapDriver::FillPatternSpans(const shape_span *spans, int32 count, const DrawData *d)
+{
+	if(!fPixelRenderer || !d)
+		return;
+	
+	fPixelRenderer->SetDrawData(d);
+	for(int32 i=0; i<count; i++)
+		fPixelRenderer->AddSpan(spans[i].left,spans[i].y,spans[i].right-spans[i].left+1,
+			spans[i].coverage);
+	fPixelRenderer->FlushSpans();
 }
 
 
@@ -825,7 +1060,7 @@ void BitmapDriver::StrokeSolidRect(const BRect &rect, const RGBColor &color)
 	\param bitmap The ServerBitmap source of the copy
 	\param sourcerect The source rectangle of the copy
 	\param dest The destination position of the copy (no scaling occurs)
-	\param d The DrawData (currently unused)
+	\param d The DrawData. Its drawing mode is used for 32-bit bitmaps.
 */
 
 // TODO: dest should really become a BPoint to avoid confusion
@@ -910,14 +1145,18 @@ void BitmapDriver::CopyBitmap(ServerBitmap *bitmap, const BRect &sourcerect, con
 	uint32 line_length = uint32 ((destrect.right - destrect.left+1)*colorspace_size);
 	uint32 lines = uint32 (destrect.bottom-destrect.top+1);
 
-	for (uint32 pos_y=0; pos_y<lines; pos_y++)
+	if(d && d->draw_mode!=B_OP_COPY && bitmap->BitsPerPixel()==32)
 	{
-		memcpy(dest_bits,src_bits,line_length);
-
-		// Increment offsets
-		src_bits += src_width;
-		dest_bits += dest_width;
+		if(composite_rect(fTiles, dest_bits, dest_width, src_bits, src_width,
+				destrect.IntegerWidth()+1, lines, fTarget->BitsPerPixel(), d))
+			return;
 	}
+
+	if(bitmap->Bits()==fTarget->Bits())
+		rect_move(dest_bits,src_bits,dest_width,line_length,lines);
+	else
+		copy_rect(fTiles,dest_bits,dest_width,src_bits,src_width,line_length,lines,
+			colorspace_size);
 }
 
 
@@ -1003,13 +1242,7 @@ void BitmapDriver::CopyToBitmap(ServerBitmap *destbmp, const BRect &sourcerect)
 	uint32 line_length = uint32 ((destrect.right - destrect.left+1)*colorspace_size);
 	uint32 lines = uint32 (source.bottom-source.top+1);
 
-	for (uint32 pos_y=0; pos_y<lines; pos_y++)
-	{
-		memcpy(dest_bits,src_bits,line_length);
-
-		// Increment offsets
-		src_bits += src_width;
-		dest_bits += dest_width;
-	}
+	copy_rect(fTiles,dest_bits,dest_width,src_bits,src_width,line_length,lines,
+		colorspace_size);
 }
 
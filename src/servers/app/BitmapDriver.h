@@ -26,7 +26,7 @@
 //  
 //------------------------------------------------------------------------------
 #ifndef _BITMAPDRIVER_H_
-#define _BITMAPNDRIVER_H_
+#define _BITMAPDRIVER_H_
 
 #include <Application.h>
 #include <View.h>
@@ -46,6 +46,13 @@ class ServerCursor;
 class ServerBitmap;
 class RGBColor;
 class PatternHandler;
+class TileRasterizer;
+
+//! Time between presentations of a double buffered driver's damage: 60 frames a second
+#define PRESENT_INTERVAL		16667
+
+//! Damage in more rectangles than this is presented as one rectangle around all of it
+#define PRESENT_MAX_RECTS		16
 
 /*!
 	\class BitmapDriver BitmapDriver.h
@@ -71,6 +78,7 @@ public:
 
 	void SetTarget(ServerBitmap *target);
 	ServerBitmap *GetTarget(void) const { return fTarget; }
+	void SetRasterizerThreads(int32 threads);
 	
 	// Settings functions
 	virtual void DrawBitmap(ServerBitmap *bmp, const BRect &src, const BRect &dest, DrawData *d);
@@ -78,6 +86,7 @@ public:
 	virtual void SetMode(const int32 &mode);
 	virtual void SetMode(const display_mode &mode);
 	virtual void InvertRect(const BRect &rect);
+	virtual void Sync(void);
 
 protected:
 	virtual bool AcquireBuffer(FBBitmap *bmp);
@@ -89,20 +98,38 @@ protected:
 	virtual void StrokeSolidLine(int32 x1, int32 y1, int32 x2, int32 y2, const RGBColor &color);
 	virtual void StrokePatternLine(int32 x1, int32 y1, int32 x2, int32 y2, const DrawData *d);
 	virtual void StrokeSolidRect(const BRect &rect, const RGBColor &color);
+	virtual void FillSolidSpans(const shape_span *spans, int32 count, const RGBColor &color);
+	virtual void FillPatternSpans(const shape_span *spans, int32 count, const DrawData *d);
 	virtual void CopyBitmap(ServerBitmap *bitmap, const BRect &source, const BRect &dest, const DrawData *d);
 	virtual void CopyToBitmap(ServerBitmap *target, const BRect &source);
 
 	void ExtractToBitmap(ServerBitmap *destbmp, BRect destrect, BRect sourcerect);
-	rgb_color GetBlitColor(rgb_color src, rgb_color dest, DrawData *d, bool use_high=true);
 	void HLinePatternThick(int32 x1, int32 x2, int32 y);
 	void VLinePatternThick(int32 x, int32 y1, int32 y2);
 //	void FillSolidRect(int32 left, int32 top, int32 right, int32 bottom);
 //	void FillPatternRect(int32 left, int32 top, int32 right, int32 bottom);
 	void SetThickPatternPixel(int x, int y);
+
+	// For drivers which are internally double buffered: Invalidate() adds to
+	// the damage and Present() puts it on the real framebuffer, at most once
+	// a PRESENT_INTERVAL or when the driver is synced
+	void StartPresenting(bigtime_t interval=PRESENT_INTERVAL);
+	void StopPresenting(void);
+	void AddDamage(const BRect &r);
+	virtual void Present(BRegion &damage);
 	
 	ServerBitmap *fTarget;
 	GraphicsBuffer *fGraphicsBuffer;
 	PixelRenderer *fPixelRenderer;
+	TileRasterizer *fTiles;
+
+private:
+	static int32 PresentThread(void *data);
+
+	BRegion fDamage;
+	thread_id fPresentThread;
+	sem_id fPresentSem;
+	bigtime_t fPresentInterval;
 };
 
 #endif
@@ -22,62 +22,97 @@
 //	File Name:		BitmapManager.cpp
 //	Author:			DarkWyrm <bpmagic@columbus.rr.com>
 //	Description:	Handler for allocating and freeing area memory for BBitmaps 
-//					on the server side. Utilizes the BGET pool allocator.
+//					on the server side. Small bitmaps share areas by size class,
+//					large ones get an area each.
 //------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
 #include "BitmapManager.h"
 #include "ServerBitmap.h"
-#include <stdio.h>
-#include "BGet++.h"
 
 //! The bitmap allocator for the server. Memory is allocated/freed by the AppServer class
 BitmapManager *bitmapmanager=NULL;
 
-//! Number of bytes to allocate to each area used for bitmap storage
-#define BITMAP_AREA_SIZE	B_PAGE_SIZE * 2
+//! Smallest number of bytes to allocate to an area shared by small bitmaps
+#define BITMAP_SLAB_SIZE		65536
+
+//! Smallest number of bitmaps an area shared by small bitmaps holds
+#define BITMAP_SLAB_MIN_SLOTS	4
+
+// Sizes of the slots of each size class, four for each power of two
+static const size_t sClassSizes[BITMAP_SIZE_CLASSES]=
+{
+	512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096,
+	5120, 6144, 7168, 8192, 10240, 12288, 14336, 16384, 20480, 24576, 28672,
+	32768, 40960, 49152, 57344, 65536, 81920, 98304, 114688, 131072
+};
+
+// An area cut in slots of the same size
+struct bitmap_slab
+{
+	area_id area;
+	uint8 *base;
+	size_t size;
+	int32 sizeclass;
+	int32 slotcount;
+	int32 freecount;
+	int32 *freeslots;	// indices of the free slots, used as a stack
+};
+
+// The bitmap memory of a team
+struct bitmap_team
+{
+	team_id team;
+	int64 bytes;
+	int32 bitmaps;
+};
+
+static int32 size_class(size_t size)
+{
+	for(int32 i=0; i<BITMAP_SIZE_CLASSES; i++)
+		if(size<=sClassSizes[i])
+			return i;
+	return -1;
+}
+
+static size_t round_to_pages(size_t size)
+{
+	return (size + B_PAGE_SIZE - 1) / B_PAGE_SIZE * B_PAGE_SIZE;
+}
 
 //! Sets up stuff to be ready to allocate space for bitmaps
 BitmapManager::BitmapManager(void)
 {
-	fMemPool=new AreaPool;
 	bmplist=new BList(0);
 
-	// When create_area is passed the B_ANY_ADDRESS flag, the address of the area
-	// is stored in the pointer to a pointer.
-	bmparea=create_area("bitmap_area",(void**)&buffer,B_ANY_ADDRESS,BITMAP_AREA_SIZE,
-			B_NO_LOCK, B_READ_AREA | B_WRITE_AREA);
-	if(bmparea==B_BAD_VALUE ||
-	   bmparea==B_NO_MEMORY ||
-	   bmparea==B_ERROR)
-	   	printf("PANIC: BitmapManager couldn't allocate area!!\n");
-	
 	lock=create_sem(1,"bmpmanager_lock");
 	if(lock<0)
 		printf("PANIC: BitmapManager couldn't allocate locking semaphore!!\n");
-	
-	fMemPool->AddToPool(buffer,BITMAP_AREA_SIZE);
+
+	const char *limit=getenv(BITMAP_TEAM_LIMIT_VARIABLE);
+	fTeamLimit=(limit ? atol(limit) : BITMAP_TEAM_LIMIT_DEFAULT_KB) * 1024LL;
+	if(fTeamLimit<0)
+		fTeamLimit=0;
+
+	fStats.bitmaps=0;
+	fStats.areas=0;
+	fStats.used=0;
+	fStats.reserved=0;
+	fStats.failures=0;
 }
 
 //! Deallocates everything associated with the manager
 BitmapManager::~BitmapManager(void)
 {
-	if(bmplist->CountItems()>0)
-	{
-		ServerBitmap *tbmp=NULL;
-		int32 itemcount=bmplist->CountItems();
-		for(int32 i=0; i<itemcount; i++)
-		{
-			tbmp=(ServerBitmap*)bmplist->RemoveItem(0L);
-			if(tbmp)
-			{
-				fMemPool->ReleaseBuffer(tbmp->fBuffer);
-				delete tbmp;
-				tbmp=NULL;
-			}
-		}
-	}
-	delete fMemPool;
+	while(bmplist->CountItems()>0)
+		DeleteBitmap((ServerBitmap*)bmplist->ItemAt(bmplist->CountItems()-1));
+
+	ReleaseUnusedMemory();
+
+	for(int32 i=0; i<fTeams.CountItems(); i++)
+		delete (bitmap_team*)fTeams.ItemAt(i);
+
 	delete bmplist;
-	delete_area(bmparea);
 	delete_sem(lock);
 }
 
@@ -88,33 +123,67 @@ BitmapManager::~BitmapManager(void)
 	\param flags Bitmap flags as defined in Bitmap.h
 	\param bytes_per_row Number of bytes per row.
 	\param screen Screen id of the screen associated with it. Unused.
+	\param team The team whose memory the bitmap counts against, -1 for the server
 	\return A new ServerBitmap or NULL if unable to allocate one.
+
+	NULL is also returned if the bitmap would take the team over its limit.
 */
 ServerBitmap * BitmapManager::CreateBitmap(BRect bounds, color_space space, int32 flags,
-	int32 bytes_per_row, screen_id screen)
+	int32 bytes_per_row, screen_id screen, team_id team)
 {
 	acquire_sem(lock);
 	ServerBitmap *bmp=new ServerBitmap(bounds, space, flags, bytes_per_row);
-	
+
+	size_t length=bmp->BitsLength();
+	int32 sizeclass=size_class(length);
+	size_t size=(sizeclass<0) ? round_to_pages(length) : sClassSizes[sizeclass];
+
+	bitmap_team *owner=NULL;
+	if(team>=0)
+	{
+		owner=FindTeam(team,true);
+		if(fTeamLimit>0 && owner->bytes+(int64)size>fTeamLimit)
+		{
+			if(owner->bitmaps==0)
+			{
+				fTeams.RemoveItem(owner);
+				delete owner;
+			}
+			fStats.failures++;
+			delete bmp;
+			release_sem(lock);
+			return NULL;
+		}
+	}
+
 	// Server version of this code will also need to handle such things as
 	// bitmaps which accept child views by checking the flags.
-	uint8 *bmpbuffer=(uint8 *)fMemPool->GetBuffer(bmp->BitsLength());
-
-	if(!bmpbuffer)
+	bool allocated=(sizeclass<0) ? AllocateLarge(bmp,size) : AllocateSmall(bmp,sizeclass);
+	if(!allocated)
 	{
+		if(owner && owner->bitmaps==0)
+		{
+			fTeams.RemoveItem(owner);
+			delete owner;
+		}
+		fStats.failures++;
 		delete bmp;
+		release_sem(lock);
 		return NULL;
 	}
-	bmp->fArea=area_for(bmpbuffer);
-	bmp->fBuffer=bmpbuffer;
+
+	if(owner)
+	{
+		owner->bytes+=size;
+		owner->bitmaps++;
+	}
+	bmp->fTeam=team;
 	bmp->fToken=tokenizer.GetToken();
 	bmp->fInitialized=true;
-	
-	// calculate area offset
-	area_info ai;
-	get_area_info(bmp->fArea,&ai);
-	bmp->fOffset=bmpbuffer-(uint8*)ai.address;
-	
+
+	fStats.bitmaps++;
+	fStats.used+=length;
+
 	bmplist->AddItem(bmp);
 	release_sem(lock);
 	return bmp;
@@ -135,9 +204,227 @@ void BitmapManager::DeleteBitmap(ServerBitmap *bitmap)
 		return;
 	}
 
-	// Server code will require a check to ensure bitmap doesn't have its own area		
-	fMemPool->ReleaseBuffer(tbmp->fBuffer);
+	size_t length=tbmp->BitsLength();
+	size_t size;
+	bitmap_slab *slab=(bitmap_slab*)tbmp->fSlab;
+	if(slab)
+	{
+		size=sClassSizes[slab->sizeclass];
+
+		if(slab->freecount==0)
+			fPartialSlabs[slab->sizeclass].AddItem(slab);
+		slab->freeslots[slab->freecount++]=tbmp->fOffset/size;
+
+		// Keep one area around for the next bitmap of its size
+		if(slab->freecount==slab->slotcount
+			&& fPartialSlabs[slab->sizeclass].CountItems()>1)
+		{
+			fPartialSlabs[slab->sizeclass].RemoveItem(slab);
+			FreeSlab(slab);
+		}
+	}
+	else
+	{
+		size=round_to_pages(length);
+		delete_area(tbmp->fArea);
+		fStats.areas--;
+		fStats.reserved-=size;
+	}
+
+	bitmap_team *owner=FindTeam(tbmp->fTeam,false);
+	if(owner)
+	{
+		owner->bytes-=size;
+		if(--owner->bitmaps==0)
+		{
+			fTeams.RemoveItem(owner);
+			delete owner;
+		}
+	}
+
+	fStats.bitmaps--;
+	fStats.used-=length;
+
 	delete tbmp;
 
 	release_sem(lock);
 }
+
+/*!
+	\brief Gives back to the system the areas which hold no bitmap
+
+	DeleteBitmap() keeps an empty area for each size class, so that bitmaps
+	which come and go do not create and delete areas all the time.
+*/
+void BitmapManager::ReleaseUnusedMemory(void)
+{
+	acquire_sem(lock);
+	for(int32 i=0; i<BITMAP_SIZE_CLASSES; i++)
+	{
+		for(int32 j=fPartialSlabs[i].CountItems()-1; j>=0; j--)
+		{
+			bitmap_slab *slab=(bitmap_slab*)fPartialSlabs[i].ItemAt(j);
+			if(slab->freecount==slab->slotcount)
+			{
+				fPartialSlabs[i].RemoveItem(j);
+				FreeSlab(slab);
+			}
+		}
+	}
+	release_sem(lock);
+}
+
+/*!
+	\brief Sets how much bitmap memory each team may use
+	\param bytes The limit, 0 for none
+
+	Bitmaps a team has already are not affected.
+*/
+void BitmapManager::SetTeamLimit(int64 bytes)
+{
+	acquire_sem(lock);
+	fTeamLimit=(bytes>0) ? bytes : 0;
+	release_sem(lock);
+}
+
+/*!
+	\brief Returns how much bitmap memory a team uses
+	\param team The team
+	\return The bytes of the slots and areas its bitmaps take
+*/
+int64 BitmapManager::TeamUsage(team_id team)
+{
+	acquire_sem(lock);
+	bitmap_team *owner=FindTeam(team,false);
+	int64 bytes=owner ? owner->bytes : 0;
+	release_sem(lock);
+	return bytes;
+}
+
+//! Returns how much memory the manager holds and how much of it is used
+void BitmapManager::GetStats(bitmap_manager_stats *stats)
+{
+	if(!stats)
+		return;
+
+	acquire_sem(lock);
+	*stats=fStats;
+	release_sem(lock);
+}
+
+/*!
+	\brief Gives a bitmap a slot in an area shared with bitmaps of its size
+	\param bitmap The bitmap
+	\param sizeclass The size class it belongs to
+	\return false if no area could be created
+*/
+bool BitmapManager::AllocateSmall(ServerBitmap *bitmap, int32 sizeclass)
+{
+	BList *partial=&fPartialSlabs[sizeclass];
+	bitmap_slab *slab=(bitmap_slab*)partial->LastItem();
+
+	if(!slab)
+	{
+		size_t slotsize=sClassSizes[sizeclass];
+		size_t size=BITMAP_SLAB_SIZE;
+		if(size<slotsize*BITMAP_SLAB_MIN_SLOTS)
+			size=round_to_pages(slotsize*BITMAP_SLAB_MIN_SLOTS);
+
+		uint8 *base=NULL;
+		area_id area=create_area("bitmap_area",(void**)&base,B_ANY_ADDRESS,size,
+			B_NO_LOCK, B_READ_AREA | B_WRITE_AREA);
+		if(area<0)
+			return false;
+
+		slab=new bitmap_slab;
+		slab->area=area;
+		slab->base=base;
+		slab->size=size;
+		slab->sizeclass=sizeclass;
+		slab->slotcount=size/slotsize;
+		slab->freecount=slab->slotcount;
+		slab->freeslots=new int32[slab->slotcount];
+
+		// hand out the slots from the start of the area
+		for(int32 i=0; i<slab->slotcount; i++)
+			slab->freeslots[i]=slab->slotcount-1-i;
+
+		partial->AddItem(slab);
+		fStats.areas++;
+		fStats.reserved+=size;
+	}
+
+	int32 slot=slab->freeslots[--slab->freecount];
+	if(slab->freecount==0)
+		partial->RemoveItem(partial->CountItems()-1);
+
+	bitmap->fArea=slab->area;
+	bitmap->fOffset=slot*sClassSizes[sizeclass];
+	bitmap->fBuffer=slab->base+bitmap->fOffset;
+	bitmap->fSlab=slab;
+	return true;
+}
+
+/*!
+	\brief Gives a bitmap an area of its own
+	\param bitmap The bitmap
+	\param size The size of the area, a multiple of B_PAGE_SIZE
+	\return false if the area could not be created
+*/
+bool BitmapManager::AllocateLarge(ServerBitmap *bitmap, size_t size)
+{
+	uint8 *base=NULL;
+	area_id area=create_area("bitmap_area",(void**)&base,B_ANY_ADDRESS,size,
+		B_NO_LOCK, B_READ_AREA | B_WRITE_AREA);
+	if(area<0)
+		return false;
+
+	bitmap->fArea=area;
+	bitmap->fOffset=0;
+	bitmap->fBuffer=base;
+	bitmap->fSlab=NULL;
+
+	fStats.areas++;
+	fStats.reserved+=size;
+	return true;
+}
+
+//! Deletes the area of a slab which holds no bitmap anymore
+void BitmapManager::FreeSlab(bitmap_slab *slab)
+{
+	delete_area(slab->area);
+	fStats.areas--;
+	fStats.reserved-=slab->size;
+
+	delete [] slab->freeslots;
+	delete slab;
+}
+
+/*!
+	\brief Looks up the bitmap memory of a team
+	\param team The team
+	\param create true to start counting for the team if it was not yet
+	\return The team's record, or NULL if there is none and create is false
+*/
+bitmap_team *BitmapManager::FindTeam(team_id team, bool create)
+{
+	if(team<0)
+		return NULL;
+
+	for(int32 i=0; i<fTeams.CountItems(); i++)
+	{
+		bitmap_team *item=(bitmap_team*)fTeams.ItemAt(i);
+		if(item->team==team)
+			return item;
+	}
+
+	if(!create)
+		return NULL;
+
+	bitmap_team *item=new bitmap_team;
+	item->team=team;
+	item->bytes=0;
+	item->bitmaps=0;
+	fTeams.AddItem(item);
+	return item;
+}
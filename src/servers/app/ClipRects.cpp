@@ -0,0 +1,151 @@
+//------------------------------------------------------------------------------
+//
+//	File Name:		ClipRects.cpp
+//	Description:	The rectangles of a clipping region which meet a shape,
+//					with a quick lookup of those on a row
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <math.h>
+#include "ClipRects.h"
+
+// Up to this many rectangles are simply all looked at
+static const int32 kLinearRects = 8;
+
+ClipRects::ClipRects(void)
+ :	fRects(NULL), fReach(NULL), fCount(0), fSize(0),
+ 	fRowTop(1), fRowBottom(0), fRowFirst(0), fRowEnd(0)
+{
+}
+
+ClipRects::~ClipRects(void)
+{
+	free(fRects);
+	free(fReach);
+}
+
+/*!
+	\brief Keeps the rectangles of a region which meet a shape
+	\param clip The clipping region
+	\param bounds Rectangle the whole shape is in, rounded out to whole pixels
+*/
+void ClipRects::Set(const BRegion *clip, const BRect &bounds)
+{
+	clipping_rect rect;
+	rect.left=(int32)floor(bounds.left);
+	rect.top=(int32)floor(bounds.top);
+	rect.right=(int32)ceil(bounds.right);
+	rect.bottom=(int32)ceil(bounds.bottom);
+	Set(clip,rect);
+}
+
+void ClipRects::Set(const BRegion *clip, const clipping_rect &bounds)
+{
+	fBounds=bounds;
+	fCount=0;
+	fRowTop=1;
+	fRowBottom=0;
+
+	BRegion *region=const_cast<BRegion*>(clip);
+	int32 count=region->CountRects();
+
+	// the usual case of a window nothing covers
+	if(count==1)
+	{
+		clipping_rect rect=region->RectAtInt(0);
+		if(rect.right<bounds.left || rect.left>bounds.right
+			|| rect.bottom<bounds.top || rect.top>bounds.bottom)
+			return;
+		if(fSize==0 && !Grow())
+			return;
+		fRects[0]=rect;
+		fReach[0]=rect.bottom;
+		fCount=1;
+		return;
+	}
+
+	clipping_rect frame=region->FrameInt();
+	if(frame.right<bounds.left || frame.left>bounds.right
+		|| frame.bottom<bounds.top || frame.top>bounds.bottom)
+		return;
+
+	for(int32 i=0; i<count; i++)
+	{
+		clipping_rect rect=region->RectAtInt(i);
+
+		// rectangles are in order by their tops, so nothing further down can
+		// meet the shape
+		if(rect.top>bounds.bottom)
+			break;
+		if(rect.right<bounds.left || rect.left>bounds.right
+			|| rect.bottom<bounds.top || rect.top>bounds.bottom)
+			continue;
+
+		if(fCount==fSize && !Grow())
+			return;
+
+		fRects[fCount]=rect;
+		if(fCount>0 && fReach[fCount-1]>rect.bottom)
+			fReach[fCount]=fReach[fCount-1];
+		else
+			fReach[fCount]=rect.bottom;
+		fCount++;
+	}
+}
+
+//! Returns a rectangle of the list in the region's coordinates
+BRect ClipRects::RectAt(int32 index) const
+{
+	const clipping_rect &rect=fRects[index];
+	return BRect(rect.left,rect.top,rect.right,rect.bottom);
+}
+
+int32 ClipRects::Search(int32 top, int32 bottom, int32 *first) const
+{
+	*first=0;
+	if(fCount<=kLinearRects)
+		return fCount;
+
+	// past the last rectangle which starts on or above the bottom row...
+	int32 low=0, high=fCount;
+	while(low<high)
+	{
+		int32 middle=(low+high)/2;
+		if(fRects[middle].top>bottom)
+			high=middle;
+		else
+			low=middle+1;
+	}
+	int32 end=low;
+
+	// ...from the first one by which they reach down to the top row
+	low=0;
+	high=end;
+	while(low<high)
+	{
+		int32 middle=(low+high)/2;
+		if(fReach[middle]<top)
+			low=middle+1;
+		else
+			high=middle;
+	}
+	*first=low;
+	return end;
+}
+
+bool ClipRects::Grow(void)
+{
+	int32 size=fSize ? fSize*2 : 16;
+	clipping_rect *rects=(clipping_rect*)realloc(fRects,size*sizeof(clipping_rect));
+	if(!rects)
+		return false;
+	fRects=rects;
+
+	int32 *reach=(int32*)realloc(fReach,size*sizeof(int32));
+	if(!reach)
+		return false;
+	fReach=reach;
+
+	fSize=size;
+	return true;
+}
@@ -0,0 +1,840 @@
+//------------------------------------------------------------------------------
+//	File Name:		Compositor.cpp
+//	Description:	Span functions which apply a drawing mode to a row of
+//					pixels, one for each mode and depth
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+#include <ColorUtils.h>
+
+#include "Compositor.h"
+#include "SpanKernels.h"
+#include "SystemPalette.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define COMPOSITOR_X86
+#include <immintrin.h>
+#endif
+
+/*
+	Each drawing mode is a struct with an Apply() function which works on one
+	pixel, and each depth is a struct which reads and writes one pixel. The
+	span functions are the composite_span() template instantiated for every
+	pair of them, so the compiler inlines both into one loop and there is no
+	switch left per pixel. Modes which don't look at the destination say so in
+	kReadsDest, and never pay for reading it.
+*/
+
+//! A pixel with 8 bits per channel, whatever the depth it came from
+struct pixel_color
+{
+	uint8 red;
+	uint8 green;
+	uint8 blue;
+	uint8 alpha;
+};
+
+static inline void to_pixel(pixel_color &p, const rgb_color &c)
+{
+	p.red=c.red;
+	p.green=c.green;
+	p.blue=c.blue;
+	p.alpha=c.alpha;
+}
+
+//! Reads a source pixel, which is always B_RGBA32
+static inline void read_source(const uint8 *src, pixel_color &c)
+{
+	c.blue=src[0];
+	c.green=src[1];
+	c.red=src[2];
+	c.alpha=src[3];
+}
+
+/*!
+	\brief Mixes two channel values
+	\param s Source value
+	\param d Destination value
+	\param a Weight of the source, 0 to 255
+
+	This is s*a/255 + d*(255-a)/255, correctly rounded. The SSE2 functions
+	below use the same arithmetic, so they give the same bits.
+*/
+static inline uint8 mix(int s, int d, int a)
+{
+	int t=s*a + d*(255-a) + 128;
+	return (t + (t>>8)) >> 8;
+}
+
+//------------------------------------------------------------------------------
+// Depths
+
+//! B_RGB32 and B_RGBA32, stored blue, green, red, alpha
+struct space_32
+{
+	enum { kSize=4 };
+
+	static inline void Read(const uint8 *p, pixel_color &c)
+	{
+		c.blue=p[0];
+		c.green=p[1];
+		c.red=p[2];
+		c.alpha=p[3];
+	}
+
+	static inline void Write(uint8 *p, const pixel_color &c)
+	{
+		p[0]=c.blue;
+		p[1]=c.green;
+		p[2]=c.red;
+		p[3]=c.alpha;
+	}
+
+	//! The color without its alpha, for telling colors apart
+	static inline uint32 Key(const uint8 *p)
+	{
+		return p[0] | (p[1]<<8) | (p[2]<<16);
+	}
+};
+
+//! B_RGB16, 5:6:5. There is no alpha, so it reads as opaque.
+struct space_16
+{
+	enum { kSize=2 };
+
+	static inline void Read(const uint8 *p, pixel_color &c)
+	{
+		uint16 v;
+		memcpy(&v,p,2);
+		uint8 r=v>>11, g=(v>>5) & 0x3f, b=v & 0x1f;
+		c.red=(r<<3) | (r>>2);
+		c.green=(g<<2) | (g>>4);
+		c.blue=(b<<3) | (b>>2);
+		c.alpha=255;
+	}
+
+	// Rounded the same way as FindClosestColor16()
+	static inline void Write(uint8 *p, const pixel_color &c)
+	{
+		uint16 v=((c.red*31/255)<<11) | ((c.green*63/255)<<5) | (c.blue*31/255);
+		memcpy(p,&v,2);
+	}
+
+	static inline uint32 Key(const uint8 *p)
+	{
+		uint16 v;
+		memcpy(&v,p,2);
+		return v;
+	}
+};
+
+//! B_RGB15 and B_RGBA15, 1:5:5:5. The alpha bit is written, but reads as opaque.
+struct space_15
+{
+	enum { kSize=2 };
+
+	static inline void Read(const uint8 *p, pixel_color &c)
+	{
+		uint16 v;
+		memcpy(&v,p,2);
+		uint8 r=(v>>10) & 0x1f, g=(v>>5) & 0x1f, b=v & 0x1f;
+		c.red=(r<<3) | (r>>2);
+		c.green=(g<<3) | (g>>2);
+		c.blue=(b<<3) | (b>>2);
+		c.alpha=255;
+	}
+
+	// Rounded the same way as FindClosestColor15()
+	static inline void Write(uint8 *p, const pixel_color &c)
+	{
+		uint16 v=((c.red*31/255)<<10) | ((c.green*31/255)<<5) | (c.blue*31/255);
+		if(c.alpha>127)
+			v|=0x8000;
+		memcpy(p,&v,2);
+	}
+
+	static inline uint32 Key(const uint8 *p)
+	{
+		uint16 v;
+		memcpy(&v,p,2);
+		return v & 0x7fff;
+	}
+};
+
+/*!
+	\brief Closest system palette index for every 15-bit color
+
+	Searching the palette for each pixel would cost more than the rest of the
+	mode together, so the search is done once for the whole 15-bit color cube.
+*/
+static uint8 *inverse_palette=NULL;
+
+static void make_inverse_palette(void)
+{
+	if(inverse_palette)
+		return;
+
+	uint8 *table=(uint8*)malloc(32768);
+	if(!table)
+		return;
+
+	rgb_color c;
+	c.alpha=255;
+	for(int32 i=0; i<32768; i++)
+	{
+		uint8 r=(i>>10) & 0x1f, g=(i>>5) & 0x1f, b=i & 0x1f;
+		c.red=(r<<3) | (r>>2);
+		c.green=(g<<3) | (g>>2);
+		c.blue=(b<<3) | (b>>2);
+		table[i]=FindClosestColor(system_palette,c);
+	}
+	inverse_palette=table;
+}
+
+//! B_CMAP8 in the system palette
+struct space_8
+{
+	enum { kSize=1 };
+
+	static inline void Read(const uint8 *p, pixel_color &c)
+	{
+		to_pixel(c,system_palette[*p]);
+	}
+
+	static inline void Write(uint8 *p, const pixel_color &c)
+	{
+		*p=inverse_palette[((c.red>>3)<<10) | ((c.green>>3)<<5) | (c.blue>>3)];
+	}
+
+	static inline uint32 Key(const uint8 *p)
+	{
+		return *p;
+	}
+};
+
+//------------------------------------------------------------------------------
+// Drawing modes. Apply() changes dest and returns true if it is to be written.
+
+struct mode_copy
+{
+	enum { kReadsDest=0 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		d=s;
+		return true;
+	}
+};
+
+//! Only the high color is drawn, and only where it is mostly opaque
+struct mode_over
+{
+	enum { kReadsDest=0 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		if(!high || s.alpha<128)
+			return false;
+		d=s;
+		return true;
+	}
+};
+
+//! Where B_OP_OVER would draw the high color, the low color is drawn
+struct mode_erase
+{
+	enum { kReadsDest=0 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		if(!high || s.alpha<128)
+			return false;
+		to_pixel(d,state->low);
+		return true;
+	}
+};
+
+struct mode_invert
+{
+	enum { kReadsDest=1 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		if(!high || s.alpha<128)
+			return false;
+		d.red=255-d.red;
+		d.green=255-d.green;
+		d.blue=255-d.blue;
+		return true;
+	}
+};
+
+struct mode_add
+{
+	enum { kReadsDest=1 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		int r=d.red+s.red, g=d.green+s.green, b=d.blue+s.blue;
+		d.red=r>255 ? 255 : r;
+		d.green=g>255 ? 255 : g;
+		d.blue=b>255 ? 255 : b;
+		return true;
+	}
+};
+
+//! The source is taken from the destination, not the other way around
+struct mode_subtract
+{
+	enum { kReadsDest=1 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		int r=d.red-s.red, g=d.green-s.green, b=d.blue-s.blue;
+		d.red=r<0 ? 0 : r;
+		d.green=g<0 ? 0 : g;
+		d.blue=b<0 ? 0 : b;
+		return true;
+	}
+};
+
+struct mode_blend
+{
+	enum { kReadsDest=1 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		d.red=(d.red+s.red)>>1;
+		d.green=(d.green+s.green)>>1;
+		d.blue=(d.blue+s.blue)>>1;
+		return true;
+	}
+};
+
+//! The darker of the two, going by the sum of the channels
+struct mode_min
+{
+	enum { kReadsDest=1 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		if(s.red+s.green+s.blue >= d.red+d.green+d.blue)
+			return false;
+		d=s;
+		return true;
+	}
+};
+
+//! The lighter of the two, going by the sum of the channels
+struct mode_max
+{
+	enum { kReadsDest=1 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		if(s.red+s.green+s.blue <= d.red+d.green+d.blue)
+			return false;
+		d=s;
+		return true;
+	}
+};
+
+/*!
+	\brief B_OP_ALPHA with B_ALPHA_OVERLAY
+
+	The source is laid over the destination with the source's alpha, or with
+	the high color's if constant is true. The destination keeps its own alpha.
+*/
+template<bool constant>
+struct mode_alpha_overlay
+{
+	enum { kReadsDest=1 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		int a=constant ? state->high.alpha : s.alpha;
+		if(a==0)
+			return false;
+		d.red=mix(s.red,d.red,a);
+		d.green=mix(s.green,d.green,a);
+		d.blue=mix(s.blue,d.blue,a);
+		return true;
+	}
+};
+
+/*!
+	\brief B_OP_ALPHA with B_ALPHA_COMPOSITE
+
+	Like B_ALPHA_OVERLAY, but the destination's alpha is taken into account
+	and the result's alpha is what both together cover, so that drawing into
+	a transparent bitmap gives the same picture as drawing onto the screen
+	does once the bitmap is drawn there.
+*/
+template<bool constant>
+struct mode_alpha_composite
+{
+	enum { kReadsDest=1 };
+	static inline bool Apply(pixel_color &d, const pixel_color &s, bool high,
+		const compositor_state *state)
+	{
+		int a=constant ? state->high.alpha : s.alpha;
+		if(a==0)
+			return false;
+		if(a==255 || d.alpha==0)
+		{
+			d.red=s.red;
+			d.green=s.green;
+			d.blue=s.blue;
+			d.alpha=a;
+			return true;
+		}
+
+		// What shows of the destination, and what both cover
+		int below=(d.alpha*(255-a) + 127)/255;
+		int total=a+below;
+		d.red=(s.red*a + d.red*below + total/2)/total;
+		d.green=(s.green*a + d.green*below + total/2)/total;
+		d.blue=(s.blue*a + d.blue*below + total/2)/total;
+		d.alpha=total;
+		return true;
+	}
+};
+
+//------------------------------------------------------------------------------
+// Span functions
+
+template<class Space, class Mode>
+static void composite_span(uint8 *dest, const uint8 *src, const uint8 *high,
+	int32 count, const compositor_state *state)
+{
+	pixel_color s, d;
+	for(int32 i=0; i<count; i++, dest+=Space::kSize, src+=4)
+	{
+		read_source(src,s);
+		if(Mode::kReadsDest)
+			Space::Read(dest,d);
+		if(Mode::Apply(d,s,high ? high[i]!=0 : true,state))
+			Space::Write(dest,d);
+	}
+}
+
+/*!
+	\brief B_OP_SELECT: where the destination is the high color, the low one is
+	drawn, and the other way around
+
+	The colors are compared as they are stored, so it works at every depth.
+	The source only matters as the pattern.
+*/
+template<class Space>
+static void select_span(uint8 *dest, const uint8 *src, const uint8 *high,
+	int32 count, const compositor_state *state)
+{
+	pixel_color highcolor, lowcolor;
+	to_pixel(highcolor,state->high);
+	to_pixel(lowcolor,state->low);
+
+	uint8 stored[4];
+	Space::Write(stored,highcolor);
+	uint32 highkey=Space::Key(stored);
+	Space::Write(stored,lowcolor);
+	uint32 lowkey=Space::Key(stored);
+
+	for(int32 i=0; i<count; i++, dest+=Space::kSize)
+	{
+		if(high && !high[i])
+			continue;
+
+		uint32 key=Space::Key(dest);
+		if(key==highkey)
+			Space::Write(dest,lowcolor);
+		else if(key==lowkey)
+			Space::Write(dest,highcolor);
+	}
+}
+
+//! At 32 bits the source is already in the target's format
+static void copy_32(uint8 *dest, const uint8 *src, const uint8 *high,
+	int32 count, const compositor_state *state)
+{
+	span_copy(dest,src,count*4);
+}
+
+#ifdef COMPOSITOR_X86
+
+//! mix() for the 16-bit channels of two pixels
+__attribute__((target("sse2")))
+static inline __m128i mix_sse2(__m128i s, __m128i d, __m128i a)
+{
+	__m128i t=_mm_add_epi16(_mm_mullo_epi16(s,a),
+		_mm_mullo_epi16(d,_mm_sub_epi16(_mm_set1_epi16(255),a)));
+	t=_mm_add_epi16(t,_mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t,_mm_srli_epi16(t,8)),8);
+}
+
+/*!
+	\brief B_ALPHA_OVERLAY onto 32 bits, four pixels at a time
+	\param constant The high color's alpha, or -1 to use the source's
+*/
+__attribute__((target("sse2")))
+static void alpha_overlay_sse2(uint8 *dest, const uint8 *src, int32 count,
+	int constant)
+{
+	const __m128i zero=_mm_setzero_si128();
+	const __m128i alphamask=_mm_set1_epi32((int)0xff000000);
+	const __m128i fixed=_mm_set1_epi16(constant);
+
+	int32 i=0;
+	for(; i+4<=count; i+=4, src+=16, dest+=16)
+	{
+		__m128i s=_mm_loadu_si128((const __m128i*)src);
+		__m128i alphas=_mm_and_si128(s,alphamask);
+
+		__m128i a0, a1;
+		if(constant<0)
+		{
+			// Nothing to do where the source is transparent, and where it is
+			// opaque it just replaces the destination's color
+			if(_mm_movemask_epi8(_mm_cmpeq_epi32(alphas,zero))==0xffff)
+				continue;
+			if(_mm_movemask_epi8(_mm_cmpeq_epi32(alphas,alphamask))==0xffff)
+			{
+				__m128i d=_mm_loadu_si128((const __m128i*)dest);
+				_mm_storeu_si128((__m128i*)dest,
+					_mm_or_si128(_mm_andnot_si128(alphamask,s),
+						_mm_and_si128(alphamask,d)));
+				continue;
+			}
+		}
+
+		__m128i d=_mm_loadu_si128((const __m128i*)dest);
+		__m128i s0=_mm_unpacklo_epi8(s,zero), s1=_mm_unpackhi_epi8(s,zero);
+		__m128i d0=_mm_unpacklo_epi8(d,zero), d1=_mm_unpackhi_epi8(d,zero);
+		if(constant<0)
+		{
+			a0=_mm_shufflehi_epi16(_mm_shufflelo_epi16(s0,0xff),0xff);
+			a1=_mm_shufflehi_epi16(_mm_shufflelo_epi16(s1,0xff),0xff);
+		}
+		else
+			a0=a1=fixed;
+
+		__m128i r=_mm_packus_epi16(mix_sse2(s0,d0,a0),mix_sse2(s1,d1,a1));
+		_mm_storeu_si128((__m128i*)dest,_mm_or_si128(_mm_andnot_si128(alphamask,r),
+			_mm_and_si128(alphamask,d)));
+	}
+
+	compositor_state state;
+	state.high.alpha=constant<0 ? 0 : constant;
+	if(constant<0)
+		composite_span<space_32, mode_alpha_overlay<false> >(dest,src,NULL,count-i,&state);
+	else
+		composite_span<space_32, mode_alpha_overlay<true> >(dest,src,NULL,count-i,&state);
+}
+
+__attribute__((target("sse2")))
+static void alpha_overlay_pixel_sse2(uint8 *dest, const uint8 *src,
+	const uint8 *high, int32 count, const compositor_state *state)
+{
+	alpha_overlay_sse2(dest,src,count,-1);
+}
+
+__attribute__((target("sse2")))
+static void alpha_overlay_constant_sse2(uint8 *dest, const uint8 *src,
+	const uint8 *high, int32 count, const compositor_state *state)
+{
+	if(state->high.alpha!=0)
+		alpha_overlay_sse2(dest,src,count,state->high.alpha);
+}
+
+/*!
+	\brief B_OP_OVER onto 32 bits, four pixels at a time
+
+	The top bit of a pixel's alpha is whether it is drawn, so shifting it
+	across the pixel gives the mask to select with.
+*/
+__attribute__((target("sse2")))
+static void over_sse2(uint8 *dest, const uint8 *src, const uint8 *high,
+	int32 count, const compositor_state *state)
+{
+	if(high)
+	{
+		composite_span<space_32, mode_over>(dest,src,high,count,state);
+		return;
+	}
+
+	int32 i=0;
+	for(; i+4<=count; i+=4, src+=16, dest+=16)
+	{
+		__m128i s=_mm_loadu_si128((const __m128i*)src);
+		__m128i mask=_mm_srai_epi32(s,31);
+		int drawn=_mm_movemask_epi8(mask);
+		if(drawn==0)
+			continue;
+		if(drawn==0xffff)
+		{
+			_mm_storeu_si128((__m128i*)dest,s);
+			continue;
+		}
+		__m128i d=_mm_loadu_si128((const __m128i*)dest);
+		_mm_storeu_si128((__m128i*)dest,_mm_or_si128(_mm_and_si128(mask,s),
+			_mm_andnot_si128(mask,d)));
+	}
+	composite_span<space_32, mode_over>(dest,src,NULL,count-i,state);
+}
+
+enum sse2_op
+{
+	SSE2_INVERT,
+	SSE2_ERASE,
+	SSE2_ADD,
+	SSE2_SUBTRACT,
+	SSE2_BLEND
+};
+
+/*!
+	\brief The modes which work on each channel by itself, onto 32 bits, four
+	pixels at a time
+
+	Every caller passes a constant op, so once this is inlined only that op's
+	code is left in the loop. Patterns, which have a high mask, are left to
+	composite_span().
+*/
+__attribute__((target("sse2"), always_inline))
+static inline void channel_op_sse2(uint8 *dest, const uint8 *src,
+	const uint8 *high, int32 count, const compositor_state *state, sse2_op op)
+{
+	int32 i=0;
+	if(!high)
+	{
+		const __m128i alphamask=_mm_set1_epi32((int)0xff000000);
+		const __m128i ones=_mm_set1_epi8(1);
+		const __m128i low=_mm_set1_epi32((int)((state->low.alpha<<24) |
+			(state->low.red<<16) | (state->low.green<<8) | state->low.blue));
+
+		for(; i+4<=count; i+=4, src+=16, dest+=16)
+		{
+			__m128i s=_mm_loadu_si128((const __m128i*)src);
+			__m128i d=_mm_loadu_si128((const __m128i*)dest);
+			__m128i color=_mm_andnot_si128(alphamask,s);
+			__m128i r;
+			switch(op)
+			{
+				case SSE2_INVERT:
+					r=_mm_xor_si128(d,_mm_andnot_si128(alphamask,
+						_mm_srai_epi32(s,31)));
+					break;
+				case SSE2_ERASE:
+				{
+					__m128i mask=_mm_srai_epi32(s,31);
+					r=_mm_or_si128(_mm_and_si128(mask,low),
+						_mm_andnot_si128(mask,d));
+					break;
+				}
+				case SSE2_ADD:
+					r=_mm_adds_epu8(d,color);
+					break;
+				case SSE2_SUBTRACT:
+					r=_mm_subs_epu8(d,color);
+					break;
+				default:
+				{
+					// _mm_avg_epu8() rounds up where mode_blend rounds down
+					__m128i avg=_mm_sub_epi8(_mm_avg_epu8(d,s),
+						_mm_and_si128(_mm_xor_si128(d,s),ones));
+					r=_mm_or_si128(_mm_andnot_si128(alphamask,avg),
+						_mm_and_si128(alphamask,d));
+					break;
+				}
+			}
+			_mm_storeu_si128((__m128i*)dest,r);
+		}
+	}
+
+	switch(op)
+	{
+		case SSE2_INVERT:
+			composite_span<space_32, mode_invert>(dest,src,high,count-i,state);
+			break;
+		case SSE2_ERASE:
+			composite_span<space_32, mode_erase>(dest,src,high,count-i,state);
+			break;
+		case SSE2_ADD:
+			composite_span<space_32, mode_add>(dest,src,high,count-i,state);
+			break;
+		case SSE2_SUBTRACT:
+			composite_span<space_32, mode_subtract>(dest,src,high,count-i,state);
+			break;
+		default:
+			composite_span<space_32, mode_blend>(dest,src,high,count-i,state);
+			break;
+	}
+}
+
+__attribute__((target("sse2")))
+static void invert_sse2(uint8 *dest, const uint8 *src, const uint8 *high,
+	int32 count, const compositor_state *state)
+{
+	channel_op_sse2(dest,src,high,count,state,SSE2_INVERT);
+}
+
+__attribute__((target("sse2")))
+static void erase_sse2(uint8 *dest, const uint8 *src, const uint8 *high,
+	int32 count, const compositor_state *state)
+{
+	channel_op_sse2(dest,src,high,count,state,SSE2_ERASE);
+}
+
+__attribute__((target("sse2")))
+static void add_sse2(uint8 *dest, const uint8 *src, const uint8 *high,
+	int32 count, const compositor_state *state)
+{
+	channel_op_sse2(dest,src,high,count,state,SSE2_ADD);
+}
+
+__attribute__((target("sse2")))
+static void subtract_sse2(uint8 *dest, const uint8 *src, const uint8 *high,
+	int32 count, const compositor_state *state)
+{
+	channel_op_sse2(dest,src,high,count,state,SSE2_SUBTRACT);
+}
+
+__attribute__((target("sse2")))
+static void blend_sse2(uint8 *dest, const uint8 *src, const uint8 *high,
+	int32 count, const compositor_state *state)
+{
+	channel_op_sse2(dest,src,high,count,state,SSE2_BLEND);
+}
+
+#endif	// COMPOSITOR_X86
+
+template<class Space>
+static compositor_func pick_compositor(drawing_mode mode, source_alpha alphasrc,
+	alpha_function alphafunc)
+{
+	switch(mode)
+	{
+		case B_OP_OVER:
+			return composite_span<Space, mode_over>;
+		case B_OP_ERASE:
+			return composite_span<Space, mode_erase>;
+		case B_OP_INVERT:
+			return composite_span<Space, mode_invert>;
+		case B_OP_ADD:
+			return composite_span<Space, mode_add>;
+		case B_OP_SUBTRACT:
+			return composite_span<Space, mode_subtract>;
+		case B_OP_BLEND:
+			return composite_span<Space, mode_blend>;
+		case B_OP_MIN:
+			return composite_span<Space, mode_min>;
+		case B_OP_MAX:
+			return composite_span<Space, mode_max>;
+		case B_OP_SELECT:
+			return select_span<Space>;
+		case B_OP_ALPHA:
+		{
+			bool constant=(alphasrc==B_CONSTANT_ALPHA);
+			if(alphafunc==B_ALPHA_COMPOSITE)
+			{
+				return constant ? composite_span<Space, mode_alpha_composite<true> >
+					: composite_span<Space, mode_alpha_composite<false> >;
+			}
+			return constant ? composite_span<Space, mode_alpha_overlay<true> >
+				: composite_span<Space, mode_alpha_overlay<false> >;
+		}
+		default:	// B_OP_COPY
+			return composite_span<Space, mode_copy>;
+	}
+}
+
+/*!
+	\brief Returns the span function for a drawing mode at a depth
+	\param mode The drawing mode
+	\param alphasrc Where B_OP_ALPHA takes its alpha from
+	\param alphafunc How B_OP_ALPHA treats the destination's alpha
+	\param bitsperpixel Depth of the target, as ServerBitmap::BitsPerPixel()
+	gives it
+	\return The function, or NULL if the depth isn't handled
+
+	Where the span kernels run with SSE2 or better, the modes which work on
+	each pixel by itself get functions which do four pixels at a time at 32
+	bits. B_OP_MIN, B_OP_MAX, B_OP_SELECT and B_ALPHA_COMPOSITE compare or
+	divide per pixel and stay scalar.
+*/
+compositor_func get_compositor(drawing_mode mode, source_alpha alphasrc,
+	alpha_function alphafunc, int32 bitsperpixel)
+{
+	switch(bitsperpixel)
+	{
+		case 32:
+		{
+			if(mode==B_OP_COPY)
+				return copy_32;
+#ifdef COMPOSITOR_X86
+			if(span_get_kernel_level()>=SPAN_KERNEL_SSE2)
+			{
+				switch(mode)
+				{
+					case B_OP_OVER:
+						return over_sse2;
+					case B_OP_INVERT:
+						return invert_sse2;
+					case B_OP_ERASE:
+						return erase_sse2;
+					case B_OP_ADD:
+						return add_sse2;
+					case B_OP_SUBTRACT:
+						return subtract_sse2;
+					case B_OP_BLEND:
+						return blend_sse2;
+					default:
+						break;
+				}
+				if(mode==B_OP_ALPHA && alphafunc!=B_ALPHA_COMPOSITE)
+				{
+					return alphasrc==B_CONSTANT_ALPHA ? alpha_overlay_constant_sse2
+						: alpha_overlay_pixel_sse2;
+				}
+			}
+#endif
+			return pick_compositor<space_32>(mode,alphasrc,alphafunc);
+		}
+		case 16:
+			return pick_compositor<space_16>(mode,alphasrc,alphafunc);
+		case 15:
+			return pick_compositor<space_15>(mode,alphasrc,alphafunc);
+		case 8:
+			make_inverse_palette();
+			if(!inverse_palette)
+				return NULL;
+			return pick_compositor<space_8>(mode,alphasrc,alphafunc);
+		default:
+			return NULL;
+	}
+}
+
+/*!
+	\brief Makes a source row for a compositor out of a pattern row
+	\param src Where to put count B_RGBA32 pixels
+	\param high Where to put count bytes marking the high color pixels. May be NULL.
+	\param count Number of pixels
+	\param patternrow The row of the 8x8 pattern, high bit leftmost
+	\param phase Pattern column of the first pixel
+	\param highcolor The high color
+	\param lowcolor The low color
+*/
+void compositor_pattern_row(uint8 *src, uint8 *high, int32 count,
+	uint8 patternrow, int32 phase, rgb_color highcolor, rgb_color lowcolor)
+{
+	for(int32 i=0; i<count; i++, src+=4)
+	{
+		bool ishigh=patternrow & (0x80 >> ((phase+i) & 7));
+		const rgb_color &c=ishigh ? highcolor : lowcolor;
+		src[0]=c.blue;
+		src[1]=c.green;
+		src[2]=c.red;
+		src[3]=c.alpha;
+		if(high)
+			high[i]=ishigh;
+	}
+}
@@ -0,0 +1,1156 @@
+//------------------------------------------------------------------------------
+//
+//	File Name:		CoverageRasterizer.cpp
+//	Description:	Anti-aliased scanline rasterizer for paths, and the
+//					flattening and stroking which turn lines, shapes and
+//					Bézier curves into paths it can fill
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "CoverageRasterizer.h"
+
+// Subpixels per pixel along each axis, as a shift
+static const int32 kSubpixelShift=8;
+static const int32 kSubpixelScale=1<<kSubpixelShift;
+static const int32 kSubpixelMask=kSubpixelScale-1;
+
+// Lines longer than this are cut in two so the products of RenderLine()
+// don't overflow
+static const int32 kMaxLineWidth=16384<<kSubpixelShift;
+
+// How far from the origin an unclipped path may go, in pixels
+static const double kMaxCoord=32767;
+
+// How far off a curve may be from the lines it is drawn with, in pixels
+static const double kFlatness=0.1;
+static const double kRoundTolerance=0.125;
+
+static const int32 kNoCell=0x7fffffff;
+
+// The ops of a BShape's op list, as BShape stores them
+#define OP_LINETO		0x10000000
+#define OP_BEZIERTO		0x20000000
+#define OP_CLOSE		0x40000000
+#define OP_MOVETO		0x80000000
+
+static inline int32 to_subpixels(double value)
+{
+	return (int32)floor(value*kSubpixelScale+.5);
+}
+
+static bool grow_array(void **array, int32 *size, int32 itemSize, int32 initial)
+{
+	int32 newSize=*size ? *size*2 : initial;
+	void *items=realloc(*array,newSize*itemSize);
+	if(!items)
+		return false;
+
+	*array=items;
+	*size=newSize;
+	return true;
+}
+
+CoverageRasterizer::CoverageRasterizer(void)
+ :	fCells(NULL), fCellCount(0), fCellSize(0),
+	fSorted(NULL), fSortedSize(0), fRows(NULL), fRowSize(0),
+	fFillRule(FILL_NONZERO), fAntialias(true), fBounds(0,0,-1,-1),
+	fSpans(NULL), fSpanCount(0), fSpanSize(0),
+	fCoverage(NULL), fCoverageCount(0), fCoverageSize(0)
+{
+	Reset();
+}
+
+CoverageRasterizer::~CoverageRasterizer(void)
+{
+	free(fCells);
+	free(fSorted);
+	free(fRows);
+	free(fSpans);
+	free(fCoverage);
+}
+
+/*!
+	\brief Starts a new path
+	\param clip Pixels outside this rectangle are never drawn. The path
+	can go anywhere, but nothing outside is worked out.
+*/
+void CoverageRasterizer::Reset(const BRect &clip)
+{
+	Reset();
+	fClipLeft=floor(clip.left);
+	fClipTop=floor(clip.top);
+	fClipRight=floor(clip.right)+1;
+	fClipBottom=floor(clip.bottom)+1;
+}
+
+//! Starts a new path which is only clipped to the largest area it can cover
+void CoverageRasterizer::Reset(void)
+{
+	fCellCount=0;
+	fCell.x=kNoCell;
+	fCell.y=kNoCell;
+	fCell.cover=0;
+	fCell.area=0;
+
+	fClipLeft=-kMaxCoord;
+	fClipTop=-kMaxCoord;
+	fClipRight=kMaxCoord;
+	fClipBottom=kMaxCoord;
+
+	fStartX=fStartY=fLastX=fLastY=0;
+	fOpen=false;
+}
+
+//! Starts a subpath, closing the one before
+void CoverageRasterizer::MoveTo(const BPoint &pt)
+{
+	ClosePath();
+
+	// pixels are a unit square from their top left corner from here on
+	fStartX=fLastX=pt.x+.5;
+	fStartY=fLastY=pt.y+.5;
+	fOpen=true;
+}
+
+//! Adds a line from the end of the subpath to pt
+void CoverageRasterizer::LineTo(const BPoint &pt)
+{
+	if(!fOpen)
+	{
+		MoveTo(pt);
+		return;
+	}
+
+	double x=pt.x+.5, y=pt.y+.5;
+	ClipLine(fLastX,fLastY,x,y);
+	fLastX=x;
+	fLastY=y;
+}
+
+//! Adds a line back to where the subpath started
+void CoverageRasterizer::ClosePath(void)
+{
+	if(!fOpen)
+		return;
+
+	ClipLine(fLastX,fLastY,fStartX,fStartY);
+	fOpen=false;
+}
+
+/*!
+	\brief Adds a closed polygon
+	\param orient Turn the polygon around if it winds the other way from
+	the ones before, so they all add up under FILL_NONZERO. Polygons with
+	no area are left out.
+*/
+void CoverageRasterizer::AddPolygon(const BPoint *points, int32 count, bool orient)
+{
+	if(!points || count<3)
+		return;
+
+	if(orient)
+	{
+		double area=0;
+		for(int32 i=0; i<count; i++)
+		{
+			const BPoint &a=points[i], &b=points[(i+1)%count];
+			area+=(double)a.x*b.y-(double)b.x*a.y;
+		}
+		if(area==0)
+			return;
+
+		if(area<0)
+		{
+			MoveTo(points[count-1]);
+			for(int32 i=count-2; i>=0; i--)
+				LineTo(points[i]);
+			ClosePath();
+			return;
+		}
+	}
+
+	MoveTo(points[0]);
+	for(int32 i=1; i<count; i++)
+		LineTo(points[i]);
+	ClosePath();
+}
+
+/*
+	Rows above and below the clipping box are left out. Parts of a line
+	left or right of it are moved onto its sides, where they still add to
+	the coverage of the pixels right of them.
+*/
+void CoverageRasterizer::ClipLine(double x1, double y1, double x2, double y2)
+{
+	if(y1==y2)
+		return;
+	if((y1<=fClipTop && y2<=fClipTop) || (y1>=fClipBottom && y2>=fClipBottom))
+		return;
+
+	double dx=x2-x1, dy=y2-y1;
+	double t1=(fClipTop-y1)/dy, t2=(fClipBottom-y1)/dy;
+	if(t1>t2)
+	{
+		double t=t1;
+		t1=t2;
+		t2=t;
+	}
+	if(t1<0)
+		t1=0;
+	if(t2>1)
+		t2=1;
+	if(t1>=t2)
+		return;
+
+	// where the line crosses the sides
+	double cuts[4];
+	int32 count=0;
+	cuts[count++]=t1;
+	if(dx!=0)
+	{
+		double left=(fClipLeft-x1)/dx, right=(fClipRight-x1)/dx;
+		if(left>right)
+		{
+			double t=left;
+			left=right;
+			right=t;
+		}
+		if(left>t1 && left<t2)
+			cuts[count++]=left;
+		if(right>t1 && right<t2)
+			cuts[count++]=right;
+	}
+	cuts[count++]=t2;
+
+	int32 lastX=0, lastY=0;
+	for(int32 i=0; i<count; i++)
+	{
+		double x=x1+dx*cuts[i], y=y1+dy*cuts[i];
+		if(cuts[i]==0)
+			x=x1, y=y1;
+		else if(cuts[i]==1)
+			x=x2, y=y2;
+
+		if(x<fClipLeft)
+			x=fClipLeft;
+		else if(x>fClipRight)
+			x=fClipRight;
+		if(y<fClipTop)
+			y=fClipTop;
+		else if(y>fClipBottom)
+			y=fClipBottom;
+
+		int32 sx=to_subpixels(x), sy=to_subpixels(y);
+		if(i>0)
+			RenderLine(lastX,lastY,sx,sy);
+		lastX=sx;
+		lastY=sy;
+	}
+}
+
+void CoverageRasterizer::SetCell(int32 x, int32 y)
+{
+	if(x==fCell.x && y==fCell.y)
+		return;
+
+	FlushCell();
+	fCell.x=x;
+	fCell.y=y;
+	fCell.cover=0;
+	fCell.area=0;
+}
+
+void CoverageRasterizer::FlushCell(void)
+{
+	if(!(fCell.cover | fCell.area))
+		return;
+
+	if(fCellCount==fCellSize
+		&& !grow_array((void**)&fCells,&fCellSize,sizeof(cell),1024))
+		return;
+
+	fCells[fCellCount++]=fCell;
+	fCell.cover=0;
+	fCell.area=0;
+}
+
+/*
+	A cell's cover is how far up or down the edges in it go, and its area
+	twice the area they leave to their right, signed the same way, in
+	subpixels. A line is cut into pieces one row high and each of those
+	into pieces one pixel wide.
+*/
+void CoverageRasterizer::RenderHLine(int32 ey, int32 x1, int32 y1, int32 x2, int32 y2)
+{
+	int32 ex1=x1>>kSubpixelShift, ex2=x2>>kSubpixelShift;
+	int32 fx1=x1 & kSubpixelMask, fx2=x2 & kSubpixelMask;
+
+	if(y1==y2)
+	{
+		SetCell(ex2,ey);
+		return;
+	}
+
+	if(ex1==ex2)
+	{
+		int32 delta=y2-y1;
+		fCell.cover+=delta;
+		fCell.area+=(fx1+fx2)*delta;
+		return;
+	}
+
+	// several cells on the row
+	int32 p=(kSubpixelScale-fx1)*(y2-y1);
+	int32 first=kSubpixelScale;
+	int32 incr=1;
+	int32 dx=x2-x1;
+	if(dx<0)
+	{
+		p=fx1*(y2-y1);
+		first=0;
+		incr=-1;
+		dx=-dx;
+	}
+
+	int32 delta=p/dx, mod=p%dx;
+	if(mod<0)
+	{
+		delta--;
+		mod+=dx;
+	}
+
+	fCell.cover+=delta;
+	fCell.area+=(fx1+first)*delta;
+
+	ex1+=incr;
+	SetCell(ex1,ey);
+	y1+=delta;
+
+	if(ex1!=ex2)
+	{
+		p=kSubpixelScale*(y2-y1+delta);
+		int32 lift=p/dx, rem=p%dx;
+		if(rem<0)
+		{
+			lift--;
+			rem+=dx;
+		}
+		mod-=dx;
+
+		while(ex1!=ex2)
+		{
+			delta=lift;
+			mod+=rem;
+			if(mod>=0)
+			{
+				mod-=dx;
+				delta++;
+			}
+
+			fCell.cover+=delta;
+			fCell.area+=kSubpixelScale*delta;
+			y1+=delta;
+			ex1+=incr;
+			SetCell(ex1,ey);
+		}
+	}
+
+	delta=y2-y1;
+	fCell.cover+=delta;
+	fCell.area+=(fx2+kSubpixelScale-first)*delta;
+}
+
+void CoverageRasterizer::RenderLine(int32 x1, int32 y1, int32 x2, int32 y2)
+{
+	int32 dx=x2-x1;
+	if(dx>=kMaxLineWidth || dx<=-kMaxLineWidth)
+	{
+		int32 cx=(x1+x2)>>1, cy=(y1+y2)>>1;
+		RenderLine(x1,y1,cx,cy);
+		RenderLine(cx,cy,x2,y2);
+		return;
+	}
+
+	int32 dy=y2-y1;
+	int32 ex1=x1>>kSubpixelShift;
+	int32 ey1=y1>>kSubpixelShift, ey2=y2>>kSubpixelShift;
+	int32 fy1=y1 & kSubpixelMask, fy2=y2 & kSubpixelMask;
+
+	SetCell(ex1,ey1);
+
+	// all on one row
+	if(ey1==ey2)
+	{
+		RenderHLine(ey1,x1,fy1,x2,fy2);
+		return;
+	}
+
+	int32 incr=1;
+
+	// a vertical line stays in one column
+	if(dx==0)
+	{
+		int32 twoFx=(x1-(ex1<<kSubpixelShift))<<1;
+		int32 first=kSubpixelScale;
+		if(dy<0)
+		{
+			first=0;
+			incr=-1;
+		}
+
+		int32 delta=first-fy1;
+		fCell.cover+=delta;
+		fCell.area+=twoFx*delta;
+
+		ey1+=incr;
+		SetCell(ex1,ey1);
+
+		delta=first+first-kSubpixelScale;
+		int32 area=twoFx*delta;
+		while(ey1!=ey2)
+		{
+			fCell.cover+=delta;
+			fCell.area+=area;
+			ey1+=incr;
+			SetCell(ex1,ey1);
+		}
+
+		delta=fy2-kSubpixelScale+first;
+		fCell.cover+=delta;
+		fCell.area+=twoFx*delta;
+		return;
+	}
+
+	// one piece of the line per row
+	int32 p=(kSubpixelScale-fy1)*dx;
+	int32 first=kSubpixelScale;
+	if(dy<0)
+	{
+		p=fy1*dx;
+		first=0;
+		incr=-1;
+		dy=-dy;
+	}
+
+	int32 delta=p/dy, mod=p%dy;
+	if(mod<0)
+	{
+		delta--;
+		mod+=dy;
+	}
+
+	int32 xFrom=x1+delta;
+	RenderHLine(ey1,x1,fy1,xFrom,first);
+
+	ey1+=incr;
+	SetCell(xFrom>>kSubpixelShift,ey1);
+
+	if(ey1!=ey2)
+	{
+		p=kSubpixelScale*dx;
+		int32 lift=p/dy, rem=p%dy;
+		if(rem<0)
+		{
+			lift--;
+			rem+=dy;
+		}
+		mod-=dy;
+
+		while(ey1!=ey2)
+		{
+			delta=lift;
+			mod+=rem;
+			if(mod>=0)
+			{
+				mod-=dy;
+				delta++;
+			}
+
+			int32 xTo=xFrom+delta;
+			RenderHLine(ey1,xFrom,kSubpixelScale-first,xTo,first);
+			xFrom=xTo;
+
+			ey1+=incr;
+			SetCell(xFrom>>kSubpixelShift,ey1);
+		}
+	}
+
+	RenderHLine(ey1,xFrom,kSubpixelScale-first,x2,fy2);
+}
+
+static int compare_cells(const void *a, const void *b)
+{
+	return *(const int32*)a - *(const int32*)b;
+}
+
+// Puts the cells in rows from the top, each from the left
+bool CoverageRasterizer::SortCells(void)
+{
+	FlushCell();
+	if(fCellCount==0)
+		return false;
+
+	int32 top=fCells[0].y, bottom=top;
+	for(int32 i=1; i<fCellCount; i++)
+	{
+		if(fCells[i].y<top)
+			top=fCells[i].y;
+		else if(fCells[i].y>bottom)
+			bottom=fCells[i].y;
+	}
+
+	int32 rows=bottom-top+1;
+	while(fRowSize<rows+1)
+	{
+		if(!grow_array((void**)&fRows,&fRowSize,sizeof(int32),256))
+			return false;
+	}
+	while(fSortedSize<fCellCount)
+	{
+		if(!grow_array((void**)&fSorted,&fSortedSize,sizeof(cell),1024))
+			return false;
+	}
+
+	// fRows[row] becomes where the row starts in fSorted
+	memset(fRows,0,(rows+1)*sizeof(int32));
+	for(int32 i=0; i<fCellCount; i++)
+		fRows[fCells[i].y-top+1]++;
+	for(int32 i=1; i<=rows; i++)
+		fRows[i]+=fRows[i-1];
+	for(int32 i=0; i<fCellCount; i++)
+		fSorted[fRows[fCells[i].y-top]++]=fCells[i];
+	for(int32 i=rows; i>0; i--)
+		fRows[i]=fRows[i-1];
+	fRows[0]=0;
+
+	for(int32 row=0; row<rows; row++)
+	{
+		cell *cells=fSorted+fRows[row];
+		int32 count=fRows[row+1]-fRows[row];
+		if(count>16)
+		{
+			qsort(cells,count,sizeof(cell),compare_cells);
+			continue;
+		}
+
+		for(int32 i=1; i<count; i++)
+		{
+			cell c=cells[i];
+			int32 j=i;
+			for(; j>0 && cells[j-1].x>c.x; j--)
+				cells[j]=cells[j-1];
+			cells[j]=c;
+		}
+	}
+	fBounds.top=top;
+	fBounds.bottom=bottom;
+	return true;
+}
+
+// Coverage from 0 to 255 of a pixel from twice the area it has inside
+int32 CoverageRasterizer::Alpha(int32 area) const
+{
+	int32 cover=area>>(kSubpixelShift+1);
+	if(cover<0)
+		cover=-cover;
+
+	if(fFillRule==FILL_EVEN_ODD)
+	{
+		cover&=2*kSubpixelScale-1;
+		if(cover>kSubpixelScale)
+			cover=2*kSubpixelScale-cover;
+	}
+
+	// a whole pixel is kSubpixelScale
+	cover=(cover*255+kSubpixelScale/2)>>kSubpixelShift;
+	if(cover>255)
+		cover=255;
+
+	if(!fAntialias)
+		return cover>=128 ? 255 : 0;
+	return cover;
+}
+
+// Pixels with the same coverage
+void CoverageRasterizer::AddRun(int32 y, int32 left, int32 right, int32 alpha)
+{
+	coverage_span *last=fSpanCount ? fSpans+fSpanCount-1 : NULL;
+	bool joins=last && last->y==y && last->right==left-1;
+
+	if(alpha==255)
+	{
+		if(joins && last->offset<0)
+		{
+			last->right=right;
+			return;
+		}
+	}
+	else
+	{
+		int32 length=right-left+1;
+		while(fCoverageCount+length>fCoverageSize)
+		{
+			if(!grow_array((void**)&fCoverage,&fCoverageSize,1,4096))
+				return;
+		}
+		memset(fCoverage+fCoverageCount,alpha,length);
+		fCoverageCount+=length;
+
+		if(joins && last->offset>=0)
+		{
+			last->right=right;
+			return;
+		}
+	}
+
+	if(fSpanCount==fSpanSize
+		&& !grow_array((void**)&fSpans,&fSpanSize,sizeof(coverage_span),256))
+		return;
+
+	coverage_span &span=fSpans[fSpanCount++];
+	span.y=y;
+	span.left=left;
+	span.right=right;
+	span.offset=alpha==255 ? -1 : fCoverageCount-(right-left+1);
+}
+
+void CoverageRasterizer::AddPixel(int32 y, int32 x, int32 alpha)
+{
+	AddRun(y,x,x,alpha);
+}
+
+/*!
+	\brief Turns the path into spans and starts a new one
+	\param spans The list to put the spans in. It is reset first.
+	\param clip Region to cut the spans to, or NULL
+
+	Spans of partly covered pixels point to coverage kept by the
+	rasterizer, which stays valid until it renders again.
+*/
+void CoverageRasterizer::Render(SpanList &spans, BRegion *clip)
+{
+	ClosePath();
+
+	fSpanCount=0;
+	fCoverageCount=0;
+	fBounds.Set(0,0,-1,-1);
+
+	if(!SortCells())
+	{
+		spans.Reset(clip,fBounds);
+		Reset();
+		return;
+	}
+
+	int32 top=(int32)fBounds.top, rows=(int32)fBounds.bottom-top+1;
+	for(int32 row=0; row<rows; row++)
+	{
+		const cell *cells=fSorted+fRows[row];
+		int32 count=fRows[row+1]-fRows[row];
+		int32 y=top+row;
+
+		int32 cover=0;
+		int32 i=0;
+		while(i<count)
+		{
+			int32 x=cells[i].x;
+			int32 area=cells[i].area;
+			cover+=cells[i].cover;
+
+			// all the cells of a pixel
+			for(i++; i<count && cells[i].x==x; i++)
+			{
+				area+=cells[i].area;
+				cover+=cells[i].cover;
+			}
+
+			if(area)
+			{
+				int32 alpha=Alpha((cover<<(kSubpixelShift+1))-area);
+				if(alpha)
+					AddPixel(y,x,alpha);
+				x++;
+			}
+
+			// up to the next cell everything is covered as much
+			if(i<count && cells[i].x>x)
+			{
+				int32 alpha=Alpha(cover<<(kSubpixelShift+1));
+				if(alpha)
+					AddRun(y,x,cells[i].x-1,alpha);
+			}
+		}
+	}
+
+	if(fSpanCount)
+	{
+		int32 left=fSpans[0].left, right=fSpans[0].right;
+		for(int32 i=1; i<fSpanCount; i++)
+		{
+			if(fSpans[i].left<left)
+				left=fSpans[i].left;
+			if(fSpans[i].right>right)
+				right=fSpans[i].right;
+		}
+		fBounds.Set(left,fSpans[0].y,right,fSpans[fSpanCount-1].y);
+	}
+	else
+		fBounds.Set(0,0,-1,-1);
+
+	// the coverage has stopped moving, so spans can point into it
+	spans.Reset(clip,fBounds);
+	for(int32 i=0; i<fSpanCount; i++)
+	{
+		const coverage_span &span=fSpans[i];
+		spans.Add(span.y,span.left,span.right,
+			span.offset<0 ? NULL : fCoverage+span.offset);
+	}
+
+	Reset();
+}
+
+PathBuilder::PathBuilder(void)
+ :	fPoints(NULL), fPointCount(0), fPointSize(0),
+	fPaths(NULL), fPathCount(0), fPathSize(0)
+{
+}
+
+PathBuilder::~PathBuilder(void)
+{
+	free(fPoints);
+	free(fPaths);
+}
+
+void PathBuilder::Reset(void)
+{
+	fPointCount=0;
+	fPathCount=0;
+}
+
+//! Starts a subpath
+void PathBuilder::MoveTo(const BPoint &pt)
+{
+	// a subpath which is just a point goes
+	if(fPathCount && fPaths[fPathCount-1].count<2)
+	{
+		fPointCount=fPaths[fPathCount-1].start;
+		fPathCount--;
+	}
+
+	if(fPathCount==fPathSize
+		&& !grow_array((void**)&fPaths,&fPathSize,sizeof(subpath),16))
+		return;
+
+	subpath &path=fPaths[fPathCount++];
+	path.start=fPointCount;
+	path.count=0;
+	path.closed=false;
+	AddPoint(pt);
+}
+
+//! Adds a line. After a closed subpath it starts one where that one did.
+void PathBuilder::LineTo(const BPoint &pt)
+{
+	if(fPathCount==0)
+	{
+		MoveTo(pt);
+		return;
+	}
+	if(fPaths[fPathCount-1].closed)
+		MoveTo(fPoints[fPaths[fPathCount-1].start]);
+
+	AddPoint(pt);
+}
+
+/*!
+	\brief Adds a cubic Bézier curve
+	\param points The two control points and the end point. The curve
+	starts where the subpath ends.
+
+	The lines a curve is cut into stray from it at most an eighth of the
+	second derivative's largest size, divided by their number squared.
+*/
+void PathBuilder::BezierTo(const BPoint *points)
+{
+	if(fPathCount==0)
+		MoveTo(points[0]);
+	else if(fPaths[fPathCount-1].closed)
+		MoveTo(fPoints[fPaths[fPathCount-1].start]);
+
+	BPoint p0=fPoints[fPointCount-1], p1=points[0], p2=points[1], p3=points[2];
+
+	double ax=p0.x-2*p1.x+p2.x, ay=p0.y-2*p1.y+p2.y;
+	double bx=p1.x-2*p2.x+p3.x, by=p1.y-2*p2.y+p3.y;
+	double a=sqrt(ax*ax+ay*ay), b=sqrt(bx*bx+by*by);
+	double bend=a>b ? a : b;
+
+	int32 steps=(int32)ceil(sqrt(.75*bend/kFlatness));
+	if(steps<1)
+		steps=1;
+	else if(steps>1000)
+		steps=1000;
+
+	for(int32 i=1; i<steps; i++)
+	{
+		double t=(double)i/steps, s=1-t;
+		double c0=s*s*s, c1=3*s*s*t, c2=3*s*t*t, c3=t*t*t;
+		AddPoint(BPoint(c0*p0.x+c1*p1.x+c2*p2.x+c3*p3.x,
+			c0*p0.y+c1*p1.y+c2*p2.y+c3*p3.y));
+	}
+	AddPoint(p3);
+}
+
+//! Closes the subpath
+void PathBuilder::Close(void)
+{
+	if(fPathCount)
+		fPaths[fPathCount-1].closed=true;
+}
+
+/*!
+	\brief Adds the contents of a BShape
+	\return B_BAD_VALUE if the ops need more points than there are
+*/
+status_t PathBuilder::AddShape(int32 opcount, const int32 *oplist, int32 ptcount,
+	const BPoint *ptlist)
+{
+	if(opcount<0 || ptcount<0 || (opcount && !oplist) || (ptcount && !ptlist))
+		return B_BAD_VALUE;
+
+	const BPoint *pt=ptlist, *end=ptlist+ptcount;
+	for(int32 i=0; i<opcount; i++)
+	{
+		uint32 op=(uint32)oplist[i];
+		int32 count=op & 0x00FFFFFF;
+
+		if((op & OP_CLOSE) && !(op & (OP_LINETO | OP_BEZIERTO | OP_MOVETO)))
+		{
+			Close();
+			continue;
+		}
+
+		if(op & OP_MOVETO)
+		{
+			if(pt>=end)
+				return B_BAD_VALUE;
+			MoveTo(*pt++);
+		}
+
+		if(op & OP_LINETO)
+		{
+			if(count>end-pt)
+				return B_BAD_VALUE;
+			for(int32 j=0; j<count; j++)
+				LineTo(*pt++);
+		}
+		else if(op & OP_BEZIERTO)
+		{
+			if(count>end-pt || count%3)
+				return B_BAD_VALUE;
+			for(int32 j=0; j<count; j+=3, pt+=3)
+				BezierTo(pt);
+		}
+	}
+	return B_OK;
+}
+
+/*!
+	\brief Returns a subpath
+	\param index Which one, from 0
+	\param count Set to the number of points in it
+	\param closed Set to whether it goes back to its first point
+*/
+const BPoint *PathBuilder::PathAt(int32 index, int32 *count, bool *closed) const
+{
+	if(index<0 || index>=fPathCount)
+		return NULL;
+
+	*count=fPaths[index].count;
+	*closed=fPaths[index].closed;
+	return fPoints+fPaths[index].start;
+}
+
+//! Adds every subpath to a rasterizer, to be filled
+void PathBuilder::Fill(CoverageRasterizer &rasterizer) const
+{
+	for(int32 i=0; i<fPathCount; i++)
+	{
+		const subpath &path=fPaths[i];
+		if(path.count<3)
+			continue;
+
+		rasterizer.MoveTo(fPoints[path.start]);
+		for(int32 j=1; j<path.count; j++)
+			rasterizer.LineTo(fPoints[path.start+j]);
+		rasterizer.ClosePath();
+	}
+}
+
+bool PathBuilder::AddPoint(const BPoint &pt)
+{
+	if(fPointCount==fPointSize
+		&& !grow_array((void**)&fPoints,&fPointSize,sizeof(BPoint),64))
+		return false;
+
+	fPoints[fPointCount++]=pt;
+	fPaths[fPathCount-1].count++;
+	return true;
+}
+
+/*!
+	\brief Sets up a stroker
+	\param pensize Width of the pen
+	\param miterLimit Longest a miter may be, in pen widths
+*/
+PathStroker::PathStroker(CoverageRasterizer &rasterizer, float pensize,
+	cap_mode cap, join_mode join, float miterLimit)
+ :	fRasterizer(rasterizer), fHalfWidth(pensize/2), fCap(cap), fJoin(join),
+	fMiterLimit(miterLimit), fVertices(NULL), fVertexSize(0)
+{
+	// enough steps around a circle that none is too far inside it
+	double step=fHalfWidth>kRoundTolerance ? acos(1-kRoundTolerance/fHalfWidth) : M_PI;
+	fCircleSteps=(int32)ceil(M_PI/step);
+	if(fCircleSteps<8)
+		fCircleSteps=8;
+	else if(fCircleSteps>256)
+		fCircleSteps=256;
+}
+
+PathStroker::~PathStroker(void)
+{
+	free(fVertices);
+}
+
+static inline bool same_point(const BPoint &a, const BPoint &b)
+{
+	return fabs(a.x-b.x)<1e-4 && fabs(a.y-b.y)<1e-4;
+}
+
+/*!
+	\brief Strokes a polyline
+	\param closed Join the last point to the first instead of capping both
+*/
+void PathStroker::Stroke(const BPoint *points, int32 count, bool closed)
+{
+	if(!points || count<1 || fHalfWidth<=0)
+		return;
+
+	while(fVertexSize<count)
+	{
+		if(!grow_array((void**)&fVertices,&fVertexSize,sizeof(BPoint),64))
+			return;
+	}
+
+	// segments with no length have no direction
+	int32 n=0;
+	for(int32 i=0; i<count; i++)
+	{
+		if(n==0 || !same_point(points[i],fVertices[n-1]))
+			fVertices[n++]=points[i];
+	}
+	if(closed && n>1 && same_point(fVertices[n-1],fVertices[0]))
+		n--;
+
+	const BPoint *v=fVertices;
+	if(n==1)
+	{
+		// a dot is round with a round cap and square otherwise
+		if(fCap==B_ROUND_CAP)
+			AddCircle(v[0]);
+		else
+		{
+			float h=fHalfWidth;
+			BPoint square[4]={ BPoint(v[0].x-h,v[0].y-h), BPoint(v[0].x+h,v[0].y-h),
+				BPoint(v[0].x+h,v[0].y+h), BPoint(v[0].x-h,v[0].y+h) };
+			fRasterizer.AddPolygon(square,4,true);
+		}
+		return;
+	}
+	if(n==2)
+		closed=false;
+
+	int32 segments=closed ? n : n-1;
+	for(int32 i=0; i<segments; i++)
+		AddSegment(v[i],v[(i+1)%n]);
+
+	if(closed)
+	{
+		for(int32 i=0; i<n; i++)
+			AddJoin(v[i],v[(i+n-1)%n],v[(i+1)%n]);
+		return;
+	}
+
+	for(int32 i=1; i<n-1; i++)
+		AddJoin(v[i],v[i-1],v[i+1]);
+	AddCap(v[0],v[0]-v[1]);
+	AddCap(v[n-1],v[n-1]-v[n-2]);
+}
+
+//! Strokes every subpath of a path
+void PathStroker::Stroke(const PathBuilder &path)
+{
+	for(int32 i=0; i<path.CountPaths(); i++)
+	{
+		int32 count;
+		bool closed;
+		const BPoint *points=path.PathAt(i,&count,&closed);
+		if(count>1)
+			Stroke(points,count,closed);
+	}
+}
+
+static inline void unit_vector(const BPoint &from, const BPoint &to, double *x, double *y)
+{
+	double dx=to.x-from.x, dy=to.y-from.y;
+	double length=sqrt(dx*dx+dy*dy);
+	*x=dx/length;
+	*y=dy/length;
+}
+
+// The pen's whole width along one segment
+void PathStroker::AddSegment(const BPoint &from, const BPoint &to)
+{
+	double dx, dy;
+	unit_vector(from,to,&dx,&dy);
+	float nx=-dy*fHalfWidth, ny=dx*fHalfWidth;
+
+	BPoint quad[4]={ BPoint(from.x+nx,from.y+ny), BPoint(to.x+nx,to.y+ny),
+		BPoint(to.x-nx,to.y-ny), BPoint(from.x-nx,from.y-ny) };
+	fRasterizer.AddPolygon(quad,4,true);
+}
+
+/*
+	Segments meeting at an angle leave a wedge on the outside of the turn
+	between their ends. A bevel join fills it with a triangle, a round one
+	with an arc, a miter one by carrying the outer edges on until they meet
+	and a square one by carrying them on half the pen width. Butt joins
+	leave it empty.
+*/
+void PathStroker::AddJoin(const BPoint &pt, const BPoint &in, const BPoint &out)
+{
+	if(fJoin==B_BUTT_JOIN)
+		return;
+
+	double d1x, d1y, d2x, d2y;
+	unit_vector(in,pt,&d1x,&d1y);
+	unit_vector(pt,out,&d2x,&d2y);
+
+	double cross=d1x*d2y-d1y*d2x, dot=d1x*d2x+d1y*d2y;
+	if(fabs(cross)<1e-9 && dot>0)
+		return;
+
+	// the normals on the outside of the turn
+	double side=cross>0 ? -1 : 1;
+	double o1x=-d1y*side, o1y=d1x*side;
+	double o2x=-d2y*side, o2y=d2x*side;
+	double h=fHalfWidth;
+	BPoint a(pt.x+o1x*h,pt.y+o1y*h), b(pt.x+o2x*h,pt.y+o2y*h);
+
+	switch(fJoin)
+	{
+		case B_ROUND_JOIN:
+		{
+			double angle=acos(dot>1 ? 1 : (dot<-1 ? -1 : dot));
+			if(o1x*d1y-o1y*d1x<0)
+				angle=-angle;
+			AddFan(pt,BPoint(o1x,o1y),angle);
+			return;
+		}
+		case B_MITER_JOIN:
+		{
+			if(1+dot>1e-9 && sqrt(2/(1+dot))<=fMiterLimit)
+			{
+				double scale=h/(1+dot);
+				BPoint miter[4]={ pt, a,
+					BPoint(pt.x+(o1x+o2x)*scale,pt.y+(o1y+o2y)*scale), b };
+				fRasterizer.AddPolygon(miter,4,true);
+				return;
+			}
+			break;
+		}
+		case B_SQUARE_JOIN:
+		{
+			BPoint square[5]={ pt, a, BPoint(a.x+d1x*h,a.y+d1y*h),
+				BPoint(b.x-d2x*h,b.y-d2y*h), b };
+			fRasterizer.AddPolygon(square,5,true);
+			return;
+		}
+		default:
+			break;
+	}
+
+	BPoint bevel[3]={ pt, a, b };
+	fRasterizer.AddPolygon(bevel,3,true);
+}
+
+//! Adds the cap at an end of an open polyline, dir pointing out of it
+void PathStroker::AddCap(const BPoint &pt, const BPoint &dir)
+{
+	double dx, dy;
+	unit_vector(BPoint(0,0),dir,&dx,&dy);
+	double nx=-dy, ny=dx, h=fHalfWidth;
+
+	if(fCap==B_ROUND_CAP)
+	{
+		// from one side around the end to the other
+		AddFan(pt,BPoint(nx,ny),nx*dy-ny*dx<0 ? -M_PI : M_PI);
+		return;
+	}
+
+	if(fCap==B_SQUARE_CAP)
+	{
+		BPoint square[4]={ BPoint(pt.x+nx*h,pt.y+ny*h),
+			BPoint(pt.x+(nx+dx)*h,pt.y+(ny+dy)*h),
+			BPoint(pt.x+(dx-nx)*h,pt.y+(dy-ny)*h),
+			BPoint(pt.x-nx*h,pt.y-ny*h) };
+		fRasterizer.AddPolygon(square,4,true);
+	}
+}
+
+/*
+	Polygons inside a circle are smaller than it. Their points are moved out
+	so each step has the area of the slice of circle it stands for.
+*/
+static inline double area_scale(double step)
+{
+	step=fabs(step);
+	return step>1e-6 ? sqrt(step/sin(step)) : 1;
+}
+
+/*!
+	\brief Adds a slice of the pen's circle
+	\param from Unit vector from the center to where the slice starts
+	\param angle How far it goes from there, counterclockwise if positive
+	in a coordinate system whose y axis goes up
+*/
+void PathStroker::AddFan(const BPoint &center, const BPoint &from, double angle)
+{
+	int32 steps=(int32)ceil(fabs(angle)/(2*M_PI)*fCircleSteps);
+	if(steps<1)
+		steps=1;
+
+	BPoint fan[258];
+	double h=fHalfWidth*area_scale(angle/steps);
+	fan[0]=center;
+	for(int32 i=0; i<=steps; i++)
+	{
+		double a=angle*i/steps;
+		double c=cos(a), s=sin(a);
+		fan[i+1].Set(center.x+(from.x*c-from.y*s)*h,center.y+(from.x*s+from.y*c)*h);
+	}
+	fRasterizer.AddPolygon(fan,steps+2,true);
+}
+
+void PathStroker::AddCircle(const BPoint &center)
+{
+	BPoint circle[256];
+	double h=fHalfWidth*area_scale(2*M_PI/fCircleSteps);
+	for(int32 i=0; i<fCircleSteps; i++)
+	{
+		double a=2*M_PI*i/fCircleSteps;
+		circle[i].Set(center.x+cos(a)*h,center.y+sin(a)*h);
+	}
+	fRasterizer.AddPolygon(circle,fCircleSteps,true);
+}
@@ -0,0 +1,140 @@
+//------------------------------------------------------------------------------
+//	File Name:		DecoratorCache.cpp
+//	Description:	Pieces of window decorators rendered once and copied to
+//					the screen afterwards
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include "BitmapDriver.h"
+#include "DecoratorCache.h"
+#include "ServerBitmap.h"
+
+//#define DEBUG_DECORATOR_CACHE
+#ifdef DEBUG_DECORATOR_CACHE
+#	include <stdio.h>
+#	define STRACE(x) printf x
+#else
+#	define STRACE(x) ;
+#endif
+
+//! The server's decorator cache. Created by the AppServer.
+DecoratorCache *decoratorcache=NULL;
+
+// A piece and what it looks like
+typedef struct
+{
+	piece_key key;
+	UtilityBitmap *bitmap;
+} cached_piece;
+
+static bool same_key(const piece_key &a, const piece_key &b)
+{
+	return a.kind==b.kind && a.state==b.state && a.width==b.width
+		&& a.height==b.height && a.color==b.color && a.space==b.space;
+}
+
+DecoratorCache::DecoratorCache(void)
+ : fLock("decorator cache lock")
+{
+	const char *value=getenv(DECORATOR_CACHE_VARIABLE);
+	fBudget=(value ? atol(value) : DECORATOR_CACHE_DEFAULT_KB) * 1024LL;
+	fUsed=0;
+	fRenderer=NULL;
+}
+
+DecoratorCache::~DecoratorCache(void)
+{
+	Flush();
+	delete fRenderer;
+}
+
+/*!
+	\brief Looks for a rendered piece
+	\param key What the piece looks like
+	\return The piece, which belongs to the cache, or NULL if it isn't there
+
+	The cache must be locked, and stay so while the piece is used.
+*/
+UtilityBitmap *DecoratorCache::Find(const piece_key &key)
+{
+	int32 count=fPieces.CountItems();
+	for(int32 i=count-1; i>=0; i--)
+	{
+		cached_piece *piece=(cached_piece*)fPieces.ItemAt(i);
+		if(!same_key(piece->key,key))
+			continue;
+
+		// the list is kept with the one used last at the end
+		if(i!=count-1)
+			fPieces.MoveItem(i,count-1);
+		return piece->bitmap;
+	}
+	return NULL;
+}
+
+/*!
+	\brief Makes room for a new piece
+	\param key What the piece will look like
+	\param bitmap Set to the piece's bitmap, which belongs to the cache
+	\return A driver drawing on the bitmap, or NULL if there is no room for it
+
+	The bitmap is key.width by key.height pixels and its contents are
+	undefined until the caller renders the piece with the driver. The cache
+	must be locked.
+*/
+DisplayDriver *DecoratorCache::Add(const piece_key &key, UtilityBitmap **bitmap)
+{
+	*bitmap=NULL;
+	if(key.width<1 || key.height<1)
+		return NULL;
+
+	UtilityBitmap *pieceBitmap=new UtilityBitmap(BRect(0,0,key.width-1,key.height-1),
+		key.space,0);
+	int64 size=pieceBitmap->BitsLength();
+	if(!pieceBitmap->Bits() || size>fBudget)
+	{
+		delete pieceBitmap;
+		return NULL;
+	}
+
+	while(fUsed+size>fBudget && fPieces.CountItems()>0)
+	{
+		cached_piece *oldest=(cached_piece*)fPieces.RemoveItem((int32)0);
+		fUsed-=oldest->bitmap->BitsLength();
+		delete oldest->bitmap;
+		delete oldest;
+	}
+
+	cached_piece *piece=new cached_piece;
+	piece->key=key;
+	piece->bitmap=pieceBitmap;
+	fPieces.AddItem(piece);
+	fUsed+=size;
+
+	STRACE(("DecoratorCache: piece %ld/%ld %ldx%ld, %ld pieces in %lld bytes\n",
+		key.kind,key.state,key.width,key.height,fPieces.CountItems(),fUsed));
+
+	if(!fRenderer)
+		fRenderer=new BitmapDriver();
+	fRenderer->SetTarget(pieceBitmap);
+
+	*bitmap=pieceBitmap;
+	return fRenderer;
+}
+
+//! Drops every piece in the cache
+void DecoratorCache::Flush(void)
+{
+	Lock();
+	for(int32 i=0; i<fPieces.CountItems(); i++)
+	{
+		cached_piece *piece=(cached_piece*)fPieces.ItemAt(i);
+		delete piece->bitmap;
+		delete piece;
+	}
+	fPieces.MakeEmpty();
+	fUsed=0;
+	if(fRenderer)
+		fRenderer->SetTarget(NULL);
+	Unlock();
+}
@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+//	File Name:		DecoratorCache.h
+//	Description:	Pieces of window decorators rendered once and copied to
+//					the screen afterwards
+//
+//------------------------------------------------------------------------------
+#ifndef _DECORATORCACHE_H_
+#define _DECORATORCACHE_H_
+
+#include <GraphicsDefs.h>
+#include <List.h>
+#include <Locker.h>
+
+class BitmapDriver;
+class DisplayDriver;
+class UtilityBitmap;
+
+//! Environment variable which sets the memory the decorator cache may use, in kilobytes. 0 turns it off.
+#define DECORATOR_CACHE_VARIABLE	"COSMOE_DECORATOR_CACHE"
+
+//! Kilobytes the decorator cache may use when DECORATOR_CACHE_VARIABLE is not set
+#define DECORATOR_CACHE_DEFAULT_KB	2048
+
+/*!
+	\brief What a rendered piece looks like
+
+	The meaning of kind and state is up to the decorator. color is whatever
+	color the piece was rendered on, so pieces of another color set are not
+	mistaken for it.
+*/
+typedef struct
+{
+	int32 kind;
+	int32 state;
+	int32 width;
+	int32 height;
+	uint32 color;
+	color_space space;
+} piece_key;
+
+/*!
+	\class DecoratorCache DecoratorCache.h
+	\brief Keeps pieces of decorators rendered into bitmaps in the screen's color space
+
+	A decorator looks for a piece with Find() and, when it is missing,
+	renders it with the driver Add() returns. Either way the piece is then
+	copied to the screen with DisplayDriver::DrawPixels(). Pieces are shared
+	by all windows, so the cache is locked from the lookup until the copy is
+	done.
+
+	When a new piece would not fit in the memory the cache may use, the
+	pieces used least recently are dropped. Flush() drops them all; it is
+	called when the system colors or the decorator change.
+*/
+class DecoratorCache
+{
+public:
+	DecoratorCache(void);
+	~DecoratorCache(void);
+
+	bool Lock(void) { return fLock.Lock(); }
+	void Unlock(void) { fLock.Unlock(); }
+
+	bool IsEnabled(void) const { return fBudget>0; }
+	UtilityBitmap *Find(const piece_key &key);
+	DisplayDriver *Add(const piece_key &key, UtilityBitmap **bitmap);
+	void Flush(void);
+
+	int32 CountPieces(void) const { return fPieces.CountItems(); }
+	int64 Used(void) const { return fUsed; }
+
+private:
+	BLocker fLock;
+	BList fPieces;
+	int64 fBudget;
+	int64 fUsed;
+	BitmapDriver *fRenderer;
+};
+
+extern DecoratorCache *decoratorcache;
+
+#endif
@@ -34,7 +34,10 @@
 #include "RGBColor.h"
 #include "RectUtils.h"
 #include <stdio.h>
+#include <Accelerant.h>
 #include "FontServer.h"
+#include "DecoratorCache.h"
+#include "ServerBitmap.h"
 
 
 //#define USE_VIEW_FILL_HACK
@@ -47,6 +50,28 @@
 #	define STRACE(x) ;
 #endif
 
+// Pieces of the decorator kept in the decorator cache
+enum
+{
+	PIECE_TAB=1,
+	PIECE_CLOSE,
+	PIECE_ZOOM,
+	PIECE_FRAME_H,	// top and bottom edges of the frame
+	PIECE_FRAME_V,	// left and right edges of the frame
+	PIECE_RESIZE	// a document window's resize thumb
+};
+
+// Tabs and frames are rendered at their size rounded up to these and fit to
+// the size they are drawn at by copying their two ends separately: what lies
+// between the ends is the same all along.
+#define TAB_PIECE_STEP		64
+#define FRAME_PIECE_STEP	128
+
+static int32 round_up(int32 size, int32 step)
+{
+	return (size+step-1)/step*step;
+}
+
 DefaultDecorator::DefaultDecorator(BRect rect, int32 wlook, int32 wfeel, int32 wflags)
  : Decorator(rect,wlook,wfeel,wflags)
 {
@@ -426,23 +451,36 @@ void DefaultDecorator::_DrawZoom(BRect r)
 	STRACE(("_DrawZoom(%f,%f,%f,%f)\n", r.left, r.top, r.right, r.bottom));
 	// If this has been implemented, then the decorator has a Zoom button
 	// which should be drawn based on the state of the member zoomstate
+	int32 width=r.IntegerWidth()+1, height=r.IntegerHeight()+1;
+	BRect source(0,0,width-1,height-1);
+	BPoint where(r.left,r.top);
+	if(!_DrawPiece(PIECE_ZOOM,width,height,&source,&where,1))
+		_DrawZoomButton(_driver,r);
+}
+
+void DefaultDecorator::_DrawZoomButton(DisplayDriver *driver, const BRect &r)
+{
 	BRect zr( r );
 	
 	zr.left		+= 3.0;
 	zr.top		+= 3.0;
-	DrawBlendedRect( zr, GetZoom() );
+	DrawBlendedRect( driver, zr, GetZoom() );
 	
 	zr			= r;
 	zr.right	-= 5.0;
 	zr.bottom	-= 5.0;
-	DrawBlendedRect( zr, GetZoom() );
+	DrawBlendedRect( driver, zr, GetZoom() );
 }
 
 void DefaultDecorator::_DrawClose(BRect r)
 {
 	STRACE(("_DrawClose(%f,%f,%f,%f)\n", r.left, r.top, r.right, r.bottom));
 	// Just like DrawZoom, but for a close button
-	DrawBlendedRect( r, GetClose());
+	int32 width=r.IntegerWidth()+1, height=r.IntegerHeight()+1;
+	BRect source(0,0,width-1,height-1);
+	BPoint where(r.left,r.top);
+	if(!_DrawPiece(PIECE_CLOSE,width,height,&source,&where,1))
+		DrawBlendedRect( _driver, r, GetClose());
 }
 
 void DefaultDecorator::_DrawTab(BRect r)
@@ -453,27 +491,21 @@ void DefaultDecorator::_DrawTab(BRect r)
 	if(_look == B_NO_BORDER_WINDOW_LOOK || _look == B_BORDERED_WINDOW_LOOK)
 		return;
 
-	RGBColor		tabColor = (GetFocus())?_colors->window_tab:_colors->inactive_window_tab;	
-	_driver->FillRect(_tabrect, tabColor);
-	
-	_driver->StrokeLine(_tabrect.LeftTop(),_tabrect.LeftBottom(),framecolors[0]);
-	_driver->StrokeLine(_tabrect.LeftTop(),_tabrect.RightTop(),framecolors[0]);
-	_driver->StrokeLine(_tabrect.RightTop(),_tabrect.RightBottom(),framecolors[5]);
-	_driver->StrokeLine( BPoint( _tabrect.left + 2, _tabrect.bottom+1 ),
-						 BPoint( _tabrect.right - 2, _tabrect.bottom+1 ),
-						 framecolors[2]);
-
-	_driver->StrokeLine( BPoint( _tabrect.left + 1, _tabrect.top + 1 ),
-						 BPoint( _tabrect.left + 1, _tabrect.bottom ),
-						 framecolors[1]);
-	_driver->StrokeLine( BPoint( _tabrect.left + 1, _tabrect.top + 1 ),
-						 BPoint( _tabrect.right - 1, _tabrect.top + 1 ),
-						 framecolors[1]);
-
-	_driver->StrokeLine( BPoint( _tabrect.right - 1, _tabrect.top + 2 ),
-						 BPoint( _tabrect.right - 1, _tabrect.bottom ),
-						 framecolors[3]);
-
+	// The tab is copied from one rendered a little wider: all of it but its
+	// two rightmost columns, those columns, and the line under it, which
+	// leaves the frame's corners alone.
+	int32 width=_tabrect.IntegerWidth()+1, height=_tabrect.IntegerHeight()+1;
+	int32 pieceWidth=round_up(width,TAB_PIECE_STEP);
+	BRect sources[3]={ BRect(0,0,width-3,height-1),
+		BRect(pieceWidth-2,0,pieceWidth-1,height-1),
+		BRect(2,height,width-3,height) };
+	BPoint where[3]={ BPoint(_tabrect.left,_tabrect.top),
+		BPoint(_tabrect.right-1,_tabrect.top),
+		BPoint(_tabrect.left+2,_tabrect.bottom+1) };
+
+	if(width<5 || !_DrawPiece(PIECE_TAB,pieceWidth,height+1,sources,where,3))
+		_DrawTabBackground(_driver,_tabrect,
+			(GetFocus())?_colors->window_tab:_colors->inactive_window_tab);
 
 	_DrawTitle(_tabrect);
 
@@ -484,12 +516,139 @@ void DefaultDecorator::_DrawTab(BRect r)
 		_DrawZoom(_zoomrect);
 }
 
+void DefaultDecorator::_DrawTabBackground(DisplayDriver *driver, const BRect &r, const RGBColor &color)
+{
+	// The tab without its title and buttons, and the line under it
+	driver->FillRect(r, color);
+	
+	driver->StrokeLine(BPoint(r.left,r.top),BPoint(r.left,r.bottom),framecolors[0]);
+	driver->StrokeLine(BPoint(r.left,r.top),BPoint(r.right,r.top),framecolors[0]);
+	driver->StrokeLine(BPoint(r.right,r.top),BPoint(r.right,r.bottom),framecolors[5]);
+	driver->StrokeLine( BPoint( r.left + 2, r.bottom+1 ),
+						BPoint( r.right - 2, r.bottom+1 ),
+						framecolors[2]);
+
+	driver->StrokeLine( BPoint( r.left + 1, r.top + 1 ),
+						BPoint( r.left + 1, r.bottom ),
+						framecolors[1]);
+	driver->StrokeLine( BPoint( r.left + 1, r.top + 1 ),
+						BPoint( r.right - 1, r.top + 1 ),
+						framecolors[1]);
+
+	driver->StrokeLine( BPoint( r.right - 1, r.top + 2 ),
+						BPoint( r.right - 1, r.bottom ),
+						framecolors[3]);
+}
+
 void DefaultDecorator::_SetColors(void)
 {
 	_SetFocus();
 }
 
-void DefaultDecorator::DrawBlendedRect(BRect r, bool down)
+/*!
+	\brief Copies parts of a piece from the decorator cache to the screen
+	\param kind Which piece: one of the PIECE_ constants
+	\param width Width the piece is rendered at
+	\param height Height the piece is rendered at
+	\param sources Parts of the piece to copy
+	\param where Where the top left corner of each part goes on screen
+	\param count Number of parts
+	\return false if there is no cache or no room in it. Nothing is drawn then.
+
+	The piece is rendered first if the cache doesn't have it. Tabs and buttons
+	are kept for each tab color and button state.
+*/
+bool DefaultDecorator::_DrawPiece(int32 kind, int32 width, int32 height,
+	const BRect *sources, const BPoint *where, int32 count)
+{
+	if(!decoratorcache || !decoratorcache->IsEnabled())
+		return false;
+
+	display_mode mode;
+	_driver->GetMode(&mode);
+
+	piece_key key;
+	key.kind=kind;
+	key.state=0;
+	key.width=width;
+	key.height=height;
+	key.color=0;
+	key.space=(color_space)mode.space;
+	if(kind==PIECE_TAB || kind==PIECE_CLOSE || kind==PIECE_ZOOM)
+	{
+		rgb_color color=(GetFocus())?_colors->window_tab.GetColor32():
+			_colors->inactive_window_tab.GetColor32();
+		key.color=(color.red<<16) | (color.green<<8) | color.blue;
+		if(kind==PIECE_CLOSE)
+			key.state=GetClose();
+		else if(kind==PIECE_ZOOM)
+			key.state=GetZoom();
+	}
+
+	decoratorcache->Lock();
+	UtilityBitmap *piece=decoratorcache->Find(key);
+	if(!piece)
+	{
+		DisplayDriver *renderer=decoratorcache->Add(key,&piece);
+		if(!renderer)
+		{
+			decoratorcache->Unlock();
+			return false;
+		}
+		_RenderPiece(renderer,kind,width,height);
+	}
+
+	for(int32 i=0; i<count; i++)
+	{
+		BRegion region(BRect(where[i].x,where[i].y,where[i].x+sources[i].Width(),
+			where[i].y+sources[i].Height()));
+		_driver->DrawPixels(&region,piece,
+			BPoint(where[i].x-sources[i].left,where[i].y-sources[i].top));
+	}
+	decoratorcache->Unlock();
+	return true;
+}
+
+/*!
+	\brief Renders a piece for the decorator cache
+	\param driver Driver drawing on the piece's bitmap
+	\param kind Which piece: one of the PIECE_ constants
+	\param width Width of the bitmap
+	\param height Height of the bitmap
+*/
+void DefaultDecorator::_RenderPiece(DisplayDriver *driver, int32 kind, int32 width, int32 height)
+{
+	BRect bounds(0,0,width-1,height-1);
+	RGBColor tabColor=(GetFocus())?_colors->window_tab:_colors->inactive_window_tab;
+
+	switch(kind)
+	{
+		case PIECE_TAB:
+			// the last row is for the line under the tab
+			_DrawTabBackground(driver,BRect(0,0,width-1,height-2),tabColor);
+			break;
+		case PIECE_CLOSE:
+			driver->FillRect(bounds,tabColor);
+			DrawBlendedRect(driver,bounds,GetClose());
+			break;
+		case PIECE_ZOOM:
+			// the zoom button leaves two corners of its rectangle to the tab
+			driver->FillRect(bounds,tabColor);
+			_DrawZoomButton(driver,bounds);
+			break;
+		case PIECE_FRAME_H:
+		case PIECE_FRAME_V:
+			// a frame 11 pixels high or wide: the edges along its length are
+			// the same all the way between the corners
+			_DrawBevel(driver,bounds);
+			break;
+		case PIECE_RESIZE:
+			_DrawResizeThumb(driver,bounds.right,bounds.bottom);
+			break;
+	}
+}
+
+void DefaultDecorator::DrawBlendedRect(DisplayDriver *driver, BRect r, bool down)
 {
 	// This bad boy is used to draw a rectangle with a gradient.
 	// Note that it is not part of the Decorator API - it's specific
@@ -527,20 +686,20 @@ void DefaultDecorator::DrawBlendedRect(BRect r, bool down)
 			uint8(startcol.green-(i*gstep)),
 			uint8(startcol.blue-(i*bstep)));
 		
-		_driver->StrokeLine(BPoint(r.left,r.top+i),
+		driver->StrokeLine(BPoint(r.left,r.top+i),
 			BPoint(r.left+i,r.top),temprgbcol);
 
 		temprgbcol.SetColor(uint8(halfcol.red-(i*rstep)),
 			uint8(halfcol.green-(i*gstep)),
 			uint8(halfcol.blue-(i*bstep)));
 
-		_driver->StrokeLine(BPoint(r.left+steps,r.top+i),
+		driver->StrokeLine(BPoint(r.left+steps,r.top+i),
 			BPoint(r.left+i,r.top+steps),temprgbcol);
 	}
 
 //	_layerdata.highcolor=startcol;
 //	_driver->FillRect(r,&_layerdata,pat_solidhigh);
-	_driver->StrokeRect(r,framecolors[3]);
+	driver->StrokeRect(r,framecolors[3]);
 }
 
 void DefaultDecorator::_DrawFrame(BRect invalid)
@@ -558,27 +717,29 @@ STRACE(("_DrawFrame(%f,%f,%f,%f)\n", invalid.left, invalid.top,
 	if(!borderwidth)
 		return;
 
-	{ // a block start
+	BRect		r = BRect(topborder.left, topborder.top, bottomborder.right, bottomborder.bottom);
+	int32		width = r.IntegerWidth()+1, height = r.IntegerHeight()+1;
+	bool		cached = false;
 
-	BRect		r = BRect(topborder.LeftTop(), bottomborder.RightBottom());
-	//top
-	for (int8 i=0; i<5; i++){
-		_driver->StrokeLine(BPoint(r.left+i, r.top+i), BPoint(r.right-i, r.top+i), framecolors[i]);
-	}
-	//left
-	for (int8 i=0; i<5; i++){
-		_driver->StrokeLine(BPoint(r.left+i, r.top+i), BPoint(r.left+i, r.bottom-i), framecolors[i]);
-	}
-	//bottom
-	for (int8 i=0; i<5; i++){
-		_driver->StrokeLine(BPoint(r.left+i, r.bottom-i), BPoint(r.right-i, r.bottom-i), framecolors[(4-i)==4? 5: (4-i)]);
-	}
-	//right
-	for (int8 i=0; i<5; i++){
-		_driver->StrokeLine(BPoint(r.right-i, r.top+i), BPoint(r.right-i, r.bottom-i), framecolors[(4-i)==4? 5: (4-i)]);
+	if(width >= 11 && height >= 11)
+	{
+		// The top and bottom edges come from a frame 11 pixels high, left
+		// and right ends separately, and the sides between them from one 11
+		// pixels wide.
+		int32	pieceWidth = round_up(width, FRAME_PIECE_STEP);
+		int32	pieceHeight = round_up(height, FRAME_PIECE_STEP);
+		BRect	edges[4] = { BRect(0, 0, width-6, 4), BRect(pieceWidth-5, 0, pieceWidth-1, 4),
+							 BRect(0, 6, width-6, 10), BRect(pieceWidth-5, 6, pieceWidth-1, 10) };
+		BPoint	edgesAt[4] = { BPoint(r.left, r.top), BPoint(r.right-4, r.top),
+							   BPoint(r.left, r.bottom-4), BPoint(r.right-4, r.bottom-4) };
+		BRect	sides[2] = { BRect(0, 5, 4, height-6), BRect(6, 5, 10, height-6) };
+		BPoint	sidesAt[2] = { BPoint(r.left, r.top+5), BPoint(r.right-4, r.top+5) };
+
+		cached = _DrawPiece(PIECE_FRAME_H, pieceWidth, 11, edges, edgesAt, 4)
+			&& _DrawPiece(PIECE_FRAME_V, 11, pieceHeight, sides, sidesAt, 2);
 	}
-
-	} // end of the block/
+	if(!cached)
+		_DrawBevel(_driver, r);
 
 	// Draw the resize thumb if we're supposed to
 	if(!(_flags & B_NOT_RESIZABLE))
@@ -588,30 +749,25 @@ STRACE(("_DrawFrame(%f,%f,%f,%f)\n", invalid.left, invalid.top,
 		switch(_look){
 		// This code is strictly for B_DOCUMENT_WINDOW looks
 			case B_DOCUMENT_WINDOW_LOOK:{
-
-				// Explicitly locking the driver is normally unnecessary. However, we need to do
-				// this because we are rapidly drawing a series of calls which would not necessarily
-				// draw correctly if we didn't do so.
 				float	x = r.right;
 				float	y = r.bottom;
-				_driver->Lock();
-				_driver->FillRect(BRect(x-13, y-13, x, y), framecolors[2]);
-				_driver->StrokeLine(BPoint(x-15, y-15), BPoint(x-15, y-2), framecolors[0]);
-				_driver->StrokeLine(BPoint(x-14, y-14), BPoint(x-14, y-1), framecolors[1]);
-				_driver->StrokeLine(BPoint(x-15, y-15), BPoint(x-2, y-15), framecolors[0]);
-				_driver->StrokeLine(BPoint(x-14, y-14), BPoint(x-1, y-14), framecolors[1]);
-
-				for(int8 i=1; i <= 4; i++){
-					for(int8 j=1; j<=i; j++){
-						BPoint		pt1(x-(3*j)+1, y-(3*(5-i))+1);
-						BPoint		pt2(x-(3*j)+2, y-(3*(5-i))+2);
-						_driver->StrokePoint(pt1, framecolors[0]);
-						_driver->StrokePoint(pt2, framecolors[1]);
-					}
+
+				// only the pixels the thumb covers
+				BRect	thumb[5] = { BRect(0, 0, 13, 0), BRect(0, 1, 14, 1), BRect(0, 2, 15, 13),
+									 BRect(1, 14, 15, 14), BRect(2, 15, 15, 15) };
+				BPoint	thumbAt[5];
+				for(int32 i=0; i < 5; i++)
+					thumbAt[i].Set(x-15+thumb[i].left, y-15+thumb[i].top);
+
+				if(!_DrawPiece(PIECE_RESIZE, 16, 16, thumb, thumbAt, 5))
+				{
+					// Explicitly locking the driver is normally unnecessary. However, we need to do
+					// this because we are rapidly drawing a series of calls which would not necessarily
+					// draw correctly if we didn't do so.
+					_driver->Lock();
+					_DrawResizeThumb(_driver, x, y);
+					_driver->Unlock();
 				}
-//				RGBColor		c(255,128,0);
-//				_driver->FillRect(BRect(50,50,600,400), c);
-				_driver->Unlock();
 				break;
 			}
 
@@ -633,3 +789,42 @@ STRACE(("_DrawFrame(%f,%f,%f,%f)\n", invalid.left, invalid.top,
 		}
 	}
 }
+
+void DefaultDecorator::_DrawBevel(DisplayDriver *driver, const BRect &r)
+{
+	//top
+	for (int8 i=0; i<5; i++){
+		driver->StrokeLine(BPoint(r.left+i, r.top+i), BPoint(r.right-i, r.top+i), framecolors[i]);
+	}
+	//left
+	for (int8 i=0; i<5; i++){
+		driver->StrokeLine(BPoint(r.left+i, r.top+i), BPoint(r.left+i, r.bottom-i), framecolors[i]);
+	}
+	//bottom
+	for (int8 i=0; i<5; i++){
+		driver->StrokeLine(BPoint(r.left+i, r.bottom-i), BPoint(r.right-i, r.bottom-i), framecolors[(4-i)==4? 5: (4-i)]);
+	}
+	//right
+	for (int8 i=0; i<5; i++){
+		driver->StrokeLine(BPoint(r.right-i, r.top+i), BPoint(r.right-i, r.bottom-i), framecolors[(4-i)==4? 5: (4-i)]);
+	}
+}
+
+void DefaultDecorator::_DrawResizeThumb(DisplayDriver *driver, float x, float y)
+{
+	// A document window's thumb, with its bottom right corner at x,y
+	driver->FillRect(BRect(x-13, y-13, x, y), framecolors[2]);
+	driver->StrokeLine(BPoint(x-15, y-15), BPoint(x-15, y-2), framecolors[0]);
+	driver->StrokeLine(BPoint(x-14, y-14), BPoint(x-14, y-1), framecolors[1]);
+	driver->StrokeLine(BPoint(x-15, y-15), BPoint(x-2, y-15), framecolors[0]);
+	driver->StrokeLine(BPoint(x-14, y-14), BPoint(x-1, y-14), framecolors[1]);
+
+	for(int8 i=1; i <= 4; i++){
+		for(int8 j=1; j<=i; j++){
+			BPoint		pt1(x-(3*j)+1, y-(3*(5-i))+1);
+			BPoint		pt2(x-(3*j)+2, y-(3*(5-i))+2);
+			driver->StrokePoint(pt1, framecolors[0]);
+			driver->StrokePoint(pt2, framecolors[1]);
+		}
+	}
+}
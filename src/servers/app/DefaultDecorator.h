@@ -56,7 +56,14 @@ protected:
 	virtual void _DoLayout(void);
 	virtual void _SetFocus(void);
 	virtual void _SetColors(void);
-	void DrawBlendedRect(BRect r, bool down);
+	void DrawBlendedRect(DisplayDriver *driver, BRect r, bool down);
+	void _DrawTabBackground(DisplayDriver *driver, const BRect &r, const RGBColor &color);
+	void _DrawZoomButton(DisplayDriver *driver, const BRect &r);
+	void _DrawBevel(DisplayDriver *driver, const BRect &r);
+	void _DrawResizeThumb(DisplayDriver *driver, float x, float y);
+	bool _DrawPiece(int32 kind, int32 width, int32 height, const BRect *sources,
+		const BPoint *where, int32 count);
+	void _RenderPiece(DisplayDriver *driver, int32 kind, int32 width, int32 height);
 	uint32 taboffset;
 
 	RGBColor tab_highcol, tab_lowcol;
@@ -25,6 +25,7 @@
 //
 //------------------------------------------------------------------------------
 #include <stdio.h>
+#include <stdlib.h>
 #include <Entry.h>
 #include <Region.h>
 #include <Message.h>
@@ -40,6 +41,8 @@
 #include "ServerWindow.h"
 #include "WinBorder.h"
 #include "Workspace.h"
+#include "HeadlessInjector.h"
+#include "headlessdriver.h"
 #include <PortLink.h>
 
 //#define REAL_MODE
@@ -102,21 +105,39 @@ void Desktop::Init(void)
 {
 STRACE(("Desktop: InitDesktop\n"));
 	DisplayDriver	*driver = NULL;
+	const char		*driverName = DRIVER_NAME;
 	int32 driverCount = 0;
 	bool initDrivers = true;
 
-	while(initDrivers)
+	// Setting COSMOE_HEADLESS to a mode such as "1024x768x16" draws into memory
+	// instead of on the display, for benchmarks and tests
+	const char		*headlessMode = getenv(HEADLESS_MODE_VARIABLE);
+	int32			width = 800, height = 600;
+	color_space		space = B_RGB32;
+
+	if(headlessMode && !HeadlessDriver::ParseMode(headlessMode, &width, &height, &space))
 	{
+		printf("Desktop: ignoring bad headless mode '%s'\n", headlessMode);
+		headlessMode = NULL;
+	}
 
-		driver = new DRIVER_CLASS;
-		STRACE(( "Loading " DRIVER_NAME "...\n" ));
+	while(initDrivers)
+	{
+		if(headlessMode)
+		{
+			driver = new HeadlessDriver(width, height, space);
+			driverName = "Headless Driver";
+		}
+		else
+			driver = new DRIVER_CLASS;
+		STRACE(( "Loading %s...\n", driverName ));
 
 		if(driver->Initialize())
 		{
-			STRACE(( DRIVER_NAME " succesfully initialized\n" ));
+			STRACE(( "%s succesfully initialized\n", driverName ));
 			driverCount++;
 
-			Screen		*sc = new Screen(driver, BPoint(800, 600), B_RGB32, driverCount);
+			Screen		*sc = new Screen(driver, BPoint(width, height), space, driverCount);
 
 			// TODO: be careful, of screen initialization - monitor may not support 640x480
 			fScreenList.AddItem(sc);
@@ -127,7 +148,7 @@ STRACE(("Desktop: InitDesktop\n"));
 		}
 		else
 		{
-			STRACE(( DRIVER_NAME "FAILED initialization - game over\n" ));
+			STRACE(( "%s FAILED initialization - game over\n", driverName ));
 			driver->Shutdown();
 			delete	driver;
 			driver	= NULL;
@@ -30,11 +30,15 @@
 #include <Accelerant.h>
 #include "Angle.h"
 #include "FontFamily.h"
+#include "FontCache.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 #include "DisplayDriver.h"
 #include "RectUtils.h"
 #include "Utils.h"
 #include "ServerCursor.h"
+#include "SpanKernels.h"
 
 // TODO: Remove remnants of old API.  Inplement all functions.  Bounds checking needs to be
 // handled by the public drawing functions.
@@ -42,6 +46,63 @@
 
 static Blitter blitter;
 
+//! A region given to ConstrainClippingRegion() and the thread which gave it
+struct clip_constraint
+{
+	thread_id thread;
+	BRegion region;
+};
+
+//! Returns the constraint a thread set in a driver's list, or NULL
+static clip_constraint *find_constraint(const BList &constraints, thread_id thread)
+{
+	for(int32 i=0; i<constraints.CountItems(); i++)
+	{
+		clip_constraint *constraint=(clip_constraint*)constraints.ItemAt(i);
+		if(constraint->thread==thread)
+			return constraint;
+	}
+	return NULL;
+}
+
+/*
+	Finds the next run of pixels of a span from *x on which are at least
+	half covered, for drivers which can't blend
+*/
+static bool next_covered_run(const shape_span &span, int32 *x, int32 *left, int32 *right)
+{
+	if(*x>span.right)
+		return false;
+
+	if(!span.coverage)
+	{
+		*left=*x;
+		*right=span.right;
+		*x=span.right+1;
+		return true;
+	}
+
+	int32 i=*x;
+	while(i<=span.right && span.coverage[i-span.left]<128)
+		i++;
+	if(i>span.right)
+		return false;
+
+	*left=i;
+	while(i<=span.right && span.coverage[i-span.left]>=128)
+		i++;
+	*right=i-1;
+	*x=i;
+	return true;
+}
+
+// The area an outline drawn with a pen of the given size covers
+static BRect pen_bounds(const BRect &r, float pensize)
+{
+	float grow=pensize>1 ? ceilf(pensize/2) : 0;
+	return BRect(r.left-grow,r.top-grow,r.right+grow,r.bottom+grow);
+}
+
 /*!
 	\brief Sets up internal variables needed by all DisplayDriver subclasses
 
@@ -59,6 +120,9 @@ DisplayDriver::DisplayDriver(void)
 	fCursorHandler=new CursorHandler(this);
 	fDPMSCaps=B_DPMS_ON;
 	fDPMSState=B_DPMS_ON;
+
+	const char *antialias=getenv(ANTIALIAS_VARIABLE);
+	fAntialias=!(antialias && atoi(antialias)==0);
 }
 
 
@@ -71,6 +135,9 @@ DisplayDriver::~DisplayDriver(void)
 {
 	delete _locker;
 	delete fCursorHandler;
+
+	for(int32 i=0; i<fConstraints.CountItems(); i++)
+		delete (clip_constraint*)fConstraints.ItemAt(i);
 }
 
 /*!
@@ -116,16 +183,6 @@ void DisplayDriver::CopyBits(const BRect &src, const BRect &dest, const DrawData
 	Unlock();
 }
 
-/*!
-	\brief A screen-to-screen blit (of sorts) which copies a BRegion
-	\param src Source region
-	\param lefttop Offset to which the region will be copied
-*/
-void DisplayDriver::CopyRegion(BRegion *src, const BPoint &lefttop)
-{
-	// TODO: Implement DisplayDriver;:CopyRegion
-}
-
 /*!
 	\brief Called for all BView::DrawBitmap calls
 	\param region Destination rects in screen coordinates
@@ -297,137 +354,442 @@ void DisplayDriver::DrawBitmap(ServerBitmap *bmp, const BRect &src, const BRect
 */
 }
 
+/*!
+	\brief Copies the rectangles of a region between the framebuffer and a bitmap
+	\param region The rectangles to copy, in screen coordinates
+	\param screen The framebuffer
+	\param bitmap The bitmap. It must have the framebuffer's pixel size.
+	\param origin Where the top left corner of the bitmap lies on screen
+	\param toBitmap true to copy from the framebuffer, false to copy to it
+*/
+static void copy_region_pixels(BRegion *region, ServerBitmap *screen,
+	ServerBitmap *bitmap, const BPoint &origin, bool toBitmap)
+{
+	int32 pixelsize = (screen->BitsPerPixel() + 7) / 8;
+	if (pixelsize != (bitmap->BitsPerPixel() + 7) / 8)
+		return;
+	
+	int32 x = (int32)origin.x;
+	int32 y = (int32)origin.y;
+	
+	// only the part which is both on screen and in the bitmap
+	clipping_rect limit;
+	limit.left = x > 0 ? x : 0;
+	limit.top = y > 0 ? y : 0;
+	limit.right = screen->Bounds().IntegerWidth();
+	if (x + bitmap->Bounds().IntegerWidth() < limit.right)
+		limit.right = x + bitmap->Bounds().IntegerWidth();
+	limit.bottom = screen->Bounds().IntegerHeight();
+	if (y + bitmap->Bounds().IntegerHeight() < limit.bottom)
+		limit.bottom = y + bitmap->Bounds().IntegerHeight();
+	
+	int32 count = region->CountRects();
+	for (int32 i = 0; i < count; i++)
+	{
+		clipping_rect r = region->RectAtInt(i);
+		if (r.left < limit.left) r.left = limit.left;
+		if (r.top < limit.top) r.top = limit.top;
+		if (r.right > limit.right) r.right = limit.right;
+		if (r.bottom > limit.bottom) r.bottom = limit.bottom;
+		if (r.left > r.right || r.top > r.bottom)
+			continue;
+		
+		uint8 *screenbits = screen->Bits() + r.top * screen->BytesPerRow()
+			+ r.left * pixelsize;
+		uint8 *bitmapbits = bitmap->Bits() + (r.top - y) * bitmap->BytesPerRow()
+			+ (r.left - x) * pixelsize;
+		size_t bytes = (r.right - r.left + 1) * pixelsize;
+		int32 rows = r.bottom - r.top + 1;
+		
+		if (toBitmap)
+			rect_copy(bitmapbits, bitmap->BytesPerRow(), screenbits,
+				screen->BytesPerRow(), bytes, rows);
+		else
+			rect_copy(screenbits, screen->BytesPerRow(), bitmapbits,
+				bitmap->BytesPerRow(), bytes, rows);
+	}
+}
+
+// A rectangle to move, with the keys which put it in a safe order
+struct sorted_rect
+{
+	int32 key1;
+	int32 key2;
+	clipping_rect rect;
+};
+
+static int compare_sorted_rects(const void *a, const void *b)
+{
+	const sorted_rect *first = (const sorted_rect*)a;
+	const sorted_rect *second = (const sorted_rect*)b;
+
+	if (first->key1 != second->key1)
+		return first->key1 < second->key1 ? -1 : 1;
+	if (first->key2 != second->key2)
+		return first->key2 < second->key2 ? -1 : 1;
+	return 0;
+}
+
+/*!
+	\brief Moves the rectangles of a region to another place in the framebuffer
+	\param region The rectangles to move, in screen coordinates
+	\param screen The framebuffer
+	\param dx Horizontal distance to move them
+	\param dy Vertical distance to move them
+
+	No temporary copy is made. The rectangles of a region are in bands sorted
+	top to bottom and left to right, so they are moved starting from the side
+	they move towards: none of them is then written over before it was moved
+	itself. Parts which would come from or go to outside the screen are
+	skipped.
+*/
+static void move_region_pixels(BRegion *region, ServerBitmap *screen,
+	int32 dx, int32 dy)
+{
+	int32 count = region->CountRects();
+	if (count == 0 || (dx == 0 && dy == 0))
+		return;
+
+	int32 pixelsize = (screen->BitsPerPixel() + 7) / 8;
+	int32 bpr = screen->BytesPerRow();
+	int32 width = screen->Bounds().IntegerWidth();
+	int32 height = screen->Bounds().IntegerHeight();
+
+	// sources whose destination is on screen as well
+	clipping_rect limit;
+	limit.left = dx < 0 ? -dx : 0;
+	limit.top = dy < 0 ? -dy : 0;
+	limit.right = dx > 0 ? width - dx : width;
+	limit.bottom = dy > 0 ? height - dy : height;
+
+	sorted_rect *rects = new sorted_rect[count];
+	int32 used = 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		clipping_rect r = region->RectAtInt(i);
+		if (r.left < limit.left) r.left = limit.left;
+		if (r.top < limit.top) r.top = limit.top;
+		if (r.right > limit.right) r.right = limit.right;
+		if (r.bottom > limit.bottom) r.bottom = limit.bottom;
+		if (r.left > r.right || r.top > r.bottom)
+			continue;
+
+		rects[used].key1 = dy > 0 ? -r.top : r.top;
+		rects[used].key2 = dx > 0 ? -r.left : r.left;
+		rects[used].rect = r;
+		used++;
+	}
+
+	qsort(rects, used, sizeof(sorted_rect), compare_sorted_rects);
+
+	uint8 *bits = screen->Bits();
+	for (int32 i = 0; i < used; i++)
+	{
+		const clipping_rect &r = rects[i].rect;
+		uint8 *src = bits + r.top * bpr + r.left * pixelsize;
+
+		// rect_move() takes care of the rows of a rectangle overlapping
+		rect_move(src + dy * bpr + dx * pixelsize, src, bpr,
+			(r.right - r.left + 1) * pixelsize, r.bottom - r.top + 1);
+	}
+
+	delete [] rects;
+}
+
+/*!
+	\brief A screen-to-screen blit (of sorts) which copies a BRegion
+	\param src Source region
+	\param lefttop Where the top left corner of the region's frame is copied to
+
+	The copy is done in place, so the source and the destination may overlap,
+	as they do when a view scrolls.
+*/
+void DisplayDriver::CopyRegion(BRegion *src, const BPoint &lefttop)
+{
+	if(!src || src->CountRects() == 0)
+		return;
+
+	BRect frame(src->Frame());
+	int32 dx = (int32)(lefttop.x - frame.left);
+	int32 dy = (int32)(lefttop.y - frame.top);
+	if(dx == 0 && dy == 0)
+		return;
+
+	Lock();
+
+	FBBitmap		frameBuffer;
+
+	if(!AcquireBuffer(&frameBuffer))
+	{
+		Unlock();
+		debugger("ERROR: Couldn't acquire framebuffer in CopyRegion()\n");
+		return;
+	}
+
+	BRect dest(frame.OffsetByCopy(dx, dy));
+	bool hideCursor = fCursorHandler->IntersectsCursor(frame | dest);
+	if(hideCursor)
+		fCursorHandler->DriverHide();
+
+	move_region_pixels(src, &frameBuffer, dx, dy);
+
+	if(hideCursor)
+		fCursorHandler->DriverShow();
+	ReleaseBuffer();
+	Unlock();
+
+	Invalidate(dest);
+}
+
+// A region which moves by some offset, as a part of CopyRegionList()
+struct region_move
+{
+	BRegion region;
+	int32 dx;
+	int32 dy;
+	UtilityBitmap *staged;
+};
+
+/*!
+	\brief Copies several regions at once, each by its own offset
+	\param list The regions to copy, in screen coordinates
+	\param pList The offsets, one BPoint for each region
+	\param rCount The number of regions
+	\param clipReg Currently unused
+
+	Every region is copied from what was on screen before any of them was.
+	Regions which share an offset, such as the layers of a moving window, are
+	moved together in place by move_region_pixels(). When there are several
+	offsets, a region is only moved once nothing still to be moved has its
+	source where it goes. Should regions be in each other's way, one is put
+	aside in a bitmap until the others are done.
+*/
 void DisplayDriver::CopyRegionList(BList* list, BList* pList, int32 rCount, BRegion* clipReg)
 {
+	if(rCount <= 0)
+		return;
+
+	// gather the regions by offset
+	BList moves;
+	for(int32 k=0; k < rCount; k++)
+	{
+		BRegion *reg = (BRegion*)list->ItemAt(k);
+		BPoint *pt = (BPoint*)pList->ItemAt(k);
+		if(!reg || !pt || reg->CountRects() == 0)
+			continue;
+
+		int32 dx = (int32)pt->x;
+		int32 dy = (int32)pt->y;
+		if(dx == 0 && dy == 0)
+			continue;
+
+		region_move *move = NULL;
+		for(int32 i=0; i < moves.CountItems(); i++)
+		{
+			region_move *item = (region_move*)moves.ItemAt(i);
+			if(item->dx == dx && item->dy == dy)
+			{
+				move = item;
+				break;
+			}
+		}
+		if(!move)
+		{
+			move = new region_move;
+			move->dx = dx;
+			move->dy = dy;
+			move->staged = NULL;
+			moves.AddItem(move);
+		}
+		move->region.Include(reg);
+	}
+
+	if(moves.CountItems() == 0)
+		return;
+
 	Lock();
 
 	FBBitmap		frameBuffer;
-	FBBitmap		*bmp = &frameBuffer;
-	
+
 	if(!AcquireBuffer(&frameBuffer))
 	{
+		Unlock();
+		for(int32 i=0; i < moves.CountItems(); i++)
+			delete (region_move*)moves.ItemAt(i);
 		debugger("ERROR: Couldn't acquire framebuffer in CopyRegionList()\n");
 		return;
 	}
-	
+
 	fCursorHandler->DriverHide();
-	
-	
-	uint32		bytesPerPixel	= bmp->BytesPerRow() / bmp->Bounds().IntegerWidth();
-	BList		rectList;
-	int32		i, k;
-	uint8		*bitmapBits = (uint8*)bmp->Bits();
-	int32		Bwidth		= bmp->Bounds().IntegerWidth() + 1;
-	int32		Bheight		= bmp->Bounds().IntegerHeight() + 1;
-
-	for(k=0; k < rCount; k++)
+
+	BRect inval;
+	BList pending(moves), staged;
+	while(pending.CountItems() > 0)
 	{
-		BRegion		*reg = (BRegion*)list->ItemAt(k);
-		
-		int32		rectCount = reg->CountRects();
-		for(i=0; i < rectCount; i++)
+		// look for a region whose destination no other one needs anymore
+		int32 next = 0;
+		for(int32 i=0; i < pending.CountItems(); i++)
 		{
-			BRect		r		= reg->RectAt(i);
-			uint8		*rectCopy;
-			uint8		*srcAddress;
-			uint8		*destAddress;
-			int32		firstRow, lastRow;
-			int32		firstCol, lastCol;
-			int32		copyLength;
-			int32		copyRows;
-	
-			firstRow	= (int32)(r.top < 0? 0: r.top);
-			lastRow		= (int32)(r.bottom > (Bheight-1)? (Bheight-1): r.bottom);
-			firstCol	= (int32)(r.left < 0? 0: r.left);
-			lastCol		= (int32)(r.right > (Bwidth-1)? (Bwidth-1): r.right);
-			copyLength	= (lastCol - firstCol + 1) < 0? 0: (lastCol - firstCol + 1);
-			copyRows	= (lastRow - firstRow + 1) < 0? 0: (lastRow - firstRow + 1);
-	
-			rectCopy	= (uint8*)malloc(copyLength * copyRows * bytesPerPixel);
-	
-			srcAddress	= bitmapBits + (((firstRow) * Bwidth + firstCol) * bytesPerPixel);
-			destAddress	= rectCopy;
-	
-			for (int32 j = 0; j < copyRows; j++)
+			region_move *move = (region_move*)pending.ItemAt(i);
+			BRegion dest(move->region);
+			dest.OffsetBy(move->dx, move->dy);
+
+			bool blocked = false;
+			for(int32 j=0; j < pending.CountItems() && !blocked; j++)
 			{
-				uint8		*destRowAddress	= destAddress + (j * copyLength * bytesPerPixel);
-				uint8		*srcRowAddress	= srcAddress + (j * Bwidth * bytesPerPixel);
-				memcpy(destRowAddress, srcRowAddress, copyLength * bytesPerPixel );
+				if(j == i)
+					continue;
+				BRegion overlap(dest);
+				overlap.IntersectWith(&((region_move*)pending.ItemAt(j))->region);
+				blocked = overlap.CountRects() > 0;
 			}
-		
-			rectList.AddItem(rectCopy);
+			if(!blocked)
+			{
+				next = i;
+				break;
+			}
+			if(i == pending.CountItems() - 1)
+				next = -1;
+		}
+
+		region_move *move;
+		if(next < 0)
+		{
+			// they all are in each other's way: set the first one aside
+			move = (region_move*)pending.RemoveItem((int32)0);
+			BRect frame(move->region.Frame());
+			move->staged = new UtilityBitmap(frame.OffsetToCopy(0, 0),
+				frameBuffer.ColorSpace(), 0);
+			copy_region_pixels(&move->region, &frameBuffer, move->staged,
+				frame.LeftTop(), true);
+			staged.AddItem(move);
+			continue;
 		}
+
+		move = (region_move*)pending.RemoveItem(next);
+		move_region_pixels(&move->region, &frameBuffer, move->dx, move->dy);
+
+		BRect dest(move->region.Frame().OffsetByCopy(move->dx, move->dy));
+		inval = inval.IsValid() ? inval | dest : dest;
 	}
 
-	int32		item = 0;
-	for(k=0; k < rCount; k++)
+	for(int32 i=0; i < staged.CountItems(); i++)
 	{
-		BRegion		*reg = (BRegion*)list->ItemAt(k);
-	
-		int32		rectCount = reg->CountRects();
-		for(i=0; i < rectCount; i++)
-		{
-			BRect		r		= reg->RectAt(i);
-			uint8		*rectCopy;
-			uint8		*srcAddress;
-			uint8		*destAddress;
-			int32		firstRow, lastRow;
-			int32		firstCol, lastCol;
-			int32		copyLength, copyLength2;
-			int32		copyRows, copyRows2;
-	
-			firstRow	= (int32)(r.top < 0? 0: r.top);
-			lastRow		= (int32)(r.bottom > (Bheight-1)? (Bheight-1): r.bottom);
-			firstCol	= (int32)(r.left < 0? 0: r.left);
-			lastCol		= (int32)(r.right > (Bwidth-1)? (Bwidth-1): r.right);
-			copyLength	= (lastCol - firstCol + 1) < 0? 0: (lastCol - firstCol + 1);
-			copyRows	= (lastRow - firstRow + 1) < 0? 0: (lastRow - firstRow + 1);
-	
-			rectCopy	= (uint8*)rectList.ItemAt(item++);
+		region_move *move = (region_move*)staged.ItemAt(i);
+		BRect frame(move->region.Frame());
+
+		move->region.OffsetBy(move->dx, move->dy);
+		copy_region_pixels(&move->region, &frameBuffer, move->staged,
+			frame.LeftTop() + BPoint(move->dx, move->dy), false);
+		delete move->staged;
+
+		BRect dest(move->region.Frame());
+		inval = inval.IsValid() ? inval | dest : dest;
+	}
+
+	for(int32 i=0; i < moves.CountItems(); i++)
+		delete (region_move*)moves.ItemAt(i);
+
+	fCursorHandler->DriverShow();
+
+	ReleaseBuffer();
+	Unlock();
+
+	if(inval.IsValid())
+		Invalidate(inval);
+}
+
+/*!
+	\brief Saves what is on screen in a region to a bitmap
+	\param region The region to save, in screen coordinates
+	\param bitmap Bitmap in the screen's color space to save it to
+	\param origin Where the top left corner of the bitmap lies on screen
 	
-			srcAddress	= rectCopy;
+	Parts of the region outside the screen or the bitmap are left alone. The
+	cursor is not saved.
+*/
+void DisplayDriver::SaveRegion(BRegion *region, ServerBitmap *bitmap, const BPoint &origin)
+{
+	Lock();
+
+	FBBitmap		frameBuffer;
 	
-			r.Set(firstCol, firstRow, lastCol, lastRow);
-			r.OffsetBy( *((BPoint*)pList->ItemAt(k%rCount)) );
-			firstRow	= (int32)(r.top < 0? 0: r.top);
-			lastRow		= (int32)(r.bottom > (Bheight-1)? (Bheight-1): r.bottom);
-			firstCol	= (int32)(r.left < 0? 0: r.left);
-			lastCol		= (int32)(r.right > (Bwidth-1)? (Bwidth-1): r.right);
-			copyLength2	= (lastCol - firstCol + 1) < 0? 0: (lastCol - firstCol + 1);
-			copyRows2	= (lastRow - firstRow + 1) < 0? 0: (lastRow - firstRow + 1);
+	if(!AcquireBuffer(&frameBuffer))
+	{
+		Unlock();
+		debugger("ERROR: Couldn't acquire framebuffer in SaveRegion()\n");
+		return;
+	}
 	
-			destAddress	= bitmapBits + (((firstRow) * Bwidth + firstCol) * bytesPerPixel);
+	bool hideCursor = fCursorHandler->IntersectsCursor(region->Frame());
+	if(hideCursor)
+		fCursorHandler->DriverHide();
 	
-			int32		minLength	= copyLength < copyLength2? copyLength: copyLength2;
-			int32		minRows		= copyRows < copyRows2? copyRows: copyRows2;
+	copy_region_pixels(region, &frameBuffer, bitmap, origin, true);
 	
-			for (int32 j = 0; j < minRows; j++)
-			{
-				uint8		*destRowAddress	= destAddress + (j * Bwidth * bytesPerPixel);
-				uint8		*srcRowAddress	= srcAddress + (j * copyLength * bytesPerPixel);
-				memcpy(destRowAddress, srcRowAddress, minLength * bytesPerPixel );
-			}
-		}
-	}
+	if(hideCursor)
+		fCursorHandler->DriverShow();
+	ReleaseBuffer();
+	Unlock();
+}
 
-	for(i=0; i < rectList.CountItems(); i++)
+/*!
+	\brief Puts back on screen what SaveRegion() saved
+	\param region The region to put back, in screen coordinates
+	\param bitmap Bitmap in the screen's color space it was saved to
+	\param origin Where the top left corner of the bitmap lies on screen
+*/
+void DisplayDriver::RestoreRegion(BRegion *region, ServerBitmap *bitmap, const BPoint &origin)
+{
+	Lock();
+
+	FBBitmap		frameBuffer;
+	
+	if(!AcquireBuffer(&frameBuffer))
 	{
-		void		*rectCopy;
-		rectCopy	= rectList.ItemAt(i);
-		if (rectCopy)
-			free(rectCopy);
+		Unlock();
+		debugger("ERROR: Couldn't acquire framebuffer in RestoreRegion()\n");
+		return;
 	}
-	rectList.MakeEmpty();
-
-	fCursorHandler->DriverShow();
 	
-	BRect		inval(bmp->Bounds());
+	BRect frame(region->Frame());
+	bool hideCursor = fCursorHandler->IntersectsCursor(frame);
+	if(hideCursor)
+		fCursorHandler->DriverHide();
+	
+	copy_region_pixels(region, &frameBuffer, bitmap, origin, false);
+	
+	if(hideCursor)
+		fCursorHandler->DriverShow();
 	ReleaseBuffer();
 	Unlock();
+	
+	Invalidate(frame);
+}
+
+/*!
+	\brief Copies pixels kept in a bitmap to the screen
+	\param region Where to copy them, in screen coordinates
+	\param bitmap Bitmap in the screen's color space holding them
+	\param origin Where the top left corner of the bitmap lies on screen
 
-//	ConstrainClippingRegion(clipReg);
-	Invalidate(inval);
-//	ConstrainClippingRegion(NULL);
+	Unlike RestoreRegion(), this is server drawing: it stays inside the
+	region given to ConstrainClippingRegion().
+*/
+void DisplayDriver::DrawPixels(BRegion *region, ServerBitmap *bitmap, const BPoint &origin)
+{
+	Lock();
+	BRegion *clip=ClippingRegion(NULL);
+	if(clip)
+	{
+		BRegion visible(*region);
+		visible.IntersectWith(clip);
+		if(visible.CountRects()>0)
+			RestoreRegion(&visible,bitmap,origin);
+	}
+	else if(region->CountRects()>0)
+		RestoreRegion(region,bitmap,origin);
+	Unlock();
 }
 
 void DisplayDriver::DrawString(const char *string, const int32 &length, const BPoint &pt, const RGBColor &color, escapement_delta *delta)
@@ -479,13 +841,12 @@ void DisplayDriver::DrawString(const char *string, const int32 &length, const BP
 	}
 
 	FT_Face face;
-	FT_GlyphSlot slot;
 	FT_Matrix rmatrix,smatrix;
 	FT_UInt glyph_index=0, previous=0;
 	FT_Vector pen,delta,space,nonspace;
-	int16 error=0;
 	int32 strlength,i;
 	Angle rotation(font->Rotation()), shear(font->Shear());
+	CachedGlyph *glyph;
 	
 	bool antialias=true;
 	
@@ -505,26 +866,18 @@ void DisplayDriver::DrawString(const char *string, const int32 &length, const BP
 	else
 		shear=90-(90-shearangle)*2;
 	
-	error=FT_New_Face(ftlib, style->GetPath(), 0, &face);
-	if(error)
+	fontcache->Lock();
+	face=fontcache->GetFace(style,font->Size());
+	if(!face)
 	{
+		fontcache->Unlock();
+		fCursorHandler->DriverShow();
 		Unlock();
 		return;
 	}
 
-	slot=face->glyph;
-
 	bool use_kerning=FT_HAS_KERNING(face) && font->Spacing()==B_STRING_SPACING;
-	
-	error=FT_Set_Char_Size(face, 0,int32(font->Size())*64,72,72);
-	if(error)
-	{
-		Unlock();
-		return;
-	}
 
-	// if we do any transformation, we do a call to FT_Set_Transform() here
-	
 	// First, rotate
 	rmatrix.xx = (FT_Fixed)( rotation.Cosine()*0x10000); 
 	rmatrix.xy = (FT_Fixed)(-rotation.Sine()*0x10000); 
@@ -549,17 +902,12 @@ void DisplayDriver::DrawString(const char *string, const int32 &length, const BP
 	pen.x=(int32)point.x * 64;
 	pen.y=(int32)point.y * 64;
 	
-	slot=face->glyph;
-
-	
 	strlength=strlen(string);
 	if(length<strlength)
 		strlength=length;
 
 	for(i=0;i<strlength;i++)
 	{
-		FT_Set_Transform(face,&smatrix,&pen);
-
 		// Handle escapement padding option
 		if((uint8)string[i]<=0x20)
 		{
@@ -572,32 +920,32 @@ void DisplayDriver::DrawString(const char *string, const int32 &length, const BP
 			pen.y+=nonspace.y;
 		}
 
-	
-		// get kerning and move pen
-		if(use_kerning && previous && glyph_index)
+		// get kerning and move pen. BFont measures strings with the same pairs.
+		if(use_kerning)
 		{
-			FT_Get_Kerning(face, previous, glyph_index,ft_kerning_default, &delta);
-			pen.x+=delta.x;
-			pen.y+=delta.y;
+			glyph_index=FT_Get_Char_Index(face,(uint8)string[i]);
+			if(previous && glyph_index)
+			{
+				FT_Get_Kerning(face, previous, glyph_index,ft_kerning_default, &delta);
+				pen.x+=delta.x;
+				pen.y+=delta.y;
+			}
+			previous=glyph_index;
 		}
 
-		error=FT_Load_Char(face,string[i],
-			((antialias)?FT_LOAD_RENDER:FT_LOAD_RENDER | FT_LOAD_MONOCHROME) );
+		// Glyphs come from the cache positioned relative to the pen's pixel
+		glyph=fontcache->GetGlyph(face,(uint8)string[i],
+			(antialias)?GLYPH_RENDER_GRAY:GLYPH_RENDER_MONO, &smatrix, pen);
+		if(!glyph)
+			continue;
 
-		if(!error)
-		{
-			if(antialias)
-				BlitGray2RGB32(&slot->bitmap,
-					BPoint(slot->bitmap_left,point.y-(slot->bitmap_top-point.y)), d);
-			else
-				BlitMono2RGB32(&slot->bitmap,
-					BPoint(slot->bitmap_left,point.y-(slot->bitmap_top-point.y)), d);
-		}
+		int32 left=(pen.x>>6)+glyph->left;
+		int32 top=(pen.y>>6)+glyph->top;
+		DrawGlyph(&glyph->bitmap, BPoint(left,point.y-(top-point.y)), antialias, ClippingRegion(d), d);
 
 		// increment pen position
-		pen.x+=slot->advance.x;
-		pen.y+=slot->advance.y;
-		previous=glyph_index;
+		pen.x+=glyph->advance.x;
+		pen.y+=glyph->advance.y;
 	}
 
 	// TODO: implement calculation of invalid rectangle in DisplayDriver::DrawString properly
@@ -607,6 +955,8 @@ void DisplayDriver::DrawString(const char *string, const int32 &length, const BP
 	r.top=point.y-face->height;
 	r.bottom=point.y+face->height;
 	
+	fontcache->Unlock();
+
 	fCursorHandler->DriverShow();
 	Invalidate(r);
 	
@@ -614,18 +964,33 @@ void DisplayDriver::DrawString(const char *string, const int32 &length, const BP
 	d->penlocation.x=pen.x / 64;
 	d->penlocation.y=pen.y / 64;
 	
-	FT_Done_Face(face);
-
 	Unlock();
 
 }
 
-void DisplayDriver::BlitMono2RGB32(FT_Bitmap *src, const BPoint &pt, const DrawData *d)
+/*!
+	\brief Finds the part of a glyph to draw
+	\param src The glyph's bitmap
+	\param pt Where its top left corner goes
+	\param clip Part of the screen it may be drawn in
+	\param framebuffer The screen
+	\param area Set to the part of the screen to draw in
+	\return false if nothing of the glyph is to be drawn
+*/
+static bool glyph_area(FT_Bitmap *src, const BPoint &pt, const clipping_rect &clip,
+	FBBitmap &framebuffer, clipping_rect *area)
+{
+	int32 x=(int32)pt.x, y=(int32)pt.y;
+	area->left=MAX(MAX(x,clip.left),0);
+	area->top=MAX(MAX(y,clip.top),0);
+	area->right=MIN(MIN(x+src->width-1,clip.right),framebuffer.Bounds().IntegerWidth());
+	area->bottom=MIN(MIN(y+src->rows-1,clip.bottom),framebuffer.Bounds().IntegerHeight());
+	return area->left<=area->right && area->top<=area->bottom;
+}
+
+void DisplayDriver::BlitMono2RGB32(FT_Bitmap *src, const BPoint &pt, const clipping_rect &clip, const DrawData *d)
 {
 	rgb_color color=d->highcolor.GetColor32();
-	
-	// pointers to the top left corner of the area to be copied in each bitmap
-	uint8 *srcbuffer, *destbuffer;
 	FBBitmap framebuffer;
 	
 	if(!AcquireBuffer(&framebuffer))
@@ -634,88 +999,43 @@ void DisplayDriver::BlitMono2RGB32(FT_Bitmap *src, const BPoint &pt, const DrawD
 		return;
 	}
 	
-	// index pointers which are incremented during the course of the blit
-	uint8 *srcindex, *destindex, *rowptr, value;
-	
-	// increment values for the index pointers
-	int32 srcinc=src->pitch, destinc=framebuffer.BytesPerRow();
-	
-	int16 i,j,k, srcwidth=src->pitch, srcheight=src->rows;
-	int32 x=(int32)pt.x,y=(int32)pt.y;
-	
-	// starting point in source bitmap
-	srcbuffer=(uint8*)src->buffer;
-
-	if(y<0)
-	{
-		if(y<pt.y)
-			y++;
-		srcbuffer+=srcinc * (0-y);
-		srcheight-=srcinc;
-		destbuffer+=destinc * (0-y);
-	}
-
-	if(y+srcheight>framebuffer.Bounds().IntegerHeight())
-	{
-		if(y>pt.y)
-			y--;
-		srcheight-=(y+srcheight-1)-framebuffer.Bounds().IntegerHeight();
-	}
-
-	if(x+srcwidth>framebuffer.Bounds().IntegerWidth())
-	{
-		if(x>pt.x)
-			x--;
-		srcwidth-=(x+srcwidth-1)-framebuffer.Bounds().IntegerWidth();
-	}
-	
-	if(x<0)
+	clipping_rect area;
+	if(!glyph_area(src,pt,clip,framebuffer,&area))
 	{
-		if(x<pt.x)
-			x++;
-		srcbuffer+=(0-x)>>3;
-		srcwidth-=0-x;
-		destbuffer+=(0-x)*4;
+		ReleaseBuffer();
+		return;
 	}
-	
-	// starting point in destination bitmap
-	destbuffer=(uint8*)framebuffer.Bits()+int32( (pt.y*framebuffer.BytesPerRow())+(pt.x*4) );
 
-	srcindex=srcbuffer;
-	destindex=destbuffer;
+	int32 x=(int32)pt.x, y=(int32)pt.y;
+	int32 destinc=framebuffer.BytesPerRow();
+	uint8 *destindex=(uint8*)framebuffer.Bits()+area.top*destinc+area.left*4;
+	uint8 *srcindex=(uint8*)src->buffer+(area.top-y)*src->pitch;
 
-	for(i=0; i<srcheight; i++)
+	for(int32 i=area.top; i<=area.bottom; i++)
 	{
-		rowptr=destindex;		
+		uint8 *rowptr=destindex;
 
-		for(j=0;j<srcwidth;j++)
+		for(int32 j=area.left; j<=area.right; j++)
 		{
-			for(k=0; k<8; k++)
+			int32 bit=j-x;
+			if(srcindex[bit>>3] & (1 << (7-(bit&7))))
 			{
-				value=*(srcindex+j) & (1 << (7-k));
-				if(value)
-				{
-					rowptr[0]=color.blue;
-					rowptr[1]=color.green;
-					rowptr[2]=color.red;
-					rowptr[3]=color.alpha;
-				}
-
-				rowptr+=4;
+				rowptr[0]=color.blue;
+				rowptr[1]=color.green;
+				rowptr[2]=color.red;
+				rowptr[3]=color.alpha;
 			}
-
+			rowptr+=4;
 		}
 		
-		srcindex+=srcinc;
+		srcindex+=src->pitch;
 		destindex+=destinc;
 	}
 	ReleaseBuffer();
 }
 
-void DisplayDriver::BlitGray2RGB32(FT_Bitmap *src, const BPoint &pt, const DrawData *d)
+void DisplayDriver::BlitGray2RGB32(FT_Bitmap *src, const BPoint &pt, const clipping_rect &clip, const DrawData *d)
 {
-	// pointers to the top left corner of the area to be copied in each bitmap
-	uint8 *srcbuffer=NULL, *destbuffer=NULL;
 	FBBitmap framebuffer;
 	
 	if(!AcquireBuffer(&framebuffer))
@@ -724,81 +1044,31 @@ void DisplayDriver::BlitGray2RGB32(FT_Bitmap *src, const BPoint &pt, const DrawD
 		return;
 	}
 	
-	// index pointers which are incremented during the course of the blit
-	uint8 *srcindex=NULL, *destindex=NULL, *rowptr=NULL;
-	
-	rgb_color highcolor=d->highcolor.GetColor32(), lowcolor=d->lowcolor.GetColor32();	float rstep,gstep,bstep,astep;
-
-	rstep=float(highcolor.red-lowcolor.red)/255.0;
-	gstep=float(highcolor.green-lowcolor.green)/255.0;
-	bstep=float(highcolor.blue-lowcolor.blue)/255.0;
-	astep=float(highcolor.alpha-lowcolor.alpha)/255.0;
-	
-	// increment values for the index pointers
-	int32 x=(int32)pt.x,
-		y=(int32)pt.y,
-		srcinc=src->pitch,
-//		destinc=dest->BytesPerRow(),
-		destinc=framebuffer.BytesPerRow(),
-		srcwidth=src->width,
-		srcheight=src->rows,
-		incval=0;
-	
-	int16 i,j;
-	
-	// starting point in source bitmap
-	srcbuffer=(uint8*)src->buffer;
-
-	// starting point in destination bitmap
-	destbuffer=(uint8*)framebuffer.Bits()+(y*framebuffer.BytesPerRow()+(x*4));
-
-
-	if(y<0)
+	clipping_rect area;
+	if(!glyph_area(src,pt,clip,framebuffer,&area))
 	{
-		if(y<pt.y)
-			y++;
-		
-		incval=0-y;
-		
-		srcbuffer+=incval * srcinc;
-		srcheight-=incval;
-		destbuffer+=incval * destinc;
+		ReleaseBuffer();
+		return;
 	}
 
-	if(y+srcheight>framebuffer.Bounds().IntegerHeight())
-	{
-		if(y>pt.y)
-			y--;
-		srcheight-=(y+srcheight-1)-framebuffer.Bounds().IntegerHeight();
-	}
+	rgb_color highcolor=d->highcolor.GetColor32(), lowcolor=d->lowcolor.GetColor32();
+	float rstep,gstep,bstep;
 
-	if(x+srcwidth>framebuffer.Bounds().IntegerWidth())
-	{
-		if(x>pt.x)
-			x--;
-		srcwidth-=(x+srcwidth-1)-framebuffer.Bounds().IntegerWidth();
-	}
+	rstep=float(highcolor.red-lowcolor.red)/255.0;
+	gstep=float(highcolor.green-lowcolor.green)/255.0;
+	bstep=float(highcolor.blue-lowcolor.blue)/255.0;
 	
-	if(x<0)
-	{
-		if(x<pt.x)
-			x++;
-		incval=0-x;
-		srcbuffer+=incval;
-		srcwidth-=incval;
-		destbuffer+=incval*4;
-	}
-
+	int32 x=(int32)pt.x, y=(int32)pt.y;
+	int32 destinc=framebuffer.BytesPerRow();
+	uint8 *destindex=(uint8*)framebuffer.Bits()+area.top*destinc+area.left*4;
+	uint8 *srcindex=(uint8*)src->buffer+(area.top-y)*src->pitch+(area.left-x);
 	int32 value;
 
-	srcindex=srcbuffer;
-	destindex=destbuffer;
-
-	for(i=0; i<srcheight; i++)
+	for(int32 i=area.top; i<=area.bottom; i++)
 	{
-		rowptr=destindex;		
+		uint8 *rowptr=destindex;
 
-		for(j=0;j<srcwidth;j++)
+		for(int32 j=0; j<=area.right-area.left; j++)
 		{
 			value=*(srcindex+j) ^ 255;
 
@@ -824,775 +1094,125 @@ void DisplayDriver::BlitGray2RGB32(FT_Bitmap *src, const BPoint &pt, const DrawD
 					}
 			}
 			rowptr+=4;
-
 		}
 		
-		srcindex+=srcinc;
+		srcindex+=src->pitch;
 		destindex+=destinc;
 	}
 	ReleaseBuffer();
 }
 
-bool DisplayDriver::AcquireBuffer(FBBitmap *bmp)
-{
-	return false;
-}
-
-void DisplayDriver::ReleaseBuffer(void)
-{
-}
-
-void DisplayDriver::Invalidate(const BRect &r)
-{
-}
-
 /*!
-	\brief Called for all BView::FillArc calls
-	\param r Rectangle enclosing the entire arc
-	\param angle Starting angle for the arc in degrees
-	\param span Span of the arc in degrees. Ending angle = angle+span.
-	\param color The color of the arc
-*/
-void DisplayDriver::FillArc(const BRect &r, const float &angle, const float &span, const RGBColor &color)
-{
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	float xc = (r.left+r.right)/2;
-	float yc = (r.top+r.bottom)/2;
-	float rx = r.Width()/2;
-	float ry = r.Height()/2;
-	int Rx2 = ROUND(rx*rx);
-	int Ry2 = ROUND(ry*ry);
-	int twoRx2 = 2*Rx2;
-	int twoRy2 = 2*Ry2;
-	int p;
-	int x=0;
-	int y = (int)ry;
-	int px = 0;
-	int py = twoRx2 * y;
-	int startx, endx;
-	int starty, endy;
-	int xclip, startclip, endclip;
-	int startQuad, endQuad;
-	bool useQuad1, useQuad2, useQuad3, useQuad4;
-	bool shortspan = false;
-
-	// Watch out for bozos giving us whacko spans
-	if ( (span >= 360) || (span <= -360) )
-	{
-		FillEllipse(r,color);
-		fCursorHandler->DriverShow();
-		return;
-	}
-
-	Lock();
-
-	if ( span > 0 )
-	{
-		startQuad = (int)(angle/90)%4+1;
-		endQuad = (int)((angle+span)/90)%4+1;
-		startx = ROUND(.5*r.Width()*fabs(cos(angle*M_PI/180)));
-		endx = ROUND(.5*r.Width()*fabs(cos((angle+span)*M_PI/180)));
-	}
-	else
-	{
-		endQuad = (int)(angle/90)%4+1;
-		startQuad = (int)((angle+span)/90)%4+1;
-		endx = ROUND(.5*r.Width()*fabs(cos(angle*M_PI/180)));
-		startx = ROUND(.5*r.Width()*fabs(cos((angle+span)*M_PI/180)));
-	}
-
-	starty = ROUND(ry*sqrt(1-(double)startx*startx/(rx*rx)));
-	endy = ROUND(ry*sqrt(1-(double)endx*endx/(rx*rx)));
-
-	if ( startQuad != endQuad )
-	{
-		useQuad1 = (endQuad > 1) && (startQuad > endQuad);
-		useQuad2 = ((startQuad == 1) && (endQuad > 2)) || ((startQuad > endQuad) && (endQuad > 2));
-		useQuad3 = ((startQuad < 3) && (endQuad == 4)) || ((startQuad < 3) && (endQuad < startQuad));
-		useQuad4 = (startQuad < 4) && (startQuad > endQuad);
-	}
-	else
-	{
-		if ( (span < 90) && (span > -90) )
-		{
-			useQuad1 = false;
-			useQuad2 = false;
-			useQuad3 = false;
-			useQuad4 = false;
-			shortspan = true;
-		}
-		else
-		{
-			useQuad1 = (startQuad != 1);
-			useQuad2 = (startQuad != 2);
-			useQuad3 = (startQuad != 3);
-			useQuad4 = (startQuad != 4);
-		}
-	}
-
-	if ( useQuad1 )
-		StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-	if ( useQuad2 )
-		StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc-x),ROUND(yc-y),color);
-	if ( useQuad3 )
-		StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc-x),ROUND(yc+y),color);
-	if ( useQuad4 )
-		StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-
-	p = ROUND (Ry2 - (Rx2 * ry) + (.25 * Rx2));
-	while (px < py)
-	{
-		x++;
-		px += twoRy2;
-		if ( p < 0 )
-			p += Ry2 + px;
-		else
-		{
-			y--;
-			py -= twoRx2;
-			p += Ry2 + px - py;
-		}
+	\brief Draws a glyph, leaving out what is outside a clipping region
+	\param src The glyph's bitmap
+	\param pt Where its top left corner goes
+	\param antialias true if src has a gray level for each pixel, false for one bit
+	\param clip The region, or NULL to draw the whole glyph
+	\param d Colors and drawing mode
 
-		if ( useQuad1 )
-			StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-		if ( useQuad2 )
-			StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc-x),ROUND(yc-y),color);
-		if ( useQuad3 )
-			StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc-x),ROUND(yc+y),color);
-		if ( useQuad4 )
-			StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-		if ( !shortspan )
-		{
-			if ( startQuad == 1 )
-			{
-				if ( x <= startx )
-					StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-				else
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc+xclip),ROUND(yc-y),color);
-				}
-			}
-			else if ( startQuad == 2 )
-			{
-				if ( x >= startx )
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc-y),ROUND(xc-xclip),ROUND(yc-y),color);
-				}
-			}
-			else if ( startQuad == 3 )
-			{
-				if ( x <= startx )
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc+y),ROUND(xc),ROUND(yc+y),color);
-				else
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeSolidLine(ROUND(xc-xclip),ROUND(yc+y),ROUND(xc),ROUND(yc+y),color);
-				}
-			}
-			else if ( startQuad == 4 )
-			{
-				if ( x >= startx )
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeSolidLine(ROUND(xc+xclip),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-				}
-			}
-
-			if ( endQuad == 1 )
-			{
-				if ( x >= endx )
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeSolidLine(ROUND(xc+xclip),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-				}
-			}
-			else if ( endQuad == 2 )
-			{
-				if ( x <= endx )
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc-y),ROUND(xc),ROUND(yc-y),color);
-				else
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeSolidLine(ROUND(xc-xclip),ROUND(yc-y),ROUND(xc),ROUND(yc-y),color);
-				}
-			}
-			else if ( endQuad == 3 )
-			{
-				if ( x >= endx )
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc+y),ROUND(xc-xclip),ROUND(yc+y),color);
-				}
-			}
-			else if ( endQuad == 4 )
-			{
-				if ( x <= endx )
-					StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-				else
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc+xclip),ROUND(yc+y),color);
-				}
-			}
-		}
-		else
-		{
-			startclip = ROUND(y*startx/(double)starty);
-			endclip = ROUND(y*endx/(double)endy);
-			if ( startQuad == 1 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeSolidLine(ROUND(xc+endclip),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-				else
-					StrokeSolidLine(ROUND(xc+endclip),ROUND(yc-y),ROUND(xc+startclip),ROUND(yc-y),color);
-			}
-			else if ( startQuad == 2 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc-y),ROUND(xc-startclip),ROUND(yc-y),color);
-				else
-					StrokeSolidLine(ROUND(xc-endclip),ROUND(yc-y),ROUND(xc-startclip),ROUND(yc-y),color);
-			}
-			else if ( startQuad == 3 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc+y),ROUND(xc-endclip),ROUND(yc+y),color);
-				else
-					StrokeSolidLine(ROUND(xc-startclip),ROUND(yc+y),ROUND(xc-endclip),ROUND(yc+y),color);
-			}
-			else if ( startQuad == 4 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeSolidLine(ROUND(xc+startclip),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-				else
-					StrokeSolidLine(ROUND(xc+startclip),ROUND(yc+y),ROUND(xc+endclip),ROUND(yc+y),color);
-			}
-		}
-	}
-
-	p = ROUND(Ry2*(x+.5)*(x+.5) + Rx2*(y-1)*(y-1) - Rx2*Ry2);
-	while (y>0)
-	{
-		y--;
-		py -= twoRx2;
-		if (p>0)
-			p += Rx2 - py;
-		else
-		{
-			x++;
-			px += twoRy2;
-			p += Rx2 - py +px;
-		}
-
-		if ( useQuad1 )
-			StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-		if ( useQuad2 )
-			StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc-x),ROUND(yc-y),color);
-		if ( useQuad3 )
-			StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc-x),ROUND(yc+y),color);
-		if ( useQuad4 )
-			StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-		if ( !shortspan )
-		{
-			if ( startQuad == 1 )
-			{
-				if ( x <= startx )
-					StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-				else
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc+xclip),ROUND(yc-y),color);
-				}
-			}
-			else if ( startQuad == 2 )
-			{
-				if ( x >= startx )
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc-y),ROUND(xc-xclip),ROUND(yc-y),color);
-				}
-			}
-			else if ( startQuad == 3 )
-			{
-				if ( x <= startx )
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc+y),ROUND(xc),ROUND(yc+y),color);
-				else
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeSolidLine(ROUND(xc-xclip),ROUND(yc+y),ROUND(xc),ROUND(yc+y),color);
-				}
-			}
-			else if ( startQuad == 4 )
-			{
-				if ( x >= startx )
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeSolidLine(ROUND(xc+xclip),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-				}
-			}
-
-			if ( endQuad == 1 )
-			{
-				if ( x >= endx )
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeSolidLine(ROUND(xc+xclip),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-				}
-			}
-			else if ( endQuad == 2 )
-			{
-				if ( x <= endx )
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc-y),ROUND(xc),ROUND(yc-y),color);
-				else
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeSolidLine(ROUND(xc-xclip),ROUND(yc-y),ROUND(xc),ROUND(yc-y),color);
-				}
-			}
-			else if ( endQuad == 3 )
-			{
-				if ( x >= endx )
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc+y),ROUND(xc-xclip),ROUND(yc+y),color);
-				}
-			}
-			else if ( endQuad == 4 )
-			{
-				if ( x <= endx )
-					StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-				else
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc+xclip),ROUND(yc+y),color);
-				}
-			}
-		}
-		else
-		{
-			startclip = ROUND(y*startx/(double)starty);
-			endclip = ROUND(y*endx/(double)endy);
-			if ( startQuad == 1 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeSolidLine(ROUND(xc+endclip),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-				else
-					StrokeSolidLine(ROUND(xc+endclip),ROUND(yc-y),ROUND(xc+startclip),ROUND(yc-y),color);
-			}
-			else if ( startQuad == 2 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc-y),ROUND(xc-startclip),ROUND(yc-y),color);
-				else
-					StrokeSolidLine(ROUND(xc-endclip),ROUND(yc-y),ROUND(xc-startclip),ROUND(yc-y),color);
-			}
-			else if ( startQuad == 3 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeSolidLine(ROUND(xc-x),ROUND(yc+y),ROUND(xc-endclip),ROUND(yc+y),color);
-				else
-					StrokeSolidLine(ROUND(xc-startclip),ROUND(yc+y),ROUND(xc-endclip),ROUND(yc+y),color);
-			}
-			else if ( startQuad == 4 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeSolidLine(ROUND(xc+startclip),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-				else
-					StrokeSolidLine(ROUND(xc+startclip),ROUND(yc+y),ROUND(xc+endclip),ROUND(yc+y),color);
-			}
-		}
-	}
-	fCursorHandler->DriverShow();
-	Invalidate(r);
-	Unlock();
-}
-
-/*!
-	\brief Called for all BView::FillArc calls
-	\param r Rectangle enclosing the entire arc
-	\param angle Starting angle for the arc in degrees
-	\param span Span of the arc in degrees. Ending angle = angle+span.
-	\param d  Object holding the bazillion other options
+	The driver must be locked.
 */
-
-void DisplayDriver::FillArc(const BRect &r, const float &angle, const float &span, const DrawData *d)
+void DisplayDriver::DrawGlyph(FT_Bitmap *src, const BPoint &pt, bool antialias, BRegion *clip,
+	const DrawData *d)
 {
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	float xc = (r.left+r.right)/2;
-	float yc = (r.top+r.bottom)/2;
-	float rx = r.Width()/2;
-	float ry = r.Height()/2;
-	int Rx2 = ROUND(rx*rx);
-	int Ry2 = ROUND(ry*ry);
-	int twoRx2 = 2*Rx2;
-	int twoRy2 = 2*Ry2;
-	int p;
-	int x=0;
-	int y = (int)ry;
-	int px = 0;
-	int py = twoRx2 * y;
-	int startx, endx;
-	int starty, endy;
-	int xclip, startclip, endclip;
-	int startQuad, endQuad;
-	bool useQuad1, useQuad2, useQuad3, useQuad4;
-	bool shortspan = false;
-	DrawData data;
-
-	// Watch out for bozos giving us whacko spans
-	if ( (span >= 360) || (span <= -360) )
-	{
-		FillEllipse(r,d);
-		fCursorHandler->DriverShow();
+	clipping_rect bounds;
+	bounds.left=(int32)pt.x;
+	bounds.top=(int32)pt.y;
+	bounds.right=bounds.left+src->width-1;
+	bounds.bottom=bounds.top+src->rows-1;
+	if(bounds.left>bounds.right || bounds.top>bounds.bottom)
 		return;
-	}
-
-	Lock();
-
-	data = *d;
-	data.pensize = 1;
-
-	if ( span > 0 )
-	{
-		startQuad = (int)(angle/90)%4+1;
-		endQuad = (int)((angle+span)/90)%4+1;
-		startx = ROUND(.5*r.Width()*fabs(cos(angle*M_PI/180)));
-		endx = ROUND(.5*r.Width()*fabs(cos((angle+span)*M_PI/180)));
-	}
-	else
-	{
-		endQuad = (int)(angle/90)%4+1;
-		startQuad = (int)((angle+span)/90)%4+1;
-		endx = ROUND(.5*r.Width()*fabs(cos(angle*M_PI/180)));
-		startx = ROUND(.5*r.Width()*fabs(cos((angle+span)*M_PI/180)));
-	}
-
-	starty = ROUND(ry*sqrt(1-(double)startx*startx/(rx*rx)));
-	endy = ROUND(ry*sqrt(1-(double)endx*endx/(rx*rx)));
-
-	if ( startQuad != endQuad )
-	{
-		useQuad1 = (endQuad > 1) && (startQuad > endQuad);
-		useQuad2 = ((startQuad == 1) && (endQuad > 2)) || ((startQuad > endQuad) && (endQuad > 2));
-		useQuad3 = ((startQuad < 3) && (endQuad == 4)) || ((startQuad < 3) && (endQuad < startQuad));
-		useQuad4 = (startQuad < 4) && (startQuad > endQuad);
-	}
-	else
-	{
-		if ( (span < 90) && (span > -90) )
-		{
-			useQuad1 = false;
-			useQuad2 = false;
-			useQuad3 = false;
-			useQuad4 = false;
-			shortspan = true;
-		}
-		else
-		{
-			useQuad1 = (startQuad != 1);
-			useQuad2 = (startQuad != 2);
-			useQuad3 = (startQuad != 3);
-			useQuad4 = (startQuad != 4);
-		}
-	}
-
-	if ( useQuad1 )
-		StrokeLine(BPoint(xc,yc-y),BPoint(xc+x,yc-y),&data);
-	if ( useQuad2 )
-		StrokeLine(BPoint(xc,yc-y),BPoint(xc-x,yc-y),&data);
-	if ( useQuad3 )
-		StrokeLine(BPoint(xc,yc+y),BPoint(xc-x,yc+y),&data);
-	if ( useQuad4 )
-		StrokeLine(BPoint(xc,yc+y),BPoint(xc+x,yc+y),&data);
-
-	p = ROUND (Ry2 - (Rx2 * ry) + (.25 * Rx2));
-	while (px < py)
-	{
-		x++;
-		px += twoRy2;
-		if ( p < 0 )
-			p += Ry2 + px;
-		else
-		{
-			y--;
-			py -= twoRx2;
-			p += Ry2 + px - py;
-		}
-
-		if ( useQuad1 )
-			StrokeLine(BPoint(xc,yc-y),BPoint(xc+x,yc-y),&data);
-		if ( useQuad2 )
-			StrokeLine(BPoint(xc,yc-y),BPoint(xc-x,yc-y),&data);
-		if ( useQuad3 )
-			StrokeLine(BPoint(xc,yc+y),BPoint(xc-x,yc+y),&data);
-		if ( useQuad4 )
-			StrokeLine(BPoint(xc,yc+y),BPoint(xc+x,yc+y),&data);
-		if ( !shortspan )
-		{
-			if ( startQuad == 1 )
-			{
-				if ( x <= startx )
-					StrokeLine(BPoint(xc,yc-y),BPoint(xc+x,yc-y),&data);
-				else
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeLine(BPoint(xc,yc-y),BPoint(xc+xclip,yc-y),&data);
-				}
-			}
-			else if ( startQuad == 2 )
-			{
-				if ( x >= startx )
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeLine(BPoint(xc-x,yc-y),BPoint(xc-xclip,yc-y),&data);
-				}
-			}
-			else if ( startQuad == 3 )
-			{
-				if ( x <= startx )
-					StrokeLine(BPoint(xc-x,yc+y),BPoint(xc,yc+y),&data);
-				else
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeLine(BPoint(xc-xclip,yc+y),BPoint(xc,yc+y),&data);
-				}
-			}
-			else if ( startQuad == 4 )
-			{
-				if ( x >= startx )
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeLine(BPoint(xc+xclip,yc+y),BPoint(xc+x,yc+y),&data);
-				}
-			}
-
-			if ( endQuad == 1 )
-			{
-				if ( x >= endx )
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeLine(BPoint(xc+xclip,yc-y),BPoint(xc+x,yc-y),&data);
-				}
-			}
-			else if ( endQuad == 2 )
-			{
-				if ( x <= endx )
-					StrokeLine(BPoint(xc-x,yc-y),BPoint(xc,yc-y),&data);
-				else
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeLine(BPoint(xc-xclip,yc-y),BPoint(xc,yc-y),&data);
-				}
-			}
-			else if ( endQuad == 3 )
-			{
-				if ( x >= endx )
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeLine(BPoint(xc-x,yc+y),BPoint(xc-xclip,yc+y),&data);
-				}
-			}
-			else if ( endQuad == 4 )
-			{
-				if ( x <= endx )
-					StrokeLine(BPoint(xc,yc+y),BPoint(xc+x,yc+y),&data);
-				else
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeLine(BPoint(xc,yc+y),BPoint(xc+xclip,yc+y),&data);
-				}
-			}
-		}
-		else
-		{
-			startclip = ROUND(y*startx/(double)starty);
-			endclip = ROUND(y*endx/(double)endy);
-			if ( startQuad == 1 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeLine(BPoint(xc+endclip,yc-y),BPoint(xc+x,yc-y),&data);
-				else
-					StrokeLine(BPoint(xc+endclip,yc-y),BPoint(xc+startclip,yc-y),&data);
-			}
-			else if ( startQuad == 2 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeLine(BPoint(xc-x,yc-y),BPoint(xc-startclip,yc-y),&data);
-				else
-					StrokeLine(BPoint(xc-endclip,yc-y),BPoint(xc-startclip,yc-y),&data);
-			}
-			else if ( startQuad == 3 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeLine(BPoint(xc-x,yc+y),BPoint(xc-endclip,yc+y),&data);
-				else
-					StrokeLine(BPoint(xc-startclip,yc+y),BPoint(xc-endclip,yc+y),&data);
-			}
-			else if ( startQuad == 4 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeLine(BPoint(xc+startclip,yc+y),BPoint(xc+x,yc+y),&data);
-				else
-					StrokeLine(BPoint(xc+startclip,yc+y),BPoint(xc+endclip,yc+y),&data);
-			}
-		}
-	}
 
-	p = ROUND(Ry2*(x+.5)*(x+.5) + Rx2*(y-1)*(y-1) - Rx2*Ry2);
-	while (y>0)
+	if(!clip)
 	{
-		y--;
-		py -= twoRx2;
-		if (p>0)
-			p += Rx2 - py;
-		else
-		{
-			x++;
-			px += twoRy2;
-			p += Rx2 - py +px;
-		}
-
-		if ( useQuad1 )
-			StrokeLine(BPoint(xc,yc-y),BPoint(xc+x,yc-y),&data);
-		if ( useQuad2 )
-			StrokeLine(BPoint(xc,yc-y),BPoint(xc-x,yc-y),&data);
-		if ( useQuad3 )
-			StrokeLine(BPoint(xc,yc+y),BPoint(xc-x,yc+y),&data);
-		if ( useQuad4 )
-			StrokeLine(BPoint(xc,yc+y),BPoint(xc+x,yc+y),&data);
-		if ( !shortspan )
-		{
-			if ( startQuad == 1 )
-			{
-				if ( x <= startx )
-					StrokeLine(BPoint(xc,yc-y),BPoint(xc+x,yc-y),&data);
-				else
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeLine(BPoint(xc,yc-y),BPoint(xc+xclip,yc-y),&data);
-				}
-			}
-			else if ( startQuad == 2 )
-			{
-				if ( x >= startx )
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeLine(BPoint(xc-x,yc-y),BPoint(xc-xclip,yc-y),&data);
-				}
-			}
-			else if ( startQuad == 3 )
-			{
-				if ( x <= startx )
-					StrokeLine(BPoint(xc-x,yc+y),BPoint(xc,yc+y),&data);
-				else
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeLine(BPoint(xc-xclip,yc+y),BPoint(xc,yc+y),&data);
-				}
-			}
-			else if ( startQuad == 4 )
-			{
-				if ( x >= startx )
-				{
-					xclip = ROUND(y*startx/(double)starty);
-					StrokeLine(BPoint(xc+xclip,yc+y),BPoint(xc+x,yc+y),&data);
-				}
-			}
-
-			if ( endQuad == 1 )
-			{
-				if ( x >= endx )
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeLine(BPoint(xc+xclip,yc-y),BPoint(xc+x,yc-y),&data);
-				}
-			}
-			else if ( endQuad == 2 )
-			{
-				if ( x <= endx )
-					StrokeLine(BPoint(xc-x,yc-y),BPoint(xc,yc-y),&data);
-				else
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeLine(BPoint(xc-xclip,yc-y),BPoint(xc,yc-y),&data);
-				}
-			}
-			else if ( endQuad == 3 )
-			{
-				if ( x >= endx )
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeLine(BPoint(xc-x,yc+y),BPoint(xc-xclip,yc+y),&data);
-				}
-			}
-			else if ( endQuad == 4 )
-			{
-				if ( x <= endx )
-					StrokeLine(BPoint(xc,yc+y),BPoint(xc+x,yc+y),&data);
-				else
-				{
-					xclip = ROUND(y*endx/(double)endy);
-					StrokeLine(BPoint(xc,yc+y),BPoint(xc+xclip,yc+y),&data);
-				}
-			}
-		}
-		else
-		{
-			startclip = ROUND(y*startx/(double)starty);
-			endclip = ROUND(y*endx/(double)endy);
-			if ( startQuad == 1 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeLine(BPoint(xc+endclip,yc-y),BPoint(xc+x,yc-y),&data);
-				else
-					StrokeLine(BPoint(xc+endclip,yc-y),BPoint(xc+startclip,yc-y),&data);
-			}
-			else if ( startQuad == 2 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeLine(BPoint(xc-x,yc-y),BPoint(xc-startclip,yc-y),&data);
-				else
-					StrokeLine(BPoint(xc-endclip,yc-y),BPoint(xc-startclip,yc-y),&data);
-			}
-			else if ( startQuad == 3 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeLine(BPoint(xc-x,yc+y),BPoint(xc-endclip,yc+y),&data);
-				else
-					StrokeLine(BPoint(xc-startclip,yc+y),BPoint(xc-endclip,yc+y),&data);
-			}
-			else if ( startQuad == 4 )
-			{
-				if ( (x <= startx) && (x >= endx) )
-					StrokeLine(BPoint(xc+startclip,yc+y),BPoint(xc+x,yc+y),&data);
-				else
-					StrokeLine(BPoint(xc+startclip,yc+y),BPoint(xc+endclip,yc+y),&data);
-			}
-		}
+		if(antialias)
+			BlitGray2RGB32(src,pt,bounds,d);
+		else
+			BlitMono2RGB32(src,pt,bounds,d);
+		return;
 	}
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+
+	fClipRects.Set(clip,bounds);
+	for(int32 i=0; i<fClipRects.CountRects(); i++)
+	{
+		if(antialias)
+			BlitGray2RGB32(src,pt,fClipRects.RectAtInt(i),d);
+		else
+			BlitMono2RGB32(src,pt,fClipRects.RectAtInt(i),d);
+	}
+}
+
+bool DisplayDriver::AcquireBuffer(FBBitmap *bmp)
+{
+	return false;
+}
+
+void DisplayDriver::ReleaseBuffer(void)
+{
+}
+
+void DisplayDriver::Invalidate(const BRect &r)
+{
+}
+
+/*!
+	\brief Puts everything drawn so far on the screen
+
+	Drivers which put off updating the screen to collect updates together
+	should do it now. Others have nothing to do.
+*/
+void DisplayDriver::Sync(void)
+{
+}
+
+/*!
+	\brief Called for all BView::FillArc calls
+	\param r Rectangle enclosing the entire arc
+	\param angle Starting angle for the arc in degrees
+	\param span Span of the arc in degrees. Ending angle = angle+span.
+	\param color The color of the arc
+*/
+void DisplayDriver::FillArc(const BRect &r, const float &angle, const float &span, const RGBColor &color)
+{
+	Lock();
+	fSpans.Reset(ClippingRegion(NULL),r);
+	rasterize_arc(fSpans,r,angle,span);
+	DrawSpans(r,color);
 	Unlock();
 }
 
-void DisplayDriver::FillBezier(BPoint *pts, const RGBColor &color)
+/*!
+	\brief Called for all BView::FillArc calls
+	\param r Rectangle enclosing the entire arc
+	\param angle Starting angle for the arc in degrees
+	\param span Span of the arc in degrees. Ending angle = angle+span.
+	\param d  Object holding the bazillion other options
+*/
+
+void DisplayDriver::FillArc(const BRect &r, const float &angle, const float &span, const DrawData *d)
 {
+	if(!d)
+		return;
+
 	Lock();
+	fSpans.Reset(ClippingRegion(d),r);
+	rasterize_arc(fSpans,r,angle,span);
+	DrawSpans(r,d);
+	Unlock();
+}
 
-	BezierCurve curve(pts);
-	
-	if(fCursorHandler->IntersectsCursor(curve.Frame()))
-		fCursorHandler->DriverHide();
-	
-	FillPolygon(curve.GetPointArray(), curve.points.CountItems(), curve.Frame(), color);
-	
-	fCursorHandler->DriverShow();
+void DisplayDriver::FillBezier(BPoint *pts, const RGBColor &color)
+{
+	if(!pts)
+		return;
+
+	Lock();
+	fPath.Reset();
+	fPath.MoveTo(pts[0]);
+	fPath.BezierTo(pts+1);
+	StartPath(NULL,FILL_NONZERO);
+	fPath.Fill(fRasterizer);
+	DrawPath(color);
 	Unlock();
 }
 
@@ -1604,16 +1224,16 @@ void DisplayDriver::FillBezier(BPoint *pts, const RGBColor &color)
 */
 void DisplayDriver::FillBezier(BPoint *pts, const DrawData *d)
 {
-	Lock();
+	if(!pts || !d)
+		return;
 
-	BezierCurve curve(pts);
-	
-	if(fCursorHandler->IntersectsCursor(curve.Frame()))
-		fCursorHandler->DriverHide();
-		
-	FillPolygon(curve.GetPointArray(), curve.points.CountItems(), curve.Frame(), d);
-	
-	fCursorHandler->DriverShow();
+	Lock();
+	fPath.Reset();
+	fPath.MoveTo(pts[0]);
+	fPath.BezierTo(pts+1);
+	StartPath(d,FILL_NONZERO);
+	fPath.Fill(fRasterizer);
+	DrawPath(d);
 	Unlock();
 }
 
@@ -1624,65 +1244,10 @@ void DisplayDriver::FillBezier(BPoint *pts, const DrawData *d)
 */
 void DisplayDriver::FillEllipse(const BRect &r, const RGBColor &color)
 {
-	float xc = (r.left+r.right)/2;
-	float yc = (r.top+r.bottom)/2;
-	float rx = r.Width()/2;
-	float ry = r.Height()/2;
-	int Rx2 = ROUND(rx*rx);
-	int Ry2 = ROUND(ry*ry);
-	int twoRx2 = 2*Rx2;
-	int twoRy2 = 2*Ry2;
-	int p;
-	int x=0;
-	int y = (int)ry;
-	int px = 0;
-	int py = twoRx2 * y;
-
 	Lock();
-
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	StrokeSolidLine(ROUND(xc),ROUND(yc-y),ROUND(xc),ROUND(yc-y),color);
-	StrokeSolidLine(ROUND(xc),ROUND(yc+y),ROUND(xc),ROUND(yc+y),color);
-
-	p = ROUND (Ry2 - (Rx2 * ry) + (.25 * Rx2));
-	while (px < py)
-	{
-		x++;
-		px += twoRy2;
-		if ( p < 0 )
-			p += Ry2 + px;
-		else
-		{
-			y--;
-			py -= twoRx2;
-			p += Ry2 + px - py;
-		}
-
-               	StrokeSolidLine(ROUND(xc-x),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-                StrokeSolidLine(ROUND(xc-x),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-	}
-
-	p = ROUND(Ry2*(x+.5)*(x+.5) + Rx2*(y-1)*(y-1) - Rx2*Ry2);
-	while (y>0)
-	{
-		y--;
-		py -= twoRx2;
-		if (p>0)
-			p += Rx2 - py;
-		else
-		{
-			x++;
-			px += twoRy2;
-			p += Rx2 - py +px;
-		}
-
-               	StrokeSolidLine(ROUND(xc-x),ROUND(yc-y),ROUND(xc+x),ROUND(yc-y),color);
-                StrokeSolidLine(ROUND(xc-x),ROUND(yc+y),ROUND(xc+x),ROUND(yc+y),color);
-	}
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+	fSpans.Reset(ClippingRegion(NULL),r);
+	rasterize_ellipse(fSpans,r);
+	DrawSpans(r,color);
 	Unlock();
 }
 
@@ -1694,69 +1259,13 @@ void DisplayDriver::FillEllipse(const BRect &r, const RGBColor &color)
 
 void DisplayDriver::FillEllipse(const BRect &r, const DrawData *d)
 {
-	float xc = (r.left+r.right)/2;
-	float yc = (r.top+r.bottom)/2;
-	float rx = r.Width()/2;
-	float ry = r.Height()/2;
-	int Rx2 = ROUND(rx*rx);
-	int Ry2 = ROUND(ry*ry);
-	int twoRx2 = 2*Rx2;
-	int twoRy2 = 2*Ry2;
-	int p;
-	int x=0;
-	int y = (int)ry;
-	int px = 0;
-	int py = twoRx2 * y;
-	DrawData data;
+	if(!d)
+		return;
 
 	Lock();
-
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	data = *d;
-	data.pensize = 1;
-
-	StrokeLine(BPoint(xc,yc-y),BPoint(xc,yc-y),&data);
-	StrokeLine(BPoint(xc,yc+y),BPoint(xc,yc+y),&data);
-
-	p = ROUND (Ry2 - (Rx2 * ry) + (.25 * Rx2));
-	while (px < py)
-	{
-		x++;
-		px += twoRy2;
-		if ( p < 0 )
-			p += Ry2 + px;
-		else
-		{
-			y--;
-			py -= twoRx2;
-			p += Ry2 + px - py;
-		}
-
-               	StrokeLine(BPoint(xc-x,yc-y),BPoint(xc+x,yc-y),&data);
-                StrokeLine(BPoint(xc-x,yc+y),BPoint(xc+x,yc+y),&data);
-	}
-
-	p = ROUND(Ry2*(x+.5)*(x+.5) + Rx2*(y-1)*(y-1) - Rx2*Ry2);
-	while (y>0)
-	{
-		y--;
-		py -= twoRx2;
-		if (p>0)
-			p += Rx2 - py;
-		else
-		{
-			x++;
-			px += twoRy2;
-			p += Rx2 - py +px;
-		}
-
-               	StrokeLine(BPoint(xc-x,yc-y),BPoint(xc+x,yc-y),&data);
-                StrokeLine(BPoint(xc-x,yc+y),BPoint(xc+x,yc+y),&data);
-	}
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+	fSpans.Reset(ClippingRegion(d),r);
+	rasterize_ellipse(fSpans,r);
+	DrawSpans(r,d);
 	Unlock();
 }
 
@@ -1768,142 +1277,23 @@ void DisplayDriver::FillEllipse(const BRect &r, const DrawData *d)
 */
 void DisplayDriver::FillPolygon(BPoint *ptlist, int32 numpts, const BRect &bounds, const RGBColor &color)
 {
-	/* Here's the plan.  Record all line segments in polygon.  If a line segments crosses
-	   the y-value of a point not in the segment, split the segment into 2 segments.
-	   Once we have gone through all of the segments, sort them primarily on y-value
-	   and secondarily on x-value.  Step through each y-value in the bounding rectangle
-	   and look for intersections with line segments.  First intersection is start of
-	   horizontal line, second intersection is end of horizontal line.  Continue for
-	   all pairs of intersections.  Watch out for horizontal line segments.
-	*/
-	if ( !ptlist || (numpts < 3) )
+	if(!ptlist || numpts<3)
 		return;
 
 	Lock();
-
-	if(fCursorHandler->IntersectsCursor(bounds))
-		fCursorHandler->DriverHide();
-	
-	BPoint *currentPoint, *nextPoint;
-	BPoint tempNextPoint;
-	BPoint tempCurrentPoint;
-	int currentIndex, bestIndex, i, j, y;
-	LineCalc *segmentArray = new LineCalc[2*numpts];
-	int numSegments = 0;
-	int minX, minY, maxX, maxY;
-
-	minX = ROUND(ptlist[0].x);
-	maxX = ROUND(ptlist[0].x);
-	minY = ROUND(ptlist[0].y);
-	maxY = ROUND(ptlist[0].y);
-	
-	// Generate the segment list
-	currentPoint = ptlist;
-	currentIndex = 0;
-	nextPoint = &ptlist[1];
-	while (currentPoint)
-	{
-		if ( numSegments >= 2*numpts )
-		{
-			printf("ERROR: Insufficient memory allocated to segment array\n");
-			delete[] segmentArray;
-			Unlock();
-			return;
-		}
-
-		if ( ROUND(currentPoint->x) < minX )
-			minX = ROUND(currentPoint->x);
-		if ( ROUND(currentPoint->x) > maxX )
-			maxX = ROUND(currentPoint->x);
-		if ( ROUND(currentPoint->y) < minY )
-			minY = ROUND(currentPoint->y);
-		if ( ROUND(currentPoint->y) > maxY )
-			maxY = ROUND(currentPoint->y);
-
-		for (i=0; i<numpts; i++)
-		{
-			if ( ((ptlist[i].y > currentPoint->y) && (ptlist[i].y < nextPoint->y)) ||
-				((ptlist[i].y < currentPoint->y) && (ptlist[i].y > nextPoint->y)) )
-			{
-				segmentArray[numSegments].SetPoints(*currentPoint,*nextPoint);
-				tempNextPoint.x = segmentArray[numSegments].GetX(ptlist[i].y);
-				tempNextPoint.y = ptlist[i].y;
-				nextPoint = &tempNextPoint;
-			}
-		}
-
-		segmentArray[numSegments].SetPoints(*currentPoint,*nextPoint);
-		numSegments++;
-		if ( nextPoint == &tempNextPoint )
-		{
-			tempCurrentPoint = tempNextPoint;
-			currentPoint = &tempCurrentPoint;
-			nextPoint = &ptlist[(currentIndex+1)%numpts];
-		}
-		else if ( nextPoint == ptlist )
-		{
-			currentPoint = NULL;
-		}
-		else
-		{
-			currentPoint = nextPoint;
-			currentIndex++;
-			nextPoint = &ptlist[(currentIndex+1)%numpts];
-		}
-	}
-
-	// Selection sort the segments.  Probably should replace this later.
-	for (i=0; i<numSegments; i++)
+	if(fAntialias)
 	{
-		bestIndex = i;
-		for (j=i+1; j<numSegments; j++)
-		{
-			if ( (segmentArray[j].MinY() < segmentArray[bestIndex].MinY()) ||
-				((segmentArray[j].MinY() == segmentArray[bestIndex].MinY()) &&
-				 (segmentArray[j].MinX() < segmentArray[bestIndex].MinX())) )
-				bestIndex = j;
-		}
-		if (bestIndex != i)
-			segmentArray[i].Swap(segmentArray[bestIndex]);
+		StartPath(NULL,FILL_EVEN_ODD);
+		fRasterizer.AddPolygon(ptlist,numpts);
+		DrawPath(color);
 	}
-
-	// Draw the lines
-	for (y=minY; y<=maxY; y++)
+	else
 	{
-		i = 0;
-		while (i<numSegments)
-		{
-			if (segmentArray[i].MinY() > y)
-				break;
-			if (segmentArray[i].MaxY() < y)
-			{
-				i++;
-				continue;
-			}
-			if (segmentArray[i].MinY() == segmentArray[i].MaxY())
-			{
-				if ( (segmentArray[i].MinX() < fDisplayMode.virtual_width) &&
-					(segmentArray[i].MaxX() >= 0) )
-					StrokeSolidLine(ROUND(segmentArray[i].MinX()), y,
-							  ROUND(segmentArray[i].MaxX()), y, color);
-				i++;
-			}
-			else
-			{
-				if ( (segmentArray[i+1].GetX(y) < fDisplayMode.virtual_width) &&
-					(segmentArray[i].GetX(y) >= 0) )
-					StrokeSolidLine(ROUND(segmentArray[i].GetX(y)), y,
-							  ROUND(segmentArray[i+1].GetX(y)), y, color);
-				i+=2;
-			}
-		}
+		fSpans.Reset(ClippingRegion(NULL),bounds);
+		rasterize_polygon(fSpans,ptlist,numpts);
+		DrawSpans(bounds,color);
 	}
-
-	delete[] segmentArray;
-	fCursorHandler->DriverShow();
-	Invalidate(bounds);
 	Unlock();
-
 }
 
 /*!
@@ -1914,212 +1304,22 @@ void DisplayDriver::FillPolygon(BPoint *ptlist, int32 numpts, const BRect &bound
 */
 void DisplayDriver::FillPolygon(BPoint *ptlist, int32 numpts, const BRect &bounds, const DrawData *d)
 {
-	/* Here's the plan.  Record all line segments in polygon.  If a line segments crosses
-	   the y-value of a point not in the segment, split the segment into 2 segments.
-	   Once we have gone through all of the segments, sort them primarily on y-value
-	   and secondarily on x-value.  Step through each y-value in the bounding rectangle
-	   and look for intersections with line segments.  First intersection is start of
-	   horizontal line, second intersection is end of horizontal line.  Continue for
-	   all pairs of intersections.  Watch out for horizontal line segments.
-	*/
-	if ( !ptlist || (numpts < 3) )
+	if(!ptlist || numpts<3 || !d)
 		return;
 
 	Lock();
-
-	if(fCursorHandler->IntersectsCursor(bounds))
-		fCursorHandler->DriverHide();
-	
-	BPoint *currentPoint, *nextPoint;
-	BPoint tempNextPoint;
-	BPoint tempCurrentPoint;
-	int currentIndex, bestIndex, i, j, y;
-	LineCalc *segmentArray = new LineCalc[2*numpts];
-	int numSegments = 0;
-	int minX, minY, maxX, maxY;
-
-	minX = ROUND(ptlist[0].x);
-	maxX = ROUND(ptlist[0].x);
-	minY = ROUND(ptlist[0].y);
-	maxY = ROUND(ptlist[0].y);
-	
-	// Generate the segment list
-	currentPoint = ptlist;
-	currentIndex = 0;
-	nextPoint = &ptlist[1];
-	while (currentPoint)
-	{
-		if ( numSegments >= 2*numpts )
-		{
-			printf("ERROR: Insufficient memory allocated to segment array\n");
-			delete[] segmentArray;
-			fCursorHandler->DriverShow();
-			Unlock();
-			return;
-		}
-
-		if ( ROUND(currentPoint->x) < minX )
-			minX = ROUND(currentPoint->x);
-		if ( ROUND(currentPoint->x) > maxX )
-			maxX = ROUND(currentPoint->x);
-		if ( ROUND(currentPoint->y) < minY )
-			minY = ROUND(currentPoint->y);
-		if ( ROUND(currentPoint->y) > maxY )
-			maxY = ROUND(currentPoint->y);
-
-		for (i=0; i<numpts; i++)
-		{
-			if ( ((ptlist[i].y > currentPoint->y) && (ptlist[i].y < nextPoint->y)) ||
-				((ptlist[i].y < currentPoint->y) && (ptlist[i].y > nextPoint->y)) )
-			{
-				segmentArray[numSegments].SetPoints(*currentPoint,*nextPoint);
-				tempNextPoint.x = segmentArray[numSegments].GetX(ptlist[i].y);
-				tempNextPoint.y = ptlist[i].y;
-				nextPoint = &tempNextPoint;
-			}
-		}
-
-		segmentArray[numSegments].SetPoints(*currentPoint,*nextPoint);
-		numSegments++;
-		if ( nextPoint == &tempNextPoint )
-		{
-			tempCurrentPoint = tempNextPoint;
-			currentPoint = &tempCurrentPoint;
-			nextPoint = &ptlist[(currentIndex+1)%numpts];
-		}
-		else if ( nextPoint == ptlist )
-		{
-			currentPoint = NULL;
-		}
-		else
-		{
-			currentPoint = nextPoint;
-			currentIndex++;
-			nextPoint = &ptlist[(currentIndex+1)%numpts];
-		}
-	}
-
-	// Selection sort the segments.  Probably should replace this later.
-	for (i=0; i<numSegments; i++)
-	{
-		bestIndex = i;
-		for (j=i+1; j<numSegments; j++)
-		{
-			if ( (segmentArray[j].MinY() < segmentArray[bestIndex].MinY()) ||
-				((segmentArray[j].MinY() == segmentArray[bestIndex].MinY()) &&
-				 (segmentArray[j].MinX() < segmentArray[bestIndex].MinX())) )
-				bestIndex = j;
-		}
-		if (bestIndex != i)
-			segmentArray[i].Swap(segmentArray[bestIndex]);
-	}
-
-	if ( !d->clipReg )
+	if(fAntialias)
 	{
-		// Draw the lines
-		for (y=minY; y<=maxY; y++)
-		{
-			i = 0;
-			while (i<numSegments)
-			{
-				if (segmentArray[i].MinY() > y)
-					break;
-				if (segmentArray[i].MaxY() < y)
-				{
-					i++;
-					continue;
-				}
-				if (segmentArray[i].MinY() == segmentArray[i].MaxY())
-				{
-					if ( (segmentArray[i].MinX() < fDisplayMode.virtual_width) &&
-						(segmentArray[i].MaxX() >= 0) )
-						StrokePatternLine(ROUND(segmentArray[i].MinX()), y,
-								  ROUND(segmentArray[i].MaxX()), y, d);
-					i++;
-				}
-				else
-				{
-					if ( (segmentArray[i+1].GetX(y) < fDisplayMode.virtual_width) &&
-						(segmentArray[i].GetX(y) >= 0) )
-						StrokePatternLine(ROUND(segmentArray[i].GetX(y)), y,
-								  ROUND(segmentArray[i+1].GetX(y)), y, d);
-					i+=2;
-				}
-			}
-		}
+		StartPath(d,FILL_EVEN_ODD);
+		fRasterizer.AddPolygon(ptlist,numpts);
+		DrawPath(d);
 	}
 	else
 	{
-		int numRects, rectIndex;
-		int yStart, yEnd;
-		BRect clipRect;
-		numRects = d->clipReg->CountRects();
-		for (rectIndex = 0; rectIndex < numRects; rectIndex++)
-		{
-			clipRect = d->clipReg->RectAt(rectIndex);
-			if ( clipRect.bottom < minY )
-				continue;
-			if ( clipRect.top > maxY )
-				continue;
-			if ( clipRect.left < minX )
-				continue;
-			if ( clipRect.right > maxX )
-				continue;
-			yStart = MAX(minY,ROUND(clipRect.top));
-			yEnd = MIN(maxY,ROUND(clipRect.bottom));
-
-			// Draw the lines
-			for (y=yStart; y<=yEnd; y++)
-			{
-				i = 0;
-				while (i<numSegments)
-				{
-					if (segmentArray[i].MinY() > y)
-						break;
-					if (segmentArray[i].MaxY() < y)
-					{
-						i++;
-						continue;
-					}
-					if (segmentArray[i].MinY() == segmentArray[i].MaxY())
-					{
-						if (segmentArray[i].MinX() > clipRect.right)
-						{
-							i++;
-							continue;
-						}
-						if (segmentArray[i].MaxX() < clipRect.left)
-						{
-							i++;
-							continue;
-						}
-						StrokePatternLine(ROUND(MAX(segmentArray[i].MinX(),clipRect.left)), y,
-								  ROUND(MIN(segmentArray[i].MaxX(),clipRect.right)), y, d);
-						i++;
-					}
-					else
-					{
-						if (segmentArray[i].GetX(y) > clipRect.right)
-						{
-							i+=2;
-							continue;
-						}
-						if (segmentArray[i+1].GetX(y) < clipRect.left)
-						{
-							i+=2;
-							continue;
-						}
-						StrokePatternLine(ROUND(MAX(segmentArray[i].GetX(y),clipRect.left)), y,
-								  ROUND(MIN(segmentArray[i+1].GetX(y),clipRect.right)), y, d);
-						i+=2;
-					}
-				}
-			}
-		}
+		fSpans.Reset(ClippingRegion(d),bounds);
+		rasterize_polygon(fSpans,ptlist,numpts);
+		DrawSpans(bounds,d);
 	}
-	delete[] segmentArray;
-	fCursorHandler->DriverShow();
-	Invalidate(bounds);
 	Unlock();
 }
 
@@ -2134,7 +1334,14 @@ void DisplayDriver::FillRect(const BRect &r, const RGBColor &color)
 	if(fCursorHandler->IntersectsCursor(r))
 		fCursorHandler->DriverHide();
 	
-	FillSolidRect(r,color);
+	BRegion *clip=ClippingRegion(NULL);
+	if(clip)
+	{
+		fClipRects.Set(clip,r);
+		FillClipped(fClipRects.Bounds(),&color,NULL);
+	}
+	else
+		FillSolidRect(r,color);
 	fCursorHandler->DriverShow();
 	Unlock();
 }
@@ -2154,17 +1361,11 @@ void DisplayDriver::FillRect(const BRect &r, const DrawData *d)
 	Lock();
 	if(fCursorHandler->IntersectsCursor(r))
 		fCursorHandler->DriverHide();
-	if ( d->clipReg )
+	BRegion *clip=ClippingRegion(d);
+	if(clip)
 	{
-		if ( d->clipReg->Intersects(r) )
-		{
-			BRegion reg(r);
-			reg.IntersectWith(d->clipReg);
-			int numRects = reg.CountRects();
-
-			for(int32 i=0; i<numRects;i++)
-				FillPatternRect(reg.RectAt(i),d);
-		}
+		fClipRects.Set(clip,r);
+		FillClipped(fClipRects.Bounds(),NULL,d);
 	}
 	else
 		FillPatternRect(r,d);
@@ -2185,11 +1386,19 @@ void DisplayDriver::FillRegion(BRegion& r, const RGBColor &color)
 	if(fCursorHandler->IntersectsCursor(r.Frame()))
 		fCursorHandler->DriverHide();
 	
-	int numRects;
-
-	numRects = r.CountRects();
-	for(int32 i=0; i<numRects;i++)
-		FillSolidRect(r.RectAt(i),color);
+	int32 numRects=r.CountRects();
+	BRegion *clip=ClippingRegion(NULL);
+	if(clip)
+	{
+		fClipRects.Set(clip,r.FrameInt());
+		for(int32 i=0; i<numRects; i++)
+			FillClipped(r.RectAtInt(i),&color,NULL);
+	}
+	else
+	{
+		for(int32 i=0; i<numRects; i++)
+			FillSolidRect(r.RectAt(i),color);
+	}
 	
 	fCursorHandler->DriverShow();
 	Invalidate(r.Frame());
@@ -2213,49 +1422,30 @@ void DisplayDriver::FillRegion(BRegion& r, const DrawData *d)
 	if(fCursorHandler->IntersectsCursor(r.Frame()))
 		fCursorHandler->DriverHide();
 	
-	int numRects;
-
-	if ( d->clipReg )
+	int32 numRects=r.CountRects();
+	BRegion *clip=ClippingRegion(d);
+	if(clip)
 	{
-		BRegion drawReg = r;
-
-		drawReg.IntersectWith(d->clipReg);
-		numRects = drawReg.CountRects();
-
-		for(int32 i=0; i<numRects;i++)
-			FillPatternRect(drawReg.RectAt(i),d);
+		fClipRects.Set(clip,r.FrameInt());
+		for(int32 i=0; i<numRects; i++)
+			FillClipped(r.RectAtInt(i),NULL,d);
 	}
 	else
 	{
-		numRects = r.CountRects();
-
-		for(int32 i=0; i<numRects;i++)
+		for(int32 i=0; i<numRects; i++)
 			FillPatternRect(r.RectAt(i),d);
 	}
 	fCursorHandler->DriverShow();
 	Invalidate(r.Frame());
 	Unlock();
-}
-
-void DisplayDriver::FillRoundRect(const BRect &r, const float &xrad, const float &yrad, const RGBColor &color)
-{
-	float arc_x;
-	float yrad2 = yrad*yrad;
-	int i;
-	
-	Lock();
-	
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	for (i=0; i<=(int)yrad; i++)
-	{
-		arc_x = xrad*sqrt(1-i*i/yrad2);
-		StrokeSolidLine(ROUND(r.left+xrad-arc_x), ROUND(r.top+yrad-i), ROUND(r.right-xrad+arc_x), ROUND(r.top+yrad-i),color);
-		StrokeSolidLine(ROUND(r.left+xrad-arc_x), ROUND(r.bottom-yrad+i), ROUND(r.right-xrad+arc_x), ROUND(r.bottom-yrad+i),color);
-	}
-	FillSolidRect(BRect(r.left,r.top+yrad,r.right,r.bottom-yrad),color);
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+}
+
+void DisplayDriver::FillRoundRect(const BRect &r, const float &xrad, const float &yrad, const RGBColor &color)
+{
+	Lock();
+	fSpans.Reset(ClippingRegion(NULL),r);
+	rasterize_round_rect(fSpans,r,xrad,yrad);
+	DrawSpans(r,color);
 	Unlock();
 }
 
@@ -2268,169 +1458,74 @@ void DisplayDriver::FillRoundRect(const BRect &r, const float &xrad, const float
 */
 void DisplayDriver::FillRoundRect(const BRect &r, const float &xrad, const float &yrad, const DrawData *d)
 {
-	float arc_x;
-	float yrad2 = yrad*yrad;
-	int i;
+	if(!d)
+		return;
 
 	Lock();
+	fSpans.Reset(ClippingRegion(d),r);
+	rasterize_round_rect(fSpans,r,xrad,yrad);
+	DrawSpans(r,d);
+	Unlock();
+}
 
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	if ( d->clipReg )
-	{
-		int numRects, rectIndex;
-		BRect clipRect;
-		int left, right, y1, y2;
-		int rectTop, rectBottom, rectLeft, rectRight;
+/*!
+	\brief Draws spans a shape was rasterized into earlier, moved
+	\param spans The spans, which must not have coverage
+	\param count Number of spans
+	\param dx Pixels to move the spans right
+	\param dy Pixels to move the spans down
+	\param bounds Area the moved spans cover
+	\param d DrawData containing all other options
 
-		numRects = d->clipReg->CountRects();
-		for (rectIndex=0; rectIndex<numRects; rectIndex++)
-		{
-			clipRect = d->clipReg->RectAt(rectIndex);
-			rectTop = ROUND(clipRect.top);
-			rectBottom = ROUND(clipRect.bottom);
-			rectLeft = ROUND(clipRect.left);
-			rectRight = ROUND(clipRect.right);
-			for (i=0; i<=(int)yrad; i++)
-			{
-				arc_x = xrad*sqrt(1-i*i/yrad2);
-				left = ROUND(r.left + xrad - arc_x);
-				right = ROUND(r.right - xrad + arc_x);
-				if ( (left > rectRight) || (right < rectLeft) )
-					continue;
-				y1 = ROUND(r.top + yrad - i);
-				y2 = ROUND(r.bottom - yrad + i);
-				if ( (y1 >= rectTop) && (y1 <= rectBottom) )
-					StrokePatternLine(MAX(left,rectLeft), y1, MIN(right,rectRight), y1,d);
-				if ( (y2 >= rectTop) && (y2 <= rectBottom) )
-					StrokePatternLine(MAX(left,rectLeft), y2, MIN(right,rectRight), y2,d);
-			}
-		}
-	}
-	else
-	{
-		for (i=0; i<=(int)yrad; i++)
-		{
-			arc_x = xrad*sqrt(1-i*i/yrad2);
-			StrokePatternLine(ROUND(r.left+xrad-arc_x), ROUND(r.top+yrad-i), ROUND(r.right-xrad+arc_x), ROUND(r.top+yrad-i),d);
-			StrokePatternLine(ROUND(r.left+xrad-arc_x), ROUND(r.bottom-yrad+i), ROUND(r.right-xrad+arc_x), ROUND(r.bottom-yrad+i),d);
-		}
-	}
-	FillPatternRect(BRect(r.left,r.top+yrad,r.right,r.bottom-yrad),d);
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+	ServerPicture keeps the spans of small shapes so drawing a picture again
+	doesn't rasterize them again.
+*/
+void DisplayDriver::FillSpans(const shape_span *spans, int32 count, int32 dx, int32 dy,
+	const BRect &bounds, const DrawData *d)
+{
+	if(!spans || !d)
+		return;
+
+	Lock();
+	fSpans.Reset(ClippingRegion(d),bounds);
+	for(int32 i=0; i<count; i++)
+		fSpans.Add(spans[i].y+dy,spans[i].left+dx,spans[i].right+dx);
+	DrawSpans(bounds,d);
 	Unlock();
 }
 
+/*!
+	\brief Called for all BView::FillShape calls
+	\param bounds Bounds of the shape
+	\param opcount Number of ops in oplist
+	\param oplist The shape's ops, as BShape keeps them
+	\param ptcount Number of points in ptlist
+	\param ptlist The points the ops use, in order
+	\param d The drawing data. Parts the shape winds around are filled.
+*/
 void DisplayDriver::FillShape(const BRect &bounds, const int32 &opcount, const int32 *oplist, 
 		const int32 &ptcount, const BPoint *ptlist, const DrawData *d)
 {
-	// TODO: Implement DisplayDriver::FillShape. How, though? AGG backend?
-	printf("DisplayDriver::FillShape unimplemented\n");
-}
-
-void DisplayDriver::FillTriangle(BPoint *pts, const BRect &bounds, const RGBColor &color)
-{
-	if ( !pts )
+	if(!d)
 		return;
 
 	Lock();
-	if(fCursorHandler->IntersectsCursor(bounds))
-		fCursorHandler->DriverHide();
-	
-	BPoint first, second, third;
-
-	// Sort points according to their y values and x values (y is primary)
-	if ( (pts[0].y < pts[1].y) ||
-		((pts[0].y == pts[1].y) && (pts[0].x <= pts[1].x)) )
-	{
-		first=pts[0];
-		second=pts[1];
-	}
-	else
-	{
-		first=pts[1];
-		second=pts[0];
-	}
-	
-	if ( (second.y<pts[2].y) ||
-		((second.y == pts[2].y) && (second.x <= pts[2].x)) )
-	{
-		third=pts[2];
-	}
-	else
-	{
-		// second is lower than "third", so we must ensure that this third point
-		// isn't higher than our first point
-		third=second;
-		if ( (first.y<pts[2].y) ||
-			((first.y == pts[2].y) && (first.x <= pts[2].x)) )
-			second=pts[2];
-		else
-		{
-			second=first;
-			first=pts[2];
-		}
-	}
-	
-	// Now that the points are sorted, check to see if they all have the same
-	// y value
-	if(first.y==second.y && second.y==third.y)
+	fPath.Reset();
+	if(fPath.AddShape(opcount,oplist,ptcount,ptlist)==B_OK)
 	{
-		BPoint start,end;
-		start.y=first.y;
-		end.y=first.y;
-		start.x=MIN(first.x,MIN(second.x,third.x));
-		end.x=MAX(first.x,MAX(second.x,third.x));
-		StrokeSolidLine(ROUND(start.x), ROUND(start.y), ROUND(end.x), ROUND(start.y), color);
-		fCursorHandler->DriverShow();
-		return;
+		StartPath(d,FILL_NONZERO);
+		fPath.Fill(fRasterizer);
+		DrawPath(d);
 	}
+	Unlock();
+}
 
-	int32 i;
-
-	// Special case #1: first and second in the same row
-	if(first.y==second.y)
-	{
-		LineCalc lineA(first, third);
-		LineCalc lineB(second, third);
-		
-		StrokeSolidLine(ROUND(first.x), ROUND(first.y), ROUND(second.x), ROUND(first.y), color);
-		for(i=(int32)first.y+1; i<=third.y; i++)
-			StrokeSolidLine(ROUND(lineA.GetX(i)), i, ROUND(lineB.GetX(i)), i, color);
-		fCursorHandler->DriverShow();
-		return;
-	}
-	
-	// Special case #2: second and third in the same row
-	if(second.y==third.y)
-	{
-		LineCalc lineA(first, second);
-		LineCalc lineB(first, third);
-		
-		StrokeSolidLine(ROUND(second.x), ROUND(second.y), ROUND(third.x), ROUND(second.y), color);
-		for(i=(int32)first.y; i<third.y; i++)
-			StrokeSolidLine(ROUND(lineA.GetX(i)), i, ROUND(lineB.GetX(i)), i, color);
-		fCursorHandler->DriverShow();
+void DisplayDriver::FillTriangle(BPoint *pts, const BRect &bounds, const RGBColor &color)
+{
+	if(!pts)
 		return;
-	}
-	
-	// Normal case.	
-	LineCalc lineA(first, second);
-	LineCalc lineB(first, third);
-	LineCalc lineC(second, third);
-	
-	for(i=(int32)first.y; i<(int32)second.y; i++)
-		StrokeSolidLine(ROUND(lineA.GetX(i)), i, ROUND(lineB.GetX(i)), i, color);
 
-	for(i=(int32)second.y; i<=third.y; i++)
-		StrokeSolidLine(ROUND(lineC.GetX(i)), i, ROUND(lineB.GetX(i)), i, color);
-	
-	fCursorHandler->DriverShow();
-	Invalidate(bounds);
-	
-	Unlock();
+	FillPolygon(pts,3,bounds,color);
 }
 
 /*!
@@ -2440,116 +1535,10 @@ void DisplayDriver::FillTriangle(BPoint *pts, const BRect &bounds, const RGBColo
 */
 void DisplayDriver::FillTriangle(BPoint *pts, const BRect &bounds, const DrawData *d)
 {
-	if ( !pts )
+	if(!pts || !d)
 		return;
 
-	Lock();
-
-	if(fCursorHandler->IntersectsCursor(bounds))
-		fCursorHandler->DriverHide();
-	
-	if ( d->clipReg )
-	{
-		// For now, cop out and use FillPolygon
-		// Need to investigate if Triangle specific code would save processing time
-		FillPolygon(pts,3,bounds,d);
-		fCursorHandler->DriverShow();
-	}
-	else
-	{
-		BPoint first, second, third;
-
-		// Sort points according to their y values and x values (y is primary)
-		if ( (pts[0].y < pts[1].y) ||
-			((pts[0].y == pts[1].y) && (pts[0].x <= pts[1].x)) )
-		{
-			first=pts[0];
-			second=pts[1];
-		}
-		else
-		{
-			first=pts[1];
-			second=pts[0];
-		}
-	
-		if ( (second.y<pts[2].y) ||
-			((second.y == pts[2].y) && (second.x <= pts[2].x)) )
-		{
-			third=pts[2];
-		}
-		else
-		{
-			// second is lower than "third", so we must ensure that this third point
-			// isn't higher than our first point
-			third=second;
-			if ( (first.y<pts[2].y) ||
-				((first.y == pts[2].y) && (first.x <= pts[2].x)) )
-				second=pts[2];
-			else
-			{
-				second=first;
-				first=pts[2];
-			}
-		}
-	
-		// Now that the points are sorted, check to see if they all have the same
-		// y value
-		if(first.y==second.y && second.y==third.y)
-		{
-			BPoint start,end;
-			start.y=first.y;
-			end.y=first.y;
-			start.x=MIN(first.x,MIN(second.x,third.x));
-			end.x=MAX(first.x,MAX(second.x,third.x));
-			StrokePatternLine(ROUND(start.x), ROUND(start.y), ROUND(end.x), ROUND(start.y), d);
-			fCursorHandler->DriverShow();
-			return;
-		}
-
-		int32 i;
-
-		// Special case #1: first and second in the same row
-		if(first.y==second.y)
-		{
-			LineCalc lineA(first, third);
-			LineCalc lineB(second, third);
-		
-			StrokePatternLine(ROUND(first.x), ROUND(first.y), ROUND(second.x), ROUND(first.y), d);
-			for(i=(int32)first.y+1; i<=third.y; i++)
-				StrokePatternLine(ROUND(lineA.GetX(i)), i, ROUND(lineB.GetX(i)), i, d);
-			fCursorHandler->DriverShow();
-			return;
-		}
-	
-		// Special case #2: second and third in the same row
-		if(second.y==third.y)
-		{
-			LineCalc lineA(first, second);
-			LineCalc lineB(first, third);
-		
-			StrokePatternLine(ROUND(second.x), ROUND(second.y), ROUND(third.x), ROUND(second.y), d);
-			for(i=(int32)first.y; i<third.y; i++)
-				StrokePatternLine(ROUND(lineA.GetX(i)), i, ROUND(lineB.GetX(i)), i, d);
-			fCursorHandler->DriverShow();
-			return;
-		}
-	
-		// Normal case.	
-		LineCalc lineA(first, second);
-		LineCalc lineB(first, third);
-		LineCalc lineC(second, third);
-	
-		for(i=(int32)first.y; i<(int32)second.y; i++)
-			StrokePatternLine(ROUND(lineA.GetX(i)), i, ROUND(lineB.GetX(i)), i, d);
-
-		for(i=(int32)second.y; i<=third.y; i++)
-			StrokePatternLine(ROUND(lineC.GetX(i)), i, ROUND(lineB.GetX(i)), i, d);
-	}
-	
-	fCursorHandler->DriverShow();
-	Invalidate(bounds);
-	
-	Unlock();
+	FillPolygon(pts,3,bounds,d);
 }
 
 /*!
@@ -2657,165 +1646,13 @@ void DisplayDriver::SetCursor(ServerCursor *cursor)
 	\param angle Starting angle for the arc in degrees
 	\param span Span of the arc in degrees. Ending angle = angle+span.
 	\param color The color of the arc
-
-	This is inefficient and should probably be reworked
 */
 void DisplayDriver::StrokeArc(const BRect &r, const float &angle, const float &span, const RGBColor &color)
 {
-	float xc = (r.left+r.right)/2;
-	float yc = (r.top+r.bottom)/2;
-	float rx = r.Width()/2;
-	float ry = r.Height()/2;
-	int Rx2 = ROUND(rx*rx);
-	int Ry2 = ROUND(ry*ry);
-	int twoRx2 = 2*Rx2;
-	int twoRy2 = 2*Ry2;
-	int p;
-	int x=0;
-	int y = (int)ry;
-	int px = 0;
-	int py = twoRx2 * y;
-	int startx, endx;
-	int startQuad, endQuad;
-	bool useQuad1, useQuad2, useQuad3, useQuad4;
-	bool shortspan = false;
-
 	Lock();
-
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	// Watch out for bozos giving us whacko spans
-	if ( (span >= 360) || (span <= -360) )
-	{
-		StrokeEllipse(r,color);
-		fCursorHandler->DriverShow();
-		return;
-	}
-
-	if ( span > 0 )
-	{
-		startQuad = (int)(angle/90)%4+1;
-		endQuad = (int)((angle+span)/90)%4+1;
-		startx = ROUND(.5*r.Width()*fabs(cos(angle*M_PI/180)));
-		endx = ROUND(.5*r.Width()*fabs(cos((angle+span)*M_PI/180)));
-	}
-	else
-	{
-		endQuad = (int)(angle/90)%4+1;
-		startQuad = (int)((angle+span)/90)%4+1;
-		endx = ROUND(.5*r.Width()*fabs(cos(angle*M_PI/180)));
-		startx = ROUND(.5*r.Width()*fabs(cos((angle+span)*M_PI/180)));
-	}
-
-	if ( startQuad != endQuad )
-	{
-		useQuad1 = (endQuad > 1) && (startQuad > endQuad);
-		useQuad2 = ((startQuad == 1) && (endQuad > 2)) || ((startQuad > endQuad) && (endQuad > 2));
-		useQuad3 = ((startQuad < 3) && (endQuad == 4)) || ((startQuad < 3) && (endQuad < startQuad));
-		useQuad4 = (startQuad < 4) && (startQuad > endQuad);
-	}
-	else
-	{
-		if ( (span < 90) && (span > -90) )
-		{
-			useQuad1 = false;
-			useQuad2 = false;
-			useQuad3 = false;
-			useQuad4 = false;
-			shortspan = true;
-		}
-		else
-		{
-			useQuad1 = (startQuad != 1);
-			useQuad2 = (startQuad != 2);
-			useQuad3 = (startQuad != 3);
-			useQuad4 = (startQuad != 4);
-		}
-	}
-
-	if ( useQuad1 || 
-	     (!shortspan && (((startQuad == 1) && (x <= startx)) || ((endQuad == 1) && (x >= endx)))) || 
-	     (shortspan && (startQuad == 1) && (x <= startx) && (x >= endx)) ) 
-		StrokePoint(BPoint(xc+x,yc-y),color);
-	if ( useQuad2 || 
-	     (!shortspan && (((startQuad == 2) && (x >= startx)) || ((endQuad == 2) && (x <= endx)))) || 
-	     (shortspan && (startQuad == 2) && (x >= startx) && (x <= endx)) ) 
-		StrokePoint(BPoint(xc-x,yc-y),color);
-	if ( useQuad3 || 
-	     (!shortspan && (((startQuad == 3) && (x <= startx)) || ((endQuad == 3) && (x >= endx)))) || 
-	     (shortspan && (startQuad == 3) && (x <= startx) && (x >= endx)) ) 
-		StrokePoint(BPoint(xc-x,yc+y),color);
-	if ( useQuad4 || 
-	     (!shortspan && (((startQuad == 4) && (x >= startx)) || ((endQuad == 4) && (x <= endx)))) || 
-	     (shortspan && (startQuad == 4) && (x >= startx) && (x <= endx)) ) 
-		StrokePoint(BPoint(xc+x,yc+y),color);
-
-	p = ROUND (Ry2 - (Rx2 * ry) + (.25 * Rx2));
-	while (px < py)
-	{
-		x++;
-		px += twoRy2;
-		if ( p < 0 )
-			p += Ry2 + px;
-		else
-		{
-			y--;
-			py -= twoRx2;
-			p += Ry2 + px - py;
-		}
-
-		if ( useQuad1 || 
-		     (!shortspan && (((startQuad == 1) && (x <= startx)) || ((endQuad == 1) && (x >= endx)))) || 
-		     (shortspan && (startQuad == 1) && (x <= startx) && (x >= endx)) ) 
-			StrokePoint(BPoint(xc+x,yc-y),color);
-		if ( useQuad2 || 
-		     (!shortspan && (((startQuad == 2) && (x >= startx)) || ((endQuad == 2) && (x <= endx)))) || 
-		     (shortspan && (startQuad == 2) && (x >= startx) && (x <= endx)) ) 
-			StrokePoint(BPoint(xc-x,yc-y),color);
-		if ( useQuad3 || 
-		     (!shortspan && (((startQuad == 3) && (x <= startx)) || ((endQuad == 3) && (x >= endx)))) || 
-		     (shortspan && (startQuad == 3) && (x <= startx) && (x >= endx)) ) 
-			StrokePoint(BPoint(xc-x,yc+y),color);
-		if ( useQuad4 || 
-		     (!shortspan && (((startQuad == 4) && (x >= startx)) || ((endQuad == 4) && (x <= endx)))) || 
-		     (shortspan && (startQuad == 4) && (x >= startx) && (x <= endx)) ) 
-			StrokePoint(BPoint(xc+x,yc+y),color);
-	}
-
-	p = ROUND(Ry2*(x+.5)*(x+.5) + Rx2*(y-1)*(y-1) - Rx2*Ry2);
-	while (y>0)
-	{
-		y--;
-		py -= twoRx2;
-		if (p>0)
-			p += Rx2 - py;
-		else
-		{
-			x++;
-			px += twoRy2;
-			p += Rx2 - py +px;
-		}
-
-		if ( useQuad1 || 
-		     (!shortspan && (((startQuad == 1) && (x <= startx)) || ((endQuad == 1) && (x >= endx)))) || 
-		     (shortspan && (startQuad == 1) && (x <= startx) && (x >= endx)) ) 
-			StrokePoint(BPoint(xc+x,yc-y),color);
-		if ( useQuad2 || 
-		     (!shortspan && (((startQuad == 2) && (x >= startx)) || ((endQuad == 2) && (x <= endx)))) || 
-		     (shortspan && (startQuad == 2) && (x >= startx) && (x <= endx)) ) 
-			StrokePoint(BPoint(xc-x,yc-y),color);
-		if ( useQuad3 || 
-		     (!shortspan && (((startQuad == 3) && (x <= startx)) || ((endQuad == 3) && (x >= endx)))) || 
-		     (shortspan && (startQuad == 3) && (x <= startx) && (x >= endx)) ) 
-			StrokePoint(BPoint(xc-x,yc+y),color);
-		if ( useQuad4 || 
-		     (!shortspan && (((startQuad == 4) && (x >= startx)) || ((endQuad == 4) && (x <= endx)))) || 
-		     (shortspan && (startQuad == 4) && (x >= startx) && (x <= endx)) ) 
-			StrokePoint(BPoint(xc+x,yc+y),color);
-	}
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+	fSpans.Reset(ClippingRegion(NULL),r);
+	rasterize_arc_outline(fSpans,r,angle,span,1);
+	DrawSpans(r,color);
 	Unlock();
 }
 
@@ -2825,165 +1662,17 @@ void DisplayDriver::StrokeArc(const BRect &r, const float &angle, const float &s
 	\param angle Starting angle for the arc in degrees
 	\param span Span of the arc in degrees. Ending angle = angle+span.
 	\param d The drawing data for the arc
-
-	This is inefficient and should probably be reworked
 */
 void DisplayDriver::StrokeArc(const BRect &r, const float &angle, const float &span, const DrawData *d)
 {
-	float xc = (r.left+r.right)/2;
-	float yc = (r.top+r.bottom)/2;
-	float rx = r.Width()/2;
-	float ry = r.Height()/2;
-	int Rx2 = ROUND(rx*rx);
-	int Ry2 = ROUND(ry*ry);
-	int twoRx2 = 2*Rx2;
-	int twoRy2 = 2*Ry2;
-	int p;
-	int x=0;
-	int y = (int)ry;
-	int px = 0;
-	int py = twoRx2 * y;
-	int startx, endx;
-	int startQuad, endQuad;
-	bool useQuad1, useQuad2, useQuad3, useQuad4;
-	bool shortspan = false;
-
-	Lock();
-
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	// Watch out for bozos giving us whacko spans
-	if ( (span >= 360) || (span <= -360) )
-	{
-		StrokeEllipse(r,d);
-		fCursorHandler->DriverShow();
+	if(!d)
 		return;
-	}
-
-	if ( span > 0 )
-	{
-		startQuad = (int)(angle/90)%4+1;
-		endQuad = (int)((angle+span)/90)%4+1;
-		startx = ROUND(.5*r.Width()*fabs(cos(angle*M_PI/180)));
-		endx = ROUND(.5*r.Width()*fabs(cos((angle+span)*M_PI/180)));
-	}
-	else
-	{
-		endQuad = (int)(angle/90)%4+1;
-		startQuad = (int)((angle+span)/90)%4+1;
-		endx = ROUND(.5*r.Width()*fabs(cos(angle*M_PI/180)));
-		startx = ROUND(.5*r.Width()*fabs(cos((angle+span)*M_PI/180)));
-	}
-
-	if ( startQuad != endQuad )
-	{
-		useQuad1 = (endQuad > 1) && (startQuad > endQuad);
-		useQuad2 = ((startQuad == 1) && (endQuad > 2)) || ((startQuad > endQuad) && (endQuad > 2));
-		useQuad3 = ((startQuad < 3) && (endQuad == 4)) || ((startQuad < 3) && (endQuad < startQuad));
-		useQuad4 = (startQuad < 4) && (startQuad > endQuad);
-	}
-	else
-	{
-		if ( (span < 90) && (span > -90) )
-		{
-			useQuad1 = false;
-			useQuad2 = false;
-			useQuad3 = false;
-			useQuad4 = false;
-			shortspan = true;
-		}
-		else
-		{
-			useQuad1 = (startQuad != 1);
-			useQuad2 = (startQuad != 2);
-			useQuad3 = (startQuad != 3);
-			useQuad4 = (startQuad != 4);
-		}
-	}
-
-	if ( useQuad1 || 
-	     (!shortspan && (((startQuad == 1) && (x <= startx)) || ((endQuad == 1) && (x >= endx)))) || 
-	     (shortspan && (startQuad == 1) && (x <= startx) && (x >= endx)) ) 
-		StrokePoint(BPoint(xc+x,yc-y),d);
-	if ( useQuad2 || 
-	     (!shortspan && (((startQuad == 2) && (x >= startx)) || ((endQuad == 2) && (x <= endx)))) || 
-	     (shortspan && (startQuad == 2) && (x >= startx) && (x <= endx)) ) 
-		StrokePoint(BPoint(xc-x,yc-y),d);
-	if ( useQuad3 || 
-	     (!shortspan && (((startQuad == 3) && (x <= startx)) || ((endQuad == 3) && (x >= endx)))) || 
-	     (shortspan && (startQuad == 3) && (x <= startx) && (x >= endx)) ) 
-		StrokePoint(BPoint(xc-x,yc+y),d);
-	if ( useQuad4 || 
-	     (!shortspan && (((startQuad == 4) && (x >= startx)) || ((endQuad == 4) && (x <= endx)))) || 
-	     (shortspan && (startQuad == 4) && (x >= startx) && (x <= endx)) ) 
-		StrokePoint(BPoint(xc+x,yc+y),d);
-
-	p = ROUND (Ry2 - (Rx2 * ry) + (.25 * Rx2));
-	while (px < py)
-	{
-		x++;
-		px += twoRy2;
-		if ( p < 0 )
-			p += Ry2 + px;
-		else
-		{
-			y--;
-			py -= twoRx2;
-			p += Ry2 + px - py;
-		}
-
-		if ( useQuad1 || 
-		     (!shortspan && (((startQuad == 1) && (x <= startx)) || ((endQuad == 1) && (x >= endx)))) || 
-		     (shortspan && (startQuad == 1) && (x <= startx) && (x >= endx)) ) 
-			StrokePoint(BPoint(xc+x,yc-y),d);
-		if ( useQuad2 || 
-		     (!shortspan && (((startQuad == 2) && (x >= startx)) || ((endQuad == 2) && (x <= endx)))) || 
-		     (shortspan && (startQuad == 2) && (x >= startx) && (x <= endx)) ) 
-			StrokePoint(BPoint(xc-x,yc-y),d);
-		if ( useQuad3 || 
-		     (!shortspan && (((startQuad == 3) && (x <= startx)) || ((endQuad == 3) && (x >= endx)))) || 
-		     (shortspan && (startQuad == 3) && (x <= startx) && (x >= endx)) ) 
-			StrokePoint(BPoint(xc-x,yc+y),d);
-		if ( useQuad4 || 
-		     (!shortspan && (((startQuad == 4) && (x >= startx)) || ((endQuad == 4) && (x <= endx)))) || 
-		     (shortspan && (startQuad == 4) && (x >= startx) && (x <= endx)) ) 
-			StrokePoint(BPoint(xc+x,yc+y),d);
-	}
-
-	p = ROUND(Ry2*(x+.5)*(x+.5) + Rx2*(y-1)*(y-1) - Rx2*Ry2);
-	while (y>0)
-	{
-		y--;
-		py -= twoRx2;
-		if (p>0)
-			p += Rx2 - py;
-		else
-		{
-			x++;
-			px += twoRy2;
-			p += Rx2 - py +px;
-		}
 
-		if ( useQuad1 || 
-		     (!shortspan && (((startQuad == 1) && (x <= startx)) || ((endQuad == 1) && (x >= endx)))) || 
-		     (shortspan && (startQuad == 1) && (x <= startx) && (x >= endx)) ) 
-			StrokePoint(BPoint(xc+x,yc-y),d);
-		if ( useQuad2 || 
-		     (!shortspan && (((startQuad == 2) && (x >= startx)) || ((endQuad == 2) && (x <= endx)))) || 
-		     (shortspan && (startQuad == 2) && (x >= startx) && (x <= endx)) ) 
-			StrokePoint(BPoint(xc-x,yc-y),d);
-		if ( useQuad3 || 
-		     (!shortspan && (((startQuad == 3) && (x <= startx)) || ((endQuad == 3) && (x >= endx)))) || 
-		     (shortspan && (startQuad == 3) && (x <= startx) && (x >= endx)) ) 
-			StrokePoint(BPoint(xc-x,yc+y),d);
-		if ( useQuad4 || 
-		     (!shortspan && (((startQuad == 4) && (x >= startx)) || ((endQuad == 4) && (x <= endx)))) || 
-		     (shortspan && (startQuad == 4) && (x >= startx) && (x <= endx)) ) 
-			StrokePoint(BPoint(xc+x,yc+y),d);
-	}
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+	BRect bounds=pen_bounds(r,d->pensize);
+	Lock();
+	fSpans.Reset(ClippingRegion(d),bounds);
+	rasterize_arc_outline(fSpans,r,angle,span,d->pensize);
+	DrawSpans(bounds,d);
 	Unlock();
 }
 
@@ -2994,20 +1683,17 @@ void DisplayDriver::StrokeArc(const BRect &r, const float &angle, const float &s
 */
 void DisplayDriver::StrokeBezier(BPoint *pts, const RGBColor &color)
 {
-	int i, numLines;
+	if(!pts)
+		return;
 
 	Lock();
-	BezierCurve curve(pts);
-
-	if(fCursorHandler->IntersectsCursor(curve.Frame()))
-		fCursorHandler->DriverHide();
-	
-	numLines = curve.points.CountItems()-1;
-	for (i=0; i<numLines; i++)
-		StrokeLine(*((BPoint*)curve.points.ItemAt(i)),*((BPoint*)curve.points.ItemAt(i+1)),color);
-	
-	fCursorHandler->DriverShow();
-	Invalidate(curve.Frame());
+	fPath.Reset();
+	fPath.MoveTo(pts[0]);
+	fPath.BezierTo(pts+1);
+	StartPath(NULL,FILL_NONZERO);
+	PathStroker stroker(fRasterizer,1,B_BUTT_CAP,B_BEVEL_JOIN,B_DEFAULT_MITER_LIMIT);
+	stroker.Stroke(fPath);
+	DrawPath(color);
 	Unlock();
 }
 
@@ -3017,97 +1703,33 @@ void DisplayDriver::StrokeBezier(BPoint *pts, const RGBColor &color)
 	\param d draw data
 */
 void DisplayDriver::StrokeBezier(BPoint *pts, const DrawData *d)
-{
-	int i, numLines;
-
-	Lock();
-	BezierCurve curve(pts);
-	
-	if(fCursorHandler->IntersectsCursor(curve.Frame()))
-		fCursorHandler->DriverHide();
-	
-	numLines = curve.points.CountItems()-1;
-	for (i=0; i<numLines; i++)
-		StrokeLine(*((BPoint*)curve.points.ItemAt(i)),*((BPoint*)curve.points.ItemAt(i+1)),d);
-	
-	fCursorHandler->DriverShow();
-	Invalidate(curve.Frame());
-	Unlock();
-}
-
-/*!
-	\brief Called for all BView::StrokeEllipse calls
-	\param r BRect enclosing the ellipse to be drawn.
-	\param color The color of the ellipse
-*/
-void DisplayDriver::StrokeEllipse(const BRect &r, const RGBColor &color)
-{
-	float xc = (r.left+r.right)/2;
-	float yc = (r.top+r.bottom)/2;
-	float rx = r.Width()/2;
-	float ry = r.Height()/2;
-	int Rx2 = ROUND(rx*rx);
-	int Ry2 = ROUND(ry*ry);
-	int twoRx2 = 2*Rx2;
-	int twoRy2 = 2*Ry2;
-	int p;
-	int x=0;
-	int y = (int)ry;
-	int px = 0;
-	int py = twoRx2 * y;
-	int lastx, lasty;
-
-	Lock();
-
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	p = ROUND (Ry2 - (Rx2 * ry) + (.25 * Rx2));
-	while (px < py)
-	{
-		lastx = x;
-		lasty = y;
-		x++;
-		px += twoRy2;
-		if ( p < 0 )
-			p += Ry2 + px;
-		else
-		{
-			y--;
-			py -= twoRx2;
-			p += Ry2 + px - py;
-		}
-
-		StrokeLine(BPoint(xc+lastx,yc-lasty),BPoint(xc+x,yc-y),color);
-		StrokeLine(BPoint(xc-lastx,yc-lasty),BPoint(xc-x,yc-y),color);
-		StrokeLine(BPoint(xc-lastx,yc+lasty),BPoint(xc-x,yc+y),color);
-		StrokeLine(BPoint(xc+lastx,yc+lasty),BPoint(xc+x,yc+y),color);
-	}
-
-	p = ROUND(Ry2*(x+.5)*(x+.5) + Rx2*(y-1)*(y-1) - Rx2*Ry2);
-	while (y>0)
-	{
-		lastx = x;
-		lasty = y;
-		y--;
-		py -= twoRx2;
-		if (p>0)
-			p += Rx2 - py;
-		else
-		{
-			x++;
-			px += twoRy2;
-			p += Rx2 - py +px;
-		}
+{
+	if(!pts || !d)
+		return;
 
-		StrokeLine(BPoint(xc+lastx,yc-lasty),BPoint(xc+x,yc-y),color);
-		StrokeLine(BPoint(xc-lastx,yc-lasty),BPoint(xc-x,yc-y),color);
-		StrokeLine(BPoint(xc-lastx,yc+lasty),BPoint(xc-x,yc+y),color);
-		StrokeLine(BPoint(xc+lastx,yc+lasty),BPoint(xc+x,yc+y),color);
-	}
-	
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+	Lock();
+	fPath.Reset();
+	fPath.MoveTo(pts[0]);
+	fPath.BezierTo(pts+1);
+	StartPath(d,FILL_NONZERO);
+	PathStroker stroker(fRasterizer,d->pensize>1 ? d->pensize : 1,d->lineCap,
+		d->lineJoin,d->miterLimit);
+	stroker.Stroke(fPath);
+	DrawPath(d);
+	Unlock();
+}
+
+/*!
+	\brief Called for all BView::StrokeEllipse calls
+	\param r BRect enclosing the ellipse to be drawn.
+	\param color The color of the ellipse
+*/
+void DisplayDriver::StrokeEllipse(const BRect &r, const RGBColor &color)
+{
+	Lock();
+	fSpans.Reset(ClippingRegion(NULL),r);
+	rasterize_ellipse_outline(fSpans,r,1);
+	DrawSpans(r,color);
 	Unlock();
 }
 
@@ -3118,71 +1740,14 @@ void DisplayDriver::StrokeEllipse(const BRect &r, const RGBColor &color)
 */
 void DisplayDriver::StrokeEllipse(const BRect &r, const DrawData *d)
 {
-	float xc = (r.left+r.right)/2;
-	float yc = (r.top+r.bottom)/2;
-	float rx = r.Width()/2;
-	float ry = r.Height()/2;
-	int Rx2 = ROUND(rx*rx);
-	int Ry2 = ROUND(ry*ry);
-	int twoRx2 = 2*Rx2;
-	int twoRy2 = 2*Ry2;
-	int p;
-	int x=0;
-	int y = (int)ry;
-	int px = 0;
-	int py = twoRx2 * y;
-	int lastx, lasty;
+	if(!d)
+		return;
 
+	BRect bounds=pen_bounds(r,d->pensize);
 	Lock();
-
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	p = ROUND (Ry2 - (Rx2 * ry) + (.25 * Rx2));
-	while (px < py)
-	{
-		lastx = x;
-		lasty = y;
-		x++;
-		px += twoRy2;
-		if ( p < 0 )
-			p += Ry2 + px;
-		else
-		{
-			y--;
-			py -= twoRx2;
-			p += Ry2 + px - py;
-		}
-
-		StrokeLine(BPoint(xc+lastx,yc-lasty),BPoint(xc+x,yc-y),d);
-		StrokeLine(BPoint(xc-lastx,yc-lasty),BPoint(xc-x,yc-y),d);
-		StrokeLine(BPoint(xc-lastx,yc+lasty),BPoint(xc-x,yc+y),d);
-		StrokeLine(BPoint(xc+lastx,yc+lasty),BPoint(xc+x,yc+y),d);
-	}
-
-	p = ROUND(Ry2*(x+.5)*(x+.5) + Rx2*(y-1)*(y-1) - Rx2*Ry2);
-	while (y>0)
-	{
-		lastx = x;
-		lasty = y;
-		y--;
-		py -= twoRx2;
-		if (p>0)
-			p += Rx2 - py;
-		else
-		{
-			x++;
-			px += twoRy2;
-			p += Rx2 - py +px;
-		}
-
-		StrokeLine(BPoint(xc+lastx,yc-lasty),BPoint(xc+x,yc-y),d);
-		StrokeLine(BPoint(xc-lastx,yc-lasty),BPoint(xc-x,yc-y),d);
-		StrokeLine(BPoint(xc-lastx,yc+lasty),BPoint(xc-x,yc+y),d);
-		StrokeLine(BPoint(xc+lastx,yc+lasty),BPoint(xc+x,yc+y),d);
-	}
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+	fSpans.Reset(ClippingRegion(d),bounds);
+	rasterize_ellipse_outline(fSpans,r,d->pensize);
+	DrawSpans(bounds,d);
 	Unlock();
 }
 
@@ -3197,7 +1762,7 @@ void DisplayDriver::StrokeLine(const BPoint &start, const BPoint &end, const RGB
 	Lock();
 	if(fCursorHandler->IntersectsCursor(BRect(start,end)))
 		fCursorHandler->DriverHide();
-	StrokeSolidLine(ROUND(start.x),ROUND(start.y),ROUND(end.x),ROUND(end.y),color);
+	StrokeClippedLine(start,end,ClippingRegion(NULL),&color,NULL);
 	
 	fCursorHandler->DriverShow();
 	Invalidate(BRect(start,end));
@@ -3212,106 +1777,27 @@ void DisplayDriver::StrokeLine(const BPoint &start, const BPoint &end, const RGB
 */
 void DisplayDriver::StrokeLine(const BPoint &start, const BPoint &end, const DrawData *d)
 {
+	if(!d)
+		return;
+
 	Lock();
-	
+
+	// thick lines are outlined with the pen's caps
+	if(d->pensize>1)
+	{
+		BPoint points[2]={ start, end };
+		StartPath(d,FILL_NONZERO);
+		PathStroker stroker(fRasterizer,d->pensize,d->lineCap,d->lineJoin,d->miterLimit);
+		stroker.Stroke(points,2,false);
+		DrawPath(d);
+		Unlock();
+		return;
+	}
+
 	if(fCursorHandler->IntersectsCursor(BRect(start,end)))
 		fCursorHandler->DriverHide();
 	
-	if ( d->pensize == 1 )
-	{
-		if ( d->clipReg )
-		{
-			int i, numRects;
-			double left, right, y1, y2;
-			BRect clipRect;
-			LineCalc line(start,end);
-			numRects = d->clipReg->CountRects();
-			for (i=0; i<numRects; i++)
-			{
-				clipRect = d->clipReg->RectAt(i);
-				left = MAX(line.MinX(), clipRect.left);
-				right = MIN(line.MaxX(), clipRect.right);
-				if ( right < left )
-					continue;
-				y1 = line.GetY(left);
-				y2 = line.GetY(right);
-				if ( MAX(y1,y2) < clipRect.top )
-					continue;
-				if ( MIN(y1,y2) > clipRect.bottom )
-					continue;
-                                if ( y1 < clipRect.top )
-                                {
-                                	y1 = clipRect.top;
-					left = line.GetX(y1);
-                                }
-				if ( y1 > clipRect.bottom )
-                                {
-                                	y1 = clipRect.bottom;
-					left = line.GetX(y1);
-                                }
-                                if ( y2 < clipRect.top )
-                                {
-                                	y2 = clipRect.top;
-					right = line.GetX(y2);
-                                }
-                                if ( y2 > clipRect.bottom )
-                                {
-                                	y2 = clipRect.bottom;
-					right = line.GetX(y2);
-                                }
-				StrokePatternLine(ROUND(left),ROUND(y1),ROUND(right),ROUND(y2),d);
-			}
-		}
-		else
-			StrokePatternLine(ROUND(start.x),ROUND(start.y),ROUND(end.x),ROUND(end.y),d);
-	}
-	else
-	{
-		BPoint corners[4];
-		double halfWidth = .5*d->pensize;
-		corners[0] = start;
-		corners[1] = start;
-		corners[2] = end;
-		corners[3] = end;
-		if ( (start.x == end.x) && (start.y == end.y) )
-		{
-			FillRect(BRect(start.x-halfWidth,start.y-halfWidth,start.x+halfWidth,start.y+halfWidth),d);
-		}
-		else
-		{
-			if ( start.x == end.x )
-			{
-				corners[0].x += halfWidth;
-				corners[1].x -= halfWidth;
-				corners[2].x -= halfWidth;
-				corners[3].x += halfWidth;
-			}
-			else if ( start.y == end.y )
-			{
-				corners[0].y -= halfWidth;
-				corners[1].y += halfWidth;
-				corners[2].y += halfWidth;
-				corners[3].y -= halfWidth;
-			}
-			else
-			{
-				double angle, xoffset, yoffset;
-				// TODO try to find a way to avoid atan2, sin, and cos
-				angle = atan2(end.y-start.y, end.x-start.x) + M_PI/4;
-				xoffset = halfWidth*cos(angle);
-				yoffset = halfWidth*sin(angle);
-				corners[0].x += xoffset;
-				corners[0].y += yoffset;
-				corners[1].x -= xoffset;
-				corners[1].y -= yoffset;
-				corners[2].x -= xoffset;
-				corners[2].y -= yoffset;
-				corners[3].x += xoffset;
-				corners[3].y += yoffset;
-			}
-			FillPolygon(corners,4,BRect(start,end),d);
-		}
-	}
+	StrokeClippedLine(start,end,ClippingRegion(d),NULL,d);
 	fCursorHandler->DriverShow();
 	Invalidate(BRect(start,end));
 	Unlock();
@@ -3394,10 +1880,21 @@ void DisplayDriver::StrokePolygon(BPoint *ptlist, int32 numpts, const BRect &bou
 */
 void DisplayDriver::StrokePolygon(BPoint *ptlist, int32 numpts, const BRect &bounds, const DrawData *d, bool is_closed)
 {
-	if(!ptlist)
+	if(!ptlist || !d)
 		return;
 
 	Lock();
+	if(d->pensize>1)
+	{
+		// one outline, so the corners are joined
+		StartPath(d,FILL_NONZERO);
+		PathStroker stroker(fRasterizer,d->pensize,d->lineCap,d->lineJoin,d->miterLimit);
+		stroker.Stroke(ptlist,numpts,is_closed);
+		DrawPath(d);
+		Unlock();
+		return;
+	}
+
 	if(fCursorHandler->IntersectsCursor(bounds))
 		fCursorHandler->DriverHide();
 	
@@ -3423,7 +1920,16 @@ void DisplayDriver::StrokeRect(const BRect &r, const RGBColor &color)
 	
 	if(fCursorHandler->IntersectsCursor(r))
 		fCursorHandler->DriverHide();
-	StrokeSolidRect(r,color);
+	BRegion *clip=ClippingRegion(NULL);
+	if(clip)
+	{
+		StrokeClippedLine(r.LeftTop(),r.RightTop(),clip,&color,NULL);
+		StrokeClippedLine(r.LeftTop(),r.LeftBottom(),clip,&color,NULL);
+		StrokeClippedLine(r.RightTop(),r.RightBottom(),clip,&color,NULL);
+		StrokeClippedLine(r.LeftBottom(),r.RightBottom(),clip,&color,NULL);
+	}
+	else
+		StrokeSolidRect(r,color);
 	
 	fCursorHandler->DriverShow();
 	Invalidate(r);
@@ -3484,37 +1990,10 @@ void DisplayDriver::StrokeRegion(BRegion& r, const DrawData *d)
 
 void DisplayDriver::StrokeRoundRect(const BRect &r, const float &xrad, const float &yrad, const RGBColor &color)
 {
-	int hLeft, hRight;
-	int vTop, vBottom;
-	float bLeft, bRight, bTop, bBottom;
-
-	hLeft = (int)ROUND(r.left + xrad);
-	hRight = (int)ROUND(r.right - xrad);
-	vTop = (int)ROUND(r.top + yrad);
-	vBottom = (int)ROUND(r.bottom - yrad);
-	bLeft = hLeft + xrad;
-	bRight = hRight -xrad;
-	bTop = vTop + yrad;
-	bBottom = vBottom - yrad;
-
 	Lock();
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	StrokeArc(BRect(bRight, r.top, r.right, bTop), 0, 90, color);
-	StrokeLine(BPoint(hRight, r.top), BPoint(hLeft, r.top), color);
-	
-	StrokeArc(BRect(r.left,r.top,bLeft,bTop), 90, 90, color);
-	StrokeLine(BPoint(r.left, vTop), BPoint(r.left, vBottom), color);
-
-	StrokeArc(BRect(r.left,bBottom,bLeft,r.bottom), 180, 90, color);
-	StrokeLine(BPoint(hLeft, r.bottom), BPoint(hRight, r.bottom), color);
-
-	StrokeArc(BRect(bRight,bBottom,r.right,r.bottom), 270, 90, color);
-	StrokeLine(BPoint(r.right, vBottom), BPoint(r.right, vTop), color);
-	
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+	fSpans.Reset(ClippingRegion(NULL),r);
+	rasterize_round_rect_outline(fSpans,r,xrad,yrad,1);
+	DrawSpans(r,color);
 	Unlock();
 }
 
@@ -3527,46 +2006,43 @@ void DisplayDriver::StrokeRoundRect(const BRect &r, const float &xrad, const flo
 */
 void DisplayDriver::StrokeRoundRect(const BRect &r, const float &xrad, const float &yrad, const DrawData *d)
 {
-	int hLeft, hRight;
-	int vTop, vBottom;
-	float bLeft, bRight, bTop, bBottom;
-
-	hLeft = (int)ROUND(r.left + xrad);
-	hRight = (int)ROUND(r.right - xrad);
-	vTop = (int)ROUND(r.top + yrad);
-	vBottom = (int)ROUND(r.bottom - yrad);
-	bLeft = hLeft + xrad;
-	bRight = hRight -xrad;
-	bTop = vTop + yrad;
-	bBottom = vBottom - yrad;
+	if(!d)
+		return;
 
+	BRect bounds=pen_bounds(r,d->pensize);
 	Lock();
-	
-	if(fCursorHandler->IntersectsCursor(r))
-		fCursorHandler->DriverHide();
-	
-	StrokeArc(BRect(bRight, r.top, r.right, bTop), 0, 90, d);
-	StrokeLine(BPoint(hRight, r.top), BPoint(hLeft, r.top), d);
-	
-	StrokeArc(BRect(r.left,r.top,bLeft,bTop), 90, 90, d);
-	StrokeLine(BPoint(r.left, vTop), BPoint(r.left, vBottom), d);
-
-	StrokeArc(BRect(r.left,bBottom,bLeft,r.bottom), 180, 90, d);
-	StrokeLine(BPoint(hLeft, r.bottom), BPoint(hRight, r.bottom), d);
-
-	StrokeArc(BRect(bRight,bBottom,r.right,r.bottom), 270, 90, d);
-	StrokeLine(BPoint(r.right, vBottom), BPoint(r.right, vTop), d);
-	
-	fCursorHandler->DriverShow();
-	Invalidate(r);
+	fSpans.Reset(ClippingRegion(d),bounds);
+	rasterize_round_rect_outline(fSpans,r,xrad,yrad,d->pensize);
+	DrawSpans(bounds,d);
 	Unlock();
 }
 
+/*!
+	\brief Called for all BView::StrokeShape calls
+	\param bounds Bounds of the shape
+	\param opcount Number of ops in oplist
+	\param oplist The shape's ops, as BShape keeps them
+	\param ptcount Number of points in ptlist
+	\param ptlist The points the ops use, in order
+	\param d The drawing data, whose pen size, line modes and miter limit are used
+*/
 void DisplayDriver::StrokeShape(const BRect &bounds, const int32 &opcount, const int32 *oplist, 
 		const int32 &ptcount, const BPoint *ptlist, const DrawData *d)
 {
-	// TODO: Implement DisplayDriver::StrokeShape. ShapeIterator subclass?
-	printf("DisplayDriver::StrokeShape unimplemented\n");
+	if(!d)
+		return;
+
+	Lock();
+	fPath.Reset();
+	if(fPath.AddShape(opcount,oplist,ptcount,ptlist)==B_OK)
+	{
+		StartPath(d,FILL_NONZERO);
+		PathStroker stroker(fRasterizer,d->pensize>1 ? d->pensize : 1,d->lineCap,
+			d->lineJoin,d->miterLimit);
+		stroker.Stroke(fPath);
+		DrawPath(d);
+	}
+	Unlock();
 }
 
 /*!
@@ -3591,17 +2067,10 @@ void DisplayDriver::StrokeTriangle(BPoint *pts, const BRect &bounds, const RGBCo
 
 void DisplayDriver::StrokeTriangle(BPoint *pts, const BRect &bounds, const DrawData *d)
 {
-	Lock();
-	if(fCursorHandler->IntersectsCursor(bounds))
-		fCursorHandler->DriverHide();
+	if(!pts)
+		return;
 
-	StrokeLine(pts[0],pts[1],d);
-	StrokeLine(pts[1],pts[2],d);
-	StrokeLine(pts[2],pts[0],d);
-	
-	fCursorHandler->DriverShow();
-	Invalidate(bounds);
-	Unlock();
+	StrokePolygon(pts,3,bounds,d,true);
 }
 
 /*!
@@ -3726,38 +2195,29 @@ float DisplayDriver::StringWidth(const char *string, int32 length, const DrawDat
 	FontStyle *style=font->Style();
 
 	if(!style)
-		return 0.0;
-
-	FT_Face face;
-	FT_GlyphSlot slot;
-	FT_UInt glyph_index=0, previous=0;
-	FT_Vector pen,delta;
-	int16 error=0;
-	int32 strlength,i;
-	float returnval;
-
-	error=FT_New_Face(ftlib, style->GetPath(), 0, &face);
-	if(error)
 	{
 		Unlock();
 		return 0.0;
 	}
 
-	slot=face->glyph;
+	FT_Face face;
+	FT_Vector pen;
+	int32 strlength,i;
+	CachedGlyph *glyph;
+	float returnval;
 
-	bool use_kerning=FT_HAS_KERNING(face) && font->Spacing()==B_STRING_SPACING;
-	
-	error=FT_Set_Char_Size(face, 0,int32(font->Size())*64,72,72);
-	if(error)
+	fontcache->Lock();
+	face=fontcache->GetFace(style,font->Size());
+	if(!face)
 	{
+		fontcache->Unlock();
 		Unlock();
 		return 0.0;
 	}
 
 	// set the pen position in 26.6 cartesian space coordinates
 	pen.x=0;
-	
-	slot=face->glyph;
+	pen.y=0;
 	
 	strlength=strlen(string);
 	if(length<strlength)
@@ -3765,21 +2225,15 @@ float DisplayDriver::StringWidth(const char *string, int32 length, const DrawDat
 
 	for(i=0;i<strlength;i++)
 	{
-		// get kerning and move pen
-		if(use_kerning && previous && glyph_index)
-		{
-			FT_Get_Kerning(face, previous, glyph_index,ft_kerning_default, &delta);
-			pen.x+=delta.x;
-		}
-
-		error=FT_Load_Char(face,string[i],FT_LOAD_MONOCHROME);
+		// The pen stays on whole pixels, so all of these are the same glyphs
+		glyph=fontcache->GetGlyph(face,(uint8)string[i],GLYPH_RENDER_MONO,NULL,pen);
 
 		// increment pen position
-		pen.x+=slot->advance.x;
-		previous=glyph_index;
+		if(glyph)
+			pen.x+=glyph->advance.x;
 	}
 
-	FT_Done_Face(face);
+	fontcache->Unlock();
 	Unlock();
 
 	returnval=pen.x>>6;
@@ -3814,28 +2268,22 @@ float DisplayDriver::StringHeight(const char *string, int32 length, const DrawDa
 	}
 
 	FT_Face face;
-	FT_GlyphSlot slot;
-	int16 error=0;
+	FT_Vector pen;
 	int32 strlength,i;
+	CachedGlyph *glyph;
 	float returnval=0.0,ascent=0.0,descent=0.0;
 
-	error=FT_New_Face(ftlib, style->GetPath(), 0, &face);
-	if(error)
-	{
-		Unlock();
-		return 0.0;
-	}
-
-	slot=face->glyph;
-	
-	error=FT_Set_Char_Size(face, 0,int32(font->Size())*64,72,72);
-	if(error)
+	fontcache->Lock();
+	face=fontcache->GetFace(style,font->Size());
+	if(!face)
 	{
+		fontcache->Unlock();
 		Unlock();
 		return 0.0;
 	}
 
-	slot=face->glyph;
+	pen.x=0;
+	pen.y=0;
 	
 	strlength=strlen(string);
 	if(length<strlength)
@@ -3843,14 +2291,16 @@ float DisplayDriver::StringHeight(const char *string, int32 length, const DrawDa
 
 	for(i=0;i<strlength;i++)
 	{
-		FT_Load_Char(face,string[i],FT_LOAD_RENDER);
-		if(slot->metrics.horiBearingY<slot->metrics.height)
-			descent=MAX((slot->metrics.height-slot->metrics.horiBearingY)>>6,descent);
+		glyph=fontcache->GetGlyph(face,(uint8)string[i],GLYPH_RENDER_GRAY,NULL,pen);
+		if(!glyph)
+			continue;
+		if(glyph->metrics.horiBearingY<glyph->metrics.height)
+			descent=MAX((glyph->metrics.height-glyph->metrics.horiBearingY)>>6,descent);
 		else
-			ascent=MAX(slot->bitmap.rows,ascent);
+			ascent=MAX(glyph->bitmap.rows,ascent);
 	}
 
-	FT_Done_Face(face);
+	fontcache->Unlock();
 
 	Unlock();
 	returnval=ascent+descent;
@@ -4236,6 +2686,96 @@ void DisplayDriver::StrokeSolidRect(const BRect &rect, const RGBColor &color)
 {
 }
 
+/*!
+	\brief Fills the spans of a shape in a solid color
+	\param spans The spans, already clipped and in the frame buffer
+	\param count Number of spans
+
+	Drivers which can draw many spans at once should override this. It draws
+	each span as a line, leaving out pixels less than half covered.
+*/
+void DisplayDriver::FillSolidSpans(const shape_span *spans, int32 count, const RGBColor &color)
+{
+	for(int32 i=0; i<count; i++)
+	{
+		int32 x=spans[i].left, left, right;
+		while(next_covered_run(spans[i],&x,&left,&right))
+			StrokeSolidLine(left,spans[i].y,right,spans[i].y,color);
+	}
+}
+
+//! Fills the spans of a shape with a DrawData's pattern, colors and mode
+void DisplayDriver::FillPatternSpans(const shape_span *spans, int32 count, const DrawData *d)
+{
+	for(int32 i=0; i<count; i++)
+	{
+		int32 x=spans[i].left, left, right;
+		while(next_covered_run(spans[i],&x,&left,&right))
+			StrokePatternLine(left,spans[i].y,right,spans[i].y,d);
+	}
+}
+
+/*!
+	\brief Draws the shape a rasterizer put in fSpans
+	\param bounds Area the shape covers
+
+	The driver must be locked.
+*/
+void DisplayDriver::DrawSpans(const BRect &bounds, const RGBColor &color)
+{
+	if(fSpans.CountSpans()==0)
+		return;
+
+	if(fCursorHandler->IntersectsCursor(bounds))
+		fCursorHandler->DriverHide();
+	FillSolidSpans(fSpans.Spans(),fSpans.CountSpans(),color);
+	fCursorHandler->DriverShow();
+	Invalidate(bounds);
+}
+
+void DisplayDriver::DrawSpans(const BRect &bounds, const DrawData *d)
+{
+	if(fSpans.CountSpans()==0)
+		return;
+
+	if(fCursorHandler->IntersectsCursor(bounds))
+		fCursorHandler->DriverHide();
+	FillPatternSpans(fSpans.Spans(),fSpans.CountSpans(),d);
+	fCursorHandler->DriverShow();
+	Invalidate(bounds);
+}
+
+/*!
+	\brief Starts a path in fRasterizer
+	\param d Drawing data for the path, or NULL if it is drawn in a color
+	\param rule How to fill parts of the path which overlap
+
+	The driver must be locked.
+*/
+void DisplayDriver::StartPath(const DrawData *d, fill_rule rule)
+{
+	BRegion *clip=ClippingRegion(d);
+	if(clip)
+		fRasterizer.Reset(clip->Frame());
+	else
+		fRasterizer.Reset();
+	fRasterizer.SetFillRule(rule);
+	fRasterizer.SetAntialiasing(fAntialias);
+}
+
+//! Draws the path in fRasterizer. The driver must be locked.
+void DisplayDriver::DrawPath(const RGBColor &color)
+{
+	fRasterizer.Render(fSpans,ClippingRegion(NULL));
+	DrawSpans(fRasterizer.Bounds(),color);
+}
+
+void DisplayDriver::DrawPath(const DrawData *d)
+{
+	fRasterizer.Render(fSpans,ClippingRegion(d));
+	DrawSpans(fRasterizer.Bounds(),d);
+}
+
 void DisplayDriver::CopyBitmap(ServerBitmap *bitmap, const BRect &source, const BRect &dest, const DrawData *d)
 {
 }
@@ -4244,6 +2784,168 @@ void DisplayDriver::CopyToBitmap(ServerBitmap *target, const BRect &source)
 {
 }
 
+/*!
+	\brief Keeps the server's own drawing inside a region
+	\param reg The region, or NULL to draw anywhere again
+
+	This is how the server draws only the visible part of a layer or a
+	decorator which needs it. Drawing done with a DrawData which has a
+	clipping region is clipped to that instead. The region only applies to
+	the calling thread, so windows which draw at the same time each keep
+	their own.
+*/
 void DisplayDriver::ConstrainClippingRegion(BRegion *reg)
 {
+	Lock();
+	thread_id thread=find_thread(NULL);
+	clip_constraint *constraint=find_constraint(fConstraints,thread);
+	if(reg)
+	{
+		if(!constraint)
+		{
+			constraint=new clip_constraint;
+			constraint->thread=thread;
+			fConstraints.AddItem(constraint);
+		}
+		constraint->region=*reg;
+	}
+	else if(constraint)
+	{
+		fConstraints.RemoveItem(constraint);
+		delete constraint;
+	}
+	Unlock();
+}
+
+/*!
+	\brief Returns the region a drawing call is clipped to
+	\param d The call's drawing data, or NULL if it draws in a color
+	\return The region, or NULL if nothing but the screen limits the call
+
+	A DrawData's own region comes first. Otherwise the region the calling
+	thread gave ConstrainClippingRegion() is used. The driver must be locked.
+*/
+BRegion *DisplayDriver::ClippingRegion(const DrawData *d)
+{
+	if(d && d->clipReg)
+		return d->clipReg;
+	if(fConstraints.CountItems()==0)
+		return NULL;
+
+	clip_constraint *constraint=find_constraint(fConstraints,find_thread(NULL));
+	return constraint ? &constraint->region : NULL;
+}
+
+/*!
+	\brief Fills the part of a rectangle in the clipping rectangles of fClipRects
+	\param rect The rectangle, which must be within the bounds fClipRects was set to
+	\param color The color to fill with, or NULL to use d
+	\param d Drawing data whose pattern, colors and mode are used when there's no color
+
+	The driver must be locked.
+*/
+void DisplayDriver::FillClipped(const clipping_rect &rect, const RGBColor *color, const DrawData *d)
+{
+	int32 first, end=fClipRects.FindRows(rect.top,rect.bottom,&first);
+	for(int32 i=first; i<end; i++)
+	{
+		const clipping_rect &clip=fClipRects.RectAtInt(i);
+		BRect part(MAX(rect.left,clip.left),MAX(rect.top,clip.top),
+			MIN(rect.right,clip.right),MIN(rect.bottom,clip.bottom));
+		if(part.left>part.right || part.top>part.bottom)
+			continue;
+
+		if(color)
+			FillSolidRect(part,*color);
+		else
+			FillPatternRect(part,d);
+	}
+}
+
+/*!
+	\brief Draws the pieces of a thin line inside a clipping region
+	\param start Starting point
+	\param end Ending point
+	\param clip The region, or NULL to draw the whole line
+	\param color The color of the line, or NULL to use d
+	\param d Drawing data whose pattern, colors and mode are used when there's no color
+
+	Only rectangles of the region which the line's bounds meet are looked at.
+	The driver must be locked.
+*/
+void DisplayDriver::StrokeClippedLine(const BPoint &start, const BPoint &end, BRegion *clip,
+	const RGBColor *color, const DrawData *d)
+{
+	if(!clip)
+	{
+		if(color)
+			StrokeSolidLine(ROUND(start.x),ROUND(start.y),ROUND(end.x),ROUND(end.y),*color);
+		else
+			StrokePatternLine(ROUND(start.x),ROUND(start.y),ROUND(end.x),ROUND(end.y),d);
+		return;
+	}
+
+	double left, right, y1, y2;
+	BRect clipRect;
+	LineCalc line(start,end);
+	fClipRects.Set(clip,BRect(line.MinX(),line.MinY(),line.MaxX(),line.MaxY()));
+	for(int32 i=0; i<fClipRects.CountRects(); i++)
+	{
+		clipRect=fClipRects.RectAt(i);
+		left=MAX(line.MinX(),clipRect.left);
+		right=MIN(line.MaxX(),clipRect.right);
+		if(right<left)
+			continue;
+
+		// a vertical line has no slope to follow
+		if(start.x==end.x)
+		{
+			y1=MAX(line.MinY(),clipRect.top);
+			y2=MIN(line.MaxY(),clipRect.bottom);
+			if(y2<y1)
+				continue;
+			if(start.y>end.y)
+			{
+				double swap=y1;
+				y1=y2;
+				y2=swap;
+			}
+			if(color)
+				StrokeSolidLine(ROUND(start.x),ROUND(y1),ROUND(start.x),ROUND(y2),*color);
+			else
+				StrokePatternLine(ROUND(start.x),ROUND(y1),ROUND(start.x),ROUND(y2),d);
+			continue;
+		}
+
+		y1=line.GetY(left);
+		y2=line.GetY(right);
+		if(MAX(y1,y2)<clipRect.top)
+			continue;
+		if(MIN(y1,y2)>clipRect.bottom)
+			continue;
+		if(y1<clipRect.top)
+		{
+			y1=clipRect.top;
+			left=line.GetX(y1);
+		}
+		if(y1>clipRect.bottom)
+		{
+			y1=clipRect.bottom;
+			left=line.GetX(y1);
+		}
+		if(y2<clipRect.top)
+		{
+			y2=clipRect.top;
+			right=line.GetX(y2);
+		}
+		if(y2>clipRect.bottom)
+		{
+			y2=clipRect.bottom;
+			right=line.GetX(y2);
+		}
+		if(color)
+			StrokeSolidLine(ROUND(left),ROUND(y1),ROUND(right),ROUND(y2),*color);
+		else
+			StrokePatternLine(ROUND(left),ROUND(y1),ROUND(right),ROUND(y2),d);
+	}
 }
@@ -0,0 +1,322 @@
+//------------------------------------------------------------------------------
+//	File Name:		FontCache.cpp
+//	Description:	Server-wide cache of open font faces and rendered glyphs
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+
+#include "FontCache.h"
+#include "FontServer.h"
+#include "FontFamily.h"
+
+//! Number of buckets in the glyph hash table. Must be a power of two.
+#define GLYPH_TABLE_SIZE	1024
+
+FontCache *fontcache=NULL;
+
+static inline uint32 glyph_hash(FT_Face face, uint32 charcode, uint8 mode,
+	uint8 phasex, uint8 phasey, const FT_Matrix *matrix)
+{
+	uint32 hash=(uint32)((size_t)face >> 4);
+	hash=hash*31 + charcode;
+	hash=hash*31 + ((mode << 16) | (phasex << 8) | phasey);
+	hash=hash*31 + (uint32)matrix->xx;
+	hash=hash*31 + (uint32)matrix->xy;
+	hash=hash*31 + (uint32)matrix->yx;
+	hash=hash*31 + (uint32)matrix->yy;
+	return hash;
+}
+
+/*!
+	\brief Sets up an empty cache
+	\param budget Number of bytes the rendered glyphs may use
+*/
+FontCache::FontCache(size_t budget)
+{
+	fLock=create_sem(1,"fontcache_lock");
+	fFaces=NULL;
+	fFaceCount=0;
+	fTable=(CachedGlyph**)calloc(GLYPH_TABLE_SIZE,sizeof(CachedGlyph*));
+	fLRUHead=NULL;
+	fLRUTail=NULL;
+	fBudget=budget;
+	fUsage=0;
+}
+
+//! Frees all glyphs and closes all faces
+FontCache::~FontCache(void)
+{
+	while(fFaces)
+		_RemoveFace(fFaces);
+	free(fTable);
+	delete_sem(fLock);
+}
+
+//! Locks access to the cache
+void FontCache::Lock(void)
+{
+	acquire_sem(fLock);
+}
+
+//! Unlocks access to the cache
+void FontCache::Unlock(void)
+{
+	release_sem(fLock);
+}
+
+/*!
+	\brief Returns an open face for a style at a size
+	\param style The style of the face
+	\param size The point size the face is to be set to
+	\return The face, or NULL if FreeType can't open the style's file
+
+	Faces are opened and sized once and kept open until the style goes away
+	or MAX_CACHED_FACES other ones were asked for since. The cache must be
+	locked.
+*/
+FT_Face FontCache::GetFace(FontStyle *style, float size)
+{
+	int32 size26=int32(size)*64;
+
+	face_entry *prev=NULL;
+	for(face_entry *entry=fFaces; entry; entry=entry->next)
+	{
+		if(entry->style==style && entry->size==size26)
+		{
+			// Most recently used faces are kept up front
+			if(prev)
+			{
+				prev->next=entry->next;
+				entry->next=fFaces;
+				fFaces=entry;
+			}
+			return entry->face;
+		}
+		prev=entry;
+	}
+
+	FT_Face face;
+	if(FT_New_Face(ftlib, style->GetPath(), 0, &face)!=0)
+		return NULL;
+	if(FT_Set_Char_Size(face, 0, size26, 72, 72)!=0)
+	{
+		FT_Done_Face(face);
+		return NULL;
+	}
+
+	if(fFaceCount>=MAX_CACHED_FACES)
+	{
+		face_entry *last=fFaces;
+		while(last->next)
+			last=last->next;
+		_RemoveFace(last);
+	}
+
+	face_entry *entry=new face_entry;
+	entry->style=style;
+	entry->size=size26;
+	entry->face=face;
+	entry->next=fFaces;
+	fFaces=entry;
+	fFaceCount++;
+	return face;
+}
+
+/*!
+	\brief Returns a rendered glyph
+	\param face A face obtained from GetFace()
+	\param charcode The character to render
+	\param mode Whether to render it in gray levels or monochrome
+	\param matrix Transformation to render it with, or NULL for none
+	\param pen Pen position in 26.6 pixels. Only the fraction is used.
+	\return The glyph, or NULL if FreeType couldn't render it
+
+	The glyph's bitmap position is relative to the whole pixel of the pen.
+	The cache must be locked, and the glyph is only good until the next call.
+*/
+CachedGlyph *FontCache::GetGlyph(FT_Face face, uint32 charcode, glyph_render_mode mode,
+	const FT_Matrix *matrix, const FT_Vector &pen)
+{
+	FT_Matrix identity;
+	if(!matrix)
+	{
+		identity.xx=identity.yy=0x10000;
+		identity.xy=identity.yx=0;
+		matrix=&identity;
+	}
+	uint8 phasex=pen.x & 63;
+	uint8 phasey=pen.y & 63;
+	uint32 hash=glyph_hash(face,charcode,mode,phasex,phasey,matrix);
+
+	CachedGlyph **bucket=&fTable[hash & (GLYPH_TABLE_SIZE-1)];
+	for(CachedGlyph *glyph=*bucket; glyph; glyph=glyph->hashnext)
+	{
+		if(glyph->hash==hash && glyph->face==face && glyph->charcode==charcode
+			&& glyph->mode==mode && glyph->phasex==phasex && glyph->phasey==phasey
+			&& glyph->matrix.xx==matrix->xx && glyph->matrix.xy==matrix->xy
+			&& glyph->matrix.yx==matrix->yx && glyph->matrix.yy==matrix->yy)
+		{
+			// Move it to the front of the LRU list
+			if(glyph!=fLRUHead)
+			{
+				glyph->lruprev->lrunext=glyph->lrunext;
+				if(glyph->lrunext)
+					glyph->lrunext->lruprev=glyph->lruprev;
+				else
+					fLRUTail=glyph->lruprev;
+				glyph->lruprev=NULL;
+				glyph->lrunext=fLRUHead;
+				fLRUHead->lruprev=glyph;
+				fLRUHead=glyph;
+			}
+			return glyph;
+		}
+	}
+
+	// Not rendered yet. FreeType is handed only the fraction of the pen, so
+	// the same bitmap fits wherever the pen has the same fraction.
+	FT_Vector phase;
+	phase.x=phasex;
+	phase.y=phasey;
+	FT_Set_Transform(face, (FT_Matrix*)matrix, &phase);
+	FT_Int32 flags=(mode==GLYPH_RENDER_MONO) ? FT_LOAD_RENDER | FT_LOAD_MONOCHROME : FT_LOAD_RENDER;
+	if(FT_Load_Char(face, charcode, flags)!=0)
+		return NULL;
+
+	FT_GlyphSlot slot=face->glyph;
+	size_t bytes=slot->bitmap.rows * abs(slot->bitmap.pitch);
+
+	CachedGlyph *glyph=new CachedGlyph;
+	glyph->bitmap=slot->bitmap;
+	glyph->bitmap.buffer=NULL;
+	if(bytes>0)
+	{
+		glyph->bitmap.buffer=(unsigned char*)malloc(bytes);
+		memcpy(glyph->bitmap.buffer, slot->bitmap.buffer, bytes);
+	}
+	glyph->left=slot->bitmap_left;
+	glyph->top=slot->bitmap_top;
+	glyph->advance=slot->advance;
+	glyph->metrics=slot->metrics;
+	glyph->face=face;
+	glyph->charcode=charcode;
+	glyph->mode=mode;
+	glyph->phasex=phasex;
+	glyph->phasey=phasey;
+	glyph->matrix=*matrix;
+	glyph->hash=hash;
+	glyph->memsize=sizeof(CachedGlyph)+bytes;
+
+	// Make room before the new glyph goes in, so it can't be the one to go
+	_Trim(fBudget>glyph->memsize ? fBudget-glyph->memsize : 0);
+
+	glyph->hashnext=*bucket;
+	*bucket=glyph;
+	glyph->lruprev=NULL;
+	glyph->lrunext=fLRUHead;
+	if(fLRUHead)
+		fLRUHead->lruprev=glyph;
+	else
+		fLRUTail=glyph;
+	fLRUHead=glyph;
+	fUsage+=glyph->memsize;
+
+	return glyph;
+}
+
+/*!
+	\brief Closes all faces of a style and frees their glyphs
+	\param style The style which is going away
+
+	The cache must not be locked.
+*/
+void FontCache::RemoveStyle(FontStyle *style)
+{
+	Lock();
+	face_entry *entry=fFaces;
+	while(entry)
+	{
+		face_entry *next=entry->next;
+		if(entry->style==style)
+			_RemoveFace(entry);
+		entry=next;
+	}
+	Unlock();
+}
+
+/*!
+	\brief Sets the number of bytes the rendered glyphs may use
+	\param budget The new budget
+
+	Glyphs are freed right away if the cache is over the new budget. The
+	cache must not be locked.
+*/
+void FontCache::SetBudget(size_t budget)
+{
+	Lock();
+	fBudget=budget;
+	_Trim(budget);
+	Unlock();
+}
+
+//! Unlinks a face, frees its glyphs and closes it
+void FontCache::_RemoveFace(face_entry *entry)
+{
+	if(fFaces==entry)
+		fFaces=entry->next;
+	else
+	{
+		face_entry *prev=fFaces;
+		while(prev->next!=entry)
+			prev=prev->next;
+		prev->next=entry->next;
+	}
+	fFaceCount--;
+
+	_RemoveGlyphs(entry->face);
+	FT_Done_Face(entry->face);
+	delete entry;
+}
+
+//! Unlinks a glyph from the hash table and LRU list and frees it
+void FontCache::_RemoveGlyph(CachedGlyph *glyph)
+{
+	CachedGlyph **link=&fTable[glyph->hash & (GLYPH_TABLE_SIZE-1)];
+	while(*link!=glyph)
+		link=&(*link)->hashnext;
+	*link=glyph->hashnext;
+
+	if(glyph->lruprev)
+		glyph->lruprev->lrunext=glyph->lrunext;
+	else
+		fLRUHead=glyph->lrunext;
+	if(glyph->lrunext)
+		glyph->lrunext->lruprev=glyph->lruprev;
+	else
+		fLRUTail=glyph->lruprev;
+
+	fUsage-=glyph->memsize;
+	free(glyph->bitmap.buffer);
+	delete glyph;
+}
+
+//! Frees all glyphs rendered from a face
+void FontCache::_RemoveGlyphs(FT_Face face)
+{
+	CachedGlyph *glyph=fLRUHead;
+	while(glyph)
+	{
+		CachedGlyph *next=glyph->lrunext;
+		if(glyph->face==face)
+			_RemoveGlyph(glyph);
+		glyph=next;
+	}
+}
+
+//! Frees the least recently used glyphs until no more than budget bytes are used
+void FontCache::_Trim(size_t budget)
+{
+	while(fUsage>budget && fLRUTail)
+		_RemoveGlyph(fLRUTail);
+}
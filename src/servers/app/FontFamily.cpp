@@ -26,6 +26,7 @@
 //------------------------------------------------------------------------------
 #include "FontFamily.h"
 #include "ServerFont.h"
+#include "FontCache.h"
 #include FT_CACHE_H
 
 FTC_Manager ftmanager;
@@ -41,6 +42,7 @@ FontStyle::FontStyle(const char *filepath, FT_Face face)
 	cachedface=new CachedFaceRec;
 	cachedface->file_path=filepath;
 	family=NULL;
+	id=0;
 	instances=new BList(0);
 	has_bitmaps=(face->num_fixed_sizes>0)?true:false;
 	is_fixedwidth=(face->face_flags & FT_FACE_FLAG_FIXED_WIDTH)?true:false;
@@ -63,6 +65,10 @@ FontStyle::FontStyle(const char *filepath, FT_Face face)
 */
 FontStyle::~FontStyle(void)
 {
+	// Faces opened from this style's file are no good anymore
+	if(fontcache)
+		fontcache->RemoveStyle(this);
+
 	delete name;
 	delete path;
 	delete cachedface;
@@ -152,11 +158,14 @@ ServerFont *FontStyle::Instantiate(float size, float rotation, float shear)
 /*!
 	\brief Constructor
 	\param namestr Name of the family
+	\param index ID of the family, unique within the font server
 */
-FontFamily::FontFamily(const char *namestr)
+FontFamily::FontFamily(const char *namestr, uint16 index)
 {
 	name=new BString(namestr);
 	styles=new BList(0);
+	id=index;
+	nextstyleid=1;
 }
 
 /*!
@@ -214,6 +223,7 @@ void FontFamily::AddStyle(const char *path,FT_Face face)
 
 	item=new FontStyle(path, face);
 	item->family=this;
+	item->id=nextstyleid++;
 	styles->AddItem(item);
 	AddDependent();
 }
@@ -308,3 +318,23 @@ FontStyle *FontFamily::GetStyle(const char *style)
 	return NULL;
 }
 
+/*!
+	\brief Get the FontStyle object for the ID given
+	\param styleid ID of the style to be obtained
+	\return The FontStyle object or NULL if none was found.
+	
+	The object returned belongs to the family and must not be deleted.
+*/
+FontStyle *FontFamily::GetStyleByID(uint16 styleid)
+{
+	int32 count=styles->CountItems();
+	FontStyle *fs;
+	for(int32 i=0; i<count; i++)
+	{
+		fs=(FontStyle *)styles->ItemAt(i);
+		if(fs && fs->id==styleid)
+			return fs;
+	}
+	return NULL;
+}
+
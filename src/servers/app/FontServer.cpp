@@ -34,10 +34,12 @@
 
 #include <FontServer.h>
 #include <FontFamily.h>
+#include <FontCache.h>
 #include <ServerFont.h>
 #include "ServerConfig.h"
 
 #include <errno.h>
+#include <string.h>
 #include <Debug.h>
 
 void pathcat( char* pzPath, const char* pzName );
@@ -80,15 +82,39 @@ FontServer::FontServer(void)
 		init=false;
 
 	families=new BList(0);
+	nextfamilyid=1;
 	plain=NULL;
 	bold=NULL;
 	fixed=NULL;
+
+	// Applications map the metrics area by name, so one left behind by an
+	// earlier server must not be found instead of ours
+	area_id stale=find_area(FONT_METRICS_AREA_NAME);
+	if(stale>=0)
+		delete_area(stale);
+
+	metrics=NULL;
+	metricsarea=create_area(FONT_METRICS_AREA_NAME,(void**)&metrics,B_ANY_ADDRESS,
+		(sizeof(font_metrics_area)+B_PAGE_SIZE-1) & ~(B_PAGE_SIZE-1),B_NO_LOCK,
+		B_READ_AREA|B_WRITE_AREA);
+	if(metricsarea<B_OK)
+	{
+		printf("ERROR: Couldn't create the font metrics area\n");
+		metrics=NULL;
+	}
+	else
+	{
+		memset(metrics,0,sizeof(font_metrics_area));
+		metrics->magic=FONT_METRICS_MAGIC;
+	}
 }
 
 //! Frees items allocated in the constructor and shuts down FreeType
 FontServer::~FontServer(void)
 {
 	delete_sem(lock);
+	if(metricsarea>=B_OK)
+		delete_area(metricsarea);
 	delete families;
 	FTC_Manager_Done(ftmanager);
 	FT_Done_FreeType(ftlib);
@@ -143,6 +169,7 @@ void FontServer::RemoveFamily(const char *family)
 	{
 		families->RemoveItem(f);
 		delete f;
+		_PublishStyles();
 	}
 }
 
@@ -168,6 +195,28 @@ FontFamily *FontServer::_FindFamily(const char *name)
 	return NULL;
 }
 
+/*!
+	\brief Protected function which locates a FontFamily object
+	\param familyid The ID of the family to find
+	\return Pointer to the specified family or NULL if not found.
+	
+	Do NOT delete the FontFamily returned by this function.
+*/
+FontFamily *FontServer::_FindFamily(uint16 familyid)
+{
+	if(!init)
+		return NULL;
+	int32 count=families->CountItems(), i;
+	FontFamily *family;
+	for(i=0; i<count; i++)
+	{
+		family=(FontFamily*)families->ItemAt(i);
+		if(family->GetID()==familyid)
+			return family;
+	}
+	return NULL;
+}
+
 /*!
 	\brief Scan a folder for all valid fonts
 	\param fontspath Path of the folder to scan.
@@ -235,7 +284,7 @@ status_t FontServer::ScanDirectory(const char *fontspath)
 				printf("Font Family: %s\n",face->family_name);
 				#endif
 
-				family=new FontFamily(face->family_name);
+				family=new FontFamily(face->family_name,nextfamilyid++);
 				families->AddItem(family);
 			}
 
@@ -260,6 +309,7 @@ status_t FontServer::ScanDirectory(const char *fontspath)
 	}
 
 	need_update=true;
+	_PublishStyles();
 	return B_OK;
 }
 
@@ -416,6 +466,58 @@ FontStyle *FontServer::GetStyle(font_family family, font_style face)
 	return NULL;
 }
 
+/*!
+	\brief Retrieves the FontStyle object
+	\param familyid ID of the font's family
+	\param styleid ID of the font's style
+	\return The FontStyle having those IDs or NULL if not available
+*/
+FontStyle *FontServer::GetStyle(uint16 familyid, uint16 styleid)
+{
+	FontFamily *ffam=_FindFamily(familyid);
+
+	if(ffam)
+		return ffam->GetStyleByID(styleid);
+	return NULL;
+}
+
+/*!
+	\brief Makes sure the metrics of a font are in the metrics area
+	\param familyid ID of the font's family
+	\param styleid ID of the font's style
+	\param size Point size of the font. Only the integral part is used, as when drawing.
+	\return Index of the font's table in the metrics area, or -1 if the font does
+	not exist or the area is full.
+	
+	Tables are written once and never changed or moved, so applications read them
+	without locking. The font server must be locked.
+*/
+int32 FontServer::GetMetrics(uint16 familyid, uint16 styleid, float size)
+{
+	if(!metrics)
+		return -1;
+
+	int32 isize=int32(size);
+	int32 count=metrics->table_count;
+	for(int32 i=0; i<count; i++)
+	{
+		font_metrics_table *table=&metrics->tables[i];
+		if(table->family_id==familyid && table->style_id==styleid && table->size==isize)
+			return i;
+	}
+
+	if(count>=FONT_METRICS_MAX_TABLES)
+		return -1;
+
+	FontStyle *style=GetStyle(familyid,styleid);
+	if(!style || !_PublishMetrics(&metrics->tables[count],style,isize))
+		return -1;
+
+	// Only now that the table is complete may applications see it
+	atomic_add(&metrics->table_count,1);
+	return count;
+}
+
 /*!
 	\brief Returns the current object used for the regular style
 	\return A ServerFont pointer which is the plain font.
@@ -484,6 +586,7 @@ bool FontServer::SetSystemPlain(const char *family, const char *style, float siz
 	if(plain)
 		delete plain;
 	plain=sty->Instantiate(size);
+	_PublishStyles();
 	return true;
 }
 
@@ -507,6 +610,7 @@ bool FontServer::SetSystemBold(const char *family, const char *style, float size
 	if(bold)
 		delete bold;
 	bold=sty->Instantiate(size);
+	_PublishStyles();
 	return true;
 }
 
@@ -530,6 +634,150 @@ bool FontServer::SetSystemFixed(const char *family, const char *style, float siz
 	if(fixed)
 		delete fixed;
 	fixed=sty->Instantiate(size);
+	_PublishStyles();
 	return true;
 }
 
+/*!
+	\brief Writes the list of styles and the system fonts to the metrics area
+	
+	This lets applications look up font families and styles by name or ID
+	without asking the server. The list is written where the previous one
+	was, not over the current one, which applications may be reading, and
+	becomes the current one when the generation is counted up.
+*/
+void FontServer::_PublishStyles(void)
+{
+	if(!metrics)
+		return;
+
+	font_metrics_style_list *list=&metrics->lists[(metrics->generation+1) & 1];
+
+	int32 count=0;
+	for(int32 i=0; i<families->CountItems(); i++)
+	{
+		FontFamily *fam=(FontFamily*)families->ItemAt(i);
+		for(int32 j=0; j<fam->CountStyles() && count<FONT_METRICS_MAX_STYLES; j++)
+		{
+			FontStyle *sty=fam->GetStyle(fam->GetStyle(j));
+			if(!sty)
+				continue;
+
+			font_metrics_style *entry=&list->styles[count++];
+			entry->family_id=fam->GetID();
+			entry->style_id=sty->GetID();
+			entry->face=B_REGULAR_FACE;
+			if(strstr(sty->Name(),"Bold"))
+				entry->face=B_BOLD_FACE;
+			if(strstr(sty->Name(),"Italic") || strstr(sty->Name(),"Oblique"))
+				entry->face=(entry->face==B_BOLD_FACE) ? B_BOLD_FACE|B_ITALIC_FACE : B_ITALIC_FACE;
+			entry->flags=sty->IsFixedWidth() ? B_IS_FIXED : 0;
+			strncpy(entry->family,fam->Name(),sizeof(font_family)-1);
+			entry->family[sizeof(font_family)-1]='\0';
+			strncpy(entry->style,sty->Name(),sizeof(font_style)-1);
+			entry->style[sizeof(font_style)-1]='\0';
+		}
+	}
+	list->style_count=count;
+
+	ServerFont *systemfonts[3]={ plain, bold, fixed };
+	font_metrics_system_font *entries[3]={ &list->plain, &list->bold, &list->fixed };
+	for(int32 i=0; i<3; i++)
+	{
+		FontStyle *sty=systemfonts[i] ? systemfonts[i]->Style() : NULL;
+		if(!sty || !sty->Family())
+		{
+			memset(entries[i],0,sizeof(font_metrics_system_font));
+			continue;
+		}
+		entries[i]->family_id=sty->Family()->GetID();
+		entries[i]->style_id=sty->GetID();
+		entries[i]->size=systemfonts[i]->Size();
+	}
+
+	// Only now that the list is complete may applications see it
+	atomic_add(&metrics->generation,1);
+}
+
+/*!
+	\brief Measures a font and writes its metrics table
+	\param table The table to fill
+	\param style The font's style
+	\param size The font's size in points
+	\return true if successful, false if the font couldn't be opened
+	
+	Advances and kerning are the ones DisplayDriver::DrawString() uses, so
+	what applications measure is what gets drawn.
+*/
+bool FontServer::_PublishMetrics(font_metrics_table *table, FontStyle *style, int32 size)
+{
+	fontcache->Lock();
+	FT_Face face=fontcache->GetFace(style,size);
+	if(!face)
+	{
+		fontcache->Unlock();
+		return false;
+	}
+
+	memset(table,0,sizeof(font_metrics_table));
+	table->family_id=style->Family()->GetID();
+	table->style_id=style->GetID();
+	table->size=size;
+	table->height.ascent=face->size->metrics.ascender/64.0;
+	table->height.descent=-face->size->metrics.descender/64.0;
+	table->height.leading=face->size->metrics.height/64.0
+		- table->height.ascent - table->height.descent;
+	if(table->height.leading<0)
+		table->height.leading=0;
+
+	// Glyphs are loaded untransformed, whatever the glyph cache last set
+	FT_Set_Transform(face,NULL,NULL);
+
+	FT_UInt indices[FONT_METRICS_CHARS];
+	for(int32 c=0; c<FONT_METRICS_CHARS; c++)
+	{
+		indices[c]=FT_Get_Char_Index(face,c);
+		if(indices[c])
+			table->has_glyph[c/8]|=1 << (c%8);
+
+		if(FT_Load_Char(face,c,FT_LOAD_DEFAULT)!=0)
+			continue;
+
+		FT_Glyph_Metrics *m=&face->glyph->metrics;
+		font_metrics_glyph *glyph=&table->glyphs[c];
+		glyph->advance=face->glyph->advance.x/64.0;
+		glyph->left=m->horiBearingX/64.0;
+		glyph->top=-m->horiBearingY/64.0;
+		glyph->right=(m->horiBearingX+m->width)/64.0;
+		glyph->bottom=(m->height-m->horiBearingY)/64.0;
+	}
+
+	// Pairs are stored sorted by left, then right character
+	table->kerning_first=metrics->kerning_count;
+	if(FT_HAS_KERNING(face))
+	{
+		FT_Vector delta;
+		for(int32 left=1; left<FONT_METRICS_CHARS; left++)
+		{
+			if(!indices[left])
+				continue;
+			for(int32 right=1; right<FONT_METRICS_CHARS; right++)
+			{
+				if(!indices[right] || metrics->kerning_count>=FONT_METRICS_MAX_KERNING)
+					continue;
+				FT_Get_Kerning(face,indices[left],indices[right],ft_kerning_default,&delta);
+				if(delta.x==0)
+					continue;
+
+				font_metrics_kerning *pair=&metrics->kerning[metrics->kerning_count++];
+				pair->left=left;
+				pair->right=right;
+				pair->amount=delta.x/64.0;
+			}
+		}
+	}
+	table->kerning_count=metrics->kerning_count-table->kerning_first;
+
+	fontcache->Unlock();
+	return true;
+}
@@ -0,0 +1,241 @@
+//------------------------------------------------------------------------------
+//	File Name:		HeadlessInjector.cpp
+//	Description:	Synthetic input and frame control for an app_server
+//					running on the headless driver
+//
+//------------------------------------------------------------------------------
+
+#include <AppDefs.h>
+#include <PortLink.h>
+#include <ServerProtocol.h>
+
+#include "HeadlessInjector.h"
+
+// How long to wait for the driver to answer a request
+#define HEADLESS_REPLY_TIMEOUT	5000000
+
+/*!
+	\brief Creates the port on which the driver's replies arrive
+
+	Nothing is sent until the server has been found with WaitForServer().
+*/
+HeadlessInjector::HeadlessInjector(void)
+{
+	fInputPort=-1;
+	fServerPort=-1;
+	fControlPort=-1;
+	fReplyPort=create_port(5,"headless_injector_reply");
+}
+
+HeadlessInjector::~HeadlessInjector(void)
+{
+	if(fReplyPort>=B_OK)
+		delete_port(fReplyPort);
+}
+
+/*!
+	\brief Waits for a headless app_server to start
+	\param timeout The longest time to wait, in microseconds
+	\return B_OK when the server's ports exist, B_TIMED_OUT if they didn't appear in time
+
+	The control port is created last, once the driver is ready to draw, so
+	finding it means the server is far enough along to take input.
+*/
+status_t HeadlessInjector::WaitForServer(bigtime_t timeout)
+{
+	bigtime_t end=system_time()+timeout;
+
+	for(;;)
+	{
+		fControlPort=find_port(HEADLESS_CONTROL_PORT_NAME);
+		fInputPort=find_port(SERVER_INPUT_PORT);
+		fServerPort=find_port(SERVER_PORT_NAME);
+
+		if(fControlPort>=B_OK && fInputPort>=B_OK && fServerPort>=B_OK)
+			return B_OK;
+
+		if(system_time()>=end)
+			return B_TIMED_OUT;
+
+		snooze(10000);
+	}
+}
+
+/*!
+	\brief Sends a mouse message the way the Input Server would
+	\param code B_MOUSE_MOVED, B_MOUSE_DOWN or B_MOUSE_UP
+*/
+status_t HeadlessInjector::SendInput(int32 code, BPoint pt, int32 modifiers,
+	int32 buttons, int32 clicks)
+{
+	if(fInputPort<B_OK)
+		return B_NO_INIT;
+
+	BPortLink link(fInputPort);
+	link.StartMessage(code);
+	link.Attach<int64>(real_time_clock_usecs());
+	link.Attach<float>(pt.x);
+	link.Attach<float>(pt.y);
+
+	switch(code)
+	{
+		case B_MOUSE_MOVED:
+			link.Attach<int32>(buttons);
+			break;
+		case B_MOUSE_DOWN:
+			link.Attach<int32>(modifiers);
+			link.Attach<int32>(buttons);
+			link.Attach<int32>(clicks);
+			break;
+		case B_MOUSE_UP:
+			link.Attach<int32>(modifiers);
+			break;
+		default:
+			link.CancelMessage();
+			return B_BAD_VALUE;
+	}
+
+	return link.Flush();
+}
+
+status_t HeadlessInjector::MouseMoved(BPoint pt, int32 buttons)
+{
+	return SendInput(B_MOUSE_MOVED,pt,0,buttons,0);
+}
+
+status_t HeadlessInjector::MouseDown(BPoint pt, int32 buttons, int32 clicks, int32 modifiers)
+{
+	return SendInput(B_MOUSE_DOWN,pt,modifiers,buttons,clicks);
+}
+
+status_t HeadlessInjector::MouseUp(BPoint pt, int32 modifiers)
+{
+	return SendInput(B_MOUSE_UP,pt,modifiers,0,0);
+}
+
+//! Moves to the point and clicks the primary button there
+status_t HeadlessInjector::Click(BPoint pt)
+{
+	status_t err=MouseMoved(pt);
+	if(err==B_OK)
+		err=MouseDown(pt);
+	if(err==B_OK)
+		err=MouseUp(pt);
+	return err;
+}
+
+status_t HeadlessInjector::KeyDown(int32 scancode, int32 modifiers)
+{
+	if(fInputPort<B_OK)
+		return B_NO_INIT;
+
+	BPortLink link(fInputPort);
+	link.StartMessage(B_KEY_DOWN);
+	link.Attach<bigtime_t>(real_time_clock_usecs());
+	link.Attach<int32>(scancode);
+	link.Attach<int32>(modifiers);
+	return link.Flush();
+}
+
+status_t HeadlessInjector::KeyUp(int32 scancode, int32 modifiers)
+{
+	if(fInputPort<B_OK)
+		return B_NO_INIT;
+
+	BPortLink link(fInputPort);
+	link.StartMessage(B_KEY_UP);
+	link.Attach<bigtime_t>(real_time_clock_usecs());
+	link.Attach<int32>(scancode);
+	link.Attach<int32>(modifiers);
+	return link.Flush();
+}
+
+/*!
+	\brief Asks the driver how much has been drawn
+	\param updates Receives the number of updates since the server started
+	\param pixels Receives the number of pixels those updates covered
+	\param bounds Receives the framebuffer's bounds
+	\param space Receives the framebuffer's color space
+	\return B_OK if the driver answered, an error if not
+
+	Any of the pointers may be NULL.
+*/
+status_t HeadlessInjector::GetFrameInfo(int32 *updates, int64 *pixels, BRect *bounds,
+	color_space *space)
+{
+	if(fControlPort<B_OK || fReplyPort<B_OK)
+		return B_NO_INIT;
+
+	BPortLink link(fControlPort,fReplyPort);
+	link.StartMessage(HEADLESS_GET_FRAME_INFO);
+	link.Attach<port_id>(fReplyPort);
+	status_t err=link.Flush();
+	if(err<B_OK)
+		return err;
+
+	int32 code;
+	err=link.GetNextReply(&code,HEADLESS_REPLY_TIMEOUT);
+	if(err<B_OK)
+		return err;
+	if(code!=SERVER_TRUE)
+		return B_ERROR;
+
+	int32 count, width, height, colorspace;
+	int64 area;
+	link.Read<int32>(&count);
+	link.Read<int64>(&area);
+	link.Read<int32>(&width);
+	link.Read<int32>(&height);
+	err=link.Read<int32>(&colorspace);
+	if(err<B_OK)
+		return err;
+
+	if(updates)
+		*updates=count;
+	if(pixels)
+		*pixels=area;
+	if(bounds)
+		bounds->Set(0,0,width-1,height-1);
+	if(space)
+		*space=(color_space)colorspace;
+	return B_OK;
+}
+
+/*!
+	\brief Has the driver save the framebuffer as a PNG
+	\param path The file to write, as the server sees it
+	\return B_OK if the frame was written, an error if not
+*/
+status_t HeadlessInjector::DumpFrame(const char *path)
+{
+	if(fControlPort<B_OK || fReplyPort<B_OK)
+		return B_NO_INIT;
+	if(!path)
+		return B_BAD_VALUE;
+
+	BPortLink link(fControlPort,fReplyPort);
+	link.StartMessage(HEADLESS_DUMP_FRAME);
+	link.Attach<port_id>(fReplyPort);
+	link.AttachString(path);
+	status_t err=link.Flush();
+	if(err<B_OK)
+		return err;
+
+	int32 code;
+	err=link.GetNextReply(&code,HEADLESS_REPLY_TIMEOUT);
+	if(err<B_OK)
+		return err;
+
+	return (code==SERVER_TRUE) ? B_OK : B_ERROR;
+}
+
+//! Asks the server to shut down, as closing the X11 window does
+status_t HeadlessInjector::Quit(void)
+{
+	if(fServerPort<B_OK)
+		return B_NO_INIT;
+
+	BPortLink link(fServerPort);
+	link.StartMessage(B_QUIT_REQUESTED);
+	return link.Flush();
+}
@@ -36,6 +36,7 @@
 #include "Layer.h"
 #include "ServerWindow.h"
 #include "WinBorder.h"
+#include "BackingStore.h"
 #include "RGBColor.h"
 #include "RootLayer.h"
 #include "DisplayDriver.h"
@@ -60,6 +61,30 @@ BRegion	gRedrawReg;
 BList gCopyRegList;
 BList gCopyList;
 
+static region_rebuild_stats gPassStats;
+static region_rebuild_stats gTotalStats;
+static int gPrintRegionStats = -1;
+
+//! Returns true if both regions are made of the same rectangles
+static bool regions_equal(const BRegion &a, const BRegion &b)
+{
+	BRegion *ra = const_cast<BRegion*>(&a);
+	BRegion *rb = const_cast<BRegion*>(&b);
+	int32 count = ra->CountRects();
+	if (count != rb->CountRects())
+		return false;
+
+	for (int32 i = 0; i < count; i++)
+	{
+		clipping_rect r1 = ra->RectAtInt(i);
+		clipping_rect r2 = rb->RectAtInt(i);
+		if (r1.left != r2.left || r1.top != r2.top
+			|| r1.right != r2.right || r1.bottom != r2.bottom)
+			return false;
+	}
+	return true;
+}
+
 Layer::Layer(BRect frame, const char *name, int32 token, uint32 resize,
 				uint32 flags, DisplayDriver *driver)
 {
@@ -106,6 +131,8 @@ Layer::Layer(BRect frame, const char *name, int32 token, uint32 resize,
 	
 	// NOW all regions (fVisible, fFullVisible, fFull) are empty
 	fClipReg		= &fVisible;
+	fRegionsDirty	= true;
+	fWasHidden		= false;
 	STRACE(("Layer(%s) successfuly created\n", GetName()));
 }
 
@@ -172,6 +199,7 @@ void Layer::AddChild(Layer *layer, ServerWindow *serverWin)
 		fTopChild = layer;
 	}
 	fBottomChild = layer;
+	MarkRegionsDirty();
 
 	// if we have no RootLayer yet, then there is no need to set any parameters --
 	// they will be set when the RootLayer for this tree will be added
@@ -279,6 +307,7 @@ void Layer::RemoveChild(Layer *layer)
 	
 	layer->fUpperSibling = NULL;
 	layer->fLowerSibling = NULL;
+	MarkRegionsDirty();
 
 	// 2) Iterate over all of the removed-layer's descendants and unset the
 	//	root layer, server window, and all redraw-related regions
@@ -300,6 +329,8 @@ void Layer::RemoveChild(Layer *layer)
 			c->fFullVisible.MakeEmpty();
 			// 2.5) we don't have a visible region anymore.
 			c->fVisible.MakeEmpty();
+			// 2.6) nothing we had computed is any good now.
+			c->fRegionsDirty = true;
 		}
 
 		// tree parsing algorithm
@@ -563,6 +594,16 @@ void Layer::RequestDraw(const BRegion &reg, Layer *startFrom)
 				if (fUpdateReg.CountRects() > 0)
 				{
 					SendUpdateMsg();
+					
+					// until the client is done, the screen doesn't have
+					// what is worth saving there
+					if (fParent && fParent->fClassID == AS_WINBORDER_CLASS)
+					{
+						WinBorder *border = (WinBorder*)fParent;
+						if (border->fBackingStore)
+							border->fBackingStore->AddPending(fUpdateReg,
+								border->fFrame.LeftTop());
+					}
 				}
 				
 				// we're not that different than other. We too have an
@@ -582,10 +623,8 @@ void Layer::RequestDraw(const BRegion &reg, Layer *startFrom)
 
 			if (fUpdateReg.CountRects() > 0)
 			{
-				// clear background with viewColor.
-				fDriver->ConstrainClippingRegion(&fUpdateReg);
-				fDriver->FillRect(fUpdateReg.Frame(), fLayerData->viewcolor);
-				fDriver->ConstrainClippingRegion(NULL);
+				// clear background with viewColor, but only where it shows
+				fDriver->FillRegion(fUpdateReg, fLayerData->viewcolor);
 			}
 		}
 		else
@@ -613,6 +652,29 @@ void Layer::RequestDraw(const BRegion &reg, Layer *startFrom)
 		}
 	}
 
+	// What the backing store has of our client area is put back once our
+	// children are done and only the rest is left to them.
+	BackingStore *store = NULL;
+	if (fClassID == AS_WINBORDER_CLASS)
+		store = ((WinBorder*)this)->fBackingStore;
+	
+	const BRegion *childReg = &reg;
+	BRegion restorable;
+	BRegion unrestored;
+	if (store)
+	{
+		BRegion client(fFullVisible);
+		client.Exclude(&fVisible);
+		store->GetRestorable(reg, client, fFrame, &restorable);
+		
+		if (restorable.CountRects() > 0)
+		{
+			unrestored = reg;
+			unrestored.Exclude(&restorable);
+			childReg = &unrestored;
+		}
+	}
+
 	for (Layer *lay = VirtualBottomChild(); lay != NULL; lay = VirtualUpperSibling())
 	{
 		if (lay == startFrom)
@@ -623,19 +685,24 @@ void Layer::RequestDraw(const BRegion &reg, Layer *startFrom)
 			// no need to go deeper if not even the FullVisible region intersects
 			// Update one.
 			BRegion common(lay->fFullVisible);
-			common.IntersectWith(&reg);
+			common.IntersectWith(childReg);
 			
 			if (common.CountRects() > 0)
 			{
 				// lock/unlock if we are a winborder
 				if (lay->fClassID == AS_WINBORDER_CLASS)
 					lay->Window()->Lock();
-				lay->RequestDraw(reg, NULL);
+				lay->RequestDraw(*childReg, NULL);
 				if (lay->fClassID == AS_WINBORDER_CLASS)
 					lay->Window()->Unlock();
 			}
 		}
 	}
+	
+	// Children may draw beyond what they were asked to, like a top view
+	// which wants full updates, so this comes last.
+	if (restorable.CountRects() > 0)
+		store->Restore(restorable, fFrame);
 }
 
 void Layer::Draw(const BRect &r)
@@ -741,6 +808,8 @@ void Layer::RebuildFullRegion(void)
 {
 	STRACE(("Layer(%s)::RebuildFullRegion()\n", GetName()));
 	
+	MarkRegionsDirty();
+	
 	if (fParent)
 		fFull.Set( fParent->ConvertToTop( fFrame ) );
 	else
@@ -769,6 +838,67 @@ void Layer::RebuildFullRegion(void)
 	}
 }
 
+/*!
+	\brief Makes the next rebuild compute this layer's regions again
+	
+	Called whenever the layer's full region or its children change. The
+	layer's ancestors are marked as well so the rebuild gets down to it.
+*/
+void Layer::MarkRegionsDirty(void)
+{
+	for (Layer *lay = this; lay != NULL; lay = lay->fParent)
+		lay->fRegionsDirty = true;
+}
+
+/*!
+	\brief Adds the parts of the screen the layer's regions are taken from
+	\param reach The region to add them to
+	
+	That is the layer's full region, along with those of its children when
+	they clip against our parent instead of us.
+*/
+void Layer::IncludeReach(BRegion *reach)
+{
+	reach->Include(&fFull);
+	gPassStats.regionOps++;
+	
+	if (fAdFlags & B_LAYER_CHILDREN_DEPENDANT)
+	{
+		for (Layer *lay = fTopChild; lay != NULL; lay = lay->fLowerSibling)
+			lay->IncludeReach(reach);
+	}
+}
+
+/*!
+	\brief Determines whether the regions from the last rebuild are still right
+	\param available Receives the part of our reach the parent has left visible
+	\return true if nothing the layer's regions depend on has changed
+	
+	A layer's regions depend only on its full region, its children and the
+	part of its reach its parent had left visible when its turn came.
+	Children of a parent which lets them clip its own parent, like the
+	top view of a WinBorder, are always rebuilt along with that parent.
+*/
+bool Layer::CanKeepRegions(BRegion *available)
+{
+	if (!fParent || (fParent->fAdFlags & B_LAYER_CHILDREN_DEPENDANT))
+		return false;
+
+	IncludeReach(available);
+	available->IntersectWith(&(fParent->fVisible));
+	gPassStats.regionOps++;
+
+	if (fRegionsDirty || IsHidden() != fWasHidden)
+		return false;
+
+	// nothing of a hidden layer is used, whatever is left for it
+	if (fWasHidden)
+		return true;
+
+	gPassStats.regionOps++;
+	return regions_equal(*available, fAvailable);
+}
+
 void Layer::RebuildRegions( const BRegion& reg, uint32 action, BPoint pt, BPoint ptOffset)
 {
 	STRACE(("Layer(%s)::RebuildRegions() START\n", GetName()));
@@ -784,6 +914,42 @@ void Layer::RebuildRegions( const BRegion& reg, uint32 action, BPoint pt, BPoint
 	// one for app_server which will be emptied as soon as this critical operation ended.
 	// Talk to DW, Gabe.
 	
+	gPassStats.layers++;
+	
+	// When nothing we depend on has changed, neither have our regions nor
+	// those of our children. All our parent needs is for us to take our part.
+	BRegion available;
+	bool keep = CanKeepRegions(&available);
+	if (action == B_LAYER_NONE && keep)
+	{
+		gPassStats.reused++;
+		if (!fWasHidden && fFullVisible.CountRects() > 0)
+		{
+			fParent->fVisible.Exclude(&fFullVisible);
+			gPassStats.regionOps++;
+		}
+		return;
+	}
+	
+	gPassStats.rebuilt++;
+	fAvailable = available;
+	
+	// a window's backing store has to know what its client area had on screen
+	BackingStore *store = NULL;
+	BRegion oldClient;
+	BPoint oldOrigin(fFrame.LeftTop());
+	if (fClassID == AS_WINBORDER_CLASS)
+		store = ((WinBorder*)this)->fBackingStore;
+	if (store && !fWasHidden)
+	{
+		oldClient = fFullVisible;
+		oldClient.Exclude(&fVisible);
+	}
+	
+	fWasHidden = IsHidden();
+	// a move or resize changes what we reach, so we'll have to look again
+	fRegionsDirty = (action != B_LAYER_NONE);
+	
 	BRegion	oldRegion;
 	uint32 newAction = action;
 	BPoint newPt = pt;
@@ -883,10 +1049,11 @@ void Layer::RebuildRegions( const BRegion& reg, uint32 action, BPoint pt, BPoint
 		}
 	}
 
-	if (!IsHidden())
+	if (!fWasHidden)
 	{
 		fFullVisible.MakeEmpty();
 		fVisible = fFull;
+		gPassStats.regionOps++;
 		
 		#ifdef DEBUG_LAYER_REBUILD
 			printf("\n ======= Layer(%s):: RR ****** ======\n", GetName());
@@ -920,7 +1087,10 @@ void Layer::RebuildRegions( const BRegion& reg, uint32 action, BPoint pt, BPoint
 
 				// our visible area is relative to our parent's parent.
 				if (fParent->fParent)
+				{
 					fVisible.IntersectWith(&(fParent->fParent->fVisible));
+					gPassStats.regionOps++;
+				}
 					
 				#ifdef DEBUG_LAYER_REBUILD
 					fVisible.PrintToStream();
@@ -928,7 +1098,10 @@ void Layer::RebuildRegions( const BRegion& reg, uint32 action, BPoint pt, BPoint
 				// exclude parent's visible area which could be composed by
 				// prior siblings' visible areas.
 				if (fVisible.CountRects() > 0)
+				{
 					fVisible.Exclude(&(fParent->fVisible));
+					gPassStats.regionOps++;
+				}
 				
 				#ifdef DEBUG_LAYER_REBUILD
 					fVisible.PrintToStream();
@@ -939,13 +1112,17 @@ void Layer::RebuildRegions( const BRegion& reg, uint32 action, BPoint pt, BPoint
 				if (fVisible.CountRects() > 0)
 				{
 					fParent->fFullVisible.Include(&fVisible);
+					gPassStats.regionOps++;
 						
 					#ifdef DEBUG_LAYER_REBUILD
 						fParent->fFullVisible.PrintToStream();
 					#endif
 					
 					if (fParent->fParent)
+					{
 						fParent->fParent->fVisible.Exclude(&fVisible);
+						gPassStats.regionOps++;
+					}
 					
 					#ifdef DEBUG_LAYER_REBUILD
 						fParent->fParent->fVisible.PrintToStream();
@@ -965,19 +1142,39 @@ void Layer::RebuildRegions( const BRegion& reg, uint32 action, BPoint pt, BPoint
 				
 				// the visible area is the one common with parent's one.
 				fVisible.IntersectWith(&(fParent->fVisible));
+				gPassStats.regionOps++;
 				// exclude from parent's visible area. we're the owners now.
 				if (fVisible.CountRects() > 0)
+				{
 					fParent->fVisible.Exclude(&fVisible);
+					gPassStats.regionOps++;
+				}
 			}
 		}
 		fFullVisible = fVisible;
+		gPassStats.regionOps++;
 	}
 	
 	// Rebuild regions for children...
 	for(Layer *lay = VirtualBottomChild(); lay != NULL; lay = VirtualUpperSibling())
 		lay->RebuildRegions(reg, newAction, newPt, newOffset);
 	
-	if(!IsHidden())
+	if (store)
+	{
+		// our visible region is the decorator's, the rest is the client's
+		BRegion newClient;
+		if (!fWasHidden)
+		{
+			newClient = fFullVisible;
+			newClient.Exclude(&fVisible);
+		}
+		
+		// nothing has been copied or redrawn yet, so the screen still has
+		// what was covered, unless we are the one moving
+		store->Update(oldClient, oldOrigin, newClient, fFrame, action == B_LAYER_NONE);
+	}
+	
+	if(!fWasHidden)
 	{
 		switch(action)
 		{
@@ -989,6 +1186,7 @@ void Layer::RebuildRegions( const BRegion& reg, uint32 action, BPoint pt, BPoint
 				
 				if(r.CountRects() > 0)
 					gRedrawReg.Include(&r);
+				gPassStats.regionOps += 3;
 				break;
 			}
 			case B_LAYER_MOVE:
@@ -1090,6 +1288,9 @@ void Layer::RebuildRegions( const BRegion& reg, uint32 action, BPoint pt, BPoint
 void Layer::StartRebuildRegions( const BRegion& reg, Layer *target, uint32 action, BPoint& pt)
 {
 	STRACE(("Layer(%s)::StartRebuildRegions() START\n", GetName()));
+	memset(&gPassStats, 0, sizeof(gPassStats));
+	gPassStats.passes = 1;
+	
 	if(!fParent)
 		fFullVisible = fFull;
 	
@@ -1126,6 +1327,21 @@ void Layer::StartRebuildRegions( const BRegion& reg, Layer *target, uint32 actio
 	if (redrawReg.CountRects() > 0)
 		gRedrawReg.Include(&redrawReg);
 	
+	gTotalStats.passes += gPassStats.passes;
+	gTotalStats.layers += gPassStats.layers;
+	gTotalStats.rebuilt += gPassStats.rebuilt;
+	gTotalStats.reused += gPassStats.reused;
+	gTotalStats.regionOps += gPassStats.regionOps;
+	
+	if (gPrintRegionStats < 0)
+		gPrintRegionStats = getenv(REGION_STATS_VARIABLE) ? 1 : 0;
+	if (gPrintRegionStats)
+	{
+		printf("Layer(%s)::StartRebuildRegions(): %ld layers, %ld rebuilt, %ld kept, "
+			"%ld region operations\n", GetName(), gPassStats.layers,
+			gPassStats.rebuilt, gPassStats.reused, gPassStats.regionOps);
+	}
+	
 	#ifdef DEBUG_LAYER_REBUILD
 	printf("Layer(%s)::StartRebuildREgions() ended! Redraw Region:\n", GetName());
 	gRedrawReg.PrintToStream();
@@ -1142,6 +1358,22 @@ void Layer::StartRebuildRegions( const BRegion& reg, Layer *target, uint32 actio
 	STRACE(("Layer(%s)::StartRebuildRegions() END\n", GetName()));
 }
 
+/*!
+	\brief Returns how much work region rebuilding has taken
+	\param last Receives the counts for the last StartRebuildRegions() call
+	\param total Receives the counts for all of them
+	
+	Either pointer may be NULL. Set REGION_STATS_VARIABLE in the environment
+	to have the counts printed after each rebuild.
+*/
+void Layer::GetRebuildStats(region_rebuild_stats *last, region_rebuild_stats *total)
+{
+	if (last)
+		*last = gPassStats;
+	if (total)
+		*total = gTotalStats;
+}
+
 //! Moves the layer by specified values, complete with redraw
 void Layer::MoveBy(float x, float y)
 {
@@ -60,6 +60,18 @@ enum
 	AS_ROOTLAYER_CLASS	= 3,
 };
 
+//! Environment variable which makes the server print the cost of each region rebuild
+#define REGION_STATS_VARIABLE	"COSMOE_REGION_STATS"
+
+typedef struct
+{
+	int32 passes;		// calls to StartRebuildRegions()
+	int32 layers;		// layers visited
+	int32 rebuilt;		// layers whose regions were computed again
+	int32 reused;		// layers whose regions were kept from the last pass
+	int32 regionOps;	// region copies, compares, intersections and exclusions
+} region_rebuild_stats;
+
 class ServerWindow;
 class RootLayer;
 class DisplayDriver;
@@ -99,6 +111,8 @@ public:
 	void StartRebuildRegions( const BRegion& reg, Layer *target, uint32 action, BPoint& pt);
 	void RebuildRegions( const BRegion& reg, uint32 action, BPoint pt, BPoint ptOffset);
 	uint32 ResizeOthers(float x, float y,  BPoint coords[], BPoint *ptOffset);
+	void MarkRegionsDirty(void);
+	static void GetRebuildStats(region_rebuild_stats *last, region_rebuild_stats *total);
 	
 	void Redraw(const BRegion& reg, Layer *startFrom=NULL);
 	
@@ -174,6 +188,11 @@ protected:
 	BRegion	fUpdateReg;
 	BRegion *fClipReg;
 	
+	// the part of our reach our parent had left visible at the last rebuild
+	BRegion fAvailable;
+	bool fRegionsDirty;
+	bool fWasHidden;
+	
 	BRegion *clipToPicture;
 	bool clipToPictureInverse;
 	
@@ -197,6 +216,8 @@ protected:
 	RootLayer *fRootLayer;
 
 private:
+	void IncludeReach(BRegion *reach);
+	bool CanKeepRegions(BRegion *available);
 	void RequestDraw(const BRegion &reg, Layer *startFrom);
 	ServerWindow *SearchForServerWindow(void);
 
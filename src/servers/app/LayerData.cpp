@@ -66,6 +66,7 @@ DrawData::~DrawData(void)
 
 DrawData::DrawData(const DrawData &data)
 {
+	clipReg=NULL;
 	*this=data;
 }
 
@@ -22,16 +22,34 @@
 //	File Name:		PixelRenderer.h
 //	Author:			DarkWyrm <bpmagic@columbus.rr.com>
 //
-//	Description:	Base class for pixel plotting renderers
+//	Description:	Span renderers for each color space
 //					Based on concepts from the Anti-Grain Geometry vector gfx library
 //------------------------------------------------------------------------------
 #include "PixelRenderer.h"
+#include <stdlib.h>
 #include <string.h>
-#include "IPoint.h"
+#include "LayerData.h"
 
+/*!
+	\brief Sets up the renderer to draw in black with B_OP_COPY
+	\param buffer The buffer to draw into
+*/
 PixelRenderer::PixelRenderer(GraphicsBuffer &buffer)
 {
 	fBuffer=&buffer;
+	fSpanCount=0;
+	fSourceValid=false;
+	
+	fHigh.red=fHigh.green=fHigh.blue=0;
+	fHigh.alpha=255;
+	fLow=fHigh;
+	memset(fPattern,0xff,8);
+	fSolid=true;
+	fMode=B_OP_COPY;
+	fAlphaSource=B_PIXEL_ALPHA;
+	fAlphaFunction=B_ALPHA_OVERLAY;
+	fComposite=NULL;
+	fBlend=NULL;
 }
 
 PixelRenderer::~PixelRenderer(void)
@@ -44,235 +62,249 @@ RGBColor PixelRenderer::GetPixel(const IPoint &pt)
 	return c;
 }
 
-void PixelRenderer::PixelRenderer::PutPixel(const IPoint &pt, RGBColor &c)
-{
-}
-
-void PixelRenderer::PutHLine(const IPoint &pt, const uint32 length, RGBColor &c)
-{
-}
-
-void PixelRenderer::PutVLine(const IPoint &pt, const uint32 length, RGBColor &c)
-{
-}
-
-//----------------------------------------------------------------------------------------
-//
-//	PixelRendererRGBA32:	32-Bit color handler
-//
-//----------------------------------------------------------------------------------------
-
-PixelRendererRGBA32::PixelRendererRGBA32(GraphicsBuffer &buffer)
- : PixelRenderer(buffer)
-{
-}
-
-PixelRendererRGBA32::~PixelRendererRGBA32(void)
-{
-}
-
-RGBColor PixelRendererRGBA32::GetPixel(const IPoint &pt)
-{
-	uint8 *pixel=GetBuffer()->RowAt(pt.y) + (pt.x << 2);
-	return RGBColor(pixel[2],pixel[1],pixel[0],pixel[3]);
-}
-
-void PixelRendererRGBA32::PutPixel(const IPoint &pt, RGBColor &color)
+/*!
+	\brief Draws everything from now on in a solid color with B_OP_COPY
+	\param color The color to draw with
+*/
+void PixelRenderer::SetColor(const RGBColor &color)
 {
 	rgb_color c=color.GetColor32();
-
-	uint8 *pixel=GetBuffer()->RowAt(pt.y) + (pt.x << 2);
+	if(fSolid && fMode==B_OP_COPY && memcmp(&c,&fHigh,sizeof(rgb_color))==0)
+		return;
 	
-	pixel[0]=c.blue;
-	pixel[1]=c.green;
-	pixel[2]=c.red;
-	pixel[3]=c.alpha;
+	FlushSpans();
+	fHigh=c;
+	fLow=c;
+	memset(fPattern,0xff,8);
+	fSolid=true;
+	fMode=B_OP_COPY;
+	fSourceValid=false;
+	UpdateColors();
 }
 
-void PixelRendererRGBA32::PutHLine(const IPoint &pt, const uint32 length, RGBColor &color)
+/*!
+	\brief Draws everything from now on with a DrawData's pattern, colors and mode
+	\param d The DrawData to draw with
+*/
+void PixelRenderer::SetDrawData(const DrawData *d)
 {
-	rgb_color c=color.GetColor32();
-	
-	uint32 *pixel32=(uint32*)GetBuffer()->RowAt(pt.y);
-	uint8 *pixel=(uint8*)&(pixel32[pt.x]);
-	
-	pixel[0]=c.blue;
-	pixel[1]=c.green;
-	pixel[2]=c.red;
-	pixel[3]=c.alpha;
-	int32 color32=*pixel32;
-	
-	uint32 end=pt.x+length;
-	
-	for(uint32 i=pt.x+1; i<end; i++)
-		pixel32[i]=color32;
-}
-
-void PixelRendererRGBA32::PutVLine(const IPoint &pt, const uint32 length, RGBColor &color)
-{
-	rgb_color c=color.GetColor32();
+	if(!d)
+		return;
 	
-	uint32 *pixel32=(uint32*)GetBuffer()->RowAt(pt.y);
-	uint8 *pixel=(uint8*)&(pixel32[pt.x]);
-	
-	pixel[0]=c.blue;
-	pixel[1]=c.green;
-	pixel[2]=c.red;
-	pixel[3]=c.alpha;
-	int32 color32=*pixel32;
-	
-	uint32 end=pt.y+length;
-	
-	for(uint32 i=pt.y+1; i<end; i++)
+	FlushSpans();
+	fHigh=d->highcolor.GetColor32();
+	fLow=d->lowcolor.GetColor32();
+	memcpy(fPattern,d->patt.GetInt8(),8);
+	fSolid=true;
+	for(int32 i=0; i<8; i++)
 	{
-		pixel32=(uint32*)GetBuffer()->RowAt(i);
-		pixel32[pt.x]=color32;
+		if(fPattern[i]!=0xff)
+			fSolid=false;
 	}
+	fMode=d->draw_mode;
+	fAlphaSource=d->alphaSrcMode;
+	fAlphaFunction=d->alphaFncMode;
+	fSourceValid=false;
+	UpdateColors();
 }
 
-//----------------------------------------------------------------------------------------
-//
-//	PixelRendererRGB16:	16-Bit color handler -- 565 space
-//
-//----------------------------------------------------------------------------------------
-
-PixelRendererRGB16::PixelRendererRGB16(GraphicsBuffer &buffer)
- : PixelRenderer(buffer)
+/*!
+	\brief Converts the colors for the buffer. Subclasses call PickCompositors().
+*/
+void PixelRenderer::UpdateColors(void)
 {
 }
 
-PixelRendererRGB16::~PixelRendererRGB16(void)
+/*!
+	\brief Picks the compositors for the drawing mode at a depth
+	\param bitsperpixel Depth of the buffer
+*/
+void PixelRenderer::PickCompositors(int32 bitsperpixel)
 {
+	fState.high=fHigh;
+	fState.low=fLow;
+	
+	fComposite=NULL;
+	if(fMode!=B_OP_COPY)
+		fComposite=get_compositor(fMode,fAlphaSource,fAlphaFunction,bitsperpixel);
+	
+	// Partly covered pixels are blended with their coverage as alpha in the
+	// modes which blend anyway
+	fBlend=get_compositor(B_OP_ALPHA,B_PIXEL_ALPHA,
+		fMode==B_OP_ALPHA ? fAlphaFunction : B_ALPHA_OVERLAY,bitsperpixel);
 }
 
-// TODO: Double check the values in RGB16 renderer to make sure they are correct for little endian
-
-RGBColor PixelRendererRGB16::GetPixel(const IPoint &pt)
+/*!
+	\brief Draws a batch of spans
+	\param spans The spans, which must be inside the buffer
+	\param count The number of spans
+*/
+void PixelRenderer::RenderSpans(const renderer_span *spans, int32 count)
 {
-	uint16 pixel=((uint16*)GetBuffer()->RowAt(pt.y))[pt.x];
-	return RGBColor( (pixel<<3) & 248, (pixel>>3) & 252, (pixel>>8) & 248);
 }
 
-void PixelRendererRGB16::PutPixel(const IPoint &pt, RGBColor &c)
+//! Makes the pattern's rows into source rows for the compositors
+void PixelRenderer::MakeSourceRows(void)
 {
-	((uint16*)GetBuffer()->RowAt(pt.y))[pt.x]=c.GetColor16();
+	for(int32 i=0; i<8; i++)
+	{
+		compositor_pattern_row(fSource[i],fSourceHigh[i],RENDERER_CHUNK_SIZE+8,
+			fPattern[i],0,fHigh,fLow);
+	}
+	fSourceValid=true;
 }
 
-void PixelRendererRGB16::PutHLine(const IPoint &pt, const uint32 length, RGBColor &color)
-{
-	uint16 *pixel16=(uint16*)GetBuffer()->RowAt(pt.y);
-	uint32 end=pt.x+length;
+/*!
+	\brief Draws a span through the compositors
+	\param span The span
+	\param dest Its first pixel in the buffer
+	\param pixelsize Bytes per pixel of the buffer
 	
-	for(uint32 i=pt.x; i<end; i++)
-		pixel16[i]=color.GetColor16();
-}
-
-void PixelRendererRGB16::PutVLine(const IPoint &pt, const uint32 length, RGBColor &color)
+	This is for drawing modes other than B_OP_COPY, and for spans with
+	coverage. B_OP_COPY and B_OP_ALPHA blend partly covered pixels. The other
+	modes have no sensible way to, so they draw the pixels which are at least
+	half covered.
+*/
+void PixelRenderer::CompositeSpan(const renderer_span &span, uint8 *dest,
+	int32 pixelsize)
 {
-	uint32 end=pt.y+length;
-	uint16 *index;
+	if(!fSourceValid)
+		MakeSourceRows();
 	
-	for(uint32 i=pt.y; i<end; i++)
+	int32 row=span.y & 7;
+	for(int32 done=0; done<span.length; done+=RENDERER_CHUNK_SIZE)
 	{
-		index=(uint16*)GetBuffer()->RowAt(i);
-		index[pt.x]=color.GetColor16();
+		int32 count=span.length-done;
+		if(count>RENDERER_CHUNK_SIZE)
+			count=RENDERER_CHUNK_SIZE;
+		
+		int32 phase=(span.x+done) & 7;
+		const uint8 *src=fSource[row] + phase*4;
+		const uint8 *high=fSourceHigh[row] + phase;
+		uint8 *pixels=dest + done*pixelsize;
+		
+		if(!span.coverage)
+		{
+			fComposite(pixels,src,high,count,&fState);
+			continue;
+		}
+		
+		const uint8 *coverage=span.coverage + done;
+		if(fMode==B_OP_COPY || fMode==B_OP_ALPHA)
+		{
+			if(!fBlend)
+				return;
+			
+			uint8 blended[RENDERER_CHUNK_SIZE*4];
+			memcpy(blended,src,count*4);
+			for(int32 i=0; i<count; i++)
+			{
+				int32 alpha=coverage[i];
+				if(fMode==B_OP_ALPHA)
+				{
+					int32 a=(fAlphaSource==B_CONSTANT_ALPHA) ? fHigh.alpha : blended[i*4+3];
+					alpha=(alpha*a + 127)/255;
+				}
+				blended[i*4+3]=alpha;
+			}
+			fBlend(pixels,blended,NULL,count,&fState);
+			continue;
+		}
+		
+		// Runs of pixels which are at least half covered
+		int32 i=0;
+		while(i<count)
+		{
+			while(i<count && coverage[i]<128)
+				i++;
+			int32 start=i;
+			while(i<count && coverage[i]>=128)
+				i++;
+			if(i>start)
+			{
+				fComposite(pixels+start*pixelsize,src+start*4,high+start,
+					i-start,&fState);
+			}
+		}
 	}
 }
 
-//----------------------------------------------------------------------------------------
-//
-//	PixelRendererRGBA15:	15-Bit color handler -- 5551 space
-//
-//----------------------------------------------------------------------------------------
-
-PixelRendererRGBA15::PixelRendererRGBA15(GraphicsBuffer &buffer)
- : PixelRenderer(buffer)
+//! Draws a pixel
+void PixelRenderer::PutPixel(const IPoint &pt)
 {
+	AddSpan(pt.x,pt.y,1);
 }
 
-PixelRendererRGBA15::~PixelRendererRGBA15(void)
-{
-}
-
-// TODO: Double check the values in RGBA15 renderer to make sure they are correct for little endian
-
-RGBColor PixelRendererRGBA15::GetPixel(const IPoint &pt)
+//! Draws a horizontal line starting at a point
+void PixelRenderer::PutHLine(const IPoint &pt, const uint32 length)
 {
-	uint16 pixel=((uint16*)GetBuffer()->RowAt(pt.y))[pt.x];
-	return RGBColor( 	(pixel<<3) & 248, 
-						(pixel>>3) & 252,
-						(pixel>>7) & 248,
-						((pixel>>8) & 128)?255:0 );
+	AddSpan(pt.x,pt.y,length);
 }
 
-void PixelRendererRGBA15::PutPixel(const IPoint &pt, RGBColor &color)
+//! Draws a vertical line starting at a point
+void PixelRenderer::PutVLine(const IPoint &pt, const uint32 length)
 {
-	((uint16*)GetBuffer()->RowAt(pt.y))[pt.x]=color.GetColor15();
+	for(uint32 i=0; i<length; i++)
+		AddSpan(pt.x,pt.y+i,1);
 }
 
-void PixelRendererRGBA15::PutHLine(const IPoint &pt, const uint32 length, RGBColor &color)
-{
-	uint16 *pixel16=(uint16*)GetBuffer()->RowAt(pt.y);
-	uint32 end=pt.x+length;
+/*!
+	\brief Draws a one pixel wide line, both ends included
 	
-	for(uint32 i=pt.x; i<end; i++)
-		pixel16[i]=color.GetColor15();
-}
-
-void PixelRendererRGBA15::PutVLine(const IPoint &pt, const uint32 length, RGBColor &color)
+	The line is walked with Bresenham's algorithm and every row of it is one
+	span, so a mostly horizontal line is a handful of spans and not a pixel
+	at a time.
+*/
+void PixelRenderer::StrokeLine(int32 x1, int32 y1, int32 x2, int32 y2)
 {
-	uint32 end=pt.y+length;
-	uint16 *index;
+	// Always go down, so that rows come one after another
+	if(y2<y1)
+	{
+		int32 t=x1; x1=x2; x2=t;
+		t=y1; y1=y2; y2=t;
+	}
 	
-	for(uint32 i=pt.y; i<end; i++)
+	int32 dx=abs(x2-x1), dy=y2-y1;
+	int32 step=(x2>=x1) ? 1 : -1;
+	
+	if(dy==0)
 	{
-		index=(uint16*)GetBuffer()->RowAt(i);
-		index[pt.x]=color.GetColor15();
+		AddSpan(x1<x2 ? x1 : x2,y1,dx+1);
+		return;
+	}
+	
+	if(dx<=dy)
+	{
+		// Steep: one pixel per row
+		int32 error=dy/2, x=x1;
+		for(int32 y=y1; y<=y2; y++)
+		{
+			AddSpan(x,y,1);
+			error-=dx;
+			if(error<0)
+			{
+				x+=step;
+				error+=dy;
+			}
+		}
+		return;
 	}
-}
-
-//----------------------------------------------------------------------------------------
-//
-//	PixelRendererCMAP8:	8-Bit color handler
-//
-//----------------------------------------------------------------------------------------
-
-PixelRendererCMAP8::PixelRendererCMAP8(GraphicsBuffer &buffer)
- : PixelRenderer(buffer)
-{
-}
-
-PixelRendererCMAP8::~PixelRendererCMAP8(void)
-{
-}
-
-// TODO: Double check the values in CMAP8 renderer to make sure they are correct for little endian
-
-RGBColor PixelRendererCMAP8::GetPixel(const IPoint &pt)
-{
-	uint8 pixel=((uint8*)GetBuffer()->RowAt(pt.y))[pt.x];
-	return RGBColor(pixel);
-}
-
-void PixelRendererCMAP8::PutPixel(const IPoint &pt, RGBColor &color)
-{
-	(GetBuffer()->RowAt(pt.y))[pt.x]=color.GetColor8();
-}
-
-void PixelRendererCMAP8::PutHLine(const IPoint &pt, const uint32 length, RGBColor &color)
-{
-	uint8 *index=GetBuffer()->RowAt(pt.y)+pt.x;
-	memset(index,color.GetColor8(),length);
-}
-
-void PixelRendererCMAP8::PutVLine(const IPoint &pt, const uint32 length, RGBColor &color)
-{
-	uint8 *index=GetBuffer()->RowAt(pt.y)+pt.x;
-	uint32 end=pt.y+length;
 	
-	for(uint32 i=pt.y; i<end; i++)
+	// Shallow: a run of pixels per row
+	int32 error=dx/2, y=y1, start=x1, x=x1;
+	for(int32 i=0; i<dx; i++)
 	{
-		*index=color.GetColor8();
-		index+=GetBuffer()->BytesPerRow();
+		error-=dy;
+		x+=step;
+		if(error<0)
+		{
+			// This row ends here
+			int32 end=x-step;
+			AddSpan(step>0 ? start : end,y,abs(end-start)+1);
+			y++;
+			start=x;
+			error+=dx;
+		}
 	}
+	AddSpan(step>0 ? start : x,y,abs(x-start)+1);
 }
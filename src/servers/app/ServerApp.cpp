@@ -48,6 +48,7 @@
 #include "ServerBitmap.h"
 #include "ServerPicture.h"
 #include "ServerConfig.h"
+#include "ServerProfiler.h"
 #include "WinBorder.h"
 #include "LayerData.h"
 #include "Utils.h"
@@ -108,6 +109,9 @@ ServerApp::ServerApp(port_id sendport, port_id rcvport, port_id clientLooperPort
 
 	fCursorHidden=false;
 
+	// Counts what the application sends when the server is profiled
+	fProfile=serverprofiler ? serverprofiler->AddApp(fSignature.String(),fClientTeamID) : NULL;
+
 	Run();
 
 	STRACE(("ServerApp %s:\n",fSignature.String()));
@@ -126,17 +130,20 @@ ServerApp::~ServerApp(void)
 	{
 		tempbmp=(ServerBitmap*)fBitmapList->ItemAt(i);
 		if(tempbmp)
-			delete tempbmp;
+			bitmapmanager->DeleteBitmap(tempbmp);
 	}
 	fBitmapList->MakeEmpty();
 	delete fBitmapList;
+	
+	// The areas the team's bitmaps leave empty are not needed anymore
+	bitmapmanager->ReleaseUnusedMemory();
 
 	ServerPicture *temppic;
 	for(i=0;i<fPictureList->CountItems();i++)
 	{
 		temppic=(ServerPicture*)fPictureList->ItemAt(i);
 		if(temppic)
-			delete temppic;
+			temppic->Release();
 	}
 	fPictureList->MakeEmpty();
 	delete fPictureList;
@@ -149,6 +156,9 @@ ServerApp::~ServerApp(void)
 
 	cursormanager->RemoveAppCursors(fClientTeamID);
 	delete_sem(fLockSem);
+
+	if(fProfile)
+		serverprofiler->RemoveApp(fProfile);
 	
 	STRACE(("#ServerApp %s:~ServerApp()\n",fSignature.String()));
 
@@ -331,7 +341,14 @@ int32 ServerApp::MonitorApp(void *data)
 			default:
 			{
 				STRACE(("ServerApp %s: Got a Message to dispatch\n",app->fSignature.String()));
-				app->_DispatchMessage(code, msgqueue);
+				if(app->fProfile)
+				{
+					bigtime_t start=system_time();
+					app->_DispatchMessage(code, msgqueue);
+					app->fProfile->Add(code, msgqueue.MessageSize(), system_time()-start);
+				}
+				else
+					app->_DispatchMessage(code, msgqueue);
 				break;
 			}
 		}
@@ -367,6 +384,48 @@ void ServerApp::_DispatchMessage(int32 code, BPortLink& msg)
 			fontserver->Unlock();
 			break;
 		}
+		case AS_GET_FONT_METRICS:
+		{
+			STRACE(("ServerApp %s: Received font metrics request\n",fSignature.String()));
+			// Makes sure a font's metrics are in the font metrics area. Once
+			// they are, the application doesn't need to ask again.
+
+			// Attached Data:
+			// 1) uint16 family ID
+			// 2) uint16 style ID
+			// 3) float size
+			// 4) port_id reply port
+			
+			// Reply Code: SERVER_TRUE
+			// Reply Data:
+			//	1) int32 index of the font's table in the metrics area
+			
+			// alternatively, if the font doesn't exist or the area is full
+			// Reply Code: SERVER_FALSE
+			uint16 familyid, styleid;
+			float size;
+			port_id replyport = -1;
+
+			msg.Read<uint16>(&familyid);
+			msg.Read<uint16>(&styleid);
+			msg.Read<float>(&size);
+			msg.Read<int32>(&replyport);
+
+			fontserver->Lock();
+			int32 index=fontserver->GetMetrics(familyid,styleid,size);
+			fontserver->Unlock();
+
+			BPortLink replylink(replyport);
+			if(index>=0)
+			{
+				replylink.StartMessage(SERVER_TRUE);
+				replylink.Attach<int32>(index);
+			}
+			else
+				replylink.StartMessage(SERVER_FALSE);
+			replylink.Flush();
+			break;
+		}
 		case AS_UPDATE_COLORS:
 		{
 			// NOTE: R2: Eventually we will have windows which will notify their children of changes in 
@@ -504,7 +563,7 @@ void ServerApp::_DispatchMessage(int32 code, BPortLink& msg)
 			msg.Read<screen_id>(&s);
 			msg.Read<int32>(&replyport);
 			
-			ServerBitmap *sbmp=bitmapmanager->CreateBitmap(r,cs,f,bpr,s);
+			ServerBitmap *sbmp=bitmapmanager->CreateBitmap(r,cs,f,bpr,s,fClientTeamID);
 
 			STRACE(("ServerApp %s: Create Bitmap (%.1f,%.1f,%.1f,%.1f)\n",
 						fSignature.String(),r.left,r.top,r.right,r.bottom));
@@ -561,16 +620,84 @@ void ServerApp::_DispatchMessage(int32 code, BPortLink& msg)
 		}
 		case AS_CREATE_PICTURE:
 		{
-			// TODO: Implement AS_CREATE_PICTURE
-			STRACE(("ServerApp %s: Create Picture unimplemented\n",fSignature.String()));
-
+			STRACE(("ServerApp %s: Create Picture\n",fSignature.String()));
+			
+			// Attached Data:
+			// 1) int32 number of sub pictures
+			// 2) int32 token of each sub picture
+			// 3) int32 size of the picture's data
+			// 4) the data
+			// 5) port_id reply port
+			
+			// Reply Code: SERVER_TRUE if the picture could be compiled
+			// Reply Data:
+			//	1) int32 server token
+			port_id replyport=-1;
+			int32 subcount=0, subtoken, size;
+			
+			// the picture can't be compiled without each picture it draws
+			BList pictures;
+			bool found=true;
+			msg.Read<int32>(&subcount);
+			for(int32 i=0; i<subcount && msg.Read<int32>(&subtoken)==B_OK; i++)
+			{
+				ServerPicture *subpicture=FindPicture(subtoken);
+				if(subpicture)
+					pictures.AddItem(subpicture);
+				else
+					found=false;
+			}
+			
+			msg.Read<int32>(&size);
+			void *data=(size>0 && size<=msg.MessageSize()) ? malloc(size) : NULL;
+			if(data && msg.Read(data,size)!=B_OK)
+			{
+				free(data);
+				data=NULL;
+			}
+			msg.Read<int32>(&replyport);
+			
+			ServerPicture *picture=(data && found) ? new ServerPicture(data,size,&pictures) : NULL;
+			free(data);
+			if(picture && !picture->InitCheck())
+			{
+				picture->Release();
+				picture=NULL;
+			}
+			
+			BPortLink replylink(replyport);
+			if(picture)
+			{
+				Lock();
+				fPictureList->AddItem(picture);
+				Unlock();
+				replylink.StartMessage(SERVER_TRUE);
+				replylink.Attach<int32>(picture->GetToken());
+			}
+			else
+				replylink.StartMessage(SERVER_FALSE);
+			replylink.Flush();
 			break;
 		}
 		case AS_DELETE_PICTURE:
 		{
-			// TODO: Implement AS_DELETE_PICTURE
-			STRACE(("ServerApp %s: Delete Picture unimplemented\n",fSignature.String()));
-
+			STRACE(("ServerApp %s: Delete Picture\n",fSignature.String()));
+			
+			// Attached Data:
+			// 1) int32 token
+			int32 token;
+			msg.Read<int32>(&token);
+			
+			// windows draw the app's pictures with the app locked
+			Lock();
+			ServerPicture *picture=FindPicture(token);
+			if(picture)
+				fPictureList->RemoveItem(picture);
+			Unlock();
+			
+			// pictures which draw it may still need it
+			if(picture)
+				picture->Release();
 			break;
 		}
 		case AS_CLONE_PICTURE:
@@ -844,10 +971,10 @@ void ServerApp::_DispatchMessage(int32 code, BPortLink& msg)
 			STRACE(("ServerApp %s: Get UI color\n",fSignature.String()));
 
 			RGBColor color;
-			int32 whichcolor;
+			color_which whichcolor;
 			port_id replyport = -1;
 			
-			msg.Read<int32>(&whichcolor);
+			msg.Read<color_which>(&whichcolor);
 			msg.Read<port_id>(&replyport);
 			
 			gui_colorset.Lock();
@@ -887,6 +1014,45 @@ ServerBitmap *ServerApp::FindBitmap(int32 token)
 	return NULL;
 }
 
+/*!
+	\brief Looks up one of the application's pictures
+	\param token The picture's token
+	\return The picture, or NULL if the application has none with the token
+	
+	The application should be locked while the picture is used, so it isn't
+	deleted meanwhile.
+*/
+ServerPicture *ServerApp::FindPicture(int32 token)
+{
+	ServerPicture *picture;
+	for(int32 i=0; i<fPictureList->CountItems();i++)
+	{
+		picture=(ServerPicture*)fPictureList->ItemAt(i);
+		if(picture && picture->GetToken()==token)
+			return picture;
+	}
+	return NULL;
+}
+
+//! Locks the application's pictures
+void ServerApp::Lock(void)
+{
+	acquire_sem(fLockSem);
+}
+
+//! Unlocks the application's pictures
+void ServerApp::Unlock(void)
+{
+	release_sem(fLockSem);
+}
+
+//! Returns whether the application is locked
+bool ServerApp::IsLocked(void)
+{
+	int32 count;
+	return get_sem_count(fLockSem,&count)==B_OK && count<1;
+}
+
 team_id ServerApp::ClientTeamID()
 {
 	return fClientTeamID;
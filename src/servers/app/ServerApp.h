@@ -39,6 +39,8 @@ class BList;
 class DisplayDriver;
 class ServerCursor;
 class ServerBitmap;
+class ServerPicture;
+class MessageProfile;
 
 /*!
 	\class ServerApp ServerApp.h
@@ -71,6 +73,7 @@ public:
 	void SendMessageToClient( const BMessage* msg ) const;
 	void SetAppCursor(void);
 	ServerBitmap *FindBitmap(int32 token);
+	ServerPicture *FindPicture(int32 token);
 	
 	team_id	ClientTeamID();
 	
@@ -104,6 +107,7 @@ protected:
 	bool fIsActive;
 	int32 fHandlerToken;
 	area_id fSharedMem;
+	MessageProfile *fProfile;
 };
 
 #endif
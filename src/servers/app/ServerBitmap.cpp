@@ -50,6 +50,8 @@ ServerBitmap::ServerBitmap(BRect rect,color_space space, int32 flags,
 	fArea=B_ERROR;
 	fBuffer=NULL;
 	fFlags=flags;
+	fSlab=NULL;
+	fTeam=-1;
 
 	_HandleSpace(space, bytesperline);
 }
@@ -60,6 +62,8 @@ ServerBitmap::ServerBitmap(const ServerBitmap *bmp)
 	fInitialized=false;
 	fArea=B_ERROR;
 	fBuffer=NULL;
+	fSlab=NULL;
+	fTeam=-1;
 
 	if(bmp)
 	{
@@ -106,7 +110,7 @@ uint32 ServerBitmap::BitsLength(void) const
 void ServerBitmap::_AllocateBuffer(void)
 {
 	if(fBuffer!=NULL)
-		delete fBuffer;
+		delete [] fBuffer;
 	fBuffer=new uint8[BitsLength()];
 }
 
@@ -119,7 +123,7 @@ void ServerBitmap::_FreeBuffer(void)
 {
 	if(fBuffer!=NULL)
 	{
-		delete fBuffer;
+		delete [] fBuffer;
 		fBuffer=NULL;
 	}
 }
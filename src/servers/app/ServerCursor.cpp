@@ -61,9 +61,7 @@ ServerCursor::ServerCursor(int8 *data)
 	{	
 		fInitialized=true;
 		fOwningTeam=-1;
-		uint32 black=0xFF000000,
-			white=0xFFFFFFFF,
-			*bmppos;
+		uint8	*bmppos;
 		uint16	*cursorpos, *maskpos,cursorflip, maskflip,
 				cursorval, maskval,powval;
 		uint8 	i,j;
@@ -77,7 +75,7 @@ ServerCursor::ServerCursor(int8 *data)
 		// for each row in the cursor data
 		for(j=0;j<16;j++)
 		{
-			bmppos=(uint32*)(fBuffer+ (j*BytesPerRow()) );
+			bmppos=fBuffer+ (j*BytesPerRow());
 	
 			// On intel, our bytes end up swapped, so we must swap them back
 			cursorflip=(cursorpos[j] & 0xFF) << 8;
@@ -93,7 +91,10 @@ ServerCursor::ServerCursor(int8 *data)
 				powval=1 << (15-i);
 				cursorval=cursorflip & powval;
 				maskval=maskflip & powval;
-				bmppos[i]=((cursorval!=0)?black:white) & ((maskval>0)?0xFFFFFFFF:0x00FFFFFF);
+				// Written a byte at a time in B_RGBA32 order: uint32 is wider
+				// than a pixel on some platforms
+				bmppos[i*4]=bmppos[i*4+1]=bmppos[i*4+2]=(cursorval!=0)?0x00:0xFF;
+				bmppos[i*4+3]=(maskval>0)?0xFF:0x00;
 			}
 		}
 	}
@@ -122,6 +122,21 @@ ServerFont& ServerFont::operator=(const ServerFont& font){
 	return *this;
 }
 
+/*! 
+	\brief Changes the style of the font
+	\param style The new style. May be NULL.
+*/
+void ServerFont::SetStyle(FontStyle *style)
+{
+	if(style==fstyle)
+		return;
+	if(fstyle)
+		fstyle->RemoveDependent();
+	fstyle=style;
+	if(fstyle)
+		fstyle->AddDependent();
+}
+
 /*! 
 	\brief Returns the number of strikes in the font
 	\return The number of strikes in the font
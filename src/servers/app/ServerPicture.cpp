@@ -24,25 +24,1373 @@
 //	Description:	Server-side counterpart to BPicture
 //  
 //------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <PictureProtocol.h>
+#include "DisplayDriver.h"
+#include "FontServer.h"
+#include "CoverageRasterizer.h"
+#include "LayerData.h"
+#include "ServerBitmap.h"
+#include "ShapeRasterizer.h"
 #include "TokenHandler.h"
 #include "ServerPicture.h"
 
 TokenHandler picture_token_handler;
 
-ServerPicture::ServerPicture(void)
+// Largest area, in pixels, of a shape whose spans are kept
+static const float kMaxCachedArea=256*256;
+
+// Deepest state stack a picture can push. Drawing a picture in a picture
+// takes two levels.
+#define PICTURE_STATE_DEPTH 32
+
+// The area left to draw on by clipping to the inverse of a picture
+static const BRect kEverything(-32768,-32768,32767,32767);
+
+// Where a picture's calls are drawn, and how, at one level of the state stack
+typedef struct
 {
-	_token=picture_token_handler.GetToken();
-	
-	_initialized=false;
+	DrawData *data;
+	BPoint origin;
+	float scale;
+	float pensize;
+	BPoint pen;
+	int32 clip;
+	int32 rects;
+	int32 pictureclip;
+} picture_level;
+
+/*!
+	\brief What decoding a picture has worked out so far
+
+	The pen location and origin are kept in picture coordinates, and the pen
+	size before it is scaled. The state of each call starts out as the default
+	DrawData, because the data of a recorded picture starts by setting whatever
+	it changes.
+*/
+struct compile_state
+{
+	DrawData data;
+	bool changed;
+
+	BPoint origin;
+	float scale;
+	float pensize;
+	BPoint pen;
+
+	// indices in the picture's clipping regions, or -1: what calls are
+	// clipped to, the clipping rectangles set and the pictures clipped to
+	int32 clip;
+	int32 rects;
+	int32 pictureclip;
+
+	picture_level stack[PICTURE_STATE_DEPTH];
+	int32 depth;
+	// states pushed by the picture which draws the one being decoded
+	int32 floor;
+
+	font_family family;
+	SpanList spans;
+};
+
+/*!
+	\class OpReader
+	\brief Reads the data of a picture's call without going past its end
+*/
+class OpReader
+{
+public:
+	OpReader(const uint8 *data, int32 size) { fData=data; fLeft=size; }
+
+	bool Read(void *out, int32 size)
+	{
+		if(size<0 || size>fLeft)
+		{
+			fLeft=0;
+			return false;
+		}
+		memcpy(out,fData,size);
+		fData+=size;
+		fLeft-=size;
+		return true;
+	}
+	template <class T> bool Read(T *out) { return Read(out,sizeof(T)); }
+
+	const uint8 *Data(void) const { return fData; }
+	int32 Left(void) const { return fLeft; }
+private:
+	const uint8 *fData;
+	int32 fLeft;
+};
+
+// Moves a point of the picture to where the current state puts it
+static inline BPoint transform(const compile_state *state, const BPoint &pt)
+{
+	return BPoint(state->origin.x+pt.x*state->scale,state->origin.y+pt.y*state->scale);
+}
+
+static inline BRect transform(const compile_state *state, const BRect &r)
+{
+	return BRect(state->origin.x+r.left*state->scale,state->origin.y+r.top*state->scale,
+		state->origin.x+r.right*state->scale,state->origin.y+r.bottom*state->scale);
+}
+
+// A rectangle moved to where a picture is drawn
+static inline BRect offset_rect(const BRect &r, const BPoint &where)
+{
+	return BRect(r.left+where.x,r.top+where.y,r.right+where.x,r.bottom+where.y);
+}
+
+// Bounds of an outline drawn with a pen of the given size, out to whole pixels
+static BRect pen_bounds(const BRect &r, float pensize)
+{
+	float grow=pensize>1 ? ceilf(pensize/2)+1 : 1;
+	return BRect(floorf(r.left)-grow,floorf(r.top)-grow,ceilf(r.right)+grow,
+		ceilf(r.bottom)+grow);
+}
+
+// A picture's clipping region moved to where the picture is drawn
+static inline void offset_region(BRegion *region, const BPoint &where)
+{
+	region->OffsetBy((int32)floorf(where.x+0.5),(int32)floorf(where.y+0.5));
+}
+
+static BRect point_bounds(const BPoint *points, int32 count)
+{
+	BRect r(points[0],points[0]);
+	for(int32 i=1; i<count; i++)
+	{
+		if(points[i].x<r.left)
+			r.left=points[i].x;
+		if(points[i].x>r.right)
+			r.right=points[i].x;
+		if(points[i].y<r.top)
+			r.top=points[i].y;
+		if(points[i].y>r.bottom)
+			r.bottom=points[i].y;
+	}
+	return r;
+}
+
+/*!
+	\brief Compiles the data of a BPicture
+	\param data The picture's calls, as BPicture flattens them
+	\param size Size of data in bytes
+	\param pictures The pictures the picture draws or clips to, which become
+	its dependents. Calls name them by their tokens.
 	
-	int8 *ptr;
-	_area=create_area("ServerPicture",(void**)&ptr,B_ANY_ADDRESS,B_PAGE_SIZE,
-		B_NO_LOCK,B_READ_AREA | B_WRITE_AREA);
+	InitCheck() is false if the data can't be used, or if it has drawing calls
+	which can't be compiled, such as those naming a picture which isn't in
+	pictures. Other calls the server doesn't know are skipped.
+*/
+ServerPicture::ServerPicture(const void *data, int32 size, const BList *pictures)
+{
+	// BView only draws pictures whose token is above 0
+	do
+		_token=picture_token_handler.GetToken();
+	while(_token==0);
 	
-	if(_area!=B_BAD_VALUE && _area!=B_NO_MEMORY && _area!=B_ERROR)
-		_initialized=true;
+	Init();
+	AddDependent();
+
+	_initialized=(data && size>0);
+	if(!_initialized)
+		return;
+
+	fData=(uint8*)malloc(size);
+	if(!fData)
+	{
+		_initialized=false;
+		return;
+	}
+	memcpy(fData,data,size);
+	fDataSize=size;
+
+	for(int32 i=0; pictures && i<pictures->CountItems(); i++)
+	{
+		ServerPicture *picture=(ServerPicture*)pictures->ItemAt(i);
+		if(picture && fPictures.AddItem(picture))
+			picture->AddDependent();
+	}
+
+	_initialized=Compile(fData,fDataSize,this,BPoint(0,0),1.0);
 }
 
+// Compiles another picture as it is drawn at an origin and scale, for the
+// area it draws on
+ServerPicture::ServerPicture(const ServerPicture *picture, const BPoint &origin,
+	float scale)
+{
+	_token=-1;
+	Init();
+	_initialized=Compile(picture->fData,picture->fDataSize,picture,origin,scale);
+}
+
+void ServerPicture::Init(void)
+{
+	fData=NULL;
+	fDataSize=0;
+	fOps=NULL;
+	fCount=0;
+	fSize=0;
+	fPoints=NULL;
+	fPointCount=0;
+	fPointSize=0;
+	fShapeOps=NULL;
+	fShapeOpCount=0;
+	fShapeOpSize=0;
+	fText=NULL;
+	fTextLength=0;
+	fTextSize=0;
+	fBounds.Set(0,0,-1,-1);
+}
+
+//! Frees the calls and everything they keep
 ServerPicture::~ServerPicture(void)
 {
+	for(int32 i=0; i<fCount; i++)
+	{
+		if(fOps[i].spans)
+			free(fOps[i].spans);
+		if(fOps[i].bitmap)
+			delete fOps[i].bitmap;
+	}
+	free(fOps);
+	free(fPoints);
+	free(fShapeOps);
+	free(fText);
+	free(fData);
+
+	for(int32 i=0; i<fStates.CountItems(); i++)
+		delete (DrawData*)fStates.ItemAt(i);
+	for(int32 i=0; i<fClips.CountItems(); i++)
+		delete (BRegion*)fClips.ItemAt(i);
+	for(int32 i=0; i<fPictures.CountItems(); i++)
+		((ServerPicture*)fPictures.ItemAt(i))->Release();
+}
+
+/*!
+	\brief Removes a dependent, deleting the picture if it was the last
+	
+	The application calls this instead of deleting a picture, which pictures
+	drawing it may still need.
+*/
+void ServerPicture::Release(void)
+{
+	RemoveDependent();
+	if(!HasDependents())
+		delete this;
+}
+
+/*!
+	\brief Draws the picture
+	\param driver The driver to draw with
+	\param where Screen location of the picture's origin
+	\param visible The part of the screen which is drawn, or NULL for all of it.
+	Calls which miss it are skipped.
+	\param layer The drawing data of the layer drawing the picture, whose
+	clipping region the picture is clipped to
+	
+	Spans kept from when the picture was compiled are used when where is a
+	whole pixel.
+*/
+void ServerPicture::Draw(DisplayDriver *driver, const BPoint &where,
+	BRegion *visible, const DrawData *layer)
+{
+	if(!driver || fCount==0)
+		return;
+
+	BRect bounds=offset_rect(fBounds,where);
+	if(visible && !visible->Intersects(bounds))
+		return;
+
+	bool whole=(where.x==floorf(where.x) && where.y==floorf(where.y));
+
+	// the picture's states don't clip, so calls which are clipped get a
+	// state of their own, copied from the picture's as they change, with
+	// the layer's clipping region or a region cut down from it
+	BRegion *layerclip=layer ? layer->clipReg : NULL;
+	DrawData *clipped=NULL;
+	BRegion *region=NULL;
+	int32 current=-1, currentclip=-2;
+	if(layerclip || fClips.CountItems()>0)
+		clipped=new DrawData;
+
+	for(int32 i=0; i<fCount; i++)
+	{
+		const picture_op *op=&fOps[i];
+		bounds=offset_rect(op->bounds,where);
+		if(visible && !visible->Intersects(bounds))
+			continue;
+
+		const DrawData *d=(const DrawData*)fStates.ItemAt(op->state);
+		if(clipped)
+		{
+			if(op->state!=current)
+			{
+				*clipped=*d;
+				current=op->state;
+			}
+			if(op->clip!=currentclip)
+			{
+				if(op->clip>=0)
+				{
+					if(!region)
+						region=new BRegion;
+					*region=*(BRegion*)fClips.ItemAt(op->clip);
+					offset_region(region,where);
+					if(layerclip)
+						region->IntersectWith(layerclip);
+					clipped->clipReg=region;
+				}
+				else
+					clipped->clipReg=layerclip;
+				currentclip=op->clip;
+			}
+			d=clipped;
+		}
+
+		if(op->spans && whole)
+			driver->FillSpans(op->spans,op->spancount,(int32)where.x,
+				(int32)where.y,bounds,d);
+		else
+			DrawOp(driver,op,where,d);
+	}
+
+	if(clipped)
+	{
+		// the region belongs to the layer, or is deleted below
+		clipped->clipReg=NULL;
+		delete clipped;
+	}
+	delete region;
+}
+
+/*!
+	\brief Gets the area the picture draws on, for clipping to it
+	\param region Region to put the area in
+	\param where Screen location of the picture's origin
+	
+	Rectangles, ellipses, arcs, round rectangles and polygons give the pixels
+	they draw. Lines, curves, other shapes, text and bitmaps give their
+	bounds. Both are cut to the regions the calls are clipped to.
+*/
+void ServerPicture::GetRegion(BRegion *region, const BPoint &where)
+{
+	if(!region)
+		return;
+
+	region->MakeEmpty();
+	
+	bool whole=(where.x==floorf(where.x) && where.y==floorf(where.y));
+	SpanList spans;
+	BRegion opregion, clip;
+	
+	for(int32 i=0; i<fCount; i++)
+	{
+		const picture_op *op=&fOps[i];
+		const shape_span *list;
+		int32 count, dx=0, dy=0;
+
+		// a clipped call's area is found on its own, then cut
+		BRegion *area=region;
+		if(op->clip>=0)
+		{
+			opregion.MakeEmpty();
+			area=&opregion;
+		}
+
+		if(op->spans && whole)
+		{
+			list=op->spans;
+			count=op->spancount;
+			dx=(int32)where.x;
+			dy=(int32)where.y;
+		}
+		else if(op->op!=B_PIC_FILL_RECT && Rasterize(spans,op,where))
+		{
+			list=spans.Spans();
+			count=spans.CountSpans();
+		}
+		else
+		{
+			area->Include(op->op==B_PIC_FILL_RECT ? offset_rect(op->rect,where)
+				: offset_rect(op->bounds,where));
+			list=NULL;
+			count=0;
+		}
+
+		clipping_rect rect;
+		for(int32 j=0; j<count; j++)
+		{
+			rect.left=list[j].left+dx;
+			rect.right=list[j].right+dx;
+			rect.top=rect.bottom=list[j].y+dy;
+			area->Include(rect);
+		}
+
+		if(area!=region)
+		{
+			clip=*(BRegion*)fClips.ItemAt(op->clip);
+			offset_region(&clip,where);
+			opregion.IntersectWith(&clip);
+			region->Include(&opregion);
+		}
+	}
+}
+
+/*!
+	\brief Decodes a picture's data with the picture's origin and scale
+	\param data The picture's calls
+	\param size Size of data in bytes
+	\param source The picture whose data it is, whose pictures calls name
+	\param origin Where the picture's origin is
+	\param scale How much the picture is scaled
+	\return false if a drawing call couldn't be compiled
+*/
+bool ServerPicture::Compile(const uint8 *data, int32 size, const ServerPicture *source,
+	const BPoint &origin, float scale)
+{
+	compile_state *state=new compile_state;
+	state->changed=true;
+	state->origin=origin;
+	state->scale=scale;
+	state->pensize=1.0;
+	state->data.pensize=scale;
+	state->pen.Set(0,0);
+	state->clip=-1;
+	state->rects=-1;
+	state->pictureclip=-1;
+	state->depth=0;
+	state->family[0]='\0';
+
+	// the picture's own origins and scales are set in the ones it is given,
+	// which it can't pop
+	PushState(state);
+	state->floor=state->depth;
+
+	bool ok=Compile(data,size,source,state);
+	for(int32 i=0; i<fCount; i++)
+		fBounds=i ? fBounds|fOps[i].bounds : fOps[i].bounds;
+
+	for(int32 i=0; i<state->depth; i++)
+		delete state->stack[i].data;
+	delete state;
+	return ok;
+}
+
+// Decodes calls, going into state changes, which hold calls of their own,
+// and into the pictures the calls draw
+bool ServerPicture::Compile(const uint8 *data, int32 size, const ServerPicture *source,
+	compile_state *state)
+{
+	while(size>=(int32)(sizeof(int16)+sizeof(int32)))
+	{
+		int16 code;
+		int32 length;
+		memcpy(&code,data,sizeof(int16));
+		memcpy(&length,data+sizeof(int16),sizeof(int32));
+		data+=sizeof(int16)+sizeof(int32);
+		size-=sizeof(int16)+sizeof(int32);
+		if(length<0 || length>size)
+			break;
+
+		OpReader reader(data,length);
+		data+=length;
+		size-=length;
+		int32 count=fCount;
+
+		switch(code)
+		{
+			case B_PIC_ENTER_STATE_CHANGE:
+			case B_PIC_ENTER_FONT_STATE:
+			{
+				if(!Compile(reader.Data(),reader.Left(),source,state))
+					return false;
+				break;
+			}
+			case B_PIC_MOVE_PEN_BY:
+			{
+				BPoint delta;
+				if(reader.Read<BPoint>(&delta))
+					state->pen+=delta;
+				break;
+			}
+			case B_PIC_SET_PEN_LOCATION:
+			{
+				reader.Read<BPoint>(&state->pen);
+				break;
+			}
+			case B_PIC_SET_ORIGIN:
+			{
+				// an origin is set in the coordinates of the pushed state
+				BPoint pt;
+				if(!reader.Read<BPoint>(&pt))
+					break;
+				if(state->depth>0)
+				{
+					picture_level *level=&state->stack[state->depth-1];
+					state->origin.Set(level->origin.x+pt.x*level->scale,
+						level->origin.y+pt.y*level->scale);
+				}
+				else
+					state->origin=pt;
+				break;
+			}
+			case B_PIC_SET_SCALE:
+			{
+				float scale;
+				if(!reader.Read<float>(&scale))
+					break;
+				state->scale=state->depth>0 ? state->stack[state->depth-1].scale*scale : scale;
+				state->data.pensize=state->pensize*state->scale;
+				state->changed=true;
+				break;
+			}
+			case B_PIC_SET_PEN_SIZE:
+			{
+				if(!reader.Read<float>(&state->pensize))
+					break;
+				state->data.pensize=state->pensize*state->scale;
+				state->changed=true;
+				break;
+			}
+			case B_PIC_SET_DRAWING_MODE:
+			{
+				int16 mode;
+				if(reader.Read<int16>(&mode))
+				{
+					state->data.draw_mode=(drawing_mode)mode;
+					state->changed=true;
+				}
+				break;
+			}
+			case B_PIC_SET_LINE_MODE:
+			{
+				reader.Read<cap_mode>(&state->data.lineCap);
+				reader.Read<join_mode>(&state->data.lineJoin);
+				reader.Read<float>(&state->data.miterLimit);
+				state->changed=true;
+				break;
+			}
+			case B_PIC_SET_FORE_COLOR:
+			case B_PIC_SET_BACK_COLOR:
+			{
+				rgb_color color;
+				if(!reader.Read<rgb_color>(&color))
+					break;
+				if(code==B_PIC_SET_FORE_COLOR)
+					state->data.highcolor=color;
+				else
+					state->data.lowcolor=color;
+				state->changed=true;
+				break;
+			}
+			case B_PIC_SET_STIPLE_PATTERN:
+			{
+				pattern pat;
+				if(reader.Read<pattern>(&pat))
+				{
+					state->data.patt.Set((int8*)pat.data);
+					state->changed=true;
+				}
+				break;
+			}
+			case B_PIC_SET_BLENDING_MODE:
+			{
+				int16 source, function;
+				if(reader.Read<int16>(&source) && reader.Read<int16>(&function))
+				{
+					state->data.alphaSrcMode=(source_alpha)source;
+					state->data.alphaFncMode=(alpha_function)function;
+					state->changed=true;
+				}
+				break;
+			}
+			case B_PIC_SET_FONT_FAMILY:
+			{
+				int32 length;
+				if(!reader.Read<int32>(&length) || length<0 || length>=(int32)sizeof(font_family)
+					|| !reader.Read(state->family,length))
+					break;
+				state->family[length]='\0';
+				break;
+			}
+			case B_PIC_SET_FONT_STYLE:
+			{
+				font_style style;
+				int32 length;
+				if(!reader.Read<int32>(&length) || length<0 || length>=(int32)sizeof(font_style)
+					|| !reader.Read(style,length))
+					break;
+				style[length]='\0';
+				
+				fontserver->Lock();
+				FontStyle *fontstyle=fontserver->GetStyle(state->family,style);
+				if(fontstyle)
+				{
+					state->data.font.SetStyle(fontstyle);
+					state->changed=true;
+				}
+				fontserver->Unlock();
+				break;
+			}
+			case B_PIC_SET_FONT_SPACING:
+			case B_PIC_SET_FONT_ENCODING:
+			case B_PIC_SET_FONT_FLAGS:
+			case B_PIC_SET_FONT_FACE:
+			{
+				int32 value;
+				if(!reader.Read<int32>(&value))
+					break;
+				if(code==B_PIC_SET_FONT_SPACING)
+					state->data.font.SetSpacing(value);
+				else if(code==B_PIC_SET_FONT_ENCODING)
+					state->data.font.SetEncoding(value);
+				else if(code==B_PIC_SET_FONT_FLAGS)
+					state->data.font.SetFlags(value);
+				else
+					state->data.font.SetFace(value);
+				state->changed=true;
+				break;
+			}
+			case B_PIC_SET_FONT_SIZE:
+			case B_PIC_SET_FONT_ROTATE:
+			case B_PIC_SET_FONT_SHEAR:
+			{
+				float value;
+				if(!reader.Read<float>(&value))
+					break;
+				if(code==B_PIC_SET_FONT_SIZE)
+					state->data.font.SetSize(value);
+				else if(code==B_PIC_SET_FONT_ROTATE)
+					state->data.font.SetRotation(value);
+				else
+					state->data.font.SetShear(value);
+				state->changed=true;
+				break;
+			}
+			case B_PIC_PUSH_STATE:
+			{
+				if(state->depth<PICTURE_STATE_DEPTH)
+					PushState(state);
+				break;
+			}
+			case B_PIC_POP_STATE:
+			{
+				// a picture drawn by another can't pop what that one pushed
+				if(state->depth>state->floor)
+					PopState(state);
+				break;
+			}
+			case B_PIC_SET_CLIPPING_RECTS:
+			{
+				int32 rectcount;
+				if(!reader.Read<int32>(&rectcount) || rectcount<0
+					|| rectcount>reader.Left()/(int32)sizeof(BRect))
+					return false;
+
+				BRegion *region=new BRegion;
+				BRect rect;
+				for(int32 i=0; i<rectcount && reader.Read<BRect>(&rect); i++)
+					region->Include(transform(state,rect));
+
+				state->rects=AddClip(region);
+				if(state->rects<0 || !UpdateClip(state))
+					return false;
+				break;
+			}
+			case B_PIC_CLEAR_CLIPPING_RECTS:
+			{
+				state->rects=-1;
+				if(!UpdateClip(state))
+					return false;
+				break;
+			}
+			case B_PIC_CLIP_TO_PICTURE:
+			{
+				int32 token;
+				BPoint where;
+				bool inverse;
+				if(!reader.Read<int32>(&token) || !reader.Read<BPoint>(&where)
+					|| !reader.Read<bool>(&inverse))
+					return false;
+				ServerPicture *picture=source->FindPicture(token);
+				if(!picture)
+					return false;
+
+				ServerPicture shape(picture,transform(state,where),state->scale);
+				if(!shape.InitCheck())
+					return false;
+				BRegion *region=new BRegion;
+				shape.GetRegion(region,BPoint(0,0));
+				if(inverse)
+				{
+					BRegion outside(kEverything);
+					outside.Exclude(region);
+					*region=outside;
+				}
+
+				// clipping to another picture clips to both
+				if(state->pictureclip>=0)
+					region->IntersectWith((BRegion*)fClips.ItemAt(state->pictureclip));
+				state->pictureclip=AddClip(region);
+				if(state->pictureclip<0 || !UpdateClip(state))
+					return false;
+				break;
+			}
+			case B_PIC_DRAW_PICTURE:
+			{
+				BPoint where;
+				int32 token;
+				if(!reader.Read<BPoint>(&where) || !reader.Read<int32>(&token))
+					return false;
+				ServerPicture *picture=source->FindPicture(token);
+				if(!picture || state->depth+2>PICTURE_STATE_DEPTH)
+					return false;
+
+				// The picture is drawn in the state it's drawn with, and
+				// then that state is back. The first level keeps it, the
+				// second is what the picture's origins and scales are set in.
+				int32 floor=state->floor;
+				PushState(state);
+				state->origin=transform(state,where);
+				state->pen.Set(0,0);
+				PushState(state);
+				state->floor=state->depth;
+				
+				bool ok=Compile(picture->fData,picture->fDataSize,picture,state);
+				
+				while(state->depth>state->floor)
+					PopState(state);
+				state->floor=floor;
+				PopState(state);
+				PopState(state);
+				if(!ok)
+					return false;
+				break;
+			}
+			case B_PIC_STROKE_LINE:
+			{
+				BPoint points[2];
+				if(!reader.Read(points,sizeof(points)))
+					break;
+				points[0]=transform(state,points[0]);
+				points[1]=transform(state,points[1]);
+				
+				picture_op *op=AddOp(code,state);
+				if(!op)
+					return false;
+				op->first=AddPoints(points,2);
+				op->count=2;
+				if(op->first<0)
+				{
+					fCount--;
+					return false;
+				}
+				op->bounds=pen_bounds(point_bounds(points,2),state->data.pensize);
+				break;
+			}
+			case B_PIC_STROKE_RECT:
+			case B_PIC_FILL_RECT:
+			case B_PIC_STROKE_ELLIPSE:
+			case B_PIC_FILL_ELLIPSE:
+			case B_PIC_STROKE_ROUND_RECT:
+			case B_PIC_FILL_ROUND_RECT:
+			{
+				BRect rect;
+				BPoint radii(0,0);
+				if(!reader.Read<BRect>(&rect))
+					break;
+				if((code==B_PIC_STROKE_ROUND_RECT || code==B_PIC_FILL_ROUND_RECT)
+					&& !reader.Read<BPoint>(&radii))
+					break;
+
+				picture_op *op=AddOp(code,state);
+				if(!op)
+					return false;
+				op->rect=transform(state,rect);
+				op->radii.Set(radii.x*state->scale,radii.y*state->scale);
+				op->bounds=pen_bounds(op->rect,state->data.pensize);
+				Cache(op,state->spans);
+				break;
+			}
+			case B_PIC_STROKE_ARC:
+			case B_PIC_FILL_ARC:
+			{
+				BPoint center, radii;
+				float angle, span;
+				if(!reader.Read<BPoint>(&center) || !reader.Read<BPoint>(&radii)
+					|| !reader.Read<float>(&angle) || !reader.Read<float>(&span))
+					break;
+
+				picture_op *op=AddOp(code,state);
+				if(!op)
+					return false;
+				op->rect=transform(state,BRect(center.x-radii.x,center.y-radii.y,
+					center.x+radii.x,center.y+radii.y));
+				op->radii.Set(angle,span);
+				op->bounds=pen_bounds(op->rect,state->data.pensize);
+				Cache(op,state->spans);
+				break;
+			}
+			case B_PIC_STROKE_BEZIER:
+			case B_PIC_FILL_BEZIER:
+			{
+				BPoint points[4];
+				if(!reader.Read(points,sizeof(points)))
+					break;
+				for(int32 i=0; i<4; i++)
+					points[i]=transform(state,points[i]);
+
+				picture_op *op=AddOp(code,state);
+				if(!op)
+					return false;
+				op->first=AddPoints(points,4);
+				op->count=4;
+				if(op->first<0)
+				{
+					fCount--;
+					return false;
+				}
+				op->bounds=pen_bounds(point_bounds(points,4),state->data.pensize);
+				break;
+			}
+			case B_PIC_STROKE_POLYGON:
+			case B_PIC_FILL_POLYGON:
+			{
+				int32 count;
+				if(!reader.Read<int32>(&count) || count<1
+					|| count>reader.Left()/(int32)sizeof(BPoint))
+					break;
+
+				picture_op *op=AddOp(code,state);
+				if(!op)
+					return false;
+				op->first=AddPoints((const BPoint*)reader.Data(),count);
+				op->count=count;
+				if(op->first<0)
+				{
+					fCount--;
+					return false;
+				}
+				
+				BPoint *points=&fPoints[op->first];
+				for(int32 i=0; i<count; i++)
+					points[i]=transform(state,points[i]);
+				if(code==B_PIC_STROKE_POLYGON)
+				{
+					OpReader rest(reader.Data()+count*sizeof(BPoint),
+						reader.Left()-count*sizeof(BPoint));
+					op->closed=true;
+					rest.Read<bool>(&op->closed);
+				}
+				op->rect=point_bounds(points,count);
+				op->bounds=pen_bounds(op->rect,state->data.pensize);
+				break;
+			}
+			case B_PIC_DRAW_STRING:
+			{
+				int32 length;
+				if(!reader.Read<int32>(&length) || length<=0 || length>reader.Left())
+					break;
+				const char *text=(const char*)reader.Data();
+				OpReader rest(reader.Data()+length,reader.Left()-length);
+				float deltax=0, deltay=0;
+				rest.Read<float>(&deltax);
+				rest.Read<float>(&deltay);
+				
+				// Like PicturePlayer, take deltax as the escapement of
+				// everything but spaces
+				if(state->data.edelta.nonspace!=deltax || state->data.edelta.space!=deltay)
+				{
+					state->data.edelta.nonspace=deltax;
+					state->data.edelta.space=deltay;
+					state->changed=true;
+				}
+
+				BPoint location=transform(state,state->pen);
+				picture_op *op=AddOp(code,state);
+				if(!op)
+					return false;
+				op->first=AddText(text,length);
+				op->count=length;
+				if(op->first<0)
+				{
+					fCount--;
+					return false;
+				}
+				op->rect.Set(location.x,location.y,location.x,location.y);
+				
+				// as rough as the driver's own guess
+				float fontsize=state->data.font.Size();
+				op->bounds.Set(floorf(location.x)-1,floorf(location.y-fontsize*1.5),
+					ceilf(location.x+fontsize*1.5*length),ceilf(location.y+fontsize*0.5)+1);
+				break;
+			}
+			case B_PIC_DRAW_PIXELS:
+			{
+				BRect source, dest;
+				int32 width, height, bytesperrow, format, flags;
+				if(!reader.Read<BRect>(&source) || !reader.Read<BRect>(&dest)
+					|| !reader.Read<int32>(&width) || !reader.Read<int32>(&height)
+					|| !reader.Read<int32>(&bytesperrow) || !reader.Read<int32>(&format)
+					|| !reader.Read<int32>(&flags))
+					break;
+				if(width<1 || height<1 || bytesperrow<1
+					|| height>reader.Left()/bytesperrow)
+					break;
+
+				// the pixels are copied once and kept with the call
+				UtilityBitmap *bitmap=new UtilityBitmap(BRect(0,0,width-1,height-1),
+					(color_space)format,flags,bytesperrow);
+				if(!bitmap->Bits())
+				{
+					delete bitmap;
+					break;
+				}
+				int32 row=bytesperrow<bitmap->BytesPerRow() ? bytesperrow : bitmap->BytesPerRow();
+				for(int32 y=0; y<height; y++)
+					memcpy(bitmap->Bits()+y*bitmap->BytesPerRow(),reader.Data()+y*bytesperrow,row);
+
+				picture_op *op=AddOp(code,state);
+				if(!op)
+				{
+					delete bitmap;
+					return false;
+				}
+				op->bitmap=bitmap;
+				op->source=source;
+				op->rect=transform(state,dest);
+				op->bounds=pen_bounds(op->rect,1);
+				break;
+			}
+			case B_PIC_STROKE_SHAPE:
+			case B_PIC_FILL_SHAPE:
+			{
+				int32 opcount, ptcount;
+				if(!reader.Read<int32>(&opcount) || !reader.Read<int32>(&ptcount)
+					|| opcount<0 || opcount>reader.Left()/(int32)sizeof(int32)
+					|| ptcount<0 || ptcount>(reader.Left()-opcount*(int32)sizeof(int32))
+						/(int32)sizeof(BPoint))
+					return false;
+
+				const int32 *ops=(const int32*)reader.Data();
+				const BPoint *points=(const BPoint*)(reader.Data()+opcount*sizeof(int32));
+
+				// the ops have to use the points there are
+				PathBuilder path;
+				if(path.AddShape(opcount,ops,ptcount,points)!=B_OK)
+					return false;
+				if(ptcount==0)
+					break;
+
+				picture_op *op=AddOp(code,state);
+				if(!op)
+					return false;
+				op->shapeop=AddShapeOps(ops,opcount);
+				op->shapeopcount=opcount;
+				op->first=AddPoints(points,ptcount);
+				op->count=ptcount;
+				if(op->shapeop<0 || op->first<0)
+				{
+					fCount--;
+					return false;
+				}
+
+				BPoint *list=&fPoints[op->first];
+				for(int32 i=0; i<ptcount; i++)
+					list[i]=transform(state,list[i]);
+				op->rect=point_bounds(list,ptcount);
+				op->bounds=pen_bounds(op->rect,state->data.pensize);
+				break;
+			}
+			default:
+				// A drawing call which isn't drawn would draw the picture
+				// wrong. Other calls this doesn't know are skipped.
+				if(code>=B_PIC_STROKE_LINE && code<B_PIC_ENTER_STATE_CHANGE)
+					return false;
+				break;
+		}
+
+		// calls which miss the region they are clipped to are left out
+		if(fCount>count && !ClipOp(&fOps[fCount-1]))
+			RemoveOp();
+	}
+	return true;
+}
+
+// Finds one of the pictures the picture draws by its token
+ServerPicture *ServerPicture::FindPicture(int32 token) const
+{
+	for(int32 i=0; i<fPictures.CountItems(); i++)
+	{
+		ServerPicture *picture=(ServerPicture*)fPictures.ItemAt(i);
+		if(picture->_token==token)
+			return picture;
+	}
+	return NULL;
+}
+
+// Saves the state, which must have room for another level
+void ServerPicture::PushState(compile_state *state)
+{
+	picture_level *level=&state->stack[state->depth++];
+	level->data=new DrawData(state->data);
+	level->origin=state->origin;
+	level->scale=state->scale;
+	level->pensize=state->pensize;
+	level->pen=state->pen;
+	level->clip=state->clip;
+	level->rects=state->rects;
+	level->pictureclip=state->pictureclip;
+
+	// what the pushed state is clipped to still clips
+	state->rects=-1;
+	state->pictureclip=-1;
+}
+
+// Goes back to the state saved last
+void ServerPicture::PopState(compile_state *state)
+{
+	picture_level *level=&state->stack[--state->depth];
+	state->data=*level->data;
+	state->origin=level->origin;
+	state->scale=level->scale;
+	state->pensize=level->pensize;
+	state->pen=level->pen;
+	state->clip=level->clip;
+	state->rects=level->rects;
+	state->pictureclip=level->pictureclip;
+	delete level->data;
+	state->changed=true;
+}
+
+// Keeps a clipping region, returning its index or -1 if it couldn't be kept
+int32 ServerPicture::AddClip(BRegion *region)
+{
+	if(!fClips.AddItem(region))
+	{
+		delete region;
+		return -1;
+	}
+	return fClips.CountItems()-1;
+}
+
+/*!
+	\brief Works out what the calls which follow are clipped to
+	\param state What decoding has worked out, whose clipping is changed
+	\return false if there's no memory for the region
+	
+	That is what the pushed state is clipped to, cut to the clipping
+	rectangles and the pictures clipped to.
+*/
+bool ServerPicture::UpdateClip(compile_state *state)
+{
+	int32 parts[3], count=0;
+	if(state->depth>0 && state->stack[state->depth-1].clip>=0)
+		parts[count++]=state->stack[state->depth-1].clip;
+	if(state->rects>=0)
+		parts[count++]=state->rects;
+	if(state->pictureclip>=0)
+		parts[count++]=state->pictureclip;
+
+	if(count<2)
+	{
+		state->clip=count ? parts[0] : -1;
+		return true;
+	}
+
+	BRegion *region=new BRegion(*(BRegion*)fClips.ItemAt(parts[0]));
+	for(int32 i=1; i<count; i++)
+		region->IntersectWith((BRegion*)fClips.ItemAt(parts[i]));
+	state->clip=AddClip(region);
+	return state->clip>=0;
+}
+
+// Cuts a call's bounds to what it is clipped to. Returns false if it misses.
+bool ServerPicture::ClipOp(picture_op *op)
+{
+	if(op->clip<0)
+		return true;
+
+	BRect frame=((BRegion*)fClips.ItemAt(op->clip))->Frame();
+	if(!frame.IsValid() || !frame.Intersects(op->bounds))
+		return false;
+	op->bounds=op->bounds & frame;
+	return true;
+}
+
+/*!
+	\brief Adds an empty call
+	\param code The call's B_PIC_* code
+	\param state What decoding has worked out. A new state is kept if it changed.
+	\return The call, or NULL if there's no memory for it
+*/
+picture_op *ServerPicture::AddOp(int16 code, compile_state *state)
+{
+	if(fCount==fSize)
+	{
+		int32 size=fSize ? fSize*2 : 16;
+		picture_op *ops=(picture_op*)realloc((void*)fOps,size*sizeof(picture_op));
+		if(!ops)
+			return NULL;
+		fOps=ops;
+		fSize=size;
+	}
+	
+	if(state->changed || fStates.CountItems()==0)
+	{
+		fStates.AddItem(new DrawData(state->data));
+		state->changed=false;
+	}
+
+	picture_op *op=&fOps[fCount++];
+	memset((void*)op,0,sizeof(picture_op));
+	op->op=code;
+	op->state=fStates.CountItems()-1;
+	op->clip=state->clip;
+	return op;
+}
+
+// Removes the call added last, with what it keeps
+void ServerPicture::RemoveOp(void)
+{
+	picture_op *op=&fOps[--fCount];
+	if(op->spans)
+		free(op->spans);
+	if(op->bitmap)
+		delete op->bitmap;
+}
+
+// Keeps a call's points with the others, returning the index of the first
+int32 ServerPicture::AddPoints(const BPoint *points, int32 count)
+{
+	if(fPointCount+count>fPointSize)
+	{
+		int32 size=fPointSize ? fPointSize*2 : 64;
+		while(size<fPointCount+count)
+			size*=2;
+		BPoint *list=(BPoint*)realloc((void*)fPoints,size*sizeof(BPoint));
+		if(!list)
+			return -1;
+		fPoints=list;
+		fPointSize=size;
+	}
+	
+	int32 first=fPointCount;
+	memcpy((void*)&fPoints[first],points,count*sizeof(BPoint));
+	fPointCount+=count;
+	return first;
+}
+
+// Keeps a shape's ops with the others, returning the index of the first
+int32 ServerPicture::AddShapeOps(const int32 *ops, int32 count)
+{
+	if(fShapeOpCount+count>fShapeOpSize)
+	{
+		int32 size=fShapeOpSize ? fShapeOpSize*2 : 32;
+		while(size<fShapeOpCount+count)
+			size*=2;
+		int32 *list=(int32*)realloc(fShapeOps,size*sizeof(int32));
+		if(!list)
+			return -1;
+		fShapeOps=list;
+		fShapeOpSize=size;
+	}
+
+	int32 first=fShapeOpCount;
+	memcpy(&fShapeOps[first],ops,count*sizeof(int32));
+	fShapeOpCount+=count;
+	return first;
+}
+
+// Keeps a string with the others, returning the index of its first byte
+int32 ServerPicture::AddText(const char *text, int32 length)
+{
+	if(fTextLength+length>fTextSize)
+	{
+		int32 size=fTextSize ? fTextSize*2 : 256;
+		while(size<fTextLength+length)
+			size*=2;
+		char *list=(char*)realloc(fText,size);
+		if(!list)
+			return -1;
+		fText=list;
+		fTextSize=size;
+	}
+
+	int32 first=fTextLength;
+	memcpy(&fText[first],text,length);
+	fTextLength+=length;
+	return first;
+}
+
+/*!
+	\brief Rasterizes a shape which is small enough once, at the picture's origin
+	\param op The call, whose bounds must be set
+	\param spans List to rasterize into
+
+	The call's spans can then be moved to wherever the picture is drawn at a
+	whole pixel. They're the same spans, moved, that rasterizing the shape
+	there would give.
+*/
+void ServerPicture::Cache(picture_op *op, SpanList &spans)
+{
+	if(op->op==B_PIC_STROKE_RECT || op->op==B_PIC_FILL_RECT)
+		return;
+	if((op->bounds.Width()+1)*(op->bounds.Height()+1)>kMaxCachedArea)
+		return;
+	if(!Rasterize(spans,op,BPoint(0,0)) || spans.CountSpans()==0)
+		return;
+
+	op->spans=(shape_span*)malloc(spans.CountSpans()*sizeof(shape_span));
+	if(!op->spans)
+		return;
+	memcpy(op->spans,spans.Spans(),spans.CountSpans()*sizeof(shape_span));
+	op->spancount=spans.CountSpans();
+}
+
+/*!
+	\brief Rasterizes a call the way the driver would, if it draws a shape
+	\param spans List to rasterize into, without clipping
+	\param op The call
+	\param where Location of the picture's origin
+	\return false if the call isn't a shape
+*/
+bool ServerPicture::Rasterize(SpanList &spans, const picture_op *op, const BPoint &where)
+{
+	const DrawData *d=(const DrawData*)fStates.ItemAt(op->state);
+	BRect rect=offset_rect(op->rect,where);
+	
+	spans.Reset(NULL,offset_rect(op->bounds,where));
+	switch(op->op)
+	{
+		case B_PIC_FILL_ELLIPSE:
+			rasterize_ellipse(spans,rect);
+			break;
+		case B_PIC_STROKE_ELLIPSE:
+			rasterize_ellipse_outline(spans,rect,d->pensize);
+			break;
+		case B_PIC_FILL_ARC:
+			rasterize_arc(spans,rect,op->radii.x,op->radii.y);
+			break;
+		case B_PIC_STROKE_ARC:
+			rasterize_arc_outline(spans,rect,op->radii.x,op->radii.y,d->pensize);
+			break;
+		case B_PIC_FILL_ROUND_RECT:
+			rasterize_round_rect(spans,rect,op->radii.x,op->radii.y);
+			break;
+		case B_PIC_STROKE_ROUND_RECT:
+			rasterize_round_rect_outline(spans,rect,op->radii.x,op->radii.y,d->pensize);
+			break;
+		case B_PIC_FILL_POLYGON:
+		{
+			BPoint *points=(BPoint*)malloc(op->count*sizeof(BPoint));
+			if(!points)
+				return false;
+			for(int32 i=0; i<op->count; i++)
+				points[i]=fPoints[op->first+i]+where;
+			rasterize_polygon(spans,points,op->count);
+			free(points);
+			break;
+		}
+		default:
+			return false;
+	}
+	return true;
+}
+
+// Draws a call which has no spans to use
+void ServerPicture::DrawOp(DisplayDriver *driver, const picture_op *op,
+	const BPoint &where, const DrawData *d)
+{
+	BRect rect=offset_rect(op->rect,where);
+	
+	switch(op->op)
+	{
+		case B_PIC_STROKE_LINE:
+			driver->StrokeLine(fPoints[op->first]+where,fPoints[op->first+1]+where,d);
+			break;
+		case B_PIC_STROKE_RECT:
+			driver->StrokeRect(rect,d);
+			break;
+		case B_PIC_FILL_RECT:
+			driver->FillRect(rect,d);
+			break;
+		case B_PIC_STROKE_ELLIPSE:
+			driver->StrokeEllipse(rect,d);
+			break;
+		case B_PIC_FILL_ELLIPSE:
+			driver->FillEllipse(rect,d);
+			break;
+		case B_PIC_STROKE_ARC:
+			driver->StrokeArc(rect,op->radii.x,op->radii.y,d);
+			break;
+		case B_PIC_FILL_ARC:
+			driver->FillArc(rect,op->radii.x,op->radii.y,d);
+			break;
+		case B_PIC_STROKE_ROUND_RECT:
+			driver->StrokeRoundRect(rect,op->radii.x,op->radii.y,d);
+			break;
+		case B_PIC_FILL_ROUND_RECT:
+			driver->FillRoundRect(rect,op->radii.x,op->radii.y,d);
+			break;
+		case B_PIC_STROKE_BEZIER:
+		case B_PIC_FILL_BEZIER:
+		{
+			BPoint points[4];
+			for(int32 i=0; i<4; i++)
+				points[i]=fPoints[op->first+i]+where;
+			if(op->op==B_PIC_STROKE_BEZIER)
+				driver->StrokeBezier(points,d);
+			else
+				driver->FillBezier(points,d);
+			break;
+		}
+		case B_PIC_STROKE_POLYGON:
+		case B_PIC_FILL_POLYGON:
+		{
+			BPoint *points=(BPoint*)malloc(op->count*sizeof(BPoint));
+			if(!points)
+				break;
+			for(int32 i=0; i<op->count; i++)
+				points[i]=fPoints[op->first+i]+where;
+			if(op->op==B_PIC_STROKE_POLYGON)
+				driver->StrokePolygon(points,op->count,rect,d,op->closed);
+			else
+				driver->FillPolygon(points,op->count,rect,d);
+			free(points);
+			break;
+		}
+		case B_PIC_STROKE_SHAPE:
+		case B_PIC_FILL_SHAPE:
+		{
+			BPoint *points=(BPoint*)malloc(op->count*sizeof(BPoint));
+			if(!points)
+				break;
+			for(int32 i=0; i<op->count; i++)
+				points[i]=fPoints[op->first+i]+where;
+			if(op->op==B_PIC_STROKE_SHAPE)
+				driver->StrokeShape(rect,op->shapeopcount,&fShapeOps[op->shapeop],
+					op->count,points,d);
+			else
+				driver->FillShape(rect,op->shapeopcount,&fShapeOps[op->shapeop],
+					op->count,points,d);
+			free(points);
+			break;
+		}
+		case B_PIC_DRAW_STRING:
+			// DrawString only reads the state it is given
+			driver->DrawString(&fText[op->first],op->count,BPoint(rect.left,rect.top),
+				const_cast<DrawData*>(d));
+			break;
+		case B_PIC_DRAW_PIXELS:
+			driver->DrawBitmap(op->bitmap,op->source,rect,d);
+			break;
+		default:
+			break;
+	}
 }
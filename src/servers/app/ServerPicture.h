@@ -19,7 +19,7 @@
 //	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 //	DEALINGS IN THE SOFTWARE.
 //
-//	File Name:		ServerPicture.cpp
+//	File Name:		ServerPicture.h
 //	Author:			DarkWyrm <bpmagic@columbus.rr.com>
 //	Description:	Server-side counterpart to BPicture
 //  
@@ -28,24 +28,128 @@
 #define SERVER_PICTURE_H
 
 #include <OS.h>
+#include <List.h>
+#include <Rect.h>
+#include <Region.h>
+#include "SharedObject.h"
 
-class AreaLink;
+class DisplayDriver;
+class DrawData;
+class ServerBitmap;
+class SpanList;
+struct shape_span;
+struct compile_state;
 
-class ServerPicture
+/*!
+	\brief One drawing call of a compiled picture
+
+	Geometry is in picture coordinates with the picture's origins, scales and
+	pen moves already applied, so drawing it only has to offset it.
+*/
+typedef struct
+{
+	int16 op;				// B_PIC_* code of the call
+	bool closed;			// whether a stroked polygon is closed
+	int32 state;			// index of the call's DrawData in the picture's states
+	int32 clip;				// index of the region the call is clipped to, or -1
+	BRect bounds;			// every pixel the call can touch
+	BRect rect;				// rectangle, frame of an ellipse or arc, or bitmap destination
+	BPoint radii;			// radii of a round rectangle, or an arc's angle and span
+	int32 first;			// first of the call's points, or of its string's bytes
+	int32 count;			// number of points or bytes
+	int32 shapeop;			// first of a shape's ops
+	int32 shapeopcount;		// number of a shape's ops
+	BRect source;			// the part of bitmap which is drawn
+	ServerBitmap *bitmap;	// the pixels of a call which draws them
+	shape_span *spans;		// the call's spans at a whole-pixel offset, or NULL
+	int32 spancount;
+} picture_op;
+
+/*!
+	\class ServerPicture ServerPicture.h
+	\brief A BPicture compiled into a list of drawing calls
+
+	The picture's data is decoded once, when the picture is created, into
+	calls with their geometry transformed and their bounds worked out. Drawing
+	the picture skips the calls which miss the area being drawn, and shapes
+	small enough to keep are rasterized once, so drawing them again at a
+	whole-pixel position only moves their spans.
+
+	Pictures drawn by a picture are compiled into its calls. The pictures it
+	draws are its dependents so that their data is still there when the
+	picture is itself drawn by a picture made later; the application which
+	made a picture is its first dependent.
+*/
+class ServerPicture : public SharedObject
 {
 public:
-	ServerPicture(void);
+	ServerPicture(const void *data, int32 size, const BList *pictures=NULL);
 	~ServerPicture(void);
 
+	void Release(void);
+
 	bool InitCheck(void) { return _initialized; }
-	area_id Area(void) { return _area; }
 	int32 GetToken(void) { return _token; }
+
+	//! Returns the area the picture covers
+	BRect Bounds(void) const { return fBounds; }
+	//! Returns the number of drawing calls the picture has
+	int32 CountOps(void) const { return fCount; }
+
+	void Draw(DisplayDriver *driver, const BPoint &where, BRegion *visible,
+		const DrawData *layer);
+	void GetRegion(BRegion *region, const BPoint &where);
 private:
-	
-	AreaLink *arealink;
+	ServerPicture(const ServerPicture *picture, const BPoint &origin, float scale);
+	void Init(void);
+	bool Compile(const uint8 *data, int32 size, const ServerPicture *source,
+		const BPoint &origin, float scale);
+	bool Compile(const uint8 *data, int32 size, const ServerPicture *source,
+		compile_state *state);
+	ServerPicture *FindPicture(int32 token) const;
+	void PushState(compile_state *state);
+	void PopState(compile_state *state);
+	int32 AddClip(BRegion *region);
+	bool UpdateClip(compile_state *state);
+	bool ClipOp(picture_op *op);
+	picture_op *AddOp(int16 op, compile_state *state);
+	void RemoveOp(void);
+	int32 AddPoints(const BPoint *points, int32 count);
+	int32 AddShapeOps(const int32 *ops, int32 count);
+	int32 AddText(const char *text, int32 length);
+	void Cache(picture_op *op, SpanList &spans);
+	bool Rasterize(SpanList &spans, const picture_op *op, const BPoint &where);
+	void DrawOp(DisplayDriver *driver, const picture_op *op, const BPoint &where,
+		const DrawData *d);
+
 	bool _initialized;
-	area_id _area;
 	int32 _token;
+
+	// the picture's data and the pictures it draws, for pictures drawing it
+	uint8 *fData;
+	int32 fDataSize;
+	BList fPictures;
+
+	picture_op *fOps;
+	int32 fCount;
+	int32 fSize;
+
+	// points and strings of all calls, kept together
+	BPoint *fPoints;
+	int32 fPointCount;
+	int32 fPointSize;
+	int32 *fShapeOps;
+	int32 fShapeOpCount;
+	int32 fShapeOpSize;
+	char *fText;
+	int32 fTextLength;
+	int32 fTextSize;
+
+	// drawing states, one for each run of calls drawn the same way
+	BList fStates;
+	// regions calls are clipped to, in picture coordinates
+	BList fClips;
+	BRect fBounds;
 };
 
 #endif
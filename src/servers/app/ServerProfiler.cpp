@@ -0,0 +1,299 @@
+//------------------------------------------------------------------------------
+//	File Name:		ServerProfiler.cpp
+//	Description:	Counts and times the messages each application and window
+//					sends the server
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+#include <PortLink.h>
+#include "ServerProfiler.h"
+
+//! The server's profiler, NULL unless PROFILE_VARIABLE is set. Created by the AppServer class.
+ServerProfiler *serverprofiler=NULL;
+
+// Whether a costs more than b: more time, or as much in more messages
+static bool costs_more(const opcode_stats &a, const opcode_stats &b)
+{
+	if(a.time!=b.time)
+		return a.time>b.time;
+	return a.count>b.count;
+}
+
+/*!
+	\brief Sets up an empty profile
+	\param name Signature of the application or title of the window
+	\param team Team of the application
+	\param app Application profile of a window, NULL for an application's own
+*/
+MessageProfile::MessageProfile(const char *name, team_id team, MessageProfile *app)
+{
+	strncpy(fName,name ? name : "",sizeof(fName)-1);
+	fName[sizeof(fName)-1]='\0';
+	fTeam=team;
+	fApp=app;
+	fExited=false;
+	Reset();
+}
+
+/*!
+	\brief Adds up the messages of all codes
+	\param totals Receives the sums. Its code is PROFILE_CODES.
+*/
+void MessageProfile::GetTotals(opcode_stats *totals) const
+{
+	totals->code=PROFILE_CODES;
+	totals->count=0;
+	totals->bytes=0;
+	totals->time=0;
+	for(int32 i=0; i<=PROFILE_CODES; i++)
+	{
+		totals->count+=fStats[i].count;
+		totals->bytes+=fStats[i].bytes;
+		totals->time+=fStats[i].time;
+	}
+}
+
+/*!
+	\brief Finds the codes which took the most time
+	\param top Array which receives them, costliest first
+	\param count Size of the array
+	\return Number of codes put in the array. Codes never sent are left out.
+*/
+int32 MessageProfile::GetTop(opcode_stats *top, int32 count) const
+{
+	int32 found=0;
+	for(int32 i=0; i<=PROFILE_CODES; i++)
+	{
+		if(fStats[i].count==0)
+			continue;
+
+		int32 j=found<count ? found++ : count;
+		while(j>0 && costs_more(fStats[i],top[j-1]))
+		{
+			if(j<count)
+				top[j]=top[j-1];
+			j--;
+		}
+		if(j<count)
+			top[j]=fStats[i];
+	}
+	return found;
+}
+
+//! Adds the messages of another profile to this one
+void MessageProfile::Merge(const MessageProfile *profile)
+{
+	for(int32 i=0; i<=PROFILE_CODES; i++)
+	{
+		fStats[i].count+=profile->fStats[i].count;
+		fStats[i].bytes+=profile->fStats[i].bytes;
+		fStats[i].time+=profile->fStats[i].time;
+	}
+}
+
+//! Forgets all messages counted so far
+void MessageProfile::Reset(void)
+{
+	for(int32 i=0; i<=PROFILE_CODES; i++)
+	{
+		fStats[i].code=i;
+		fStats[i].count=0;
+		fStats[i].bytes=0;
+		fStats[i].time=0;
+	}
+}
+
+/*!
+	\brief Sets up the profiler
+	\param dumppath File the profile is to be written to when the server quits, if any
+*/
+ServerProfiler::ServerProfiler(const char *dumppath)
+{
+	fLock=create_sem(1,"profiler sem");
+	fDumpPath=dumppath ? strdup(dumppath) : NULL;
+}
+
+//! Frees all profiles
+ServerProfiler::~ServerProfiler(void)
+{
+	free(fDumpPath);
+	for(int32 i=0; i<fProfiles.CountItems(); i++)
+		delete (MessageProfile*)fProfiles.ItemAtFast(i);
+	delete_sem(fLock);
+}
+
+/*!
+	\brief Creates the profile of an application
+	\param signature The application's signature
+	\param team The application's team
+	\return The new profile, which the profiler owns
+*/
+MessageProfile *ServerProfiler::AddApp(const char *signature, team_id team)
+{
+	MessageProfile *profile=new MessageProfile(signature,team,NULL);
+	acquire_sem(fLock);
+	fProfiles.AddItem(profile);
+	release_sem(fLock);
+	return profile;
+}
+
+/*!
+	\brief Creates the profile of a window
+	\param title The window's title
+	\param app The profile of the window's application
+	\return The new profile, which the profiler owns
+*/
+MessageProfile *ServerProfiler::AddWindow(const char *title, MessageProfile *app)
+{
+	MessageProfile *profile=new MessageProfile(title,app ? app->fTeam : -1,app);
+	acquire_sem(fLock);
+	fProfiles.AddItem(profile);
+	release_sem(fLock);
+	return profile;
+}
+
+/*!
+	\brief Marks an application's profile as the one of an application which quit
+	
+	The profile stays with the others. Nothing may be added to it anymore.
+*/
+void ServerProfiler::RemoveApp(MessageProfile *profile)
+{
+	acquire_sem(fLock);
+	profile->fExited=true;
+	release_sem(fLock);
+}
+
+//! Adds a window's profile to its application's and deletes it
+void ServerProfiler::RemoveWindow(MessageProfile *profile)
+{
+	acquire_sem(fLock);
+	fProfiles.RemoveItem(profile);
+	if(profile->fApp)
+		profile->fApp->Merge(profile);
+	release_sem(fLock);
+	delete profile;
+}
+
+/*!
+	\brief Forgets what all profiles counted so far
+	
+	Profiles of applications which quit are kept, since windows of theirs may
+	still be open.
+*/
+void ServerProfiler::Reset(void)
+{
+	acquire_sem(fLock);
+	for(int32 i=0; i<fProfiles.CountItems(); i++)
+		((MessageProfile*)fProfiles.ItemAtFast(i))->Reset();
+	release_sem(fLock);
+}
+
+/*!
+	\brief Attaches all profiles to a message
+	\param link The message
+	\param top Most codes attached for each profile
+	
+	The number of profiles is attached first. Each profile is then its name,
+	its team, whether it is a window's, its totals, the number of codes which
+	follow and that many opcode_stats, costliest first.
+*/
+void ServerProfiler::Attach(BPortLink *link, int32 top)
+{
+	opcode_stats *stats=(opcode_stats*)malloc(sizeof(opcode_stats)*(top>0 ? top : 1));
+
+	acquire_sem(fLock);
+	link->Attach<int32>(fProfiles.CountItems());
+	for(int32 i=0; i<fProfiles.CountItems(); i++)
+	{
+		MessageProfile *profile=(MessageProfile*)fProfiles.ItemAtFast(i);
+		opcode_stats totals;
+		profile->GetTotals(&totals);
+		int32 count=profile->GetTop(stats,top);
+
+		link->AttachString(profile->fName);
+		link->Attach<team_id>(profile->fTeam);
+		link->Attach<bool>(profile->fApp!=NULL);
+		link->Attach<opcode_stats>(totals);
+		link->Attach<int32>(count);
+		link->Attach(stats,sizeof(opcode_stats)*count);
+	}
+	release_sem(fLock);
+
+	free(stats);
+}
+
+// One line of a printed profile, labelled with its code unless a label is given
+static void print_stats(FILE *file, const char *label, const opcode_stats &stats)
+{
+	char codelabel[32];
+	if(!label)
+	{
+		if(stats.code==PROFILE_CODES)
+			sprintf(codelabel,"other");
+		else
+			sprintf(codelabel,"offset %ld",stats.code);
+		label=codelabel;
+	}
+	fprintf(file,"  %-24s %9ld %11lld %10.3f %9.3f\n",label,stats.count,stats.bytes,
+		stats.time/1000.0,stats.count ? (double)stats.time/stats.count : 0.0);
+}
+
+/*!
+	\brief Prints all profiles
+	\param file Where to print them
+	\param top Most codes listed for each profile, besides the server's totals
+
+	The server's totals come first, with all codes, then every profile with its
+	totals and its costliest codes. Codes are given by their offset from
+	SERVER_TRUE in ServerProtocol.h.
+*/
+void ServerProfiler::Print(FILE *file, int32 top)
+{
+	MessageProfile all("server",-1,NULL);
+	opcode_stats *stats=(opcode_stats*)malloc(sizeof(opcode_stats)*(PROFILE_CODES+1));
+
+	acquire_sem(fLock);
+	for(int32 i=0; i<fProfiles.CountItems(); i++)
+		all.Merge((MessageProfile*)fProfiles.ItemAtFast(i));
+
+	fprintf(file,"  %-24s %9s %11s %10s %9s\n","code","messages","bytes","ms","us each");
+	int32 count=all.GetTop(stats,PROFILE_CODES+1);
+	for(int32 i=0; i<count; i++)
+		print_stats(file,NULL,stats[i]);
+
+	for(int32 i=0; i<fProfiles.CountItems(); i++)
+	{
+		MessageProfile *profile=(MessageProfile*)fProfiles.ItemAtFast(i);
+		opcode_stats totals;
+		profile->GetTotals(&totals);
+
+		fprintf(file,"\n%s %s, team %ld%s\n",profile->fApp ? "window" : "application",
+			profile->fName,profile->fTeam,profile->fExited ? ", quit" : "");
+		print_stats(file,"all",totals);
+
+		count=profile->GetTop(stats,top);
+		for(int32 j=0; j<count; j++)
+			print_stats(file,NULL,stats[j]);
+	}
+	release_sem(fLock);
+
+	free(stats);
+}
+
+/*!
+	\brief Writes all profiles to a file
+	\param path The file, which is replaced
+	\param top Most codes listed for each profile
+	\return B_OK, or B_ERROR if the file could not be written
+*/
+status_t ServerProfiler::Dump(const char *path, int32 top)
+{
+	FILE *file=fopen(path,"w");
+	if(!file)
+		return B_ERROR;
+
+	Print(file,top);
+	return fclose(file)==0 ? B_OK : B_ERROR;
+}
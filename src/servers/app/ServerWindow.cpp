@@ -27,12 +27,14 @@
 //------------------------------------------------------------------------------
 #include <AppDefs.h>
 #include <Rect.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <View.h>	// for B_XXXXX_MOUSE_BUTTON defines
 #include <Message.h>
 #include <GraphicsDefs.h>
 #include <PortLink.h>
+#include <CommandRing.h>
 #include "AppServer.h"
 #include "Layer.h"
 #include "RootLayer.h"
@@ -40,13 +42,17 @@
 #include "ServerApp.h"
 #include "ServerProtocol.h"
 #include "WinBorder.h"
+#include "BackingStore.h"
 #include "Desktop.h"
 #include "TokenHandler.h"
 #include "Utils.h"
 #include "DisplayDriver.h"
+#include "FontServer.h"
 #include "ServerPicture.h"
 #include "CursorManager.h"
 #include "Workspace.h"
+#include "SessionPlayer.h"
+#include "ServerProfiler.h"
 
 //#define DEBUG_SERVERWINDOW
 //#define DEBUG_SERVERWINDOW_MOUSE
@@ -148,11 +154,41 @@ ServerWindow::ServerWindow(BRect rect, const char *string, uint32 wlook,
 	fMessagePort = create_port(30,fTitle.String());
 
 	fMsgSender=new LinkMsgSender(fClientWinPort);
-	fMsgReader=new LinkMsgReader(fMessagePort);
+
+	// Sessions are recorded for SessionPlayer when a directory is given for them
+	const char *sessiondir=getenv(SESSION_RECORD_VARIABLE);
+	if(sessiondir)
+	{
+		char sessionpath[B_PATH_NAME_LENGTH];
+		snprintf(sessionpath,sizeof(sessionpath),"%s/window-%ld.session",sessiondir,fMessagePort);
+		fMsgReader=new SessionRecorder(fMessagePort,sessionpath);
+	}
+	else
+		fMsgReader=new LinkMsgReader(fMessagePort);
+
+	// The window's messages come through a shared ring unless it is turned off
+	fCommandRing=NULL;
+	const char *ring=getenv(COMMAND_RING_VARIABLE);
+	if(!ring || atoi(ring)!=0)
+	{
+		fCommandRing=new CommandRing(fTitle.String());
+		if(fCommandRing->InitCheck()==B_OK)
+			fMsgReader->SetRing(fCommandRing);
+		else
+		{
+			delete fCommandRing;
+			fCommandRing=NULL;
+		}
+	}
 	
-	// Send a reply to our window - it is expecting fMessagePort port.
+	// Counts what the window sends when the server is profiled
+	fProfile=serverprofiler ? serverprofiler->AddWindow(fTitle.String(),winapp->fProfile) : NULL;
+
+	// Send a reply to our window - it is expecting fMessagePort port, and
+	// the area of the ring it should write to
 	fMsgSender->StartMessage(SERVER_TRUE);
 	fMsgSender->Attach<port_id>(fMessagePort);
+	fMsgSender->Attach<area_id>(fCommandRing ? fCommandRing->Area() : B_ERROR);
 	fMsgSender->Flush();
 
 	STRACE(("ServerWindow %s:\n",fTitle.String()));
@@ -193,6 +229,12 @@ ServerWindow::~ServerWindow(void)
 		delete fMsgReader;
 		fMsgReader=NULL;
 	}
+
+	delete fCommandRing;
+	fCommandRing=NULL;
+
+	if(fProfile)
+		serverprofiler->RemoveWindow(fProfile);
 	
 	if (fWinBorder)
 	{
@@ -515,10 +557,13 @@ void ServerWindow::SetLayerFontState(Layer *layer, LinkMsgReader &link)
 	if (mask & B_FONT_FAMILY_AND_STYLE)
 	{
 		uint32		fontID;
-		link.Read<int32>((int32*)&fontID);
+		link.Read<uint32>(&fontID);
 		
-		// TODO: Implement. ServerFont::SetFamilyAndStyle(uint32) is needed
-		//layer->fLayerData->font->
+		fontserver->Lock();
+		FontStyle *style=fontserver->GetStyle(fontID >> 16, fontID & 0xFFFF);
+		if(style)
+			layer->fLayerData->font.SetStyle(style);
+		fontserver->Unlock();
 	}
 
 	if (mask & B_FONT_SIZE)
@@ -669,6 +714,76 @@ Layer * ServerWindow::CreateLayerTree(Layer *localRoot, LinkMsgReader &link)
 	return newLayer;
 }
 //------------------------------------------------------------------------------
+/*!
+	\brief Makes the window's backing store forget what a message changes
+	\param code The message about to be handled for the current layer
+	
+	Drawing outside of an update changes what is under the current layer, even
+	in the parts of it which are covered. Changes to the layers themselves can
+	move anything in the window.
+*/
+void ServerWindow::DiscardStoredContents(int32 code)
+{
+	BackingStore *store = fWinBorder ? fWinBorder->fBackingStore : NULL;
+	if (!store || !cl)
+		return;
+	
+	switch(code)
+	{
+		case AS_STROKE_ARC:
+		case AS_STROKE_BEZIER:
+		case AS_STROKE_ELLIPSE:
+		case AS_STROKE_LINE:
+		case AS_STROKE_LINEARRAY:
+		case AS_STROKE_POLYGON:
+		case AS_STROKE_RECT:
+		case AS_STROKE_ROUNDRECT:
+		case AS_STROKE_SHAPE:
+		case AS_STROKE_TRIANGLE:
+		case AS_FILL_ARC:
+		case AS_FILL_BEZIER:
+		case AS_FILL_ELLIPSE:
+		case AS_FILL_POLYGON:
+		case AS_FILL_RECT:
+		case AS_FILL_REGION:
+		case AS_FILL_ROUNDRECT:
+		case AS_FILL_SHAPE:
+		case AS_FILL_TRIANGLE:
+		case AS_DRAW_STRING:
+		case AS_LAYER_DRAW_BITMAP_ASYNC_IN_RECT:
+		case AS_LAYER_DRAW_BITMAP_ASYNC_AT_POINT:
+		case AS_LAYER_DRAW_BITMAP_SYNC_IN_RECT:
+		case AS_LAYER_DRAW_BITMAP_SYNC_AT_POINT:
+		case AS_LAYER_DRAW_PICTURE:
+		case AS_LAYER_COPY_BITS:
+		{
+			if (!cl->fInUpdate)
+				store->Discard(cl->fFull, fWinBorder->fFrame.LeftTop());
+			break;
+		}
+		case AS_LAYER_SET_ORIGIN:
+		case AS_LAYER_SET_VIEW_COLOR:
+		case AS_LAYER_INVAL_RECT:
+		case AS_LAYER_INVAL_REGION:
+		{
+			store->Discard(cl->fFull, fWinBorder->fFrame.LeftTop());
+			break;
+		}
+		case AS_LAYER_CREATE:
+		case AS_LAYER_DELETE:
+		case AS_LAYER_MOVETO:
+		case AS_LAYER_RESIZETO:
+		case AS_LAYER_SHOW:
+		case AS_LAYER_HIDE:
+		{
+			store->Discard();
+			break;
+		}
+		default:
+			break;
+	}
+}
+//------------------------------------------------------------------------------
 void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 {
 	if (cl == NULL && code != AS_LAYER_CREATE_ROOT)
@@ -677,6 +792,8 @@ void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 		return;
 	}
 
+	DiscardStoredContents(code);
+
 	switch(code)
 	{
 		//--------- BView Messages -----------------
@@ -728,6 +845,42 @@ void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 			}
 			break;
 		}
+		case AS_LAYER_DRAW_PICTURE:
+		{
+			STRACE(("ServerWindow %s: Message AS_LAYER_DRAW_PICTURE: Layer: %s\n",fTitle.String(), cl->fName->String()));
+			
+			// Attached Data:
+			// 1) int32 token
+			// 2) BPoint where
+			// 3) int32 SERVER_TRUE, if a reply is wanted
+			int32 pictureToken;
+			BPoint where;
+			
+			link.Read<int32>(&pictureToken);
+			link.Read<BPoint>(&where);
+			
+			if(cl && cl->fLayerData)
+			{
+				// the application can't delete the picture while it's drawn
+				fServerApp->Lock();
+				ServerPicture *sp=fServerApp->FindPicture(pictureToken);
+				if(sp)
+					sp->Draw(desktop->GetDisplayDriver(),cl->ConvertToTop(where),
+						cl->ClippingRegion(),cl->fLayerData);
+				fServerApp->Unlock();
+			}
+			
+			// BView::DrawPicture() adds SERVER_TRUE and waits for the picture
+			// to be drawn
+			int32 sync;
+			if(link.Read<int32>(&sync)==B_OK && sync==SERVER_TRUE)
+			{
+				fMsgSender->StartMessage(SERVER_TRUE);
+				fMsgSender->Attach<status_t>(B_OK);
+				fMsgSender->Flush();
+			}
+			break;
+		}
 		case AS_LAYER_DRAW_BITMAP_SYNC_IN_RECT:
 		{
 			int32 bitmapToken;
@@ -1247,26 +1400,16 @@ void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 				redraw		= true;
 			}
 			
-			// search for a picture with the specified token.
-			ServerPicture *sp = NULL;
-			int32 i = 0;
-			while(1)
+			// the area the picture draws on is what the layer is clipped to
+			fServerApp->Lock();
+			ServerPicture *sp=fServerApp->FindPicture(pictureToken);
+			if(sp)
 			{
-				sp=static_cast<ServerPicture*>(cl->fServerWin->fServerApp->fPictureList->ItemAt(i++));
-				if (!sp)
-					break;
-				
-				if(sp->GetToken() == pictureToken)
-				{
-					//cl->clipToPicture	= sp;
-					
-					// TODO: Increase that picture's reference count.(~ allocate a picture)
-					break;
-				}
+				if(!cl->clipToPicture)
+					cl->clipToPicture=new BRegion;
+				sp->GetRegion(cl->clipToPicture,cl->ConvertToTop(where));
 			}
-			
-			// avoid compiler warning
-			i = 0;
+			fServerApp->Unlock();
 			
 			// we have a new picture to clip to, so rebuild our full region
 			if(cl->clipToPicture) 
@@ -1310,25 +1453,15 @@ void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 			link.Read<int32>(&pictureToken);
 			link.Read<BPoint>(&where);
 			
-			ServerPicture *sp = NULL;
-			int32 i = 0;
-			
-			while(1)
+			fServerApp->Lock();
+			ServerPicture *sp=fServerApp->FindPicture(pictureToken);
+			if(sp)
 			{
-				sp= static_cast<ServerPicture*>(cl->fServerWin->fServerApp->fPictureList->ItemAt(i++));
-				if (!sp)
-					break;
-					
-				if(sp->GetToken() == pictureToken)
-				{
-					//cl->clipToPicture	= sp;
-					
-					// TODO: Increase that picture's reference count.(~ allocate a picture)
-					break;
-				}
+				if(!cl->clipToPicture)
+					cl->clipToPicture=new BRegion;
+				sp->GetRegion(cl->clipToPicture,cl->ConvertToTop(where));
 			}
-			// avoid compiler warning
-			i = 0;
+			fServerApp->Unlock();
 			
 			// if a picture has been found...
 			if(cl->clipToPicture) 
@@ -1443,6 +1576,49 @@ void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 
 			break;
 		}
+		case AS_LAYER_COPY_BITS:
+		{
+			STRACE(("ServerWindow %s: Message AS_LAYER_COPY_BITS: Layer: %s\n",fTitle.String(), cl->fName->String()));
+			
+			BRect src, dst;
+			
+			link.Read<BRect>(&src);
+			link.Read<BRect>(&dst);
+			
+			BRect source(cl->ConvertToTop(src));
+			BRect dest(cl->ConvertToTop(dst));
+			int32 dx = (int32)(dest.left - source.left);
+			int32 dy = (int32)(dest.top - source.top);
+			
+			// Only what the view shows can be copied, to where it shows.
+			// Nothing is copied to a destination of another size, which
+			// the view then draws whole, rather than scaling the copy.
+			BRegion copyReg;
+			if(source.Width() == dest.Width() && source.Height() == dest.Height())
+			{
+				copyReg.Set(source);
+				copyReg.IntersectWith(&cl->fVisible);
+				copyReg.OffsetBy(dx, dy);
+				copyReg.IntersectWith(&cl->fVisible);
+			}
+			
+			// and the view has to draw the rest of the destination itself
+			BRegion invalReg(dest);
+			invalReg.IntersectWith(&cl->fVisible);
+			invalReg.Exclude(&copyReg);
+			
+			if(copyReg.CountRects() > 0)
+			{
+				BPoint lefttop(copyReg.Frame().LeftTop());
+				copyReg.OffsetBy(-dx, -dy);
+				desktop->GetDisplayDriver()->CopyRegion(&copyReg, lefttop);
+			}
+			
+			if(invalReg.CountRects() > 0)
+				cl->Invalidate(invalReg);
+			
+			break;
+		}
 		case AS_BEGIN_UPDATE:
 		{
 			STRACE(("ServerWindowo %s: AS_BEGIN_UPDATE\n",fTitle.String()));
@@ -1453,6 +1629,11 @@ void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 		{
 			STRACE(("ServerWindowo %s: AS_END_UPDATE\n",fTitle.String()));
 			cl->UpdateEnd();
+			
+			// what the layer shows is final now and may be saved
+			if (fWinBorder && fWinBorder->fBackingStore)
+				fWinBorder->fBackingStore->RemovePending(cl->fVisible,
+					fWinBorder->fFrame.LeftTop());
 			break;
 		}
 
@@ -1896,7 +2077,6 @@ void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 		{
 			STRACE(("ServerWindow %s: Message AS_FILL_TRIANGLE\n",fTitle.String()));
 			
-			// TODO:: Add clipping to AS_FILL_TRIANGLE
 			BPoint pts[3];
 			BRect rect;
 			
@@ -1934,7 +2114,7 @@ void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 			for(int32 i=0; i<pointcount; i++)
 				pointlist[i]=cl->ConvertToTop(pointlist[i]);
 			
-			desktop->GetDisplayDriver()->StrokePolygon(pointlist,pointcount,polyframe,
+			desktop->GetDisplayDriver()->StrokePolygon(pointlist,pointcount,cl->ConvertToTop(polyframe),
 					cl->fLayerData,isclosed);
 			
 			delete [] pointlist;
@@ -1959,7 +2139,7 @@ void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 			for(int32 i=0; i<pointcount; i++)
 				pointlist[i]=cl->ConvertToTop(pointlist[i]);
 			
-			desktop->GetDisplayDriver()->FillPolygon(pointlist,pointcount,polyframe,cl->fLayerData);
+			desktop->GetDisplayDriver()->FillPolygon(pointlist,pointcount,cl->ConvertToTop(polyframe),cl->fLayerData);
 			
 			delete [] pointlist;
 			
@@ -2141,7 +2321,8 @@ void ServerWindow::DispatchMessage(int32 code, LinkMsgReader &link)
 		}
 		case AS_SYNC:
 		{
-			// TODO: AS_SYNC is a no-op for now, just to get things working
+			// Everything drawn so far has to be on screen before the reply
+			desktop->GetDisplayDriver()->Sync();
 			fMsgSender->StartMessage(SERVER_TRUE);
 			fMsgSender->Flush();
 			break;
@@ -2201,7 +2382,14 @@ int32 ServerWindow::MonitorWin(void *data)
 			}
 			default:
 			{
-				win->DispatchMessage(code, *ses);
+				if(win->fProfile)
+				{
+					bigtime_t start=system_time();
+					win->DispatchMessage(code, *ses);
+					win->fProfile->Add(code, ses->MessageSize(), system_time()-start);
+				}
+				else
+					win->DispatchMessage(code, *ses);
 				break;
 			}
 		}
@@ -2279,7 +2467,7 @@ void ServerWindow::SendMessageToClient(const BMessage* msg) const
 	else
 		printf("PANIC: ServerWindow %s: can't flatten message in 'SendMessageToClient()'\n", fTitle.String());
 
-	delete buffer;
+	delete [] buffer;
 }
 //------------------------------------------------------------------------------
 
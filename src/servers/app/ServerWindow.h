@@ -45,6 +45,8 @@ class BMessage;
 class ServerApp;
 class Decorator;
 class BPortLink;
+class CommandRing;
+class MessageProfile;
 class WinBorder;
 class Workspace;
 class Layer;
@@ -128,6 +130,7 @@ private:
 
 	// message handle methods.
 	void DispatchMessage(int32 code, LinkMsgReader &link);
+	void DiscardStoredContents(int32 code);
 	static int32 MonitorWin(void *data);
 
 
@@ -160,6 +163,8 @@ protected:
 	
 	LinkMsgReader *fMsgReader;
 	LinkMsgSender *fMsgSender;
+	CommandRing *fCommandRing;
+	MessageProfile *fProfile;
 
 	// cl is short for currentLayer. We'll use it a lot, that's why it's short :-)
 	Layer *cl;
@@ -0,0 +1,755 @@
+//------------------------------------------------------------------------------
+//	File Name:		SessionPlayer.cpp
+//	Description:	Records the messages a window sends the server and plays
+//					their drawing back for benchmarking
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+#include <Font.h>
+#include <ServerProtocol.h>
+#include "DisplayDriver.h"
+#include "LayerData.h"
+#include "ServerPicture.h"
+#include "SessionPlayer.h"
+
+// Each message starts with its size, code and flags, as on the port
+static const int32 kHeaderSize = sizeof(int32) * 3;
+
+static const struct
+{
+	int32 code;
+	const char *name;
+} kCodeNames[] =
+{
+	{ AS_LAYER_SET_HIGH_COLOR, "AS_LAYER_SET_HIGH_COLOR" },
+	{ AS_LAYER_SET_LOW_COLOR, "AS_LAYER_SET_LOW_COLOR" },
+	{ AS_LAYER_SET_PEN_SIZE, "AS_LAYER_SET_PEN_SIZE" },
+	{ AS_LAYER_SET_PEN_LOC, "AS_LAYER_SET_PEN_LOC" },
+	{ AS_LAYER_SET_DRAW_MODE, "AS_LAYER_SET_DRAW_MODE" },
+	{ AS_LAYER_SET_BLEND_MODE, "AS_LAYER_SET_BLEND_MODE" },
+	{ AS_LAYER_SET_LINE_MODE, "AS_LAYER_SET_LINE_MODE" },
+	{ AS_LAYER_SET_SCALE, "AS_LAYER_SET_SCALE" },
+	{ AS_LAYER_PUSH_STATE, "AS_LAYER_PUSH_STATE" },
+	{ AS_LAYER_POP_STATE, "AS_LAYER_POP_STATE" },
+	{ AS_MOVEPENTO, "AS_MOVEPENTO" },
+	{ AS_SETPENSIZE, "AS_SETPENSIZE" },
+	{ AS_STROKE_LINE, "AS_STROKE_LINE" },
+	{ AS_STROKE_RECT, "AS_STROKE_RECT" },
+	{ AS_FILL_RECT, "AS_FILL_RECT" },
+	{ AS_STROKE_ARC, "AS_STROKE_ARC" },
+	{ AS_FILL_ARC, "AS_FILL_ARC" },
+	{ AS_STROKE_BEZIER, "AS_STROKE_BEZIER" },
+	{ AS_FILL_BEZIER, "AS_FILL_BEZIER" },
+	{ AS_STROKE_ELLIPSE, "AS_STROKE_ELLIPSE" },
+	{ AS_FILL_ELLIPSE, "AS_FILL_ELLIPSE" },
+	{ AS_STROKE_ROUNDRECT, "AS_STROKE_ROUNDRECT" },
+	{ AS_FILL_ROUNDRECT, "AS_FILL_ROUNDRECT" },
+	{ AS_STROKE_TRIANGLE, "AS_STROKE_TRIANGLE" },
+	{ AS_FILL_TRIANGLE, "AS_FILL_TRIANGLE" },
+	{ AS_STROKE_POLYGON, "AS_STROKE_POLYGON" },
+	{ AS_FILL_POLYGON, "AS_FILL_POLYGON" },
+	{ AS_STROKE_SHAPE, "AS_STROKE_SHAPE" },
+	{ AS_FILL_SHAPE, "AS_FILL_SHAPE" },
+	{ AS_FILL_REGION, "AS_FILL_REGION" },
+	{ AS_STROKE_LINEARRAY, "AS_STROKE_LINEARRAY" },
+	{ AS_DRAW_STRING, "AS_DRAW_STRING" },
+	{ AS_CREATE_PICTURE, "AS_CREATE_PICTURE" },
+	{ AS_LAYER_DRAW_PICTURE, "AS_LAYER_DRAW_PICTURE" },
+	{ AS_LAYER_COPY_BITS, "AS_LAYER_COPY_BITS" },
+	{ AS_END_UPDATE, "AS_END_UPDATE" },
+	{ AS_SYNC, "AS_SYNC" },
+	{ 0, NULL }
+};
+
+static const char *code_name(int32 code)
+{
+	for(int32 i=0; kCodeNames[i].name; i++)
+		if(kCodeNames[i].code==code)
+			return kCodeNames[i].name;
+	return NULL;
+}
+
+static bool ends_frame(int32 code)
+{
+	return code==AS_END_UPDATE || code==AS_SYNC;
+}
+
+/*
+	Reads the attachments of one message in a session the way LinkMsgReader
+	reads them from a port. Like LinkMsgReader, once a read fails every read
+	after it fails, so only the last one needs checking.
+*/
+class SessionMessage
+{
+public:
+	SessionMessage(const char *data, int32 size)
+		: fData(data), fSize(size), fPosition(0), fError(B_OK) {}
+
+	status_t Read(void *data, ssize_t size)
+	{
+		if(fError<B_OK)
+			return fError;
+		if(size<1 || fPosition+size>fSize)
+		{
+			fError=B_BAD_VALUE;
+			return fError;
+		}
+		memcpy(data,fData+fPosition,size);
+		fPosition+=size;
+		return B_OK;
+	}
+
+	template <class Type> status_t Read(Type *data)
+	{
+		return Read(data,sizeof(Type));
+	}
+
+	// Points into the session instead of allocating a copy
+	status_t ReadString(const char **string)
+	{
+		int32 length;
+		if(Read<int32>(&length)<B_OK)
+			return fError;
+		if(length<1 || fPosition+length>fSize || fData[fPosition+length-1]!='\0')
+		{
+			fError=B_BAD_VALUE;
+			return fError;
+		}
+		*string=fData+fPosition;
+		fPosition+=length;
+		return B_OK;
+	}
+
+	// Array reads with a count from the message are sanity checked first
+	bool CanRead(int32 count, size_t size) const
+	{
+		return fError==B_OK && count>=0 && size_t(count)<=size_t(fSize-fPosition)/size;
+	}
+
+private:
+	const char *fData;
+	int32 fSize;
+	int32 fPosition;
+	status_t fError;
+};
+
+//------------------------------------------------------------------------------
+/*!
+	\brief Reads from a port and appends each message to a session file
+	\param port The port to read messages from
+	\param path The file to write. An existing file is replaced.
+
+	If the file can't be opened, the object only reads.
+*/
+SessionRecorder::SessionRecorder(port_id port, const char *path)
+ : LinkMsgReader(port)
+{
+	fFile=path ? fopen(path,"wb") : NULL;
+	if(!fFile)
+		printf("SessionRecorder: couldn't open %s\n",path ? path : "(null)");
+}
+
+SessionRecorder::~SessionRecorder(void)
+{
+	if(fFile)
+		fclose(fFile);
+}
+
+status_t SessionRecorder::GetNextMessage(int32 *code, bigtime_t timeout)
+{
+	status_t err=LinkMsgReader::GetNextMessage(code,timeout);
+
+	if(err==B_OK && fFile)
+	{
+		fwrite(fRecvBuffer+fRecvStart,1,fReplySize,fFile);
+
+		// A window can be killed at any time, so don't lose its last frame
+		if(ends_frame(*code))
+			fflush(fFile);
+	}
+
+	return err;
+}
+
+//------------------------------------------------------------------------------
+SessionPlayer::SessionPlayer(void)
+{
+	fData=NULL;
+	fSize=0;
+	fMessageCount=0;
+	fFrameCount=0;
+	ResetStats();
+}
+
+SessionPlayer::~SessionPlayer(void)
+{
+	Unset();
+}
+
+void SessionPlayer::Unset(void)
+{
+	free(fData);
+	fData=NULL;
+	fSize=0;
+	fMessageCount=0;
+	fFrameCount=0;
+}
+
+/*!
+	\brief Loads a session file
+	\param path The file to load
+	\return B_OK if successful, B_ENTRY_NOT_FOUND if it couldn't be read,
+	B_BAD_DATA if it isn't a session
+*/
+status_t SessionPlayer::SetTo(const char *path)
+{
+	FILE *file=path ? fopen(path,"rb") : NULL;
+	if(!file)
+		return B_ENTRY_NOT_FOUND;
+
+	fseek(file,0,SEEK_END);
+	long size=ftell(file);
+	fseek(file,0,SEEK_SET);
+
+	char *data=(size>0) ? (char*)malloc(size) : NULL;
+	if(!data || fread(data,1,size,file)!=size_t(size))
+	{
+		free(data);
+		fclose(file);
+		return B_ENTRY_NOT_FOUND;
+	}
+	fclose(file);
+
+	status_t err=SetTo(data,size);
+	free(data);
+	return err;
+}
+
+/*!
+	\brief Copies a session from memory
+	\param data The messages
+	\param size Size of the messages in bytes
+	\return B_OK if successful, B_BAD_DATA if the messages are not well formed
+*/
+status_t SessionPlayer::SetTo(const void *data, int32 size)
+{
+	Unset();
+	ResetStats();
+
+	if(!data || size<kHeaderSize)
+		return B_BAD_DATA;
+
+	// Check every header now so playing doesn't have to
+	int32 messages=0, frames=0;
+	for(int32 offset=0; offset<size; )
+	{
+		int32 header[3];
+		if(size-offset<kHeaderSize)
+			return B_BAD_DATA;
+		memcpy(header,(const char*)data+offset,kHeaderSize);
+		if(header[0]<kHeaderSize || header[0]>size-offset)
+			return B_BAD_DATA;
+
+		if(ends_frame(header[1]))
+			frames++;
+		messages++;
+		offset+=header[0];
+	}
+
+	fData=(char*)malloc(size);
+	if(!fData)
+		return B_NO_MEMORY;
+	memcpy(fData,data,size);
+	fSize=size;
+	fMessageCount=messages;
+	fFrameCount=frames ? frames : 1;
+	return B_OK;
+}
+
+/*!
+	\brief Plays the session once, adding to the timings
+	\param driver The driver to draw on
+	\param data The drawing state to start with. States pushed by the session
+	are popped again before returning.
+	\return B_OK, or B_NO_INIT if there is no session
+*/
+status_t SessionPlayer::Play(DisplayDriver *driver, LayerData *data)
+{
+	if(!fData || !driver || !data)
+		return B_NO_INIT;
+
+	LayerData *state=data;
+	bigtime_t start=system_time();
+
+	for(int32 offset=0; offset<fSize; )
+	{
+		int32 header[3];
+		memcpy(header,fData+offset,kHeaderSize);
+
+		const char *name=code_name(header[1]);
+		if(name)
+		{
+			bigtime_t opstart=system_time();
+			Dispatch(header[1],fData+offset+kHeaderSize,header[0]-kHeaderSize,driver,&state);
+			bigtime_t optime=system_time()-opstart;
+
+			session_code_stats *stats=StatsFor(header[1]);
+			if(stats)
+			{
+				stats->count++;
+				stats->time+=optime;
+			}
+		}
+		else
+			fSkipped++;
+
+		offset+=header[0];
+	}
+
+	while(state!=data)
+	{
+		LayerData *ld=state;
+		state=state->prevState;
+		delete ld;
+	}
+
+	for(int32 i=0; i<fPictures.CountItems(); i++)
+		((ServerPicture*)fPictures.ItemAt(i))->Release();
+	fPictures.MakeEmpty();
+
+	fPlayTime+=system_time()-start;
+	fFramesPlayed+=fFrameCount;
+	return B_OK;
+}
+
+void SessionPlayer::ResetStats(void)
+{
+	memset(fStats,0,sizeof(fStats));
+	fStatsCount=0;
+	fFramesPlayed=0;
+	fSkipped=0;
+	fPlayTime=0;
+}
+
+/*!
+	\brief Prints frames per second and the time spent on each message code
+	\param out Where to print
+*/
+void SessionPlayer::PrintStats(FILE *out) const
+{
+	float seconds=fPlayTime/1000000.0;
+
+	fprintf(out,"%ld frames in %.3f s: %.1f frames/s\n",fFramesPlayed,seconds,
+			(seconds>0) ? fFramesPlayed/seconds : 0.0);
+	fprintf(out,"%-26s %10s %12s %10s %7s\n","message","count","total us","us each","time");
+
+	for(int32 i=0; i<fStatsCount; i++)
+	{
+		const session_code_stats &stats=fStats[i];
+		fprintf(out,"%-26s %10ld %12Ld %10.2f %6.1f%%\n",code_name(stats.code),
+				stats.count,stats.time,float(stats.time)/stats.count,
+				(fPlayTime>0) ? 100.0*stats.time/fPlayTime : 0.0);
+	}
+
+	if(fSkipped)
+		fprintf(out,"%ld messages without drawing were skipped\n",fSkipped);
+}
+
+session_code_stats *SessionPlayer::StatsFor(int32 code)
+{
+	for(int32 i=0; i<fStatsCount; i++)
+		if(fStats[i].code==code)
+			return &fStats[i];
+
+	if(fStatsCount==SESSION_MAX_CODES)
+		return NULL;
+
+	session_code_stats *stats=&fStats[fStatsCount++];
+	stats->code=code;
+	return stats;
+}
+
+/*!
+	\brief Handles one message as ServerWindow::DispatchMessage would
+	\param code The message's code
+	\param data The message's attachments
+	\param size Size of the attachments
+	\param driver The driver to draw on
+	\param state The current drawing state, which pushing and popping change
+*/
+void SessionPlayer::Dispatch(int32 code, const char *data, int32 size,
+	DisplayDriver *driver, LayerData **state)
+{
+	SessionMessage link(data,size);
+	LayerData *ld=*state;
+
+	switch(code)
+	{
+		case AS_LAYER_SET_HIGH_COLOR:
+		case AS_LAYER_SET_LOW_COLOR:
+		{
+			rgb_color c;
+			if(link.Read(&c,sizeof(rgb_color))<B_OK)
+				break;
+			if(code==AS_LAYER_SET_HIGH_COLOR)
+				ld->highcolor.SetColor(c);
+			else
+				ld->lowcolor.SetColor(c);
+			break;
+		}
+		case AS_LAYER_SET_PEN_SIZE:
+		case AS_SETPENSIZE:
+		{
+			float size;
+			if(link.Read<float>(&size)==B_OK)
+				ld->pensize=size;
+			break;
+		}
+		case AS_LAYER_SET_PEN_LOC:
+		case AS_MOVEPENTO:
+		{
+			float x, y;
+			link.Read<float>(&x);
+			if(link.Read<float>(&y)==B_OK)
+				ld->penlocation.Set(x,y);
+			break;
+		}
+		case AS_LAYER_SET_DRAW_MODE:
+		{
+			int8 drawingMode;
+			if(link.Read<int8>(&drawingMode)==B_OK)
+				ld->draw_mode=(drawing_mode)drawingMode;
+			break;
+		}
+		case AS_LAYER_SET_BLEND_MODE:
+		{
+			int8 srcAlpha, alphaFunc;
+			link.Read<int8>(&srcAlpha);
+			if(link.Read<int8>(&alphaFunc)<B_OK)
+				break;
+			ld->alphaSrcMode=(source_alpha)srcAlpha;
+			ld->alphaFncMode=(alpha_function)alphaFunc;
+			break;
+		}
+		case AS_LAYER_SET_LINE_MODE:
+		{
+			int8 lineCap, lineJoin;
+			float miterLimit;
+			link.Read<int8>(&lineCap);
+			link.Read<int8>(&lineJoin);
+			if(link.Read<float>(&miterLimit)<B_OK)
+				break;
+			ld->lineCap=(cap_mode)lineCap;
+			ld->lineJoin=(join_mode)lineJoin;
+			ld->miterLimit=miterLimit;
+			break;
+		}
+		case AS_LAYER_SET_SCALE:
+		{
+			float scale;
+			if(link.Read<float>(&scale)==B_OK)
+				ld->scale=scale;
+			break;
+		}
+		case AS_LAYER_PUSH_STATE:
+		{
+			LayerData *pushed=new LayerData();
+			pushed->prevState=ld;
+			*state=pushed;
+			break;
+		}
+		case AS_LAYER_POP_STATE:
+		{
+			if(!ld->prevState)
+				break;
+			*state=ld->prevState;
+			delete ld;
+			break;
+		}
+		case AS_STROKE_LINE:
+		{
+			float x1, y1, x2, y2;
+			link.Read<float>(&x1);
+			link.Read<float>(&y1);
+			link.Read<float>(&x2);
+			if(link.Read<float>(&y2)<B_OK)
+				break;
+			driver->StrokeLine(BPoint(x1,y1),BPoint(x2,y2),ld);
+			ld->penlocation.Set(x2,y2);
+			break;
+		}
+		case AS_STROKE_RECT:
+		{
+			float left, top, right, bottom;
+			link.Read<float>(&left);
+			link.Read<float>(&top);
+			link.Read<float>(&right);
+			if(link.Read<float>(&bottom)==B_OK)
+				driver->StrokeRect(BRect(left,top,right,bottom),ld);
+			break;
+		}
+		case AS_FILL_RECT:
+		{
+			BRect rect;
+			if(link.Read<BRect>(&rect)==B_OK)
+				driver->FillRect(rect,ld);
+			break;
+		}
+		case AS_STROKE_ARC:
+		case AS_FILL_ARC:
+		{
+			BRect r;
+			float angle, span;
+			link.Read<BRect>(&r);
+			link.Read<float>(&angle);
+			if(link.Read<float>(&span)<B_OK)
+				break;
+			if(code==AS_STROKE_ARC)
+				driver->StrokeArc(r,angle,span,ld);
+			else
+				driver->FillArc(r,angle,span,ld);
+			break;
+		}
+		case AS_STROKE_BEZIER:
+		case AS_FILL_BEZIER:
+		{
+			BPoint pts[4];
+			if(link.Read(pts,sizeof(pts))<B_OK)
+				break;
+			if(code==AS_STROKE_BEZIER)
+				driver->StrokeBezier(pts,ld);
+			else
+				driver->FillBezier(pts,ld);
+			break;
+		}
+		case AS_STROKE_ELLIPSE:
+		case AS_FILL_ELLIPSE:
+		{
+			BRect rect;
+			if(link.Read<BRect>(&rect)<B_OK)
+				break;
+			if(code==AS_STROKE_ELLIPSE)
+				driver->StrokeEllipse(rect,ld);
+			else
+				driver->FillEllipse(rect,ld);
+			break;
+		}
+		case AS_STROKE_ROUNDRECT:
+		case AS_FILL_ROUNDRECT:
+		{
+			BRect rect;
+			float xrad, yrad;
+			link.Read<BRect>(&rect);
+			link.Read<float>(&xrad);
+			if(link.Read<float>(&yrad)<B_OK)
+				break;
+			if(code==AS_STROKE_ROUNDRECT)
+				driver->StrokeRoundRect(rect,xrad,yrad,ld);
+			else
+				driver->FillRoundRect(rect,xrad,yrad,ld);
+			break;
+		}
+		case AS_STROKE_TRIANGLE:
+		case AS_FILL_TRIANGLE:
+		{
+			BPoint pts[3];
+			BRect rect;
+			link.Read(pts,sizeof(pts));
+			if(link.Read<BRect>(&rect)<B_OK)
+				break;
+			if(code==AS_STROKE_TRIANGLE)
+				driver->StrokeTriangle(pts,rect,ld);
+			else
+				driver->FillTriangle(pts,rect,ld);
+			break;
+		}
+		case AS_STROKE_POLYGON:
+		case AS_FILL_POLYGON:
+		{
+			BRect polyframe;
+			bool isclosed=true;
+			int32 pointcount;
+
+			link.Read<BRect>(&polyframe);
+			if(code==AS_STROKE_POLYGON)
+				link.Read<bool>(&isclosed);
+			link.Read<int32>(&pointcount);
+			if(!link.CanRead(pointcount,sizeof(BPoint)) || pointcount<1)
+				break;
+
+			BPoint *pointlist=new BPoint[pointcount];
+			link.Read(pointlist,sizeof(BPoint)*pointcount);
+
+			if(code==AS_STROKE_POLYGON)
+				driver->StrokePolygon(pointlist,pointcount,polyframe,ld,isclosed);
+			else
+				driver->FillPolygon(pointlist,pointcount,polyframe,ld);
+
+			delete [] pointlist;
+			break;
+		}
+		case AS_STROKE_SHAPE:
+		case AS_FILL_SHAPE:
+		{
+			BRect shaperect;
+			int32 opcount, ptcount;
+
+			link.Read<BRect>(&shaperect);
+			link.Read<int32>(&opcount);
+			link.Read<int32>(&ptcount);
+			if(!link.CanRead(opcount,sizeof(int32)) || !link.CanRead(ptcount,sizeof(BPoint)))
+				break;
+
+			int32 *oplist=new int32[opcount];
+			BPoint *ptlist=new BPoint[ptcount];
+			link.Read(oplist,sizeof(int32)*opcount);
+
+			if(link.Read(ptlist,sizeof(BPoint)*ptcount)==B_OK)
+			{
+				if(code==AS_STROKE_SHAPE)
+					driver->StrokeShape(shaperect,opcount,oplist,ptcount,ptlist,ld);
+				else
+					driver->FillShape(shaperect,opcount,oplist,ptcount,ptlist,ld);
+			}
+
+			delete [] oplist;
+			delete [] ptlist;
+			break;
+		}
+		case AS_FILL_REGION:
+		{
+			int32 rectcount;
+			link.Read<int32>(&rectcount);
+			if(!link.CanRead(rectcount,sizeof(BRect)))
+				break;
+
+			for(int32 i=0; i<rectcount; i++)
+			{
+				BRect rect;
+				link.Read<BRect>(&rect);
+				driver->FillRect(rect,ld);
+			}
+			break;
+		}
+		case AS_STROKE_LINEARRAY:
+		{
+			int32 linecount;
+			link.Read<int32>(&linecount);
+			if(linecount<1 || !link.CanRead(linecount,sizeof(float)*4+sizeof(rgb_color)))
+				break;
+
+			LineArrayData *linedata=new LineArrayData[linecount];
+			for(int32 i=0; i<linecount; i++)
+			{
+				LineArrayData *index=&linedata[i];
+
+				link.Read<float>(&(index->pt1.x));
+				link.Read<float>(&(index->pt1.y));
+				link.Read<float>(&(index->pt2.x));
+				link.Read<float>(&(index->pt2.y));
+				link.Read<rgb_color>(&(index->color));
+			}
+			driver->StrokeLineArray(linecount,linedata,ld);
+			delete [] linedata;
+			break;
+		}
+		case AS_DRAW_STRING:
+		{
+			int32 length;
+			BPoint location;
+			escapement_delta delta;
+			const char *string;
+
+			link.Read<int32>(&length);
+			link.Read<BPoint>(&location);
+			link.Read<escapement_delta>(&delta);
+			if(link.ReadString(&string)<B_OK)
+				break;
+
+			if(length<0 || length>int32(strlen(string)))
+				length=strlen(string);
+			driver->DrawString(string,length,location,ld);
+			break;
+		}
+		case AS_CREATE_PICTURE:
+		{
+			int32 subcount, subtoken, size;
+
+			// a picture which draws one the session hasn't made isn't made
+			BList pictures;
+			bool found=true;
+			link.Read<int32>(&subcount);
+			for(int32 i=0; i<subcount && link.Read<int32>(&subtoken)==B_OK; i++)
+			{
+				ServerPicture *picture=(ServerPicture*)fPictures.ItemAt(subtoken-1);
+				if(picture)
+					pictures.AddItem(picture);
+				else
+					found=false;
+			}
+
+			link.Read<int32>(&size);
+			if(!link.CanRead(size,1) || size<1)
+				break;
+			char *pictureData=(char*)malloc(size);
+			if(link.Read(pictureData,size)<B_OK || !found)
+			{
+				free(pictureData);
+				break;
+			}
+
+			ServerPicture *picture=new ServerPicture(pictureData,size,&pictures);
+			free(pictureData);
+			if(picture->InitCheck())
+				fPictures.AddItem(picture);
+			else
+				picture->Release();
+			break;
+		}
+		case AS_LAYER_DRAW_PICTURE:
+		{
+			int32 token;
+			BPoint where;
+			link.Read<int32>(&token);
+			if(link.Read<BPoint>(&where)<B_OK)
+				break;
+
+			ServerPicture *picture=(ServerPicture*)fPictures.ItemAt(token-1);
+			if(picture)
+				picture->Draw(driver,where,ld->clipReg,ld);
+			break;
+		}
+		case AS_LAYER_COPY_BITS:
+		{
+			BRect src, dst;
+			link.Read<BRect>(&src);
+			if(link.Read<BRect>(&dst)<B_OK)
+				break;
+
+			// only what the clipping region shows is copied, to where it
+			// shows, and only to a destination of the same size
+			if(src.Width()!=dst.Width() || src.Height()!=dst.Height())
+				break;
+			int32 dx=(int32)(dst.left-src.left);
+			int32 dy=(int32)(dst.top-src.top);
+			BRegion copyReg(src);
+			if(ld->clipReg)
+			{
+				copyReg.IntersectWith(ld->clipReg);
+				copyReg.OffsetBy(dx,dy);
+				copyReg.IntersectWith(ld->clipReg);
+				copyReg.OffsetBy(-dx,-dy);
+			}
+			if(copyReg.CountRects()>0)
+			{
+				BRect frame=copyReg.Frame();
+				driver->CopyRegion(&copyReg,BPoint(frame.left+dx,frame.top+dy));
+			}
+			break;
+		}
+		default:
+			// AS_END_UPDATE and AS_SYNC only mark frames
+			break;
+	}
+}
@@ -0,0 +1,99 @@
+//------------------------------------------------------------------------------
+//	File Name:		SessionPlayer.h
+//	Description:	Records the messages a window sends the server and plays
+//					their drawing back for benchmarking
+//
+//------------------------------------------------------------------------------
+#ifndef	_SESSIONPLAYER_H
+#define	_SESSIONPLAYER_H
+
+#include <stdio.h>
+#include <OS.h>
+#include <List.h>
+#include <LinkMsgReader.h>
+
+class DisplayDriver;
+class LayerData;
+
+//! Environment variable naming the directory in which window sessions are recorded
+#define SESSION_RECORD_VARIABLE		"COSMOE_RECORD_SESSION"
+
+//! Most distinct message codes the player keeps timings for
+#define SESSION_MAX_CODES			64
+
+/*!
+	\class SessionRecorder SessionPlayer.h
+	\brief LinkMsgReader which writes every message it reads to a file
+
+	A session file is just the window's messages one after the other, each with
+	the size, code and flags header it had on the port. It is only meaningful to
+	a server built the same way as the one which recorded it.
+*/
+class SessionRecorder : public LinkMsgReader
+{
+public:
+	SessionRecorder(port_id port, const char *path);
+	virtual ~SessionRecorder(void);
+
+	virtual status_t GetNextMessage(int32 *code, bigtime_t timeout=B_INFINITE_TIMEOUT);
+
+private:
+	FILE *fFile;
+};
+
+typedef struct
+{
+	int32 code;
+	int32 count;
+	bigtime_t time;
+} session_code_stats;
+
+/*!
+	\class SessionPlayer SessionPlayer.h
+	\brief Plays the drawing in a recorded session on a driver and times it
+
+	Drawing and drawing state messages are handled the way ServerWindow does,
+	except that coordinates are used as they are, without a layer to convert
+	them. AS_CREATE_PICTURE is handled as ServerApp does, without a reply, and
+	a session names the pictures it creates by the order it creates them in,
+	from 1. They are deleted each time the session has been played. Everything
+	else is skipped. A frame ends with each AS_END_UPDATE or AS_SYNC; a
+	session without either is one frame.
+*/
+class SessionPlayer
+{
+public:
+	SessionPlayer(void);
+	~SessionPlayer(void);
+
+	status_t SetTo(const char *path);
+	status_t SetTo(const void *data, int32 size);
+
+	int32 CountMessages(void) const { return fMessageCount; }
+	int32 CountFrames(void) const { return fFrameCount; }
+
+	status_t Play(DisplayDriver *driver, LayerData *data);
+
+	void ResetStats(void);
+	void PrintStats(FILE *out) const;
+
+private:
+	void Unset(void);
+	void Dispatch(int32 code, const char *data, int32 size,
+		DisplayDriver *driver, LayerData **state);
+	session_code_stats *StatsFor(int32 code);
+
+	char *fData;
+	int32 fSize;
+	BList fPictures;
+	int32 fMessageCount;
+	int32 fFrameCount;
+
+	session_code_stats fStats[SESSION_MAX_CODES];
+	int32 fStatsCount;
+	int32 fFramesPlayed;
+	int32 fSkipped;
+	bigtime_t fPlayTime;
+};
+
+#endif
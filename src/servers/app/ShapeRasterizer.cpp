@@ -0,0 +1,628 @@
+//------------------------------------------------------------------------------
+//
+//	File Name:		ShapeRasterizer.cpp
+//	Description:	Scanline rasterizers which turn ellipses, arcs, round
+//					rectangles and polygons into clipped spans
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <math.h>
+#include "ShapeRasterizer.h"
+
+// Spans a list has room for when it is first used
+static const int32 kInitialSpans = 256;
+
+// Pixel centers this close to an edge are on it
+static const double kEdgeTolerance = 1e-6;
+
+static inline int32 round_coord(double value)
+{
+	return (int32)floor(value+.5);
+}
+
+SpanList::SpanList(void)
+ :	fSpans(NULL), fCount(0), fSize(0), fClipping(false)
+{
+}
+
+SpanList::~SpanList(void)
+{
+	free(fSpans);
+}
+
+/*!
+	\brief Empties the list for a new shape
+	\param clip Region the spans are cut to, or NULL to keep them whole
+	\param bounds Rectangle the whole shape is in. Rectangles of the region
+	outside it are left out from the start.
+*/
+void SpanList::Reset(BRegion *clip, const BRect &bounds)
+{
+	fCount=0;
+	fClipping=(clip!=NULL);
+	if(clip)
+		fClip.Set(clip,bounds);
+}
+
+//! Empties the list for a new shape which isn't clipped
+void SpanList::Reset(void)
+{
+	fCount=0;
+	fClipping=false;
+}
+
+void SpanList::AddClipped(int32 y, int32 left, int32 right,
+	const uint8 *coverage)
+{
+	// the rectangles of a region don't overlap, so neither do the pieces
+	int32 first, end=fClip.FindRow(y,&first);
+	for(int32 i=first; i<end; i++)
+	{
+		const clipping_rect &rect=fClip.RectAtInt(i);
+		if(y<rect.top || y>rect.bottom || left>rect.right || right<rect.left)
+			continue;
+
+		if(fCount==fSize && !Grow())
+			return;
+
+		shape_span &span=fSpans[fCount++];
+		span.y=y;
+		span.left=left>rect.left ? left : rect.left;
+		span.right=right<rect.right ? right : rect.right;
+		span.coverage=coverage ? coverage+(span.left-left) : NULL;
+	}
+}
+
+bool SpanList::Grow(void)
+{
+	int32 size=fSize ? fSize*2 : kInitialSpans;
+	shape_span *spans=(shape_span*)realloc(fSpans,size*sizeof(shape_span));
+	if(!spans)
+		return false;
+
+	fSpans=spans;
+	fSize=size;
+	return true;
+}
+
+/*
+	An ellipse is a rectangle with elliptical corners as large as they can
+	be, so both are a rounded_shape: a continuous area which has a pixel in
+	it when it has the pixel's center. Its edges go through the centers of
+	the outermost pixels of the rectangle it is made from, moved out by
+	grow, so filling uses half a pixel and outlines half the pen.
+
+	Even pens put the edges of a ring right on pixel centers, where the
+	two shapes would leave a pixel sticking out of the outer one and one
+	missing from the inner one. Centers on the edge are inside a filled
+	shape and outside the two of a ring.
+*/
+struct rounded_shape
+{
+	double left;
+	double top;
+	double right;
+	double bottom;
+	double xrad;
+	double yrad;
+	double tolerance;	// how far outside a center may be and still be in
+
+	int32 FirstRow(void) const { return (int32)ceil(top-tolerance); }
+	int32 LastRow(void) const { return (int32)floor(bottom+tolerance); }
+	bool Row(int32 y, int32 *first, int32 *last) const;
+};
+
+static rounded_shape make_shape(const BRect &r, double xrad, double yrad,
+	double grow, bool ring=false)
+{
+	rounded_shape shape;
+	shape.tolerance=ring ? -kEdgeTolerance : kEdgeTolerance;
+	shape.left=r.left-grow;
+	shape.top=r.top-grow;
+	shape.right=r.right+grow;
+	shape.bottom=r.bottom+grow;
+
+	if(xrad>0 && yrad>0)
+	{
+		xrad+=grow;
+		yrad+=grow;
+	}
+	double halfwidth=(shape.right-shape.left)/2;
+	double halfheight=(shape.bottom-shape.top)/2;
+	shape.xrad=xrad<halfwidth ? xrad : halfwidth;
+	shape.yrad=yrad<halfheight ? yrad : halfheight;
+	if(shape.xrad<=0 || shape.yrad<=0)
+	{
+		shape.xrad=0;
+		shape.yrad=0;
+	}
+	return shape;
+}
+
+static inline rounded_shape ellipse_shape(const BRect &r, double grow)
+{
+	return make_shape(r,(r.right-r.left)/2,(r.bottom-r.top)/2,grow);
+}
+
+/*!
+	\brief Gets the pixels of a row which are in the shape
+	\return false if there are none
+*/
+bool rounded_shape::Row(int32 y, int32 *first, int32 *last) const
+{
+	if(y<top-tolerance || y>bottom+tolerance)
+		return false;
+
+	double inset=0;
+	if(yrad>0)
+	{
+		double d=0;
+		if(y<top+yrad)
+			d=top+yrad-y;
+		else if(y>bottom-yrad)
+			d=y-(bottom-yrad);
+		if(d>0)
+		{
+			double t=d/yrad;
+			inset=xrad*(1-sqrt(t<1 ? 1-t*t : 0));
+		}
+	}
+
+	*first=(int32)ceil(left+inset-tolerance);
+	*last=(int32)floor(right-inset+tolerance);
+	return *first<=*last;
+}
+
+/*
+	The part of the plane between an arc's rays. The rays are worked out
+	with the ellipse made a unit circle, u to the right and v up, where each
+	is a half-plane that is a half-line on any one row.
+*/
+struct arc_wedge
+{
+	double cx;
+	double cy;
+	double rx;
+	double ry;
+	double sx, sy;	// start ray
+	double ex, ey;	// end ray, counterclockwise from the start
+	bool wide;		// more than half the plane
+
+	void Clip(SpanList &spans, int32 y, int32 left, int32 right) const;
+};
+
+/*!
+	\brief Sets up the wedge of an arc
+	\return false if the arc is the whole ellipse
+*/
+static bool make_wedge(arc_wedge *wedge, const BRect &r, float angle, float span)
+{
+	if(span>=360 || span<=-360)
+		return false;
+
+	double start=angle, sweep=span;
+	if(sweep<0)
+	{
+		start+=sweep;
+		sweep=-sweep;
+	}
+
+	double s=start*M_PI/180, e=(start+sweep)*M_PI/180;
+	wedge->sx=cos(s);
+	wedge->sy=sin(s);
+	wedge->ex=cos(e);
+	wedge->ey=sin(e);
+	wedge->wide=(sweep>180);
+
+	wedge->cx=(r.left+r.right)/2;
+	wedge->cy=(r.top+r.bottom)/2;
+	wedge->rx=(r.right-r.left)/2;
+	wedge->ry=(r.bottom-r.top)/2;
+	if(wedge->rx<.5)
+		wedge->rx=.5;
+	if(wedge->ry<.5)
+		wedge->ry=.5;
+	return true;
+}
+
+/*
+	Where a*u+b>=0 on a row, in pixel x: a range of x which is open on one
+	side, everything or nothing.
+*/
+static void half_line(double a, double b, double cx, double rx,
+	double *low, double *high)
+{
+	*low=-HUGE_VAL;
+	*high=HUGE_VAL;
+	if(a>0)
+		*low=cx-b*rx/a;
+	else if(a<0)
+		*high=cx-b*rx/a;
+	else if(b<0)
+		*low=HUGE_VAL;
+}
+
+// Pixels within half a pixel of the rays are in the wedge, so its edges
+// are as solid as lines
+static inline int32 first_pixel(double x, int32 limit)
+{
+	if(x<limit)
+		return limit;
+	return (int32)ceil(x-.5);
+}
+
+static inline int32 last_pixel(double x, int32 limit)
+{
+	if(x>limit)
+		return limit;
+	return (int32)floor(x+.5);
+}
+
+//! Adds what is in the wedge of a span
+void arc_wedge::Clip(SpanList &spans, int32 y, int32 left, int32 right) const
+{
+	double v=(cy-y)/ry;
+	double low1, high1, low2, high2;
+
+	if(!wide)
+	{
+		// counterclockwise of the start ray and clockwise of the end ray
+		half_line(-sy,sx*v,cx,rx,&low1,&high1);
+		half_line(ey,-ex*v,cx,rx,&low2,&high2);
+		double low=low1>low2 ? low1 : low2;
+		double high=high1<high2 ? high1 : high2;
+		if(low>high)
+			return;
+		spans.Add(y,first_pixel(low,left),last_pixel(high,right));
+		return;
+	}
+
+	// everything but the narrow wedge from the end ray to the start ray
+	half_line(-ey,ex*v,cx,rx,&low1,&high1);
+	half_line(sy,-sx*v,cx,rx,&low2,&high2);
+	double low=low1>low2 ? low1 : low2;
+	double high=high1<high2 ? high1 : high2;
+	if(low>high)
+	{
+		spans.Add(y,left,right);
+		return;
+	}
+
+	// the pixels left out are those further than half a pixel inside
+	int32 cutfirst=first_pixel(low+1,left-1);
+	int32 cutlast=last_pixel(high-1,right+1);
+	if(cutfirst>cutlast)
+	{
+		spans.Add(y,left,right);
+		return;
+	}
+	spans.Add(y,left,cutfirst-1 < right ? cutfirst-1 : right);
+	spans.Add(y,cutlast+1 > left ? cutlast+1 : left,right);
+}
+
+static inline void add_span(SpanList &spans, const arc_wedge *wedge, int32 y,
+	int32 left, int32 right)
+{
+	if(wedge)
+		wedge->Clip(spans,y,left,right);
+	else
+		spans.Add(y,left,right);
+}
+
+static void fill_shape(SpanList &spans, const rounded_shape &shape,
+	const arc_wedge *wedge)
+{
+	int32 first, last;
+	for(int32 y=shape.FirstRow(); y<=shape.LastRow(); y++)
+		if(shape.Row(y,&first,&last))
+			add_span(spans,wedge,y,first,last);
+}
+
+/*
+	A one pixel outline is made of the pixels of the filled shape which have
+	a neighbor outside it, to the side, above or below.
+*/
+static void outline_shape(SpanList &spans, const rounded_shape &shape,
+	const arc_wedge *wedge)
+{
+	int32 top=shape.FirstRow(), bottom=shape.LastRow();
+	int32 first, last, upfirst=0, uplast=0, downfirst=0, downlast=0;
+	bool up=false;
+	bool here=shape.Row(top,&first,&last);
+
+	for(int32 y=top; y<=bottom; y++)
+	{
+		bool down=shape.Row(y+1,&downfirst,&downlast);
+		if(here)
+		{
+			int32 innerfirst=first+1, innerlast=last-1;
+			if(up && down)
+			{
+				if(upfirst>innerfirst)
+					innerfirst=upfirst;
+				if(downfirst>innerfirst)
+					innerfirst=downfirst;
+				if(uplast<innerlast)
+					innerlast=uplast;
+				if(downlast<innerlast)
+					innerlast=downlast;
+			}
+
+			if(!up || !down || innerfirst>innerlast)
+				add_span(spans,wedge,y,first,last);
+			else
+			{
+				add_span(spans,wedge,y,first,innerfirst-1);
+				add_span(spans,wedge,y,innerlast+1,last);
+			}
+		}
+
+		up=here;
+		upfirst=first;
+		uplast=last;
+		here=down;
+		first=downfirst;
+		last=downlast;
+	}
+}
+
+//! A pen wider than a pixel draws what is between two shapes
+static void ring_shape(SpanList &spans, const rounded_shape &outer,
+	const rounded_shape &inner, const arc_wedge *wedge)
+{
+	int32 first, last, innerfirst, innerlast;
+	for(int32 y=outer.FirstRow(); y<=outer.LastRow(); y++)
+	{
+		if(!outer.Row(y,&first,&last))
+			continue;
+
+		if(!inner.Row(y,&innerfirst,&innerlast))
+			add_span(spans,wedge,y,first,last);
+		else
+		{
+			add_span(spans,wedge,y,first,innerfirst-1);
+			add_span(spans,wedge,y,innerlast+1,last);
+		}
+	}
+}
+
+static void outline(SpanList &spans, const BRect &r, double xrad, double yrad,
+	float pensize, const arc_wedge *wedge)
+{
+	if(pensize<=1)
+	{
+		outline_shape(spans,make_shape(r,xrad,yrad,.5),wedge);
+		return;
+	}
+
+	ring_shape(spans,make_shape(r,xrad,yrad,pensize/2,true),
+		make_shape(r,xrad,yrad,-pensize/2,true),wedge);
+}
+
+/*!
+	\brief Rasterizes a filled ellipse
+	\param spans The list to add to
+	\param r The rectangle the ellipse fits in, its edges included
+*/
+void rasterize_ellipse(SpanList &spans, const BRect &r)
+{
+	fill_shape(spans,ellipse_shape(r,.5),NULL);
+}
+
+/*!
+	\brief Rasterizes the outline of an ellipse
+	\param spans The list to add to
+	\param r The rectangle the ellipse fits in
+	\param pensize Width of the outline
+*/
+void rasterize_ellipse_outline(SpanList &spans, const BRect &r, float pensize)
+{
+	outline(spans,r,(r.right-r.left)/2,(r.bottom-r.top)/2,pensize,NULL);
+}
+
+/*!
+	\brief Rasterizes a filled arc, the wedge of an ellipse between two rays
+	\param spans The list to add to
+	\param r The rectangle the ellipse fits in
+	\param angle Angle of the first ray
+	\param span Angle from the first ray to the second
+*/
+void rasterize_arc(SpanList &spans, const BRect &r, float angle, float span)
+{
+	arc_wedge wedge;
+	fill_shape(spans,ellipse_shape(r,.5),
+		make_wedge(&wedge,r,angle,span) ? &wedge : NULL);
+}
+
+/*!
+	\brief Rasterizes an arc, the part of an ellipse's outline between two rays
+	\param spans The list to add to
+	\param r The rectangle the ellipse fits in
+	\param angle Angle of the first ray
+	\param span Angle from the first ray to the second
+	\param pensize Width of the arc
+*/
+void rasterize_arc_outline(SpanList &spans, const BRect &r, float angle,
+	float span, float pensize)
+{
+	arc_wedge wedge;
+	outline(spans,r,(r.right-r.left)/2,(r.bottom-r.top)/2,pensize,
+		make_wedge(&wedge,r,angle,span) ? &wedge : NULL);
+}
+
+/*!
+	\brief Rasterizes a filled rectangle with elliptical corners
+	\param spans The list to add to
+	\param r The rectangle, its edges included
+	\param xrad Horizontal radius of the corners
+	\param yrad Vertical radius of the corners
+*/
+void rasterize_round_rect(SpanList &spans, const BRect &r, float xrad,
+	float yrad)
+{
+	fill_shape(spans,make_shape(r,xrad,yrad,.5),NULL);
+}
+
+/*!
+	\brief Rasterizes the outline of a rectangle with elliptical corners
+	\param spans The list to add to
+	\param r The rectangle
+	\param xrad Horizontal radius of the corners
+	\param yrad Vertical radius of the corners
+	\param pensize Width of the outline
+*/
+void rasterize_round_rect_outline(SpanList &spans, const BRect &r, float xrad,
+	float yrad, float pensize)
+{
+	outline(spans,r,xrad,yrad,pensize,NULL);
+}
+
+struct polygon_edge
+{
+	double x0, y0;	// the upper end
+	double x1, y1;
+	double dxdy;
+};
+
+static int compare_edges(const void *a, const void *b)
+{
+	double y0=((const polygon_edge*)a)->y0, y1=((const polygon_edge*)b)->y0;
+	return y0<y1 ? -1 : (y0>y1 ? 1 : 0);
+}
+
+struct row_interval
+{
+	int32 left;
+	int32 right;
+};
+
+/*!
+	\brief Rasterizes a filled polygon
+	\param spans The list to add to
+	\param points Its corners
+	\param count Number of corners
+
+	The inside is found with the even-odd rule at pixel centers. The pixels
+	its edges go through are added to it, so that it covers its outline as a
+	filled rectangle does, and each row's pieces are merged so that no pixel
+	is drawn twice.
+*/
+void rasterize_polygon(SpanList &spans, const BPoint *points, int32 count)
+{
+	if(!points || count<1)
+		return;
+
+	polygon_edge *edges=new polygon_edge[count];
+	row_interval *intervals=new row_interval[count*2+1];
+	double *crossings=new double[count];
+
+	double ymin=points[0].y, ymax=points[0].y;
+	for(int32 i=0; i<count; i++)
+	{
+		const BPoint &a=points[i], &b=points[(i+1)%count];
+		polygon_edge &edge=edges[i];
+		if(a.y<=b.y)
+		{
+			edge.x0=a.x; edge.y0=a.y;
+			edge.x1=b.x; edge.y1=b.y;
+		}
+		else
+		{
+			edge.x0=b.x; edge.y0=b.y;
+			edge.x1=a.x; edge.y1=a.y;
+		}
+		edge.dxdy=(edge.y1>edge.y0) ? (edge.x1-edge.x0)/(edge.y1-edge.y0) : 0;
+
+		if(a.y<ymin)
+			ymin=a.y;
+		if(a.y>ymax)
+			ymax=a.y;
+	}
+	qsort(edges,count,sizeof(polygon_edge),compare_edges);
+
+	int32 top=round_coord(ymin), bottom=round_coord(ymax);
+	for(int32 y=top; y<=bottom; y++)
+	{
+		int32 n=0, crossed=0;
+		for(int32 i=0; i<count; i++)
+		{
+			const polygon_edge &edge=edges[i];
+			if(edge.y0>y+.5)
+				break;
+			if(edge.y1<y-.5)
+				continue;
+
+			// the edge where it goes through the row
+			double xa, xb;
+			if(edge.y1==edge.y0)
+			{
+				xa=edge.x0;
+				xb=edge.x1;
+			}
+			else
+			{
+				double ya=edge.y0>y-.5 ? edge.y0 : y-.5;
+				double yb=edge.y1<y+.5 ? edge.y1 : y+.5;
+				xa=edge.x0+(ya-edge.y0)*edge.dxdy;
+				xb=edge.x0+(yb-edge.y0)*edge.dxdy;
+
+				if(y>=edge.y0 && y<edge.y1)
+					crossings[crossed++]=edge.x0+(y-edge.y0)*edge.dxdy;
+			}
+			if(xa>xb)
+			{
+				double x=xa;
+				xa=xb;
+				xb=x;
+			}
+			intervals[n].left=round_coord(xa);
+			intervals[n].right=round_coord(xb);
+			n++;
+		}
+
+		// sorted crossings pair up into the inside
+		for(int32 i=1; i<crossed; i++)
+		{
+			double x=crossings[i];
+			int32 j=i-1;
+			for(; j>=0 && crossings[j]>x; j--)
+				crossings[j+1]=crossings[j];
+			crossings[j+1]=x;
+		}
+		for(int32 i=0; i+1<crossed; i+=2)
+		{
+			intervals[n].left=round_coord(crossings[i]);
+			intervals[n].right=round_coord(crossings[i+1]);
+			n++;
+		}
+		if(n==0)
+			continue;
+
+		for(int32 i=1; i<n; i++)
+		{
+			row_interval interval=intervals[i];
+			int32 j=i-1;
+			for(; j>=0 && intervals[j].left>interval.left; j--)
+				intervals[j+1]=intervals[j];
+			intervals[j+1]=interval;
+		}
+
+		row_interval current=intervals[0];
+		for(int32 i=1; i<n; i++)
+		{
+			if(intervals[i].left<=current.right+1)
+			{
+				if(intervals[i].right>current.right)
+					current.right=intervals[i].right;
+				continue;
+			}
+			spans.Add(y,current.left,current.right);
+			current=intervals[i];
+		}
+		spans.Add(y,current.left,current.right);
+	}
+
+	delete[] crossings;
+	delete[] intervals;
+	delete[] edges;
+}
@@ -0,0 +1,635 @@
+//------------------------------------------------------------------------------
+//	File Name:		SpanKernels.cpp
+//	Description:	Vectorized span and rectangle primitives used by the
+//					drivers for fills, pattern fills and blits
+//
+//------------------------------------------------------------------------------
+#include <string.h>
+
+#include "SpanKernels.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define SPAN_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+struct span_kernel_table
+{
+	void (*fill)(uint8 *dest, const uint8 *block, size_t bytes);
+	void (*copy)(uint8 *dest, const uint8 *src, size_t bytes);
+	void (*move)(uint8 *dest, const uint8 *src, size_t bytes);
+};
+
+/*!
+	\brief Makes a block twice as long as a fill block, so that the block as
+	seen from any byte of its first half can be loaded in one go
+*/
+static inline void double_block(uint8 *twice, const uint8 *block)
+{
+	memcpy(twice,block,SPAN_BLOCK_SIZE);
+	memcpy(twice+SPAN_BLOCK_SIZE,block,SPAN_BLOCK_SIZE);
+}
+
+//------------------------------------------------------------------------------
+// Scalar kernels. These are what the other levels are checked against.
+
+static void fill_scalar(uint8 *dest, const uint8 *block, size_t bytes)
+{
+	size_t head=(-(size_t)dest) & 7;
+	if(head>bytes)
+		head=bytes;
+
+	for(size_t i=0; i<head; i++)
+		dest[i]=block[i];
+	dest+=head;
+	bytes-=head;
+
+	uint8 twice[SPAN_BLOCK_SIZE*2];
+	double_block(twice,block);
+	const uint8 *phase=twice+head;
+
+	uint64 words[SPAN_BLOCK_SIZE/8];
+	memcpy(words,phase,SPAN_BLOCK_SIZE);
+
+	uint64 *fb=(uint64*)dest;
+	size_t blocks=bytes/SPAN_BLOCK_SIZE;
+	while(blocks--)
+	{
+		fb[0]=words[0];
+		fb[1]=words[1];
+		fb[2]=words[2];
+		fb[3]=words[3];
+		fb+=4;
+	}
+
+	size_t tail=bytes % SPAN_BLOCK_SIZE;
+	size_t i=0;
+	for(; i+8<=tail; i+=8)
+		*fb++=words[i/8];
+	dest=(uint8*)fb;
+	for(size_t j=0; i<tail; i++, j++)
+		dest[j]=phase[i];
+}
+
+static void copy_scalar(uint8 *dest, const uint8 *src, size_t bytes)
+{
+	memcpy(dest,src,bytes);
+}
+
+static void move_scalar(uint8 *dest, const uint8 *src, size_t bytes)
+{
+	memmove(dest,src,bytes);
+}
+
+#ifdef SPAN_KERNELS_X86
+
+//------------------------------------------------------------------------------
+// SSE2 kernels. Stores are aligned to 16 bytes, loads need not be.
+
+__attribute__((target("sse2")))
+static void fill_sse2(uint8 *dest, const uint8 *block, size_t bytes)
+{
+	// Not worth lining up the vectors for
+	if(bytes<SPAN_BLOCK_SIZE*2)
+	{
+		fill_scalar(dest,block,bytes);
+		return;
+	}
+
+	size_t head=(-(size_t)dest) & 15;
+	if(head>bytes)
+		head=bytes;
+
+	for(size_t i=0; i<head; i++)
+		dest[i]=block[i];
+	dest+=head;
+	bytes-=head;
+
+	uint8 twice[SPAN_BLOCK_SIZE*2];
+	double_block(twice,block);
+	const uint8 *phase=twice+head;
+
+	__m128i a=_mm_loadu_si128((const __m128i*)phase);
+	__m128i b=_mm_loadu_si128((const __m128i*)(phase+16));
+
+	size_t blocks=bytes/SPAN_BLOCK_SIZE;
+	while(blocks--)
+	{
+		_mm_store_si128((__m128i*)dest,a);
+		_mm_store_si128((__m128i*)(dest+16),b);
+		dest+=SPAN_BLOCK_SIZE;
+	}
+
+	size_t tail=bytes % SPAN_BLOCK_SIZE;
+	size_t i=0;
+	if(tail>=16)
+	{
+		_mm_store_si128((__m128i*)dest,a);
+		i=16;
+	}
+	for(; i<tail; i++)
+		dest[i]=phase[i];
+}
+
+// The odd bytes are moved rather than copied, so that move_sse2() can use
+// this for going forwards
+__attribute__((target("sse2")))
+static void copy_sse2(uint8 *dest, const uint8 *src, size_t bytes)
+{
+	if(bytes<64)
+	{
+		memmove(dest,src,bytes);
+		return;
+	}
+
+	size_t head=(-(size_t)dest) & 15;
+	memmove(dest,src,head);
+	dest+=head;
+	src+=head;
+	bytes-=head;
+
+	for(; bytes>=64; bytes-=64)
+	{
+		__m128i a=_mm_loadu_si128((const __m128i*)src);
+		__m128i b=_mm_loadu_si128((const __m128i*)(src+16));
+		__m128i c=_mm_loadu_si128((const __m128i*)(src+32));
+		__m128i d=_mm_loadu_si128((const __m128i*)(src+48));
+		_mm_store_si128((__m128i*)dest,a);
+		_mm_store_si128((__m128i*)(dest+16),b);
+		_mm_store_si128((__m128i*)(dest+32),c);
+		_mm_store_si128((__m128i*)(dest+48),d);
+		src+=64;
+		dest+=64;
+	}
+	for(; bytes>=16; bytes-=16)
+	{
+		_mm_store_si128((__m128i*)dest,_mm_loadu_si128((const __m128i*)src));
+		src+=16;
+		dest+=16;
+	}
+	memmove(dest,src,bytes);
+}
+
+__attribute__((target("sse2")))
+static void move_sse2(uint8 *dest, const uint8 *src, size_t bytes)
+{
+	// Going forwards is safe unless the source starts before the destination
+	// and runs into it. Each group of vectors is loaded before it is stored.
+	if(dest<=src || dest>=src+bytes)
+	{
+		copy_sse2(dest,src,bytes);
+		return;
+	}
+
+	// Backwards, from the last byte
+	uint8 *dend=dest+bytes;
+	const uint8 *send=src+bytes;
+	size_t tail=(size_t)dend & 15;
+	if(tail>bytes)
+		tail=bytes;
+	while(tail--)
+		*--dend=*--send;
+
+	bytes=dend-dest;
+	for(; bytes>=64; bytes-=64)
+	{
+		send-=64;
+		dend-=64;
+		__m128i a=_mm_loadu_si128((const __m128i*)send);
+		__m128i b=_mm_loadu_si128((const __m128i*)(send+16));
+		__m128i c=_mm_loadu_si128((const __m128i*)(send+32));
+		__m128i d=_mm_loadu_si128((const __m128i*)(send+48));
+		_mm_store_si128((__m128i*)(dend+48),d);
+		_mm_store_si128((__m128i*)(dend+32),c);
+		_mm_store_si128((__m128i*)(dend+16),b);
+		_mm_store_si128((__m128i*)dend,a);
+	}
+	for(; bytes>=16; bytes-=16)
+	{
+		send-=16;
+		dend-=16;
+		_mm_store_si128((__m128i*)dend,_mm_loadu_si128((const __m128i*)send));
+	}
+	while(bytes--)
+		*--dend=*--send;
+}
+
+//------------------------------------------------------------------------------
+// AVX2 kernels. Stores are aligned to 32 bytes, loads need not be.
+
+__attribute__((target("avx2")))
+static void fill_avx2(uint8 *dest, const uint8 *block, size_t bytes)
+{
+	// Not worth lining up the vectors for
+	if(bytes<SPAN_BLOCK_SIZE*2)
+	{
+		fill_scalar(dest,block,bytes);
+		return;
+	}
+
+	size_t head=(-(size_t)dest) & 31;
+	if(head>bytes)
+		head=bytes;
+
+	for(size_t i=0; i<head; i++)
+		dest[i]=block[i];
+	dest+=head;
+	bytes-=head;
+
+	uint8 twice[SPAN_BLOCK_SIZE*2];
+	double_block(twice,block);
+	const uint8 *phase=twice+head;
+
+	__m256i v=_mm256_loadu_si256((const __m256i*)phase);
+
+	for(; bytes>=128; bytes-=128)
+	{
+		_mm256_store_si256((__m256i*)dest,v);
+		_mm256_store_si256((__m256i*)(dest+32),v);
+		_mm256_store_si256((__m256i*)(dest+64),v);
+		_mm256_store_si256((__m256i*)(dest+96),v);
+		dest+=128;
+	}
+	for(; bytes>=32; bytes-=32)
+	{
+		_mm256_store_si256((__m256i*)dest,v);
+		dest+=32;
+	}
+
+	size_t i=0;
+	if(bytes>=16)
+	{
+		_mm_store_si128((__m128i*)dest,_mm256_castsi256_si128(v));
+		i=16;
+	}
+	for(; i<bytes; i++)
+		dest[i]=phase[i];
+
+	_mm256_zeroupper();
+}
+
+__attribute__((target("avx2")))
+static void copy_avx2(uint8 *dest, const uint8 *src, size_t bytes)
+{
+	if(bytes<128)
+	{
+		memmove(dest,src,bytes);
+		return;
+	}
+
+	size_t head=(-(size_t)dest) & 31;
+	memmove(dest,src,head);
+	dest+=head;
+	src+=head;
+	bytes-=head;
+
+	for(; bytes>=128; bytes-=128)
+	{
+		__m256i a=_mm256_loadu_si256((const __m256i*)src);
+		__m256i b=_mm256_loadu_si256((const __m256i*)(src+32));
+		__m256i c=_mm256_loadu_si256((const __m256i*)(src+64));
+		__m256i d=_mm256_loadu_si256((const __m256i*)(src+96));
+		_mm256_store_si256((__m256i*)dest,a);
+		_mm256_store_si256((__m256i*)(dest+32),b);
+		_mm256_store_si256((__m256i*)(dest+64),c);
+		_mm256_store_si256((__m256i*)(dest+96),d);
+		src+=128;
+		dest+=128;
+	}
+	for(; bytes>=32; bytes-=32)
+	{
+		_mm256_store_si256((__m256i*)dest,_mm256_loadu_si256((const __m256i*)src));
+		src+=32;
+		dest+=32;
+	}
+	_mm256_zeroupper();
+	memmove(dest,src,bytes);
+}
+
+__attribute__((target("avx2")))
+static void move_avx2(uint8 *dest, const uint8 *src, size_t bytes)
+{
+	if(dest<=src || dest>=src+bytes)
+	{
+		copy_avx2(dest,src,bytes);
+		return;
+	}
+
+	uint8 *dend=dest+bytes;
+	const uint8 *send=src+bytes;
+	size_t tail=(size_t)dend & 31;
+	if(tail>bytes)
+		tail=bytes;
+	while(tail--)
+		*--dend=*--send;
+
+	bytes=dend-dest;
+	for(; bytes>=128; bytes-=128)
+	{
+		send-=128;
+		dend-=128;
+		__m256i a=_mm256_loadu_si256((const __m256i*)send);
+		__m256i b=_mm256_loadu_si256((const __m256i*)(send+32));
+		__m256i c=_mm256_loadu_si256((const __m256i*)(send+64));
+		__m256i d=_mm256_loadu_si256((const __m256i*)(send+96));
+		_mm256_store_si256((__m256i*)(dend+96),d);
+		_mm256_store_si256((__m256i*)(dend+64),c);
+		_mm256_store_si256((__m256i*)(dend+32),b);
+		_mm256_store_si256((__m256i*)dend,a);
+	}
+	for(; bytes>=32; bytes-=32)
+	{
+		send-=32;
+		dend-=32;
+		_mm256_store_si256((__m256i*)dend,_mm256_loadu_si256((const __m256i*)send));
+	}
+	_mm256_zeroupper();
+	while(bytes--)
+		*--dend=*--send;
+}
+
+#endif	// SPAN_KERNELS_X86
+
+static const span_kernel_table scalar_kernels=
+	{ fill_scalar, copy_scalar, move_scalar };
+#ifdef SPAN_KERNELS_X86
+static const span_kernel_table sse2_kernels=
+	{ fill_sse2, copy_sse2, move_sse2 };
+static const span_kernel_table avx2_kernels=
+	{ fill_avx2, copy_avx2, move_avx2 };
+#endif
+
+static const span_kernel_table *kernels=NULL;
+static span_kernel_level kernel_level=SPAN_KERNEL_SCALAR;
+
+static inline const span_kernel_table *get_kernels(void)
+{
+	if(!kernels)
+		span_set_kernel_level(span_best_kernel_level());
+	return kernels;
+}
+
+//! Returns the level the kernels are run with
+span_kernel_level span_get_kernel_level(void)
+{
+	get_kernels();
+	return kernel_level;
+}
+
+//! Returns the best level this CPU can run the kernels with
+span_kernel_level span_best_kernel_level(void)
+{
+#ifdef SPAN_KERNELS_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return SPAN_KERNEL_AVX2;
+	if(__builtin_cpu_supports("sse2"))
+		return SPAN_KERNEL_SSE2;
+#endif
+	return SPAN_KERNEL_SCALAR;
+}
+
+/*!
+	\brief Sets the instruction set the kernels are run with
+	\param level The level to use
+	\return false if the CPU can't run the kernels at that level
+
+	This is mostly for comparing the levels against each other.
+*/
+bool span_set_kernel_level(span_kernel_level level)
+{
+	if(level>span_best_kernel_level())
+		return false;
+
+	switch(level)
+	{
+#ifdef SPAN_KERNELS_X86
+		case SPAN_KERNEL_AVX2:
+			kernels=&avx2_kernels;
+			break;
+		case SPAN_KERNEL_SSE2:
+			kernels=&sse2_kernels;
+			break;
+#endif
+		default:
+			kernels=&scalar_kernels;
+			break;
+	}
+	kernel_level=level;
+	return true;
+}
+
+//! Returns a printable name for a kernel level
+const char *span_kernel_level_name(span_kernel_level level)
+{
+	switch(level)
+	{
+		case SPAN_KERNEL_AVX2:
+			return "avx2";
+		case SPAN_KERNEL_SSE2:
+			return "sse2";
+		default:
+			return "scalar";
+	}
+}
+
+/*!
+	\brief Returns the number of bytes a pixel takes
+	\param bitsperpixel Depth as ServerBitmap::BitsPerPixel() gives it
+	\return 1, 2 or 4, or 0 for depths the kernels don't handle
+
+	24-bit targets are handled as 32-bit ones, as the drivers always have.
+*/
+int32 span_pixel_size(int32 bitsperpixel)
+{
+	switch(bitsperpixel)
+	{
+		case 8:
+			return 1;
+		case 15:
+		case 16:
+			return 2;
+		case 24:
+		case 32:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+static inline void put_pixel(uint8 *dest, uint32 pixel, int32 pixelsize)
+{
+	switch(pixelsize)
+	{
+		case 1:
+			*dest=(uint8)pixel;
+			break;
+		case 2:
+		{
+			uint16 value=(uint16)pixel;
+			memcpy(dest,&value,2);
+			break;
+		}
+		default:
+			memcpy(dest,&pixel,4);
+			break;
+	}
+}
+
+/*!
+	\brief Fills a block with one pixel value
+	\param block SPAN_BLOCK_SIZE bytes
+	\param pixel The pixel as stored in the frame buffer
+	\param pixelsize Bytes per pixel
+*/
+void span_make_block(uint8 *block, uint32 pixel, int32 pixelsize)
+{
+	for(int32 i=0; i<SPAN_BLOCK_SIZE; i+=pixelsize)
+		put_pixel(block+i,pixel,pixelsize);
+}
+
+/*!
+	\brief Fills a block with a row of an 8x8 pattern
+	\param block SPAN_BLOCK_SIZE bytes
+	\param patternrow The pattern's row, high bit first
+	\param phase Pattern column of the first pixel
+	\param high Pixel value for set bits
+	\param low Pixel value for clear bits
+	\param pixelsize Bytes per pixel
+*/
+void span_make_pattern_block(uint8 *block, uint8 patternrow, int32 phase,
+	uint32 high, uint32 low, int32 pixelsize)
+{
+	for(int32 i=0, x=phase; i<SPAN_BLOCK_SIZE; i+=pixelsize, x++)
+		put_pixel(block+i,(patternrow & (0x80 >> (x & 7))) ? high : low,pixelsize);
+}
+
+/*!
+	\brief Writes a block over and over
+	\param dest First byte of the span
+	\param block SPAN_BLOCK_SIZE bytes. The span's first byte gets the first.
+	\param bytes Length of the span
+*/
+void span_fill(uint8 *dest, const uint8 *block, size_t bytes)
+{
+	get_kernels()->fill(dest,block,bytes);
+}
+
+//! Copies a span which doesn't overlap its source
+void span_copy(uint8 *dest, const uint8 *src, size_t bytes)
+{
+	get_kernels()->copy(dest,src,bytes);
+}
+
+//! Copies a span which may overlap its source
+void span_move(uint8 *dest, const uint8 *src, size_t bytes)
+{
+	get_kernels()->move(dest,src,bytes);
+}
+
+/*!
+	\brief Fills a rectangle with a color
+	\param dest Top left pixel of the rectangle
+	\param bpr Bytes per row of the buffer
+	\param width Width in pixels
+	\param height Height in pixels
+	\param pixel The pixel as stored in the frame buffer
+	\param pixelsize Bytes per pixel
+*/
+void rect_fill(uint8 *dest, int32 bpr, int32 width, int32 height,
+	uint32 pixel, int32 pixelsize)
+{
+	if(width<=0 || height<=0)
+		return;
+
+	uint8 block[SPAN_BLOCK_SIZE];
+	span_make_block(block,pixel,pixelsize);
+
+	const span_kernel_table *table=get_kernels();
+	size_t bytes=width*pixelsize;
+	for(int32 y=0; y<height; y++, dest+=bpr)
+		table->fill(dest,block,bytes);
+}
+
+/*!
+	\brief Fills a rectangle with an 8x8 pattern
+	\param dest Top left pixel of the rectangle
+	\param bpr Bytes per row of the buffer
+	\param width Width in pixels
+	\param height Height in pixels
+	\param pattern The pattern's eight rows, high bit first
+	\param x Buffer coordinate of the rectangle's left edge
+	\param y Buffer coordinate of the rectangle's top edge
+	\param high Pixel value for set bits
+	\param low Pixel value for clear bits
+	\param pixelsize Bytes per pixel
+
+	The pattern is aligned to the buffer, not to the rectangle.
+*/
+void rect_fill_pattern(uint8 *dest, int32 bpr, int32 width, int32 height,
+	const uint8 *pattern, int32 x, int32 y, uint32 high, uint32 low,
+	int32 pixelsize)
+{
+	if(width<=0 || height<=0)
+		return;
+
+	// The rectangle has at most eight different rows
+	uint8 blocks[8][SPAN_BLOCK_SIZE];
+	int32 rows=(height<8) ? height : 8;
+	for(int32 i=0; i<rows; i++)
+		span_make_pattern_block(blocks[i],pattern[(y+i) & 7],x & 7,high,low,pixelsize);
+
+	const span_kernel_table *table=get_kernels();
+	size_t bytes=width*pixelsize;
+	for(int32 i=0; i<height; i++, dest+=bpr)
+		table->fill(dest,blocks[i & 7],bytes);
+}
+
+/*!
+	\brief Copies a rectangle between buffers which don't overlap
+	\param dest Top left pixel of the destination
+	\param destbpr Bytes per row of the destination
+	\param src Top left pixel of the source
+	\param srcbpr Bytes per row of the source
+	\param bytes Bytes per row to copy
+	\param rows Rows to copy
+*/
+void rect_copy(uint8 *dest, int32 destbpr, const uint8 *src, int32 srcbpr,
+	size_t bytes, int32 rows)
+{
+	const span_kernel_table *table=get_kernels();
+	for(int32 i=0; i<rows; i++, dest+=destbpr, src+=srcbpr)
+		table->copy(dest,src,bytes);
+}
+
+/*!
+	\brief Moves a rectangle within one buffer
+	\param dest Top left pixel of the destination
+	\param src Top left pixel of the source
+	\param bpr Bytes per row of the buffer
+	\param bytes Bytes per row to move
+	\param rows Rows to move
+
+	The rectangles may overlap. Rows are moved bottom up if the destination
+	comes after the source, so no row is overwritten before it is moved.
+*/
+void rect_move(uint8 *dest, const uint8 *src, int32 bpr, size_t bytes,
+	int32 rows)
+{
+	if(rows<=0)
+		return;
+
+	const span_kernel_table *table=get_kernels();
+	if(dest>src)
+	{
+		dest+=(rows-1)*bpr;
+		src+=(rows-1)*bpr;
+		for(int32 i=0; i<rows; i++, dest-=bpr, src-=bpr)
+			table->move(dest,src,bytes);
+	}
+	else
+	{
+		for(int32 i=0; i<rows; i++, dest+=bpr, src+=bpr)
+			table->move(dest,src,bytes);
+	}
+}
@@ -0,0 +1,227 @@
+//------------------------------------------------------------------------------
+//	File Name:		TileRasterizer.cpp
+//	Description:	Worker threads which rasterize the bands of a large
+//					rectangle in parallel
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <Locker.h>
+#include "TileRasterizer.h"
+
+// The rasterizer all drivers share and how many of them use it
+static TileRasterizer *sRasterizer=NULL;
+static int32 sRasterizerUsers=0;
+static BLocker sRasterizerLock("rasterizer users");
+
+/*!
+	\brief Starts the worker threads
+	\param threads How many threads to draw with, counting the caller. 0 picks
+	the number with DefaultThreadCount().
+*/
+TileRasterizer::TileRasterizer(int32 threads)
+{
+	fWorkerCount=0;
+	fQuitting=false;
+	fBusy=0;
+	fFunc=NULL;
+	fCookie=NULL;
+	fRows=0;
+	fBandRows=0;
+	fBandCount=0;
+	fNextBand=0;
+
+	fStartSem=create_sem(0,"rasterizer start");
+	fDoneSem=create_sem(0,"rasterizer done");
+
+	SetThreadCount(threads);
+}
+
+//! Stops the worker threads
+TileRasterizer::~TileRasterizer(void)
+{
+	StopWorkers();
+	delete_sem(fStartSem);
+	delete_sem(fDoneSem);
+}
+
+/*!
+	\brief Returns the server's rasterizer, starting it for the first driver
+	
+	Each call must be matched by one to Release().
+*/
+TileRasterizer *TileRasterizer::Acquire(void)
+{
+	sRasterizerLock.Lock();
+	if(!sRasterizer)
+		sRasterizer=new TileRasterizer();
+	sRasterizerUsers++;
+	TileRasterizer *tiles=sRasterizer;
+	sRasterizerLock.Unlock();
+
+	return tiles;
+}
+
+//! Stops the server's rasterizer once no driver uses it anymore
+void TileRasterizer::Release(void)
+{
+	sRasterizerLock.Lock();
+	if(sRasterizerUsers>0 && --sRasterizerUsers==0)
+	{
+		delete sRasterizer;
+		sRasterizer=NULL;
+	}
+	sRasterizerLock.Unlock();
+}
+
+/*!
+	\brief Returns how many threads a rasterizer draws with by default
+	
+	This is the number of CPUs, unless TILE_THREADS_VARIABLE says otherwise.
+*/
+int32 TileRasterizer::DefaultThreadCount(void)
+{
+	int32 threads;
+	const char *setting=getenv(TILE_THREADS_VARIABLE);
+	if(setting && *setting)
+		threads=atol(setting);
+	else
+	{
+		system_info info;
+		threads=(get_system_info(&info)==B_OK) ? info.cpu_count : 1;
+	}
+
+	if(threads<1)
+		threads=1;
+	if(threads>TILE_MAX_THREADS)
+		threads=TILE_MAX_THREADS;
+	return threads;
+}
+
+/*!
+	\brief Changes the number of threads which draw
+	\param threads How many threads to draw with, counting the caller. 0 picks
+	the number with DefaultThreadCount().
+
+	The worker threads are all stopped and as many started as are needed,
+	once the job being drawn, if any, is done.
+*/
+void TileRasterizer::SetThreadCount(int32 threads)
+{
+	while(atomic_or(&fBusy,1))
+		snooze(1000);
+
+	StopWorkers();
+
+	if(threads<=0)
+		threads=DefaultThreadCount();
+	if(threads>TILE_MAX_THREADS)
+		threads=TILE_MAX_THREADS;
+
+	if(fStartSem>=B_OK && fDoneSem>=B_OK)
+	{
+		for(int32 i=0; i<threads-1; i++)
+		{
+			thread_id thread=spawn_thread(WorkerThread,"rasterizer",B_DISPLAY_PRIORITY,this);
+			if(thread<B_OK)
+				break;
+			fWorkers[fWorkerCount++]=thread;
+			resume_thread(thread);
+		}
+	}
+
+	atomic_and(&fBusy,0);
+}
+
+void TileRasterizer::StopWorkers(void)
+{
+	if(fWorkerCount==0)
+		return;
+
+	fQuitting=true;
+	release_sem_etc(fStartSem,fWorkerCount,0);
+
+	status_t result;
+	for(int32 i=0; i<fWorkerCount; i++)
+		wait_for_thread(fWorkers[i],&result);
+
+	fWorkerCount=0;
+	fQuitting=false;
+}
+
+/*!
+	\brief Draws a job with all the threads
+	\param func The function which draws some of the job's rows
+	\param cookie The job, which is passed on to func
+	\param rows Number of rows in the job
+	\param width Number of pixels in each row
+
+	Jobs too small to be worth waking the other threads for are drawn on the
+	calling thread with a single call to func, as are those of a driver which
+	finds the threads busy with another driver's job.
+*/
+void TileRasterizer::Run(tile_func func, void *cookie, int32 rows, int32 width)
+{
+	if(!func || rows<=0 || width<=0)
+		return;
+
+	if(fWorkerCount==0 || rows<TILE_MIN_ROWS*2 || rows*width<TILE_MIN_PIXELS
+		|| atomic_or(&fBusy,1))
+	{
+		func(cookie,0,rows);
+		return;
+	}
+
+	// A few bands a thread even out rows which take longer than others
+	int32 threads=fWorkerCount+1;
+	int32 bandrows=(rows+threads*4-1)/(threads*4);
+	if(bandrows<TILE_MIN_ROWS)
+		bandrows=TILE_MIN_ROWS;
+
+	fFunc=func;
+	fCookie=cookie;
+	fRows=rows;
+	fBandRows=bandrows;
+	fBandCount=(rows+bandrows-1)/bandrows;
+	fNextBand=0;
+
+	int32 helpers=(fBandCount-1<fWorkerCount) ? fBandCount-1 : fWorkerCount;
+	if(helpers>0)
+		release_sem_etc(fStartSem,helpers,0);
+
+	DoBands();
+
+	if(helpers>0)
+		acquire_sem_etc(fDoneSem,helpers,0,0);
+
+	atomic_and(&fBusy,0);
+}
+
+//! Draws bands until there are none left
+void TileRasterizer::DoBands(void)
+{
+	for(;;)
+	{
+		int32 band=atomic_add(&fNextBand,1);
+		if(band>=fBandCount)
+			break;
+
+		int32 first=band*fBandRows;
+		int32 count=(fRows-first<fBandRows) ? fRows-first : fBandRows;
+		fFunc(fCookie,first,count);
+	}
+}
+
+int32 TileRasterizer::WorkerThread(void *data)
+{
+	TileRasterizer *tiles=(TileRasterizer*)data;
+
+	for(;;)
+	{
+		if(acquire_sem(tiles->fStartSem)!=B_OK || tiles->fQuitting)
+			break;
+
+		tiles->DoBands();
+		release_sem(tiles->fDoneSem);
+	}
+	return 0;
+}
@@ -36,6 +36,7 @@
 #include "DisplayDriver.h"
 #include "Desktop.h"
 #include "WinBorder.h"
+#include "BackingStore.h"
 #include "AppServer.h"	// for new_decorator()
 #include "TokenHandler.h"
 #include "Globals.h"
@@ -91,6 +92,7 @@ WinBorder::WinBorder(const BRect &r, const char *name, const int32 look, const i
 	fMainWinBorder	= NULL;
 	fDecorator		= NULL;
 	fTopLayer		= NULL;
+	fBackingStore	= NULL;
 	fAdFlags		= fAdFlags | B_LAYER_CHILDREN_DEPENDANT;
 	fFlags			= B_WILL_DRAW | B_FULL_UPDATE_ON_RESIZE;
 
@@ -106,6 +108,9 @@ WinBorder::WinBorder(const BRect &r, const char *name, const int32 look, const i
 	if (feel!= B_NO_BORDER_WINDOW_LOOK)
 		fDecorator = new_decorator(r, name, look, feel, flags, fDriver);
 
+	if (BackingStore::IsEnabled())
+		fBackingStore = new BackingStore(fDriver);
+
 	STRACE(("WinBorder %s:\n",GetName()));
 	STRACE(("\tFrame: (%.1f,%.1f,%.1f,%.1f)\n",r.left,r.top,r.right,r.bottom));
 	STRACE(("\tWindow %s\n",win?win->Title():"NULL"));
@@ -124,6 +129,8 @@ WinBorder::~WinBorder(void)
 		delete fDecorator;
 		fDecorator = NULL;
 	}
+
+	delete fBackingStore;
 }
 
 //! Rebuilds the WinBorder's "fully-visible" region based on info from the decorator
@@ -131,6 +138,7 @@ void WinBorder::RebuildFullRegion(void)
 {
 	STRACE(("WinBorder(%s)::RebuildFullRegion()\n",GetName()));
 
+	MarkRegionsDirty();
 	fFull.MakeEmpty();
 
 	// Winborder holds Decorator's full regions. if any...
@@ -378,6 +386,10 @@ void WinBorder::ResizeBy(float x, float y)
 	if(fDecorator)
 		fDecorator->ResizeBy(x,y);
 
+	// what was saved doesn't fit the new size
+	if(fBackingStore)
+		fBackingStore->Discard();
+
 	Layer::ResizeBy(x,y);
 }
 
@@ -36,6 +36,7 @@ class ServerWindow;
 class Decorator;
 class DisplayDriver;
 class Desktop;
+class BackingStore;
 
 class PointerEvent
 {
@@ -105,6 +106,7 @@ protected:
 
 	Decorator *fDecorator;
 	Layer *fTopLayer;
+	BackingStore *fBackingStore;
 
 	int32 fMouseButtons;
 	int32 fKeyModifiers;
@@ -0,0 +1,330 @@
+//------------------------------------------------------------------------------
+//	File Name:		HeadlessDriver.cpp
+//	Description:	Display driver which renders into memory only, for
+//					benchmarking and testing on machines without a display
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SupportDefs.h>
+
+#include "headlessdriver.h"
+#include "HeadlessInjector.h"
+#include "PNGDump.h"
+#include "ServerBitmap.h"
+
+#include <PortLink.h>
+#include <ServerProtocol.h>
+
+//#define DEBUG_HEADLESS_DRIVER
+
+#ifdef DEBUG_HEADLESS_DRIVER
+	#define STRACE(a) printf a
+#else
+	#define STRACE(a) /* nothing */
+#endif
+
+/*!
+	\brief Sets up internal variables needed by the HeadlessDriver
+	\param width Width of the framebuffer in pixels
+	\param height Height of the framebuffer in pixels
+	\param space Color space of the framebuffer
+*/
+HeadlessDriver::HeadlessDriver(int32 width, int32 height, color_space space)
+ : BitmapDriver()
+{
+	STRACE(("HeadlessDriver::HeadlessDriver(%ld,%ld,%d)\n",width,height,space));
+
+	fWidth=width;
+	fHeight=height;
+	fSpace=space;
+	fFramebuffer=NULL;
+	fUpdateCount=0;
+	fUpdatedPixels=0;
+	fControlPort=-1;
+	fControlThread=-1;
+}
+
+HeadlessDriver::~HeadlessDriver()
+{
+	STRACE(("HeadlessDriver::~HeadlessDriver\n"));
+	Shutdown();
+}
+
+/*!
+	\brief Allocates the framebuffer and starts listening for control requests
+	\return true if successful, false if not
+*/
+bool HeadlessDriver::Initialize(void)
+{
+	STRACE(("HeadlessDriver::Initialize\n"));
+
+	if(fWidth<1 || fHeight<1)
+		return false;
+
+	fFramebuffer=new UtilityBitmap(BRect(0,0,fWidth-1,fHeight-1),fSpace,0);
+	if(!fFramebuffer->Bits())
+	{
+		delete fFramebuffer;
+		fFramebuffer=NULL;
+		return false;
+	}
+	memset(fFramebuffer->Bits(),0,fFramebuffer->BitsLength());
+	SetTarget(fFramebuffer);
+
+	// Nothing else owns the control port, so a second headless server is
+	// caught here instead of answering the first one's requests
+	if(find_port(HEADLESS_CONTROL_PORT_NAME)>=B_OK)
+		return false;
+
+	fControlPort=create_port(20,HEADLESS_CONTROL_PORT_NAME);
+	if(fControlPort<B_OK)
+		return false;
+
+	fControlThread=spawn_thread(ControlThread,"headless control",B_NORMAL_PRIORITY,this);
+	if(fControlThread<B_OK)
+		return false;
+	resume_thread(fControlThread);
+
+	return true;
+}
+
+/*!
+	\brief Stops the control thread and frees the framebuffer
+
+	It is safe to call this more than once and after a failed Initialize().
+*/
+void HeadlessDriver::Shutdown(void)
+{
+	STRACE(("HeadlessDriver::Shutdown\n"));
+
+	if(fControlThread>=B_OK)
+	{
+		BPortLink link(fControlPort);
+		link.StartMessage(HEADLESS_STOP);
+		link.Flush();
+
+		status_t result;
+		wait_for_thread(fControlThread,&result);
+		fControlThread=-1;
+	}
+
+	if(fControlPort>=B_OK)
+	{
+		delete_port(fControlPort);
+		fControlPort=-1;
+	}
+
+	if(fFramebuffer)
+	{
+		SetTarget(NULL);
+		delete fFramebuffer;
+		fFramebuffer=NULL;
+	}
+}
+
+/*!
+	\brief Saves the framebuffer as a 32-bit PNG
+	\param path Name of the file to write
+	\return true if the framebuffer could be read, false if not
+
+	Framebuffers which are not 32-bit are converted a pixel at a time, which is
+	slow but only done when a frame is dumped.
+*/
+bool HeadlessDriver::DumpToFile(const char *path)
+{
+	if(!path)
+		return false;
+
+	Lock();
+	if(!fTarget)
+	{
+		Unlock();
+		return false;
+	}
+
+	// SaveToPNG takes the bounds as a width and height
+	BRect bounds(0,0,fWidth,fHeight);
+
+	if(fSpace==B_RGB32 || fSpace==B_RGBA32)
+	{
+		SaveToPNG(path,bounds,fSpace,fTarget->Bits(),fTarget->BitsLength(),
+				fTarget->BytesPerRow());
+		Unlock();
+		return true;
+	}
+
+	int32 bpr=fWidth*4;
+	uint8 *bits=new uint8[bpr*fHeight];
+	for(int32 y=0; y<fHeight; y++)
+	{
+		uint8 *pixel=bits+y*bpr;
+		for(int32 x=0; x<fWidth; x++, pixel+=4)
+		{
+			rgb_color c=fPixelRenderer->GetPixel(IPoint(x,y)).GetColor32();
+			pixel[0]=c.blue;
+			pixel[1]=c.green;
+			pixel[2]=c.red;
+			pixel[3]=255;
+		}
+	}
+	Unlock();
+
+	SaveToPNG(path,bounds,B_RGBA32,bits,bpr*fHeight,bpr);
+	delete [] bits;
+	return true;
+}
+
+/*!
+	\brief Returns a copy of the framebuffer
+	\return A new UtilityBitmap, which belongs to the caller, or NULL
+*/
+ServerBitmap *HeadlessDriver::DumpToBitmap(void)
+{
+	Lock();
+	ServerBitmap *bitmap=fTarget ? new UtilityBitmap(fTarget) : NULL;
+	Unlock();
+	return bitmap;
+}
+
+/*!
+	\brief Parses a mode string of the form WIDTHxHEIGHT[xDEPTH]
+	\param string The string to parse, such as "1024x768x16"
+	\param width Receives the width
+	\param height Receives the height
+	\param space Receives the color space for the depth, B_RGB32 if none is given
+	\return true if the string names a mode the driver can use, false if not
+
+	An empty string or "1" asks for the default 800x600x32 mode.
+*/
+bool HeadlessDriver::ParseMode(const char *string, int32 *width, int32 *height,
+	color_space *space)
+{
+	if(!string || !width || !height || !space)
+		return false;
+
+	*width=800;
+	*height=600;
+	*space=B_RGB32;
+
+	if(*string=='\0' || strcmp(string,"1")==0)
+		return true;
+
+	int w=0, h=0, depth=32;
+	int count=sscanf(string,"%dx%dx%d",&w,&h,&depth);
+	if(count<2 || w<1 || h<1 || w>16384 || h>16384)
+		return false;
+
+	switch(depth)
+	{
+		case 32:
+			*space=B_RGB32;
+			break;
+		case 16:
+			*space=B_RGB16;
+			break;
+		case 15:
+			*space=B_RGB15;
+			break;
+		case 8:
+			*space=B_CMAP8;
+			break;
+		default:
+			return false;
+	}
+
+	*width=w;
+	*height=h;
+	return true;
+}
+
+/*!
+	\brief Counts the update in place of putting it on a screen
+	\param r The BRect rectangle which was drawn to
+*/
+void HeadlessDriver::Invalidate(const BRect &r)
+{
+	if(!fTarget)
+		return;
+
+	BRect damage=r & fTarget->Bounds();
+	if(!damage.IsValid())
+		return;
+
+	Lock();
+	fUpdateCount++;
+	fUpdatedPixels+=int64(damage.IntegerWidth()+1)*(damage.IntegerHeight()+1);
+	Unlock();
+}
+
+/*!
+	\brief Answers the requests defined in HeadlessInjector.h
+	\param data The driver the thread belongs to
+	\return Throwaway value - always 0
+*/
+int32 HeadlessDriver::ControlThread(void *data)
+{
+	HeadlessDriver *driver=(HeadlessDriver*)data;
+	BPortLink link(-1,driver->fControlPort);
+	int32 code;
+
+	for(;;)
+	{
+		status_t err=link.GetNextReply(&code);
+		if(err==B_BAD_PORT_ID)
+			break;
+		if(err<B_OK)
+			continue;
+
+		if(code==HEADLESS_STOP)
+			break;
+
+		port_id replyport=-1;
+		if(link.Read<port_id>(&replyport)<B_OK)
+			continue;
+
+		BPortLink reply(replyport);
+
+		switch(code)
+		{
+			case HEADLESS_GET_FRAME_INFO:
+			{
+				driver->Lock();
+				reply.StartMessage(SERVER_TRUE);
+				reply.Attach<int32>(driver->fUpdateCount);
+				reply.Attach<int64>(driver->fUpdatedPixels);
+				reply.Attach<int32>(driver->fWidth);
+				reply.Attach<int32>(driver->fHeight);
+				reply.Attach<int32>(driver->fSpace);
+				driver->Unlock();
+				break;
+			}
+			case HEADLESS_DUMP_FRAME:
+			{
+				char *path=NULL;
+
+				if(link.ReadString(&path)==B_OK && driver->DumpToFile(path))
+					reply.StartMessage(SERVER_TRUE);
+				else
+					reply.StartMessage(SERVER_FALSE);
+
+				if(path)
+					free(path);
+				break;
+			}
+			default:
+			{
+				STRACE(("HeadlessDriver: unexpected control code %lx\n",code));
+				reply.StartMessage(SERVER_FALSE);
+				break;
+			}
+		}
+
+		reply.Flush();
+	}
+
+	return 0;
+}
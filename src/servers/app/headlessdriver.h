@@ -0,0 +1,63 @@
+//------------------------------------------------------------------------------
+//	File Name:		HeadlessDriver.h
+//	Description:	Display driver which renders into memory only, for
+//					benchmarking and testing on machines without a display
+//
+//------------------------------------------------------------------------------
+
+#ifndef __HEADLESSDRIVER_H__
+#define __HEADLESSDRIVER_H__
+
+#include "BitmapDriver.h"
+
+class UtilityBitmap;
+
+/*!
+	\class HeadlessDriver headlessdriver.h
+	\brief Driver which draws into a framebuffer nobody looks at
+
+	The framebuffer is an ordinary UtilityBitmap of any size and of any depth
+	BitmapDriver can draw on. There is no input device: input comes from a
+	HeadlessInjector, which posts to the input port just like the Input Server.
+	The driver itself listens on HEADLESS_CONTROL_PORT_NAME so a test can ask
+	how many updates were made and have the frame saved as a PNG.
+*/
+class HeadlessDriver : public BitmapDriver
+{
+public:
+					HeadlessDriver(int32 width=800, int32 height=600,
+						color_space space=B_RGB32);
+	virtual			~HeadlessDriver();
+
+	virtual bool	Initialize();
+	virtual void	Shutdown();
+
+	virtual bool	DumpToFile(const char *path);
+	virtual ServerBitmap *DumpToBitmap(void);
+
+	int32			UpdateCount(void) const { return fUpdateCount; }
+	int64			UpdatedPixels(void) const { return fUpdatedPixels; }
+
+	static bool		ParseMode(const char *string, int32 *width, int32 *height,
+						color_space *space);
+
+protected:
+	virtual void	Invalidate(const BRect &r);
+
+private:
+	static int32	ControlThread(void *data);
+
+	int32			fWidth;
+	int32			fHeight;
+	color_space		fSpace;
+
+	UtilityBitmap	*fFramebuffer;
+
+	int32			fUpdateCount;
+	int64			fUpdatedPixels;
+
+	port_id			fControlPort;
+	thread_id		fControlThread;
+};
+
+#endif // __HEADLESSDRIVER_H__
@@ -256,6 +256,8 @@ bool SDLDriver::Initialize(void)
 	
 	SDL_ShowCursor(0);
 
+	StartPresenting();
+
 	return true;
 }
 
@@ -268,6 +270,7 @@ bool SDLDriver::Initialize(void)
 void SDLDriver::Shutdown( void )
 {
 	STRACE( "SDLDriver::Close()\n" );
+	StopPresenting();
 	SDL_Quit();
 }
 
@@ -303,18 +306,26 @@ void SDLDriver::InvertRect(const BRect &r)
 // TODO: determine why we may need the DrawData parameter
 void SDLDriver::Blit(const BRect &src, const BRect &dest, const DrawData *d)
 {
-	SDL_Rect source, destination;
-	bool success;
-	
 	STRACE("SDLDriver::Blit()\n");
 	
-	RectToSDLRect(src, source);
-	RectToSDLRect(dest, destination);
+	// SDL_BlitSurface() doesn't handle the source and destination
+	// overlapping, which they do whenever something is scrolled
+	if (SDL_MUSTLOCK(mScreen))
+	{
+		if (SDL_LockSurface(mScreen) < 0)
+			return;
+	}
 	
-	success = (SDL_BlitSurface(mScreen, &source, mScreen, &destination) == 0);
+	BitmapDriver::Blit(src, dest, d);
 	
-	if (success)
-		InvalidateSDL(destination);
+	if (SDL_MUSTLOCK(mScreen))
+	{
+		SDL_UnlockSurface(mScreen);
+	}
+	
+	BRect destrect(src);
+	destrect.OffsetTo(dest.left, dest.top);
+	Invalidate(destrect);
 }
 
 
@@ -322,17 +333,23 @@ void SDLDriver::FillSolidRect(const BRect &r, const RGBColor &color)
 {
 	STRACE("SDLDriver::FillSolidRect()\n");
 
-	rgb_color col=color.GetColor32();
-	Uint32	aColor = SDL_MapRGB(mScreen->format, col.red, col.green, col.blue);
-	SDL_Rect aRect;
-	bool success;
-
-	RectToSDLRect(r, aRect);
+	// Lock the screen, if necessary, so we can safely play
+	// with the underlying pixels.
+	if (SDL_MUSTLOCK(mScreen))
+	{
+		if (SDL_LockSurface(mScreen) < 0)
+			return;
+	}
 	
-	success = (SDL_FillRect(mScreen, &aRect, aColor) == 0);
-
-	if (success)
-		InvalidateSDL(aRect);
+	BitmapDriver::FillSolidRect(r, color);
+	
+	// Unlock the screen if we locked it
+	if (SDL_MUSTLOCK(mScreen))
+	{
+		SDL_UnlockSurface(mScreen);
+	}
+	
+	Invalidate(r);
 }
 
 
@@ -539,27 +556,41 @@ void SDLDriver::CopyBitmap(ServerBitmap *bitmap, const BRect &sourcerect, const
 
 
 /*!
-	\brief Refresh the SDL bitmap with the contents of the ServerBitmap
+	\brief Marks a part of the SDL bitmap to be refreshed with the next frame
 	\param r      The BRect rectangle to refresh
 */
 void SDLDriver::Invalidate(const BRect &r)
 {
-	SDL_Rect aRect;
-	BRect damage(r & fTarget->Bounds());
-	RectToSDLRect(damage, aRect);
+	AddDamage(r);
+}
 
-	InvalidateSDL(aRect);
+
+/*!
+	\brief Marks a part of the SDL bitmap to be refreshed with the next frame
+	\param r      The SDL_Rect rectangle to refresh
+*/
+void SDLDriver::InvalidateSDL(const SDL_Rect &r)
+{
+	AddDamage(BRect(r.x, r.y, r.x + r.w - 1, r.y + r.h - 1));
 }
 
 
 /*!
 	\brief Refresh the SDL bitmap with the contents of the ServerBitmap
-	\param r      The BRect rectangle to refresh
+	\param damage The parts of the bitmap to refresh
 */
-void SDLDriver::InvalidateSDL(const SDL_Rect &r)
+void SDLDriver::Present(BRegion &damage)
 {
+	SDL_Rect rects[PRESENT_MAX_RECTS];
+	int32 count = damage.CountRects();
+	if (count > PRESENT_MAX_RECTS)
+		count = PRESENT_MAX_RECTS;
+
+	for (int32 i = 0; i < count; i++)
+		RectToSDLRect(damage.RectAt(i), rects[i]);
+
 	acquire_sem(drawsem);
-	SDL_UpdateRect(mScreen, r.x, r.y, r.w, r.h);
+	SDL_UpdateRects(mScreen, count, rects);
 	release_sem(drawsem);
 }
 
@@ -58,6 +58,7 @@ private:
 	// This is for drivers which are internally double buffered and calling this will cause the real
 	// framebuffer to be updated
 	virtual void Invalidate(const BRect &r);
+	virtual void Present(BRegion &damage);
 	void InvalidateSDL(const SDL_Rect &r);
 	
 	void DrawPixel(int x, int y, uint32 color);
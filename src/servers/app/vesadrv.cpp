@@ -34,6 +34,7 @@
 
 #include "vesadrv.h"
 #include "ServerFont.h"
+#include "SpanKernels.h"
 
 #define DEBUG_VESA_DRIVER
 
@@ -1303,90 +1304,11 @@ static void invert_line32( ServerBitmap* pcBitmap, const IRect& cClip,
 // SEE ALSO:
 //----------------------------------------------------------------------------
 
-static inline void Blit( uint8 *Src, uint8* Dst, int SMod, int DMod, int W, int H, bool Rev )
-{
-	int          i;
-	int           X,Y;
-	uint32* LSrc;
-	uint32* LDst;
-
-	if (Rev)
-	{
-		for ( Y = 0 ; Y < H ; Y++ )
-		{
-			for( X = 0 ; (X < W) && ((uint32(Src - 3)) & 3) ; X++ ) {
-				*Dst-- = *Src--;
-			}
-
-			LSrc=(uint32*)(((uint32)Src)-3);
-			LDst=(uint32*)(((uint32)Dst)-3);
-
-			i = (W - X) / 4;
-
-			X += i * 4;
-
-			for ( ; i ; i-- ) {
-				*LDst--=*LSrc--;
-			}
-
-			Src=(uint8*)(((uint32)LSrc)+3);
-			Dst=(uint8*)(((uint32)LDst)+3);
-
-			for ( ; X < W ; X++ ) {
-				*Dst--=*Src--;
-			}
-
-			Dst-= (int32)DMod;
-			Src-= (int32)SMod;
-		}
-	}
-	else
-	{
-		for ( Y = 0 ; Y < H ; Y++ )
-		{
-			for ( X = 0 ; (X < W) && (((uint32)Src) & 3) ; ++X ) {
-				*Dst++ = *Src++;
-			}
-
-			LSrc = (uint32*) Src;
-			LDst = (uint32*) Dst;
-
-			i = (W - X) / 4;
-
-			X += i * 4;
-
-			for( ; i ; i-- ) {
-				*LDst++ = *LSrc++;
-			}
-
-			Src        =        (uint8*) LSrc;
-			Dst        =        (uint8*) LDst;
-
-			for ( ; X < W ; X++ ) {
-				*Dst++=*Src++;
-			}
-
-			Dst += DMod;
-			Src += SMod;
-		}
-	}
-}
-
-//----------------------------------------------------------------------------
-// NAME:
-// DESC:
-// NOTE:
-// SEE ALSO:
-//----------------------------------------------------------------------------
-
 static inline void BitBlit( ServerBitmap *sbm, ServerBitmap *dbm,
                             int sx, int sy, int dx, int dy, int w, int h )
 {
-	int        Smod,Dmod;
 	int        BytesPerPix = 1;
 
-	int        InPtr,OutPtr;
-
 	int nBitsPerPix = BitsPerPixel( dbm->ColorSpace() );
 
 	if ( nBitsPerPix == 15 ) {
@@ -1395,49 +1317,14 @@ static inline void BitBlit( ServerBitmap *sbm, ServerBitmap *dbm,
 		BytesPerPix = nBitsPerPix / 8;
 	}
 
-	sx *= BytesPerPix;
-	dx *= BytesPerPix;
-	w  *= BytesPerPix;
+	uint8* pSrc = sbm->Bits() + sy * sbm->BytesPerRow() + sx * BytesPerPix;
+	uint8* pDst = dbm->Bits() + dy * dbm->BytesPerRow() + dx * BytesPerPix;
 
-	if ( sx >= dx )
-	{
-		if ( sy >= dy )
-		{
-			Smod = sbm->BytesPerRow() - w;
-			Dmod = dbm->BytesPerRow() - w;
-			InPtr  = sy * sbm->BytesPerRow() + sx;
-			OutPtr = dy * dbm->BytesPerRow() + dx;
-
-			Blit( sbm->Bits() + InPtr, dbm->Bits() + OutPtr, Smod, Dmod, w, h, false );
-		}
-		else
-		{
-			Smod        =-sbm->BytesPerRow() - w;
-			Dmod        =-dbm->BytesPerRow() - w;
-			InPtr       = ((sy+h-1)*sbm->BytesPerRow())+sx;
-			OutPtr      = ((dy+h-1)*dbm->BytesPerRow())+dx;
-
-			Blit( sbm->Bits() + InPtr, dbm->Bits() + OutPtr, Smod, Dmod, w, h, false );
-		}
-	}
-	else
-	{
-		if ( sy > dy )
-		{
-			Smod=-(sbm->BytesPerRow() + w);
-			Dmod=-(dbm->BytesPerRow() + w);
-			InPtr                = (sy*sbm->BytesPerRow())+sx+w-1;
-			OutPtr        = (dy*dbm->BytesPerRow())+dx+w-1;
-			Blit( sbm->Bits() + InPtr, dbm->Bits() + OutPtr, Smod, Dmod, w, h, true );
-		}
-		else
-		{
-			Smod = sbm->BytesPerRow() - w;
-			Dmod = dbm->BytesPerRow() - w;
-			InPtr                = (sy + h - 1) * sbm->BytesPerRow() + sx + w - 1;
-			OutPtr        = (dy + h - 1) * dbm->BytesPerRow() + dx + w - 1;
-			Blit( sbm->Bits() + InPtr, dbm->Bits() + OutPtr, Smod, Dmod, w, h, true );
-		}
+	// Within one bitmap the rectangles may overlap
+	if ( sbm->Bits() == dbm->Bits() ) {
+		rect_move( pDst, pSrc, dbm->BytesPerRow(), w * BytesPerPix, h );
+	} else {
+		rect_copy( pDst, dbm->BytesPerRow(), pSrc, sbm->BytesPerRow(), w * BytesPerPix, h );
 	}
 }
 
@@ -2021,16 +1908,7 @@ void VesaDriver::HideCursor(void)
 
 void VesaDriver::FillBlit8( uint8* pDst, int nMod, int W,int H, int nColor )
 {
-	int X,Y;
-
-	for ( Y = 0 ; Y < H ; Y++ )
-	{
-		for ( X = 0 ; X < W ; X++ )
-		{
-			*pDst++ = nColor;
-		}
-		pDst += nMod;
-	}
+	rect_fill( pDst, W + nMod, W, H, nColor, 1 );
 }
 
 //----------------------------------------------------------------------------
@@ -2042,16 +1920,7 @@ void VesaDriver::FillBlit8( uint8* pDst, int nMod, int W,int H, int nColor )
 
 void VesaDriver::FillBlit16( uint16 *pDst, int nMod, int W, int H, uint32 nColor )
 {
-	int X,Y;
-
-	for ( Y = 0 ; Y < H ; Y++ )
-	{
-		for ( X = 0 ; X < W ; X++ )
-		{
-			*pDst++ = nColor;
-		}
-		pDst += nMod;
-	}
+	rect_fill( (uint8*) pDst, (W + nMod) * 2, W, H, nColor, 2 );
 }
 
 //----------------------------------------------------------------------------
@@ -2086,16 +1955,7 @@ void VesaDriver::FillBlit24( uint8* pDst, int nMod, int W, int H, uint32 nColor
 
 void VesaDriver::FillBlit32( uint32 *pDst, int nMod, int W, int H, uint32 nColor )
 {
-	int X,Y;
-
-	for ( Y = 0 ; Y < H ; Y++ )
-	{
-		for ( X = 0 ; X < W ; X++ )
-		{
-			*pDst++ = nColor;
-		}
-		pDst += nMod;
-	}
+	rect_fill( (uint8*) pDst, (W + nMod) * 4, W, H, nColor, 4 );
 }
 
 bool VesaDriver::ClipLine( const IRect& cRect, int* x1, int* y1, int* x2, int* y2 )
@@ -69,12 +69,23 @@ X11Driver::X11Driver(void) : BitmapDriver()
 	STRACE("X11Driver::X11Driver\n");
 
 	drawsem = create_sem(1, "X11 draw semaphore");
+
+	use_shm = false;
 }
 
 
 X11Driver::~X11Driver()
 {
 	STRACE("X11Driver::~X11Driver\n");
+
+	StopPresenting();
+
+	if (use_shm)
+	{
+		XShmDetach(display, &shm_info);
+		shmdt(shm_info.shmaddr);
+	}
+
 	delete serverlink;
 }
 
@@ -257,12 +268,19 @@ bool X11Driver::Initialize(void)
 	target = new UtilityBitmap(BRect(0, 0,
 								X11DRIVER_WIDTH - 1, X11DRIVER_HEIGHT - 1),
 								B_RGBA32, 0);
+
+	// With MIT-SHM, the X server reads the pixels straight out of the
+	// target instead of having them sent down the socket
+	use_shm = InitShm(target);
+	STRACE(use_shm ? "using MIT-SHM\n" : "not using MIT-SHM\n");
+
 	SetTarget(target);
 
 	STRACE("passed SetTarget()\n");
 
 	// Then we point XCreateImage at the UtilityBitmap's bits
-	ximage = XCreateImage (display, CopyFromParent, depth, ZPixmap, 0,
+	if (!use_shm)
+		ximage = XCreateImage (display, CopyFromParent, depth, ZPixmap, 0,
 						(char*)target->Bits(), X11DRIVER_WIDTH, X11DRIVER_HEIGHT,
 						X11DRIVER_DEPTH, X11DRIVER_WIDTH * 4);
 
@@ -272,6 +290,70 @@ bool X11Driver::Initialize(void)
 				X11DRIVER_WIDTH, X11DRIVER_HEIGHT);
 	XFlush(display);
 
+	StartPresenting();
+
+	return true;
+}
+
+
+/*!
+	\brief Makes a shared memory XImage and has the target draw into it
+	\param target The bitmap which is about to become the target
+	\return true if the X server shares the image, false if it has to be
+	sent the pixels the old way
+
+	Shared memory only works with a server on this machine, so it is not tried
+	for displays reached over the network.
+*/
+bool X11Driver::InitShm(UtilityBitmap *target)
+{
+	const char *name = DisplayString(display);
+	if (!name || name[0] != ':' || !XShmQueryExtension(display))
+		return false;
+
+	ximage = XShmCreateImage(display, DefaultVisual(display, screen), depth,
+						ZPixmap, NULL, &shm_info, X11DRIVER_WIDTH, X11DRIVER_HEIGHT);
+	if (!ximage)
+		return false;
+
+	if (ximage->bytes_per_line != target->BytesPerRow() ||
+		ximage->bits_per_pixel != X11DRIVER_DEPTH)
+	{
+		XDestroyImage(ximage);
+		ximage = NULL;
+		return false;
+	}
+
+	shm_info.shmid = shmget(IPC_PRIVATE, target->BitsLength(), IPC_CREAT | 0600);
+	if (shm_info.shmid < 0)
+	{
+		XDestroyImage(ximage);
+		ximage = NULL;
+		return false;
+	}
+
+	shm_info.shmaddr = ximage->data = (char*)shmat(shm_info.shmid, NULL, 0);
+	shm_info.readOnly = False;
+
+	if (shm_info.shmaddr == (char*)-1 || !XShmAttach(display, &shm_info))
+	{
+		if (shm_info.shmaddr != (char*)-1)
+			shmdt(shm_info.shmaddr);
+		shmctl(shm_info.shmid, IPC_RMID, NULL);
+		ximage->data = NULL;
+		XDestroyImage(ximage);
+		ximage = NULL;
+		return false;
+	}
+
+	// Once both sides have it attached, the segment can be marked for removal
+	// so it goes away with the server, however it quits
+	XSync(display, False);
+	shmctl(shm_info.shmid, IPC_RMID, NULL);
+
+	memset(shm_info.shmaddr, 0, target->BitsLength());
+	target->_FreeBuffer();
+	target->_SetBuffer(shm_info.shmaddr);
 	return true;
 }
 
@@ -383,20 +465,37 @@ void X11Driver::CopyBitmap(ServerBitmap *bitmap, const BRect &sourcerect, const
 
 
 /*!
-	\brief Refresh the X11 window with the contents of the ServerBitmap
+	\brief Marks a part of the X11 window to be refreshed with the next frame
 	\param r      The BRect rectangle to refresh
 */
 void X11Driver::Invalidate(const BRect &r)
 {
-	BRect damage = (r & fTarget->Bounds());
+	AddDamage(r);
+}
+
+/*!
+	\brief Refresh the X11 window with the contents of the ServerBitmap
+	\param damage The parts of the window to refresh
+*/
+void X11Driver::Present(BRegion &damage)
+{
+	STRACE("X11Driver::Present()\n");
 
-	STRACE("X11Driver::Invalidate()\n");
-	
 	acquire_sem(drawsem);
-	XPutImage(display, xcanvas, image_gc, ximage, damage.left, damage.top,
-												  damage.left, damage.top,
-												  damage.IntegerWidth() + 1,
-												  damage.IntegerHeight() + 1);
+	for (int32 i = 0; i < damage.CountRects(); i++)
+	{
+		BRect r = damage.RectAt(i);
+
+		if (use_shm)
+			XShmPutImage(display, xcanvas, image_gc, ximage, (int)r.left, (int)r.top,
+						(int)r.left, (int)r.top, r.IntegerWidth() + 1,
+						r.IntegerHeight() + 1, False);
+		else
+			XPutImage(display, xcanvas, image_gc, ximage, (int)r.left, (int)r.top,
+						(int)r.left, (int)r.top, r.IntegerWidth() + 1,
+						r.IntegerHeight() + 1);
+	}
+	XFlush(display);
 	release_sem(drawsem);
 }
 
@@ -29,6 +29,8 @@
 #define __X11DRIVER_H__
 
 #include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #include "BitmapDriver.h"
 #include <PortLink.h>
@@ -38,11 +40,13 @@ namespace X11 {
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
 
 #undef ScreenCount
 };
 
 class PortLink;
+class UtilityBitmap;
 
 class X11Driver : public BitmapDriver
 {
@@ -68,8 +72,11 @@ private:
 	// This is for drivers which are internally double buffered and calling this will cause the real
 	// framebuffer to be updated
 	virtual void Invalidate(const BRect &r);
+	virtual void Present(BRegion &damage);
 	void DrawPixel(int x, int y, const RGBColor &color);
 
+	bool InitShm(UtilityBitmap *target);
+
 	int							screen;
 	int							depth;
 	unsigned long				window_mask;
@@ -83,6 +90,8 @@ private:
 	X11::XSetWindowAttributes	window_attributes;
 	X11::XSizeHints				window_hints;
 	X11::Pixmap					xpixmap;
+	X11::XShmSegmentInfo		shm_info;
+	bool						use_shm;
 
 	sem_id						drawsem;
 